@@ -0,0 +1,479 @@
+//***************************************************************************************
+// BindingBenchmark.cpp
+//***************************************************************************************
+
+#include "BindingBenchmark.h"
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+namespace
+{
+	// Indices of the root parameters; the CBV models have only the first.
+	const UINT ObjectRootParameter = 0;
+	const UINT ObjectsRootParameter = 1;
+
+	// Matches the command signature: the object index, then the draw.
+	struct IndirectCommand
+	{
+		UINT ObjectIndex;
+		D3D12_DRAW_ARGUMENTS Draw;
+	};
+
+	double Median(std::vector<double> samples)
+	{
+		if(samples.empty())
+			return 0.0;
+
+		size_t n = samples.size() / 2;
+		std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+		return samples[n];
+	}
+
+	ComPtr<ID3D12RootSignature> CreateRootSignature(ID3D12Device* device, const CD3DX12_ROOT_SIGNATURE_DESC& desc)
+	{
+		ComPtr<ID3DBlob> serializedRootSig = nullptr;
+		ComPtr<ID3DBlob> errorBlob = nullptr;
+		HRESULT hr = D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1,
+			serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+		if(errorBlob != nullptr)
+		{
+			::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+		}
+		ThrowIfFailed(hr);
+
+		ComPtr<ID3D12RootSignature> rootSignature;
+		ThrowIfFailed(device->CreateRootSignature(
+			0,
+			serializedRootSig->GetBufferPointer(),
+			serializedRootSig->GetBufferSize(),
+			IID_PPV_ARGS(rootSignature.GetAddressOf())));
+		return rootSignature;
+	}
+}
+
+const char* BindingBenchmark::ModelName(BindingModel model)
+{
+	switch(model)
+	{
+	case BindingModel::DescriptorTable: return "descriptor_table";
+	case BindingModel::RootCbv:         return "root_cbv";
+	case BindingModel::RootConstant:    return "root_constant";
+	case BindingModel::Bindless:        return "bindless";
+	case BindingModel::ExecuteIndirect: return "execute_indirect";
+	default:                            return "unknown";
+	}
+}
+
+BindingBenchmark::BindingBenchmark(ID3D12Device* device, ID3D12CommandQueue* queue, ShaderCache* shaders,
+	bool bindlessSupported)
+{
+	md3dDevice = device;
+	mQueue = queue;
+	mBindlessSupported = bindlessSupported;
+
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_DIRECT,
+		IID_PPV_ARGS(mCmdListAlloc.GetAddressOf())));
+
+	ThrowIfFailed(md3dDevice->CreateCommandList(
+		0,
+		D3D12_COMMAND_LIST_TYPE_DIRECT,
+		mCmdListAlloc.Get(),
+		nullptr,
+		IID_PPV_ARGS(mCommandList.GetAddressOf())));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	ThrowIfFailed(mQueue->GetTimestampFrequency(&mTimestampFrequency));
+
+	BuildRootSignatures();
+	BuildPsos(shaders);
+	BuildTarget();
+
+	// The list was created open; BuildScene resets it.
+	ThrowIfFailed(mCommandList->Close());
+}
+
+BindingBenchmark::~BindingBenchmark()
+{
+	if(mFenceEvent != nullptr)
+	{
+		// Every list is waited for as it is executed; this only covers a throw
+		// between the two.
+		if(mQueue->Signal(mFence.Get(), ++mCurrentFence) == S_OK &&
+			mFence->SetEventOnCompletion(mCurrentFence, mFenceEvent) == S_OK)
+			WaitForSingleObject(mFenceEvent, INFINITE);
+		CloseHandle(mFenceEvent);
+	}
+}
+
+std::vector<BindingBenchmarkResult> BindingBenchmark::Run(UINT objectCount, UINT frameCount)
+{
+	BuildScene(std::min(std::max(objectCount, 1u), MaxObjects));
+
+	std::vector<BindingBenchmarkResult> results;
+	for(int i = 0; i < (int)BindingModel::Count; ++i)
+	{
+		BindingModel model = (BindingModel)i;
+		if(model == BindingModel::Bindless && !mBindlessSupported)
+			continue;
+
+		// The first frame pays for first-use costs: paging the scene in, the
+		// driver's shader compile, and so on.
+		Record(model);
+		ExecuteAndWait();
+
+		std::vector<double> cpuMs;
+		std::vector<double> gpuMs;
+		for(UINT frame = 0; frame < frameCount; ++frame)
+		{
+			cpuMs.push_back(Record(model));
+			ExecuteAndWait();
+
+			UINT64* timestamps = nullptr;
+			CD3DX12_RANGE readRange(0, 2*sizeof(UINT64));
+			ThrowIfFailed(mTimestampReadback->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+			gpuMs.push_back(1000.0 * (double)(timestamps[1] - timestamps[0]) / (double)mTimestampFrequency);
+			CD3DX12_RANGE writeRange(0, 0);
+			mTimestampReadback->Unmap(0, &writeRange);
+		}
+
+		BindingBenchmarkResult result;
+		result.Model = model;
+		result.ObjectCount = mObjectCount;
+		result.CpuRecordMs = Median(cpuMs);
+		result.GpuMs = Median(gpuMs);
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+void BindingBenchmark::WriteResults(const std::vector<BindingBenchmarkResult>& results, const std::wstring& filename)
+{
+	std::ofstream fout(filename);
+	if(!fout)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
+
+	// cpu_record_ms: Reset to Close of the model's list.  gpu_ms: timestamps around
+	// its draws.  Both are medians over the measured frames.
+	fout << "model,objects,cpu_record_ms,gpu_ms,cpu_ms_per_1k,gpu_ms_per_1k\n";
+	for(const auto& r : results)
+	{
+		double thousands = r.ObjectCount / 1000.0;
+		fout << ModelName(r.Model) << "," << r.ObjectCount << "," << r.CpuRecordMs << "," << r.GpuMs << "," <<
+			r.CpuRecordMs / thousands << "," << r.GpuMs / thousands << "\n";
+	}
+}
+
+void BindingBenchmark::BuildRootSignatures()
+{
+	// A CBV descriptor table per draw, as Lab #4 bound its objects.
+	CD3DX12_DESCRIPTOR_RANGE cbvTable;
+	cbvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
+
+	CD3DX12_ROOT_PARAMETER tableParameters[1];
+	tableParameters[0].InitAsDescriptorTable(1, &cbvTable, D3D12_SHADER_VISIBILITY_VERTEX);
+	mRootSignatures[(int)BindingModel::DescriptorTable] = CreateRootSignature(md3dDevice,
+		CD3DX12_ROOT_SIGNATURE_DESC(_countof(tableParameters), tableParameters));
+
+	// A root CBV per draw, as the castle binds its objects' cbuffers.
+	CD3DX12_ROOT_PARAMETER cbvParameters[1];
+	cbvParameters[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	mRootSignatures[(int)BindingModel::RootCbv] = CreateRootSignature(md3dDevice,
+		CD3DX12_ROOT_SIGNATURE_DESC(_countof(cbvParameters), cbvParameters));
+
+	// The object index as a root constant, into a structured buffer that is bound
+	// once.  ExecuteIndirect writes the same constant from its arguments.
+	CD3DX12_ROOT_PARAMETER constantParameters[2];
+	constantParameters[ObjectRootParameter].InitAsConstants(1, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	constantParameters[ObjectsRootParameter].InitAsShaderResourceView(0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+	mRootSignatures[(int)BindingModel::RootConstant] = CreateRootSignature(md3dDevice,
+		CD3DX12_ROOT_SIGNATURE_DESC(_countof(constantParameters), constantParameters));
+	mRootSignatures[(int)BindingModel::ExecuteIndirect] = mRootSignatures[(int)BindingModel::RootConstant];
+
+	if(mBindlessSupported)
+	{
+		CD3DX12_DESCRIPTOR_RANGE bindlessTable;
+		bindlessTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, UINT_MAX, 0, 1, 0);
+
+		CD3DX12_ROOT_PARAMETER bindlessParameters[2];
+		bindlessParameters[ObjectRootParameter].InitAsConstants(1, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
+		bindlessParameters[ObjectsRootParameter].InitAsDescriptorTable(1, &bindlessTable, D3D12_SHADER_VISIBILITY_VERTEX);
+		mRootSignatures[(int)BindingModel::Bindless] = CreateRootSignature(md3dDevice,
+			CD3DX12_ROOT_SIGNATURE_DESC(_countof(bindlessParameters), bindlessParameters));
+	}
+
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[2] = {};
+	argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	argumentDescs[0].Constant.RootParameterIndex = ObjectRootParameter;
+	argumentDescs[0].Constant.DestOffsetIn32BitValues = 0;
+	argumentDescs[0].Constant.Num32BitValuesToSet = 1;
+	argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+
+	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+	commandSignatureDesc.pArgumentDescs = argumentDescs;
+	commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+	commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+
+	// The root signature is required because the commands change root arguments.
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&commandSignatureDesc,
+		mRootSignatures[(int)BindingModel::ExecuteIndirect].Get(), IID_PPV_ARGS(&mCommandSignature)));
+}
+
+void BindingBenchmark::BuildPsos(ShaderCache* shaders)
+{
+	const D3D_SHADER_MACRO cbvDefines[] = { "MODEL_CBV", "1", NULL, NULL };
+	const D3D_SHADER_MACRO bindlessDefines[] = { "MODEL_BINDLESS", "1", NULL, NULL };
+
+	const std::wstring filename = L"Shaders\\BindingBenchmark.hlsl";
+
+	for(int i = 0; i < (int)BindingModel::Count; ++i)
+	{
+		BindingModel model = (BindingModel)i;
+		if(model == BindingModel::Bindless && !mBindlessSupported)
+			continue;
+
+		const D3D_SHADER_MACRO* defines = nullptr;
+		if(model == BindingModel::DescriptorTable || model == BindingModel::RootCbv)
+			defines = cbvDefines;
+		else if(model == BindingModel::Bindless)
+			defines = bindlessDefines;
+
+		ComPtr<ID3DBlob> vs = shaders->Compile(filename, defines, "VS", "vs_5_1");
+		ComPtr<ID3DBlob> ps = shaders->Compile(filename, defines, "PS", "ps_5_1");
+
+		// No input layout: the triangle's corners come from SV_VertexID.
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+		psoDesc.pRootSignature = mRootSignatures[i].Get();
+		psoDesc.VS = { reinterpret_cast<BYTE*>(vs->GetBufferPointer()), vs->GetBufferSize() };
+		psoDesc.PS = { reinterpret_cast<BYTE*>(ps->GetBufferPointer()), ps->GetBufferSize() };
+		psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+		psoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+		psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+		psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+		psoDesc.DepthStencilState.DepthEnable = FALSE;
+		psoDesc.SampleMask = UINT_MAX;
+		psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+		psoDesc.NumRenderTargets = 1;
+		psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+		psoDesc.SampleDesc.Count = 1;
+		psoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&mPsos[i])));
+	}
+}
+
+void BindingBenchmark::BuildTarget()
+{
+	// Small, so fill rate stays out of the GPU times.
+	D3D12_CLEAR_VALUE clearValue = {};
+	clearValue.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, TargetSize, TargetSize, 1, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+		D3D12_RESOURCE_STATE_RENDER_TARGET,
+		&clearValue,
+		IID_PPV_ARGS(&mTarget)));
+
+	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
+	rtvHeapDesc.NumDescriptors = 1;
+	rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
+	md3dDevice->CreateRenderTargetView(mTarget.Get(), nullptr, mRtvHeap->GetCPUDescriptorHandleForHeapStart());
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = 2;
+	ThrowIfFailed(md3dDevice->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&mTimestamps)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(2*sizeof(UINT64)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mTimestampReadback)));
+}
+
+void BindingBenchmark::BuildScene(UINT objectCount)
+{
+	if(objectCount == mObjectCount)
+		return;
+
+	mObjectCount = objectCount;
+	mConstants = nullptr;
+	mObjects = nullptr;
+	mArguments = nullptr;
+	mCbvHeap = nullptr;
+
+	// The objects tile the target in a square grid, each a triangle a cell across.
+	UINT side = (UINT)std::ceil(std::sqrt((double)objectCount));
+	float cell = 2.0f / side;
+
+	const UINT cbByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(BenchmarkObject));
+	std::vector<std::uint8_t> constants((size_t)objectCount * cbByteSize);
+	std::vector<BenchmarkObject> objects(objectCount);
+	std::vector<IndirectCommand> arguments(objectCount);
+	for(UINT i = 0; i < objectCount; ++i)
+	{
+		BenchmarkObject& o = objects[i];
+		o.Offset = XMFLOAT2(-1.0f + (i % side + 0.5f)*cell, -1.0f + (i / side + 0.5f)*cell);
+		o.Scale = 0.5f*cell;
+		o.ObjectPad0 = 0.0f;
+		o.Color = XMFLOAT4((i & 0xff) / 255.0f, ((i >> 8) & 0xff) / 255.0f, ((i >> 16) & 0xff) / 255.0f, 1.0f);
+		memcpy(&constants[(size_t)i * cbByteSize], &o, sizeof(o));
+
+		arguments[i].ObjectIndex = i;
+		arguments[i].Draw = { 3, 1, 0, 0 };
+	}
+
+	ThrowIfFailed(mCmdListAlloc->Reset());
+	ThrowIfFailed(mCommandList->Reset(mCmdListAlloc.Get(), nullptr));
+
+	// Left in GENERIC_READ, which covers constant, shader resource and indirect
+	// argument reads.
+	ComPtr<ID3D12Resource> constantsUploader;
+	ComPtr<ID3D12Resource> objectsUploader;
+	ComPtr<ID3D12Resource> argumentsUploader;
+	mConstants = d3dUtil::CreateDefaultBuffer(md3dDevice, mCommandList.Get(),
+		constants.data(), constants.size(), constantsUploader);
+	mObjects = d3dUtil::CreateDefaultBuffer(md3dDevice, mCommandList.Get(),
+		objects.data(), (UINT64)objects.size() * sizeof(BenchmarkObject), objectsUploader);
+	mArguments = d3dUtil::CreateDefaultBuffer(md3dDevice, mCommandList.Get(),
+		arguments.data(), (UINT64)arguments.size() * sizeof(IndirectCommand), argumentsUploader);
+
+	ThrowIfFailed(mCommandList->Close());
+	ExecuteAndWait();
+
+	// One CBV per object, shared by the descriptor table and bindless models.
+	D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc = {};
+	cbvHeapDesc.NumDescriptors = objectCount;
+	cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&cbvHeapDesc, IID_PPV_ARGS(&mCbvHeap)));
+	mCbvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
+	D3D12_GPU_VIRTUAL_ADDRESS address = mConstants->GetGPUVirtualAddress();
+	for(UINT i = 0; i < objectCount; ++i)
+	{
+		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
+		cbvDesc.BufferLocation = address + (UINT64)i * cbByteSize;
+		cbvDesc.SizeInBytes = cbByteSize;
+		md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
+		handle.Offset(1, mCbvDescriptorSize);
+	}
+}
+
+double BindingBenchmark::Record(BindingModel model)
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER start;
+	LARGE_INTEGER end;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	ThrowIfFailed(mCmdListAlloc->Reset());
+	ThrowIfFailed(mCommandList->Reset(mCmdListAlloc.Get(), mPsos[(int)model].Get()));
+
+	D3D12_VIEWPORT viewport = { 0.0f, 0.0f, (float)TargetSize, (float)TargetSize, 0.0f, 1.0f };
+	D3D12_RECT scissorRect = { 0, 0, (LONG)TargetSize, (LONG)TargetSize };
+	mCommandList->RSSetViewports(1, &viewport);
+	mCommandList->RSSetScissorRects(1, &scissorRect);
+
+	D3D12_CPU_DESCRIPTOR_HANDLE rtv = mRtvHeap->GetCPUDescriptorHandleForHeapStart();
+	mCommandList->ClearRenderTargetView(rtv, Colors::Black, 0, nullptr);
+	mCommandList->OMSetRenderTargets(1, &rtv, true, nullptr);
+	mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	mCommandList->EndQuery(mTimestamps.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0);
+	RecordDraws(model);
+	mCommandList->EndQuery(mTimestamps.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 1);
+	mCommandList->ResolveQueryData(mTimestamps.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0, 2, mTimestampReadback.Get(), 0);
+
+	ThrowIfFailed(mCommandList->Close());
+
+	QueryPerformanceCounter(&end);
+	return 1000.0 * (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+}
+
+void BindingBenchmark::RecordDraws(BindingModel model)
+{
+	ID3D12GraphicsCommandList* cmdList = mCommandList.Get();
+	cmdList->SetGraphicsRootSignature(mRootSignatures[(int)model].Get());
+
+	if(model == BindingModel::DescriptorTable || model == BindingModel::Bindless)
+	{
+		ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvHeap.Get() };
+		cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+	}
+
+	switch(model)
+	{
+	case BindingModel::DescriptorTable:
+	{
+		CD3DX12_GPU_DESCRIPTOR_HANDLE cbv(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+		for(UINT i = 0; i < mObjectCount; ++i)
+		{
+			cmdList->SetGraphicsRootDescriptorTable(ObjectRootParameter, cbv);
+			cmdList->DrawInstanced(3, 1, 0, 0);
+			cbv.Offset(1, mCbvDescriptorSize);
+		}
+		break;
+	}
+	case BindingModel::RootCbv:
+	{
+		const UINT cbByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(BenchmarkObject));
+		D3D12_GPU_VIRTUAL_ADDRESS address = mConstants->GetGPUVirtualAddress();
+		for(UINT i = 0; i < mObjectCount; ++i)
+		{
+			cmdList->SetGraphicsRootConstantBufferView(ObjectRootParameter, address + (UINT64)i * cbByteSize);
+			cmdList->DrawInstanced(3, 1, 0, 0);
+		}
+		break;
+	}
+	case BindingModel::RootConstant:
+	case BindingModel::Bindless:
+	{
+		if(model == BindingModel::Bindless)
+			cmdList->SetGraphicsRootDescriptorTable(ObjectsRootParameter, mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+		else
+			cmdList->SetGraphicsRootShaderResourceView(ObjectsRootParameter, mObjects->GetGPUVirtualAddress());
+
+		for(UINT i = 0; i < mObjectCount; ++i)
+		{
+			cmdList->SetGraphicsRoot32BitConstant(ObjectRootParameter, i, 0);
+			cmdList->DrawInstanced(3, 1, 0, 0);
+		}
+		break;
+	}
+	case BindingModel::ExecuteIndirect:
+		cmdList->SetGraphicsRootShaderResourceView(ObjectsRootParameter, mObjects->GetGPUVirtualAddress());
+		cmdList->ExecuteIndirect(mCommandSignature.Get(), mObjectCount, mArguments.Get(), 0, nullptr, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+void BindingBenchmark::ExecuteAndWait()
+{
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	ThrowIfFailed(mQueue->Signal(mFence.Get(), ++mCurrentFence));
+	if(mFence->GetCompletedValue() < mCurrentFence)
+	{
+		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, mFenceEvent));
+		WaitForSingleObject(mFenceEvent, INFINITE);
+	}
+}
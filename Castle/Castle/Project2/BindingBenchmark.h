@@ -0,0 +1,130 @@
+//***************************************************************************************
+// BindingBenchmark.h
+//
+// Measures what each way of handing a draw its constants costs, on a synthetic scene
+// of one tiny triangle per object, so the rasterizer does next to nothing and the
+// numbers are dominated by per-draw binding.  The models are those the labs and the
+// castle have used:
+//   DescriptorTable  a CBV descriptor per object, a table set per draw (Lab #4).
+//   RootCbv          a root CBV per draw into 256-byte constants (the castle's
+//                    cbuffer mode).
+//   RootConstant     the object index as a root constant into a structured buffer
+//                    (the castle's structured constants mode).
+//   Bindless         the object index as a root constant into one unbounded CBV
+//                    table, set once.  Unbounded CBV ranges need resource binding
+//                    tier 3.
+//   ExecuteIndirect  the index and draw arguments of every object in one buffer,
+//                    submitted by a single ExecuteIndirect.
+//
+// Each model records its draws into a list of its own, which is timed on the CPU
+// from Reset to Close and on the GPU by timestamps around the draws.  The list is
+// executed and waited for before the next, so the GPU times do not overlap.
+//***************************************************************************************
+
+#ifndef BINDINGBENCHMARK_H
+#define BINDINGBENCHMARK_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/ShaderCache.h"
+
+enum class BindingModel : int
+{
+	DescriptorTable = 0,
+	RootCbv,
+	RootConstant,
+	Bindless,
+	ExecuteIndirect,
+	Count
+};
+
+// Must match ObjectData in BindingBenchmark.hlsl.
+struct BenchmarkObject
+{
+	DirectX::XMFLOAT2 Offset;
+	float Scale;
+	float ObjectPad0;
+	DirectX::XMFLOAT4 Color;
+};
+
+struct BindingBenchmarkResult
+{
+	BindingModel Model = BindingModel::DescriptorTable;
+	UINT ObjectCount = 0;
+	// Medians over the measured frames.
+	double CpuRecordMs = 0.0;
+	double GpuMs = 0.0;
+};
+
+class BindingBenchmark
+{
+public:
+	// The most objects a run may draw: one CBV descriptor each must fit in a
+	// shader-visible heap at every binding tier.
+	static const UINT MaxObjects = D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1;
+
+	static const char* ModelName(BindingModel model);
+
+	// Compiles the shaders through shaders and builds the root signatures and PSOs.
+	// Bindless is skipped where bindlessSupported is false.
+	BindingBenchmark(ID3D12Device* device, ID3D12CommandQueue* queue, ShaderCache* shaders,
+		bool bindlessSupported);
+	BindingBenchmark(const BindingBenchmark& rhs) = delete;
+	BindingBenchmark& operator=(const BindingBenchmark& rhs) = delete;
+	~BindingBenchmark();
+
+	// Builds a scene of objectCount objects, at most MaxObjects, and draws it under
+	// every supported model, a warm-up frame and then frameCount measured frames each.
+	std::vector<BindingBenchmarkResult> Run(UINT objectCount, UINT frameCount);
+
+	// One row per result: model, objects, CPU record and GPU milliseconds, and both
+	// per thousand objects.
+	static void WriteResults(const std::vector<BindingBenchmarkResult>& results, const std::wstring& filename);
+
+private:
+	void BuildRootSignatures();
+	void BuildPsos(ShaderCache* shaders);
+	void BuildTarget();
+	void BuildScene(UINT objectCount);
+
+	// Records one frame of model into mCommandList, returning the CPU milliseconds.
+	double Record(BindingModel model);
+	void RecordDraws(BindingModel model);
+
+	// Executes mCommandList and blocks until it is done.
+	void ExecuteAndWait();
+
+private:
+	static const UINT TargetSize = 256;
+
+	ID3D12Device* md3dDevice = nullptr;
+	ID3D12CommandQueue* mQueue = nullptr;
+	bool mBindlessSupported = false;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCmdListAlloc;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	UINT64 mCurrentFence = 0;
+	HANDLE mFenceEvent = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignatures[(int)BindingModel::Count];
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> mPsos[(int)BindingModel::Count];
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> mCommandSignature;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mTarget;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mRtvHeap;
+
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mTimestamps;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mTimestampReadback;
+	UINT64 mTimestampFrequency = 0;
+
+	// The scene: each object's constants padded to 256 bytes for CBVs and packed for
+	// the structured buffer, a CBV descriptor per object, and the indirect arguments.
+	UINT mObjectCount = 0;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mConstants;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mObjects;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mArguments;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mCbvHeap;
+	UINT mCbvDescriptorSize = 0;
+};
+
+#endif // BINDINGBENCHMARK_H
@@ -0,0 +1,347 @@
+//***************************************************************************************
+// CascadedShadowMaps.cpp
+//***************************************************************************************
+
+#include "CascadedShadowMaps.h"
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+// Weight of the logarithmic splits against uniform ones.  Logarithmic splits give
+// every cascade the same texels per pixel but leave the near one tiny.
+static const float gSplitLambda = 0.75f;
+
+// Extra radius a static map is fitted with, so the camera can move a little before
+// its slice leaves the map and it has to be redrawn.
+static const float gCacheMargin = 0.25f;
+
+// Cosine of the angle the light may turn before the cached maps are redrawn.
+static const float gLightTurnCos = 0.99995f;
+
+CascadedShadowMaps::CascadedShadowMaps(ID3D12Device* device, UINT staticSize, UINT dynamicSize)
+{
+	md3dDevice = device;
+	mStaticSize = staticSize;
+	mDynamicSize = dynamicSize;
+
+	BuildResource(mStaticSize, CascadeCount, mStaticMaps);
+	BuildResource(mDynamicSize, DynamicCascadeCount, mDynamicMaps);
+}
+
+CascadedShadowMaps::~CascadedShadowMaps()
+{
+}
+
+void CascadedShadowMaps::SetCasterState(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	desc.NumRenderTargets = 0;
+	desc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+	desc.BlendState.RenderTarget[0].RenderTargetWriteMask = 0;
+	desc.DSVFormat = DepthFormat;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+
+	// Blended casters too write depth.
+	desc.DepthStencilState.DepthEnable = true;
+	desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+	desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+
+	// The constant bias is in units of the float depth's precision near the
+	// primitive, so it scales with depth; the slope term covers surfaces seen
+	// edge on by the light.
+	desc.RasterizerState.DepthBias = 1000;
+	desc.RasterizerState.DepthBiasClamp = 0.0f;
+	desc.RasterizerState.SlopeScaledDepthBias = 1.5f;
+
+	// Casters in front of the near plane are clamped onto it rather than lost.
+	desc.RasterizerState.DepthClipEnable = false;
+}
+
+void CascadedShadowMaps::BuildResource(UINT size, UINT slices, ComPtr<ID3D12Resource>& resource)
+{
+	D3D12_CLEAR_VALUE optClear;
+	optClear.Format = DepthFormat;
+	optClear.DepthStencil.Depth = 1.0f;
+	optClear.DepthStencil.Stencil = 0;
+
+	// Typeless, to be viewed as depth and as R32_FLOAT.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_TYPELESS, size, size, (UINT16)slices, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL),
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+		&optClear,
+		IID_PPV_ARGS(resource.ReleaseAndGetAddressOf())));
+}
+
+void CascadedShadowMaps::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+	UINT srvDescriptorSize,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+	UINT dsvDescriptorSize)
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = CascadeCount;
+	md3dDevice->CreateShaderResourceView(mStaticMaps.Get(), &srvDesc, hCpuSrv);
+
+	srvDesc.Texture2DArray.ArraySize = DynamicCascadeCount;
+	md3dDevice->CreateShaderResourceView(mDynamicMaps.Get(), &srvDesc, hCpuSrv.Offset(1, srvDescriptorSize));
+
+	mSrvs = hGpuSrv;
+	mDsvs = hCpuDsv;
+	mDsvDescriptorSize = dsvDescriptorSize;
+
+	// One view per slice, the static maps' first.
+	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DepthFormat;
+	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+	dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
+	dsvDesc.Texture2DArray.MipSlice = 0;
+	dsvDesc.Texture2DArray.ArraySize = 1;
+	for(UINT i = 0; i < DsvCount; ++i)
+	{
+		bool dynamic = i >= CascadeCount;
+		dsvDesc.Texture2DArray.FirstArraySlice = dynamic ? i - CascadeCount : i;
+		md3dDevice->CreateDepthStencilView(dynamic ? mDynamicMaps.Get() : mStaticMaps.Get(), &dsvDesc,
+			CD3DX12_CPU_DESCRIPTOR_HANDLE(mDsvs, i, mDsvDescriptorSize));
+	}
+}
+
+void CascadedShadowMaps::Update(const XMFLOAT4X4& view, const XMFLOAT4X4& proj,
+	float nearZ, float shadowDistance, const XMFLOAT3& lightDir, float casterReach)
+{
+	XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&lightDir));
+
+	// Every cached map was drawn from the old direction.
+	if(mInvalidated || XMVectorGetX(XMVector3Dot(dir, XMLoadFloat3(&mLightDir))) < gLightTurnCos)
+	{
+		XMStoreFloat3(&mLightDir, dir);
+
+		// A light straight down is parallel to the usual up vector.
+		XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		XMStoreFloat4x4(&mLightView, XMMatrixLookToLH(XMVectorZero(), dir, up));
+
+		for(auto& cascade : mCascades)
+			cascade.Radius = 0.0f;
+		mInvalidated = false;
+	}
+
+	for(UINT i = 0; i < CascadeCount; ++i)
+	{
+		float f = (float)(i + 1) / CascadeCount;
+		float logSplit = nearZ*powf(shadowDistance / nearZ, f);
+		float uniformSplit = nearZ + (shadowDistance - nearZ)*f;
+		mSplits[i] = gSplitLambda*logSplit + (1.0f - gSplitLambda)*uniformSplit;
+	}
+
+	XMMATRIX toLight = MathHelper::InverseRigid(XMLoadFloat4x4(&view)) * XMLoadFloat4x4(&mLightView);
+
+	// Distance from the view axis of a frustum corner at unit depth; proj(0,0) and
+	// proj(1,1) are the cotangents of the half fields of view.
+	float cornerScale = sqrtf(1.0f / (proj(0, 0)*proj(0, 0)) + 1.0f / (proj(1, 1)*proj(1, 1)));
+
+	float sliceNear = nearZ;
+	for(UINT i = 0; i < CascadeCount; ++i)
+	{
+		float sliceFar = mSplits[i];
+
+		// The smallest sphere through the corners of both ends of the slice, centered
+		// on the view axis.  It depends only on the projection, so its size stays put
+		// as the camera turns.
+		float nearRadius = sliceNear*cornerScale;
+		float farRadius = sliceFar*cornerScale;
+		float center = (sliceFar*sliceFar + farRadius*farRadius - sliceNear*sliceNear - nearRadius*nearRadius) /
+			(2.0f*(sliceFar - sliceNear));
+		center = std::min(center, sliceFar);
+		float radius = sqrtf((sliceFar - center)*(sliceFar - center) + farRadius*farRadius);
+
+		XMVECTOR centerL = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, center, 1.0f), toLight);
+
+		// Reuse the cached map while the slice is still inside it and the map is
+		// not too coarse for it, as after the window grew narrower.
+		Cascade& cascade = mCascades[i];
+		float fittedRadius = radius*(1.0f + gCacheMargin);
+		cascade.Stale = cascade.Radius == 0.0f ||
+			fabsf(cascade.Radius - fittedRadius) > 0.01f*fittedRadius ||
+			XMVectorGetX(XMVector3Length(centerL - XMLoadFloat3(&cascade.CenterL))) + radius > cascade.Radius;
+
+		if(cascade.Stale)
+		{
+			Fit(i, centerL, fittedRadius, casterReach);
+			++mRedrawCount;
+		}
+
+		sliceNear = sliceFar;
+	}
+}
+
+void CascadedShadowMaps::Fit(UINT cascadeIndex, FXMVECTOR centerL, float radius, float casterReach)
+{
+	Cascade& cascade = mCascades[cascadeIndex];
+
+	// On whole texels, so a refitted map samples the scene at the same points as the
+	// one before and shadow edges do not crawl.
+	float texel = 2.0f*radius / mStaticSize;
+	XMFLOAT3 c;
+	XMStoreFloat3(&c, centerL);
+	c.x = floorf(c.x / texel + 0.5f)*texel;
+	c.y = floorf(c.y / texel + 0.5f)*texel;
+
+	cascade.CenterL = c;
+	cascade.Radius = radius;
+
+	float zNear = c.z - radius - casterReach;
+	float zFar = c.z + radius;
+
+	XMMATRIX lightView = XMLoadFloat4x4(&mLightView);
+	XMMATRIX lightProj = XMMatrixOrthographicOffCenterLH(c.x - radius, c.x + radius, c.y - radius, c.y + radius, zNear, zFar);
+	XMMATRIX viewProj = lightView*lightProj;
+
+	// NDC [-1,+1]^2 to texture space [0,1]^2, y down.
+	XMMATRIX T(
+		0.5f, 0.0f, 0.0f, 0.0f,
+		0.0f, -0.5f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.5f, 0.5f, 0.0f, 1.0f);
+
+	XMStoreFloat4x4(&cascade.ViewProj, viewProj);
+	XMStoreFloat4x4(&cascade.ShadowTransform, viewProj*T);
+
+	BoundingOrientedBox boxL(XMFLOAT3(c.x, c.y, 0.5f*(zNear + zFar)),
+		XMFLOAT3(radius, radius, 0.5f*(zFar - zNear)), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+	boxL.Transform(cascade.Bounds, MathHelper::InverseRigid(lightView));
+}
+
+void CascadedShadowMaps::Invalidate()
+{
+	mInvalidated = true;
+}
+
+bool CascadedShadowMaps::StaticStale(UINT cascade)const
+{
+	return mCascades[cascade].Stale;
+}
+
+UINT CascadedShadowMaps::StaticRedrawCount()const
+{
+	return mRedrawCount;
+}
+
+const XMFLOAT4X4& CascadedShadowMaps::ViewProj(UINT cascade)const
+{
+	return mCascades[cascade].ViewProj;
+}
+
+const XMFLOAT4X4& CascadedShadowMaps::ShadowTransform(UINT cascade)const
+{
+	return mCascades[cascade].ShadowTransform;
+}
+
+const BoundingOrientedBox& CascadedShadowMaps::Bounds(UINT cascade)const
+{
+	return mCascades[cascade].Bounds;
+}
+
+XMFLOAT4 CascadedShadowMaps::SplitDistances()const
+{
+	static_assert(CascadeCount == 4, "SplitDistances packs one float per cascade");
+	return XMFLOAT4(mSplits[0], mSplits[1], mSplits[2], mSplits[3]);
+}
+
+XMFLOAT4 CascadedShadowMaps::TexelWorldSizes()const
+{
+	XMFLOAT4 sizes;
+	float* s = &sizes.x;
+	for(UINT i = 0; i < CascadeCount; ++i)
+		s[i] = 2.0f*mCascades[i].Radius / mStaticSize;
+	return sizes;
+}
+
+float CascadedShadowMaps::StaticTexelSize()const
+{
+	return 1.0f / mStaticSize;
+}
+
+float CascadedShadowMaps::DynamicTexelSize()const
+{
+	return 1.0f / mDynamicSize;
+}
+
+void CascadedShadowMaps::BeginStatic(ID3D12GraphicsCommandList* cmdList)
+{
+	D3D12_RESOURCE_BARRIER barriers[CascadeCount];
+	UINT count = 0;
+	for(UINT i = 0; i < CascadeCount; ++i)
+	{
+		if(mCascades[i].Stale)
+		{
+			barriers[count++] = CD3DX12_RESOURCE_BARRIER::Transition(mStaticMaps.Get(),
+				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE, i);
+		}
+	}
+	if(count > 0)
+		cmdList->ResourceBarrier(count, barriers);
+}
+
+void CascadedShadowMaps::BindStatic(ID3D12GraphicsCommandList* cmdList, UINT cascade)
+{
+	Bind(cmdList, cascade, mStaticSize);
+}
+
+void CascadedShadowMaps::EndStatic(ID3D12GraphicsCommandList* cmdList)
+{
+	D3D12_RESOURCE_BARRIER barriers[CascadeCount];
+	UINT count = 0;
+	for(UINT i = 0; i < CascadeCount; ++i)
+	{
+		if(mCascades[i].Stale)
+		{
+			barriers[count++] = CD3DX12_RESOURCE_BARRIER::Transition(mStaticMaps.Get(),
+				D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, i);
+		}
+	}
+	if(count > 0)
+		cmdList->ResourceBarrier(count, barriers);
+}
+
+void CascadedShadowMaps::BeginDynamic(ID3D12GraphicsCommandList* cmdList)
+{
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDynamicMaps.Get(),
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+}
+
+void CascadedShadowMaps::BindDynamic(ID3D12GraphicsCommandList* cmdList, UINT cascade)
+{
+	Bind(cmdList, CascadeCount + cascade, mDynamicSize);
+}
+
+void CascadedShadowMaps::EndDynamic(ID3D12GraphicsCommandList* cmdList)
+{
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDynamicMaps.Get(),
+		D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+void CascadedShadowMaps::Bind(ID3D12GraphicsCommandList* cmdList, UINT dsvIndex, UINT size)
+{
+	CD3DX12_CPU_DESCRIPTOR_HANDLE dsv(mDsvs, dsvIndex, mDsvDescriptorSize);
+	cmdList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+	cmdList->OMSetRenderTargets(0, nullptr, false, &dsv);
+
+	D3D12_VIEWPORT viewport = { 0.0f, 0.0f, (float)size, (float)size, 0.0f, 1.0f };
+	D3D12_RECT scissorRect = { 0, 0, (LONG)size, (LONG)size };
+	cmdList->RSSetViewports(1, &viewport);
+	cmdList->RSSetScissorRects(1, &scissorRect);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE CascadedShadowMaps::Srv()const
+{
+	return mSrvs;
+}
@@ -0,0 +1,144 @@
+//***************************************************************************************
+// CascadedShadowMaps.h
+//
+// Cascaded shadow maps for the main directional light.  The view frustum out to the
+// shadow distance is split into CascadeCount slices, each covered by an orthographic
+// map from the light.  A cascade is fitted to its slice's bounding sphere, which does
+// not change as the camera turns, and its center snapped to whole texels.
+//
+// Most casters never move, so each cascade's static casters are cached: the static
+// map of a cascade is fitted with a margin around its slice and only redrawn once
+// the slice leaves it, the light turns or Invalidate is called.  Casters that move,
+// such as the water, are drawn every frame into a smaller dynamic map covering the
+// first DynamicCascadeCount cascades with the same projections, and the shader takes
+// the darker of the two.
+//
+// Both maps are arrays with one slice per cascade that rest in PIXEL_SHADER_RESOURCE
+// outside the Begin and End calls.  The client draws the casters with PSOs set up by
+// SetCasterState, under pass constants whose view-projection is ViewProj.
+//***************************************************************************************
+
+#ifndef CASCADEDSHADOWMAPS_H
+#define CASCADEDSHADOWMAPS_H
+
+#include "../../Common/d3dUtil.h"
+
+class CascadedShadowMaps
+{
+public:
+	static const UINT CascadeCount = 4;
+	static const UINT DynamicCascadeCount = 2;
+
+	// Consecutive descriptors BuildDescriptors fills: the static array, then the
+	// dynamic array.  Likewise the DSVs, one per slice.
+	static const UINT SrvCount = 2;
+	static const UINT DsvCount = CascadeCount + DynamicCascadeCount;
+
+	static const DXGI_FORMAT DepthFormat = DXGI_FORMAT_D32_FLOAT;
+
+	CascadedShadowMaps(ID3D12Device* device, UINT staticSize, UINT dynamicSize);
+	CascadedShadowMaps(const CascadedShadowMaps& rhs) = delete;
+	CascadedShadowMaps& operator=(const CascadedShadowMaps& rhs) = delete;
+	~CascadedShadowMaps();
+
+	// Sets the targets, depth bias and rasterizer state of desc for drawing casters.
+	static void SetCasterState(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+		UINT srvDescriptorSize,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+		UINT dsvDescriptorSize);
+
+	// Fits the cascades to the camera's frustum between nearZ and shadowDistance,
+	// for a light shining along lightDir.  A cascade whose slice has left its cached
+	// map, or every cascade if the light turned, is refitted and must be redrawn
+	// this frame.  casterReach is how far towards the light casters may lie beyond
+	// a slice.
+	void Update(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj,
+		float nearZ, float shadowDistance, const DirectX::XMFLOAT3& lightDir, float casterReach);
+
+	// Redraws every static map on the next Update, as when a static caster moves.
+	void Invalidate();
+
+	// Whether the static map of cascade is redrawn this frame.
+	bool StaticStale(UINT cascade)const;
+
+	// Static map redraws since startup.
+	UINT StaticRedrawCount()const;
+
+	// World to light clip space of cascade, for drawing its casters.
+	const DirectX::XMFLOAT4X4& ViewProj(UINT cascade)const;
+
+	// World to shadow map texture space and depth, for the shader.
+	const DirectX::XMFLOAT4X4& ShadowTransform(UINT cascade)const;
+
+	// The world space volume cascade's map covers, for culling its casters.
+	const DirectX::BoundingOrientedBox& Bounds(UINT cascade)const;
+
+	// The view depth each cascade reaches, and the world size of a static map texel
+	// in each, for the shader's normal offset.
+	DirectX::XMFLOAT4 SplitDistances()const;
+	DirectX::XMFLOAT4 TexelWorldSizes()const;
+
+	// Size of a texel in texture space of each map.
+	float StaticTexelSize()const;
+	float DynamicTexelSize()const;
+
+	// The static maps being redrawn go to DEPTH_WRITE for BindStatic, which clears
+	// and binds one.  EndStatic returns them.
+	void BeginStatic(ID3D12GraphicsCommandList* cmdList);
+	void BindStatic(ID3D12GraphicsCommandList* cmdList, UINT cascade);
+	void EndStatic(ID3D12GraphicsCommandList* cmdList);
+
+	// The dynamic maps are cleared every frame.
+	void BeginDynamic(ID3D12GraphicsCommandList* cmdList);
+	void BindDynamic(ID3D12GraphicsCommandList* cmdList, UINT cascade);
+	void EndDynamic(ID3D12GraphicsCommandList* cmdList);
+
+	// Table of both arrays, static first.
+	D3D12_GPU_DESCRIPTOR_HANDLE Srv()const;
+
+private:
+	void BuildResource(UINT size, UINT slices, Microsoft::WRL::ComPtr<ID3D12Resource>& resource);
+	void Bind(ID3D12GraphicsCommandList* cmdList, UINT dsvIndex, UINT size);
+	void Fit(UINT cascade, DirectX::FXMVECTOR centerL, float radius, float casterReach);
+
+private:
+	struct Cascade
+	{
+		// Of the cached map, in light space.  A radius of zero has never been drawn.
+		DirectX::XMFLOAT3 CenterL = { 0.0f, 0.0f, 0.0f };
+		float Radius = 0.0f;
+		bool Stale = true;
+
+		DirectX::XMFLOAT4X4 ViewProj;
+		DirectX::XMFLOAT4X4 ShadowTransform;
+		DirectX::BoundingOrientedBox Bounds;
+	};
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mStaticSize = 0;
+	UINT mDynamicSize = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mStaticMaps = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDynamicMaps = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mSrvs;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mDsvs;
+	UINT mDsvDescriptorSize = 0;
+
+	Cascade mCascades[CascadeCount];
+	float mSplits[CascadeCount] = {};
+
+	// The light the cached maps were drawn for, and its rotation into light space.
+	DirectX::XMFLOAT3 mLightDir = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT4X4 mLightView;
+
+	bool mInvalidated = true;
+	UINT mRedrawCount = 0;
+};
+
+#endif // CASCADEDSHADOWMAPS_H
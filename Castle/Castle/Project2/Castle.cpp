@@ -6,8 +6,44 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/GpuProfiler.h"
+#include "../../Common/GeometryHeap.h"
+#include "../../Common/TextureStreamer.h"
+#include "../../Common/TiledTextureStreamer.h"
+#include "../../Common/TextureConditioner.h"
+#include "../../Common/ResidencyManager.h"
+#include "../../Common/DescriptorAllocator.h"
+#include "../../Common/RenderQueue.h"
+#include "../../Common/CachedCommandList.h"
+#include "../../Common/PipelineCache.h"
+#include "../../Common/ShaderPermutations.h"
+#include "../../Common/StartupGraph.h"
+#include "../../Common/HandleRegistry.h"
+#include "../../Common/MeshFile.h"
+#include "../../Common/MeshOptimizer.h"
+#include "../../Common/MeshletBuilder.h"
+#include "../../Common/JobSystem.h"
+#include "../../Common/RenderGraph.h"
 #include "FrameResource.h"
 #include "Waves.h"
+#include "WaterPatches.h"
+#include "GpuWaves.h"
+#include "Terrain.h"
+#include "Vegetation.h"
+#include "ClusteredLighting.h"
+#include "OitTargets.h"
+#include "DynamicResolution.h"
+#include "PostAntiAliasing.h"
+#include "VariableRateShading.h"
+#include "CascadedShadowMaps.h"
+#include "OcclusionCulling.h"
+#include "VisibilityBuffer.h"
+#include "MipFeedback.h"
+#include "BindingBenchmark.h"
+#include "CpuBenchmark.h"
+#include "StaticBatcher.h"
+#include "SceneEntities.h"
+#include <mutex>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -16,7 +52,66 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 
-const int gNumFrameResources = 3;
+// Frames the CPU may record ahead of the GPU.  Read from the command line before
+// the app initializes, and fixed from then on.
+int gNumFrameResources = 3;
+
+// Far clip distance, reaching across most of the terrain.
+const float gFarPlane = 4000.0f;
+
+// How far above a shadow cascade casters may stand, and the terrain tiles laid over
+// each cascade per side.
+const float gShadowCasterReach = 100.0f;
+const UINT gShadowTerrainTiles = 4;
+
+// Trees scattered by BuildVegetation.
+const UINT gTreeCount = 100000;
+
+// Distance between the torches BuildLocalLights mounts along the castle walls.
+const float gTorchSpacing = 0.5f;
+
+// The CPU waves' lake: patches of gWaterPatchQuads quads a side, one grid point a
+// metre.  Patches within gWaterActiveRadius of the camera's are simulated and drawn
+// at full resolution, and each ring beyond one of gWaterLodCount levels coarser.
+const int gWaterPatchesPerSide = 8;
+const int gWaterPatchQuads = 64;
+const int gWaterLodCount = 4;
+const int gWaterActiveRadius = 1;
+
+// The water is disturbed every gWaveDisturbInterval seconds.  After a long frame the
+// simulation runs at most gMaxWaveCatchUpSteps steps to catch up and skips the rest;
+// missed disturbances are never made up.
+const double gWaveDisturbInterval = 0.25;
+const UINT gMaxWaveCatchUpSteps = 4;
+
+// Side of the x/z cells static batches are split by, in metres.  The castle fits in
+// the one cell centered on the origin; scenery beyond it would batch apart.
+const float gStaticBatchCellSize = 80.0f;
+
+// Bytes between the rows of a patch's heights staged for a copy into the texture.
+const UINT gWaterHeightRowPitch = ((gWaterPatchQuads + 1)*sizeof(float) + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) &
+	~(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+
+// One level of an item's LOD chain: a submesh of the item's geometry.
+struct LodLevel
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// Drawn while the item's projected height, as a fraction of the viewport height,
+	// is at least this.  The coarsest level uses 0.
+	float MinScreenSize = 0.0f;
+};
+
+// Fraction a projected size must move past a level's threshold before the level
+// changes, so items sitting on a threshold do not flicker between levels.
+const float gLodHysteresis = 0.1f;
+
+// Items or instances frustum culled per job, and object constants written per job
+// by a full rewrite.  Ranges no longer than this stay on the calling thread.
+const UINT gCullGrain = 256;
+const UINT gObjectConstantsGrain = 128;
 
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
@@ -24,43 +119,430 @@ struct RenderItem
 {
 	RenderItem() = default;
 
-    // World matrix of the shape that describes the object's local space
-    // relative to the world space, which defines the position, orientation,
-    // and scale of the object in the world.
-    XMFLOAT4X4 World = MathHelper::Identity4x4();
-
-	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// The item's entity in mScene, which holds its transforms, bounds, material and
+	// draw arguments.  Also its index into the ObjectCB.
 	UINT ObjCBIndex = -1;
 
-	Material* Mat = nullptr;
-	MeshGeometry* Geo = nullptr;
+	// Resolved from its name when the item is built.  Invalid for items without
+	// vertex buffers.
+	Handle<MeshGeometry> Geo;
+
+	// Small id of Geo for the render queue's sort keys.
+	UINT GeometryId = 0;
 
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
-    // DrawIndexedInstanced parameters.
-    UINT IndexCount = 0;
-    UINT StartIndexLocation = 0;
-    int BaseVertexLocation = 0;
+	// Used by the displacement-mapped water grid only.
+	XMFLOAT2 DisplacementMapTexelSize = { 1.0f, 1.0f };
+	float GridSpatialStep = 1.0f;
+
+	// Moved after it is built, by SceneEntities::SetLocal, or with an animated
+	// surface.  Such items never enter the cached shadow maps and take the local
+	// light lookup wherever they go.
+	bool Moves = false;
+
+	// Instanced items only.  Instances holds every placement of the submesh and
+	// InstanceBounds their world-space boxes (instances are static).  Each frame the
+	// visible instances are packed into the item's range of the instance buffer,
+	// starting at InstanceBufferOffset, and InstanceCount is set to how many survived.
+	std::vector<InstanceData> Instances;
+	std::vector<BoundingBox> InstanceBounds;
+	UINT InstanceBufferOffset = 0;
+	UINT InstanceCount = 0;
+
+	// Level of detail chain, finest first.  Items without one keep the draw arguments
+	// they were added with; otherwise those are set from the level picked each frame, Lod.  Instanced
+	// items pick a level per instance, remembered in InstanceLods, and pack the
+	// visible instances grouped by level, LodInstanceCounts[i] of them at level i.
+	std::vector<LodLevel> Lods;
+	UINT Lod = 0;
+	std::vector<UINT> InstanceLods;
+	std::vector<UINT> LodInstanceCounts;
+
+	// Instanced items without levels only: the last FoggedInstanceCount of the
+	// visible instances lie wholly in the fog and are drawn at a coarse shading rate.
+	UINT FoggedInstanceCount = 0;
+
+	// Index into mPsoVariants of the pipeline state the item is drawn with, set by
+	// BuildPsoVariants from its layer, vertex format and lighting.
+	UINT PsoVariant = 0;
+};
+
+// Chains the named submeshes of geo, finest first, each with its MinScreenSize.
+std::vector<LodLevel> MakeLodChain(const MeshGeometry& geo,
+	std::initializer_list<std::pair<const char*, float>> levels)
+{
+	std::vector<LodLevel> lods;
+	for(const auto& e : levels)
+	{
+		const SubmeshGeometry& submesh = geo.DrawArgs.at(e.first);
+
+		LodLevel lod;
+		lod.IndexCount = submesh.IndexCount;
+		lod.StartIndexLocation = submesh.StartIndexLocation;
+		lod.BaseVertexLocation = submesh.BaseVertexLocation;
+		lod.MinScreenSize = e.second;
+		lods.push_back(lod);
+	}
+	return lods;
+}
+
+// A piece of the castle placed once and never moved: a submesh of shapeGeo.  Unless
+// they are baked, the repeated pieces are drawn as the instances of one item per
+// submesh, the rest as one item each.
+struct StaticPiece
+{
+	const char* Submesh;
+	const char* Material;
+	XMFLOAT4X4 World;
+	bool Instanced;
 };
 
+std::vector<StaticPiece> CastleStaticPieces()
+{
+	std::vector<StaticPiece> pieces;
+	auto add = [&pieces](const char* submesh, const char* material, FXMMATRIX world, bool instanced)
+	{
+		StaticPiece piece;
+		piece.Submesh = submesh;
+		piece.Material = material;
+		XMStoreFloat4x4(&piece.World, world);
+		piece.Instanced = instanced;
+		pieces.push_back(piece);
+	};
+
+	add("pedastal", "metal0", XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 1.5f, 0.0f), false);
+	add("diamond", "ice0", XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 2.5f, 0.0f), false);
+	add("grid", "bricks2", XMMatrixScaling(15.0f, 1.0f, 19.0f) * XMMatrixTranslation(0.0f, 1.0f, 0.0f), false);
+	add("ramp", "wood0", XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 1.5f, 0.0f), false);
+	add("kite", "metal0", XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 2.0f, 9.25f), false);
+	add("pentagon", "gate0", XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 3.5f, -8.75f), false);
+	add("grid", "grass0", XMMatrixScaling(30.0f, 1.0f, 50.0f) * XMMatrixTranslation(0.0f, 0.9f, -10.0f), false);
+
+	for(int i = 0; i < 2; ++i)
+	{
+		add("wall", "bricks0", XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.0f, 3.5f, -8.75f + i * 18.0f), true);
+		add("wall", "bricks0", XMMatrixScaling(0.1f, 1.0f, 8.90f) * XMMatrixTranslation(-7.0f + i * 14.0f, 3.5f, 0.0f), true);
+		add("pyramid", "roof0", XMMatrixScaling(1.0f, 2.0f, 1.0f) * XMMatrixTranslation(-7.5f + i * 15.0f, 9.0f, -10.0f), true);
+		add("pyramid", "roof0", XMMatrixScaling(1.0f, 2.0f, 1.0f) * XMMatrixTranslation(-7.5f + i * 15.0f, 9.0f, 10.0f), true);
+	}
+
+	// Scale and position of each maze block.
+	const XMFLOAT3 mazeBlocks[][2] =
+	{
+		{ XMFLOAT3(8.0f, 3.0f, 1.0f),  XMFLOAT3(5.0f, 2.5f, -32.0f) },
+		{ XMFLOAT3(8.0f, 3.0f, 1.0f),  XMFLOAT3(-5.0f, 2.5f, -32.0f) },
+		{ XMFLOAT3(8.0f, 3.0f, 1.0f),  XMFLOAT3(-5.0f, 2.5f, -15.0f) },
+		{ XMFLOAT3(8.0f, 3.0f, 1.0f),  XMFLOAT3(5.0f, 2.5f, -15.0f) },
+		{ XMFLOAT3(1.0f, 3.0f, 18.0f), XMFLOAT3(9.0f, 2.5f, -23.5f) },
+		{ XMFLOAT3(1.0f, 3.0f, 18.0f), XMFLOAT3(-9.0f, 2.5f, -23.5f) },
+		{ XMFLOAT3(1.0f, 3.0f, 6.0f),  XMFLOAT3(1.5f, 2.5f, -18.0f) },
+		{ XMFLOAT3(1.0f, 3.0f, 6.0f),  XMFLOAT3(-1.5f, 2.5f, -29.0f) },
+		{ XMFLOAT3(10.0f, 3.0f, 1.0f), XMFLOAT3(-0.5f, 2.5f, -26.0f) },
+		{ XMFLOAT3(10.0f, 3.0f, 1.0f), XMFLOAT3(0.5f, 2.5f, -21.0f) },
+	};
+
+	for(const auto& block : mazeBlocks)
+	{
+		add("maze", "maze0", XMMatrixScaling(block[0].x, block[0].y, block[0].z) *
+			XMMatrixTranslation(block[1].x, block[1].y, block[1].z), true);
+	}
+
+	return pieces;
+}
+
+// Steps from the current level towards the one screenSize calls for, with hysteresis.
+UINT SelectLod(const std::vector<LodLevel>& lods, UINT current, float screenSize)
+{
+	UINT lod = std::min(current, (UINT)lods.size() - 1);
+	while(lod + 1 < lods.size() && screenSize < lods[lod].MinScreenSize*(1.0f - gLodHysteresis))
+		++lod;
+	while(lod > 0 && screenSize > lods[lod - 1].MinScreenSize*(1.0f + gLodHysteresis))
+		--lod;
+	return lod;
+}
+
 enum class RenderLayer : int
 {
 	Opaque = 0,
+	OpaqueInstanced,
 	Transparent,
 	AlphaTested,
 	AlphaTestedTreeSprites,
+	GpuWaves,
+	Terrain,
+	Count
+};
+
+// A run of consecutive indirect commands in one layer that share a diffuse texture
+// and PSO variant.  Descriptor tables and PSOs cannot be changed by ExecuteIndirect,
+// so those are set once per batch and everything else comes from the argument buffer.
+// In bindless mode the material constants select the texture.
+struct IndirectBatch
+{
+	UINT SrvHeapIndex = 0;
+	UINT PsoVariant = 0;
+	UINT FirstCommand = 0;
+	UINT CommandCount = 0;
+};
+
+// How a layer pass treats depth.  Layers in the depth pre-pass are first drawn with
+// a depth-only PSO, then shaded with an EQUAL depth test and depth writes off.
+// Blended layers in OIT mode accumulate into the OIT targets with depth writes off.
+// Layers that cast shadows are drawn depth-only into the shadow maps.  With the
+// visibility buffer the opaque layer writes only triangle ids, with depth.
+enum class DepthPass : int
+{
+	Shade = 0,
+	Prepass,
+	Equal,
+	Oit,
+	Shadow,
+	Visibility,
+	Count
+};
+
+// Features a Default.hlsl permutation is compiled with.  Each bit, or field, is a
+// define in gShaderFeatureFields; an item's PSO is built from the fewest it needs.
+enum ShaderFeature : UINT
+{
+	ShaderFeatureFog = 1 << 0,
+	ShaderFeatureAlphaTest = 1 << 1,
+	ShaderFeatureInstancing = 1 << 2,
+	ShaderFeatureCompactVertex = 1 << 3,
+	ShaderFeatureTerrain = 1 << 4,
+	ShaderFeatureDisplacementMap = 1 << 5,
+	ShaderFeatureLocalLights = 1 << 6,
+	// Bits 7 and 8 hold the directional light count.
+	ShaderFeatureOit = 1 << 9,
+	ShaderFeatureShadows = 1 << 10,
+};
+
+// Two bits from here hold the number of directional lights, NUM_DIR_LIGHTS.
+const UINT gDirLightCountShift = 7;
+const UINT gDirLightCount = 3;
+
+const std::vector<ShaderFeatureField> gShaderFeatureFields =
+{
+	{ "FOG", 0, 1 },
+	{ "ALPHA_TEST", 1, 1 },
+	{ "INSTANCING", 2, 1 },
+	{ "COMPACT_VERTEX", 3, 1 },
+	{ "TERRAIN", 4, 1 },
+	{ "DISPLACEMENT_MAP", 5, 1 },
+	{ "LOCAL_LIGHTS", 6, 1 },
+	{ "NUM_DIR_LIGHTS", gDirLightCountShift, 2 },
+	{ "OIT", 9, 1 },
+	{ "SHADOWS", 10, 1 },
+};
+
+// The features the vertex shader reads; the rest only change the pixel shader.
+const UINT gVertexShaderFeatures = ShaderFeatureInstancing | ShaderFeatureCompactVertex |
+	ShaderFeatureTerrain | ShaderFeatureDisplacementMap;
+
+// A layer, its name in the profiler and the shader features every item in it needs.
+// Blended layers draw back to front over the opaque image, or into the OIT targets.
+struct LayerPass
+{
+	RenderLayer Layer;
+	const char* PsoName;
+	bool DepthPrepass;
+	bool Blended;
+	bool CastsShadows;
+	UINT ShaderFeatures;
+};
+
+// Layers in the order they are drawn.  In parallel recording mode each pass gets
+// its own worker command list, and the lists are submitted in this order.
+const LayerPass gLayerPasses[] =
+{
+	{ RenderLayer::Opaque, "opaque", true, false, true, 0 },
+	{ RenderLayer::OpaqueInstanced, "opaqueInstanced", true, false, true, ShaderFeatureInstancing },
+	{ RenderLayer::Terrain, "terrain", true, false, true, ShaderFeatureInstancing | ShaderFeatureTerrain },
+	{ RenderLayer::AlphaTested, "alphaTested", true, false, true, ShaderFeatureAlphaTest },
+	{ RenderLayer::AlphaTestedTreeSprites, "treeSprites", false, false, false, 0 },
+	{ RenderLayer::Transparent, "transparent", false, true, true, 0 },
+	{ RenderLayer::GpuWaves, "wavesRender", false, true, true, ShaderFeatureDisplacementMap },
+};
+const int gNumLayerPasses = _countof(gLayerPasses);
+
+struct TextureSlot
+{
+	const char* Name;
+	const wchar_t* Filename;
+	bool IsArray;
+};
+
+// Material textures.  BuildMaterials refers to them by slot; a slot's descriptor is
+// allocated when its texture arrives.
+const TextureSlot gTextureSlots[] =
+{
+	{ "grassTex", L"../../Textures/grass.dds", false },
+	{ "waterTex", L"../../Textures/water1.dds", false },
+	{ "fenceTex", L"../../Textures/WireFence.dds", false },
+	{ "bricksTex", L"../../Textures/bricks.dds", false },
+	{ "stoneTex", L"../../Textures/stone.dds", false },
+	{ "tileTex", L"../../Textures/tile.dds", false },
+	{ "woodTex", L"../../Textures/wood.dds", false },
+	{ "iceTex", L"../../Textures/ice.dds", false },
+	{ "gateTex", L"../../Textures/WireFence.dds", false },
+	{ "roofTex", L"../../Textures/roof.dds", false },
+	{ "metalTex", L"../../Textures/metal.dds", false },
+	{ "bricks2Tex", L"../../Textures/bricks2.dds", false },
+	{ "maze0Tex", L"../../Textures/maze.dds", false },
+	{ "treeArrayTex", L"../../Textures/treeArray.dds", true },
+};
+const UINT gNumTextureSlots = _countof(gTextureSlots);
+
+const wchar_t* const gTextureDirectory = L"../../Textures/";
+const wchar_t* const gConditionedTextureDirectory = L"../../Textures/Conditioned/";
+
+struct TextureJob
+{
+	const wchar_t* Output;
+	TextureEncoding Encoding;
+	// One per array slice, up to the first null.
+	const wchar_t* Sources[4];
+};
+
+// What ConditionTextures writes to gConditionedTextureDirectory, from files in
+// gTextureDirectory: the gTextureSlots textures that ship without mips.  Block
+// compressed files that already have mips, the tree array among them, are left as
+// they are.
+const TextureJob gTextureJobs[] =
+{
+	{ L"bricks.dds", TextureEncoding::BC7, { L"bricks.dds" } },
+	{ L"ice.dds", TextureEncoding::BC7, { L"ice.dds" } },
+	{ L"stone.dds", TextureEncoding::BC7, { L"stone.dds" } },
+	{ L"tile.dds", TextureEncoding::BC7, { L"tile.dds" } },
+};
+
+// The conditioned copy of a texture file, if ConditionTextures has written one.
+std::wstring ConditionedTextureFile(const std::wstring& filename)
+{
+	size_t slash = filename.find_last_of(L"\\/");
+	std::wstring conditioned = gConditionedTextureDirectory + filename.substr(slash + 1);
+	return GetFileAttributesW(conditioned.c_str()) != INVALID_FILE_ATTRIBUTES ? conditioned : filename;
+}
+
+// Compiled shaders are cached here, relative to the working directory.
+const wchar_t* const gShaderCacheDirectory = L"ShaderCache";
+
+// The shader permutations a run compiled, for PrecompileShaders to replay.
+const wchar_t* const gShaderManifestFile = L"shader_permutations.txt";
+
+// Generated meshes are cached here.  Bump a mesh's version when the code that builds
+// it changes, so the stale file is rebuilt.
+const wchar_t* const gMeshCacheDirectory = L"MeshCache";
+const UINT gShapeGeometryVersion = 2;
+
+// Layout of Vertex.
+const D3D12_INPUT_ELEMENT_DESC gVertexLayout[] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
+// Layout of CompactVertex.
+const D3D12_INPUT_ELEMENT_DESC gCompactVertexLayout[] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
+// Layout of QuantizedVertex.  The shader reads three of the four position components.
+const D3D12_INPUT_ELEMENT_DESC gQuantizedVertexLayout[] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
+// Indexed by VertexFormat.
+struct VertexFormatDesc
+{
+	const char* Name;
+	const D3D12_INPUT_ELEMENT_DESC* Layout;
+	UINT LayoutCount;
+	UINT Stride;
+};
+
+const VertexFormatDesc gVertexFormats[] =
+{
+	{ "full", gVertexLayout, _countof(gVertexLayout), sizeof(Vertex) },
+	{ "compact", gCompactVertexLayout, _countof(gCompactVertexLayout), sizeof(CompactVertex) },
+	{ "quantized", gQuantizedVertexLayout, _countof(gQuantizedVertexLayout), sizeof(QuantizedVertex) },
+};
+
+// The pipeline states of one layer, vertex format and feature set, one per depth
+// pass; null for passes the layer takes no part in.
+struct PsoVariant
+{
+	RenderLayer Layer = RenderLayer::Opaque;
+	UINT VertexFormat = 0;
+	UINT Features = 0;
+	ComPtr<ID3D12PipelineState> Psos[(int)DepthPass::Count];
+	// Instanced layer only, with mesh shaders: the same passes drawn as meshlets.
+	ComPtr<ID3D12PipelineState> MeshletPsos[(int)DepthPass::Count];
+};
+static_assert(_countof(gVertexFormats) == (int)VertexFormat::Count, "gVertexFormats must cover VertexFormat");
+
+// Root constants of the meshlet draws.  Must match cbMeshlets in Meshlet.hlsl.  The
+// first two are set per draw, the rest once per list.
+struct MeshletConstants
+{
+	UINT FirstMeshlet;
+	UINT MeshletCount;
+	UINT VertexFormat;
+	UINT DepthWidth;
+	UINT DepthHeight;
+	UINT MipCount;
+	UINT PyramidValid;
+};
+const UINT gMeshletConstantCount = sizeof(MeshletConstants) / 4;
+
+// Meshlets an amplification shader group tests.  Must match AS_THREADS in Meshlet.hlsl.
+const UINT gMeshletGroupSize = 32;
+
+// Post-process anti-aliasing of the finished scene.
+enum class PostAA : int
+{
+	Off = 0,
+	Fast,
+	Quality,
 	Count
 };
 
+struct PostAADesc
+{
+	const char* Name;
+	FxaaSettings Settings;
+};
+
+// Indexed by PostAA.  The fast preset gives up on long edges sooner, skips fainter
+// ones and leaves more subpixel aliasing.
+const PostAADesc gPostAAModes[] =
+{
+	{ "off", { 0, 0.0f, 0.0f, 0.0f } },
+	{ "fast", { 6, 0.5f, 0.166f, 0.0833f } },
+	{ "quality", { 12, 0.75f, 0.125f, 0.0312f } },
+};
+static_assert(_countof(gPostAAModes) == (int)PostAA::Count, "gPostAAModes must cover PostAA");
+
+// Headless benchmark run: a fixed timestep, a scripted camera orbit and seeded wave
+// disturbances, so two builds render exactly the same frames.
+struct BenchmarkSettings
+{
+	UINT FrameCount = 0;
+	UINT WarmupFrames = 60;
+	double TimeStep = 1.0 / 60.0;
+	unsigned int Seed = 1;
+	std::wstring OutputFile = L"benchmark.csv";
+};
+
 class TreeBillboardsApp : public D3DApp
 {
 public:
@@ -71,42 +553,199 @@ public:
 
     virtual bool Initialize()override;
 
+	// Call before Initialize.
+	void EnableBenchmark(const BenchmarkSettings& settings);
+	void SetBindless(bool enable);
+	void SetStructuredConstants(bool enable);
+	void SetShaderCompiler(ShaderCompiler compiler);
+	void SetVertexFormat(VertexFormat format);
+	void SetOptimizeMeshes(bool enable);
+	void SetBakeStaticGeometry(bool enable);
+	void SetDepthPrepass(bool enable);
+	void SetOit(bool enable);
+	void SetOcclusionCulling(bool enable);
+	void SetAsyncCompute(bool enable);
+	void SetDynamicResolution(bool enable);
+	// GPU milliseconds dynamic resolution keeps frames within; 0 follows the display.
+	void SetGpuBudget(double ms);
+	void SetPostAA(PostAA mode);
+	void SetVariableRateShading(bool enable);
+	void SetShadows(bool enable);
+	void SetMeshShaders(bool enable);
+	void SetVisibilityBuffer(bool enable);
+	void SetVirtualTextures(bool enable);
+	void SetTextureBudget(UINT megabytes);
+	void SetGpuWaves(bool enable);
+	void SetStreamWaveHeights(bool enable);
+	void SetInterpolateWaves(bool enable);
+
+	// Compiles every shader permutation into the shader cache without creating a
+	// device, for running as a build step.  Use instead of Initialize.
+	void PrecompileShaders();
+
+	// Rewrites the gTextureJobs whose sources changed since they were last conditioned.
+	// Needs no device either.
+	void ConditionTextures();
+
+	// Creates a device but no scene and times each binding model drawing 1000
+	// objects, then ten times as many and so on up to maxObjects, writing the
+	// results to outputFile.  Use instead of Initialize.
+	void RunBindingBenchmark(UINT maxObjects, const std::wstring& outputFile);
+
 private:
+    virtual void CreateRtvAndDsvDescriptorHeaps()override;
     virtual void OnResize()override;
     virtual void Update(const GameTimer& gt)override;
     virtual void Draw(const GameTimer& gt)override;
+	virtual void Simulate(const GameTimer& gt)override;
+	virtual void PublishSimulation()override;
+    virtual std::wstring FrameStatsText()const override;
 
     virtual void OnMouseDown(WPARAM btnState, int x, int y)override;
     virtual void OnMouseUp(WPARAM btnState, int x, int y)override;
     virtual void OnMouseMove(WPARAM btnState, int x, int y)override;
+    virtual void OnKeyUp(WPARAM vkeyCode)override;
+	virtual bool FrameNeeded()override;
 
     void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
+	// Queue a modified item or material on every frame resource's dirty list.
+	void MarkObjectDirty(UINT entity);
+	void MarkMaterialDirty(Material* mat);
+	// Writes the constants of entities [first, first + count).
+	void WriteObjectConstants(UINT first, UINT count, UINT frameBit);
+	MaterialConstants BuildMaterialConstants(const Material& mat);
 	void UpdateMainPassCB(const GameTimer& gt);
+	void UpdateShadows(const GameTimer& gt);
+	// Vertices of the water each frame resource streams; 0 when the grid is static.
+	UINT WaveVertexCount()const;
 	void UpdateWaves(const GameTimer& gt); 
+	void UpdateWaveVertices();
+	void UpdateWavesGPU(const GameTimer& gt);
+	// Schedules the wave steps and disturbances in mSimulationSteps.
+	void BuildSimulationSystems();
+	// Stages the patches whose heights in mWaveHeights are out of date, for
+	// CopyWaveHeights to copy in.
+	void StageWaveHeights();
+	void CopyWaveHeights();
+
+	// Records and submits this frame's compute queue passes, and holds the frame's
+	// direct queue work back until they are done.
+	void SubmitAsyncCompute();
+
+	// Picks this frame's render resolution from the GPU time of a recent frame.
+	void UpdateDynamicResolution();
+	void UpdateRenderGraph();
+	// Whether the scene is drawn into the dynamic resolution target rather than
+	// straight into the back buffer, for the passes that read it afterwards.
+	bool SceneOffscreen()const;
+	// Whether the scene's draws set shading rates, with the device's support.
+	bool VrsActive()const;
+	// Whether the instanced layer is drawn as meshlets, with the device's support.
+	bool MeshShadersActive()const;
+	// Whether the opaque layer is shaded from the visibility buffer, where it can be.
+	bool VisibilityBufferActive()const;
+	// Whether a layer pass draws and shades its layer itself, rather than leaving it
+	// to the visibility buffer's resolve.
+	bool DrawsForward(RenderLayer layer)const;
+	D3D12_CPU_DESCRIPTOR_HANDLE SceneRtv()const;
+	// Anti-aliases an offscreen scene and stretches it over the back buffer.
+	void ResolveScene(ID3D12GraphicsCommandList* cmdList);
+	void UpdateVisibility(const GameTimer& gt);
+	void UpdateInstanceBuffer(const GameTimer& gt);
+	void UpdateTerrain(const GameTimer& gt);
+	void UpdateRenderQueue(const GameTimer& gt);
+	void UpdateIndirectCommands(const GameTimer& gt);
+	void UpdateVisibilityGeometry();
+	void UpdateLocalLights(const GameTimer& gt);
+	float ProjectedSize(const BoundingBox& bounds)const;
+	// How fogged the nearest point of bounds is, as Default.hlsl fogs it.
+	float FogAmount(const BoundingBox& bounds)const;
+	void UpdateStreamedTextures();
+	void UpdateVirtualTextures();
+	void UpdateResidency();
 
 	void LoadTextures();
     void BuildRootSignature();
+	void BuildWavesRootSignature();
+	void BuildVegetationRootSignature();
+	void BuildLightCullRootSignature();
+	void BuildOitRootSignature();
+	void BuildUpscaleRootSignature();
+	void BuildPostAARootSignature();
+	void BuildShadingRateRootSignature();
+	void BuildOcclusionRootSignatures();
+	void BuildCommandSignature();
 	void BuildDescriptorHeaps();
+	void BuildTextureSrv(UINT slot);
+	void BuildWavesDescriptors();
+	void BuildWaveHeightDescriptors();
+	void BuildOitDescriptors();
+	void BuildDynamicResolutionDescriptors();
+	void BuildPostAADescriptors();
+	void RebuildMovedDescriptors();
+	void BuildVrsDescriptors();
+	void BuildShadowDescriptors();
+	void BuildOcclusionDescriptors();
+	void BuildVisibilityBuffer();
+	void BuildVisibilityDescriptors();
+	// Which of the geometry heap's buffers resource is, or UINT_MAX if none.
+	UINT GeometryBufferIndex(ID3D12Resource* resource)const;
+	// Whether every opaque item fits the visibility buffer's ids, with triangles the
+	// resolve can fetch from the geometry heap.
+	bool VisibilityBufferFits()const;
     void BuildShadersAndInputLayouts();
 	void BuildShapeGeometry();
-    void BuildLandGeometry();
+	void BuildMeshlets();
+	void BuildStaticBatches();
+	void BuildTerrainGeometry();
     void BuildWavesGeometry();
+	void BuildGpuWavesGeometry();
 	void BuildBoxGeometry();
-	void BuildTreeSpritesGeometry();
+	void BuildVegetation();
+	void BuildLocalLights();
+	void BuildOcclusionCulling();
+	void AddGeometry(std::unique_ptr<MeshGeometry> geo);
+	void SetGeometryVertices(MeshGeometry& geo, const std::vector<Vertex>& vertices, VertexFormat format);
+	// Inverse of SetGeometryVertices, from geo's CPU copy, to within its format's precision.
+	void DecodeGeometryVertices(const MeshGeometry& geo, std::vector<Vertex>& vertices)const;
+	void OptimizeMesh(GeometryGenerator::MeshData& mesh, const char* name);
+	// Cached meshes are keyed by their version and whether they were optimized.
+	UINT64 MeshCacheKey(UINT version)const;
+	bool LoadCachedGeometry(const std::string& name, UINT version, bool keepCpuCopies = false);
+	void StoreCachedGeometry(const MeshGeometry& geo, UINT version);
     void BuildPSOs();
+	UINT ItemShaderFeatures(const LayerPass& pass, const RenderItem& ri)const;
+	UINT FindPsoVariant(RenderLayer layer, UINT vertexFormat, UINT features);
+	void BuildPsoVariants();
+	void BuildPsoVariant(PsoVariant& variant);
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
-
-	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
-
-    float GetHillsHeight(float x, float z)const;
-    XMFLOAT3 GetHillsNormal(float x, float z)const;
+    void DrawRenderItems(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass, const std::vector<RenderItem*>& ritems);
+	void DrawInstancedRenderItems(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass, const std::vector<RenderItem*>& ritems);
+	void DrawRenderItemsIndirect(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass);
+	void DrawOccludedRenderItems(CachedCommandList& cmdList, DepthPass depthPass, D3D12_GPU_VIRTUAL_ADDRESS commands);
+	void DrawVegetation(CachedCommandList& cmdList);
+	void DrawLayer(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass);
+	CommandListStats DrawShadows();
+	void DrawShadowCasters(CachedCommandList& cmdList, UINT cascade, bool dynamic);
+
+	// The depth pass a layer's shading draws use this frame.
+	DepthPass ShadingPass(const LayerPass& pass)const;
+	void SetCommonPassState(CachedCommandList& cmdList);
+	void CompositeTransparency(ID3D12GraphicsCommandList* cmdList);
+	// Records the layers that draw, one worker list each, writes the lists to
+	// cmdLists in submission order and returns how many there are.
+	UINT RecordLayersParallel(ID3D12CommandList** cmdLists);
+
+	void RecordBenchmarkFrame();
+	void WriteBenchmarkResults()const;
+
+	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> GetStaticSamplers();
 
 private:
 
@@ -117,27 +756,387 @@ private:
     UINT mCbvSrvDescriptorSize = 0;
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mWavesRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mVegetationRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mLightCullRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mOitRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mUpscaleRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mPostAARootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mShadingRateRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mOcclusionCullRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mHiZRootSignature = nullptr;
+	ComPtr<ID3D12CommandSignature> mCommandSignature = nullptr;
+
+	// Every CBV/SRV/UAV the app creates.
+	std::unique_ptr<DescriptorAllocator> mDescriptors;
+	UINT mDescriptorGeneration = 0;
+	UINT mFallbackSrvIndex = 0;
+	UINT mFallbackArraySrvIndex = 0;
+	UINT mWavesSrvIndex = 0;
+	UINT mOitSrvIndex = 0;
+	UINT mVisibilitySrvIndex = 0;
+	UINT mSceneSrvIndex = 0;
+	UINT mPostAASrvIndex = 0;
+	UINT mVrsSrvIndex = 0;
+	UINT mOcclusionSrvIndex = 0;
+	UINT mTextureSrvIndex[gNumTextureSlots];
+
+	// Pixel shaders index one unbounded texture table by the material's DiffuseMapIndex,
+	// so draws do not bind a texture table of their own.  Requested with -bindless and
+	// fixed at startup; needs resource binding tier 2.
+	bool mBindless = true;
+
+	// Object and material constants are read from tightly packed structured buffers,
+	// bound once per list, and a draw passes only its object index as a root constant.
+	// Otherwise each draw binds two root CBVs into 256-byte padded constants.
+	// Requested with -constants and fixed at startup.
+	bool mStructuredConstants = true;
+
+	// Compiler for the shader cache; DXC falls back to FXC without shader model 6.
+	// Requested with -shaders.
+	ShaderCompiler mShaderCompiler = ShaderCompiler::Fxc;
+	std::unique_ptr<ShaderCache> mShaderCache;
+	std::unique_ptr<ShaderPermutations> mShaderPermutations;
+
+	// Vertex format of the static shape geometry.  Requested with -vertices.
+	VertexFormat mVertexFormat = VertexFormat::Full;
+
+	// Reorder generated meshes for the vertex cache and overdraw before upload.
+	// Requested with -optimizemeshes.
+	bool mOptimizeMeshes = true;
+
+	// Merge the castle's static pieces into per-material batches in world space,
+	// "staticGeo", drawn as one item each.  Requested with -bakestatic.
+	bool mBakeStaticGeometry = true;
+	std::vector<StaticBatcher::Batch> mStaticBatches;
+
+	// Backs the VBs/IBs of every static MeshGeometry in mGeometries.
+	std::unique_ptr<GeometryHeap> mGeometryHeap;
+	HandleRegistry<MeshGeometry> mGeometries;
+
+	// The Build*Geometry steps run concurrently at startup.
+	std::mutex mGeometryMutex;
+	HandleRegistry<Material> mMaterials;
+	HandleRegistry<Texture> mTextures;
+	// mTextures by texture slot.
+	Handle<Texture> mTextureHandles[gNumTextureSlots];
+
+	// mMaterials by MatCBIndex, for the dirty lists and full rewrites.
+	std::vector<Material*> mMaterialsByIndex;
+	Material* mWaterMat = nullptr;
+
+	// Tracks what we allocate against the video memory budget.  'R' writes
+	// memory_report.csv.
+	std::unique_ptr<ResidencyManager> mResidency;
+
+	// Streamer ticket -> texture slot, for requests still in flight.
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	std::unordered_map<UINT, UINT> mStreamingTextures;
+
+	// Texture slot -> materials drawing with the fallback until it arrives.
+	std::unordered_map<UINT, std::vector<Material*>> mAwaitingTexture;
+	// The texture slot of each material, by MatCBIndex.
+	std::vector<UINT> mMaterialSlots;
+
+	// The non-array material textures stream into reserved resources instead, a mip
+	// at a time as the pixel shaders ask for finer ones, within mTextureBudgetMB of
+	// tiles.  Needs tiled resources.  Requested with -virtualtextures and fixed at
+	// startup.
+	bool mVirtualTexturing = false;
+	UINT mTextureBudgetMB = 64;
+	std::unique_ptr<TiledTextureStreamer> mVirtualTextures;
+	std::unique_ptr<MipFeedback> mMipFeedback;
+	// Streamer id of each slot's texture, or -1 where it streams whole, and back.
+	UINT mVirtualTextureIds[gNumTextureSlots];
+	std::vector<UINT> mVirtualTextureSlots;
+	// The root UAV the requests are written through, after the meshlet parameters.
+	UINT mMipRequestRootParameter = 0;
+	HandleRegistry<ID3DBlob, ComPtr<ID3DBlob>> mShaders;
+	HandleRegistry<ID3D12PipelineState, ComPtr<ID3D12PipelineState>> mPSOs;
+
+	// The PSOs used every frame that are not PSO variants, resolved once by BuildPSOs.
+	struct FramePsos
+	{
+		Handle<ID3D12PipelineState> TreeSprites;
+		Handle<ID3D12PipelineState> VegetationCull;
+		Handle<ID3D12PipelineState> LightCull;
+		Handle<ID3D12PipelineState> OcclusionCull;
+		Handle<ID3D12PipelineState> HiZReduce;
+		Handle<ID3D12PipelineState> OitComposite;
+		Handle<ID3D12PipelineState> Upscale;
+		Handle<ID3D12PipelineState> Fxaa;
+		Handle<ID3D12PipelineState> ShadingRate;
+		Handle<ID3D12PipelineState> WavesDisturb;
+		Handle<ID3D12PipelineState> WavesUpdate;
+		Handle<ID3D12PipelineState> VisibilityResolve;
+	};
+	FramePsos mFramePsos;
+
+	// Fixed-function state of each Default.hlsl layer, which BuildPsoVariant adds the
+	// shaders and input layout to.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC mLayerPsoDescs[(int)RenderLayer::Count] = {};
 
-	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
+	// Every pipeline state some render item is drawn with, keyed by layer, vertex
+	// format and features.
+	std::vector<PsoVariant> mPsoVariants;
+	std::unordered_map<UINT64, UINT> mPsoVariantIds;
+	UINT mFirstPsoVariant[(int)RenderLayer::Count] = {};
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
-	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	// PSOs compiled on an earlier run are loaded from here rather than compiled again.
+	std::unique_ptr<PipelineCache> mPipelineCache;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
-	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mTerrainInputLayout;
 
     RenderItem* mWavesRitem = nullptr;
 
+	// Per-entity data of the render items, walked by culling, constant updates and
+	// command building.
+	SceneEntities mScene;
+	std::vector<UINT> mChangedEntities;
+
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+	// mAllRitems by entity.
+	std::vector<RenderItem*> mObjectItems;
 
-	// Render items divided by PSO.
+	// Render items divided by PSO, and the same items' entities in ascending order.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
+	std::vector<UINT> mLayerEntities[(int)RenderLayer::Count];
+
+	// Submit each layer with ExecuteIndirect instead of one draw per item.  Toggle with 'I'.
+	bool mIndirectDraw = true;
+	std::vector<IndirectBatch> mIndirectBatches[(int)RenderLayer::Count];
+	std::vector<RenderItem*> mIndirectScratch;
+	std::vector<UINT> mVisibleInstances;
+	// The visible instances of the item being packed, in the order they are packed.
+	std::vector<UINT> mPackedInstances;
+	// Culling results, by entity and by instance of the item being culled.
+	std::vector<UINT8> mEntityVisible;
+	std::vector<UINT8> mInstanceVisible;
+	std::vector<UINT> mLodOffsets;
+
+	// Record each layer pass on its own command list from a worker thread.  Toggle with 'M'.
+	bool mParallelRecord = true;
+
+	// State calls forwarded and dropped as redundant while recording the last frame.
+	CommandListStats mRecordStats;
+
+	// Lay down the depth of the opaque and alpha-tested layers before shading them,
+	// so each pixel is shaded once.  Toggle with 'Z'.
+	bool mDepthPrepass = false;
+
+	// Draw the blended layers with weighted blended order-independent transparency,
+	// so they need no back to front sort.  Toggle with 'B'.
+	bool mOit = true;
+	std::unique_ptr<OitTargets> mOitTargets;
+
+	// Draw the scene at whatever fraction of the window's resolution keeps the GPU
+	// within budget, and upscale it to the back buffer.  Toggle with 'D'.
+	bool mDynamicResolution = true;
+	double mGpuBudgetMs = 0.0;
+	std::unique_ptr<DynamicResolution> mDynamicRes;
+
+	// This frame's render resolution, from UpdateDynamicResolution.
+	D3D12_VIEWPORT mSceneViewport;
+	D3D12_RECT mSceneScissorRect;
+
+	// Anti-alias the scene at its render resolution, ahead of the upscale, in place
+	// of MSAA.  Cycle with 'X'.
+	PostAA mPostAA = PostAA::Quality;
+	std::unique_ptr<PostAntiAliasing> mPostAntiAliasing;
+	// The graph's transient the pass writes, and the generation its views were built for.
+	ID3D12Resource* mPostAAOutput = nullptr;
+	UINT mPostAAGeneration = UINT_MAX;
+
+	// The passes over the finished scene, built in Update and recorded at the end of
+	// the frame, with the barriers between them and the back buffer's return to Present.
+	std::unique_ptr<RenderGraph> mRenderGraph;
+
+	// Shade what the fog covers at a coarser rate: per draw, and at Tier 2 from a
+	// rate image built after the depth pre-pass.  Toggle with 'S'.
+	bool mVariableRateShading = true;
+	std::unique_ptr<VariableRateShading> mVrs;
+	// Whether this frame's image is built, for the lists that bind it.
+	bool mShadingRateImageReady = false;
+
+	// Cascaded shadow maps for the main light, with the static casters cached and
+	// the moving ones redrawn every frame.  Toggle with 'L'.
+	bool mShadows = true;
+	std::unique_ptr<CascadedShadowMaps> mShadowMaps;
+	UINT mShadowSrvIndex = 0;
+	// Per entity, whether it is drawn into the dynamic maps.  Entities that move
+	// join them for good.
+	std::vector<UINT8> mShadowDynamic;
+	// The static instanced casters of each cascade, in this frame's ShadowInstances.
+	struct ShadowDraw
+	{
+		RenderItem* Item;
+		UINT FirstInstance;
+		UINT InstanceCount;
+	};
+	std::vector<ShadowDraw> mShadowDraws[CascadedShadowMaps::CascadeCount];
+	// ShadowInstances holds every instance and terrain tile once per cascade.
+	UINT mShadowInstanceCount = 0;
+
+	// Cull the indirect draws of the Opaque layer against a depth pyramid, in two
+	// phases around the pyramid's rebuild.  Toggle with 'H'.
+	bool mOcclusionCulling = true;
+	std::unique_ptr<OcclusionCulling> mOcclusion;
+	// The Opaque layer's first command in this frame's argument buffer.
+	UINT mOpaqueFirstCommand = 0;
+
+	// Draw the instanced layer as meshlets, which an amplification shader culls
+	// against the frustum, their normal cones and the occlusion pyramid.  Needs mesh
+	// shaders and DXC; without them the layer keeps its vertex shader PSOs.  Toggle
+	// with 'N'.
+	bool mMeshShaders = true;
+	bool mMeshShadersSupported = false;
+
+	// Draw the opaque layer's triangle ids into a visibility buffer, then shade each
+	// pixel once in a full-screen resolve.  Needs bindless structured constants and
+	// an opaque layer that fits the ids; without them the layer stays forward.
+	// Toggle with 'U'.
+	bool mVisibilityBuffer = false;
+	bool mVisibilityBufferSupported = false;
+	std::unique_ptr<VisibilityBuffer> mVisibility;
+	// The resolve's table and its geometry records, after the other root parameters.
+	UINT mVisibilityRootParameter = 0;
+	// The first of the meshlet root parameters, after the others: the constants, the
+	// vertex buffer, the meshlets, their indices and the pyramid's table.
+	UINT mMeshletRootParameter = 0;
+	// The meshlets of each submesh of mMeshletGeometry, by its StartIndexLocation.
+	struct MeshletRange
+	{
+		UINT FirstMeshlet;
+		UINT MeshletCount;
+	};
+	Handle<MeshGeometry> mMeshletGeometry;
+	std::unordered_map<UINT, MeshletRange> mMeshletRanges;
+	GeometryRange mMeshlets;
+	GeometryRange mMeshletIndices;
+	UINT mMeshletCount = 0;
+
+	// Items of each layer that pass the frustum test this frame.  Toggle culling with 'C'.
+	bool mFrustumCulling = true;
+	std::vector<RenderItem*> mVisibleRitems[(int)RenderLayer::Count];
+	UINT mVisibleCount = 0;
+
+	// Reorders each layer's visible items by sort key: state first and front to back
+	// for depth-tested layers, back to front for blended ones.  Toggle with 'O'.
+	bool mSortDraws = true;
+	RenderQueue mRenderQueue;
+	std::vector<RenderItem*> mQueueItems;
+
+	// Total number of instances over all instanced render items.
+	UINT mInstanceCount = 0;
+
+	// Camera frustum in world space, refreshed by UpdateVisibility.
+	BoundingFrustum mWorldFrustum;
+
+	// Camera frustum in view space; rebuilt when the projection changes.
+	BoundingFrustum mCamFrustum;
+
+	// Run the water simulation in compute shaders and displace a static grid, rather
+	// than solving on the CPU and uploading the vertices every frame.  Fixed at startup
+	// since the two paths build different geometry and pipeline state.
+	bool mUseGpuWaves = true;
 
 	std::unique_ptr<Waves> mWaves;
+	std::unique_ptr<GpuWaves> mGpuWaves;
+
+	// The CPU waves cover a lake of gWaterPatchesPerSide^2 patches, each an item of
+	// its own in the transparent layer, in patch order.  mWaterPatchRevisions holds
+	// the mWaterRevision at which each patch's drawn points last changed, by a
+	// published step or disturbance or by a new blend between steps.
+	std::unique_ptr<WaterPatches> mWaterPatches;
+	std::vector<RenderItem*> mWaterPatchRitems;
+	std::vector<UINT64> mWaterPatchRevisions;
+	UINT64 mWaterRevision = 1;
+
+	// The waves' systems in mSimulationSteps.
+	UINT mWaveStepSystem = 0;
+	UINT mWaveDisturbSystem = 0;
+
+	// Draw the CPU waves part way from the previous step's solution to the current
+	// one, by the scheduler's blend, rather than holding each step until the next.
+	// mWaveAlpha is the blend the patches were last staged at.
+	bool mInterpolateWaves = true;
+	float mWaveAlpha = 1.0f;
+
+	// The GPU waves' steps and disturbances are recorded by Draw, so the simulation
+	// stage schedules them into the first two and PublishSimulation hands them over.
+	struct WaveDisturbance
+	{
+		int I;
+		int J;
+		float Magnitude;
+	};
+	UINT mGpuWaveStepsScheduled = 0;
+	std::vector<WaveDisturbance> mGpuWaveDisturbancesScheduled;
+	UINT mGpuWaveSteps = 0;
+	std::vector<WaveDisturbance> mGpuWaveDisturbances;
+
+	// Stream only the CPU waves' heights, into mWaveHeights, and displace a static
+	// grid in the vertex shader as the GPU path does, rather than uploading whole
+	// vertices.  Fixed at startup like mUseGpuWaves.
+	bool mStreamWaveHeights = true;
+
+	// One texel per grid point.  mWaveHeightRevisions holds the mWaterPatchRevisions
+	// each patch's texels were copied at; UpdateWaves stages the stale patches in
+	// this frame's upload memory and Draw copies them in.
+	struct WaveHeightCopy
+	{
+		int Patch;
+		LinearAllocation Upload;
+	};
+	Microsoft::WRL::ComPtr<ID3D12Resource> mWaveHeights;
+	std::vector<UINT64> mWaveHeightRevisions;
+	std::vector<WaveHeightCopy> mWaveHeightCopies;
+	UINT mWaveHeightSrvIndex = 0;
+
+	// Tiles are laid out and culled per frame by UpdateTerrain and drawn as the
+	// instances of mTerrainRitem, after the instanced items' range of the buffer.
+	std::unique_ptr<Terrain> mTerrain;
+	RenderItem* mTerrainRitem = nullptr;
+
+	// Culled by a compute pass at the start of the frame and drawn indirectly with
+	// the material and constants of mVegetationRitem, which has no geometry.
+	std::unique_ptr<Vegetation> mVegetation;
+	RenderItem* mVegetationRitem = nullptr;
+
+	// Point and spot lights at their base strength; UpdateLocalLights animates them
+	// into the frame's LocalLights and a compute pass bins them into clusters.
+	std::vector<Light> mLocalLights;
+	UINT mFirstTorch = 0;
+	std::unique_ptr<ClusteredLighting> mClusteredLighting;
+
+	// GPU time per layer pass, shown in the caption.  'G' writes gpu_profile.csv.
+	std::unique_ptr<GpuProfiler> mGpuProfiler;
+	UINT mFrameScope = 0;
+
+	// Bin the lights on the compute queue, where the cull can overlap the previous
+	// frame's graphics work rather than run ahead of this one's.  Toggle with 'A'.
+	bool mAsyncCompute = true;
+	std::unique_ptr<GpuProfiler> mComputeProfiler;
+
+	// Time the last measured compute pass ran alongside the frame before it on the
+	// direct queue, and that frame's span on the CPU clock.
+	double mAsyncOverlapMs = 0.0;
+	double mPrevGpuFrameBegin = 0.0;
+	double mPrevGpuFrameEnd = 0.0;
+
+	bool mBenchmarking = false;
+
+	// Whether the simulation thread has seeded its rand state.
+	bool mSimulationSeeded = false;
+	BenchmarkSettings mBenchmark;
+	UINT mBenchmarkFrame = 0;
+	__int64 mFrameBeginTime = 0;
+	__int64 mLastFrameEndTime = 0;
+	std::vector<double> mFrameIntervalMs;
+	std::vector<double> mCpuFrameMs;
+	std::vector<double> mGpuFrameMs;
 
     PassConstants mMainPassCB;
 
@@ -163,6 +1162,212 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     try
     {
         TreeBillboardsApp theApp(hInstance);
+
+        // -frameresources <n>: frames the CPU may record ahead of the GPU.
+        // -latency <n>: frames DXGI may queue for presentation.
+        // -present vsync|immediate|vrr: how frames are handed to the display; default immediate.
+        // -benchmark <frames> [-seed <n>] [-benchout <file>]: headless timing run.
+        // -bindless on|off: index textures from the material instead of per-draw tables.
+        // -constants structured|cbuffer: how object and material constants are bound.
+        // -shaders fxc|dxc: compile shader model 5.1 with FXC or 6.0 with DXC.
+        // -precompileshaders: fill the shader cache with every permutation and exit.
+        // -conditiontextures: compress the textures into Textures/Conditioned and exit.
+        // -bindingbenchmark <objects>: time each binding model drawing 1000 objects and
+        //     tenfold up to <objects>, to binding_benchmark.csv or -benchout, and exit.
+        // -cpubenchmark [<threads>]: time geometry generation, the CPU waves on up to
+        //     <threads> threads and the math helpers, to cpu_benchmark.json or -benchout,
+        //     and exit.  Needs no device.
+        // -vertices full|compact|quantized: vertex format of the static meshes; default full.
+        // -optimizemeshes on|off: reorder generated meshes for the vertex cache.
+        // -bakestatic on|off: merge the castle's fixed pieces into per-material batches.
+        // -depthprepass on|off: lay down opaque depth before shading ('Z' toggles).
+        // -oit on|off: order-independent transparency for blended layers ('B' toggles).
+        // -occlusion on|off: GPU occlusion culling of the opaque layer ('H' toggles).
+        // -pipeline on|off: simulate the next frame while recording this one.
+        // -ondemand on|off: draw only when the input, window or streamed textures change.
+        // -minfps <n>: with -ondemand on, draw at least <n> frames a second regardless.
+        // -asynccompute on|off: bin the lights on the compute queue ('A' toggles).
+        // -dynres on|off: lower the render resolution to stay in budget ('D' toggles).
+        // -gpubudget <ms>: GPU frame time dynamic resolution aims for; default the refresh period.
+        // -postaa off|fast|quality: FXAA preset applied to the scene ('X' cycles).
+        // -vrs on|off: coarser shading of fogged pixels, where the device supports it.
+        // -shadows on|off: cascaded shadow maps for the main light ('L' toggles).
+        // -meshshaders on|off: draw the castle as culled meshlets, with -shaders dxc ('N' toggles).
+        // -visbuffer on|off: shade the opaque layer from a visibility buffer, with bindless
+        //     structured constants ('U' toggles).
+        // -virtualtextures on|off: stream material texture mips into tiles as they are sampled.
+        // -texturebudget <MB>: video memory the virtual textures' tiles may take; default 64.
+        // -waves gpu|cpu: simulate the water in compute shaders or on the CPU.
+        // -waveheights on|off: with -waves cpu, upload only the heights rather than vertices.
+        // -waveblend on|off: with -waves cpu, blend the water between simulation steps.
+        // -gpu high|low|<name>: the high-performance or power-saving GPU, or the first
+        //     whose name contains <name>; the capability report goes to the debug output.
+        std::istringstream args(cmdLine);
+        std::string arg;
+        BenchmarkSettings benchmark;
+        bool precompileShaders = false;
+        bool conditionTextures = false;
+        int bindingBenchmarkObjects = 0;
+        bool cpuBenchmark = false;
+        int cpuBenchmarkThreads = 0;
+        while(args >> arg)
+        {
+            int value = 0;
+            if(arg == "-frameresources" && args >> value)
+                gNumFrameResources = MathHelper::Clamp(value, 1, 8);
+            else if(arg == "-latency" && args >> value)
+                theApp.SetMaxFrameLatency((UINT)std::max(value, 1));
+            else if(arg == "-present" && args >> arg)
+            {
+                if(arg == "vsync")
+                    theApp.SetPresentMode(PresentMode::Vsync);
+                else if(arg == "immediate")
+                    theApp.SetPresentMode(PresentMode::Immediate);
+                else if(arg == "vrr")
+                    theApp.SetPresentMode(PresentMode::VariableRefresh);
+            }
+            else if(arg == "-benchmark" && args >> value)
+                benchmark.FrameCount = (UINT)std::max(value, 1);
+            else if(arg == "-seed" && args >> value)
+                benchmark.Seed = (unsigned int)value;
+            else if(arg == "-benchout" && args >> arg)
+                benchmark.OutputFile = AnsiToWString(arg);
+            else if(arg == "-bindless" && args >> arg)
+                theApp.SetBindless(arg != "off");
+            else if(arg == "-constants" && args >> arg)
+                theApp.SetStructuredConstants(arg != "cbuffer");
+            else if(arg == "-shaders" && args >> arg)
+                theApp.SetShaderCompiler(arg == "dxc" ? ShaderCompiler::Dxc : ShaderCompiler::Fxc);
+            else if(arg == "-precompileshaders")
+                precompileShaders = true;
+            else if(arg == "-conditiontextures")
+                conditionTextures = true;
+            else if(arg == "-bindingbenchmark" && args >> value)
+                bindingBenchmarkObjects = std::max(value, 1000);
+            else if(arg == "-cpubenchmark")
+            {
+                cpuBenchmark = true;
+
+                // The thread count is optional, so only consume the next argument
+                // if it is one.
+                std::istringstream::pos_type next = args.tellg();
+                if(args >> value)
+                    cpuBenchmarkThreads = std::max(value, 1);
+                else
+                {
+                    args.clear();
+                    args.seekg(next);
+                }
+            }
+            else if(arg == "-vertices" && args >> arg)
+            {
+                for(UINT i = 0; i < (UINT)VertexFormat::Count; ++i)
+                {
+                    if(arg == gVertexFormats[i].Name)
+                        theApp.SetVertexFormat((VertexFormat)i);
+                }
+            }
+            else if(arg == "-optimizemeshes" && args >> arg)
+                theApp.SetOptimizeMeshes(arg != "off");
+            else if(arg == "-bakestatic" && args >> arg)
+                theApp.SetBakeStaticGeometry(arg != "off");
+            else if(arg == "-depthprepass" && args >> arg)
+                theApp.SetDepthPrepass(arg != "off");
+            else if(arg == "-oit" && args >> arg)
+                theApp.SetOit(arg != "off");
+            else if(arg == "-occlusion" && args >> arg)
+                theApp.SetOcclusionCulling(arg != "off");
+            else if(arg == "-pipeline" && args >> arg)
+                theApp.SetPipelined(arg != "off");
+            else if(arg == "-ondemand" && args >> arg)
+                theApp.SetRenderOnDemand(arg != "off");
+            else if(arg == "-minfps" && args >> value)
+                theApp.SetMinimumFrameRate((double)std::max(value, 0));
+            else if(arg == "-asynccompute" && args >> arg)
+                theApp.SetAsyncCompute(arg != "off");
+            else if(arg == "-dynres" && args >> arg)
+                theApp.SetDynamicResolution(arg != "off");
+            else if(arg == "-gpubudget" && args >> value)
+                theApp.SetGpuBudget((double)std::max(value, 1));
+            else if(arg == "-postaa" && args >> arg)
+            {
+                for(int i = 0; i < (int)PostAA::Count; ++i)
+                {
+                    if(arg == gPostAAModes[i].Name)
+                        theApp.SetPostAA((PostAA)i);
+                }
+            }
+            else if(arg == "-vrs" && args >> arg)
+                theApp.SetVariableRateShading(arg != "off");
+            else if(arg == "-shadows" && args >> arg)
+                theApp.SetShadows(arg != "off");
+            else if(arg == "-meshshaders" && args >> arg)
+                theApp.SetMeshShaders(arg != "off");
+            else if(arg == "-visbuffer" && args >> arg)
+                theApp.SetVisibilityBuffer(arg != "off");
+            else if(arg == "-virtualtextures" && args >> arg)
+                theApp.SetVirtualTextures(arg != "off");
+            else if(arg == "-texturebudget" && args >> value)
+                theApp.SetTextureBudget((UINT)std::max(value, 1));
+            else if(arg == "-waves" && args >> arg)
+                theApp.SetGpuWaves(arg != "cpu");
+            else if(arg == "-waveheights" && args >> arg)
+                theApp.SetStreamWaveHeights(arg != "off");
+            else if(arg == "-waveblend" && args >> arg)
+                theApp.SetInterpolateWaves(arg != "off");
+            else if(arg == "-gpu" && args >> arg)
+            {
+                if(arg == "high")
+                    theApp.SetAdapterPreference(DXGI_GPU_PREFERENCE_HIGH_PERFORMANCE);
+                else if(arg == "low")
+                    theApp.SetAdapterPreference(DXGI_GPU_PREFERENCE_MINIMUM_POWER);
+                else
+                    theApp.SetAdapterName(AnsiToWString(arg));
+            }
+        }
+
+        // With simulation off the critical path the CPU gets further ahead of the
+        // GPU, so give it a frame resource for the frame being simulated, one being
+        // recorded and one in flight.
+        if(theApp.GetPipelined())
+            gNumFrameResources = std::max(gNumFrameResources, 3);
+
+        // Run from a build step, so report failure through the exit code rather
+        // than a message box.
+        if(precompileShaders || conditionTextures || bindingBenchmarkObjects > 0 || cpuBenchmark)
+        {
+            // -benchout names the output here too, unless left at the frame benchmark's default.
+            const bool benchout = benchmark.OutputFile != BenchmarkSettings().OutputFile;
+
+            try
+            {
+                if(precompileShaders)
+                    theApp.PrecompileShaders();
+                if(conditionTextures)
+                    theApp.ConditionTextures();
+                if(bindingBenchmarkObjects > 0)
+                {
+                    theApp.RunBindingBenchmark((UINT)bindingBenchmarkObjects,
+                        benchout ? benchmark.OutputFile : L"binding_benchmark.csv");
+                }
+                if(cpuBenchmark)
+                {
+                    CpuBenchmark cpu;
+                    cpu.Run((UINT)cpuBenchmarkThreads);
+                    cpu.WriteJson(benchout ? benchmark.OutputFile : L"cpu_benchmark.json");
+                }
+            }
+            catch(DxException& e)
+            {
+                OutputDebugString(e.ToString().c_str());
+                return 1;
+            }
+            return 0;
+        }
+
+        if(benchmark.FrameCount > 0)
+            theApp.EnableBenchmark(benchmark);
+
         if(!theApp.Initialize())
             return 0;
 
@@ -186,810 +1391,3363 @@ TreeBillboardsApp::~TreeBillboardsApp()
         FlushCommandQueue();
 }
 
-bool TreeBillboardsApp::Initialize()
+void TreeBillboardsApp::SetBindless(bool enable)
 {
-    if(!D3DApp::Initialize())
-        return false;
+	mBindless = enable;
+}
 
-    // Reset the command list to prep for initialization commands.
-    ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+void TreeBillboardsApp::SetStructuredConstants(bool enable)
+{
+	mStructuredConstants = enable;
+}
 
-    // Get the increment size of a descriptor in this heap type.  This is hardware specific, 
-	// so we have to query this information.
-    mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+void TreeBillboardsApp::SetShaderCompiler(ShaderCompiler compiler)
+{
+	mShaderCompiler = compiler;
+}
 
-    mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
- 
-	LoadTextures();
-    BuildRootSignature();
-	BuildDescriptorHeaps();
-    BuildShadersAndInputLayouts();
-	BuildShapeGeometry();
-    BuildLandGeometry();
-    BuildWavesGeometry();
-	BuildBoxGeometry();
-	BuildTreeSpritesGeometry();
-	BuildMaterials();
-    BuildRenderItems();
-    BuildFrameResources();
-    BuildPSOs();
+void TreeBillboardsApp::SetVertexFormat(VertexFormat format)
+{
+	mVertexFormat = format;
+}
 
-    // Execute the initialization commands.
-    ThrowIfFailed(mCommandList->Close());
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+void TreeBillboardsApp::SetOptimizeMeshes(bool enable)
+{
+	mOptimizeMeshes = enable;
+}
 
-    // Wait until initialization is complete.
-    FlushCommandQueue();
+void TreeBillboardsApp::SetBakeStaticGeometry(bool enable)
+{
+	mBakeStaticGeometry = enable;
+}
 
-    return true;
+void TreeBillboardsApp::SetDepthPrepass(bool enable)
+{
+	mDepthPrepass = enable;
 }
- 
-void TreeBillboardsApp::OnResize()
+
+void TreeBillboardsApp::SetOit(bool enable)
 {
-    D3DApp::OnResize();
+	mOit = enable;
+}
 
-    // The window resized, so update the aspect ratio and recompute the projection matrix.
-    XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
-    XMStoreFloat4x4(&mProj, P);
+void TreeBillboardsApp::SetOcclusionCulling(bool enable)
+{
+	mOcclusionCulling = enable;
 }
 
-void TreeBillboardsApp::Update(const GameTimer& gt)
+void TreeBillboardsApp::SetAsyncCompute(bool enable)
 {
-    OnKeyboardInput(gt);
-	UpdateCamera(gt);
+	mAsyncCompute = enable;
+}
 
-    // Cycle through the circular frame resource array.
-    mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
-    mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
+void TreeBillboardsApp::SetDynamicResolution(bool enable)
+{
+	mDynamicResolution = enable;
+}
 
-    // Has the GPU finished processing the commands of the current frame resource?
-    // If not, wait until the GPU has completed commands up to this fence point.
-    if(mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
-    {
-        HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
-    }
+void TreeBillboardsApp::SetGpuBudget(double ms)
+{
+	mGpuBudgetMs = ms;
+}
 
-	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
-	UpdateMaterialCBs(gt);
-	UpdateMainPassCB(gt);
-    UpdateWaves(gt);
+void TreeBillboardsApp::SetPostAA(PostAA mode)
+{
+	mPostAA = mode;
 }
 
-void TreeBillboardsApp::Draw(const GameTimer& gt)
+void TreeBillboardsApp::SetVariableRateShading(bool enable)
 {
-    auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
+	mVariableRateShading = enable;
+}
 
-    // Reuse the memory associated with command recording.
-    // We can only reset when the associated command lists have finished execution on the GPU.
-    ThrowIfFailed(cmdListAlloc->Reset());
+void TreeBillboardsApp::SetShadows(bool enable)
+{
+	mShadows = enable;
+}
 
-    // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
-    // Reusing the command list reuses memory.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+void TreeBillboardsApp::SetMeshShaders(bool enable)
+{
+	mMeshShaders = enable;
+}
 
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+void TreeBillboardsApp::SetVisibilityBuffer(bool enable)
+{
+	mVisibilityBuffer = enable;
+}
 
-    // Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+void TreeBillboardsApp::SetVirtualTextures(bool enable)
+{
+	mVirtualTexturing = enable;
+}
 
-    // Clear the back buffer and depth buffer.
-    mCommandList->ClearRenderTargetView(CurrentBackBufferView(), (float*)&mMainPassCB.FogColor, 0, nullptr);
-    mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+void TreeBillboardsApp::SetTextureBudget(UINT megabytes)
+{
+	mTextureBudgetMB = megabytes;
+}
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+void TreeBillboardsApp::SetGpuWaves(bool enable)
+{
+	mUseGpuWaves = enable;
+}
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+void TreeBillboardsApp::SetStreamWaveHeights(bool enable)
+{
+	mStreamWaveHeights = enable;
+}
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+void TreeBillboardsApp::SetInterpolateWaves(bool enable)
+{
+	mInterpolateWaves = enable;
+}
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+void TreeBillboardsApp::PrecompileShaders()
+{
+	const bool bindless = mBindless;
+	const bool structuredConstants = mStructuredConstants;
+	const bool virtualTexturing = mVirtualTexturing;
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	mShaderCache = std::make_unique<ShaderCache>(gShaderCacheDirectory, mShaderCompiler);
+	for(int i = 0; i < 8; ++i)
+	{
+		mBindless = (i & 1) != 0;
+		mStructuredConstants = (i & 2) != 0;
+		mVirtualTexturing = (i & 4) != 0;
+		BuildShadersAndInputLayouts();
 
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+		// The Default.hlsl permutations the last run drew with, in every mode.
+		mShaderPermutations->Precompile(gShaderManifestFile);
+	}
 
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+	mBindless = bindless;
+	mStructuredConstants = structuredConstants;
+	mVirtualTexturing = virtualTexturing;
+	mShaders.Clear();
+	mShaderPermutations = nullptr;
+}
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+void TreeBillboardsApp::ConditionTextures()
+{
+	TextureConditioner conditioner;
+	for(const auto& job : gTextureJobs)
+	{
+		std::vector<std::wstring> sources;
+		for(UINT i = 0; i < _countof(job.Sources) && job.Sources[i] != nullptr; ++i)
+			sources.push_back(gTextureDirectory + std::wstring(job.Sources[i]));
 
-    // Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+		// A source already in the job's encoding with its mips needs no copy.
+		if(sources.size() == 1 && TextureConditioner::IsConditioned(sources[0], job.Encoding))
+			continue;
 
-    // Done recording commands.
-    ThrowIfFailed(mCommandList->Close());
+		std::wstring output = gConditionedTextureDirectory + std::wstring(job.Output);
+		if(TextureConditioner::IsUpToDate(sources, output))
+			continue;
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+		conditioner.Condition(sources, job.Encoding, output);
+		OutputDebugStringW((L"Conditioned " + output + L"\n").c_str());
+	}
+}
 
-    // Swap the back and front buffers
-    ThrowIfFailed(mSwapChain->Present(0, 0));
-	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+void TreeBillboardsApp::RunBindingBenchmark(UINT maxObjects, const std::wstring& outputFile)
+{
+	const UINT FrameCount = 16;
 
-    // Advance the fence value to mark commands up to this fence point.
-    mCurrFrameResource->Fence = ++mCurrentFence;
+	mHeadless = true;
+	if(!D3DApp::Initialize())
+		ThrowIfFailed(E_FAIL);
 
-    // Add an instruction to the command queue to set a new fence point. 
-    // Because we are on the GPU timeline, the new fence point won't be 
-    // set until the GPU finishes processing all the commands prior to this Signal().
-    mCommandQueue->Signal(mFence.Get(), mCurrentFence);
-}
+	mShaderCache = std::make_unique<ShaderCache>(gShaderCacheDirectory, mShaderCompiler);
 
-void TreeBillboardsApp::OnMouseDown(WPARAM btnState, int x, int y)
-{
-    mLastMousePos.x = x;
-    mLastMousePos.y = y;
+	// Unbounded CBV ranges, unlike SRV ones, need tier 3.
+	BindingBenchmark benchmark(md3dDevice.Get(), mCommandQueue.Get(), mShaderCache.get(),
+		Caps().ResourceBindingTier >= D3D12_RESOURCE_BINDING_TIER_3);
+
+	maxObjects = std::min(maxObjects, BindingBenchmark::MaxObjects);
+
+	std::vector<BindingBenchmarkResult> results;
+	for(UINT objectCount = 1000; objectCount <= maxObjects; objectCount *= 10)
+	{
+		auto counted = benchmark.Run(objectCount, FrameCount);
+		results.insert(results.end(), counted.begin(), counted.end());
+	}
+	BindingBenchmark::WriteResults(results, outputFile);
+}
+
+void TreeBillboardsApp::EnableBenchmark(const BenchmarkSettings& settings)
+{
+	mBenchmarking = true;
+	mBenchmark = settings;
+
+	mHeadless = true;
+	mTimer.SetFixedTimeStep(settings.TimeStep);
+
+	// MathHelper::Rand drives the wave disturbances.
+	srand(settings.Seed);
+
+	mFrameIntervalMs.reserve(settings.FrameCount);
+	mCpuFrameMs.reserve(settings.FrameCount);
+	mGpuFrameMs.reserve(settings.FrameCount);
+}
+
+bool TreeBillboardsApp::Initialize()
+{
+    if(!D3DApp::Initialize())
+        return false;
+
+    // Reset the command list to prep for initialization commands.
+    ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+
+    // Get the increment size of a descriptor in this heap type.  This is hardware specific, 
+	// so we have to query this information.
+    mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	mResidency = std::make_unique<ResidencyManager>(md3dDevice.Get(), mdxgiFactory.Get());
+
+	// Name the GPU in the caption, so captured numbers say which one they are from.
+	mMainWndCaption += L" - " + Caps().AdapterName;
+
+	if(!Caps().BindlessSupported())
+		mBindless = false;
+
+	// Reserved resources need tiled resources; without them every texture streams whole.
+	if(Caps().TiledResourcesTier < D3D12_TILED_RESOURCES_TIER_1)
+		mVirtualTexturing = false;
+
+	mDescriptors = std::make_unique<DescriptorAllocator>(md3dDevice.Get());
+	mGeometryHeap = std::make_unique<GeometryHeap>(md3dDevice.Get());
+
+	// DXC output needs shader model 6.
+	if(mShaderCompiler == ShaderCompiler::Dxc && Caps().HighestShaderModel < D3D_SHADER_MODEL_6_0)
+		mShaderCompiler = ShaderCompiler::Fxc;
+	mShaderCache = std::make_unique<ShaderCache>(gShaderCacheDirectory, mShaderCompiler);
+	mPipelineCache = std::make_unique<PipelineCache>(md3dDevice.Get(), L"pipeline_cache.bin");
+
+	// Only DXC compiles mesh shaders.  The meshlets and their PSOs are built whenever
+	// they can be, so 'N' can switch to them.
+	mMeshShadersSupported = Caps().MeshShadersSupported() && mShaderCache->Compiler() == ShaderCompiler::Dxc;
+
+	// The id pass takes each draw's object index from its root constant, and the
+	// resolve samples whichever material the pixel's object has.  Like the meshlets,
+	// the visibility buffer is built whenever it can be, so 'U' can switch to it.
+	mVisibilityBufferSupported = mBindless && mStructuredConstants;
+
+	// Everything that records into mCommandList or tracks residency runs on this
+	// thread, so the uploads still go out in the one submission below.  The rest
+	// runs on workers as soon as what it reads has been built.
+	StartupGraph startup;
+	startup.Add("waves", {}, [this]()
+	{
+		if(mUseGpuWaves)
+		{
+			mGpuWaves = std::make_unique<GpuWaves>(md3dDevice.Get(), mCommandList.Get(), 512, 512, 0.25f, 0.03f, 4.0f, 0.2f);
+			for(auto resource : mGpuWaves->Resources())
+				mResidency->Track(resource, ResidencyCategory::Compute);
+		}
+		else
+		{
+			const int gridSize = gWaterPatchesPerSide*gWaterPatchQuads + 1;
+			mWaves = std::make_unique<Waves>(gridSize, gridSize, 1.0f, 0.03f, 4.0f, 0.2f);
+			mWaterPatches = std::make_unique<WaterPatches>(*mWaves, gWaterPatchesPerSide, gWaterPatchQuads,
+				gWaterLodCount, gWaterActiveRadius);
+			mWaterPatches->Update(mEyePos);
+			mWaves->SetActiveRegion(mWaterPatches->ActiveRegion());
+			mWaterPatchRevisions.assign(mWaterPatches->PatchCount(), mWaterRevision);
+
+			if(mStreamWaveHeights)
+			{
+				ThrowIfFailed(md3dDevice->CreateCommittedResource(
+					&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+					D3D12_HEAP_FLAG_NONE,
+					&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_FLOAT, gridSize, gridSize, 1, 1),
+					D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+					nullptr,
+					IID_PPV_ARGS(&mWaveHeights)));
+				mResidency->Track(mWaveHeights.Get(), ResidencyCategory::Texture);
+
+				// Nothing has been copied in, so the first frame copies every patch.
+				mWaveHeightRevisions.assign(mWaterPatches->PatchCount(), 0);
+			}
+		}
+	}, StartupThread::Main);
+	startup.Add("textures", {}, [this]() { LoadTextures(); }, StartupThread::Main);
+	startup.Add("rootSignature", {}, [this]()
+	{
+		BuildRootSignature();
+		BuildVegetationRootSignature();
+		BuildLightCullRootSignature();
+		BuildOitRootSignature();
+		BuildUpscaleRootSignature();
+		BuildPostAARootSignature();
+		BuildShadingRateRootSignature();
+		BuildOcclusionRootSignatures();
+		if(mUseGpuWaves)
+			BuildWavesRootSignature();
+	});
+	startup.Add("commandSignature", { "rootSignature" }, [this]() { BuildCommandSignature(); });
+	startup.Add("descriptors", { "waves", "textures" }, [this]() { BuildDescriptorHeaps(); });
+	startup.Add("shaders", {}, [this]() { BuildShadersAndInputLayouts(); });
+	startup.Add("shapeGeometry", {}, [this]() { BuildShapeGeometry(); });
+	startup.Add("meshlets", { "shapeGeometry" }, [this]() { BuildMeshlets(); });
+	startup.Add("staticBatches", { "shapeGeometry" }, [this]() { BuildStaticBatches(); });
+	startup.Add("terrainGeometry", {}, [this]() { BuildTerrainGeometry(); });
+	startup.Add("wavesGeometry", { "waves" }, [this]()
+	{
+		if(mUseGpuWaves)
+			BuildGpuWavesGeometry();
+		else
+			BuildWavesGeometry();
+	});
+	startup.Add("boxGeometry", {}, [this]() { BuildBoxGeometry(); });
+	startup.Add("vegetation", {}, [this]() { BuildVegetation(); }, StartupThread::Main);
+	startup.Add("localLights", {}, [this]() { BuildLocalLights(); }, StartupThread::Main);
+	startup.Add("geometryUploads",
+		{ "shapeGeometry", "meshlets", "staticBatches", "terrainGeometry", "wavesGeometry", "boxGeometry" }, [this]()
+	{
+		mGeometryHeap->RecordUploads(mCommandList.Get());
+		for(UINT i = 0; i < mGeometryHeap->HeapCount(); ++i)
+			mResidency->Track(mGeometryHeap->Heap(i), ResidencyCategory::Geometry);
+	}, StartupThread::Main);
+	startup.Add("materials", { "descriptors" }, [this]() { BuildMaterials(); });
+	startup.Add("renderItems", { "materials", "geometryUploads" }, [this]() { BuildRenderItems(); });
+	startup.Add("frameResources", { "renderItems", "localLights" }, [this]() { BuildFrameResources(); });
+	startup.Add("occlusion", { "renderItems" }, [this]() { BuildOcclusionCulling(); }, StartupThread::Main);
+	startup.Add("psos", { "rootSignature", "shaders" }, [this]() { BuildPSOs(); });
+	startup.Add("visibilityBuffer", { "descriptors", "renderItems", "psos" }, [this]() { BuildVisibilityBuffer(); },
+		StartupThread::Main);
+	startup.Add("psoVariants", { "psos", "renderItems", "localLights", "visibilityBuffer" }, [this]()
+	{
+		BuildPsoVariants();
+		mPipelineCache->Save();
+		mShaderPermutations->WriteManifest(gShaderManifestFile);
+	});
+	startup.Run();
+	BuildSimulationSystems();
+
+	std::string timeline = startup.Timeline();
+	OutputDebugStringA(("Startup timeline:\n" + timeline).c_str());
+	startup.WriteTimeline(L"startup_timeline.csv");
+
+	// One scope per layer pass plus the frame, the wave simulation, the vegetation
+	// and light culls, the shadow maps, the depth pre-pass, the shading rate image,
+	// the visibility buffer's id pass and resolve, the OIT composite, the post AA and
+	// the upscale.
+	mGpuProfiler = std::make_unique<GpuProfiler>(md3dDevice.Get(), mCommandQueue.Get(),
+		gNumFrameResources, gNumLayerPasses + 12);
+	mComputeProfiler = std::make_unique<GpuProfiler>(md3dDevice.Get(), mComputeQueue.Get(),
+		gNumFrameResources, 4);
+
+    // Execute the initialization commands.
+    ThrowIfFailed(mCommandList->Close());
+    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+    // Wait until initialization is complete.
+    FlushCommandQueue();
+
+	// The initial copies have executed; drop everything that only fed them.
+	mGeometryHeap->ReleaseStaging();
+	for(auto& geo : mGeometries)
+		geo->DisposeUploaders();
+	mTextures["fallbackTex"]->UploadHeap = nullptr;
+	if(mUseGpuWaves)
+		mGpuWaves->ReleaseUploadBuffers();
+	mVegetation->ReleaseUploadBuffers();
+
+    return true;
+}
+ 
+void TreeBillboardsApp::CreateRtvAndDsvDescriptorHeaps()
+{
+	// Add +2 for the OIT targets, +1 for the dynamic resolution target and +1 for
+	// the visibility buffer.
+	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
+	rtvHeapDesc.NumDescriptors = SwapChainBufferCount + OitTargets::RtvCount + 1 + VisibilityBuffer::RtvCount;
+	rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	rtvHeapDesc.NodeMask = 0;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
+		&rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
+
+	// Add the shadow map slices after the depth buffer.
+	D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
+	dsvHeapDesc.NumDescriptors = 1 + CascadedShadowMaps::DsvCount;
+	dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	dsvHeapDesc.NodeMask = 0;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
+		&dsvHeapDesc, IID_PPV_ARGS(mDsvHeap.GetAddressOf())));
+}
+
+void TreeBillboardsApp::OnResize()
+{
+    D3DApp::OnResize();
+
+	// The first resize comes before BuildDescriptorHeaps creates the targets.  Any
+	// later one has flushed the queue if the size changed.
+	if(mOitTargets != nullptr)
+	{
+		mOitTargets->Resize(mClientWidth, mClientHeight);
+		BuildOitDescriptors();
+
+		mDynamicRes->Resize(mClientWidth, mClientHeight);
+		BuildDynamicResolutionDescriptors();
+
+		// The graph gives the pass a new output on the next frame.
+		mPostAntiAliasing->Resize(mClientWidth, mClientHeight);
+	}
+
+	// The depth buffer was recreated, so the pyramid is rebuilt from scratch.
+	if(mOcclusion != nullptr)
+	{
+		mOcclusion->Resize(mDepthStencilBuffer.Get(), mClientWidth, mClientHeight);
+		BuildOcclusionDescriptors();
+	}
+	if(mVrs != nullptr)
+	{
+		mVrs->Resize(mDepthStencilBuffer.Get(), mClientWidth, mClientHeight);
+		BuildVrsDescriptors();
+	}
+	if(mVisibility != nullptr)
+	{
+		mVisibility->Resize(mClientWidth, mClientHeight);
+		BuildVisibilityDescriptors();
+	}
+
+    // The window resized, so update the aspect ratio and recompute the projection matrix.
+    XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, gFarPlane);
+    XMStoreFloat4x4(&mProj, P);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
+}
+
+void TreeBillboardsApp::Update(const GameTimer& gt)
+{
+	if(mBenchmarking)
+		QueryPerformanceCounter((LARGE_INTEGER*)&mFrameBeginTime);
+
+	{
+		PROFILE_SCOPE("OnKeyboardInput");
+		OnKeyboardInput(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateCamera");
+		UpdateCamera(gt);
+	}
+
+    // Cycle through the circular frame resource array.
+    mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+    mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
+
+    // Has the GPU finished processing the commands of the current frame resource?
+    // If not, wait until the GPU has completed commands up to this fence point.
+    if(mCurrFrameResource->Fence != 0)
+        WaitForFence(mCurrFrameResource->Fence);
+
+	mDescriptors->BeginFrame(mCurrentFence + 1, mFence->GetCompletedValue());
+
+	// The GPU is done with this frame's upload memory; hand it out again.
+	// A pass for the camera and one per shadow cascade.
+	mCurrFrameResource->AllocateFrameData(1 + CascadedShadowMaps::CascadeCount, (UINT)mAllRitems.size(), mMaterials.Size(),
+		mInstanceCount + mTerrain->MaxTileCount(), WaveVertexCount(), (UINT)mLocalLights.size(),
+		mShadowInstanceCount, mStructuredConstants, VisibilityBufferActive());
+
+	if(mTextureStreamer->PendingCount() > 0)
+	{
+		PROFILE_SCOPE("UpdateStreamedTextures");
+		UpdateStreamedTextures();
+	}
+
+	// Ahead of UpdateMaterialCBs, which writes the mip clamps it changes.
+	if(mVirtualTexturing)
+	{
+		PROFILE_SCOPE("UpdateVirtualTextures");
+		UpdateVirtualTextures();
+	}
+
+	{
+		PROFILE_SCOPE("AnimateMaterials");
+		AnimateMaterials(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateObjectCBs");
+		UpdateObjectCBs(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateMaterialCBs");
+		UpdateMaterialCBs(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateDynamicResolution");
+		UpdateDynamicResolution();
+	}
+	{
+		PROFILE_SCOPE("UpdateRenderGraph");
+		UpdateRenderGraph();
+	}
+	{
+		PROFILE_SCOPE("UpdateShadows");
+		UpdateShadows(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateMainPassCB");
+		UpdateMainPassCB(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateLocalLights");
+		UpdateLocalLights(gt);
+	}
+	if(!mUseGpuWaves)
+	{
+		PROFILE_SCOPE("UpdateWaves");
+		UpdateWaves(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateVisibility");
+		UpdateVisibility(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateInstanceBuffer");
+		UpdateInstanceBuffer(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateTerrain");
+		UpdateTerrain(gt);
+	}
+	if(mSortDraws)
+	{
+		PROFILE_SCOPE("UpdateRenderQueue");
+		UpdateRenderQueue(gt);
+	}
+	{
+		PROFILE_SCOPE("UpdateIndirectCommands");
+		UpdateIndirectCommands(gt);
+	}
+	if(VisibilityBufferActive())
+	{
+		PROFILE_SCOPE("UpdateVisibilityGeometry");
+		UpdateVisibilityGeometry();
+	}
+	{
+		PROFILE_SCOPE("UpdateResidency");
+		UpdateResidency();
+	}
+}
+
+void TreeBillboardsApp::Draw(const GameTimer& gt)
+{
+    auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
+
+    // Reuse the memory associated with command recording.
+    // We can only reset when the associated command lists have finished execution on the GPU.
+    ThrowIfFailed(cmdListAlloc->Reset());
+
+    // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
+    // Reusing the command list reuses memory.
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), nullptr));
+
+	// The fence wait in Update guarantees this frame resource's timestamps are ready.
+	mGpuProfiler->BeginFrame(mCurrFrameResourceIndex);
+	mComputeProfiler->BeginFrame(mCurrFrameResourceIndex);
+
+	// Both profilers just read back the same frame; its compute pass is compared
+	// with the direct queue's frame before it.
+	double computeBegin = 0.0;
+	double computeEnd = 0.0;
+	if(mAsyncCompute && mComputeProfiler->LastInterval("lightCull", computeBegin, computeEnd))
+	{
+		mAsyncOverlapMs = std::max(0.0,
+			std::min(computeEnd, mPrevGpuFrameEnd) - std::max(computeBegin, mPrevGpuFrameBegin));
+	}
+	else
+		mAsyncOverlapMs = 0.0;
+	mGpuProfiler->LastInterval("frame", mPrevGpuFrameBegin, mPrevGpuFrameEnd);
+
+	mFrameScope = mGpuProfiler->BeginScope(mCommandList.Get(), "frame");
+
+	// Read back what the last frame asked for and start this frame's requests afresh.
+	if(mVirtualTexturing)
+		mMipFeedback->BeginFrame(mCommandList.Get(), mCurrFrameResourceIndex);
+
+	// Step the water simulation ahead of any list that samples the displacement map.
+	if(mUseGpuWaves)
+	{
+		ID3D12DescriptorHeap* descriptorHeaps[] = { mDescriptors->Heap() };
+		mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+		UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "wavesSim");
+		UpdateWavesGPU(gt);
+		mGpuProfiler->EndScope(mCommandList.Get(), scope);
+	}
+	else if(!mWaveHeightCopies.empty())
+	{
+		UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "wavesUpload");
+		CopyWaveHeights();
+		mGpuProfiler->EndScope(mCommandList.Get(), scope);
+	}
+
+	// Compact this frame's visible trees ahead of the list that draws them.  Past
+	// the end of the fog they would be drawn in the fog color, so they are dropped.
+	{
+		UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "vegetationCull");
+		mVegetation->Cull(mCommandList.Get(), mVegetationRootSignature.Get(), mPSOs[mFramePsos.VegetationCull].Get(),
+			mWorldFrustum, mFrustumCulling, mEyePos, mMainPassCB.gFogStart + mMainPassCB.gFogRange);
+		mGpuProfiler->EndScope(mCommandList.Get(), scope);
+	}
+
+	// Bin this frame's local lights for the pixel shaders of every pass.
+	if(mAsyncCompute)
+		SubmitAsyncCompute();
+	else
+	{
+		UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "lightCull");
+		mClusteredLighting->Cull(mCommandList.Get(), mLightCullRootSignature.Get(), mPSOs[mFramePsos.LightCull].Get(),
+			mCurrFrameResourceIndex, mView, mProj, mCurrFrameResource->LocalLights.GpuAddress(), (UINT)mLocalLights.size());
+		mGpuProfiler->EndScope(mCommandList.Get(), scope);
+	}
+
+	// Ahead of every pass that samples the shadow maps.
+	CommandListStats shadowStats = DrawShadows();
+
+    // Indicate a state transition on the resource usage.
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+    // Clear the back buffer and depth buffer.  At a lower resolution the scene target
+    // is cleared instead, and the upscale covers every back buffer pixel.
+	if(SceneOffscreen())
+		mDynamicRes->Begin(mCommandList.Get());
+	else
+		mCommandList->ClearRenderTargetView(CurrentBackBufferView(), (float*)&mMainPassCB.FogColor, 0, nullptr);
+    mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+	if(mOit)
+		mOitTargets->Clear(mCommandList.Get());
+
+	// The opaque layer's triangle ids, and its depth, ahead of everything else.
+	// Like the pre-pass, kept on the main list.
+	CommandListStats prepassStats;
+	mShadingRateImageReady = false;
+	if(VisibilityBufferActive())
+	{
+		CachedCommandList cmdList(mCommandList.Get());
+		SetCommonPassState(cmdList);
+		mVisibility->Clear(mCommandList.Get());
+		mVisibility->Bind(mCommandList.Get(), DepthStencilView());
+
+		UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "visibility");
+		if(!mRitemLayer[(int)RenderLayer::Opaque].empty())
+			DrawLayer(cmdList, RenderLayer::Opaque, DepthPass::Visibility);
+		mGpuProfiler->EndScope(mCommandList.Get(), scope);
+
+		prepassStats += cmdList.Stats();
+	}
+
+	// Depth-only draws of the pre-pass layers, ahead of every shading pass.  Kept on
+	// the main list so parallel recording needs no extra list or ordering.
+	if(mDepthPrepass)
+	{
+		CachedCommandList cmdList(mCommandList.Get());
+		SetCommonPassState(cmdList);
+
+		UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "depthPrepass");
+		for(const auto& pass : gLayerPasses)
+		{
+			if(pass.DepthPrepass && DrawsForward(pass.Layer) && !mRitemLayer[(int)pass.Layer].empty())
+				DrawLayer(cmdList, pass.Layer, DepthPass::Prepass);
+		}
+		mGpuProfiler->EndScope(mCommandList.Get(), scope);
+
+		prepassStats += cmdList.Stats();
+
+		// With this frame's depth in, coarsen the tiles the fog covers.
+		if(VrsActive() && mVrs->ImageSupported())
+		{
+			scope = mGpuProfiler->BeginScope(mCommandList.Get(), "shadingRate");
+			mVrs->BuildImage(mCommandList.Get(), mShadingRateRootSignature.Get(), mPSOs[mFramePsos.ShadingRate].Get(),
+				mProj, (UINT)mSceneViewport.Width, (UINT)mSceneViewport.Height,
+				mMainPassCB.gFogStart, mMainPassCB.gFogRange);
+			mGpuProfiler->EndScope(mCommandList.Get(), scope);
+			mShadingRateImageReady = true;
+		}
+	}
+
+	// Shade the opaque layer from its ids, once per pixel, under the layers drawn
+	// forward after it.  Full rate: the resolve is one full-screen draw, so a coarse
+	// tile would share one id's shading across the silhouettes inside it.  The
+	// passes after it bind the shading rate again in SetCommonPassState.
+	if(VisibilityBufferActive())
+	{
+		CachedCommandList cmdList(mCommandList.Get());
+		SetCommonPassState(cmdList);
+		if(VrsActive())
+			mVrs->Unbind(cmdList);
+
+		UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "visibilityResolve");
+		mVisibility->Resolve(mCommandList.Get(), mPSOs[mFramePsos.VisibilityResolve].Get(), mVisibilityRootParameter,
+			mCurrFrameResource->VisibilityGeometries.GpuAddress(), SceneRtv());
+		mGpuProfiler->EndScope(mCommandList.Get(), scope);
+
+		prepassStats += cmdList.Stats();
+	}
+
+	if(mParallelRecord)
+	{
+		// The main list only clears, lays down depth and resolves the visibility
+		// buffer; the layer passes follow on the worker lists.
+		ThrowIfFailed(mCommandList->Close());
+
+		// Submit everything in one call, in draw order.
+		ID3D12CommandList* cmdsLists[1 + gNumLayerPasses];
+		cmdsLists[0] = mCommandList.Get();
+		UINT cmdListCount = 1;
+		{
+			PROFILE_SCOPE("RecordLayersParallel");
+			cmdListCount += RecordLayersParallel(cmdsLists + 1);
+		}
+		mRecordStats += prepassStats;
+		mRecordStats += shadowStats;
+
+		mCommandQueue->ExecuteCommandLists(cmdListCount, cmdsLists);
+	}
+	else
+	{
+		CachedCommandList cmdList(mCommandList.Get());
+		SetCommonPassState(cmdList);
+
+		for(const auto& pass : gLayerPasses)
+		{
+			// Only one of Transparent and GpuWaves is populated, and the PSO of the
+			// other may not exist.
+			if(mRitemLayer[(int)pass.Layer].empty() || !DrawsForward(pass.Layer))
+				continue;
+
+			// The blended layers come last, so once they switch to the OIT targets
+			// nothing else draws to the back buffer before the composite.
+			DepthPass depthPass = ShadingPass(pass);
+			if(depthPass == DepthPass::Oit)
+				mOitTargets->Bind(mCommandList.Get(), DepthStencilView());
+
+			// The draws set the PSO of their item's variant.
+			UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), pass.PsoName);
+			DrawLayer(cmdList, pass.Layer, depthPass);
+			mGpuProfiler->EndScope(mCommandList.Get(), scope);
+		}
+
+		mRecordStats = cmdList.Stats();
+		mRecordStats += prepassStats;
+		mRecordStats += shadowStats;
+
+		// Full rate again for the passes over the finished scene.
+		if(VrsActive())
+			mVrs->Unbind(cmdList);
+		CompositeTransparency(mCommandList.Get());
+		ResolveScene(mCommandList.Get());
+
+		mGpuProfiler->EndScope(mCommandList.Get(), mFrameScope);
+		mGpuProfiler->EndFrame(mCommandList.Get());
+
+		// Done recording commands.
+		ThrowIfFailed(mCommandList->Close());
+
+		// Add the command list to the queue for execution.
+		ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+		mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	}
+
+    // Swap the back and front buffers
+	{
+		PROFILE_WAIT_SCOPE("Present");
+		Present();
+	}
+	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+
+    // Advance the fence value to mark commands up to this fence point.
+    mCurrFrameResource->Fence = ++mCurrentFence;
+
+    // Add an instruction to the command queue to set a new fence point. 
+    // Because we are on the GPU timeline, the new fence point won't be 
+    // set until the GPU finishes processing all the commands prior to this Signal().
+    mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	if(mBenchmarking)
+		RecordBenchmarkFrame();
+}
+
+void TreeBillboardsApp::SubmitAsyncCompute()
+{
+	// Update's fence wait covers these too, since that frame's direct queue work
+	// waited on its compute work.
+	auto cmdListAlloc = mCurrFrameResource->ComputeCmdListAlloc;
+	auto cmdList = mCurrFrameResource->ComputeCmdList;
+	ThrowIfFailed(cmdListAlloc->Reset());
+	ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), nullptr));
+
+	UINT scope = mComputeProfiler->BeginScope(cmdList.Get(), "lightCull");
+	mClusteredLighting->Cull(cmdList.Get(), mLightCullRootSignature.Get(), mPSOs[mFramePsos.LightCull].Get(),
+		mCurrFrameResourceIndex, mView, mProj, mCurrFrameResource->LocalLights.GpuAddress(), (UINT)mLocalLights.size());
+	mComputeProfiler->EndScope(cmdList.Get(), scope);
+	mComputeProfiler->EndFrame(cmdList.Get());
+
+	ThrowIfFailed(cmdList->Close());
+	ID3D12CommandList* cmdsLists[] = { cmdList.Get() };
+	mComputeQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	// The cull reads only what the CPU wrote this frame and writes this frame
+	// resource's clusters, which nothing in flight reads, so the compute queue
+	// starts at once, alongside whatever the direct queue is still drawing.  This
+	// frame's direct queue work all comes after the clusters it shades with.
+	GraphicsWaitForCompute(SignalCompute());
+}
+
+void TreeBillboardsApp::RecordBenchmarkFrame()
+{
+	__int64 countsPerSec, now;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+	QueryPerformanceCounter((LARGE_INTEGER*)&now);
+	double msPerCount = 1000.0 / (double)countsPerSec;
+
+	// Frames drawn while textures are still streaming in count as warm-up.
+	if(mTextureStreamer->PendingCount() > 0)
+		mBenchmarkFrame = 0;
+
+	// The warm-up also covers the frames whose GPU timestamps are not back yet.
+	if(++mBenchmarkFrame > mBenchmark.WarmupFrames && mCpuFrameMs.size() < mBenchmark.FrameCount)
+	{
+		mFrameIntervalMs.push_back((now - mLastFrameEndTime) * msPerCount);
+		mCpuFrameMs.push_back((now - mFrameBeginTime) * msPerCount);
+		mGpuFrameMs.push_back(mGpuProfiler->LastMs("frame"));
+
+		if(mCpuFrameMs.size() == mBenchmark.FrameCount)
+		{
+			WriteBenchmarkResults();
+			PostQuitMessage(0);
+		}
+	}
+
+	mLastFrameEndTime = now;
+}
+
+void TreeBillboardsApp::WriteBenchmarkResults()const
+{
+	auto percentile = [](std::vector<double> samples, double p)
+	{
+		size_t n = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+		std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+		return samples[n];
+	};
+
+	std::ofstream fout(mBenchmark.OutputFile);
+	if(!fout)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
+
+	// frame: wall time between frames.  cpu: Update + Draw, including fence
+	// waits.  gpu: the "frame" timestamp scope.
+	fout << "metric,p50_ms,p95_ms,p99_ms,frames\n";
+
+	const std::pair<const char*, const std::vector<double>*> metrics[] =
+	{
+		{ "frame", &mFrameIntervalMs },
+		{ "cpu", &mCpuFrameMs },
+		{ "gpu", &mGpuFrameMs },
+	};
+	for(const auto& m : metrics)
+	{
+		fout << m.first << "," << percentile(*m.second, 0.50) << "," << percentile(*m.second, 0.95) <<
+			"," << percentile(*m.second, 0.99) << "," << m.second->size() << "\n";
+	}
+}
+
+void TreeBillboardsApp::SetCommonPassState(CachedCommandList& cmdList)
+{
+	// Command lists do not inherit state from each other, so every list that draws
+	// a layer has to bind the targets, heaps, root signature and pass constants.
+	cmdList.Get()->RSSetViewports(1, &mSceneViewport);
+	cmdList.Get()->RSSetScissorRects(1, &mSceneScissorRect);
+
+	cmdList.Get()->OMSetRenderTargets(1, &SceneRtv(), true, &DepthStencilView());
+
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mDescriptors->Heap() };
+	cmdList.Get()->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	cmdList.SetGraphicsRootSignature(mRootSignature.Get());
+
+	cmdList.SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCB.GpuAddress());
+
+	if(mUseGpuWaves)
+		cmdList.SetGraphicsRootDescriptorTable(5, mGpuWaves->DisplacementMap());
+	else if(mStreamWaveHeights)
+		cmdList.SetGraphicsRootDescriptorTable(5, mDescriptors->GpuHandle(mWaveHeightSrvIndex));
+
+	// Draws index into these with their root constant.
+	if(mStructuredConstants)
+	{
+		cmdList.SetGraphicsRootShaderResourceView(3, mCurrFrameResource->MaterialCB.GpuAddress());
+		cmdList.SetGraphicsRootShaderResourceView(6, mCurrFrameResource->ObjectCB.GpuAddress());
+	}
+
+	cmdList.SetGraphicsRootShaderResourceView(7, mCurrFrameResource->LocalLights.GpuAddress());
+	cmdList.SetGraphicsRootShaderResourceView(8, mClusteredLighting->ClusterLights(mCurrFrameResourceIndex));
+	cmdList.SetGraphicsRootDescriptorTable(9, mShadowMaps->Srv());
+
+	if(mBindless)
+		cmdList.SetGraphicsRootDescriptorTable(10, mDescriptors->GpuHandle(0));
+
+	if(mVirtualTexturing)
+		cmdList.SetGraphicsRootUnorderedAccessView(mMipRequestRootParameter, mMipFeedback->RequestAddress());
+
+	if(MeshShadersActive())
+	{
+		const MeshGeometry* geo = mGeometries[mMeshletGeometry].get();
+		const UINT root = mMeshletRootParameter;
+		cmdList.SetGraphicsRootShaderResourceView(root + 1, geo->VertexBufferGPU->GetGPUVirtualAddress() + geo->VertexBufferOffset);
+		cmdList.SetGraphicsRootShaderResourceView(root + 2, mMeshlets.Resource->GetGPUVirtualAddress() + mMeshlets.Offset);
+		cmdList.SetGraphicsRootShaderResourceView(root + 3, mMeshletIndices.Resource->GetGPUVirtualAddress() + mMeshletIndices.Offset);
+		cmdList.SetGraphicsRootDescriptorTable(root + 4, mOcclusion->PyramidSrv());
+
+		// The Opaque layer, drawn ahead of the instanced one, rebuilds the pyramid
+		// with this frame's view when it goes through the occlusion culler.  Any
+		// other pyramid is from another view and is not tested against.
+		const auto& opaque = mVisibleRitems[(int)RenderLayer::Opaque];
+		bool pyramidBuilt = mIndirectDraw && mOcclusionCulling &&
+			!opaque.empty() && opaque.size() <= mOcclusion->MaxCommands();
+
+		MeshletConstants constants = {};
+		constants.VertexFormat = geo->VertexFormat;
+		constants.DepthWidth = (UINT)mSceneViewport.Width;
+		constants.DepthHeight = (UINT)mSceneViewport.Height;
+		constants.MipCount = mOcclusion->MipCount();
+		constants.PyramidValid = pyramidBuilt ? 1 : 0;
+
+		const UINT* values = (const UINT*)&constants;
+		for(UINT i = offsetof(MeshletConstants, VertexFormat) / 4; i < gMeshletConstantCount; ++i)
+			cmdList.SetGraphicsRoot32BitConstant(root, values[i], i);
+	}
+
+	// The draws coarsen their own rates from here, over the image if there is one.
+	if(VrsActive())
+		mVrs->Bind(cmdList, mShadingRateImageReady);
+}
+
+void TreeBillboardsApp::CompositeTransparency(ID3D12GraphicsCommandList* cmdList)
+{
+	if(!mOit)
+		return;
+
+	// Straight after the last blended layer, so the descriptor heap is still set.
+	UINT scope = mGpuProfiler->BeginScope(cmdList, "oitComposite");
+	mOitTargets->Composite(cmdList, mOitRootSignature.Get(), mPSOs[mFramePsos.OitComposite].Get(), SceneRtv());
+	mGpuProfiler->EndScope(cmdList, scope);
+}
+
+void TreeBillboardsApp::UpdateDynamicResolution()
+{
+	if(!mDynamicResolution)
+	{
+		mDynamicRes->Reset();
+		mSceneViewport = mScreenViewport;
+		mSceneScissorRect = mScissorRect;
+		return;
+	}
+
+	// The timing is a few frames old, so its resolution may differ from the last
+	// frame's; the controller only moves part of the way on each one.
+	mDynamicRes->SetBudgetMs(mGpuBudgetMs > 0.0 ? mGpuBudgetMs : 1000.0 / mRefreshRate);
+	mDynamicRes->Update(mGpuProfiler->LastMs("frame"));
+
+	mSceneViewport = mDynamicRes->Viewport();
+	mSceneScissorRect = mDynamicRes->ScissorRect();
+}
+
+bool TreeBillboardsApp::SceneOffscreen()const
+{
+	return mDynamicResolution || mPostAA != PostAA::Off;
+}
+
+bool TreeBillboardsApp::VrsActive()const
+{
+	return mVariableRateShading && mVrs->Supported();
+}
+
+bool TreeBillboardsApp::MeshShadersActive()const
+{
+	return mMeshShaders && mMeshShadersSupported;
+}
+
+bool TreeBillboardsApp::VisibilityBufferActive()const
+{
+	return mVisibilityBuffer && mVisibilityBufferSupported;
+}
+
+bool TreeBillboardsApp::DrawsForward(RenderLayer layer)const
+{
+	return layer != RenderLayer::Opaque || !VisibilityBufferActive();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE TreeBillboardsApp::SceneRtv()const
+{
+	return SceneOffscreen() ? mDynamicRes->Rtv() : CurrentBackBufferView();
+}
+
+void TreeBillboardsApp::ResolveScene(ID3D12GraphicsCommandList* cmdList)
+{
+	// Last in the frame, on a list whose descriptor heap is already set.  The frame
+	// signals the next fence value once this list has run.
+	mRenderGraph->Execute(cmdList, nullptr, mCurrentFence + 1);
+}
+
+UINT TreeBillboardsApp::RecordLayersParallel(ID3D12CommandList** cmdLists)
+{
+	// Like the serial path, skip the layers with nothing to draw forward.  Only one
+	// of Transparent and GpuWaves is populated, and the PSO of the other may not
+	// exist.  The last layer's list is kept even when it draws nothing, since it
+	// closes the frame.
+	UINT passes[gNumLayerPasses];
+	UINT passCount = 0;
+	for(UINT i = 0; i < (UINT)gNumLayerPasses; ++i)
+	{
+		const LayerPass& pass = gLayerPasses[i];
+		if(!mRitemLayer[(int)pass.Layer].empty() && DrawsForward(pass.Layer))
+			passes[passCount++] = i;
+	}
+	if(passCount == 0 || passes[passCount - 1] != (UINT)gNumLayerPasses - 1)
+		passes[passCount++] = (UINT)gNumLayerPasses - 1;
+
+	CommandListStats passStats[gNumLayerPasses];
+
+	JobSystem::Shared().ParallelFor(0, passCount, 1, [&](UINT job)
+	{
+		const UINT i = passes[job];
+		auto cmdListAlloc = mCurrFrameResource->WorkerCmdListAllocs[i];
+		auto cmdList = mCurrFrameResource->WorkerCmdLists[i];
+
+		ThrowIfFailed(cmdListAlloc->Reset());
+		ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), nullptr));
+
+		PROFILE_SCOPE(gLayerPasses[i].PsoName);
+
+		CachedCommandList cachedList(cmdList.Get());
+		SetCommonPassState(cachedList);
+
+		const LayerPass& pass = gLayerPasses[i];
+		if(!mRitemLayer[(int)pass.Layer].empty() && DrawsForward(pass.Layer))
+		{
+			DepthPass depthPass = ShadingPass(pass);
+			if(depthPass == DepthPass::Oit)
+				mOitTargets->Bind(cmdList.Get(), DepthStencilView());
+
+			UINT scope = mGpuProfiler->BeginScope(cmdList.Get(), pass.PsoName);
+			DrawLayer(cachedList, pass.Layer, depthPass);
+			mGpuProfiler->EndScope(cmdList.Get(), scope);
+		}
+
+		passStats[job] = cachedList.Stats();
+
+		if(i != (UINT)gNumLayerPasses - 1)
+			ThrowIfFailed(cmdList->Close());
+	});
+
+	mRecordStats = CommandListStats();
+	for(const auto& stats : passStats)
+		mRecordStats += stats;
+
+	// The last list executes last, so it closes the frame once every worker has
+	// taken its scopes: composite the transparency, resolve the timestamps and hand
+	// the back buffer back.
+	auto lastCmdList = mCurrFrameResource->WorkerCmdLists[gNumLayerPasses - 1].Get();
+
+	if(VrsActive())
+	{
+		CachedCommandList cmdList(lastCmdList);
+		mVrs->Unbind(cmdList);
+	}
+	CompositeTransparency(lastCmdList);
+	ResolveScene(lastCmdList);
+
+	mGpuProfiler->EndScope(lastCmdList, mFrameScope);
+	mGpuProfiler->EndFrame(lastCmdList);
+
+	ThrowIfFailed(lastCmdList->Close());
+
+	for(UINT job = 0; job < passCount; ++job)
+		cmdLists[job] = mCurrFrameResource->WorkerCmdLists[passes[job]].Get();
+	return passCount;
+}
+
+void TreeBillboardsApp::OnMouseDown(WPARAM btnState, int x, int y)
+{
+    mLastMousePos.x = x;
+    mLastMousePos.y = y;
 
     SetCapture(mhMainWnd);
 }
 
-void TreeBillboardsApp::OnMouseUp(WPARAM btnState, int x, int y)
+void TreeBillboardsApp::OnMouseUp(WPARAM btnState, int x, int y)
+{
+    ReleaseCapture();
+}
+
+void TreeBillboardsApp::OnMouseMove(WPARAM btnState, int x, int y)
+{
+    if((btnState & MK_LBUTTON) != 0)
+    {
+        // Make each pixel correspond to a quarter of a degree.
+        float dx = XMConvertToRadians(0.25f*static_cast<float>(x - mLastMousePos.x));
+        float dy = XMConvertToRadians(0.25f*static_cast<float>(y - mLastMousePos.y));
+
+        // Update angles based on input to orbit camera around box.
+        mTheta += dx;
+        mPhi += dy;
+
+        // Restrict the angle mPhi.
+        mPhi = MathHelper::Clamp(mPhi, 0.1f, MathHelper::Pi - 0.1f);
+    }
+    else if((btnState & MK_RBUTTON) != 0)
+    {
+        // Make each pixel correspond to 0.2 unit in the scene.
+        float dx = 0.2f*static_cast<float>(x - mLastMousePos.x);
+        float dy = 0.2f*static_cast<float>(y - mLastMousePos.y);
+
+        // Update the camera radius based on input.
+        mRadius += dx - dy;
+
+        // Restrict the radius.
+        mRadius = MathHelper::Clamp(mRadius, 5.0f, 150.0f);
+    }
+
+    mLastMousePos.x = x;
+    mLastMousePos.y = y;
+}
+ 
+void TreeBillboardsApp::OnKeyUp(WPARAM vkeyCode)
+{
+	if(vkeyCode == 'I')
+		mIndirectDraw = !mIndirectDraw;
+	else if(vkeyCode == 'M')
+		mParallelRecord = !mParallelRecord;
+	else if(vkeyCode == 'C')
+		mFrustumCulling = !mFrustumCulling;
+	else if(vkeyCode == 'O')
+		mSortDraws = !mSortDraws;
+	else if(vkeyCode == 'Z')
+		mDepthPrepass = !mDepthPrepass;
+	else if(vkeyCode == 'B')
+		mOit = !mOit;
+	else if(vkeyCode == 'A')
+		mAsyncCompute = !mAsyncCompute;
+	else if(vkeyCode == 'D')
+		mDynamicResolution = !mDynamicResolution;
+	else if(vkeyCode == 'X')
+		mPostAA = (PostAA)(((int)mPostAA + 1) % (int)PostAA::Count);
+	else if(vkeyCode == 'S')
+		mVariableRateShading = !mVariableRateShading;
+	else if(vkeyCode == 'L')
+		mShadows = !mShadows;
+	else if(vkeyCode == 'H')
+	{
+		// A pyramid from before the toggle may be stale by now.
+		mOcclusionCulling = !mOcclusionCulling;
+		mOcclusion->Invalidate();
+	}
+	else if(vkeyCode == 'N')
+		mMeshShaders = !mMeshShaders;
+	else if(vkeyCode == 'U')
+		mVisibilityBuffer = !mVisibilityBuffer;
+	else if(vkeyCode == 'V')
+		SetPresentMode((PresentMode)(((int)GetPresentMode() + 1) % 3));
+	else if(vkeyCode == 'G')
+		mGpuProfiler->WriteCsv(L"gpu_profile.csv");
+	else if(vkeyCode == 'R')
+		mResidency->WriteReport(L"memory_report.csv");
+#if CPU_PROFILER_ENABLED
+	else if(vkeyCode == 'T')
+		CpuProfiler::ExportChromeTrace(L"cpu_trace.json");
+#endif
+}
+
+bool TreeBillboardsApp::FrameNeeded()
+{
+	// Textures still loading sharpen the picture as they arrive, and so do virtual
+	// texture mips, whose arrival Update only sees on a drawn frame.
+	return mTextureStreamer->PendingCount() > 0 ||
+		(mVirtualTexturing && mVirtualTextures->LoadingCount() > 0);
+}
+
+std::wstring TreeBillboardsApp::FrameStatsText()const
+{
+	// Count instances rather than instanced render items.
+	size_t objectCount = mAllRitems.size() - mRitemLayer[(int)RenderLayer::OpaqueInstanced].size() + mInstanceCount -
+		1 + mTerrain->MaxTileCount();
+
+	static const wchar_t* presentNames[] = { L"vsync", L"immediate", L"vrr" };
+
+	std::wostringstream async;
+	if(mAsyncCompute)
+	{
+		async.setf(std::ios::fixed);
+		async.precision(2);
+		async << L"   async: " << mComputeProfiler->Summary() << L" (" << mAsyncOverlapMs << L" overlapped)";
+	}
+
+	return L"   drawn: " + std::to_wstring(mVisibleCount) +
+		L"/" + std::to_wstring(objectCount) +
+		(mFrustumCulling ? L"" : L" (culling off)") +
+		(mDepthPrepass ? L"   prepass" : L"") +
+		(mOit ? L"   oit" : L"") +
+		(mOcclusionCulling ? L"   occlusion" : L"") +
+		(MeshShadersActive() ? L"   meshlets: " + std::to_wstring(mMeshletCount) : L"") +
+		(VisibilityBufferActive() ? L"   visbuffer" : L"") +
+		(mVirtualTexturing ? L"   tiles: " + std::to_wstring(mVirtualTextures->TileCount() - mVirtualTextures->FreeTileCount()) +
+			L"/" + std::to_wstring(mVirtualTextures->TileCount()) : L"") +
+		(mDynamicResolution ? L"   res: " + std::to_wstring(mDynamicRes->Width()) + L"x" +
+			std::to_wstring(mDynamicRes->Height()) : L"") +
+		L"   aa: " + AnsiToWString(gPostAAModes[(int)mPostAA].Name) +
+		(VrsActive() ? (mShadingRateImageReady ? L"   vrs: image" : L"   vrs: per draw") : L"") +
+		(mShadows ? L"   shadows: " + std::to_wstring(mShadowMaps->StaticRedrawCount()) + L" redraws" : L"") +
+		L"   lights: " + std::to_wstring(mLocalLights.size()) +
+		L"   psos: " + std::to_wstring(mPsoVariants.size()) + L" (" +
+		std::to_wstring(mShaderPermutations->PermutationCount()) + L" shaders)" +
+		L"   present: " + presentNames[(int)GetPresentMode()] +
+		(TearingSupported() ? L"" : L" (no tearing)") +
+		L"   state: " + std::to_wstring(mRecordStats.Issued) + L" set, " +
+		std::to_wstring(mRecordStats.Elided) + L" elided" +
+		L"   gpu ms: " + mGpuProfiler->Summary() + async.str() +
+		L"   graph: " + mRenderGraph->Summary() +
+		L"   vidmem: " + mResidency->Summary();
+}
+
+void TreeBillboardsApp::OnKeyboardInput(const GameTimer& gt)
+{
+}
+ 
+void TreeBillboardsApp::UpdateCamera(const GameTimer& gt)
+{
+	// Scripted orbit: one lap every 25 s, bobbing in elevation and distance.
+	if(mBenchmarking)
+	{
+		float t = gt.TotalTime();
+		mTheta = 1.5f*XM_PI + 0.04f*XM_2PI*t;
+		mPhi = 0.3f*XM_PI + 0.1f*XM_PI*sinf(0.5f*t);
+		mRadius = 60.0f + 25.0f*sinf(0.3f*t);
+	}
+
+	// Convert Spherical to Cartesian coordinates.
+	mEyePos.x = mRadius*sinf(mPhi)*cosf(mTheta);
+	mEyePos.z = mRadius*sinf(mPhi)*sinf(mTheta);
+	mEyePos.y = mRadius*cosf(mPhi);
+
+	// Build the view matrix.
+	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
+	XMVECTOR target = XMVectorZero();
+	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+
+	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
+	XMStoreFloat4x4(&mView, view);
+}
+
+void TreeBillboardsApp::AnimateMaterials(const GameTimer& gt)
+{
+	// Scroll the water material texture coordinates.
+	auto waterMat = mWaterMat;
+
+	float& tu = waterMat->MatTransform(3, 0);
+	float& tv = waterMat->MatTransform(3, 1);
+
+	tu += 0.1f * gt.DeltaTime();
+	tv += 0.02f * gt.DeltaTime();
+
+	if(tu >= 1.0f)
+		tu -= 1.0f;
+
+	if(tv >= 1.0f)
+		tv -= 1.0f;
+
+	waterMat->MatTransform(3, 0) = tu;
+	waterMat->MatTransform(3, 1) = tv;
+
+	// Material has changed, so need to update cbuffer.
+	MarkMaterialDirty(waterMat);
+}
+
+void TreeBillboardsApp::MarkObjectDirty(UINT entity)
+{
+	UINT& dirtyFrames = mScene.DirtyFrames[entity];
+	for(int i = 0; i < gNumFrameResources; ++i)
+	{
+		if((dirtyFrames & (1u << i)) == 0)
+		{
+			dirtyFrames |= 1u << i;
+			mFrameResources[i]->DirtyObjects.push_back(entity);
+		}
+	}
+}
+
+void TreeBillboardsApp::MarkMaterialDirty(Material* mat)
+{
+	for(int i = 0; i < gNumFrameResources; ++i)
+	{
+		if((mat->DirtyFrames & (1u << i)) == 0)
+		{
+			mat->DirtyFrames |= 1u << i;
+			mFrameResources[i]->DirtyMaterials.push_back((UINT)mat->MatCBIndex);
+		}
+	}
+}
+
+void TreeBillboardsApp::UpdateObjectCBs(const GameTimer& gt)
+{
+	auto& dirtyObjects = mCurrFrameResource->DirtyObjects;
+	const UINT frameBit = 1u << mCurrFrameResourceIndex;
+
+	// Carry moved transforms down the hierarchy and queue everything that changed.
+	mScene.UpdateTransforms(mChangedEntities);
+	for(UINT entity : mChangedEntities)
+	{
+		// The local lights of the others were decided from where they were built.
+		assert(mObjectItems[entity]->Moves);
+		MarkObjectDirty(entity);
+	}
+
+	// Only update the cbuffer data of the items queued since this frame resource
+	// was last used, unless every slot moved.  Queued entities are written a run of
+	// consecutive indices at a time.
+	if(mCurrFrameResource->FrameDataMoved)
+	{
+		const UINT count = mScene.Count();
+		const UINT chunkCount = (count + gObjectConstantsGrain - 1) / gObjectConstantsGrain;
+		JobSystem::Shared().ParallelFor(0, chunkCount, 1, [this, count, frameBit](UINT chunk)
+		{
+			UINT first = chunk*gObjectConstantsGrain;
+			WriteObjectConstants(first, std::min(gObjectConstantsGrain, count - first), frameBit);
+		});
+	}
+	else
+	{
+		std::sort(dirtyObjects.begin(), dirtyObjects.end());
+		for(size_t i = 0; i < dirtyObjects.size();)
+		{
+			size_t run = 1;
+			while(i + run < dirtyObjects.size() && dirtyObjects[i + run] == dirtyObjects[i] + run)
+				++run;
+
+			WriteObjectConstants(dirtyObjects[i], (UINT)run, frameBit);
+			i += run;
+		}
+	}
+	dirtyObjects.clear();
+}
+
+void TreeBillboardsApp::WriteObjectConstants(UINT first, UINT count, UINT frameBit)
+{
+	// A block at a time is built in cached memory, the matrices straight from the
+	// scene's arrays, then streamed into the mapped constants whole.
+	alignas(16) ObjectConstants staging[gObjectConstantsGrain];
+	UploadWriter<ObjectConstants> writer = mCurrFrameResource->ObjectCB.Writer(first);
+	for(UINT block = first; block < first + count; block += gObjectConstantsGrain)
+	{
+		const UINT blockCount = std::min(gObjectConstantsGrain, first + count - block);
+		MathHelper::TransposeMatrices(&mScene.World[block], sizeof(XMFLOAT4X4),
+			&staging[0].World, sizeof(ObjectConstants), blockCount);
+		MathHelper::TransposeMatrices(&mScene.TexTransform[block], sizeof(XMFLOAT4X4),
+			&staging[0].TexTransform, sizeof(ObjectConstants), blockCount);
+
+		for(UINT i = 0; i < blockCount; ++i)
+		{
+			const UINT entity = block + i;
+			const RenderItem& ri = *mObjectItems[entity];
+
+			ObjectConstants& objConstants = staging[i];
+			objConstants.DisplacementMapTexelSize = ri.DisplacementMapTexelSize;
+			objConstants.GridSpatialStep = ri.GridSpatialStep;
+			objConstants.MaterialIndex = mMaterials[mScene.Materials[entity]]->MatCBIndex;
+			objConstants.PositionBias = ri.Geo.IsValid() ? mGeometries[ri.Geo]->PositionBias : XMFLOAT3(0.0f, 0.0f, 0.0f);
+			objConstants.PositionScale = ri.Geo.IsValid() ? mGeometries[ri.Geo]->PositionScale : XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+			mScene.LocalBounds[entity].Transform(mScene.Bounds[entity], XMLoadFloat4x4(&mScene.World[entity]));
+
+			// This frame resource is up to date; the others still have it queued.
+			mScene.DirtyFrames[entity] &= ~frameBit;
+		}
+
+		writer.Write(staging, blockCount);
+	}
+}
+
+void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
+{
+	auto& dirtyMaterials = mCurrFrameResource->DirtyMaterials;
+	const UINT frameBit = 1u << mCurrFrameResourceIndex;
+
+	// Built in the frame's arena, then streamed to their slots in one pass.
+	ArenaVector<UINT> indices(mCurrFrameResource->Arena);
+	ArenaVector<MaterialConstants> constants(mCurrFrameResource->Arena);
+	auto stage = [&](Material& mat)
+	{
+		indices.push_back((UINT)mat.MatCBIndex);
+		constants.push_back(BuildMaterialConstants(mat));
+		mat.DirtyFrames &= ~frameBit;
+	};
+
+	if(mCurrFrameResource->FrameDataMoved)
+	{
+		for(auto mat : mMaterialsByIndex)
+			stage(*mat);
+	}
+	else
+	{
+		for(UINT index : dirtyMaterials)
+			stage(*mMaterialsByIndex[index]);
+	}
+	dirtyMaterials.clear();
+
+	mCurrFrameResource->MaterialCB.CopyScatter(indices.data(), constants.data(), (UINT)constants.size());
+}
+
+MaterialConstants TreeBillboardsApp::BuildMaterialConstants(const Material& mat)
+{
+	XMMATRIX matTransform = XMLoadFloat4x4(&mat.MatTransform);
+
+	MaterialConstants matConstants;
+	matConstants.DiffuseAlbedo = mat.DiffuseAlbedo;
+	matConstants.FresnelR0 = mat.FresnelR0;
+	matConstants.Roughness = mat.Roughness;
+	XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+	matConstants.DiffuseMapIndex = (UINT)mat.DiffuseSrvHeapIndex;
+
+	// Once a virtual texture has mips in, sampling is clamped to them and asks for finer.
+	UINT slot = mMaterialSlots[mat.MatCBIndex];
+	if(mVirtualTexturing && mVirtualTextureIds[slot] != (UINT)-1)
+	{
+		UINT residentMip = mVirtualTextures->ResidentMip(mVirtualTextureIds[slot]);
+		if(residentMip < mVirtualTextures->MipCount(mVirtualTextureIds[slot]))
+		{
+			matConstants.FeedbackIndex = slot;
+			matConstants.DiffuseMinLod = (float)residentMip;
+		}
+	}
+
+	return matConstants;
+}
+
+void TreeBillboardsApp::UpdateMainPassCB(const GameTimer& gt)
+{
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX proj = XMLoadFloat4x4(&mProj);
+
+	// The view is rigid and the projection a plain perspective, so both have closed
+	// form inverses, and (VP)^-1 = P^-1 V^-1.
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMMATRIX invView = MathHelper::InverseRigid(view);
+	XMMATRIX invProj = MathHelper::InversePerspective(proj);
+	XMMATRIX invViewProj = XMMatrixMultiply(invProj, invView);
+
+	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
+	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
+	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
+	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
+	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
+	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+	mMainPassCB.EyePosW = mEyePos;
+	mMainPassCB.RenderTargetSize = XMFLOAT2(mSceneViewport.Width, mSceneViewport.Height);
+	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mSceneViewport.Width, 1.0f / mSceneViewport.Height);
+	mMainPassCB.NearZ = 1.0f;
+	mMainPassCB.FarZ = gFarPlane;
+	mMainPassCB.TotalTime = gt.TotalTime();
+	mMainPassCB.DeltaTime = gt.DeltaTime();
+	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
+	/*mMainPassCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
+	mMainPassCB.Lights[0].Strength = { 0.6f, 0.6f, 0.6f };
+	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
+	mMainPassCB.Lights[1].Strength = { 0.3f, 0.3f, 0.3f };
+	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
+	mMainPassCB.Lights[2].Strength = { 0.15f, 0.15f, 0.15f };*/
+	mMainPassCB.ClusterDepthScaleBias = mClusteredLighting->DepthSliceScaleBias();
+
+	UploadWriter<PassConstants> passWriter = mCurrFrameResource->PassCB.Writer();
+	passWriter.Write(mMainPassCB);
+
+	// The casters of each cascade are drawn under the same constants, seen from the light.
+	if(mShadows)
+	{
+		PassConstants casterPass = mMainPassCB;
+		for(UINT c = 0; c < CascadedShadowMaps::CascadeCount; ++c)
+		{
+			XMStoreFloat4x4(&casterPass.ViewProj, XMMatrixTranspose(XMLoadFloat4x4(&mShadowMaps->ViewProj(c))));
+			passWriter.Write(casterPass);
+		}
+	}
+}
+
+void TreeBillboardsApp::UpdateShadows(const GameTimer& gt)
+{
+	// A caster that moves leaves the cached maps for good, which are redrawn without it.
+	for(UINT entity : mChangedEntities)
+	{
+		if(!mShadowDynamic[entity])
+		{
+			mShadowDynamic[entity] = 1;
+			mShadowMaps->Invalidate();
+		}
+	}
+
+	if(!mShadows)
+	{
+		mMainPassCB.ShadowCascadeCount = 0;
+		mMainPassCB.DynamicShadowCascadeCount = 0;
+		return;
+	}
+
+	// Nothing past the fog needs shadows.
+	float shadowDistance = std::min(mMainPassCB.gFogStart + mMainPassCB.gFogRange, gFarPlane);
+	mShadowMaps->Update(mView, mProj, 1.0f, shadowDistance, mMainPassCB.Lights[0].Direction, gShadowCasterReach);
+
+	for(UINT c = 0; c < CascadedShadowMaps::CascadeCount; ++c)
+	{
+		XMStoreFloat4x4(&mMainPassCB.ShadowTransforms[c],
+			XMMatrixTranspose(XMLoadFloat4x4(&mShadowMaps->ShadowTransform(c))));
+	}
+	mMainPassCB.CascadeSplits = mShadowMaps->SplitDistances();
+	mMainPassCB.ShadowTexelWorldSizes = mShadowMaps->TexelWorldSizes();
+	mMainPassCB.ShadowCascadeCount = CascadedShadowMaps::CascadeCount;
+	mMainPassCB.DynamicShadowCascadeCount = CascadedShadowMaps::DynamicCascadeCount;
+	mMainPassCB.StaticShadowTexelSize = mShadowMaps->StaticTexelSize();
+	mMainPassCB.DynamicShadowTexelSize = mShadowMaps->DynamicTexelSize();
+
+	// The instanced casters of each static map being redrawn.  Instances keep their
+	// finest level, since the camera picks the levels, and the terrain is laid out in
+	// tiles over the cascade rather than the camera's rings.
+	auto& shadowInstances = mCurrFrameResource->ShadowInstances;
+	const UINT cascadeInstanceCount = mShadowInstanceCount / CascadedShadowMaps::CascadeCount;
+	for(UINT c = 0; c < CascadedShadowMaps::CascadeCount; ++c)
+	{
+		mShadowDraws[c].clear();
+		if(!mShadowMaps->StaticStale(c))
+			continue;
+
+		const BoundingOrientedBox& bounds = mShadowMaps->Bounds(c);
+		UploadWriter<InstanceData> writer = shadowInstances.Writer(c*cascadeInstanceCount);
+		for(auto ri : mRitemLayer[(int)RenderLayer::OpaqueInstanced])
+		{
+			ShadowDraw draw = { ri, writer.Index(), 0 };
+			for(size_t i = 0; i < ri->Instances.size(); ++i)
+			{
+				if(!bounds.Intersects(ri->InstanceBounds[i]))
+					continue;
+
+				InstanceData data;
+				XMStoreFloat4x4(&data.World, XMMatrixTranspose(XMLoadFloat4x4(&ri->Instances[i].World)));
+				XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&ri->Instances[i].TexTransform)));
+				writer.Write(data);
+			}
+
+			draw.InstanceCount = writer.Index() - draw.FirstInstance;
+			if(draw.InstanceCount > 0)
+				mShadowDraws[c].push_back(draw);
+		}
+
+		XMFLOAT3 corners[BoundingOrientedBox::CORNER_COUNT];
+		bounds.GetCorners(corners);
+		BoundingBox footprint;
+		BoundingBox::CreateFromPoints(footprint, BoundingOrientedBox::CORNER_COUNT, corners, sizeof(XMFLOAT3));
+
+		float tileSize = 2.0f*std::max(footprint.Extents.x, footprint.Extents.z) / gShadowTerrainTiles;
+		ShadowDraw terrainDraw = { mTerrainRitem, writer.Index(), gShadowTerrainTiles*gShadowTerrainTiles };
+		for(UINT z = 0; z < gShadowTerrainTiles; ++z)
+		{
+			for(UINT x = 0; x < gShadowTerrainTiles; ++x)
+			{
+				XMMATRIX world = XMMatrixScaling(tileSize, 1.0f, tileSize) * XMMatrixTranslation(
+					footprint.Center.x - footprint.Extents.x + x*tileSize, 0.0f,
+					footprint.Center.z - footprint.Extents.z + z*tileSize);
+
+				InstanceData data;
+				XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+				XMStoreFloat4x4(&data.TexTransform, XMMatrixIdentity());
+				writer.Write(data);
+			}
+		}
+		mShadowDraws[c].push_back(terrainDraw);
+	}
+}
+
+void TreeBillboardsApp::UpdateLocalLights(const GameTimer& gt)
+{
+	// The lights before the torches never change.
+	UploadWriter<Light> writer = mCurrFrameResource->LocalLights.Writer();
+	writer.Write(mLocalLights.data(), std::min(mFirstTorch, (UINT)mLocalLights.size()));
+	for(UINT i = writer.Index(); i < (UINT)mLocalLights.size(); ++i)
+	{
+		Light light = mLocalLights[i];
+
+		// Each torch flickers at its own rate and phase.
+		float flicker = 0.85f + 0.1f*sinf(gt.TotalTime()*(7.0f + (float)(i % 5)) + 2.4f*(float)i) +
+			0.05f*sinf(gt.TotalTime()*23.0f + 1.7f*(float)i);
+		light.Strength.x *= flicker;
+		light.Strength.y *= flicker;
+		light.Strength.z *= flicker;
+		writer.Write(light);
+	}
+}
+
+void TreeBillboardsApp::BuildSimulationSystems()
+{
+	// Both run in the simulation stage, after Simulate.  Nothing the frame being drawn
+	// reads changes until PublishSimulation.
+	const double step = mUseGpuWaves ? mGpuWaves->TimeStep() : mWaves->TimeStep();
+	mWaveStepSystem = mSimulationSteps.Add("SimulateWaves", step, gMaxWaveCatchUpSteps, [this]()
+	{
+		if(mUseGpuWaves)
+			++mGpuWaveStepsScheduled;
+		else
+			mWaves->Step();
+	});
+
+	mWaveDisturbSystem = mSimulationSteps.Add("DisturbWaves", gWaveDisturbInterval, 1, [this]()
+	{
+		// Only the active region of the CPU waves is simulated, so disturb the water there.
+		const Waves::Region region = mUseGpuWaves ?
+			Waves::Region{ 0, 0, mGpuWaves->RowCount(), mGpuWaves->ColumnCount() } : mWaves->ActiveRegion();
+
+		int i = MathHelper::Rand(region.Row0 + 4, region.Row1 - 5);
+		int j = MathHelper::Rand(region.Col0 + 4, region.Col1 - 5);
+
+		float r = MathHelper::RandF(0.2f, 0.5f);
+
+		if(mUseGpuWaves)
+			mGpuWaveDisturbancesScheduled.push_back({ i, j, r });
+		else
+			mWaves->Disturb(i, j, r);
+	});
+}
+
+void TreeBillboardsApp::Simulate(const GameTimer& gt)
+{
+	// The CRT's rand state is per thread, so the simulation thread seeds its own
+	// before the scheduled disturbances draw from it.
+	if(GetPipelined() && !mSimulationSeeded)
+	{
+		srand(mBenchmark.Seed);
+		mSimulationSeeded = true;
+	}
+}
+
+void TreeBillboardsApp::PublishSimulation()
+{
+	if(mUseGpuWaves)
+	{
+		mGpuWaveSteps += mGpuWaveStepsScheduled;
+		mGpuWaveStepsScheduled = 0;
+		mGpuWaveDisturbances.insert(mGpuWaveDisturbances.end(),
+			mGpuWaveDisturbancesScheduled.begin(), mGpuWaveDisturbancesScheduled.end());
+		mGpuWaveDisturbancesScheduled.clear();
+		return;
+	}
+
+	// Publish moves on to the region requested below, so note the one simulated.
+	const Waves::Region region = mWaves->ActiveRegion();
+	UINT64 revision = mWaves->Revision();
+	mWaves->Publish();
+
+	// What was just published only moved points of the region it was simulated in.
+	if(mWaves->Revision() != revision)
+	{
+		++mWaterRevision;
+		for(int patch = 0; patch < mWaterPatches->PatchCount(); ++patch)
+		{
+			if(mWaterPatches->Overlaps(patch, region))
+				mWaterPatchRevisions[patch] = mWaterRevision;
+		}
+	}
+
+	// Follow the camera from the next Publish on.
+	mWaves->SetActiveRegion(mWaterPatches->ActiveRegion());
+}
+
+UINT TreeBillboardsApp::WaveVertexCount()const
+{
+	return mUseGpuWaves || mStreamWaveHeights ? 0 : mWaterPatches->VertexCount();
+}
+
+void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
+{
+	// Between steps, the simulated patches are drawn part way from the previous
+	// solution to the current one, so they change whenever the blend does.  Only
+	// points of the active region differ between the two.
+	float alpha = mInterpolateWaves ? mSimulationSteps.Alpha(mWaveStepSystem) : 1.0f;
+	if(alpha != mWaveAlpha)
+	{
+		mWaveAlpha = alpha;
+		++mWaterRevision;
+		for(int patch = 0; patch < mWaterPatches->PatchCount(); ++patch)
+		{
+			if(mWaterPatches->Overlaps(patch, mWaves->ActiveRegion()))
+				mWaterPatchRevisions[patch] = mWaterRevision;
+		}
+	}
+
+	if(mStreamWaveHeights)
+		StageWaveHeights();
+	else
+		UpdateWaveVertices();
+
+	// Pick each patch's level and stitched edges for where the camera is now.
+	// PublishSimulation moves the simulated region after it.
+	mWaterPatches->Update(mEyePos);
+	for(int patch = 0; patch < mWaterPatches->PatchCount(); ++patch)
+	{
+		WaterPatches::IndexRange range = mWaterPatches->Indices(patch);
+		EntityDrawArgs& args = mScene.DrawArgs[mWaterPatchRitems[patch]->ObjCBIndex];
+		args.IndexCount = range.IndexCount;
+		args.StartIndexLocation = range.StartIndexLocation;
+	}
+}
+
+void TreeBillboardsApp::UpdateWaveVertices()
 {
-    ReleaseCapture();
+	// Update the wave vertex buffer with the last published solution.  The simulation
+	// steps less often than we draw and only near the camera, so only rewrite the
+	// patches whose copy in this frame's buffer is out of date.
+	auto& currWavesVB = mCurrFrameResource->WavesVB;
+	auto& patchRevisions = mCurrFrameResource->WavesPatchRevisions;
+	patchRevisions.resize(mWaterPatches->PatchCount(), 0);
+
+	// Each row of a patch is built in cached memory and streamed out whole.
+	const float invWidth = 1.0f / mWaves->Width();
+	const float invDepth = 1.0f / mWaves->Depth();
+	const int patchQuads = gWaterPatchQuads;
+	Vertex rowVertices[gWaterPatchQuads + 1];
+	for(int patch = 0; patch < mWaterPatches->PatchCount(); ++patch)
+	{
+		if(patchRevisions[patch] == mWaterPatchRevisions[patch])
+			continue;
+
+		UploadWriter<Vertex> writer = currWavesVB.Writer(patch*mWaterPatches->PatchVertexCount());
+		for(int row = 0; row <= patchQuads; ++row)
+		{
+			for(int col = 0; col <= patchQuads; ++col)
+			{
+				int i = mWaterPatches->GridIndex(patch, row, col);
+
+				Vertex v;
+
+				v.Pos = mWaves->Position(i);
+				v.Pos.y = mWaves->Height(i, mWaveAlpha);
+				v.Normal = mWaves->Normal(i);
+
+				// Derive tex-coords from position by 
+				// mapping [-w/2,w/2] --> [0,1]
+				v.TexC.x = 0.5f + v.Pos.x*invWidth;
+				v.TexC.y = 0.5f - v.Pos.z*invDepth;
+
+				rowVertices[col] = v;
+			}
+			writer.Write(rowVertices, patchQuads + 1);
+		}
+
+		patchRevisions[patch] = mWaterPatchRevisions[patch];
+	}
+
+	// Set the dynamic VB of the wave renderitem to the current frame VB.
+	mGeometries[mWavesRitem->Geo]->VertexBufferGPU = currWavesVB.Resource();
+	mGeometries[mWavesRitem->Geo]->VertexBufferOffset = currWavesVB.Offset();
+}
+
+void TreeBillboardsApp::StageWaveHeights()
+{
+	// The texture outlives the frame resources, so a patch is staged once per change
+	// rather than once per frame resource, and as one float per point rather than a
+	// whole vertex.  Each patch gets its own footprint, its rows at the pitch copies
+	// from buffers need.
+	const UINT patchPoints = gWaterPatchQuads + 1;
+
+	mWaveHeightCopies.clear();
+	for(int patch = 0; patch < mWaterPatches->PatchCount(); ++patch)
+	{
+		if(mWaveHeightRevisions[patch] == mWaterPatchRevisions[patch])
+			continue;
+
+		WaveHeightCopy copy;
+		copy.Patch = patch;
+		copy.Upload = mCurrFrameResource->UploadAlloc->Allocate((UINT64)gWaterHeightRowPitch*patchPoints,
+			D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+		for(UINT row = 0; row < patchPoints; ++row)
+		{
+			float* dst = reinterpret_cast<float*>(copy.Upload.CpuAddress + (UINT64)row*gWaterHeightRowPitch);
+			for(UINT col = 0; col < patchPoints; ++col)
+				dst[col] = mWaves->Height(mWaterPatches->GridIndex(patch, (int)row, (int)col), mWaveAlpha);
+		}
+
+		mWaveHeightCopies.push_back(copy);
+		mWaveHeightRevisions[patch] = mWaterPatchRevisions[patch];
+	}
+}
+
+void TreeBillboardsApp::CopyWaveHeights()
+{
+	const UINT patchPoints = gWaterPatchQuads + 1;
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mWaveHeights.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+
+	CD3DX12_TEXTURE_COPY_LOCATION dst(mWaveHeights.Get(), 0);
+	for(const WaveHeightCopy& copy : mWaveHeightCopies)
+	{
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+		footprint.Offset = copy.Upload.Offset;
+		footprint.Footprint = CD3DX12_SUBRESOURCE_FOOTPRINT(DXGI_FORMAT_R32_FLOAT, patchPoints, patchPoints, 1, gWaterHeightRowPitch);
+		CD3DX12_TEXTURE_COPY_LOCATION src(copy.Upload.Resource, footprint);
+
+		// Patches share their edge points, so their boxes overlap by one texel.
+		int patchRow = copy.Patch / gWaterPatchesPerSide;
+		int patchCol = copy.Patch % gWaterPatchesPerSide;
+		mCommandList->CopyTextureRegion(&dst, patchCol*gWaterPatchQuads, patchRow*gWaterPatchQuads, 0, &src, nullptr);
+	}
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mWaveHeights.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+
+	mWaveHeightCopies.clear();
+}
+
+void TreeBillboardsApp::UpdateWavesGPU(const GameTimer& gt)
+{
+	// Record the work the simulation stage scheduled since the last frame.
+	for(const WaveDisturbance& d : mGpuWaveDisturbances)
+	{
+		mGpuWaves->Disturb(mCommandList.Get(), mWavesRootSignature.Get(), mPSOs[mFramePsos.WavesDisturb].Get(),
+			d.I, d.J, d.Magnitude);
+	}
+	mGpuWaveDisturbances.clear();
+
+	for(; mGpuWaveSteps > 0; --mGpuWaveSteps)
+		mGpuWaves->Step(mCommandList.Get(), mWavesRootSignature.Get(), mPSOs[mFramePsos.WavesUpdate].Get());
+}
+
+void TreeBillboardsApp::UpdateVisibility(const GameTimer& gt)
+{
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = MathHelper::InverseRigid(view);
+
+	// Bring the view space frustum into world space once, rather than every
+	// item's bounds into view space.
+	mCamFrustum.Transform(mWorldFrustum, invView);
+
+	mVisibleCount = 0;
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		auto& visible = mVisibleRitems[layer];
+		visible.clear();
+
+		// Instanced items are culled per instance in UpdateInstanceBuffer, terrain
+		// tiles in UpdateTerrain and trees on the GPU.
+		if(layer == (int)RenderLayer::OpaqueInstanced || layer == (int)RenderLayer::Terrain ||
+			layer == (int)RenderLayer::AlphaTestedTreeSprites)
+			continue;
+
+		// Only the bounds of the layer's run of entities are read until an item
+		// survives.  The tests run in parallel chunks and the survivors are gathered
+		// afterwards, in order.
+		const auto& entities = mLayerEntities[layer];
+		JobSystem::Shared().ParallelFor(0, (UINT)entities.size(), gCullGrain, [this, &entities](UINT i)
+		{
+			UINT entity = entities[i];
+			const BoundingBox& bounds = mScene.Bounds[entity];
+			mEntityVisible[entity] = !mFrustumCulling || mWorldFrustum.Contains(bounds) != DirectX::DISJOINT;
+
+			RenderItem* ri = mObjectItems[entity];
+			if(mEntityVisible[entity] && !ri->Lods.empty())
+			{
+				ri->Lod = SelectLod(ri->Lods, ri->Lod, ProjectedSize(bounds));
+
+				const LodLevel& level = ri->Lods[ri->Lod];
+				EntityDrawArgs& args = mScene.DrawArgs[entity];
+				args.IndexCount = level.IndexCount;
+				args.StartIndexLocation = level.StartIndexLocation;
+				args.BaseVertexLocation = level.BaseVertexLocation;
+			}
+		});
+
+		for(UINT entity : entities)
+		{
+			if(mEntityVisible[entity])
+				visible.push_back(mObjectItems[entity]);
+		}
+
+		mVisibleCount += (UINT)visible.size();
+	}
+}
+
+void TreeBillboardsApp::UpdateInstanceBuffer(const GameTimer& gt)
+{
+	auto& currInstanceBuffer = mCurrFrameResource->InstanceBuffer;
+	auto& visible = mVisibleRitems[(int)RenderLayer::OpaqueInstanced];
+
+	for(auto ri : mRitemLayer[(int)RenderLayer::OpaqueInstanced])
+	{
+		const UINT lodCount = std::max((UINT)ri->Lods.size(), 1u);
+		ri->LodInstanceCounts.assign(lodCount, 0);
+		ri->InstanceLods.resize(ri->Instances.size(), 0);
+
+		mInstanceVisible.resize(ri->Instances.size());
+		JobSystem::Shared().ParallelFor(0, (UINT)ri->Instances.size(), gCullGrain, [this, ri](UINT i)
+		{
+			mInstanceVisible[i] = !mFrustumCulling ||
+				mWorldFrustum.Contains(ri->InstanceBounds[i]) != DirectX::DISJOINT;
+
+			if(mInstanceVisible[i] && !ri->Lods.empty())
+				ri->InstanceLods[i] = SelectLod(ri->Lods, ri->InstanceLods[i], ProjectedSize(ri->InstanceBounds[i]));
+		});
+
+		mVisibleInstances.clear();
+		for(UINT i = 0; i < (UINT)ri->Instances.size(); ++i)
+		{
+			if(!mInstanceVisible[i])
+				continue;
+
+			ri->LodInstanceCounts[ri->Lods.empty() ? 0 : ri->InstanceLods[i]]++;
+			mVisibleInstances.push_back(i);
+		}
+
+		// Pack the instances that survive culling at the front of the item's range,
+		// grouped by level so each level is one draw.
+		mLodOffsets.assign(lodCount, 0);
+		for(UINT lod = 1; lod < lodCount; ++lod)
+			mLodOffsets[lod] = mLodOffsets[lod - 1] + ri->LodInstanceCounts[lod - 1];
+
+		// Ordered as they are packed first, so they stream out in one pass.
+		mPackedInstances.resize(mVisibleInstances.size());
+		for(UINT i : mVisibleInstances)
+			mPackedInstances[mLodOffsets[ri->Lods.empty() ? 0 : ri->InstanceLods[i]]++] = i;
+
+		UploadWriter<InstanceData> writer = currInstanceBuffer.Writer(ri->InstanceBufferOffset);
+		for(UINT i : mPackedInstances)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&ri->Instances[i].World);
+			XMMATRIX texTransform = XMLoadFloat4x4(&ri->Instances[i].TexTransform);
+
+			InstanceData data;
+			XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+			writer.Write(data);
+		}
+
+		UINT visibleInstanceCount = (UINT)mVisibleInstances.size();
+		ri->InstanceCount = visibleInstanceCount;
+		if(visibleInstanceCount > 0)
+			visible.push_back(ri);
+
+		mVisibleCount += visibleInstanceCount;
+	}
+}
+
+void TreeBillboardsApp::UpdateTerrain(const GameTimer& gt)
+{
+	auto& currInstanceBuffer = mCurrFrameResource->InstanceBuffer;
+	auto& visible = mVisibleRitems[(int)RenderLayer::Terrain];
+	visible.clear();
+
+	mTerrain->Update(mEyePos, mWorldFrustum, mFrustumCulling);
+
+	const auto& tiles = mTerrain->VisibleTiles();
+	if(tiles.empty())
+		return;
+
+	// The grass repeats every eight units, in world space.
+	XMMATRIX texTransform = XMMatrixScaling(0.125f, 0.125f, 1.0f);
+
+	// The outer levels are mostly hidden by the fog.  With shading rates the tiles
+	// wholly inside it are packed last, to be drawn apart at a coarse rate.
+	BoundingBox bounds = tiles[0].Bounds;
+	UploadWriter<InstanceData> writer = currInstanceBuffer.Writer(mTerrainRitem->InstanceBufferOffset);
+	UINT foggedCount = 0;
+	for(int fogged = 0; fogged < (VrsActive() ? 2 : 1); ++fogged)
+	{
+		for(const Terrain::Tile& tile : tiles)
+		{
+			if(VrsActive() && (FogAmount(tile.Bounds) >= VariableRateShading::CoarseRateFog) != (fogged == 1))
+				continue;
+
+			XMMATRIX world = XMMatrixScaling(tile.Size, 1.0f, tile.Size) *
+				XMMatrixTranslation(tile.Origin.x, 0.0f, tile.Origin.y);
+
+			InstanceData data;
+			XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+			writer.Write(data);
+
+			BoundingBox::CreateMerged(bounds, bounds, tile.Bounds);
+			foggedCount += fogged;
+		}
+	}
+
+	// The render queue sorts by these bounds.
+	mScene.Bounds[mTerrainRitem->ObjCBIndex] = bounds;
+	mTerrainRitem->InstanceCount = (UINT)tiles.size();
+	mTerrainRitem->FoggedInstanceCount = foggedCount;
+	visible.push_back(mTerrainRitem);
+
+	mVisibleCount += (UINT)tiles.size();
+}
+
+float TreeBillboardsApp::FogAmount(const BoundingBox& bounds)const
+{
+	// Per axis, how far the eye is outside the box.
+	XMVECTOR outside = XMVectorMax(XMVectorZero(),
+		XMVectorAbs(XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&mEyePos)) - XMLoadFloat3(&bounds.Extents));
+	float distance = XMVectorGetX(XMVector3Length(outside));
+	return MathHelper::Clamp((distance - mMainPassCB.gFogStart) / mMainPassCB.gFogRange, 0.0f, 1.0f);
+}
+
+float TreeBillboardsApp::ProjectedSize(const BoundingBox& bounds)const
+{
+	// The bounding sphere's diameter over the viewport height at its distance;
+	// mProj(1,1) is 1/tan(fovY/2).
+	float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+	float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&mEyePos)));
+	if(distance <= radius)
+		return MathHelper::Infinity;
+
+	return radius*mProj(1, 1) / distance;
+}
+
+void TreeBillboardsApp::UpdateVisibilityGeometry()
+{
+	// Only the visible items can have ids in the buffer, so only theirs are written,
+	// staged in the frame's arena and streamed to their slots in one pass.
+	const auto& visible = mVisibleRitems[(int)RenderLayer::Opaque];
+	ArenaVector<UINT> indices(mCurrFrameResource->Arena);
+	ArenaVector<VisibilityGeometry> records(mCurrFrameResource->Arena);
+	indices.reserve(visible.size());
+	records.reserve(visible.size());
+	for(const RenderItem* ri : visible)
+	{
+		const MeshGeometry* geo = mGeometries[ri->Geo].get();
+		const EntityDrawArgs& args = mScene.DrawArgs[ri->ObjCBIndex];
+		const UINT indexSize = geo->IndexFormat == DXGI_FORMAT_R32_UINT ? 4 : 2;
+
+		// The draw's first vertex and index, as byte offsets into the raw buffers.
+		VisibilityGeometry record = {};
+		record.VertexBuffer = GeometryBufferIndex(geo->VertexBufferGPU.Get());
+		record.VertexOffset = (UINT)(geo->VertexBufferOffset + (INT64)args.BaseVertexLocation*geo->VertexByteStride);
+		record.IndexBuffer = GeometryBufferIndex(geo->IndexBufferGPU.Get());
+		record.IndexOffset = (UINT)(geo->IndexBufferOffset + (UINT64)args.StartIndexLocation*indexSize);
+		record.VertexFormat = geo->VertexFormat;
+		record.IndexSize = indexSize;
+
+		indices.push_back(ri->ObjCBIndex);
+		records.push_back(record);
+	}
+
+	mCurrFrameResource->VisibilityGeometries.CopyScatter(indices.data(), records.data(), (UINT)records.size());
+}
+
+void TreeBillboardsApp::UpdateIndirectCommands(const GameTimer& gt)
+{
+	const auto& objectCB = mCurrFrameResource->ObjectCB;
+	const auto& matCB = mCurrFrameResource->MaterialCB;
+
+	// The commands are written in order, and so are the opaque layer's candidates.
+	UploadWriter<IndirectCommand> indirectArgs = mCurrFrameResource->IndirectArgs.Writer();
+	UploadWriter<StructuredIndirectCommand> structuredArgs = mCurrFrameResource->StructuredIndirectArgs.Writer();
+	UploadWriter<OcclusionCandidate> candidates = mCurrFrameResource->OcclusionCandidates.Writer();
+	UINT commandIndex = 0;
+
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		auto& batches = mIndirectBatches[layer];
+		batches.clear();
+
+		// Instanced items are always drawn directly, and the vegetation has its own
+		// argument buffer.
+		if(layer == (int)RenderLayer::OpaqueInstanced || layer == (int)RenderLayer::Terrain ||
+			layer == (int)RenderLayer::AlphaTestedTreeSprites)
+			continue;
+
+		// Order does not matter for depth-tested layers, so without the render queue
+		// group items by PSO variant and texture to get fewer batches.  Blended items
+		// keep their submission order unless drawn with OIT.
+		mIndirectScratch = mVisibleRitems[layer];
+		if((mOit || layer != (int)RenderLayer::Transparent) && !mSortDraws)
+		{
+			const bool bindless = mBindless;
+			std::stable_sort(mIndirectScratch.begin(), mIndirectScratch.end(),
+				[this, bindless](const RenderItem* a, const RenderItem* b)
+				{
+					if(a->PsoVariant != b->PsoVariant)
+						return a->PsoVariant < b->PsoVariant;
+					return !bindless && mMaterials[mScene.Materials[a->ObjCBIndex]]->DiffuseSrvHeapIndex <
+						mMaterials[mScene.Materials[b->ObjCBIndex]]->DiffuseSrvHeapIndex;
+				});
+		}
+
+		if(layer == (int)RenderLayer::Opaque)
+			mOpaqueFirstCommand = commandIndex;
+
+		for(auto ri : mIndirectScratch)
+		{
+			const UINT entity = ri->ObjCBIndex;
+			const Material* mat = mMaterials[mScene.Materials[entity]].get();
+			const EntityDrawArgs& args = mScene.DrawArgs[entity];
+
+			D3D12_DRAW_INDEXED_ARGUMENTS drawArgs;
+			drawArgs.IndexCountPerInstance = args.IndexCount;
+			drawArgs.InstanceCount = 1;
+			drawArgs.StartIndexLocation = args.StartIndexLocation;
+			drawArgs.BaseVertexLocation = args.BaseVertexLocation;
+			drawArgs.StartInstanceLocation = 0;
+
+			if(mStructuredConstants)
+			{
+				structuredArgs.Emplace([&](StructuredIndirectCommand& cmd)
+				{
+					cmd.VertexBufferView = mGeometries[ri->Geo]->VertexBufferView();
+					cmd.IndexBufferView = mGeometries[ri->Geo]->IndexBufferView();
+					cmd.ObjectIndex = entity;
+					cmd.DrawArguments = drawArgs;
+				});
+			}
+			else
+			{
+				indirectArgs.Emplace([&](IndirectCommand& cmd)
+				{
+					cmd.ObjectCBV = objectCB.GpuAddress(entity);
+					cmd.MaterialCBV = matCB.GpuAddress(mat->MatCBIndex);
+					cmd.VertexBufferView = mGeometries[ri->Geo]->VertexBufferView();
+					cmd.IndexBufferView = mGeometries[ri->Geo]->IndexBufferView();
+					cmd.DrawArguments = drawArgs;
+				});
+			}
+
+			UINT srvIndex = mBindless ? 0 : (UINT)mat->DiffuseSrvHeapIndex;
+			if(batches.empty() || batches.back().SrvHeapIndex != srvIndex ||
+				batches.back().PsoVariant != ri->PsoVariant)
+			{
+				IndirectBatch batch;
+				batch.SrvHeapIndex = srvIndex;
+				batch.PsoVariant = ri->PsoVariant;
+				batch.FirstCommand = commandIndex;
+				batches.push_back(batch);
+			}
+			batches.back().CommandCount++;
+
+			// The occlusion cull finds each command's batch and where the batch starts
+			// relative to the layer.
+			if(layer == (int)RenderLayer::Opaque)
+			{
+				candidates.Emplace([&](OcclusionCandidate& candidate)
+				{
+					candidate.Center = mScene.Bounds[entity].Center;
+					candidate.Batch = (UINT)batches.size() - 1;
+					candidate.Extents = mScene.Bounds[entity].Extents;
+					candidate.BatchSlot = batches.back().FirstCommand - mOpaqueFirstCommand;
+				});
+			}
+
+			++commandIndex;
+		}
+	}
+}
+
+void TreeBillboardsApp::UpdateRenderQueue(const GameTimer& gt)
+{
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	float invDepthRange = 1.0f / (mCamFrustum.Far - mCamFrustum.Near);
+
+	mRenderQueue.Clear();
+	mQueueItems.clear();
+	for(UINT pass = 0; pass < (UINT)gNumLayerPasses; ++pass)
+	{
+		UINT layer = (UINT)gLayerPasses[pass].Layer;
+		// OIT does not depend on draw order, so then blended items sort by state too.
+		bool blended = gLayerPasses[pass].Blended && !mOit;
+
+		for(auto ri : mVisibleRitems[layer])
+		{
+			const UINT entity = ri->ObjCBIndex;
+			XMVECTOR centerV = XMVector3TransformCoord(XMLoadFloat3(&mScene.Bounds[entity].Center), view);
+			float depth = (XMVectorGetZ(centerV) - mCamFrustum.Near) * invDepthRange;
+
+			// The layer decides the pass, so the PSO field only has to tell the layer's
+			// variants apart.
+			UINT pso = ri->PsoVariant - mFirstPsoVariant[layer];
+			UINT matIndex = mMaterials[mScene.Materials[entity]]->MatCBIndex;
+			UINT64 key = blended ?
+				RenderQueue::MakeBlendedKey(layer, pso, ri->GeometryId, matIndex, depth) :
+				RenderQueue::MakeOpaqueKey(layer, pso, ri->GeometryId, matIndex, depth);
+
+			mRenderQueue.Push(key, (UINT)mQueueItems.size());
+			mQueueItems.push_back(ri);
+		}
+	}
+
+	mRenderQueue.Sort();
+
+	// The layer is the top of the key, so each layer comes back as one run.
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+		mVisibleRitems[layer].clear();
+	for(const auto& e : mRenderQueue.Entries())
+		mVisibleRitems[RenderQueue::KeyLayer(e.Key)].push_back(mQueueItems[e.Item]);
+}
+
+void TreeBillboardsApp::UpdateRenderGraph()
+{
+	// Only the tail of the frame goes through the graph.  The passes before it are
+	// spread over the worker lists, which the graph does not record.
+	mRenderGraph->Reset(mFence->GetCompletedValue(), mCurrFrameResource->Arena);
+
+	// Draw has moved the back buffer to RENDER_TARGET by the time the graph runs.
+	RenderGraph::Handle backBuffer = mRenderGraph->Import("backBuffer", CurrentBackBuffer(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+
+	RenderGraph::Handle postAAOutput = RenderGraph::InvalidHandle;
+	if(SceneOffscreen())
+	{
+		RenderGraph::Handle scene = mRenderGraph->Import("scene", mDynamicRes->Target(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET, DynamicResolution::ReadState);
+		RenderGraph::Handle source = scene;
+
+		if(mPostAA != PostAA::Off)
+		{
+			postAAOutput = mRenderGraph->CreateTexture("postAAOutput", mPostAntiAliasing->OutputDesc());
+
+			UINT pass = mRenderGraph->AddPass("postAA", RenderGraphQueue::Graphics,
+				[this](ID3D12GraphicsCommandList* cmdList)
+			{
+				UINT scope = mGpuProfiler->BeginScope(cmdList, "postAA");
+				mPostAntiAliasing->Apply(cmdList, mPostAARootSignature.Get(), mPSOs[mFramePsos.Fxaa].Get(),
+					mDynamicRes->Srv(), mDynamicRes->Width(), mDynamicRes->Height(),
+					gPostAAModes[(int)mPostAA].Settings);
+				mGpuProfiler->EndScope(cmdList, scope);
+			});
+			mRenderGraph->Read(pass, scene, DynamicResolution::ReadState);
+			mRenderGraph->Write(pass, postAAOutput, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+			source = postAAOutput;
+		}
+
+		bool filtered = source != scene;
+		UINT pass = mRenderGraph->AddPass("upscale", RenderGraphQueue::Graphics,
+			[this, filtered](ID3D12GraphicsCommandList* cmdList)
+		{
+			// At full resolution this is a copy: the filter's taps land on texel centers.
+			UINT scope = mGpuProfiler->BeginScope(cmdList, "upscale");
+			mDynamicRes->Upscale(cmdList, mUpscaleRootSignature.Get(), mPSOs[mFramePsos.Upscale].Get(),
+				filtered ? mPostAntiAliasing->Output() : mDynamicRes->Srv(),
+				CurrentBackBufferView(), mScreenViewport, mScissorRect);
+			mGpuProfiler->EndScope(cmdList, scope);
+		});
+		mRenderGraph->Read(pass, source, filtered ? D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE : DynamicResolution::ReadState);
+		mRenderGraph->Write(pass, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	}
+
+	// The light cull stays on its own compute path, so nothing here runs async.
+	mRenderGraph->Compile(false);
+
+	if(postAAOutput == RenderGraph::InvalidHandle)
+	{
+		// The graph releases the output once it is unused.
+		mPostAAOutput = nullptr;
+	}
+	else if(mRenderGraph->TransientGeneration() != mPostAAGeneration)
+	{
+		// Frames in flight may still use the views of the old output, so the new
+		// ones take fresh descriptors.
+		mPostAAGeneration = mRenderGraph->TransientGeneration();
+		mPostAAOutput = mRenderGraph->Resource(postAAOutput);
+		mDescriptors->Free(mPostAASrvIndex, PostAntiAliasing::DescriptorCount);
+		mPostAASrvIndex = mDescriptors->Allocate(PostAntiAliasing::DescriptorCount);
+		BuildPostAADescriptors();
+		RebuildMovedDescriptors();
+	}
+}
+
+void TreeBillboardsApp::UpdateStreamedTextures()
+{
+	// Poll also makes the graphics queue wait on the copies, ahead of this frame's lists.
+	for(auto& streamed : mTextureStreamer->Poll(mCommandQueue.Get()))
+	{
+		UINT slot = mStreamingTextures.at(streamed.Ticket);
+		mStreamingTextures.erase(streamed.Ticket);
+
+		mTextures[mTextureHandles[slot]]->Resource = streamed.Resource;
+		BuildTextureSrv(slot);
+
+		// Off screen material textures may be evicted when over budget.
+		mResidency->Track(streamed.Resource.Get(), ResidencyCategory::Texture, true);
+
+		// The material constants carry the index in bindless mode.
+		for(Material* mat : mAwaitingTexture[slot])
+		{
+			mat->DiffuseSrvHeapIndex = (int)mTextureSrvIndex[slot];
+			MarkMaterialDirty(mat);
+		}
+		mAwaitingTexture.erase(slot);
+	}
+
+	RebuildMovedDescriptors();
+}
+
+void TreeBillboardsApp::UpdateVirtualTextures()
+{
+	// This frame resource's fence has passed, so its readback holds what its last
+	// frame asked for.
+	if(const UINT* requests = mMipFeedback->Requests(mCurrFrameResourceIndex))
+	{
+		for(UINT slot = 0; slot < gNumTextureSlots; ++slot)
+		{
+			if(mVirtualTextureIds[slot] != (UINT)-1 && requests[slot] != MipFeedback::NoRequest)
+				mVirtualTextures->Request(mVirtualTextureIds[slot], requests[slot]);
+		}
+	}
+
+	// Mips are evicted from this frame on; their tiles are freed once it has passed.
+	for(UINT id : mVirtualTextures->Update(mCommandQueue.Get(), mFence->GetCompletedValue(), mCurrentFence + 1))
+	{
+		UINT slot = mVirtualTextureSlots[id];
+
+		// The view covers every mip; the first mips to arrive swap it in for the fallback.
+		if(mTextureSrvIndex[slot] == (UINT)-1)
+		{
+			BuildTextureSrv(slot);
+			for(Material* mat : mAwaitingTexture[slot])
+				mat->DiffuseSrvHeapIndex = (int)mTextureSrvIndex[slot];
+			mAwaitingTexture.erase(slot);
+		}
+
+		// The clamp moved.
+		for(Material* mat : mMaterialsByIndex)
+		{
+			if(mMaterialSlots[mat->MatCBIndex] == slot)
+				MarkMaterialDirty(mat);
+		}
+
+		// On demand, keep drawing so the feedback asks for whatever mips come next.
+		// It is read back gNumFrameResources frames after the frame that wrote it,
+		// so the frame drawn with the new mip must be followed that far.
+		RequestFrames(gNumFrameResources + 1);
+	}
+
+	RebuildMovedDescriptors();
+}
+
+void TreeBillboardsApp::RebuildMovedDescriptors()
+{
+	// Allocating views may have moved everything to a larger heap.
+	if(mDescriptors->Generation() != mDescriptorGeneration)
+	{
+		mDescriptorGeneration = mDescriptors->Generation();
+		if(mUseGpuWaves)
+			BuildWavesDescriptors();
+		else if(mStreamWaveHeights)
+			BuildWaveHeightDescriptors();
+		BuildOitDescriptors();
+		BuildDynamicResolutionDescriptors();
+		BuildPostAADescriptors();
+		BuildOcclusionDescriptors();
+		BuildVrsDescriptors();
+		BuildShadowDescriptors();
+		if(mVisibility != nullptr)
+			BuildVisibilityDescriptors();
+	}
+}
+
+void TreeBillboardsApp::UpdateResidency()
+{
+	// Mark the textures this frame samples with the fence it will signal, making
+	// any that were evicted resident again before the frame is submitted.
+	bool used[gNumTextureSlots] = {};
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		// Instanced items are culled per instance and trees on the GPU, so take
+		// them all.
+		const auto& ritems = layer == (int)RenderLayer::OpaqueInstanced ||
+			layer == (int)RenderLayer::AlphaTestedTreeSprites ? mRitemLayer[layer] : mVisibleRitems[layer];
+
+		for(auto ri : ritems)
+		{
+			UINT srvIndex = (UINT)mMaterials[mScene.Materials[ri->ObjCBIndex]]->DiffuseSrvHeapIndex;
+			for(UINT slot = 0; slot < gNumTextureSlots; ++slot)
+			{
+				if(mTextureSrvIndex[slot] == srvIndex)
+					used[slot] = true;
+			}
+		}
+	}
+
+	for(UINT slot = 0; slot < gNumTextureSlots; ++slot)
+	{
+		if(used[slot])
+			mResidency->MarkUsed(mTextures[mTextureHandles[slot]]->Resource.Get(), mCurrentFence + 1);
+	}
+
+	mResidency->Update(mFence->GetCompletedValue());
+}
+
+void TreeBillboardsApp::LoadTextures()
+{
+	// A 1x1 white texture, bound in place of each material texture until that
+	// texture has streamed in.
+	auto fallbackTex = std::make_unique<Texture>();
+	fallbackTex->Name = "fallbackTex";
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&fallbackTex->Resource)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(GetRequiredIntermediateSize(fallbackTex->Resource.Get(), 0, 1)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&fallbackTex->UploadHeap)));
+
+	const UINT32 white = 0xffffffff;
+	D3D12_SUBRESOURCE_DATA texData = {};
+	texData.pData = &white;
+	texData.RowPitch = sizeof(white);
+	texData.SlicePitch = sizeof(white);
+	UpdateSubresources<1>(mCommandList.Get(), fallbackTex->Resource.Get(), fallbackTex->UploadHeap.Get(), 0, 0, 1, &texData);
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(fallbackTex->Resource.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	mResidency->Track(fallbackTex->Resource.Get(), ResidencyCategory::Texture);
+	mTextures[fallbackTex->Name] = std::move(fallbackTex);
+
+	// The material textures load in the background; UpdateStreamedTextures picks
+	// them up as they arrive.
+	mTextureStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get());
+
+	if(mVirtualTexturing)
+	{
+		mVirtualTextures = std::make_unique<TiledTextureStreamer>(md3dDevice.Get(),
+			(UINT64)mTextureBudgetMB * 1024 * 1024);
+		mResidency->Track(mVirtualTextures->Heap(), ResidencyCategory::Texture);
+
+		// A request per slot; only the virtual slots' materials write theirs.
+		mMipFeedback = std::make_unique<MipFeedback>(md3dDevice.Get(), gNumTextureSlots, gNumFrameResources);
+		for(ID3D12Resource* resource : mMipFeedback->Resources())
+			mResidency->Track(resource, ResidencyCategory::Texture);
+	}
+
+	for(UINT slot = 0; slot < gNumTextureSlots; ++slot)
+	{
+		auto tex = std::make_unique<Texture>();
+		tex->Name = gTextureSlots[slot].Name;
+		tex->Filename = ConditionedTextureFile(gTextureSlots[slot].Filename);
+
+		// Array textures are drawn by the tree sprites, which write no requests.
+		mVirtualTextureIds[slot] = (UINT)-1;
+		if(mVirtualTexturing && !gTextureSlots[slot].IsArray)
+		{
+			mVirtualTextureIds[slot] = mVirtualTextures->Add(tex->Filename);
+			mVirtualTextureSlots.push_back(slot);
+			tex->Resource = mVirtualTextures->Resource(mVirtualTextureIds[slot]);
+		}
+		else
+			mStreamingTextures[mTextureStreamer->Request(tex->Filename)] = slot;
+
+		mTextureHandles[slot] = mTextures.Add(tex->Name);
+		mTextures[mTextureHandles[slot]] = std::move(tex);
+
+		// No view until the texture arrives.
+		mTextureSrvIndex[slot] = (UINT)-1;
+	}
+}
+
+void TreeBillboardsApp::BuildRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE texTable;
+	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+
+	CD3DX12_DESCRIPTOR_RANGE displacementMapTable;
+	displacementMapTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);
+
+	CD3DX12_DESCRIPTOR_RANGE shadowMapTable;
+	shadowMapTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, CascadedShadowMaps::SrvCount, 2);
+
+	// Both ranges cover the whole heap from its start, as 2D textures for
+	// Default.hlsl and as texture arrays for the tree sprites.
+	CD3DX12_DESCRIPTOR_RANGE bindlessTable[2];
+	bindlessTable[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 2, 0);
+	bindlessTable[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 3, 0);
+
+	CD3DX12_DESCRIPTOR_RANGE pyramidTable;
+	pyramidTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3, 4);
+
+	// The visibility buffer's ids and however many geometry buffers follow them.
+	CD3DX12_DESCRIPTOR_RANGE visibilityTable;
+	visibilityTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 5, 0);
+
+    // Root parameter can be a table, root descriptor or root constants.
+    CD3DX12_ROOT_PARAMETER slotRootParameter[19];
+
+	// Perfomance TIP: Order from most frequent to least frequent.
+	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+	if(mStructuredConstants)
+	{
+		// The object index, and the material data it leads to.
+		slotRootParameter[1].InitAsConstants(1, 0);
+		slotRootParameter[3].InitAsShaderResourceView(2, 1);
+	}
+	else
+	{
+		slotRootParameter[1].InitAsConstantBufferView(0);
+		slotRootParameter[3].InitAsConstantBufferView(2);
+	}
+    slotRootParameter[2].InitAsConstantBufferView(1);
+	slotRootParameter[4].InitAsShaderResourceView(0, 1);
+	slotRootParameter[5].InitAsDescriptorTable(1, &displacementMapTable, D3D12_SHADER_VISIBILITY_VERTEX);
+	slotRootParameter[6].InitAsShaderResourceView(1, 1);
+	slotRootParameter[7].InitAsShaderResourceView(3, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[8].InitAsShaderResourceView(4, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[9].InitAsDescriptorTable(1, &shadowMapTable, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[10].InitAsDescriptorTable(_countof(bindlessTable), bindlessTable, D3D12_SHADER_VISIBILITY_PIXEL);
+
+	// Meshlet.hlsl's constants and, in space4, the vertex buffer it reads raw, the
+	// meshlets, their indices and the occlusion pyramid.
+	UINT parameterCount = mBindless ? 11 : 10;
+	if(mMeshShadersSupported)
+	{
+		mMeshletRootParameter = parameterCount;
+		slotRootParameter[parameterCount++].InitAsConstants(gMeshletConstantCount, 3);
+		slotRootParameter[parameterCount++].InitAsShaderResourceView(0, 4);
+		slotRootParameter[parameterCount++].InitAsShaderResourceView(1, 4);
+		slotRootParameter[parameterCount++].InitAsShaderResourceView(2, 4);
+		slotRootParameter[parameterCount++].InitAsDescriptorTable(1, &pyramidTable);
+	}
+
+	// Default.hlsl's mip requests, with VIRTUAL_TEXTURES.
+	if(mVirtualTexturing)
+	{
+		mMipRequestRootParameter = parameterCount;
+		slotRootParameter[parameterCount++].InitAsUnorderedAccessView(0, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	}
+
+	// VisibilityBuffer.hlsl's table in space5 and its geometry records in space6.
+	if(mVisibilityBufferSupported)
+	{
+		mVisibilityRootParameter = parameterCount;
+		slotRootParameter[parameterCount++].InitAsDescriptorTable(1, &visibilityTable, D3D12_SHADER_VISIBILITY_PIXEL);
+		slotRootParameter[parameterCount++].InitAsShaderResourceView(0, 6, D3D12_SHADER_VISIBILITY_PIXEL);
+	}
+
+	auto staticSamplers = GetStaticSamplers();
+
+    // A root signature is an array of root parameters.  The object data SRV in
+    // slot 6 is only read in structured constants mode.  Slots 7 and 8 are the local
+    // lights and their clusters, and slot 9 the shadow maps.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(parameterCount, slotRootParameter,
+		(UINT)staticSamplers.size(), staticSamplers.data(),
+		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+    // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+    if(errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::OnMouseMove(WPARAM btnState, int x, int y)
+void TreeBillboardsApp::BuildWavesRootSignature()
 {
-    if((btnState & MK_LBUTTON) != 0)
-    {
-        // Make each pixel correspond to a quarter of a degree.
-        float dx = XMConvertToRadians(0.25f*static_cast<float>(x - mLastMousePos.x));
-        float dy = XMConvertToRadians(0.25f*static_cast<float>(y - mLastMousePos.y));
+	CD3DX12_DESCRIPTOR_RANGE uavTable0;
+	uavTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-        // Update angles based on input to orbit camera around box.
-        mTheta += dx;
-        mPhi += dy;
+	CD3DX12_DESCRIPTOR_RANGE uavTable1;
+	uavTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
 
-        // Restrict the angle mPhi.
-        mPhi = MathHelper::Clamp(mPhi, 0.1f, MathHelper::Pi - 0.1f);
-    }
-    else if((btnState & MK_RBUTTON) != 0)
-    {
-        // Make each pixel correspond to 0.2 unit in the scene.
-        float dx = 0.2f*static_cast<float>(x - mLastMousePos.x);
-        float dy = 0.2f*static_cast<float>(y - mLastMousePos.y);
+	CD3DX12_DESCRIPTOR_RANGE uavTable2;
+	uavTable2.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 2);
 
-        // Update the camera radius based on input.
-        mRadius += dx - dy;
+	// Root parameter can be a table, root descriptor or root constants.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
-        // Restrict the radius.
-        mRadius = MathHelper::Clamp(mRadius, 5.0f, 150.0f);
-    }
+	// Perfomance TIP: Order from most frequent to least frequent.
+	slotRootParameter[0].InitAsConstants(6, 0);
+	slotRootParameter[1].InitAsDescriptorTable(1, &uavTable0);
+	slotRootParameter[2].InitAsDescriptorTable(1, &uavTable1);
+	slotRootParameter[3].InitAsDescriptorTable(1, &uavTable2);
 
-    mLastMousePos.x = x;
-    mLastMousePos.y = y;
-}
- 
-void TreeBillboardsApp::OnKeyboardInput(const GameTimer& gt)
-{
-}
- 
-void TreeBillboardsApp::UpdateCamera(const GameTimer& gt)
-{
-	// Convert Spherical to Cartesian coordinates.
-	mEyePos.x = mRadius*sinf(mPhi)*cosf(mTheta);
-	mEyePos.z = mRadius*sinf(mPhi)*sinf(mTheta);
-	mEyePos.y = mRadius*cosf(mPhi);
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	// Build the view matrix.
-	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
-	XMVECTOR target = XMVectorZero();
-	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	// create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
-	XMStoreFloat4x4(&mView, view);
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
+
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mWavesRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::AnimateMaterials(const GameTimer& gt)
+void TreeBillboardsApp::BuildVegetationRootSignature()
 {
-	// Scroll the water material texture coordinates.
-	auto waterMat = mMaterials["water"].get();
-
-	float& tu = waterMat->MatTransform(3, 0);
-	float& tv = waterMat->MatTransform(3, 1);
-
-	tu += 0.1f * gt.DeltaTime();
-	tv += 0.02f * gt.DeltaTime();
+	// The buffers are bound as root descriptors, so the cull needs no heap.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	slotRootParameter[0].InitAsConstants(Vegetation::CullConstantCount, 0);
+	slotRootParameter[1].InitAsShaderResourceView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(0);
+	slotRootParameter[3].InitAsUnorderedAccessView(1);
 
-	if(tu >= 1.0f)
-		tu -= 1.0f;
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	if(tv >= 1.0f)
-		tv -= 1.0f;
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-	waterMat->MatTransform(3, 0) = tu;
-	waterMat->MatTransform(3, 1) = tv;
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-	// Material has changed, so need to update cbuffer.
-	waterMat->NumFramesDirty = gNumFrameResources;
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mVegetationRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::UpdateObjectCBs(const GameTimer& gt)
+void TreeBillboardsApp::BuildLightCullRootSignature()
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
-	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
+	slotRootParameter[0].InitAsConstants(ClusteredLighting::CullConstantCount, 0);
+	slotRootParameter[1].InitAsShaderResourceView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(0);
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
 	}
+	ThrowIfFailed(hr);
+
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mLightCullRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
+void TreeBillboardsApp::BuildOitRootSignature()
 {
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-	for(auto& e : mMaterials)
-	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
-		if(mat->NumFramesDirty > 0)
-		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+	CD3DX12_DESCRIPTOR_RANGE srvTable;
+	srvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, OitTargets::SrvCount, 0);
 
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+	CD3DX12_ROOT_PARAMETER slotRootParameter[1];
+	slotRootParameter[0].InitAsDescriptorTable(1, &srvTable, D3D12_SHADER_VISIBILITY_PIXEL);
 
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(1, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
-		}
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
 	}
+	ThrowIfFailed(hr);
+
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mOitRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::UpdateMainPassCB(const GameTimer& gt)
+void TreeBillboardsApp::BuildUpscaleRootSignature()
 {
-	XMMATRIX view = XMLoadFloat4x4(&mView);
-	XMMATRIX proj = XMLoadFloat4x4(&mProj);
+	CD3DX12_DESCRIPTOR_RANGE srvTable;
+	srvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+	slotRootParameter[0].InitAsDescriptorTable(1, &srvTable, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[1].InitAsConstants(DynamicResolution::UpscaleConstantCount, 0, 0, D3D12_SHADER_VISIBILITY_PIXEL);
 
-	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	mMainPassCB.EyePosW = mEyePos;
-	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-	mMainPassCB.NearZ = 1.0f;
-	mMainPassCB.FarZ = 1000.0f;
-	mMainPassCB.TotalTime = gt.TotalTime();
-	mMainPassCB.DeltaTime = gt.DeltaTime();
-	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
-	/*mMainPassCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[0].Strength = { 0.6f, 0.6f, 0.6f };
-	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[1].Strength = { 0.3f, 0.3f, 0.3f };
-	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
-	mMainPassCB.Lights[2].Strength = { 0.15f, 0.15f, 0.15f };*/
+	const CD3DX12_STATIC_SAMPLER_DESC linearClamp(0,
+		D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+		D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+		D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+		D3D12_TEXTURE_ADDRESS_MODE_CLAMP);
 
-	mMainPassCB.Lights[3].Position = { 0.0f, 3.5f, -0.75f };
-	mMainPassCB.Lights[3].Strength = { 0.0f, 0.0f, 2.0f };
-	
-	mMainPassCB.Lights[4].Position = { 0.0f, 3.5f, -11.0f };
-	mMainPassCB.Lights[4].Strength = { 2.0f, 0.0f, 0.0f }; //colors
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter,
+		1, &linearClamp,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mUpscaleRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
+void TreeBillboardsApp::BuildPostAARootSignature()
 {
-	// Every quarter second, generate a random wave.
-	static float t_base = 0.0f;
-	if((mTimer.TotalTime() - t_base) >= 0.25f)
-	{
-		t_base += 0.25f;
-
-		int i = MathHelper::Rand(4, mWaves->RowCount() - 5);
-		int j = MathHelper::Rand(4, mWaves->ColumnCount() - 5);
+	CD3DX12_DESCRIPTOR_RANGE srvTable;
+	srvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-		float r = MathHelper::RandF(0.2f, 0.5f);
+	CD3DX12_DESCRIPTOR_RANGE uavTable;
+	uavTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-		mWaves->Disturb(i, j, r);
-	}
+	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
+	slotRootParameter[0].InitAsConstants(PostAntiAliasing::ConstantCount, 0);
+	slotRootParameter[1].InitAsDescriptorTable(1, &srvTable);
+	slotRootParameter[2].InitAsDescriptorTable(1, &uavTable);
 
-	// Update the wave simulation.
-	mWaves->Update(gt.DeltaTime());
+	const CD3DX12_STATIC_SAMPLER_DESC linearClamp(0,
+		D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+		D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+		D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+		D3D12_TEXTURE_ADDRESS_MODE_CLAMP);
 
-	// Update the wave vertex buffer with the new solution.
-	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
-	{
-		Vertex v;
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter,
+		1, &linearClamp,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-		
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-		currWavesVB->CopyData(i, v);
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
 	}
+	ThrowIfFailed(hr);
 
-	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mPostAARootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::LoadTextures()
+void TreeBillboardsApp::BuildShadingRateRootSignature()
 {
-	auto grassTex = std::make_unique<Texture>();
-	grassTex->Name = "grassTex";
-	grassTex->Filename = L"../../Textures/grass.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), grassTex->Filename.c_str(),
-		grassTex->Resource, grassTex->UploadHeap));
-
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"../../Textures/water1.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
-
-	auto fenceTex = std::make_unique<Texture>();
-	fenceTex->Name = "fenceTex";
-	fenceTex->Filename = L"../../Textures/WireFence.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), fenceTex->Filename.c_str(),
-		fenceTex->Resource, fenceTex->UploadHeap));
-
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"../../Textures/treeArray.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
-
-	auto bricksTex = std::make_unique<Texture>();
-	bricksTex->Name = "bricksTex";
-	bricksTex->Filename = L"../../Textures/bricks.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricksTex->Filename.c_str(),
-		bricksTex->Resource, bricksTex->UploadHeap));
-
-	auto stoneTex = std::make_unique<Texture>();
-	stoneTex->Name = "stoneTex";
-	stoneTex->Filename = L"../../Textures/stone.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), stoneTex->Filename.c_str(),
-		stoneTex->Resource, stoneTex->UploadHeap));
-
-	auto tileTex = std::make_unique<Texture>();
-	tileTex->Name = "tileTex";
-	tileTex->Filename = L"../../Textures/tile.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), tileTex->Filename.c_str(),
-		tileTex->Resource, tileTex->UploadHeap));
-
-	auto woodTex = std::make_unique<Texture>();
-	woodTex->Name = "woodTex";
-	woodTex->Filename = L"../../Textures/wood.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), woodTex->Filename.c_str(),
-		woodTex->Resource, woodTex->UploadHeap));
-
-	auto iceTex = std::make_unique<Texture>();
-	iceTex->Name = "iceTex";
-	iceTex->Filename = L"../../Textures/ice.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), iceTex->Filename.c_str(),
-		iceTex->Resource, iceTex->UploadHeap));
-
-	auto gateTex = std::make_unique<Texture>();
-	gateTex->Name = "gateTex";
-	gateTex->Filename = L"../../Textures/WireFence.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), gateTex->Filename.c_str(),
-		gateTex->Resource, gateTex->UploadHeap));
-
-	auto roofTex = std::make_unique<Texture>();
-	roofTex->Name = "roofTex";
-	roofTex->Filename = L"../../Textures/roof.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), roofTex->Filename.c_str(),
-		roofTex->Resource, roofTex->UploadHeap));
-
-	auto metalTex = std::make_unique<Texture>();
-	metalTex->Name = "metalTex";
-	metalTex->Filename = L"../../Textures/metal.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), metalTex->Filename.c_str(),
-		metalTex->Resource, metalTex->UploadHeap));
-
-	auto bricks2Tex = std::make_unique<Texture>();
-	bricks2Tex->Name = "bricks2Tex";
-	bricks2Tex->Filename = L"../../Textures/bricks2.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricks2Tex->Filename.c_str(),
-		bricks2Tex->Resource, bricks2Tex->UploadHeap));
-	
-	auto maze0Tex = std::make_unique<Texture>();
-	maze0Tex->Name = "maze0Tex";
-	maze0Tex->Filename = L"../../Textures/maze.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), maze0Tex->Filename.c_str(),
-		maze0Tex->Resource, maze0Tex->UploadHeap));
-
-	mTextures[grassTex->Name] = std::move(grassTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[fenceTex->Name] = std::move(fenceTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[stoneTex->Name] = std::move(stoneTex);
-	mTextures[tileTex->Name] = std::move(tileTex);
-	mTextures[woodTex->Name] = std::move(woodTex);
-	mTextures[iceTex->Name] = std::move(iceTex);
-	mTextures[gateTex->Name] = std::move(gateTex);
-	mTextures[roofTex->Name] = std::move(roofTex);
-	mTextures[metalTex->Name] = std::move(metalTex);
-	mTextures[bricks2Tex->Name] = std::move(bricks2Tex);
-	mTextures[maze0Tex->Name] = std::move(maze0Tex);
-}
+	CD3DX12_DESCRIPTOR_RANGE srvTable;
+	srvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-void TreeBillboardsApp::BuildRootSignature()
-{
-	CD3DX12_DESCRIPTOR_RANGE texTable;
-	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+	CD3DX12_DESCRIPTOR_RANGE uavTable;
+	uavTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-    // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
+	slotRootParameter[0].InitAsConstants(VariableRateShading::ConstantCount, 0);
+	slotRootParameter[1].InitAsDescriptorTable(1, &srvTable);
+	slotRootParameter[2].InitAsDescriptorTable(1, &uavTable);
 
-	// Perfomance TIP: Order from most frequent to least frequent.
-	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
-    slotRootParameter[1].InitAsConstantBufferView(0);
-    slotRootParameter[2].InitAsConstantBufferView(1);
-    slotRootParameter[3].InitAsConstantBufferView(2);
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	auto staticSamplers = GetStaticSamplers();
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-    // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
-		(UINT)staticSamplers.size(), staticSamplers.data(),
-		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-    // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
-    ComPtr<ID3DBlob> serializedRootSig = nullptr;
-    ComPtr<ID3DBlob> errorBlob = nullptr;
-    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mShadingRateRootSignature.GetAddressOf())));
+}
 
-    if(errorBlob != nullptr)
-    {
-        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
-    }
-    ThrowIfFailed(hr);
+void TreeBillboardsApp::BuildOcclusionRootSignatures()
+{
+	CD3DX12_DESCRIPTOR_RANGE pyramidTable;
+	pyramidTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 2);
+
+	CD3DX12_ROOT_PARAMETER cullRootParameter[7];
+	cullRootParameter[0].InitAsConstants(OcclusionCulling::CullConstantCount, 0);
+	cullRootParameter[1].InitAsShaderResourceView(0);
+	cullRootParameter[2].InitAsShaderResourceView(1);
+	cullRootParameter[3].InitAsUnorderedAccessView(0);
+	cullRootParameter[4].InitAsUnorderedAccessView(1);
+	cullRootParameter[5].InitAsUnorderedAccessView(2);
+	cullRootParameter[6].InitAsDescriptorTable(1, &pyramidTable);
+
+	CD3DX12_DESCRIPTOR_RANGE srcTable;
+	srcTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3);
+	CD3DX12_DESCRIPTOR_RANGE dstTable;
+	dstTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 3);
+
+	CD3DX12_ROOT_PARAMETER reduceRootParameter[3];
+	reduceRootParameter[0].InitAsConstants(OcclusionCulling::ReduceConstantCount, 1);
+	reduceRootParameter[1].InitAsDescriptorTable(1, &srcTable);
+	reduceRootParameter[2].InitAsDescriptorTable(1, &dstTable);
+
+	const CD3DX12_ROOT_SIGNATURE_DESC rootSigDescs[] =
+	{
+		CD3DX12_ROOT_SIGNATURE_DESC(_countof(cullRootParameter), cullRootParameter,
+			0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE),
+		CD3DX12_ROOT_SIGNATURE_DESC(_countof(reduceRootParameter), reduceRootParameter,
+			0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE),
+	};
+	ID3D12RootSignature** rootSigs[] =
+	{
+		mOcclusionCullRootSignature.GetAddressOf(),
+		mHiZRootSignature.GetAddressOf(),
+	};
 
-    ThrowIfFailed(md3dDevice->CreateRootSignature(
-		0,
-        serializedRootSig->GetBufferPointer(),
-        serializedRootSig->GetBufferSize(),
-        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+	for(int i = 0; i < _countof(rootSigDescs); ++i)
+	{
+		ComPtr<ID3DBlob> serializedRootSig = nullptr;
+		ComPtr<ID3DBlob> errorBlob = nullptr;
+		HRESULT hr = D3D12SerializeRootSignature(&rootSigDescs[i], D3D_ROOT_SIGNATURE_VERSION_1,
+			serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+		if(errorBlob != nullptr)
+		{
+			::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+		}
+		ThrowIfFailed(hr);
+
+		ThrowIfFailed(md3dDevice->CreateRootSignature(
+			0,
+			serializedRootSig->GetBufferPointer(),
+			serializedRootSig->GetBufferSize(),
+			IID_PPV_ARGS(rootSigs[i])));
+	}
 }
 
-void TreeBillboardsApp::BuildDescriptorHeaps()
+void TreeBillboardsApp::BuildCommandSignature()
 {
-	//
-	// Create the SRV heap.
-	//
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 15;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
+	// Each indirect command rebinds the per-object and per-material root CBVs and the
+	// geometry, then draws.  This must match the IndirectCommand layout.
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[5] = {};
+	argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW;
+	argumentDescs[0].ConstantBufferView.RootParameterIndex = 1;
+	argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW;
+	argumentDescs[1].ConstantBufferView.RootParameterIndex = 3;
+	argumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+	argumentDescs[2].VertexBuffer.Slot = 0;
+	argumentDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+	argumentDescs[4].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	// With structured constants only the object index changes between draws.  This
+	// must match the StructuredIndirectCommand layout.
+	D3D12_INDIRECT_ARGUMENT_DESC structuredArgumentDescs[4] = {};
+	structuredArgumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+	structuredArgumentDescs[0].VertexBuffer.Slot = 0;
+	structuredArgumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+	structuredArgumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	structuredArgumentDescs[2].Constant.RootParameterIndex = 1;
+	structuredArgumentDescs[2].Constant.DestOffsetIn32BitValues = 0;
+	structuredArgumentDescs[2].Constant.Num32BitValuesToSet = 1;
+	structuredArgumentDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+	if(mStructuredConstants)
+	{
+		commandSignatureDesc.pArgumentDescs = structuredArgumentDescs;
+		commandSignatureDesc.NumArgumentDescs = _countof(structuredArgumentDescs);
+		commandSignatureDesc.ByteStride = sizeof(StructuredIndirectCommand);
+	}
+	else
+	{
+		commandSignatureDesc.pArgumentDescs = argumentDescs;
+		commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+		commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+	}
 
-	//
-	// Fill out the heap with actual descriptors.
-	//
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	// The root signature is required because the commands change root arguments.
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&commandSignatureDesc,
+		mRootSignature.Get(), IID_PPV_ARGS(mCommandSignature.GetAddressOf())));
+}
 
-	auto grassTex = mTextures["grassTex"]->Resource;
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto fenceTex = mTextures["fenceTex"]->Resource;
-	
-	auto bricksTex = mTextures["bricksTex"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
-	auto stoneTex = mTextures["stoneTex"]->Resource;
-	auto tileTex = mTextures["tileTex"]->Resource;
-	auto woodTex = mTextures["woodTex"]->Resource;
-	auto iceTex = mTextures["iceTex"]->Resource;
-	auto gateTex = mTextures["gateTex"]->Resource;
-	auto roofTex = mTextures["roofTex"]->Resource;
-	auto metalTex = mTextures["metalTex"]->Resource;
-	auto bricks2Tex = mTextures["bricks2Tex"]->Resource;
-	auto maze0Tex = mTextures["maze0Tex"]->Resource;
+void TreeBillboardsApp::BuildDescriptorHeaps()
+{
+	// The material texture views are allocated by BuildTextureSrv as the
+	// textures stream in.  Until then materials point at the fallback views.
+	auto fallbackTex = mTextures["fallbackTex"]->Resource;
 
+	mFallbackSrvIndex = mDescriptors->Allocate();
+	mFallbackArraySrvIndex = mDescriptors->Allocate();
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = grassTex->GetDesc().Format;
+	srvDesc.Format = fallbackTex->GetDesc().Format;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 	srvDesc.Texture2D.MostDetailedMip = 0;
 	srvDesc.Texture2D.MipLevels = -1;
-	md3dDevice->CreateShaderResourceView(grassTex.Get(), &srvDesc, hDescriptor);
+	md3dDevice->CreateShaderResourceView(fallbackTex.Get(), &srvDesc, mDescriptors->CpuHandle(mFallbackSrvIndex));
+	mDescriptors->Publish(mFallbackSrvIndex);
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-
-	srvDesc.Format = waterTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(waterTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// A one-slice array view for the tree sprites; the shader's array index clamps to it.
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = -1;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = 1;
+	md3dDevice->CreateShaderResourceView(fallbackTex.Get(), &srvDesc, mDescriptors->CpuHandle(mFallbackArraySrvIndex));
+	mDescriptors->Publish(mFallbackArraySrvIndex);
 
-	srvDesc.Format = fenceTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(fenceTex.Get(), &srvDesc, hDescriptor);
+	if(mUseGpuWaves)
+	{
+		mWavesSrvIndex = mDescriptors->Allocate(mGpuWaves->DescriptorCount());
+		BuildWavesDescriptors();
+	}
+	else if(mStreamWaveHeights)
+	{
+		mWaveHeightSrvIndex = mDescriptors->Allocate(1);
+		BuildWaveHeightDescriptors();
+	}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	mOitTargets = std::make_unique<OitTargets>(md3dDevice.Get());
+	mOitTargets->Resize(mClientWidth, mClientHeight);
+	mOitSrvIndex = mDescriptors->Allocate(OitTargets::SrvCount);
+	BuildOitDescriptors();
 
-	srvDesc.Format = bricksTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(bricksTex.Get(), &srvDesc, hDescriptor);
+	mDynamicRes = std::make_unique<DynamicResolution>(md3dDevice.Get(), mBackBufferFormat,
+		(const float*)&mMainPassCB.FogColor);
+	mDynamicRes->Resize(mClientWidth, mClientHeight);
+	mSceneSrvIndex = mDescriptors->Allocate(1);
+	BuildDynamicResolutionDescriptors();
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	mPostAntiAliasing = std::make_unique<PostAntiAliasing>(md3dDevice.Get(), mBackBufferFormat);
+	mPostAntiAliasing->Resize(mClientWidth, mClientHeight);
+	mPostAASrvIndex = mDescriptors->Allocate(PostAntiAliasing::DescriptorCount);
 
-	srvDesc.Format = stoneTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = stoneTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(stoneTex.Get(), &srvDesc, hDescriptor);
+	mRenderGraph = std::make_unique<RenderGraph>(md3dDevice.Get());
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	mVrs = std::make_unique<VariableRateShading>(md3dDevice.Get());
+	mVrs->Resize(mDepthStencilBuffer.Get(), mClientWidth, mClientHeight);
+	if(mVrs->ImageSupported())
+		mVrsSrvIndex = mDescriptors->Allocate(VariableRateShading::DescriptorCount);
+	BuildVrsDescriptors();
 
-	srvDesc.Format = tileTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = tileTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(tileTex.Get(), &srvDesc, hDescriptor);
+	mShadowMaps = std::make_unique<CascadedShadowMaps>(md3dDevice.Get(), 2048, 1024);
+	mShadowSrvIndex = mDescriptors->Allocate(CascadedShadowMaps::SrvCount);
+	BuildShadowDescriptors();
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	mDescriptorGeneration = mDescriptors->Generation();
+}
 
-	srvDesc.Format = woodTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = woodTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(woodTex.Get(), &srvDesc, hDescriptor);
+void TreeBillboardsApp::BuildWavesDescriptors()
+{
+	// GpuWaves keeps GPU handles, so this runs again whenever the heap is replaced.
+	mGpuWaves->BuildDescriptors(mDescriptors->CpuHandle(mWavesSrvIndex),
+		mDescriptors->GpuHandle(mWavesSrvIndex), mCbvSrvDescriptorSize);
+	mDescriptors->Publish(mWavesSrvIndex, mGpuWaves->DescriptorCount());
+}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void TreeBillboardsApp::BuildWaveHeightDescriptors()
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = 1;
+	md3dDevice->CreateShaderResourceView(mWaveHeights.Get(), &srvDesc, mDescriptors->CpuHandle(mWaveHeightSrvIndex));
+	mDescriptors->Publish(mWaveHeightSrvIndex);
+}
 
-	srvDesc.Format = iceTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = iceTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(iceTex.Get(), &srvDesc, hDescriptor);
+void TreeBillboardsApp::BuildOitDescriptors()
+{
+	// The RTVs follow the swap chain's.
+	mOitTargets->BuildDescriptors(mDescriptors->CpuHandle(mOitSrvIndex),
+		mDescriptors->GpuHandle(mOitSrvIndex), mCbvSrvDescriptorSize,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mRtvHeap->GetCPUDescriptorHandleForHeapStart(), SwapChainBufferCount, mRtvDescriptorSize),
+		mRtvDescriptorSize);
+	mDescriptors->Publish(mOitSrvIndex, OitTargets::SrvCount);
+}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void TreeBillboardsApp::BuildDynamicResolutionDescriptors()
+{
+	// The RTV follows the OIT targets'.
+	mDynamicRes->BuildDescriptors(mDescriptors->CpuHandle(mSceneSrvIndex), mDescriptors->GpuHandle(mSceneSrvIndex),
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mRtvHeap->GetCPUDescriptorHandleForHeapStart(),
+			SwapChainBufferCount + OitTargets::RtvCount, mRtvDescriptorSize));
+	mDescriptors->Publish(mSceneSrvIndex);
+}
 
-	srvDesc.Format = gateTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = gateTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(gateTex.Get(), &srvDesc, hDescriptor);
+void TreeBillboardsApp::BuildPostAADescriptors()
+{
+	// The graph creates the output with the first frame that filters.
+	if(mPostAAOutput == nullptr)
+		return;
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	mPostAntiAliasing->BuildDescriptors(mDescriptors->CpuHandle(mPostAASrvIndex),
+		mDescriptors->GpuHandle(mPostAASrvIndex), mCbvSrvDescriptorSize, mPostAAOutput);
+	mDescriptors->Publish(mPostAASrvIndex, PostAntiAliasing::DescriptorCount);
+}
 
-	srvDesc.Format = roofTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = roofTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(roofTex.Get(), &srvDesc, hDescriptor);
+void TreeBillboardsApp::BuildVrsDescriptors()
+{
+	// Views the depth buffer, like the occlusion pyramid's.
+	if(!mVrs->ImageSupported())
+		return;
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	mVrs->BuildDescriptors(mDescriptors->CpuHandle(mVrsSrvIndex),
+		mDescriptors->GpuHandle(mVrsSrvIndex), mCbvSrvDescriptorSize);
+	mDescriptors->Publish(mVrsSrvIndex, VariableRateShading::DescriptorCount);
+}
 
-	srvDesc.Format = metalTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = metalTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(metalTex.Get(), &srvDesc, hDescriptor);
-	
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void TreeBillboardsApp::BuildShadowDescriptors()
+{
+	// The DSVs follow the depth buffer's.
+	mShadowMaps->BuildDescriptors(mDescriptors->CpuHandle(mShadowSrvIndex),
+		mDescriptors->GpuHandle(mShadowSrvIndex), mCbvSrvDescriptorSize,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mDsvHeap->GetCPUDescriptorHandleForHeapStart(), 1, mDsvDescriptorSize),
+		mDsvDescriptorSize);
+	mDescriptors->Publish(mShadowSrvIndex, CascadedShadowMaps::SrvCount);
+}
 
-	srvDesc.Format = bricks2Tex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = bricks2Tex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(bricks2Tex.Get(), &srvDesc, hDescriptor);
-	
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void TreeBillboardsApp::BuildOcclusionDescriptors()
+{
+	// Keeps GPU handles and views of the depth buffer, so this runs again on resize
+	// as well as when the heap is replaced.
+	mOcclusion->BuildDescriptors(mDescriptors->CpuHandle(mOcclusionSrvIndex),
+		mDescriptors->GpuHandle(mOcclusionSrvIndex), mCbvSrvDescriptorSize);
+	mDescriptors->Publish(mOcclusionSrvIndex, OcclusionCulling::DescriptorCount());
+}
 
-	srvDesc.Format = maze0Tex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = maze0Tex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(maze0Tex.Get(), &srvDesc, hDescriptor);
+void TreeBillboardsApp::BuildVisibilityDescriptors()
+{
+	// The RTV follows the dynamic resolution target's.  The geometry heap's buffers
+	// are all created by now, and never replaced.
+	std::vector<ID3D12Resource*> buffers;
+	for(UINT i = 0; i < mGeometryHeap->HeapCount(); ++i)
+		buffers.push_back(mGeometryHeap->Buffer(i));
+
+	mVisibility->BuildDescriptors(mDescriptors->CpuHandle(mVisibilitySrvIndex),
+		mDescriptors->GpuHandle(mVisibilitySrvIndex), mCbvSrvDescriptorSize, buffers,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mRtvHeap->GetCPUDescriptorHandleForHeapStart(),
+			SwapChainBufferCount + OitTargets::RtvCount + 1, mRtvDescriptorSize));
+	mDescriptors->Publish(mVisibilitySrvIndex, VisibilityBuffer::DescriptorCount((UINT)buffers.size()));
+}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void TreeBillboardsApp::BuildTextureSrv(UINT slot)
+{
+	auto tex = mTextures[mTextureHandles[slot]]->Resource;
 
-	auto desc = treeArrayTex->GetDesc();
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
-	srvDesc.Format = treeArrayTex->GetDesc().Format;
-	srvDesc.Texture2DArray.MostDetailedMip = 0;
-	srvDesc.Texture2DArray.MipLevels = -1;
-	srvDesc.Texture2DArray.FirstArraySlice = 0;
-	srvDesc.Texture2DArray.ArraySize = treeArrayTex->GetDesc().DepthOrArraySize;
-	md3dDevice->CreateShaderResourceView(treeArrayTex.Get(), &srvDesc, hDescriptor);
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = tex->GetDesc().Format;
+	if(gTextureSlots[slot].IsArray)
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.MipLevels = -1;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = tex->GetDesc().DepthOrArraySize;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = -1;
+	}
 
-	
+	// A fresh descriptor, so no frame in flight can be reading it.
+	mTextureSrvIndex[slot] = mDescriptors->Allocate();
+	md3dDevice->CreateShaderResourceView(tex.Get(), &srvDesc, mDescriptors->CpuHandle(mTextureSrvIndex[slot]));
+	mDescriptors->Publish(mTextureSrvIndex[slot]);
 }
 
 void TreeBillboardsApp::BuildShadersAndInputLayouts()
 {
-	const D3D_SHADER_MACRO defines[] =
+	// The graphics shaders are built for the binding modes chosen at startup, on
+	// top of their own defines.
+	auto withModes = [this](std::vector<D3D_SHADER_MACRO> macros)
+	{
+		if(mBindless)
+			macros.push_back({ "BINDLESS", "1" });
+		if(mStructuredConstants)
+			macros.push_back({ "STRUCTURED_CONSTANTS", "1" });
+		if(mVirtualTexturing)
+			macros.push_back({ "VIRTUAL_TEXTURES", "1" });
+		macros.push_back({ NULL, NULL });
+		return macros;
+	};
+
+	const auto baseDefines = withModes({});
+	const auto alphaTestDefines = withModes({ { "FOG", "1" }, { "ALPHA_TEST", "1" } });
+
+	// Default.hlsl is compiled per feature mask as BuildPsoVariants asks for it.
+	mShaderPermutations = std::make_unique<ShaderPermutations>(mShaderCache.get(), gShaderFeatureFields, baseDefines);
+
+	struct ShaderJob
+	{
+		const char* Name;
+		const wchar_t* Filename;
+		const D3D_SHADER_MACRO* Defines;
+		const char* Entrypoint;
+		const char* Target;
+	};
+
+	const ShaderJob jobs[] =
+	{
+		{ "wavesUpdateCS", L"Shaders\\WaveSim.hlsl", nullptr, "UpdateWavesCS", "cs_5_1" },
+		{ "wavesDisturbCS", L"Shaders\\WaveSim.hlsl", nullptr, "DisturbWavesCS", "cs_5_1" },
+
+		{ "vegetationCullCS", L"Shaders\\Vegetation.hlsl", nullptr, "CullCS", "cs_5_1" },
+		{ "lightCullCS", L"Shaders\\LightCull.hlsl", nullptr, "CullCS", "cs_5_1" },
+		{ "occlusionCullCS", L"Shaders\\OcclusionCull.hlsl", nullptr, "CullCS", "cs_5_1" },
+		{ "hiZReduceCS", L"Shaders\\OcclusionCull.hlsl", nullptr, "ReduceCS", "cs_5_1" },
+
+		{ "oitCompositeVS", L"Shaders\\OitComposite.hlsl", nullptr, "VS", "vs_5_1" },
+		{ "oitCompositePS", L"Shaders\\OitComposite.hlsl", nullptr, "PS", "ps_5_1" },
+		{ "upscaleVS", L"Shaders\\Upscale.hlsl", nullptr, "VS", "vs_5_1" },
+		{ "upscalePS", L"Shaders\\Upscale.hlsl", nullptr, "PS", "ps_5_1" },
+		{ "fxaaCS", L"Shaders\\Fxaa.hlsl", nullptr, "FxaaCS", "cs_5_1" },
+		{ "shadingRateCS", L"Shaders\\ShadingRate.hlsl", nullptr, "RateCS", "cs_5_1" },
+
+		{ "treeSpriteVS", L"Shaders\\TreeSprite.hlsl", baseDefines.data(), "VS", "vs_5_1" },
+		{ "treeSpritePS", L"Shaders\\TreeSprite.hlsl", alphaTestDefines.data(), "PS", "ps_5_1" },
+	};
+
+	// The compiles are independent, so a cold cache compiles them side by side.
+	ComPtr<ID3DBlob> byteCode[_countof(jobs)];
+	JobSystem::Shared().ParallelFor(0, _countof(jobs), 1, [&](UINT i)
+	{
+		byteCode[i] = mShaderCache->Compile(jobs[i].Filename, jobs[i].Defines, jobs[i].Entrypoint, jobs[i].Target);
+	});
+
+	for(int i = 0; i < _countof(jobs); ++i)
+		mShaders[jobs[i].Name] = byteCode[i];
+
+    mStdInputLayout.assign(std::begin(gVertexLayout), std::end(gVertexLayout));
+
+	mTerrainInputLayout =
 	{
-		"FOG", "1",
-		NULL, NULL
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
+}
+
+void TreeBillboardsApp::BuildTerrainGeometry()
+{
+	// Sixteen unit tiles at the finest level, out to a couple of kilometres.
+	mTerrain = std::make_unique<Terrain>(16.0f, 8);
+
+	// One tile mesh serves every level; the heights come from the vertex shader.
+	std::vector<XMFLOAT3> vertices;
+	std::vector<std::uint16_t> indices;
+	Terrain::BuildTileMesh(vertices, indices);
+
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(XMFLOAT3);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "terrainGeo";
+
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+
+	mGeometryHeap->UploadVertices(*geo, vertices.data(), vbByteSize);
+	mGeometryHeap->UploadIndices(*geo, indices.data(), ibByteSize);
+
+	geo->VertexByteStride = sizeof(XMFLOAT3);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
 
-	const D3D_SHADER_MACRO alphaTestDefines[] =
-	{
-		"FOG", "1",
-		"ALPHA_TEST", "1",
-		NULL, NULL
-	};
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)indices.size();
+	submesh.StartIndexLocation = 0;
+	submesh.BaseVertexLocation = 0;
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
-	
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	// Tiles are culled by their own bounds in Terrain::Update.
+	submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	submesh.Bounds.Extents = XMFLOAT3(mTerrain->Extent(), Terrain::MaxHeight, mTerrain->Extent());
 
-    mStdInputLayout =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
+	geo->DrawArgs["tile"] = submesh;
 
-	mTreeSpriteInputLayout =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	};
+	AddGeometry(std::move(geo));
 }
 
-void TreeBillboardsApp::BuildLandGeometry()
+void TreeBillboardsApp::BuildWavesGeometry()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
-
-    //
-    // Extract the vertex elements we are interested and apply the height function to
-    // each vertex.  In addition, color the vertices based on their height so we have
-    // sandy looking beaches, grassy low hills, and snow mountain peaks.
-    //
+	// Every patch draws one of these index ranges from its own base vertex, so the
+	// indices stay 16-bit however large the lake.
+	std::vector<std::uint16_t> indices;
+	mWaterPatches->BuildIndices(indices);
 
-    std::vector<Vertex> vertices(grid.Vertices.size());
-    for(size_t i = 0; i < grid.Vertices.size(); ++i)
-    {
-        auto& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-        vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
-        vertices[i].Normal = GetHillsNormal(p.x, p.z);
-		vertices[i].TexC = grid.Vertices[i].TexC;
-    }
+	UINT vbByteSize = mWaterPatches->VertexCount()*sizeof(Vertex);
+	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
 
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "waterGeo";
 
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	if(mStreamWaveHeights)
+	{
+		// Only x/z and the texture coordinates, which address the point's texel of
+		// the height texture; the vertex shader reads the height and derives the
+		// normal, so the buffer is static.
+		std::vector<Vertex> vertices(mWaterPatches->VertexCount());
+		const int patchPoints = gWaterPatchQuads + 1;
+		for(int patch = 0; patch < mWaterPatches->PatchCount(); ++patch)
+		{
+			for(int row = 0; row < patchPoints; ++row)
+			{
+				for(int col = 0; col < patchPoints; ++col)
+				{
+					int i = mWaterPatches->GridIndex(patch, row, col);
+
+					Vertex& v = vertices[patch*mWaterPatches->PatchVertexCount() + row*patchPoints + col];
+					v.Pos = mWaves->Position(i);
+					v.Pos.y = 0.0f;
+					v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+					v.TexC.x = (i % mWaves->ColumnCount() + 0.5f) / mWaves->ColumnCount();
+					v.TexC.y = (i / mWaves->ColumnCount() + 0.5f) / mWaves->RowCount();
+				}
+			}
+		}
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "landGeo";
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+		mGeometryHeap->UploadVertices(*geo, vertices.data(), vbByteSize);
+	}
+	else
+	{
+		// Set dynamically.
+		geo->VertexBufferCPU = nullptr;
+		geo->VertexBufferGPU = nullptr;
+	}
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	mGeometryHeap->UploadIndices(*geo, indices.data(), ibByteSize);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
+	// The finest, unstitched level of the first patch; BuildRenderItems gives each
+	// patch its own, and UpdateWaves picks their levels.
+	WaterPatches::IndexRange range = mWaterPatches->Indices(0);
+
 	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
+	submesh.IndexCount = range.IndexCount;
+	submesh.StartIndexLocation = range.StartIndexLocation;
 	submesh.BaseVertexLocation = 0;
+	submesh.Bounds = mWaterPatches->Bounds(0);
 
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["landGeo"] = std::move(geo);
+	AddGeometry(std::move(geo));
 }
 
-void TreeBillboardsApp::BuildWavesGeometry()
+void TreeBillboardsApp::BuildGpuWavesGeometry()
 {
-    std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
-
-    // Iterate over each quad.
-    int m = mWaves->RowCount();
-    int n = mWaves->ColumnCount();
-    int k = 0;
-    for(int i = 0; i < m - 1; ++i)
-    {
-        for(int j = 0; j < n - 1; ++j)
-        {
-            indices[k] = i*n + j;
-            indices[k + 1] = i*n + j + 1;
-            indices[k + 2] = (i + 1)*n + j;
+	// The grid only supplies x/z and texture coordinates; the vertex shader reads the
+	// heights from the displacement map, so the buffers are static.  Space the
+	// vertices one simulation cell apart so the shader's finite differences match.
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(
+		(mGpuWaves->ColumnCount() - 1)*mGpuWaves->SpatialStep(),
+		(mGpuWaves->RowCount() - 1)*mGpuWaves->SpatialStep(),
+		mGpuWaves->RowCount(), mGpuWaves->ColumnCount());
 
-            indices[k + 3] = (i + 1)*n + j;
-            indices[k + 4] = i*n + j + 1;
-            indices[k + 5] = (i + 1)*n + j + 1;
+	std::vector<Vertex> vertices(grid.Vertices.size());
+	for(size_t i = 0; i < grid.Vertices.size(); ++i)
+	{
+		vertices[i].Pos = grid.Vertices[i].Position;
+		vertices[i].Normal = grid.Vertices[i].Normal;
+		vertices[i].TexC = grid.Vertices[i].TexC;
+	}
 
-            k += 6; // next quad
-        }
-    }
+	// Large grids exceed the range of 16-bit indices.
+	std::vector<std::uint32_t> indices = grid.Indices32;
 
-	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	UINT vbByteSize = (UINT)vertices.size()*sizeof(Vertex);
+	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint32_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
 
-	// Set dynamically.
-	geo->VertexBufferCPU = nullptr;
-	geo->VertexBufferGPU = nullptr;
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	mGeometryHeap->UploadVertices(*geo, vertices.data(), vbByteSize);
+	mGeometryHeap->UploadIndices(*geo, indices.data(), ibByteSize);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = -1;
+	submesh.BaseVertexLocation = 0;
+
+	// The heights are animated, so bound the grid with some vertical slack.
+	submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	submesh.Bounds.Extents = XMFLOAT3(0.5f*mGpuWaves->Width(), 2.0f, 0.5f*mGpuWaves->Depth());
 
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["waterGeo"] = std::move(geo);
+	AddGeometry(std::move(geo));
 }
 
 void TreeBillboardsApp::BuildBoxGeometry()
@@ -1020,11 +4778,8 @@ void TreeBillboardsApp::BuildBoxGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	mGeometryHeap->UploadVertices(*geo, vertices.data(), vbByteSize);
+	mGeometryHeap->UploadIndices(*geo, indices.data(), ibByteSize);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
@@ -1035,79 +4790,198 @@ void TreeBillboardsApp::BuildBoxGeometry()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["box"] = submesh;
 
-	mGeometries["boxGeo"] = std::move(geo);
+	AddGeometry(std::move(geo));
 }
 
-void TreeBillboardsApp::BuildTreeSpritesGeometry()
+void TreeBillboardsApp::BuildVegetation()
 {
-	//step5
-	struct TreeSpriteVertex
-	{
-		XMFLOAT3 Pos;
-		XMFLOAT2 Size;
-	};
+	// Scatter the forest over the dry land around the lake, out to a kilometre.
+	const float minRadius = 75.0f;
+	const float maxRadius = 1000.0f;
 
-	static const int treeCount = 5;
-	std::array<TreeSpriteVertex, 16> vertices;
-	for(UINT i = 0; i < 5; ++i)
+	std::vector<TreeInstance> trees;
+	trees.reserve(gTreeCount);
+	for(UINT attempt = 0; trees.size() < gTreeCount && attempt < 4*gTreeCount; ++attempt)
 	{
-		/*float x = MathHelper::RandF(-10.0f, 10.0f);
-		float z = MathHelper::RandF(-10.0f, 10.0f);*/
-		// Move tree slightly above land height.
-		/*y += 8.0f;*/
-
-		vertices[1].Pos = XMFLOAT3(12.5, 10, 11);
-		vertices[2].Pos = XMFLOAT3(-12.5, 10, 11);
-		vertices[3].Pos = XMFLOAT3(12.5, 10, -11);
-		vertices[4].Pos = XMFLOAT3(-12.5, 10, -11);
-		vertices[i].Size = XMFLOAT2(20.0f, 20.0f);
+		// Uniform over the ring's area.
+		float r = sqrtf(MathHelper::RandF(minRadius*minRadius, maxRadius*maxRadius));
+		float theta = MathHelper::RandF(0.0f, 2.0f*MathHelper::Pi);
+		float x = r*cosf(theta);
+		float z = r*sinf(theta);
+
+		float y = Terrain::Height(x, z);
+		if(y < 0.5f)
+			continue;
+
+		TreeInstance tree;
+		tree.Height = MathHelper::RandF(10.0f, 20.0f);
+		tree.Width = tree.Height*MathHelper::RandF(0.8f, 1.0f);
+		// Sink the base a little so it does not float on slopes.
+		tree.Position = XMFLOAT3(x, y - 0.5f, z);
+		tree.TextureIndex = (UINT)trees.size() % 3;
+		tree.Pad = XMFLOAT2(0.0f, 0.0f);
+		trees.push_back(tree);
 	}
-	
 
-	std::array<std::uint16_t, 16> indices =
+	mVegetation = std::make_unique<Vegetation>(md3dDevice.Get(), mCommandList.Get(), trees);
+	for(auto resource : mVegetation->Resources())
+		mResidency->Track(resource, ResidencyCategory::Geometry);
+}
+
+void TreeBillboardsApp::BuildLocalLights()
+{
+	// The blue and red lights inside and in front of the keep.
+	Light blue;
+	blue.Position = { 0.0f, 3.5f, -0.75f };
+	blue.Strength = { 0.0f, 0.0f, 2.0f };
+	blue.SpotPower = 0.0f;
+	mLocalLights.push_back(blue);
+
+	Light red;
+	red.Position = { 0.0f, 3.5f, -11.0f };
+	red.Strength = { 2.0f, 0.0f, 0.0f };
+	red.SpotPower = 0.0f;
+	mLocalLights.push_back(red);
+
+	// Torches along both faces of the four walls placed by BuildRenderItems, just
+	// below the wall tops: each face runs from (x0, z0) to (x1, z1) and faces (nx, nz).
+	const float wallFaces[][6] =
 	{
-		0, 1, 2, 3, 4, 5, 6, 7,
-		8, 9, 10, 11, 12, 13, 14, 15
+		{ -7.0f, -9.75f,  7.0f, -9.75f,  0.0f, -1.0f },
+		{ -7.0f, -7.75f,  7.0f, -7.75f,  0.0f,  1.0f },
+		{ -7.0f,  8.25f,  7.0f,  8.25f,  0.0f, -1.0f },
+		{ -7.0f, 10.25f,  7.0f, 10.25f,  0.0f,  1.0f },
+		{ -7.75f, -7.5f, -7.75f,  7.5f, -1.0f,  0.0f },
+		{ -6.25f, -7.5f, -6.25f,  7.5f,  1.0f,  0.0f },
+		{  6.25f, -7.5f,  6.25f,  7.5f, -1.0f,  0.0f },
+		{  7.75f, -7.5f,  7.75f,  7.5f,  1.0f,  0.0f },
 	};
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	const float offset = 0.3f;
+	mFirstTorch = (UINT)mLocalLights.size();
+	for(const auto& face : wallFaces)
+	{
+		float length = sqrtf((face[2] - face[0])*(face[2] - face[0]) + (face[3] - face[1])*(face[3] - face[1]));
+		UINT count = (UINT)(length / gTorchSpacing) + 1;
+		for(UINT i = 0; i < count; ++i)
+		{
+			float t = (float)i / (float)(count - 1);
+
+			Light torch;
+			torch.Position.x = face[0] + t*(face[2] - face[0]) + offset*face[4];
+			torch.Position.y = 5.0f;
+			torch.Position.z = face[1] + t*(face[3] - face[1]) + offset*face[5];
+			torch.Strength = { 0.3f, 0.16f, 0.05f };
+			torch.FalloffStart = 0.5f;
+			torch.FalloffEnd = 3.0f;
+			torch.SpotPower = 0.0f;
+			mLocalLights.push_back(torch);
+		}
+	}
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "treeSpritesGeo";
+	// Nothing past the end of the fog is lit; it is drawn in the fog color.
+	mClusteredLighting = std::make_unique<ClusteredLighting>(md3dDevice.Get(),
+		1.0f, mMainPassCB.gFogStart + mMainPassCB.gFogRange, gNumFrameResources);
+	for(UINT i = 0; i < mClusteredLighting->BufferCount(); ++i)
+		mResidency->Track(mClusteredLighting->Resource(i), ResidencyCategory::Compute);
+}
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+void TreeBillboardsApp::BuildOcclusionCulling()
+{
+	// At most one command per opaque item, in the current constants mode's layout.
+	UINT commandStride = mStructuredConstants ? sizeof(StructuredIndirectCommand) : sizeof(IndirectCommand);
+	UINT maxCommands = std::max((UINT)mRitemLayer[(int)RenderLayer::Opaque].size(), 1u);
+	mOcclusion = std::make_unique<OcclusionCulling>(md3dDevice.Get(), maxCommands, commandStride);
+	for(auto resource : mOcclusion->Resources())
+		mResidency->Track(resource, ResidencyCategory::Compute);
+
+	mOcclusion->Resize(mDepthStencilBuffer.Get(), mClientWidth, mClientHeight);
+	mOcclusionSrvIndex = mDescriptors->Allocate(OcclusionCulling::DescriptorCount());
+	BuildOcclusionDescriptors();
+}
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+void TreeBillboardsApp::BuildVisibilityBuffer()
+{
+	if(!mVisibilityBufferSupported)
+		return;
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	if(!VisibilityBufferFits())
+	{
+		OutputDebugStringA("Visibility buffer: the opaque layer does not fit its ids; it stays forward.\n");
+		mVisibilityBufferSupported = false;
+		return;
+	}
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	mVisibility = std::make_unique<VisibilityBuffer>(md3dDevice.Get());
+	mVisibility->Resize(mClientWidth, mClientHeight);
+	mVisibilitySrvIndex = mDescriptors->Allocate(VisibilityBuffer::DescriptorCount(mGeometryHeap->HeapCount()));
+	BuildVisibilityDescriptors();
 
-	geo->VertexByteStride = sizeof(TreeSpriteVertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	auto bytecode = [](ID3DBlob* blob)
+	{
+		return D3D12_SHADER_BYTECODE{ blob->GetBufferPointer(), blob->GetBufferSize() };
+	};
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	// The opaque layer's target state, drawn as one full-screen triangle with no
+	// depth.  The resolve cannot tell which pixels the local lights reach, so it
+	// always looks them up.
+	const wchar_t* const filename = L"Shaders\\VisibilityBuffer.hlsl";
+	const UINT features = ShaderFeatureFog | ShaderFeatureShadows | ShaderFeatureLocalLights |
+		(gDirLightCount << gDirLightCountShift);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC resolveDesc = mLayerPsoDescs[(int)RenderLayer::Opaque];
+	resolveDesc.InputLayout = { nullptr, 0 };
+	resolveDesc.VS = bytecode(mShaderPermutations->Get(filename, "ResolveVS", "vs_5_1", 0));
+	resolveDesc.PS = bytecode(mShaderPermutations->Get(filename, "ResolvePS", "ps_5_1", features));
+	resolveDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	resolveDesc.DepthStencilState.DepthEnable = false;
+	resolveDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	resolveDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+	mPSOs["visibilityResolve"] = mPipelineCache->CreateGraphicsPipelineState(resolveDesc);
+	mFramePsos.VisibilityResolve = mPSOs.Find("visibilityResolve");
+}
 
-	geo->DrawArgs["points"] = submesh;
+UINT TreeBillboardsApp::GeometryBufferIndex(ID3D12Resource* resource)const
+{
+	for(UINT i = 0; i < mGeometryHeap->HeapCount(); ++i)
+	{
+		if(mGeometryHeap->Buffer(i) == resource)
+			return i;
+	}
+	return UINT_MAX;
+}
 
-	mGeometries["treeSpritesGeo"] = std::move(geo);
+bool TreeBillboardsApp::VisibilityBufferFits()const
+{
+	for(const RenderItem* ri : mRitemLayer[(int)RenderLayer::Opaque])
+	{
+		const MeshGeometry* geo = mGeometries[ri->Geo].get();
+		if(ri->ObjCBIndex >= VisibilityBuffer::MaxObjects ||
+			ri->PrimitiveType != D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST ||
+			GeometryBufferIndex(geo->VertexBufferGPU.Get()) == UINT_MAX ||
+			GeometryBufferIndex(geo->IndexBufferGPU.Get()) == UINT_MAX)
+			return false;
+
+		// Whichever level is drawn, its primitive ids must fit.
+		UINT indexCount = mScene.DrawArgs[ri->ObjCBIndex].IndexCount;
+		for(const LodLevel& level : ri->Lods)
+			indexCount = std::max(indexCount, level.IndexCount);
+		if(indexCount / 3 > VisibilityBuffer::MaxTriangles)
+			return false;
+	}
+	return true;
 }
 
 void TreeBillboardsApp::BuildShapeGeometry()
 {
+	// The meshlets and static batches are built from the CPU copies.
+	if(LoadCachedGeometry("shapeGeo", gShapeGeometryVersion, mMeshShadersSupported || mBakeStaticGeometry))
+		return;
+
 	GeometryGenerator geoGen;
 	GeometryGenerator::MeshData pedastal = geoGen.CreatePedastal(1.5f, 0.5f, 1.5f, 3);
 	GeometryGenerator::MeshData grid = geoGen.CreateGrid(1.0f, 1.0f, 60, 40);
@@ -1122,6 +4996,19 @@ void TreeBillboardsApp::BuildShapeGeometry()
 	GeometryGenerator::MeshData pentagon = geoGen.CreatePentagon(1.5f, 0.5f, 1.5f, 3);// added
 	GeometryGenerator::MeshData maze = geoGen.CreateBox(1.0, 1.0, 1.0, 3);
 
+	// Before the offsets below are taken, though optimizing keeps the counts.
+	OptimizeMesh(pedastal, "pedastal");
+	OptimizeMesh(grid, "grid");
+	OptimizeMesh(sphere, "sphere");
+	OptimizeMesh(cylinder, "cylinder");
+	OptimizeMesh(diamond, "diamond");
+	OptimizeMesh(wall, "wall");
+	OptimizeMesh(ramp, "ramp");
+	OptimizeMesh(pyramid, "pyramid");
+	OptimizeMesh(kite, "kite");
+	OptimizeMesh(pentagon, "pentagon");
+	OptimizeMesh(maze, "maze");
+
 	//
 	// We are concatenating all the geometry into one big vertex/index buffer.  So
 	// define the regions in the buffer each submesh covers.
@@ -1331,26 +5218,60 @@ void TreeBillboardsApp::BuildShapeGeometry()
 	indices.insert(indices.end(), std::begin(pentagon.GetIndices16()), std::end(pentagon.GetIndices16()));
 	indices.insert(indices.end(), std::begin(maze.GetIndices16()), std::end(maze.GetIndices16()));
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	// Compute the local space bounds of each submesh from its vertex range.
+	auto computeBounds = [&vertices](SubmeshGeometry& submesh, size_t vertexCount)
+	{
+		BoundingBox::CreateFromPoints(submesh.Bounds, vertexCount,
+			&vertices[submesh.BaseVertexLocation].Pos, sizeof(Vertex));
+	};
+
+	computeBounds(pedastalSubmesh, pedastal.Vertices.size());
+	computeBounds(gridSubmesh, grid.Vertices.size());
+	computeBounds(sphereSubmesh, sphere.Vertices.size());
+	computeBounds(cylinderSubmesh, cylinder.Vertices.size());
+	computeBounds(diamondSubmesh, diamond.Vertices.size());
+	computeBounds(wallSubmesh, wall.Vertices.size());
+	computeBounds(rampSubmesh, ramp.Vertices.size());
+	computeBounds(pyramidSubmesh, pyramid.Vertices.size());
+	computeBounds(kiteSubmesh, kite.Vertices.size());
+	computeBounds(pentagonSubmesh, pentagon.Vertices.size());
+	computeBounds(mazeSubmesh, maze.Vertices.size());
+
+	// Coarser levels of the towers, appended after everything else as submeshes
+	// named <shape>_lod<n>.  BuildRenderItems chains them after the full level.
+	std::vector<std::pair<std::string, SubmeshGeometry>> lodSubmeshes;
+	auto appendLod = [&](const std::string& name, GeometryGenerator::MeshData mesh)
+	{
+		OptimizeMesh(mesh, name.c_str());
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)mesh.Indices32.size();
+		submesh.StartIndexLocation = (UINT)indices.size();
+		submesh.BaseVertexLocation = (INT)vertices.size();
+
+		for(const auto& v : mesh.Vertices)
+			vertices.push_back({ v.Position, v.Normal, v.TexC });
+		indices.insert(indices.end(), std::begin(mesh.GetIndices16()), std::end(mesh.GetIndices16()));
+
+		computeBounds(submesh, mesh.Vertices.size());
+		lodSubmeshes.push_back({ name, submesh });
+	};
+
+	appendLod("cylinder_lod1", geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 10, 4));
+	appendLod("cylinder_lod2", geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 6, 1));
+
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "shapeGeo";
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	SetGeometryVertices(*geo, vertices, mVertexFormat);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	mGeometryHeap->UploadIndices(*geo, indices.data(), ibByteSize);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
@@ -1365,30 +5286,332 @@ void TreeBillboardsApp::BuildShapeGeometry()
 	geo->DrawArgs["kite"] = kiteSubmesh;
 	geo->DrawArgs["pentagon"] = pentagonSubmesh;
 	geo->DrawArgs["maze"] = mazeSubmesh;
+	for(const auto& e : lodSubmeshes)
+		geo->DrawArgs[e.first] = e.second;
+
+	StoreCachedGeometry(*geo, gShapeGeometryVersion);
+	AddGeometry(std::move(geo));
+}
+
+void TreeBillboardsApp::BuildMeshlets()
+{
+	using namespace DirectX::PackedVector;
+
+	if(!mMeshShadersSupported)
+		return;
+
+	const MeshGeometry* geo = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mGeometryMutex);
+		mMeshletGeometry = mGeometries.Find("shapeGeo");
+		geo = mGeometries[mMeshletGeometry].get();
+	}
+
+	// Bounds are taken from the positions as the shaders decode them.
+	const UINT vertexCount = geo->VertexBufferByteSize / geo->VertexByteStride;
+	const BYTE* vertexData = (const BYTE*)geo->VertexBufferCPU->GetBufferPointer();
+	std::vector<XMFLOAT3> positions(vertexCount);
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		const BYTE* vertex = vertexData + (size_t)i*geo->VertexByteStride;
+		if(geo->VertexFormat == (UINT)VertexFormat::Quantized)
+		{
+			XMVECTOR q = XMLoadShortN4((const XMSHORTN4*)vertex);
+			XMStoreFloat3(&positions[i], XMLoadFloat3(&geo->PositionBias) + q*XMLoadFloat3(&geo->PositionScale));
+		}
+		else
+			positions[i] = *(const XMFLOAT3*)vertex;
+	}
+
+	// Every submesh, levels of detail included, gets its own meshlets.
+	const std::uint16_t* indices = (const std::uint16_t*)geo->IndexBufferCPU->GetBufferPointer();
+	MeshletData data;
+	for(const auto& e : geo->DrawArgs)
+	{
+		const SubmeshGeometry& submesh = e.second;
+
+		MeshletRange range;
+		range.FirstMeshlet = (UINT)data.Meshlets.size();
+		range.MeshletCount = MeshletBuilder::Build(indices + submesh.StartIndexLocation, submesh.IndexCount,
+			submesh.BaseVertexLocation, positions, data);
+		mMeshletRanges[submesh.StartIndexLocation] = range;
+	}
 
+	mMeshletCount = (UINT)data.Meshlets.size();
+	mMeshlets = mGeometryHeap->Allocate(data.Meshlets.data(), data.Meshlets.size()*sizeof(Meshlet));
+	mMeshletIndices = mGeometryHeap->Allocate(data.Indices.data(), data.Indices.size()*sizeof(UINT));
+
+	char text[128];
+	sprintf_s(text, "Meshlets: %u from %u submeshes\n", mMeshletCount, (UINT)geo->DrawArgs.size());
+	OutputDebugStringA(text);
+}
+
+void TreeBillboardsApp::BuildStaticBatches()
+{
+	if(!mBakeStaticGeometry)
+		return;
+
+	const MeshGeometry* shapeGeo = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mGeometryMutex);
+		shapeGeo = mGeometries[mGeometries.Find("shapeGeo")].get();
+	}
+
+	std::vector<Vertex> shapeVertices;
+	DecodeGeometryVertices(*shapeGeo, shapeVertices);
+	const std::uint16_t* shapeIndices = (const std::uint16_t*)shapeGeo->IndexBufferCPU->GetBufferPointer();
+
+	StaticBatcher batcher(gStaticBatchCellSize);
+	for(const StaticPiece& piece : CastleStaticPieces())
+	{
+		batcher.Add(piece.Material, shapeVertices, shapeIndices, shapeGeo->DrawArgs.at(piece.Submesh),
+			XMLoadFloat4x4(&piece.World));
+	}
+
+	std::vector<Vertex> vertices;
+	std::vector<std::uint16_t> indices;
+	batcher.Build(vertices, indices, mStaticBatches);
+
+	const UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "staticGeo";
+
+	SetGeometryVertices(*geo, vertices, mVertexFormat);
+
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+
+	mGeometryHeap->UploadIndices(*geo, indices.data(), ibByteSize);
+
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	char text[128];
+	sprintf_s(text, "Static batches: %u from %u pieces, %u vertices\n", (UINT)mStaticBatches.size(),
+		batcher.PieceCount(), (UINT)vertices.size());
+	OutputDebugStringA(text);
+
+	AddGeometry(std::move(geo));
+}
+
+void TreeBillboardsApp::AddGeometry(std::unique_ptr<MeshGeometry> geo)
+{
+	std::lock_guard<std::mutex> lock(mGeometryMutex);
 	mGeometries[geo->Name] = std::move(geo);
 }
 
+void TreeBillboardsApp::SetGeometryVertices(MeshGeometry& geo, const std::vector<Vertex>& vertices, VertexFormat format)
+{
+	using namespace DirectX::PackedVector;
+
+	const UINT stride = gVertexFormats[(int)format].Stride;
+	const UINT vbByteSize = (UINT)vertices.size() * stride;
+
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo.VertexBufferCPU));
+	BYTE* data = (BYTE*)geo.VertexBufferCPU->GetBufferPointer();
+
+	if(format == VertexFormat::Full)
+		CopyMemory(data, vertices.data(), vbByteSize);
+	else if(format == VertexFormat::Compact)
+	{
+		CompactVertex* dst = (CompactVertex*)data;
+		for(size_t i = 0; i < vertices.size(); ++i)
+		{
+			XMFLOAT2 n = MathHelper::OctahedralEncode(vertices[i].Normal);
+			dst[i].Pos = vertices[i].Pos;
+			dst[i].Normal = XMSHORTN2(n.x, n.y);
+			dst[i].TexC = XMHALF2(vertices[i].TexC.x, vertices[i].TexC.y);
+		}
+	}
+	else
+	{
+		// Map the bounds onto [-1,1]^3.  An axis with no extent stores zeros and
+		// decodes to the center.
+		BoundingBox bounds;
+		BoundingBox::CreateFromPoints(bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
+		geo.PositionBias = bounds.Center;
+		geo.PositionScale = bounds.Extents;
+
+		const float* center = &bounds.Center.x;
+		const float* extents = &bounds.Extents.x;
+		QuantizedVertex* dst = (QuantizedVertex*)data;
+		for(size_t i = 0; i < vertices.size(); ++i)
+		{
+			const float* p = &vertices[i].Pos.x;
+			float q[3];
+			for(int j = 0; j < 3; ++j)
+				q[j] = extents[j] > 0.0f ? (p[j] - center[j]) / extents[j] : 0.0f;
+
+			XMFLOAT2 n = MathHelper::OctahedralEncode(vertices[i].Normal);
+			dst[i].Pos = XMSHORTN4(q[0], q[1], q[2], 0.0f);
+			dst[i].Normal = XMSHORTN2(n.x, n.y);
+			dst[i].TexC = XMHALF2(vertices[i].TexC.x, vertices[i].TexC.y);
+		}
+	}
+
+	mGeometryHeap->UploadVertices(geo, data, vbByteSize);
+
+	geo.VertexByteStride = stride;
+	geo.VertexBufferByteSize = vbByteSize;
+	geo.VertexFormat = (UINT)format;
+}
+
+void TreeBillboardsApp::DecodeGeometryVertices(const MeshGeometry& geo, std::vector<Vertex>& vertices)const
+{
+	using namespace DirectX::PackedVector;
+
+	const UINT vertexCount = geo.VertexBufferByteSize / geo.VertexByteStride;
+	const BYTE* data = (const BYTE*)geo.VertexBufferCPU->GetBufferPointer();
+	vertices.resize(vertexCount);
+
+	if(geo.VertexFormat == (UINT)VertexFormat::Full)
+	{
+		CopyMemory(vertices.data(), data, (size_t)vertexCount*sizeof(Vertex));
+		return;
+	}
+
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		const BYTE* vertex = data + (size_t)i*geo.VertexByteStride;
+
+		XMSHORTN2 normal;
+		XMHALF2 texC;
+		if(geo.VertexFormat == (UINT)VertexFormat::Compact)
+		{
+			const CompactVertex* src = (const CompactVertex*)vertex;
+			vertices[i].Pos = src->Pos;
+			normal = src->Normal;
+			texC = src->TexC;
+		}
+		else
+		{
+			const QuantizedVertex* src = (const QuantizedVertex*)vertex;
+			XMVECTOR q = XMLoadShortN4(&src->Pos);
+			XMStoreFloat3(&vertices[i].Pos, XMLoadFloat3(&geo.PositionBias) + q*XMLoadFloat3(&geo.PositionScale));
+			normal = src->Normal;
+			texC = src->TexC;
+		}
+
+		XMFLOAT2 n;
+		XMStoreFloat2(&n, XMLoadShortN2(&normal));
+		vertices[i].Normal = MathHelper::OctahedralDecode(n);
+		vertices[i].TexC = XMFLOAT2(XMConvertHalfToFloat(texC.x), XMConvertHalfToFloat(texC.y));
+	}
+}
+
+void TreeBillboardsApp::OptimizeMesh(GeometryGenerator::MeshData& mesh, const char* name)
+{
+	if(!mOptimizeMeshes)
+		return;
+
+	MeshOptimizer::Report report = MeshOptimizer::Optimize(mesh);
+
+	char text[128];
+	sprintf_s(text, "Mesh %s: ACMR %.3f -> %.3f\n", name, report.AcmrBefore, report.AcmrAfter);
+	OutputDebugStringA(text);
+}
+
+bool TreeBillboardsApp::LoadCachedGeometry(const std::string& name, UINT version, bool keepCpuCopies)
+{
+	MeshFile file;
+	// A file of another vertex format fails the layout check and is rebuilt.
+	const VertexFormatDesc& format = gVertexFormats[(int)mVertexFormat];
+	if(!file.Open(std::wstring(gMeshCacheDirectory) + L"\\" + AnsiToWString(name) + L".mesh", MeshCacheKey(version),
+		format.Layout, format.LayoutCount, format.Stride))
+		return false;
+
+	// The heap copies the data out of the mapping, so the file closes on return.
+	MeshFileData data = file.Data();
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = name;
+
+	mGeometryHeap->UploadVertices(*geo, data.Vertices, data.VertexBufferByteSize);
+	mGeometryHeap->UploadIndices(*geo, data.Indices, data.IndexBufferByteSize);
+
+	if(keepCpuCopies)
+	{
+		ThrowIfFailed(D3DCreateBlob(data.VertexBufferByteSize, &geo->VertexBufferCPU));
+		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), data.Vertices, data.VertexBufferByteSize);
+		ThrowIfFailed(D3DCreateBlob(data.IndexBufferByteSize, &geo->IndexBufferCPU));
+		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), data.Indices, data.IndexBufferByteSize);
+	}
+
+	geo->VertexByteStride = data.VertexByteStride;
+	geo->VertexBufferByteSize = data.VertexBufferByteSize;
+	geo->IndexFormat = data.IndexFormat;
+	geo->IndexBufferByteSize = data.IndexBufferByteSize;
+	geo->PositionBias = data.PositionBias;
+	geo->PositionScale = data.PositionScale;
+	geo->VertexFormat = (UINT)mVertexFormat;
+
+	for(const MeshFileSubmesh& s : data.Submeshes)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = s.IndexCount;
+		submesh.StartIndexLocation = s.StartIndexLocation;
+		submesh.BaseVertexLocation = s.BaseVertexLocation;
+		submesh.Bounds = s.Bounds;
+		geo->DrawArgs[s.Name] = submesh;
+	}
+
+	AddGeometry(std::move(geo));
+	return true;
+}
+
+UINT64 TreeBillboardsApp::MeshCacheKey(UINT version)const
+{
+	return ((UINT64)mOptimizeMeshes << 32) | version;
+}
+
+void TreeBillboardsApp::StoreCachedGeometry(const MeshGeometry& geo, UINT version)
+{
+	if(geo.VertexBufferCPU == nullptr || geo.IndexBufferCPU == nullptr)
+		return;
+
+	MeshFileData data;
+	data.Vertices = geo.VertexBufferCPU->GetBufferPointer();
+	data.VertexByteStride = geo.VertexByteStride;
+	data.VertexBufferByteSize = geo.VertexBufferByteSize;
+	data.Indices = geo.IndexBufferCPU->GetBufferPointer();
+	data.IndexFormat = geo.IndexFormat;
+	data.IndexBufferByteSize = geo.IndexBufferByteSize;
+	data.PositionBias = geo.PositionBias;
+	data.PositionScale = geo.PositionScale;
+	for(const auto& e : geo.DrawArgs)
+	{
+		MeshFileSubmesh submesh;
+		submesh.Name = e.first;
+		submesh.IndexCount = e.second.IndexCount;
+		submesh.StartIndexLocation = e.second.StartIndexLocation;
+		submesh.BaseVertexLocation = e.second.BaseVertexLocation;
+		submesh.Bounds = e.second.Bounds;
+		data.Submeshes.push_back(submesh);
+	}
+
+	// A failed write only costs a rebuild next run.
+	CreateDirectoryW(gMeshCacheDirectory, nullptr);
+	const VertexFormatDesc& format = gVertexFormats[geo.VertexFormat];
+	MeshFile::Write(std::wstring(gMeshCacheDirectory) + L"\\" + AnsiToWString(geo.Name) + L".mesh", MeshCacheKey(version),
+		data, format.Layout, format.LayoutCount);
+}
+
 void TreeBillboardsApp::BuildPSOs()
 {
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
+	//
+	// Fixed-function state of the Default.hlsl layers.  The shaders and input layout
+	// are filled in per variant by BuildPsoVariant.
+	//
+
 	//
 	// PSO for opaque objects.
 	//
     ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
 	opaquePsoDesc.InputLayout = { mStdInputLayout.data(), (UINT)mStdInputLayout.size() };
 	opaquePsoDesc.pRootSignature = mRootSignature.Get();
-	opaquePsoDesc.VS = 
-	{ 
-		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()), 
-		mShaders["standardVS"]->GetBufferSize()
-	};
-	opaquePsoDesc.PS = 
-	{ 
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
-	};
 	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
@@ -1404,7 +5627,21 @@ void TreeBillboardsApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+	mLayerPsoDescs[(int)RenderLayer::Opaque] = opaquePsoDesc;
+
+	//
+	// PSO for instanced opaque objects
+	//
+
+	mLayerPsoDescs[(int)RenderLayer::OpaqueInstanced] = opaquePsoDesc;
+
+	//
+	// PSO for terrain tiles
+	//
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC terrainPsoDesc = opaquePsoDesc;
+	terrainPsoDesc.InputLayout = { mTerrainInputLayout.data(), (UINT)mTerrainInputLayout.size() };
+	mLayerPsoDescs[(int)RenderLayer::Terrain] = terrainPsoDesc;
 
 	//
 	// PSO for transparent objects
@@ -1424,23 +5661,114 @@ void TreeBillboardsApp::BuildPSOs()
 	transparencyBlendDesc.LogicOp = D3D12_LOGIC_OP_NOOP;
 	transparencyBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
 
-	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
+	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
+
+	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
+	mLayerPsoDescs[(int)RenderLayer::Transparent] = transparentPsoDesc;
+
+	//
+	// PSO for the OIT composite, blending a full-screen triangle over the back buffer
+	//
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC oitCompositePsoDesc = transparentPsoDesc;
+	oitCompositePsoDesc.pRootSignature = mOitRootSignature.Get();
+	oitCompositePsoDesc.InputLayout = { nullptr, 0 };
+	oitCompositePsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["oitCompositeVS"]->GetBufferPointer()),
+		mShaders["oitCompositeVS"]->GetBufferSize()
+	};
+	oitCompositePsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["oitCompositePS"]->GetBufferPointer()),
+		mShaders["oitCompositePS"]->GetBufferSize()
+	};
+	oitCompositePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	oitCompositePsoDesc.DepthStencilState.DepthEnable = false;
+	oitCompositePsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	oitCompositePsoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+	// Into the scene target, which is single sampled like the OIT targets.
+	oitCompositePsoDesc.SampleDesc.Count = 1;
+	oitCompositePsoDesc.SampleDesc.Quality = 0;
+	mPSOs["oitComposite"] = mPipelineCache->CreateGraphicsPipelineState(oitCompositePsoDesc);
+
+	//
+	// PSO for the dynamic resolution upscale, overwriting the whole back buffer
+	//
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC upscalePsoDesc = oitCompositePsoDesc;
+	upscalePsoDesc.pRootSignature = mUpscaleRootSignature.Get();
+	upscalePsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["upscaleVS"]->GetBufferPointer()),
+		mShaders["upscaleVS"]->GetBufferSize()
+	};
+	upscalePsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["upscalePS"]->GetBufferPointer()),
+		mShaders["upscalePS"]->GetBufferSize()
+	};
+	upscalePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	mPSOs["upscale"] = mPipelineCache->CreateGraphicsPipelineState(upscalePsoDesc);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC fxaaPSO = {};
+	fxaaPSO.pRootSignature = mPostAARootSignature.Get();
+	fxaaPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["fxaaCS"]->GetBufferPointer()),
+		mShaders["fxaaCS"]->GetBufferSize()
+	};
+	fxaaPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["fxaa"] = mPipelineCache->CreateComputePipelineState(fxaaPSO);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC shadingRatePSO = {};
+	shadingRatePSO.pRootSignature = mShadingRateRootSignature.Get();
+	shadingRatePSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["shadingRateCS"]->GetBufferPointer()),
+		mShaders["shadingRateCS"]->GetBufferSize()
+	};
+	shadingRatePSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["shadingRate"] = mPipelineCache->CreateComputePipelineState(shadingRatePSO);
+
+	//
+	// PSOs for the GPU wave simulation and the displacement-mapped water
+	//
 
-	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
+	if(mUseGpuWaves || mStreamWaveHeights)
+		mLayerPsoDescs[(int)RenderLayer::GpuWaves] = transparentPsoDesc;
+
+	if(mUseGpuWaves)
+	{
+
+		D3D12_COMPUTE_PIPELINE_STATE_DESC wavesDisturbPSO = {};
+		wavesDisturbPSO.pRootSignature = mWavesRootSignature.Get();
+		wavesDisturbPSO.CS =
+		{
+			reinterpret_cast<BYTE*>(mShaders["wavesDisturbCS"]->GetBufferPointer()),
+			mShaders["wavesDisturbCS"]->GetBufferSize()
+		};
+		wavesDisturbPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+		mPSOs["wavesDisturb"] = mPipelineCache->CreateComputePipelineState(wavesDisturbPSO);
+
+		D3D12_COMPUTE_PIPELINE_STATE_DESC wavesUpdatePSO = {};
+		wavesUpdatePSO.pRootSignature = mWavesRootSignature.Get();
+		wavesUpdatePSO.CS =
+		{
+			reinterpret_cast<BYTE*>(mShaders["wavesUpdateCS"]->GetBufferPointer()),
+			mShaders["wavesUpdateCS"]->GetBufferSize()
+		};
+		wavesUpdatePSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+		mPSOs["wavesUpdate"] = mPipelineCache->CreateComputePipelineState(wavesUpdatePSO);
+	}
 
 	//
 	// PSO for alpha tested objects
 	//
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
-	alphaTestedPsoDesc.PS = 
-	{ 
-		reinterpret_cast<BYTE*>(mShaders["alphaTestedPS"]->GetBufferPointer()),
-		mShaders["alphaTestedPS"]->GetBufferSize()
-	};
 	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
+	mLayerPsoDescs[(int)RenderLayer::AlphaTested] = alphaTestedPsoDesc;
 
 	//
 	// PSO for tree sprites
@@ -1451,22 +5779,248 @@ void TreeBillboardsApp::BuildPSOs()
 		reinterpret_cast<BYTE*>(mShaders["treeSpriteVS"]->GetBufferPointer()),
 		mShaders["treeSpriteVS"]->GetBufferSize()
 	};
-	treeSpritePsoDesc.GS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
-		mShaders["treeSpriteGS"]->GetBufferSize()
-	};
 	treeSpritePsoDesc.PS =
 	{
 		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
 		mShaders["treeSpritePS"]->GetBufferSize()
 	};
-	//step1
-	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
-	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
+	// The vertex shader builds the quads from the instance data alone.
+	treeSpritePsoDesc.InputLayout = { nullptr, 0 };
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+	mPSOs["treeSprites"] = mPipelineCache->CreateGraphicsPipelineState(treeSpritePsoDesc);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC vegetationCullPSO = {};
+	vegetationCullPSO.pRootSignature = mVegetationRootSignature.Get();
+	vegetationCullPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["vegetationCullCS"]->GetBufferPointer()),
+		mShaders["vegetationCullCS"]->GetBufferSize()
+	};
+	vegetationCullPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["vegetationCull"] = mPipelineCache->CreateComputePipelineState(vegetationCullPSO);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC lightCullPSO = {};
+	lightCullPSO.pRootSignature = mLightCullRootSignature.Get();
+	lightCullPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["lightCullCS"]->GetBufferPointer()),
+		mShaders["lightCullCS"]->GetBufferSize()
+	};
+	lightCullPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["lightCull"] = mPipelineCache->CreateComputePipelineState(lightCullPSO);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC occlusionCullPSO = {};
+	occlusionCullPSO.pRootSignature = mOcclusionCullRootSignature.Get();
+	occlusionCullPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["occlusionCullCS"]->GetBufferPointer()),
+		mShaders["occlusionCullCS"]->GetBufferSize()
+	};
+	occlusionCullPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["occlusionCull"] = mPipelineCache->CreateComputePipelineState(occlusionCullPSO);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC hiZReducePSO = {};
+	hiZReducePSO.pRootSignature = mHiZRootSignature.Get();
+	hiZReducePSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["hiZReduceCS"]->GetBufferPointer()),
+		mShaders["hiZReduceCS"]->GetBufferSize()
+	};
+	hiZReducePSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["hiZReduce"] = mPipelineCache->CreateComputePipelineState(hiZReducePSO);
+
+	// The waves' handles stay invalid with the CPU simulation.
+	mFramePsos.TreeSprites = mPSOs.Find("treeSprites");
+	mFramePsos.VegetationCull = mPSOs.Find("vegetationCull");
+	mFramePsos.LightCull = mPSOs.Find("lightCull");
+	mFramePsos.OcclusionCull = mPSOs.Find("occlusionCull");
+	mFramePsos.HiZReduce = mPSOs.Find("hiZReduce");
+	mFramePsos.OitComposite = mPSOs.Find("oitComposite");
+	mFramePsos.Upscale = mPSOs.Find("upscale");
+	mFramePsos.Fxaa = mPSOs.Find("fxaa");
+	mFramePsos.ShadingRate = mPSOs.Find("shadingRate");
+	mFramePsos.WavesDisturb = mPSOs.Find("wavesDisturb");
+	mFramePsos.WavesUpdate = mPSOs.Find("wavesUpdate");
+}
+
+UINT TreeBillboardsApp::ItemShaderFeatures(const LayerPass& pass, const RenderItem& ri)const
+{
+	// Every layer receives shadows; with them off the pass constants hold no cascades.
+	UINT features = pass.ShaderFeatures | ShaderFeatureFog | ShaderFeatureShadows |
+		(gDirLightCount << gDirLightCountShift);
+	if(mGeometries[ri.Geo]->VertexFormat != (UINT)VertexFormat::Full)
+		features |= ShaderFeatureCompactVertex;
+
+	// Items out of reach of every local light skip the cluster lookup.  The lights
+	// and instances never move, so static items are decided from where they are; an
+	// item that moves may come into reach of any light, so always looks them up.
+	auto touchesLights = [this](const BoundingBox& box)
+	{
+		for(const auto& light : mLocalLights)
+		{
+			if(box.Intersects(BoundingSphere(light.Position, light.FalloffEnd)))
+				return true;
+		}
+		return false;
+	};
+
+	bool lit = ri.Moves;
+	if(!lit && ri.InstanceBounds.empty())
+	{
+		BoundingBox bounds;
+		mScene.LocalBounds[ri.ObjCBIndex].Transform(bounds, XMLoadFloat4x4(&mScene.World[ri.ObjCBIndex]));
+		lit = touchesLights(bounds);
+	}
+	for(size_t i = 0; i < ri.InstanceBounds.size() && !lit; ++i)
+		lit = touchesLights(ri.InstanceBounds[i]);
+
+	if(lit)
+		features |= ShaderFeatureLocalLights;
+	return features;
+}
+
+UINT TreeBillboardsApp::FindPsoVariant(RenderLayer layer, UINT vertexFormat, UINT features)
+{
+	UINT64 key = ((UINT64)layer << 40) | ((UINT64)vertexFormat << 32) | features;
+	auto it = mPsoVariantIds.find(key);
+	if(it != mPsoVariantIds.end())
+		return it->second;
+
+	PsoVariant variant;
+	variant.Layer = layer;
+	variant.VertexFormat = vertexFormat;
+	variant.Features = features;
+	mPsoVariants.push_back(variant);
+
+	UINT id = (UINT)mPsoVariants.size() - 1;
+	mPsoVariantIds[key] = id;
+	return id;
+}
+
+void TreeBillboardsApp::BuildPsoVariants()
+{
+	for(const auto& pass : gLayerPasses)
+	{
+		// The trees are drawn with their own shaders.
+		if(pass.Layer == RenderLayer::AlphaTestedTreeSprites)
+			continue;
+
+		// Each layer's variants are added together, so the render queue can key them
+		// by their offset from the first.
+		mFirstPsoVariant[(int)pass.Layer] = (UINT)mPsoVariants.size();
+		for(auto ri : mRitemLayer[(int)pass.Layer])
+			ri->PsoVariant = FindPsoVariant(pass.Layer, mGeometries[ri->Geo]->VertexFormat, ItemShaderFeatures(pass, *ri));
+	}
+
+	// Only the variants some item uses are built, and each is independent of the
+	// others, so their shaders compile side by side.
+	JobSystem::Shared().ParallelFor(0, (UINT)mPsoVariants.size(), 1, [this](UINT i)
+	{
+		BuildPsoVariant(mPsoVariants[i]);
+	});
+}
+
+void TreeBillboardsApp::BuildPsoVariant(PsoVariant& variant)
+{
+	const wchar_t* const filename = L"Shaders\\Default.hlsl";
+
+	auto bytecode = [](ID3DBlob* blob)
+	{
+		return D3D12_SHADER_BYTECODE{ blob->GetBufferPointer(), blob->GetBufferSize() };
+	};
+
+	// The vertex and pixel shaders are each built with only the features they read,
+	// so variants that differ in the other stage's features share them.
+	UINT vsFeatures = variant.Features & gVertexShaderFeatures;
+	UINT psFeatures = variant.Features & ~gVertexShaderFeatures;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = mLayerPsoDescs[(int)variant.Layer];
+	desc.VS = bytecode(mShaderPermutations->Get(filename,
+		(variant.Features & ShaderFeatureTerrain) ? "TerrainVS" : "VS", "vs_5_1", vsFeatures));
+	desc.PS = bytecode(mShaderPermutations->Get(filename, "PS", "ps_5_1", psFeatures));
+
+	// Terrain tiles keep their position-only layout.
+	if(!(variant.Features & ShaderFeatureTerrain))
+	{
+		const VertexFormatDesc& format = gVertexFormats[variant.VertexFormat];
+		desc.InputLayout = { format.Layout, format.LayoutCount };
+	}
+	variant.Psos[(int)DepthPass::Shade] = mPipelineCache->CreateGraphicsPipelineState(desc);
+
+	const LayerPass* pass = std::find_if(std::begin(gLayerPasses), std::end(gLayerPasses),
+		[&variant](const LayerPass& p) { return p.Layer == variant.Layer; });
+
+	// Blended layers also accumulate into the OIT targets.
+	if(pass->Blended)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC oitDesc = desc;
+		oitDesc.PS = bytecode(mShaderPermutations->Get(filename, "PS", "ps_5_1", psFeatures | ShaderFeatureOit));
+		OitTargets::SetAccumulateState(oitDesc);
+		variant.Psos[(int)DepthPass::Oit] = mPipelineCache->CreateGraphicsPipelineState(oitDesc);
+	}
+
+	// Casters are drawn depth-only into the shadow maps, with DepthPS clipping cut-outs.
+	if(pass->CastsShadows)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC shadowDesc = desc;
+		shadowDesc.PS = { nullptr, 0 };
+		if(variant.Features & ShaderFeatureAlphaTest)
+			shadowDesc.PS = bytecode(mShaderPermutations->Get(filename, "DepthPS", "ps_5_1", ShaderFeatureAlphaTest));
+		CascadedShadowMaps::SetCasterState(shadowDesc);
+		variant.Psos[(int)DepthPass::Shadow] = mPipelineCache->CreateGraphicsPipelineState(shadowDesc);
+	}
+
+	// The opaque layer's id pass keeps the shading pass's depth state and vertex
+	// shader; only its pixel shader and target differ.
+	if(mVisibilityBufferSupported && variant.Layer == RenderLayer::Opaque)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC idDesc = desc;
+		idDesc.PS = bytecode(mShaderPermutations->Get(filename, "VisibilityPS", "ps_5_1", 0));
+		VisibilityBuffer::SetIdState(idDesc);
+		variant.Psos[(int)DepthPass::Visibility] = mPipelineCache->CreateGraphicsPipelineState(idDesc);
+	}
+
+	if(!pass->DepthPrepass)
+		return;
+
+	//
+	// Depth pre-pass variants.  The pre-pass writes depth only, running DepthPS first
+	// where cut-outs must be clipped.  The equal pass shades the surface the pre-pass
+	// left; clipped fragments fail the depth test, so it needs no clip and keeps early-Z.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC equalDesc = desc;
+	equalDesc.PS = bytecode(mShaderPermutations->Get(filename, "PS", "ps_5_1", psFeatures & ~ShaderFeatureAlphaTest));
+	equalDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_EQUAL;
+	equalDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	variant.Psos[(int)DepthPass::Equal] = mPipelineCache->CreateGraphicsPipelineState(equalDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC depthDesc = desc;
+	depthDesc.PS = { nullptr, 0 };
+	if(variant.Features & ShaderFeatureAlphaTest)
+		depthDesc.PS = bytecode(mShaderPermutations->Get(filename, "DepthPS", "ps_5_1", ShaderFeatureAlphaTest));
+	depthDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = 0;
+	variant.Psos[(int)DepthPass::Prepass] = mPipelineCache->CreateGraphicsPipelineState(depthDesc);
+
+	// The instanced layer's meshlets are drawn with the pixel shaders and state of
+	// the passes above.  Shadow casters keep the vertex shader: the culling is for
+	// the camera's view.
+	if(mMeshShadersSupported && variant.Layer == RenderLayer::OpaqueInstanced)
+	{
+		const wchar_t* const meshletFile = L"Shaders\\Meshlet.hlsl";
+		D3D12_SHADER_BYTECODE as = bytecode(mShaderPermutations->Get(meshletFile, "AS", "as_6_5", ShaderFeatureInstancing));
+		D3D12_SHADER_BYTECODE ms = bytecode(mShaderPermutations->Get(meshletFile, "MS", "ms_6_5", ShaderFeatureInstancing));
+
+		auto meshletPso = [&](D3D12_GRAPHICS_PIPELINE_STATE_DESC meshletDesc)
+		{
+			meshletDesc.VS = { nullptr, 0 };
+			meshletDesc.InputLayout = { nullptr, 0 };
+			return mPipelineCache->CreateMeshPipelineState(meshletDesc, as, ms);
+		};
+		variant.MeshletPsos[(int)DepthPass::Shade] = meshletPso(desc);
+		variant.MeshletPsos[(int)DepthPass::Equal] = meshletPso(equalDesc);
+		variant.MeshletPsos[(int)DepthPass::Prepass] = meshletPso(depthDesc);
+	}
 }
 
 void TreeBillboardsApp::BuildFrameResources()
@@ -1474,7 +6028,9 @@ void TreeBillboardsApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1 + CascadedShadowMaps::CascadeCount, (UINT)mAllRitems.size(), mMaterials.Size(),
+            mInstanceCount + mTerrain->MaxTileCount() + mShadowInstanceCount,
+            WaveVertexCount(), (UINT)mLocalLights.size(), gNumLayerPasses));
     }
 }
 
@@ -1609,390 +6165,668 @@ void TreeBillboardsApp::BuildMaterials()
 	mMaterials["bricks2"] = std::move(bricks2);
 	mMaterials["maze0"] = std::move(maze0);
 
+	mMaterialsByIndex.resize(mMaterials.Size());
+	for(auto& mat : mMaterials)
+	{
+		assert((UINT)mat->MatCBIndex < mMaterials.Size());
+		mMaterialsByIndex[mat->MatCBIndex] = mat.get();
+	}
+	mWaterMat = mMaterials["water"].get();
+
+	// Nothing has streamed in yet; draw with the fallback until it does.
+	mMaterialSlots.resize(mMaterials.Size());
+	for(auto& e : mMaterials)
+	{
+		Material* mat = e.get();
+		UINT slot = (UINT)mat->DiffuseSrvHeapIndex;
 
+		mMaterialSlots[mat->MatCBIndex] = slot;
+		mAwaitingTexture[slot].push_back(mat);
+		mat->DiffuseSrvHeapIndex = gTextureSlots[slot].IsArray ? mFallbackArraySrvIndex : mFallbackSrvIndex;
+	}
 }
 
 void TreeBillboardsApp::BuildRenderItems()
 {
-    auto wavesRitem = std::make_unique<RenderItem>();
-    wavesRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	wavesRitem->ObjCBIndex = 0;
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	const XMFLOAT4X4 identity = MathHelper::Identity4x4();
+	auto toFloat4x4 = [](FXMMATRIX m)
+	{
+		XMFLOAT4X4 f;
+		XMStoreFloat4x4(&f, m);
+		return f;
+	};
 
-    mWavesRitem = wavesRitem.get();
+	mScene.Clear();
 
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
+	// Entities are numbered in the order they are added here, so add each layer's
+	// items together.
+	if(mUseGpuWaves)
+	{
+		auto wavesRitem = std::make_unique<RenderItem>();
+		wavesRitem->Geo = mGeometries.Find("waterGeo");
+		wavesRitem->ObjCBIndex = mScene.Add(identity, toFloat4x4(XMMatrixScaling(5.0f, 5.0f, 1.0f)),
+			mMaterials.Find("water"), mGeometries[wavesRitem->Geo]->DrawArgs["grid"]);
+		wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+		wavesRitem->DisplacementMapTexelSize.x = 1.0f / mGpuWaves->ColumnCount();
+		wavesRitem->DisplacementMapTexelSize.y = 1.0f / mGpuWaves->RowCount();
+		wavesRitem->GridSpatialStep = mGpuWaves->SpatialStep();
+		wavesRitem->Moves = true;
+
+		mWavesRitem = wavesRitem.get();
+		mRitemLayer[(int)RenderLayer::GpuWaves].push_back(wavesRitem.get());
+		mAllRitems.push_back(std::move(wavesRitem));
+	}
+	else
+	{
+		// One item per patch, each with its own bounds so the patches are culled
+		// apart, and its own range of the vertex buffer.  The texture repeats as
+		// often per metre as it did across the original 128 metre pond.  Streaming
+		// only the heights, the patches are displaced like the GPU waves' grid.
+		const RenderLayer layer = mStreamWaveHeights ? RenderLayer::GpuWaves : RenderLayer::Transparent;
+		const float texScale = 5.0f*mWaves->Width() / 128.0f;
+		const SubmeshGeometry& grid = mGeometries[mGeometries.Find("waterGeo")]->DrawArgs["grid"];
+
+		mWaterPatchRitems.clear();
+		for(int patch = 0; patch < mWaterPatches->PatchCount(); ++patch)
+		{
+			SubmeshGeometry submesh = grid;
+			submesh.BaseVertexLocation = patch*mWaterPatches->PatchVertexCount();
+			submesh.Bounds = mWaterPatches->Bounds(patch);
+
+			auto patchRitem = std::make_unique<RenderItem>();
+			patchRitem->Geo = mGeometries.Find("waterGeo");
+			patchRitem->ObjCBIndex = mScene.Add(identity, toFloat4x4(XMMatrixScaling(texScale, texScale, 1.0f)),
+				mMaterials.Find("water"), submesh);
+			patchRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+			patchRitem->DisplacementMapTexelSize.x = 1.0f / mWaves->ColumnCount();
+			patchRitem->DisplacementMapTexelSize.y = 1.0f / mWaves->RowCount();
+			patchRitem->GridSpatialStep = mWaves->SpatialStep();
+			patchRitem->Moves = true;
+
+			mWaterPatchRitems.push_back(patchRitem.get());
+			mRitemLayer[(int)layer].push_back(patchRitem.get());
+			mAllRitems.push_back(std::move(patchRitem));
+		}
 
- 
+		// The patches share the geometry UpdateWaves points at this frame's vertices,
+		// when it streams them.
+		mWavesRitem = mWaterPatchRitems[0];
+	}
 
+	// Supplies the vegetation's constants and material; the trees themselves are in
+	// mVegetation.
 	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = 1;
-	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
+	treeSpritesRitem->ObjCBIndex = mScene.Add(identity, identity, mMaterials.Find("treeSprites"));
 	//step2
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
+	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
 	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
+	mVegetationRitem = treeSpritesRitem.get();
 
+	auto shapeGeo = mGeometries.Find("shapeGeo");
+	auto& shapeArgs = mGeometries[shapeGeo]->DrawArgs;
 
-	auto pedastalRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pedastalRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 1.5f, 0.0f));
-	XMStoreFloat4x4(&pedastalRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-	pedastalRitem->ObjCBIndex = 2;
-	pedastalRitem->Mat = mMaterials["metal0"].get();
-	pedastalRitem->Geo = mGeometries["shapeGeo"].get();
-	pedastalRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pedastalRitem->IndexCount = pedastalRitem->Geo->DrawArgs["pedastal"].IndexCount;
-	pedastalRitem->StartIndexLocation = pedastalRitem->Geo->DrawArgs["pedastal"].StartIndexLocation;
-	pedastalRitem->BaseVertexLocation = pedastalRitem->Geo->DrawArgs["pedastal"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pedastalRitem.get());
-	
-	//added this item
-	auto diamondRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&diamondRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 2.5f, 0.0f));
-	diamondRitem->ObjCBIndex = 3;
-	diamondRitem->Mat = mMaterials["ice0"].get();
-	diamondRitem->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-	diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-	diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem.get());
-	
-	auto gridRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&gridRitem->World, XMMatrixScaling(15.0f, 1.0f, 19.0f) * XMMatrixTranslation(0.0f, 1.0f, 0.0f));
-	gridRitem->ObjCBIndex = 4;
-	gridRitem->Mat = mMaterials["bricks2"].get();
-	gridRitem->Geo = mGeometries["shapeGeo"].get();
-	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
-
-	UINT objCBIndexw = 5; //5-8
+	// The castle's fixed pieces, baked into one item per batch, or one item each with
+	// the repeated pieces drawn as one instanced draw per submesh.  An instanced
+	// item only describes the shared geometry and material; placement lives in
+	// Instances.
+	const std::vector<StaticPiece> pieces = CastleStaticPieces();
+	if(mBakeStaticGeometry)
+	{
+		auto staticGeo = mGeometries.Find("staticGeo");
+		for(const StaticBatcher::Batch& batch : mStaticBatches)
+		{
+			auto batchRitem = std::make_unique<RenderItem>();
+			batchRitem->ObjCBIndex = mScene.Add(identity, identity, mMaterials.Find(batch.Material), batch.Submesh);
+			batchRitem->Geo = staticGeo;
+			batchRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			mRitemLayer[(int)RenderLayer::Opaque].push_back(batchRitem.get());
+			mAllRitems.push_back(std::move(batchRitem));
+		}
+	}
+	else
+	{
+		for(const StaticPiece& piece : pieces)
+		{
+			if(piece.Instanced)
+				continue;
+
+			auto pieceRitem = std::make_unique<RenderItem>();
+			pieceRitem->ObjCBIndex = mScene.Add(piece.World, identity, mMaterials.Find(piece.Material),
+				shapeArgs[piece.Submesh]);
+			pieceRitem->Geo = shapeGeo;
+			pieceRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			mRitemLayer[(int)RenderLayer::Opaque].push_back(pieceRitem.get());
+			mAllRitems.push_back(std::move(pieceRitem));
+		}
+
+		std::unordered_map<std::string, RenderItem*> instancedRitems;
+		for(const StaticPiece& piece : pieces)
+		{
+			if(!piece.Instanced)
+				continue;
+
+			RenderItem*& ri = instancedRitems[piece.Submesh];
+			if(!ri)
+			{
+				auto instancedRitem = std::make_unique<RenderItem>();
+				instancedRitem->ObjCBIndex = mScene.Add(identity, identity, mMaterials.Find(piece.Material),
+					shapeArgs[piece.Submesh]);
+				instancedRitem->Geo = shapeGeo;
+				instancedRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+				ri = instancedRitem.get();
+				mRitemLayer[(int)RenderLayer::OpaqueInstanced].push_back(ri);
+				mAllRitems.push_back(std::move(instancedRitem));
+			}
+
+			InstanceData instance;
+			instance.World = piece.World;
+			ri->Instances.push_back(instance);
+		}
+	}
+
+	// The towers pick a level of detail per instance, so are never baked.
+	auto towersRitem = std::make_unique<RenderItem>();
+	towersRitem->ObjCBIndex = mScene.Add(identity, identity, mMaterials.Find("bricks0"), shapeArgs["cylinder"]);
+	towersRitem->Geo = shapeGeo;
+	towersRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	towersRitem->Lods = MakeLodChain(*mGeometries[towersRitem->Geo],
+		{ { "cylinder", 0.2f }, { "cylinder_lod1", 0.06f }, { "cylinder_lod2", 0.0f } });
 
 	for (int i = 0; i < 2; ++i)
 	{
-		auto frontWallRitem = std::make_unique<RenderItem>();
-		auto sideWallRitem = std::make_unique<RenderItem>();
-
-
-		XMStoreFloat4x4(&frontWallRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.0f, 3.5f, -8.75f + i * 18.0f));
-		frontWallRitem->ObjCBIndex = objCBIndexw++;
-		frontWallRitem->Mat = mMaterials["bricks0"].get();
-		frontWallRitem->Geo = mGeometries["shapeGeo"].get();
-		frontWallRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		frontWallRitem->IndexCount = frontWallRitem->Geo->DrawArgs["wall"].IndexCount;
-		frontWallRitem->StartIndexLocation = frontWallRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		frontWallRitem->BaseVertexLocation = frontWallRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-		
-		mRitemLayer[(int)RenderLayer::Opaque].push_back(frontWallRitem.get());
-		mAllRitems.push_back(std::move(frontWallRitem));
-
-
-		XMStoreFloat4x4(&sideWallRitem->World, XMMatrixScaling(0.1f, 1.0f, 8.90f) * XMMatrixTranslation(-7.0f + i * 14.0f, 3.5f, 0.0f));
-		sideWallRitem->ObjCBIndex = objCBIndexw++;
-		sideWallRitem->Mat = mMaterials["bricks0"].get();
-		sideWallRitem->Geo = mGeometries["shapeGeo"].get();
-		sideWallRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		sideWallRitem->IndexCount = sideWallRitem->Geo->DrawArgs["wall"].IndexCount;
-		sideWallRitem->StartIndexLocation = sideWallRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		sideWallRitem->BaseVertexLocation = sideWallRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::Opaque].push_back(sideWallRitem.get());
-		mAllRitems.push_back(std::move(sideWallRitem));
-
-	}
-
-	auto rampRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&rampRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 1.5f, 0.0f));
-	rampRitem->ObjCBIndex = 9;
-	rampRitem->Mat = mMaterials["wood0"].get();
-	rampRitem->Geo = mGeometries["shapeGeo"].get();
-	rampRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	rampRitem->IndexCount = rampRitem->Geo->DrawArgs["ramp"].IndexCount;
-	rampRitem->StartIndexLocation = rampRitem->Geo->DrawArgs["ramp"].StartIndexLocation;
-	rampRitem->BaseVertexLocation = rampRitem->Geo->DrawArgs["ramp"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(rampRitem.get());
-
-	UINT objCBIndex = 10; //10- 17
-	for (int i = 0; i < 2; ++i) // multiple
-	{
-		auto leftCylRitem = std::make_unique<RenderItem>();
-		auto rightCylRitem = std::make_unique<RenderItem>();
-
-		auto frontPyramidRitem = std::make_unique<RenderItem>();
-		auto backPyramidRitem = std::make_unique<RenderItem>();
-
-		/*XMMATRIX leftCylWorld = XMMatrixTranslation(-7.50f, 1.5f, -10.0f + i * 20.0f);*/
-		/*XMMATRIX rightCylWorld = XMMatrixTranslation(+7.50f, 1.5f, -10.0f + i * 20.0f);*/
-
-		XMStoreFloat4x4(&leftCylRitem->World, XMMatrixTranslation(-7.50f, 2.5f, -10.0f + i * 20.0f));
-		leftCylRitem->ObjCBIndex = objCBIndex++;
-		leftCylRitem->Mat = mMaterials["bricks0"].get();
-		leftCylRitem->Geo = mGeometries["shapeGeo"].get();
-		leftCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::Opaque].push_back(leftCylRitem.get());
-		mAllRitems.push_back(std::move(leftCylRitem));
-
-		XMStoreFloat4x4(&rightCylRitem->World, XMMatrixTranslation(+7.50f, 2.5f, -10.0f + i * 20.0f));
-		rightCylRitem->ObjCBIndex = objCBIndex++;
-		rightCylRitem->Mat = mMaterials["bricks0"].get();
-		rightCylRitem->Geo = mGeometries["shapeGeo"].get();
-		rightCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::Opaque].push_back(rightCylRitem.get());
-		mAllRitems.push_back(std::move(rightCylRitem));
-
-		XMStoreFloat4x4(&frontPyramidRitem->World, XMMatrixScaling(1.0f, 2.0f, 1.0f) * XMMatrixTranslation(-7.5f + i * 15.0f, 9.0f, -10.0f));
-		frontPyramidRitem->ObjCBIndex = objCBIndex++;
-		frontPyramidRitem->Mat = mMaterials["roof0"].get();
-		frontPyramidRitem->Geo = mGeometries["shapeGeo"].get();
-		frontPyramidRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		frontPyramidRitem->IndexCount = frontPyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-		frontPyramidRitem->StartIndexLocation = frontPyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-		frontPyramidRitem->BaseVertexLocation = frontPyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::Opaque].push_back(frontPyramidRitem.get());
-		mAllRitems.push_back(std::move(frontPyramidRitem));
-
-		XMStoreFloat4x4(&backPyramidRitem->World, XMMatrixScaling(1.0f, 2.0f, 1.0f) * XMMatrixTranslation(-7.5f + i * 15.0f, 9.0f, 10.0f));
-		backPyramidRitem->ObjCBIndex = objCBIndex++;
-		backPyramidRitem->Mat = mMaterials["roof0"].get();
-		backPyramidRitem->Geo = mGeometries["shapeGeo"].get();
-		backPyramidRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		backPyramidRitem->IndexCount = backPyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-		backPyramidRitem->StartIndexLocation = backPyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-		backPyramidRitem->BaseVertexLocation = backPyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-		mRitemLayer[(int)RenderLayer::Opaque].push_back(backPyramidRitem.get());
-		mAllRitems.push_back(std::move(backPyramidRitem));
+		InstanceData leftCyl;
+		XMStoreFloat4x4(&leftCyl.World, XMMatrixTranslation(-7.50f, 2.5f, -10.0f + i * 20.0f));
+		towersRitem->Instances.push_back(leftCyl);
 
+		InstanceData rightCyl;
+		XMStoreFloat4x4(&rightCyl.World, XMMatrixTranslation(+7.50f, 2.5f, -10.0f + i * 20.0f));
+		towersRitem->Instances.push_back(rightCyl);
 	}
 
-	
+	mRitemLayer[(int)RenderLayer::OpaqueInstanced].push_back(towersRitem.get());
+	mAllRitems.push_back(std::move(towersRitem));
 
-	auto kiteRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&kiteRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f)* XMMatrixTranslation(0.0f, 2.0f, 9.25f));
-	kiteRitem->ObjCBIndex = 18;
-	kiteRitem->Mat = mMaterials["metal0"].get();
-	kiteRitem->Geo = mGeometries["shapeGeo"].get();
-	kiteRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	kiteRitem->IndexCount = kiteRitem->Geo->DrawArgs["kite"].IndexCount;
-	kiteRitem->StartIndexLocation = kiteRitem->Geo->DrawArgs["kite"].StartIndexLocation;
-	kiteRitem->BaseVertexLocation = kiteRitem->Geo->DrawArgs["kite"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(kiteRitem.get());
-	
-	auto pentagonRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pentagonRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f)* XMMatrixTranslation(0.0f, 3.5f, -8.75f));
-	pentagonRitem->ObjCBIndex = 19;
-	pentagonRitem->Mat = mMaterials["gate0"].get();
-	pentagonRitem->Geo = mGeometries["shapeGeo"].get();
-	pentagonRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pentagonRitem->IndexCount = pentagonRitem->Geo->DrawArgs["pentagon"].IndexCount;
-	pentagonRitem->StartIndexLocation = pentagonRitem->Geo->DrawArgs["pentagon"].StartIndexLocation;
-	pentagonRitem->BaseVertexLocation = pentagonRitem->Geo->DrawArgs["pentagon"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pentagonRitem.get());
-
-	auto grid2Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&grid2Ritem->World, XMMatrixScaling(30.0f, 1.0f, 50.0f)* XMMatrixTranslation(0.0f, 0.9f, -10.0f));
-	grid2Ritem->ObjCBIndex = 20;
-	grid2Ritem->Mat = mMaterials["grass0"].get();
-	grid2Ritem->Geo = mGeometries["shapeGeo"].get();
-	grid2Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	grid2Ritem->IndexCount = grid2Ritem->Geo->DrawArgs["grid"].IndexCount;
-	grid2Ritem->StartIndexLocation = grid2Ritem->Geo->DrawArgs["grid"].StartIndexLocation;
-	grid2Ritem->BaseVertexLocation = grid2Ritem->Geo->DrawArgs["grid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(grid2Ritem.get());
-	
+	// Give every instanced item its own range of the per-frame instance buffer and
+	// precompute the world bounds of its (static) instances for culling.
+	mInstanceCount = 0;
+	for(auto ri : mRitemLayer[(int)RenderLayer::OpaqueInstanced])
+	{
+		ri->InstanceBufferOffset = mInstanceCount;
+		ri->InstanceCount = (UINT)ri->Instances.size();
+		mInstanceCount += (UINT)ri->Instances.size();
 
-	
+		ri->InstanceBounds.resize(ri->Instances.size());
+		for(size_t i = 0; i < ri->Instances.size(); ++i)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&ri->Instances[i].World);
+			mScene.LocalBounds[ri->ObjCBIndex].Transform(ri->InstanceBounds[i], world);
+		}
+	}
 
+	// The terrain's instances are its visible tiles, written after those of the
+	// instanced items.
+	auto terrainRitem = std::make_unique<RenderItem>();
+	terrainRitem->Geo = mGeometries.Find("terrainGeo");
+	terrainRitem->ObjCBIndex = mScene.Add(identity, identity, mMaterials.Find("grass0"),
+		mGeometries[terrainRitem->Geo]->DrawArgs["tile"]);
+	terrainRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	terrainRitem->InstanceBufferOffset = mInstanceCount;
+	mRitemLayer[(int)RenderLayer::Terrain].push_back(terrainRitem.get());
+	mTerrainRitem = terrainRitem.get();
 
+	mShadowInstanceCount = CascadedShadowMaps::CascadeCount*(mInstanceCount + gShadowTerrainTiles*gShadowTerrainTiles);
 
-	auto mazeRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeRitem->World, XMMatrixScaling(8.0f, 3.0f, 1.0f)* XMMatrixTranslation(5.0f, 2.5f, -32.0f));
-	mazeRitem->ObjCBIndex = 21;
-	mazeRitem->Mat = mMaterials["maze0"].get();
-	mazeRitem->Geo = mGeometries["shapeGeo"].get();
-	mazeRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeRitem->IndexCount = mazeRitem->Geo->DrawArgs["maze"].IndexCount;
-	mazeRitem->StartIndexLocation = mazeRitem->Geo->DrawArgs["maze"].StartIndexLocation;
-	mazeRitem->BaseVertexLocation = mazeRitem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeRitem.get());
-
-
-	auto maze1Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze1Ritem->World, XMMatrixScaling(8.0f, 3.0f, 1.0f)* XMMatrixTranslation(-5.0f, 2.5f, -32.0f));
-	maze1Ritem->ObjCBIndex = 22;
-	maze1Ritem->Mat = mMaterials["maze0"].get();
-	maze1Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze1Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze1Ritem->IndexCount = maze1Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze1Ritem->StartIndexLocation = maze1Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze1Ritem->BaseVertexLocation = maze1Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze1Ritem.get());
-	
-	auto maze2Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze2Ritem->World, XMMatrixScaling(8.0f, 3.0f, 1.0f)* XMMatrixTranslation(-5.0f, 2.5f, -15.0f));
-	maze2Ritem->ObjCBIndex = 23;
-	maze2Ritem->Mat = mMaterials["maze0"].get();
-	maze2Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze2Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze2Ritem->IndexCount = maze2Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze2Ritem->StartIndexLocation = maze2Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze2Ritem->BaseVertexLocation = maze2Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze2Ritem.get());
-	
-	auto maze3Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze3Ritem->World, XMMatrixScaling(8.0f, 3.0f, 1.0f)* XMMatrixTranslation(5.0f, 2.5f, -15.0f));
-	maze3Ritem->ObjCBIndex = 24;
-	maze3Ritem->Mat = mMaterials["maze0"].get();
-	maze3Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze3Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze3Ritem->IndexCount = maze3Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze3Ritem->StartIndexLocation = maze3Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze3Ritem->BaseVertexLocation = maze3Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze3Ritem.get());
-	
-	auto maze4Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze4Ritem->World, XMMatrixScaling(1.0f, 3.0f, 18.0f)* XMMatrixTranslation(9.0f, 2.5f, -23.5f));
-	maze4Ritem->ObjCBIndex = 25;
-	maze4Ritem->Mat = mMaterials["maze0"].get();
-	maze4Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze4Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze4Ritem->IndexCount = maze4Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze4Ritem->StartIndexLocation = maze4Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze4Ritem->BaseVertexLocation = maze4Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze4Ritem.get());
-	
-	auto maze5Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze5Ritem->World, XMMatrixScaling(1.0f, 3.0f, 18.0f)* XMMatrixTranslation(-9.0f, 2.5f, -23.5f));
-	maze5Ritem->ObjCBIndex = 26;
-	maze5Ritem->Mat = mMaterials["maze0"].get();
-	maze5Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze5Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze5Ritem->IndexCount = maze5Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze5Ritem->StartIndexLocation = maze5Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze5Ritem->BaseVertexLocation = maze5Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze5Ritem.get());
-	
-	auto maze6Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze6Ritem->World, XMMatrixScaling(1.0f, 3.0f, 6.0f)* XMMatrixTranslation(1.5f, 2.5f, -18.0f));
-	maze6Ritem->ObjCBIndex = 27;
-	maze6Ritem->Mat = mMaterials["maze0"].get();
-	maze6Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze6Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze6Ritem->IndexCount = maze6Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze6Ritem->StartIndexLocation = maze6Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze6Ritem->BaseVertexLocation = maze6Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze6Ritem.get());
-	
-	auto maze7Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze7Ritem->World, XMMatrixScaling(1.0f, 3.0f, 6.0f)* XMMatrixTranslation(-1.5f, 2.5f, -29.0f));
-	maze7Ritem->ObjCBIndex = 28;
-	maze7Ritem->Mat = mMaterials["maze0"].get();
-	maze7Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze7Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze7Ritem->IndexCount = maze7Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze7Ritem->StartIndexLocation = maze7Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze7Ritem->BaseVertexLocation = maze7Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze7Ritem.get());
-	
-	auto maze8Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze8Ritem->World, XMMatrixScaling(10.0f, 3.0f, 1.0f)* XMMatrixTranslation(-0.5f, 2.5f, -26.0f));
-	maze8Ritem->ObjCBIndex = 29;
-	maze8Ritem->Mat = mMaterials["maze0"].get();
-	maze8Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze8Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze8Ritem->IndexCount = maze8Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze8Ritem->StartIndexLocation = maze8Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze8Ritem->BaseVertexLocation = maze8Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze8Ritem.get());
-	
-	auto maze9Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&maze9Ritem->World, XMMatrixScaling(10.0f, 3.0f, 1.0f)* XMMatrixTranslation(0.5f, 2.5f, -21.0f));
-	maze9Ritem->ObjCBIndex = 30;
-	maze9Ritem->Mat = mMaterials["maze0"].get();
-	maze9Ritem->Geo = mGeometries["shapeGeo"].get();
-	maze9Ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	maze9Ritem->IndexCount = maze9Ritem->Geo->DrawArgs["maze"].IndexCount;
-	maze9Ritem->StartIndexLocation = maze9Ritem->Geo->DrawArgs["maze"].StartIndexLocation;
-	maze9Ritem->BaseVertexLocation = maze9Ritem->Geo->DrawArgs["maze"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(maze9Ritem.get());
-
-	mAllRitems.push_back(std::move(grid2Ritem));
-	mAllRitems.push_back(std::move(pentagonRitem));
-	mAllRitems.push_back(std::move(kiteRitem));
-	mAllRitems.push_back(std::move(rampRitem));
-	mAllRitems.push_back(std::move(gridRitem));
-	mAllRitems.push_back(std::move(diamondRitem));
-	mAllRitems.push_back(std::move(pedastalRitem));
-    mAllRitems.push_back(std::move(wavesRitem));
-    mAllRitems.push_back(std::move(mazeRitem));
-    mAllRitems.push_back(std::move(maze1Ritem));
-    mAllRitems.push_back(std::move(maze2Ritem));
-    mAllRitems.push_back(std::move(maze3Ritem));
-    mAllRitems.push_back(std::move(maze4Ritem));
-    mAllRitems.push_back(std::move(maze5Ritem));
-	mAllRitems.push_back(std::move(maze6Ritem));
-	mAllRitems.push_back(std::move(maze7Ritem));
-	mAllRitems.push_back(std::move(maze8Ritem));
-	mAllRitems.push_back(std::move(maze9Ritem));
+	mAllRitems.push_back(std::move(terrainRitem));
     /*mAllRitems.push_back(std::move(gridRitem));*/
 	/*mAllRitems.push_back(std::move(boxRitem));*/
 	
 	mAllRitems.push_back(std::move(treeSpritesRitem));
-	
-	
+
+	assert(mAllRitems.size() == mScene.Count());
+	mEntityVisible.assign(mAllRitems.size(), 0);
+
+	// The water and anything else that moves never enters the cached shadow maps.
+	mShadowDynamic.assign(mAllRitems.size(), 0);
+	for(auto& ri : mAllRitems)
+		mShadowDynamic[ri->ObjCBIndex] = ri->Moves ? 1 : 0;
+
+	mObjectItems.resize(mAllRitems.size());
+	for(auto& ri : mAllRitems)
+		mObjectItems[ri->ObjCBIndex] = ri.get();
+
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		mLayerEntities[layer].clear();
+		for(auto ri : mRitemLayer[layer])
+			mLayerEntities[layer].push_back(ri->ObjCBIndex);
+		std::sort(mLayerEntities[layer].begin(), mLayerEntities[layer].end());
+	}
+
+	// Number the geometries in the order the items first use them.
+	std::unordered_map<UINT, UINT> geometryIds;
+	for(auto& ri : mAllRitems)
+	{
+		auto it = geometryIds.insert(std::make_pair(ri->Geo.Value, (UINT)geometryIds.size())).first;
+		ri->GeometryId = it->second;
+	}
 }
 
-void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void TreeBillboardsApp::DrawRenderItems(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
-
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	const auto& objectCB = mCurrFrameResource->ObjectCB;
+	const auto& matCB = mCurrFrameResource->MaterialCB;
 
     // For each render item...
     for(size_t i = 0; i < ritems.size(); ++i)
     {
         auto ri = ritems[i];
+		const Material* mat = mMaterials[mScene.Materials[ri->ObjCBIndex]].get();
+		const EntityDrawArgs& args = mScene.DrawArgs[ri->ObjCBIndex];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+		cmdList.SetPipelineState(mPsoVariants[ri->PsoVariant].Psos[(int)depthPass].Get());
+        cmdList.SetGeometry(mGeometries[ri->Geo].get());
 		//step3
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+        cmdList.IASetPrimitiveTopology(ri->PrimitiveType);
+
+		if(!mBindless)
+			cmdList.SetGraphicsRootDescriptorTable(0, mDescriptors->GpuHandle(mat->DiffuseSrvHeapIndex));
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+		if(mStructuredConstants)
+			cmdList.SetGraphicsRoot32BitConstant(1, ri->ObjCBIndex, 0);
+		else
+		{
+			D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB.GpuAddress(ri->ObjCBIndex);
+			D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB.GpuAddress(mat->MatCBIndex);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+			cmdList.SetGraphicsRootConstantBufferView(1, objCBAddress);
+			cmdList.SetGraphicsRootConstantBufferView(3, matCBAddress);
+		}
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+		// Tier 1 has no image, so this is all it gets of the fog.  The passes that
+		// shade nothing keep full rate.
+		if(VrsActive() && depthPass != DepthPass::Prepass && depthPass != DepthPass::Visibility)
+			cmdList.RSSetShadingRate(mVrs->RateForFog(FogAmount(mScene.Bounds[ri->ObjCBIndex])), mVrs->Combiners());
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+        cmdList.DrawIndexedInstanced(args.IndexCount, 1, args.StartIndexLocation, args.BaseVertexLocation, 0);
     }
+
+	// Later layers' draws do not all pick a rate.
+	if(VrsActive())
+		cmdList.RSSetShadingRate(D3D12_SHADING_RATE_1X1, mVrs->Combiners());
+}
+
+void TreeBillboardsApp::DrawInstancedRenderItems(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass, const std::vector<RenderItem*>& ritems)
+{
+	const auto& objectCB = mCurrFrameResource->ObjectCB;
+	const auto& matCB = mCurrFrameResource->MaterialCB;
+	const auto& instanceBuffer = mCurrFrameResource->InstanceBuffer;
+
+	for(auto ri : ritems)
+	{
+		const Material* mat = mMaterials[mScene.Materials[ri->ObjCBIndex]].get();
+
+		// Passes without meshlet PSOs, such as the shadow casters, fall back to the
+		// vertex shader.
+		const PsoVariant& variant = mPsoVariants[ri->PsoVariant];
+		ID3D12PipelineState* meshletPso = MeshShadersActive() && ri->Geo == mMeshletGeometry ?
+			variant.MeshletPsos[(int)depthPass].Get() : nullptr;
+
+		if(meshletPso)
+			cmdList.SetPipelineState(meshletPso);
+		else
+		{
+			cmdList.SetPipelineState(variant.Psos[(int)depthPass].Get());
+			cmdList.SetGeometry(mGeometries[ri->Geo].get());
+			cmdList.IASetPrimitiveTopology(ri->PrimitiveType);
+		}
+
+		// A meshlet draw runs an amplification shader group per gMeshletGroupSize
+		// meshlets of the submesh and instance.  A submesh that was not split into
+		// meshlets is drawn through the vertex shader instead.
+		auto draw = [&](UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex)
+		{
+			auto range = meshletPso ? mMeshletRanges.find(startIndex) : mMeshletRanges.end();
+			if(range == mMeshletRanges.end())
+			{
+				cmdList.SetPipelineState(variant.Psos[(int)depthPass].Get());
+				cmdList.SetGeometry(mGeometries[ri->Geo].get());
+				cmdList.IASetPrimitiveTopology(ri->PrimitiveType);
+				cmdList.DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, 0);
+				return;
+			}
+
+			cmdList.SetPipelineState(meshletPso);
+			cmdList.SetGraphicsRoot32BitConstant(mMeshletRootParameter, range->second.FirstMeshlet, 0);
+			cmdList.SetGraphicsRoot32BitConstant(mMeshletRootParameter, range->second.MeshletCount, 1);
+			cmdList.DispatchMesh((range->second.MeshletCount + gMeshletGroupSize - 1) / gMeshletGroupSize, instanceCount, 1);
+		};
+
+		// Point the shader at this item's packed range of visible instances.
+		D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer.GpuAddress(ri->InstanceBufferOffset);
+
+		if(!mBindless)
+			cmdList.SetGraphicsRootDescriptorTable(0, mDescriptors->GpuHandle(mat->DiffuseSrvHeapIndex));
+
+		if(mStructuredConstants)
+			cmdList.SetGraphicsRoot32BitConstant(1, ri->ObjCBIndex, 0);
+		else
+		{
+			cmdList.SetGraphicsRootConstantBufferView(1, objectCB.GpuAddress(ri->ObjCBIndex));
+			cmdList.SetGraphicsRootConstantBufferView(3, matCB.GpuAddress(mat->MatCBIndex));
+		}
+		if(ri->Lods.empty())
+		{
+			const EntityDrawArgs& args = mScene.DrawArgs[ri->ObjCBIndex];
+			UINT nearCount = ri->InstanceCount - ri->FoggedInstanceCount;
+			if(nearCount > 0)
+			{
+				cmdList.SetGraphicsRootShaderResourceView(4, instanceAddress);
+				draw(args.IndexCount, nearCount, args.StartIndexLocation, args.BaseVertexLocation);
+			}
+
+			// The packed instances wholly in the fog.
+			if(ri->FoggedInstanceCount > 0)
+			{
+				bool coarse = VrsActive() && depthPass != DepthPass::Prepass;
+				if(coarse)
+					cmdList.RSSetShadingRate(mVrs->CoarseRate(), mVrs->Combiners());
+				cmdList.SetGraphicsRootShaderResourceView(4, instanceBuffer.GpuAddress(ri->InstanceBufferOffset + nearCount));
+				draw(args.IndexCount, ri->FoggedInstanceCount, args.StartIndexLocation, args.BaseVertexLocation);
+				if(coarse)
+					cmdList.RSSetShadingRate(D3D12_SHADING_RATE_1X1, mVrs->Combiners());
+			}
+			continue;
+		}
+
+		// One draw per level in use, each over its run of the packed instances.
+		UINT firstInstance = 0;
+		for(size_t lod = 0; lod < ri->Lods.size(); ++lod)
+		{
+			UINT count = ri->LodInstanceCounts[lod];
+			if(count == 0)
+				continue;
+
+			const LodLevel& level = ri->Lods[lod];
+			cmdList.SetGraphicsRootShaderResourceView(4, instanceBuffer.GpuAddress(ri->InstanceBufferOffset + firstInstance));
+			draw(level.IndexCount, count, level.StartIndexLocation, level.BaseVertexLocation);
+			firstInstance += count;
+		}
+	}
+}
+
+void TreeBillboardsApp::DrawRenderItemsIndirect(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass)
+{
+	const auto& ritems = mVisibleRitems[(int)layer];
+	if(ritems.empty())
+		return;
+
+	// Topology is not part of the command signature; all items in a layer share it.
+	cmdList.IASetPrimitiveTopology(ritems[0]->PrimitiveType);
+
+	ID3D12Resource* argResource = nullptr;
+	UINT64 argOffset = 0;
+	UINT64 argStride = 0;
+	if(mStructuredConstants)
+	{
+		const auto& argBuffer = mCurrFrameResource->StructuredIndirectArgs;
+		argResource = argBuffer.Resource();
+		argOffset = argBuffer.Offset();
+		argStride = sizeof(StructuredIndirectCommand);
+	}
+	else
+	{
+		const auto& argBuffer = mCurrFrameResource->IndirectArgs;
+		argResource = argBuffer.Resource();
+		argOffset = argBuffer.Offset();
+		argStride = sizeof(IndirectCommand);
+	}
+
+	// Items added since the culler was sized are drawn unculled.
+	if(layer == RenderLayer::Opaque && mOcclusionCulling && ritems.size() <= mOcclusion->MaxCommands())
+	{
+		DrawOccludedRenderItems(cmdList, depthPass, argResource->GetGPUVirtualAddress() + argOffset);
+		return;
+	}
+
+	for(const auto& batch : mIndirectBatches[(int)layer])
+	{
+		cmdList.SetPipelineState(mPsoVariants[batch.PsoVariant].Psos[(int)depthPass].Get());
+		if(!mBindless)
+			cmdList.SetGraphicsRootDescriptorTable(0, mDescriptors->GpuHandle(batch.SrvHeapIndex));
+
+		cmdList.ExecuteIndirect(mCommandSignature.Get(), batch.CommandCount,
+			argResource, argOffset + (UINT64)batch.FirstCommand*argStride);
+	}
+}
+
+void TreeBillboardsApp::DrawOccludedRenderItems(CachedCommandList& cmdList, DepthPass depthPass, D3D12_GPU_VIRTUAL_ADDRESS commands)
+{
+	const auto& batches = mIndirectBatches[(int)RenderLayer::Opaque];
+	const UINT commandCount = (UINT)mVisibleRitems[(int)RenderLayer::Opaque].size();
+	const D3D12_PRIMITIVE_TOPOLOGY topology = mVisibleRitems[(int)RenderLayer::Opaque][0]->PrimitiveType;
+	const D3D12_GPU_VIRTUAL_ADDRESS candidates = mCurrFrameResource->OcclusionCandidates.GpuAddress();
+
+	// Each batch draws what the phase kept of it, up to its full size.
+	auto drawPhase = [&](OcclusionCulling::Phase phase)
+	{
+		for(UINT i = 0; i < (UINT)batches.size(); ++i)
+		{
+			const auto& batch = batches[i];
+			cmdList.SetPipelineState(mPsoVariants[batch.PsoVariant].Psos[(int)depthPass].Get());
+			if(!mBindless)
+				cmdList.SetGraphicsRootDescriptorTable(0, mDescriptors->GpuHandle(batch.SrvHeapIndex));
+
+			cmdList.ExecuteIndirect(mCommandSignature.Get(), batch.CommandCount,
+				mOcclusion->Arguments(), mOcclusion->ArgumentOffset(phase, batch.FirstCommand - mOpaqueFirstCommand),
+				mOcclusion->Counts(), mOcclusion->CountOffset(phase, i));
+		}
+	};
+
+	// With the pre-pass the culls ran during it, and shading draws what they kept.
+	if(depthPass == DepthPass::Equal)
+	{
+		drawPhase(OcclusionCulling::Early);
+		drawPhase(OcclusionCulling::Late);
+		return;
+	}
+
+	// The compute work sets a PSO behind the cache's back; the graphics root
+	// signature and arguments are untouched.
+	mOcclusion->Cull(cmdList.Get(), mOcclusionCullRootSignature.Get(), mPSOs[mFramePsos.OcclusionCull].Get(),
+		OcclusionCulling::Early, commands, candidates, mOpaqueFirstCommand, commandCount);
+	cmdList.Invalidate();
+	cmdList.IASetPrimitiveTopology(topology);
+	drawPhase(OcclusionCulling::Early);
+
+	// Rebuild the pyramid from what the early phase drew, then draw whatever it
+	// wrongly rejected.  The pyramid is kept for the next frame's early phase.
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&mView), XMLoadFloat4x4(&mProj)));
+	mOcclusion->BuildPyramid(cmdList.Get(), mHiZRootSignature.Get(), mPSOs[mFramePsos.HiZReduce].Get(), viewProj,
+		(UINT)mSceneViewport.Width, (UINT)mSceneViewport.Height);
+	mOcclusion->Cull(cmdList.Get(), mOcclusionCullRootSignature.Get(), mPSOs[mFramePsos.OcclusionCull].Get(),
+		OcclusionCulling::Late, commands, candidates, mOpaqueFirstCommand, commandCount);
+	cmdList.Invalidate();
+	cmdList.IASetPrimitiveTopology(topology);
+	drawPhase(OcclusionCulling::Late);
+}
+
+void TreeBillboardsApp::DrawVegetation(CachedCommandList& cmdList)
+{
+	const auto& objectCB = mCurrFrameResource->ObjectCB;
+	const auto& matCB = mCurrFrameResource->MaterialCB;
+	const RenderItem* ri = mVegetationRitem;
+	const Material* mat = mMaterials[mScene.Materials[ri->ObjCBIndex]].get();
+
+	// No vertex buffers: the vertex shader reads the visible trees directly.
+	cmdList.SetPipelineState(mPSOs[mFramePsos.TreeSprites].Get());
+	cmdList.IASetPrimitiveTopology(ri->PrimitiveType);
+
+	if(!mBindless)
+		cmdList.SetGraphicsRootDescriptorTable(0, mDescriptors->GpuHandle(mat->DiffuseSrvHeapIndex));
+
+	if(mStructuredConstants)
+		cmdList.SetGraphicsRoot32BitConstant(1, ri->ObjCBIndex, 0);
+	else
+	{
+		cmdList.SetGraphicsRootConstantBufferView(1, objectCB.GpuAddress(ri->ObjCBIndex));
+		cmdList.SetGraphicsRootConstantBufferView(3, matCB.GpuAddress(mat->MatCBIndex));
+	}
+	cmdList.SetGraphicsRootShaderResourceView(4, mVegetation->VisibleTrees());
+
+	// The cull wrote the instance count.
+	cmdList.ExecuteIndirect(mVegetation->CommandSignature(), 1, mVegetation->DrawArguments(), 0);
+}
+
+void TreeBillboardsApp::DrawLayer(CachedCommandList& cmdList, RenderLayer layer, DepthPass depthPass)
+{
+	if(layer == RenderLayer::OpaqueInstanced || layer == RenderLayer::Terrain)
+		DrawInstancedRenderItems(cmdList, layer, depthPass, mVisibleRitems[(int)layer]);
+	else if(layer == RenderLayer::AlphaTestedTreeSprites)
+		DrawVegetation(cmdList);
+	else if(mIndirectDraw)
+		DrawRenderItemsIndirect(cmdList, layer, depthPass);
+	else
+		DrawRenderItems(cmdList, layer, depthPass, mVisibleRitems[(int)layer]);
+}
+
+CommandListStats TreeBillboardsApp::DrawShadows()
+{
+	if(!mShadows)
+		return CommandListStats();
+
+	CachedCommandList cmdList(mCommandList.Get());
+	UINT scope = mGpuProfiler->BeginScope(mCommandList.Get(), "shadows");
+
+	// The casters read what the layer passes do, less the lights and shadow maps.
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mDescriptors->Heap() };
+	cmdList.Get()->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	cmdList.SetGraphicsRootSignature(mRootSignature.Get());
+
+	if(mUseGpuWaves)
+		cmdList.SetGraphicsRootDescriptorTable(5, mGpuWaves->DisplacementMap());
+	else if(mStreamWaveHeights)
+		cmdList.SetGraphicsRootDescriptorTable(5, mDescriptors->GpuHandle(mWaveHeightSrvIndex));
+
+	if(mStructuredConstants)
+	{
+		cmdList.SetGraphicsRootShaderResourceView(3, mCurrFrameResource->MaterialCB.GpuAddress());
+		cmdList.SetGraphicsRootShaderResourceView(6, mCurrFrameResource->ObjectCB.GpuAddress());
+	}
+
+	if(mBindless)
+		cmdList.SetGraphicsRootDescriptorTable(10, mDescriptors->GpuHandle(0));
+
+	// Most frames redraw no static map at all.
+	bool anyStale = false;
+	for(UINT c = 0; c < CascadedShadowMaps::CascadeCount; ++c)
+		anyStale |= mShadowMaps->StaticStale(c);
+
+	if(anyStale)
+	{
+		mShadowMaps->BeginStatic(mCommandList.Get());
+		for(UINT c = 0; c < CascadedShadowMaps::CascadeCount; ++c)
+		{
+			if(!mShadowMaps->StaticStale(c))
+				continue;
+
+			mShadowMaps->BindStatic(mCommandList.Get(), c);
+			cmdList.SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCB.GpuAddress(1 + c));
+			DrawShadowCasters(cmdList, c, false);
+		}
+		mShadowMaps->EndStatic(mCommandList.Get());
+	}
+
+	mShadowMaps->BeginDynamic(mCommandList.Get());
+	for(UINT c = 0; c < CascadedShadowMaps::DynamicCascadeCount; ++c)
+	{
+		mShadowMaps->BindDynamic(mCommandList.Get(), c);
+		cmdList.SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCB.GpuAddress(1 + c));
+		DrawShadowCasters(cmdList, c, true);
+	}
+	mShadowMaps->EndDynamic(mCommandList.Get());
+
+	mGpuProfiler->EndScope(mCommandList.Get(), scope);
+	return cmdList.Stats();
+}
+
+void TreeBillboardsApp::DrawShadowCasters(CachedCommandList& cmdList, UINT cascade, bool dynamic)
+{
+	const auto& objectCB = mCurrFrameResource->ObjectCB;
+	const auto& matCB = mCurrFrameResource->MaterialCB;
+	const BoundingOrientedBox& bounds = mShadowMaps->Bounds(cascade);
+
+	auto setItemState = [&](const RenderItem& ri)
+	{
+		const Material* mat = mMaterials[mScene.Materials[ri.ObjCBIndex]].get();
+
+		cmdList.SetPipelineState(mPsoVariants[ri.PsoVariant].Psos[(int)DepthPass::Shadow].Get());
+		cmdList.SetGeometry(mGeometries[ri.Geo].get());
+		cmdList.IASetPrimitiveTopology(ri.PrimitiveType);
+
+		// DepthPS samples the cut-outs.
+		if(!mBindless)
+			cmdList.SetGraphicsRootDescriptorTable(0, mDescriptors->GpuHandle(mat->DiffuseSrvHeapIndex));
+
+		if(mStructuredConstants)
+			cmdList.SetGraphicsRoot32BitConstant(1, ri.ObjCBIndex, 0);
+		else
+		{
+			cmdList.SetGraphicsRootConstantBufferView(1, objectCB.GpuAddress(ri.ObjCBIndex));
+			cmdList.SetGraphicsRootConstantBufferView(3, matCB.GpuAddress(mat->MatCBIndex));
+		}
+	};
+
+	// The single items of every casting layer, culled against the cascade.
+	for(const auto& pass : gLayerPasses)
+	{
+		if(!pass.CastsShadows || pass.Layer == RenderLayer::OpaqueInstanced || pass.Layer == RenderLayer::Terrain)
+			continue;
+
+		for(auto ri : mRitemLayer[(int)pass.Layer])
+		{
+			if((mShadowDynamic[ri->ObjCBIndex] != 0) != dynamic || !bounds.Intersects(mScene.Bounds[ri->ObjCBIndex]))
+				continue;
+
+			setItemState(*ri);
+			const EntityDrawArgs& args = mScene.DrawArgs[ri->ObjCBIndex];
+			cmdList.DrawIndexedInstanced(args.IndexCount, 1, args.StartIndexLocation, args.BaseVertexLocation, 0);
+		}
+	}
+
+	if(dynamic)
+		return;
+
+	// The instances and terrain tiles UpdateShadows laid out for this cascade.
+	const auto& shadowInstances = mCurrFrameResource->ShadowInstances;
+	for(const ShadowDraw& draw : mShadowDraws[cascade])
+	{
+		setItemState(*draw.Item);
+		cmdList.SetGraphicsRootShaderResourceView(4, shadowInstances.GpuAddress(draw.FirstInstance));
+		if(draw.Item->Lods.empty())
+		{
+			const EntityDrawArgs& args = mScene.DrawArgs[draw.Item->ObjCBIndex];
+			cmdList.DrawIndexedInstanced(args.IndexCount, draw.InstanceCount, args.StartIndexLocation, args.BaseVertexLocation, 0);
+		}
+		else
+		{
+			const LodLevel& level = draw.Item->Lods[0];
+			cmdList.DrawIndexedInstanced(level.IndexCount, draw.InstanceCount, level.StartIndexLocation, level.BaseVertexLocation, 0);
+		}
+	}
 }
 
-std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TreeBillboardsApp::GetStaticSamplers()
+DepthPass TreeBillboardsApp::ShadingPass(const LayerPass& pass)const
+{
+	if(mOit && pass.Blended)
+		return DepthPass::Oit;
+	return mDepthPrepass && pass.DepthPrepass ? DepthPass::Equal : DepthPass::Shade;
+}
+
+std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> TreeBillboardsApp::GetStaticSamplers()
 {
 	// Applications usually only need a handful of samplers.  So just define them all up front
 	// and keep them available as part of the root signature.  
@@ -2043,27 +6877,21 @@ std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TreeBillboardsApp::GetStaticSam
 		0.0f,                              // mipLODBias
 		8);                                // maxAnisotropy
 
+	// Filtered depth comparison for the shadow maps; outside them is lit.
+	const CD3DX12_STATIC_SAMPLER_DESC shadow(
+		6, // shaderRegister
+		D3D12_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT, // filter
+		D3D12_TEXTURE_ADDRESS_MODE_BORDER,  // addressU
+		D3D12_TEXTURE_ADDRESS_MODE_BORDER,  // addressV
+		D3D12_TEXTURE_ADDRESS_MODE_BORDER,  // addressW
+		0.0f,                               // mipLODBias
+		16,                                 // maxAnisotropy
+		D3D12_COMPARISON_FUNC_LESS_EQUAL,
+		D3D12_STATIC_BORDER_COLOR_OPAQUE_WHITE);
+
 	return { 
 		pointWrap, pointClamp,
 		linearWrap, linearClamp, 
-		anisotropicWrap, anisotropicClamp };
-}
-
-float TreeBillboardsApp::GetHillsHeight(float x, float z)const
-{
-    return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
-}
-
-XMFLOAT3 TreeBillboardsApp::GetHillsNormal(float x, float z)const
-{
-    // n = (-df/dx, 1, -df/dz)
-    XMFLOAT3 n(
-        -0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z),
-        1.0f,
-        -0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z));
-
-    XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
-    XMStoreFloat3(&n, unitNormal);
-
-    return n;
+		anisotropicWrap, anisotropicClamp,
+		shadow };
 }
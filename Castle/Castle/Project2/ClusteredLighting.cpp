@@ -0,0 +1,86 @@
+//***************************************************************************************
+// ClusteredLighting.cpp
+//***************************************************************************************
+
+#include "ClusteredLighting.h"
+#include <cassert>
+
+using namespace DirectX;
+
+ClusteredLighting::ClusteredLighting(ID3D12Device* device, float nearZ, float farZ, UINT frameCount)
+{
+	assert(nearZ > 0.0f && farZ > nearZ);
+
+	md3dDevice = device;
+	mNearZ = nearZ;
+	mFarZ = farZ;
+
+	// Written by every cull before it is read, so they need no initial data.
+	mClusterLights.resize(frameCount);
+	for(auto& buffer : mClusterLights)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer((UINT64)ClusterCount*ClusterStride*sizeof(UINT),
+				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+			D3D12_RESOURCE_STATE_COMMON,
+			nullptr,
+			IID_PPV_ARGS(&buffer)));
+	}
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+}
+
+UINT ClusteredLighting::BufferCount()const
+{
+	return (UINT)mClusterLights.size();
+}
+
+ID3D12Resource* ClusteredLighting::Resource(UINT frameIndex)const
+{
+	return mClusterLights[frameIndex].Get();
+}
+
+XMFLOAT2 ClusteredLighting::DepthSliceScaleBias()const
+{
+	// Slice k starts at nearZ*(farZ/nearZ)^(k/ClusterCountZ).
+	float scale = (float)ClusterCountZ / log2f(mFarZ / mNearZ);
+	return XMFLOAT2(scale, -log2f(mNearZ)*scale);
+}
+
+void ClusteredLighting::Cull(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+	UINT frameIndex, const XMFLOAT4X4& view, const XMFLOAT4X4& proj, D3D12_GPU_VIRTUAL_ADDRESS lights, UINT lightCount)
+{
+	LightCullConstants constants;
+	XMStoreFloat4x4(&constants.View, XMMatrixTranspose(XMLoadFloat4x4(&view)));
+	constants.ProjScaleX = proj(0, 0);
+	constants.ProjScaleY = proj(1, 1);
+	constants.NearZ = mNearZ;
+	constants.FarZ = mFarZ;
+	constants.LightCount = lightCount;
+
+	// Buffers decay to COMMON when the list that read them completes.
+	ID3D12Resource* clusterLights = mClusterLights[frameIndex].Get();
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(clusterLights,
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetComputeRoot32BitConstants(0, CullConstantCount, &constants, 0);
+	cmdList->SetComputeRootShaderResourceView(1, lights);
+	cmdList->SetComputeRootUnorderedAccessView(2, clusterLights->GetGPUVirtualAddress());
+
+	// One thread per cluster.
+	cmdList->Dispatch((ClusterCount + CullThreadGroupSize - 1) / CullThreadGroupSize, 1, 1);
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(clusterLights,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON));
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS ClusteredLighting::ClusterLights(UINT frameIndex)const
+{
+	return mClusterLights[frameIndex]->GetGPUVirtualAddress();
+}
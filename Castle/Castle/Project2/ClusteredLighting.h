@@ -0,0 +1,93 @@
+//***************************************************************************************
+// ClusteredLighting.h
+//
+// Bins the scene's local lights into a grid of view space clusters: screen tiles cut
+// into slices that grow exponentially with depth.  Each frame a compute pass tests
+// every light's sphere of influence against every cluster and writes, per cluster, a
+// count followed by the indices of the lights reaching it.  The pixel shader finds its
+// cluster from its screen position and depth and only evaluates those lights.
+//
+// The lights themselves come from the caller, as a structured buffer of Light; the
+// directional lights stay in the pass constants.  Like Vegetation, this class does
+// not draw anything itself.
+//
+// There is one cluster buffer per frame resource, so a frame's cull can run on the
+// compute queue while the previous frame still reads its own clusters.  The buffers
+// rest in COMMON, the one state compute lists can hand a pixel shader read.
+//***************************************************************************************
+
+#ifndef CLUSTEREDLIGHTING_H
+#define CLUSTEREDLIGHTING_H
+
+#include "../../Common/d3dUtil.h"
+
+// Root constants of the culling pass.  Must match cbCull in LightCull.hlsl.
+struct LightCullConstants
+{
+	// Transposed, as in PassConstants.
+	DirectX::XMFLOAT4X4 View;
+	// The projection's x and y scale, to turn NDC into view space rays.
+	float ProjScaleX;
+	float ProjScaleY;
+	float NearZ;
+	float FarZ;
+	UINT LightCount;
+};
+
+class ClusteredLighting
+{
+public:
+	// Must match ClusteredLighting.hlsl.
+	static const UINT ClusterCountX = 16;
+	static const UINT ClusterCountY = 9;
+	static const UINT ClusterCountZ = 24;
+	static const UINT ClusterCount = ClusterCountX*ClusterCountY*ClusterCountZ;
+
+	// Lights past this many in one cluster are dropped.  A cluster's record is its
+	// count followed by this many indices.
+	static const UINT MaxLightsPerCluster = 127;
+	static const UINT ClusterStride = MaxLightsPerCluster + 1;
+
+	// Must match CULL_THREADS in LightCull.hlsl.
+	static const UINT CullThreadGroupSize = 64;
+
+	// The culling root signature has the constants at 0, the lights SRV at 1 and the
+	// cluster UAV at 2.
+	static const UINT CullConstantCount = sizeof(LightCullConstants) / 4;
+
+	// Clusters span view depths [nearZ, farZ]; nothing beyond farZ is lit.
+	// frameCount must match the number of frame resources.
+	ClusteredLighting(ID3D12Device* device, float nearZ, float farZ, UINT frameCount);
+	ClusteredLighting(const ClusteredLighting& rhs) = delete;
+	ClusteredLighting& operator=(const ClusteredLighting& rhs) = delete;
+	~ClusteredLighting();
+
+	// The buffers to keep resident.
+	UINT BufferCount()const;
+	ID3D12Resource* Resource(UINT frameIndex)const;
+
+	// Scale and bias that turn log2 of a view depth into a slice index, for the
+	// pass constants.
+	DirectX::XMFLOAT2 DepthSliceScaleBias()const;
+
+	// Bins lightCount lights read from lights, in world space, into frameIndex's
+	// clusters of the view and projection.  cmdList may be a direct or a compute list.
+	// Once it has executed, ClusterLights(frameIndex) is readable by pixel shaders.
+	void Cull(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+		UINT frameIndex, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj,
+		D3D12_GPU_VIRTUAL_ADDRESS lights, UINT lightCount);
+
+	// Structured buffer of ClusterCount*ClusterStride uints.
+	D3D12_GPU_VIRTUAL_ADDRESS ClusterLights(UINT frameIndex)const;
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	float mNearZ = 1.0f;
+	float mFarZ = 1.0f;
+
+	// Rest in COMMON between culls; the pixel shader read promotes them implicitly.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mClusterLights;
+};
+
+#endif // CLUSTEREDLIGHTING_H
@@ -0,0 +1,252 @@
+//***************************************************************************************
+// CpuBenchmark.cpp
+//***************************************************************************************
+
+#include "CpuBenchmark.h"
+#include "Waves.h"
+#include "../../Common/GeometryGenerator.h"
+#include "../../Common/JobSystem.h"
+#include "../../Common/MathHelper.h"
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+	double NowMs()
+	{
+		static const double msPerCount = []()
+		{
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			return 1000.0 / (double)frequency.QuadPart;
+		}();
+
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return now.QuadPart * msPerCount;
+	}
+
+	// Keeps the compiler from discarding work whose results are otherwise unused.
+	volatile float gSink = 0.0f;
+}
+
+void CpuBenchmark::Run(UINT maxThreads)
+{
+	mResults.clear();
+
+	RunGeometry();
+	RunWaves(maxThreads);
+	RunMath();
+}
+
+const std::vector<CpuBenchmarkResult>& CpuBenchmark::Results()const
+{
+	return mResults;
+}
+
+void CpuBenchmark::WriteJson(const std::wstring& filename)const
+{
+	std::ofstream fout(filename);
+	if(!fout)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
+
+	fout << "{\n";
+	fout << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+	fout << "  \"results\": [\n";
+	for(size_t i = 0; i < mResults.size(); ++i)
+	{
+		const CpuBenchmarkResult& r = mResults[i];
+
+		// Names and parameter names are identifiers, so need no escaping.
+		fout << "    { \"name\": \"" << r.Name << "\", \"parameters\": {";
+		for(size_t j = 0; j < r.Parameters.size(); ++j)
+		{
+			fout << (j > 0 ? ", " : " ") << "\"" << r.Parameters[j].first << "\": " << r.Parameters[j].second;
+		}
+		fout << (r.Parameters.empty() ? "}" : " }");
+
+		fout << ", \"items\": " << r.Items << ", \"iterations\": " << r.Iterations <<
+			", \"median_ms\": " << r.MedianMs << ", \"min_ms\": " << r.MinMs << " }" <<
+			(i + 1 < mResults.size() ? "," : "") << "\n";
+	}
+	fout << "  ]\n";
+	fout << "}\n";
+}
+
+void CpuBenchmark::RunGeometry()
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData mesh;
+	auto noSetup = []() {};
+
+	for(UINT subdivisions = 0; subdivisions <= 6; ++subdivisions)
+	{
+		Measure("GeometryGenerator::CreateBox", { { "subdivisions", subdivisions } }, 1, noSetup,
+			[&]() { mesh = geoGen.CreateBox(1.0f, 1.0f, 1.0f, subdivisions); });
+		Measure("GeometryGenerator::CreateGeosphere", { { "subdivisions", subdivisions } }, 1, noSetup,
+			[&]() { mesh = geoGen.CreateGeosphere(0.5f, subdivisions); });
+	}
+
+	for(UINT slices = 16; slices <= 256; slices *= 4)
+	{
+		Measure("GeometryGenerator::CreateSphere", { { "slices", slices }, { "stacks", slices } }, 1, noSetup,
+			[&]() { mesh = geoGen.CreateSphere(0.5f, slices, slices); });
+		Measure("GeometryGenerator::CreateCylinder", { { "slices", slices }, { "stacks", slices } }, 1, noSetup,
+			[&]() { mesh = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, slices, slices); });
+	}
+
+	for(UINT n = 64; n <= 1024; n *= 4)
+	{
+		Measure("GeometryGenerator::CreateGrid", { { "rows", n }, { "columns", n } }, 1, noSetup,
+			[&]() { mesh = geoGen.CreateGrid(160.0f, 160.0f, n, n); });
+	}
+
+	// Subdivide works in place, so each run gets a fresh copy of the coarser mesh.
+	for(UINT subdivisions = 0; subdivisions <= 5; ++subdivisions)
+	{
+		const GeometryGenerator::MeshData source = geoGen.CreateGeosphere(0.5f, subdivisions);
+		Measure("GeometryGenerator::Subdivide", { { "from_subdivisions", subdivisions } }, 1,
+			[&]() { mesh = source; },
+			[&]() { geoGen.Subdivide(mesh); });
+	}
+
+	// GetIndices16 caches its result, so each run gets a copy that has none.
+	for(UINT n = 64; n <= 256; n *= 2)
+	{
+		const GeometryGenerator::MeshData source = geoGen.CreateGrid(160.0f, 160.0f, n - 1, n - 1);
+		Measure("GeometryGenerator::GetIndices16", { { "rows", n - 1 }, { "columns", n - 1 } }, 1,
+			[&]() { mesh = source; },
+			[&]() { gSink = (float)mesh.GetIndices16().size(); });
+	}
+}
+
+void CpuBenchmark::RunWaves(UINT maxThreads)
+{
+	const UINT hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	if(maxThreads == 0 || maxThreads > hardwareThreads)
+		maxThreads = hardwareThreads;
+
+	// 1, 2, 4, ... threads, and the maximum if it is not a power of two.
+	std::vector<UINT> threadCounts;
+	for(UINT threads = 1; threads < maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+
+	for(UINT threads : threadCounts)
+	{
+		// The thread calling ParallelFor works too, so one thread needs no workers.
+		std::unique_ptr<JobSystem> jobs;
+		if(threads > 1)
+			jobs = std::make_unique<JobSystem>(threads - 1);
+
+		for(UINT n = 128; n <= 2048; n *= 2)
+		{
+			// The castle's constants.  Each run's step is published first, as a frame's
+			// would be.
+			Waves waves((int)n, (int)n, 1.0f, 0.03f, 4.0f, 0.2f);
+			waves.SetJobSystem(jobs.get());
+			waves.Disturb((int)n / 2, (int)n / 2, 0.5f);
+
+			Measure("Waves::Step", { { "rows", n }, { "columns", n }, { "threads", threads } }, n*n,
+				[&]() { waves.Publish(); },
+				[&]() { waves.Step(); });
+			gSink = waves.Height((int)(n*n / 2));
+		}
+	}
+}
+
+void CpuBenchmark::RunMath()
+{
+	const UINT count = 4096;
+	auto noSetup = []() {};
+
+	std::vector<XMFLOAT4X4> worlds(count);
+	std::vector<XMFLOAT4X4A> results(count);
+	std::vector<XMFLOAT3> points(count);
+	std::vector<XMFLOAT3> transformed(count);
+	for(UINT i = 0; i < count; ++i)
+	{
+		XMMATRIX world = XMMatrixRotationRollPitchYaw(MathHelper::RandF(), MathHelper::RandF(), MathHelper::RandF()) *
+			XMMatrixTranslation(MathHelper::RandF(-50.0f, 50.0f), MathHelper::RandF(0.0f, 20.0f), MathHelper::RandF(-50.0f, 50.0f));
+		XMStoreFloat4x4(&worlds[i], world);
+
+		XMStoreFloat3(&points[i], MathHelper::RandUnitVec3());
+	}
+
+	Measure("MathHelper::TransposeMatrices", {}, count, noSetup, [&]()
+	{
+		MathHelper::TransposeMatrices(worlds.data(), sizeof(XMFLOAT4X4), results.data(), sizeof(XMFLOAT4X4A), count);
+	});
+
+	Measure("MathHelper::InverseTranspose", {}, count, noSetup, [&]()
+	{
+		for(UINT i = 0; i < count; ++i)
+			XMStoreFloat4x4A(&results[i], MathHelper::InverseTranspose(XMLoadFloat4x4(&worlds[i])));
+	});
+
+	Measure("MathHelper::InverseRigid", {}, count, noSetup, [&]()
+	{
+		for(UINT i = 0; i < count; ++i)
+			XMStoreFloat4x4A(&results[i], MathHelper::InverseRigid(XMLoadFloat4x4(&worlds[i])));
+	});
+
+	// The general inverse InverseRigid stands in for.
+	Measure("XMMatrixInverse", {}, count, noSetup, [&]()
+	{
+		for(UINT i = 0; i < count; ++i)
+			XMStoreFloat4x4A(&results[i], XMMatrixInverse(nullptr, XMLoadFloat4x4(&worlds[i])));
+	});
+
+	Measure("MathHelper::OctahedralEncode", {}, count, noSetup, [&]()
+	{
+		float sum = 0.0f;
+		for(UINT i = 0; i < count; ++i)
+			sum += MathHelper::OctahedralEncode(points[i]).x;
+		gSink = sum;
+	});
+
+	// One world matrix applied to a batch of points, as bounds are transformed.
+	Measure("XMVector3TransformCoordStream", {}, count, noSetup, [&]()
+	{
+		XMVector3TransformCoordStream(transformed.data(), sizeof(XMFLOAT3), points.data(), sizeof(XMFLOAT3), count,
+			XMLoadFloat4x4(&worlds[0]));
+	});
+
+	gSink = results[count / 2]._41 + transformed[count / 2].x;
+}
+
+void CpuBenchmark::Measure(const std::string& name, std::vector<std::pair<std::string, UINT>> parameters, UINT items,
+	const std::function<void()>& setup, const std::function<void()>& body)
+{
+	// Warm up.
+	setup();
+	body();
+
+	std::vector<double> samples;
+	double total = 0.0;
+	while(samples.size() < MaxIterations && (samples.size() < MinIterations || total < MinTimeMs))
+	{
+		setup();
+
+		double start = NowMs();
+		body();
+		double elapsed = NowMs() - start;
+
+		samples.push_back(elapsed);
+		total += elapsed;
+	}
+
+	CpuBenchmarkResult result;
+	result.Name = name;
+	result.Parameters = std::move(parameters);
+	result.Items = items;
+	result.Iterations = (UINT)samples.size();
+	result.MinMs = *std::min_element(samples.begin(), samples.end());
+
+	size_t n = samples.size() / 2;
+	std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+	result.MedianMs = samples[n];
+
+	mResults.push_back(std::move(result));
+}
@@ -0,0 +1,69 @@
+//***************************************************************************************
+// CpuBenchmark.h
+//
+// Times the CPU-side building blocks the castle leans on, without a device: the
+// GeometryGenerator shapes at several tessellations, Subdivide and GetIndices16, the
+// CPU wave simulation's Update from 128x128 to 2048x2048 on one thread and on job
+// systems of increasing size, and the MathHelper matrix routines over batches.
+//
+// Each case runs once to warm caches and allocators, then repeatedly until it has
+// run MinIterations times and for MinTimeMs, or MaxIterations times.  Setup work,
+// such as copying the mesh a case modifies, runs outside the timed region.  Results
+// are written as JSON so runs can be compared from one commit to the next.
+//***************************************************************************************
+
+#ifndef CPUBENCHMARK_H
+#define CPUBENCHMARK_H
+
+#include "../../Common/d3dUtil.h"
+#include <functional>
+
+struct CpuBenchmarkResult
+{
+	std::string Name;
+
+	// The case's parameters, such as subdivisions or thread count, by name.
+	std::vector<std::pair<std::string, UINT>> Parameters;
+
+	// Items processed per iteration, for cases over batches; otherwise 1.
+	UINT Items = 1;
+
+	UINT Iterations = 0;
+	double MedianMs = 0.0;
+	double MinMs = 0.0;
+};
+
+class CpuBenchmark
+{
+public:
+	CpuBenchmark() = default;
+	CpuBenchmark(const CpuBenchmark& rhs) = delete;
+	CpuBenchmark& operator=(const CpuBenchmark& rhs) = delete;
+
+	// Runs every case.  maxThreads caps the job systems the wave cases try; 0 goes
+	// up to the hardware thread count.
+	void Run(UINT maxThreads = 0);
+
+	const std::vector<CpuBenchmarkResult>& Results()const;
+
+	// Throws if the file cannot be opened.
+	void WriteJson(const std::wstring& filename)const;
+
+private:
+	void RunGeometry();
+	void RunWaves(UINT maxThreads);
+	void RunMath();
+
+	// Times body, calling setup before each run of it.
+	void Measure(const std::string& name, std::vector<std::pair<std::string, UINT>> parameters, UINT items,
+		const std::function<void()>& setup, const std::function<void()>& body);
+
+private:
+	static const UINT MinIterations = 5;
+	static const UINT MaxIterations = 1000;
+	static constexpr double MinTimeMs = 200.0;
+
+	std::vector<CpuBenchmarkResult> mResults;
+};
+
+#endif // CPUBENCHMARK_H
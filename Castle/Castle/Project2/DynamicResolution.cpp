@@ -0,0 +1,164 @@
+//***************************************************************************************
+// DynamicResolution.cpp
+//***************************************************************************************
+
+#include "DynamicResolution.h"
+#include "../../Common/MathHelper.h"
+
+DynamicResolution::DynamicResolution(ID3D12Device* device, DXGI_FORMAT format, const float clearColor[4])
+{
+	md3dDevice = device;
+	mFormat = format;
+	memcpy(mClearColor, clearColor, sizeof(mClearColor));
+}
+
+DynamicResolution::~DynamicResolution()
+{
+}
+
+void DynamicResolution::Resize(UINT width, UINT height)
+{
+	if(mTargetWidth == width && mTargetHeight == height)
+		return;
+
+	mTargetWidth = width;
+	mTargetHeight = height;
+	UpdateSize();
+
+	D3D12_CLEAR_VALUE optClear;
+	optClear.Format = mFormat;
+	memcpy(optClear.Color, mClearColor, sizeof(optClear.Color));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(mFormat, mTargetWidth, mTargetHeight, 1, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+		ReadState,
+		&optClear,
+		IID_PPV_ARGS(mTarget.ReleaseAndGetAddressOf())));
+}
+
+void DynamicResolution::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv)
+{
+	md3dDevice->CreateShaderResourceView(mTarget.Get(), nullptr, hCpuSrv);
+	md3dDevice->CreateRenderTargetView(mTarget.Get(), nullptr, hCpuRtv);
+
+	mSrv = hGpuSrv;
+	mRtv = hCpuRtv;
+}
+
+void DynamicResolution::SetBudgetMs(double ms)
+{
+	mBudgetMs = ms;
+}
+
+void DynamicResolution::Update(double gpuFrameMs)
+{
+	if(gpuFrameMs <= 0.0)
+		return;
+
+	float target = mScale * (float)sqrt(TargetLoad * mBudgetMs / gpuFrameMs);
+	if(gpuFrameMs > mBudgetMs)
+		mScale += DropRate * (target - mScale);
+	else if(gpuFrameMs < Headroom * mBudgetMs)
+		mScale += RaiseRate * (target - mScale);
+
+	mScale = MathHelper::Clamp(mScale, MinScale, 1.0f);
+	UpdateSize();
+}
+
+void DynamicResolution::Reset()
+{
+	mScale = 1.0f;
+	UpdateSize();
+}
+
+float DynamicResolution::Scale()const
+{
+	return mScale;
+}
+
+UINT DynamicResolution::Width()const
+{
+	return mWidth;
+}
+
+UINT DynamicResolution::Height()const
+{
+	return mHeight;
+}
+
+D3D12_VIEWPORT DynamicResolution::Viewport()const
+{
+	D3D12_VIEWPORT viewport;
+	viewport.TopLeftX = 0.0f;
+	viewport.TopLeftY = 0.0f;
+	viewport.Width = (float)mWidth;
+	viewport.Height = (float)mHeight;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	return viewport;
+}
+
+D3D12_RECT DynamicResolution::ScissorRect()const
+{
+	return { 0, 0, (LONG)mWidth, (LONG)mHeight };
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DynamicResolution::Rtv()const
+{
+	return mRtv;
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DynamicResolution::Srv()const
+{
+	return mSrv;
+}
+
+ID3D12Resource* DynamicResolution::Target()const
+{
+	return mTarget.Get();
+}
+
+void DynamicResolution::Begin(ID3D12GraphicsCommandList* cmdList)
+{
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mTarget.Get(),
+		ReadState, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+	// Only the rendered region is ever read.
+	D3D12_RECT rect = ScissorRect();
+	cmdList->ClearRenderTargetView(mRtv, mClearColor, 1, &rect);
+}
+
+void DynamicResolution::Upscale(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso, D3D12_GPU_DESCRIPTOR_HANDLE source,
+	D3D12_CPU_DESCRIPTOR_HANDLE backBuffer, const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect)
+{
+	UpscaleConstants constants;
+	constants.UVScale = DirectX::XMFLOAT2((float)mWidth / mTargetWidth, (float)mHeight / mTargetHeight);
+	// Half a texel in from the edge, where bilinear taps stop reaching outside.
+	constants.MaxUV = DirectX::XMFLOAT2((mWidth - 0.5f) / mTargetWidth, (mHeight - 0.5f) / mTargetHeight);
+	constants.TargetSize = DirectX::XMFLOAT2((float)mTargetWidth, (float)mTargetHeight);
+	constants.InvTargetSize = DirectX::XMFLOAT2(1.0f / mTargetWidth, 1.0f / mTargetHeight);
+	constants.InvOutputSize = DirectX::XMFLOAT2(1.0f / viewport.Width, 1.0f / viewport.Height);
+
+	cmdList->RSSetViewports(1, &viewport);
+	cmdList->RSSetScissorRects(1, &scissorRect);
+	cmdList->OMSetRenderTargets(1, &backBuffer, true, nullptr);
+	cmdList->SetPipelineState(pso);
+	cmdList->SetGraphicsRootSignature(rootSig);
+	cmdList->SetGraphicsRootDescriptorTable(0, source);
+	cmdList->SetGraphicsRoot32BitConstants(1, UpscaleConstantCount, &constants, 0);
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdList->DrawInstanced(3, 1, 0, 0);
+}
+
+void DynamicResolution::UpdateSize()
+{
+	mWidth = std::max(1u, (UINT)(mTargetWidth * mScale + 0.5f));
+	mHeight = std::max(1u, (UINT)(mTargetHeight * mScale + 0.5f));
+}
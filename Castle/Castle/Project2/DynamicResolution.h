@@ -0,0 +1,135 @@
+//***************************************************************************************
+// DynamicResolution.h
+//
+// Renders the scene at a fraction of the output resolution when the GPU would
+// otherwise miss its frame budget.  The scene target is allocated at the full output
+// size and the scene is drawn into its top left corner through a scaled viewport, so
+// a new scale costs nothing but a new viewport.  A full-screen pass then upscales
+// that corner to the back buffer with a Catmull-Rom filter, which keeps edges
+// sharper than bilinear filtering.
+//
+// The scale follows the GPU frame time.  Most of a frame's cost goes with its pixel
+// count, the square of the scale, so the scale aims for the square root of the ratio
+// of the budget to the time taken.  It drops quickly when a frame runs over the
+// budget and climbs back slowly while there is headroom; timings arrive a few frames
+// late, so each step only goes part of the way.
+//
+// The client draws with PSOs writing the target's format and supplies the upscale PSO
+// and root signature, whose parameter 0 is the table of the source SRV and parameter 1
+// the UpscaleConstants, with a linear clamp sampler at s0.  Like the scene, the target
+// is single sampled.  Once the scene is drawn the frame's render graph returns it to
+// ReadState, in which any shader may read it until the next Begin, so post passes can
+// work on the rendered region and hand their own copy to Upscale.
+//***************************************************************************************
+
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include "../../Common/d3dUtil.h"
+
+// Root constants of the upscale pass.  Must match cbUpscale in Upscale.hlsl.
+struct UpscaleConstants
+{
+	// Scene target uv of an output uv: the rendered size over the target size.
+	DirectX::XMFLOAT2 UVScale;
+	// Largest uv a bilinear tap may have and still only read rendered texels.
+	DirectX::XMFLOAT2 MaxUV;
+	DirectX::XMFLOAT2 TargetSize;
+	DirectX::XMFLOAT2 InvTargetSize;
+	DirectX::XMFLOAT2 InvOutputSize;
+};
+
+class DynamicResolution
+{
+public:
+	static const UINT UpscaleConstantCount = sizeof(UpscaleConstants) / 4;
+
+	// Neither axis is rendered at less than this fraction of the output.
+	static constexpr float MinScale = 0.5f;
+
+	// The target's state outside Begin and the scene's drawing.
+	static constexpr D3D12_RESOURCE_STATES ReadState =
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+	// clearColor is what Begin clears the target to.
+	DynamicResolution(ID3D12Device* device, DXGI_FORMAT format, const float clearColor[4]);
+	DynamicResolution(const DynamicResolution& rhs) = delete;
+	DynamicResolution& operator=(const DynamicResolution& rhs) = delete;
+	~DynamicResolution();
+
+	// Recreates the target at the new output size; the GPU must be done with the old
+	// one.  Call BuildDescriptors again afterwards.
+	void Resize(UINT width, UINT height);
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv);
+
+	// GPU milliseconds a frame may take.
+	void SetBudgetMs(double ms);
+
+	// Moves the scale towards what would have fit gpuFrameMs, the GPU time of a
+	// recent frame, into the budget.  Zero times are ignored.
+	void Update(double gpuFrameMs);
+
+	// Back to full resolution.
+	void Reset();
+
+	float Scale()const;
+
+	// The rendered region: the scene's render target size.
+	UINT Width()const;
+	UINT Height()const;
+	D3D12_VIEWPORT Viewport()const;
+	D3D12_RECT ScissorRect()const;
+
+	D3D12_CPU_DESCRIPTOR_HANDLE Rtv()const;
+	D3D12_GPU_DESCRIPTOR_HANDLE Srv()const;
+
+	// For importing into the render graph, which leaves it in RENDER_TARGET after Begin.
+	ID3D12Resource* Target()const;
+
+	// Makes the target writable and clears it.
+	void Begin(ID3D12GraphicsCommandList* cmdList);
+
+	// Filters the rendered region of source, the SRV of the target or of a texture
+	// of the same size, up to fill backBuffer through viewport.  The descriptor heap
+	// of the SRV must be set.  Leaves backBuffer bound without a depth buffer.
+	void Upscale(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso, D3D12_GPU_DESCRIPTOR_HANDLE source,
+		D3D12_CPU_DESCRIPTOR_HANDLE backBuffer, const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect);
+
+private:
+	void UpdateSize();
+
+private:
+	// Steps over the budget and under the headroom go this far towards the target.
+	static constexpr float DropRate = 0.5f;
+	static constexpr float RaiseRate = 0.05f;
+
+	// The scale aims for this fraction of the budget, and is only raised once a
+	// frame takes less than Headroom of it, so it does not hunt around the target.
+	static constexpr double TargetLoad = 0.9;
+	static constexpr double Headroom = 0.8;
+
+	ID3D12Device* md3dDevice = nullptr;
+	DXGI_FORMAT mFormat = DXGI_FORMAT_UNKNOWN;
+	float mClearColor[4];
+
+	UINT mTargetWidth = 0;
+	UINT mTargetHeight = 0;
+
+	double mBudgetMs = 1000.0 / 60.0;
+	float mScale = 1.0f;
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mSrv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mRtv;
+
+	// In ReadState until Begin.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mTarget = nullptr;
+};
+
+#endif // DYNAMICRESOLUTION_H
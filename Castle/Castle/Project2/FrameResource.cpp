@@ -1,17 +1,55 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount, UINT waveVertCount,
+    UINT lightCount, UINT workerCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-  //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    WorkerCmdListAllocs.resize(workerCount);
+    WorkerCmdLists.resize(workerCount);
+    for(UINT i = 0; i < workerCount; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(WorkerCmdListAllocs[i].GetAddressOf())));
 
-    WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+        ThrowIfFailed(device->CreateCommandList(
+            0,
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            WorkerCmdListAllocs[i].Get(),
+            nullptr,
+            IID_PPV_ARGS(WorkerCmdLists[i].GetAddressOf())));
+
+        // Start off closed; the first use resets the list.
+        WorkerCmdLists[i]->Close();
+    }
+
+    ThrowIfFailed(device->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_COMPUTE,
+        IID_PPV_ARGS(ComputeCmdListAlloc.GetAddressOf())));
+
+    ThrowIfFailed(device->CreateCommandList(
+        0,
+        D3D12_COMMAND_LIST_TYPE_COMPUTE,
+        ComputeCmdListAlloc.Get(),
+        nullptr,
+        IID_PPV_ARGS(ComputeCmdList.GetAddressOf())));
+    ComputeCmdList->Close();
+
+    // Size the first page for the initial scene; the allocator grows if it changes.
+    UINT64 pageSize =
+        (UINT64)passCount*d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants)) +
+        (UINT64)objectCount*d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants)) +
+        (UINT64)materialCount*d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants)) +
+        (UINT64)instanceCount*sizeof(InstanceData) +
+        (UINT64)waveVertCount*sizeof(Vertex) +
+        (UINT64)lightCount*sizeof(Light) +
+        (UINT64)objectCount*sizeof(IndirectCommand) +
+        (UINT64)objectCount*sizeof(OcclusionCandidate) +
+        8*D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+    UploadAlloc = std::make_unique<LinearAllocator>(device, pageSize);
 }
 
 FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
@@ -20,14 +58,61 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-	//  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-	MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
-
+	UINT64 pageSize =
+		(UINT64)passCount*d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants)) +
+		(UINT64)objectCount*d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants)) +
+		(UINT64)materialCount*d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants)) +
+		(UINT64)objectCount*sizeof(IndirectCommand) +
+		4*D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+	UploadAlloc = std::make_unique<LinearAllocator>(device, pageSize);
 }
 
 FrameResource::~FrameResource()
 {
 
+}
+
+void FrameResource::AllocateFrameData(UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount, UINT waveVertCount,
+	UINT lightCount, UINT shadowInstanceCount, bool structuredConstants, bool visibilityBuffer)
+{
+	D3D12_GPU_VIRTUAL_ADDRESS prevObjectCB = ObjectCB.GpuAddress();
+	D3D12_GPU_VIRTUAL_ADDRESS prevMaterialCB = MaterialCB.GpuAddress();
+	D3D12_GPU_VIRTUAL_ADDRESS prevWavesVB = WavesVB.GpuAddress();
+	D3D12_GPU_VIRTUAL_ADDRESS prevPassCB = PassCB.GpuAddress();
+
+	UploadAlloc->Reset();
+	Arena.Reset();
+
+	// Slices whose contents persist across frames come first, so a change in
+	// the per-frame instance count cannot move them.
+	if(structuredConstants)
+	{
+		ObjectCB = UploadAlloc->AllocateArray<ObjectConstants>(objectCount);
+		MaterialCB = UploadAlloc->AllocateArray<MaterialConstants>(materialCount);
+	}
+	else
+	{
+		ObjectCB = UploadAlloc->AllocateConstants<ObjectConstants>(objectCount);
+		MaterialCB = UploadAlloc->AllocateConstants<MaterialConstants>(materialCount);
+	}
+	WavesVB = UploadAlloc->AllocateArray<Vertex>(waveVertCount);
+	PassCB = UploadAlloc->AllocateConstants<PassConstants>(passCount);
+	InstanceBuffer = UploadAlloc->AllocateArray<InstanceData>(instanceCount);
+	ShadowInstances = UploadAlloc->AllocateArray<InstanceData>(shadowInstanceCount);
+	LocalLights = UploadAlloc->AllocateArray<Light>(lightCount);
+
+	// At most one indirect command per render item.
+	IndirectArgs = UploadAlloc->AllocateArray<IndirectCommand>(structuredConstants ? 0 : objectCount);
+	StructuredIndirectArgs = UploadAlloc->AllocateArray<StructuredIndirectCommand>(structuredConstants ? objectCount : 0);
+	OcclusionCandidates = UploadAlloc->AllocateArray<OcclusionCandidate>(objectCount);
+	VisibilityGeometries = UploadAlloc->AllocateArray<VisibilityGeometry>(visibilityBuffer ? objectCount : 0);
+
+	// PassCB follows the persistent slices, so it also moves if any of their
+	// sizes changed.  The first frame compares against null addresses.
+	FrameDataMoved = ObjectCB.GpuAddress() != prevObjectCB ||
+		MaterialCB.GpuAddress() != prevMaterialCB ||
+		PassCB.GpuAddress() != prevPassCB;
+
+	if(FrameDataMoved || WavesVB.GpuAddress() != prevWavesVB)
+		std::fill(WavesPatchRevisions.begin(), WavesPatchRevisions.end(), 0);
 }
\ No newline at end of file
@@ -3,11 +3,36 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include <DirectXPackedVector.h>
+#include "../../Common/LinearAllocator.h"
+#include "../../Common/FrameArena.h"
+#include "OcclusionCulling.h"
+#include "CascadedShadowMaps.h"
 
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	DirectX::XMFLOAT2 DisplacementMapTexelSize = { 1.0f, 1.0f };
+	float GridSpatialStep = 1.0f;
+
+	// Read from the object data in structured constants mode, where a draw passes
+	// nothing but the object's index.
+	UINT MaterialIndex = 0;
+
+	// The geometry's position decode, used by the compact vertex shaders.
+	DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
+	float ObjectPad0 = 0.0f;
+	DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+	float ObjectPad1 = 0.0f;
+};
+
+// Per-instance data read by the vertex shader from a structured buffer when
+// drawing with INSTANCING defined.  Matrices are stored transposed, as for ObjectConstants.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 };
 
 struct PassConstants
@@ -32,13 +57,62 @@ struct PassConstants
 	DirectX::XMFLOAT4 FogColor = { 0.7f, 0.7f, 0.7f, 1.0f };
 	float gFogStart = 5.0f;
 	float gFogRange = 150.0f;
-	DirectX::XMFLOAT2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
+	// ClusteredLighting::DepthSliceScaleBias.
+	DirectX::XMFLOAT2 ClusterDepthScaleBias = { 0.0f, 0.0f };
+
+    // Indices [0, NUM_DIR_LIGHTS) are directional lights.  Point and spot lights
+    // are in LocalLights and binned by ClusteredLighting.
     Light Lights[MaxLights];
+
+	// Shadows of Lights[0] from CascadedShadowMaps: world to shadow map space and the
+	// view depth reached by each cascade, and the world size of a texel in each for
+	// the normal offset.  ShadowCascadeCount is 0 with shadows off.
+	DirectX::XMFLOAT4X4 ShadowTransforms[CascadedShadowMaps::CascadeCount];
+	DirectX::XMFLOAT4 CascadeSplits = { 0.0f, 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT4 ShadowTexelWorldSizes = { 0.0f, 0.0f, 0.0f, 0.0f };
+	UINT ShadowCascadeCount = 0;
+	UINT DynamicShadowCascadeCount = 0;
+	float StaticShadowTexelSize = 0.0f;
+	float DynamicShadowTexelSize = 0.0f;
+};
+
+// Layout of one record in the ExecuteIndirect argument buffer.  The member order
+// must match the D3D12_INDIRECT_ARGUMENT_DESC array used to build the command
+// signature: object CBV (root slot 1), material CBV (root slot 3), VB, IB, draw.
+struct IndirectCommand
+{
+    D3D12_GPU_VIRTUAL_ADDRESS ObjectCBV;
+    D3D12_GPU_VIRTUAL_ADDRESS MaterialCBV;
+    D3D12_VERTEX_BUFFER_VIEW VertexBufferView;
+    D3D12_INDEX_BUFFER_VIEW IndexBufferView;
+    D3D12_DRAW_INDEXED_ARGUMENTS DrawArguments;
+};
+
+// The same for structured constants mode: VB, IB, object index (root constant in
+// slot 1), draw.  The index sits after the views so every member is at its natural
+// offset without padding.
+struct StructuredIndirectCommand
+{
+    D3D12_VERTEX_BUFFER_VIEW VertexBufferView;
+    D3D12_INDEX_BUFFER_VIEW IndexBufferView;
+    UINT ObjectIndex;
+    D3D12_DRAW_INDEXED_ARGUMENTS DrawArguments;
+};
+
+// Where the visibility buffer's resolve finds the triangles an opaque object's draw
+// covers this frame: the geometry heap buffers, by their index in the resolve's
+// table, and byte offsets of the draw's base vertex and first index.  Must match
+// VisibilityGeometry in VisibilityBuffer.hlsl.
+struct VisibilityGeometry
+{
+	UINT VertexBuffer;
+	UINT VertexOffset;
+	UINT IndexBuffer;
+	UINT IndexOffset;
+	UINT VertexFormat;
+	UINT IndexSize;
+	UINT GeometryPad[2];
 };
 
 struct Vertex
@@ -48,32 +122,123 @@ struct Vertex
 	DirectX::XMFLOAT2 TexC;
 };
 
+// Vertex layouts a MeshGeometry can be stored in, as MeshGeometry::VertexFormat.
+enum class VertexFormat : UINT
+{
+	Full = 0,
+	Compact,
+	Quantized,
+	Count
+};
+
+// 20 bytes: the normal octahedral encoded to two snorms and half precision
+// texture coordinates.
+struct CompactVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::PackedVector::XMSHORTN2 Normal;
+	DirectX::PackedVector::XMHALF2 TexC;
+};
+
+// 16 bytes: as CompactVertex, with the position normalized to the geometry's
+// bounds.  The fourth position component is unused.
+struct QuantizedVertex
+{
+	DirectX::PackedVector::XMSHORTN4 Pos;
+	DirectX::PackedVector::XMSHORTN2 Normal;
+	DirectX::PackedVector::XMHALF2 TexC;
+};
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
 struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount, UINT waveVertCount,
+        UINT lightCount, UINT workerCount);
 	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
 
+    // Resets UploadAlloc and Arena and carves this frame's slices out of it.  Call once the
+    // GPU has passed Fence.  The counts may differ from frame to frame.  With
+    // structuredConstants the object and material constants are packed tightly, to
+    // be read as structured buffers, rather than padded to 256 bytes for root CBVs.
+    // visibilityBuffer allocates VisibilityGeometries.
+    void AllocateFrameData(UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount, UINT waveVertCount,
+        UINT lightCount, UINT shadowInstanceCount, bool structuredConstants, bool visibilityBuffer);
+
     // We cannot reset the allocator until the GPU is done processing the commands.
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // One allocator and command list per recording worker, so the workers can
+    // reset and record without sharing anything.  The lists are created closed.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> WorkerCmdLists;
+
+    // For the passes run on the compute queue, created closed.  The direct queue
+    // waits on the compute work of its frame, so reaching Fence frees these too.
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> ComputeCmdListAlloc;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> ComputeCmdList;
+
     // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
-   // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
-
-    // We cannot update a dynamic vertex buffer until the GPU is done processing
-    // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    // that reference it.  So each frame needs their own cbuffers.  All of this
+    // frame's dynamic data is sliced from one persistently mapped upload allocator.
+    std::unique_ptr<LinearAllocator> UploadAlloc;
+
+    // CPU scratch for the frame's transient containers, on the main thread only.
+    FrameArena Arena;
+
+    UploadSlice<PassConstants> PassCB;
+    UploadSlice<MaterialConstants> MaterialCB;
+    UploadSlice<ObjectConstants> ObjectCB;
+
+    // Visible instances of every instanced render item, rewritten each frame.
+    UploadSlice<InstanceData> InstanceBuffer;
+
+    // Instances drawn into the shadow maps redrawn this frame, cascade by cascade.
+    UploadSlice<InstanceData> ShadowInstances;
+
+    // Point and spot lights, rewritten each frame; read by the light culling pass
+    // and the pixel shader.
+    UploadSlice<Light> LocalLights;
+
+    // Empty when the waves are simulated on the GPU.
+    UploadSlice<Vertex> WavesVB;
+
+    // Per water patch, the app's water revision last written to the patch's
+    // vertices in WavesVB; 0 for never.
+    std::vector<UINT64> WavesPatchRevisions;
+
+    // Argument buffer consumed by ExecuteIndirect.  It references this frame's
+    // object/material cbuffers, so it is rebuilt per frame like they are.  Only
+    // the one for the current constants mode is allocated.
+    UploadSlice<IndirectCommand> IndirectArgs;
+    UploadSlice<StructuredIndirectCommand> StructuredIndirectArgs;
+
+    // World bounds and batch of every Opaque command, in command order, for the
+    // occlusion culling pass.
+    UploadSlice<OcclusionCandidate> OcclusionCandidates;
+
+    // By object index, for the opaque objects drawn into the visibility buffer;
+    // empty without it.
+    UploadSlice<VisibilityGeometry> VisibilityGeometries;
+
+    // ObjCBIndex and MatCBIndex of the render items and materials modified since
+    // this frame resource last wrote their constants, each listed once.  Only these
+    // are written, unless FrameDataMoved.
+    std::vector<UINT> DirtyObjects;
+    std::vector<UINT> DirtyMaterials;
+
+    // The slices are requested in the same order every frame, so they land where
+    // they did the last time this frame resource was used and the data written
+    // then is still valid.  Set when the persistent slices moved (a count changed
+    // or the allocator grew) and the object and material constants have to be
+    // rewritten in full.
+    bool FrameDataMoved = true;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
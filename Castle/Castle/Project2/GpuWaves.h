@@ -0,0 +1,99 @@
+//***************************************************************************************
+// GpuWaves.h
+//
+// Performs the calculations for the wave simulation with compute shaders on the GPU.
+// The solution is kept in floating-point textures that are ping-ponged every step.
+// The client binds DisplacementMap() as a SRV and displaces a static grid in the
+// vertex shader.  This class only does the calculations, it does not do any drawing.
+//***************************************************************************************
+
+#ifndef GPUWAVES_H
+#define GPUWAVES_H
+
+#include "../../Common/d3dUtil.h"
+
+class GpuWaves
+{
+public:
+	// Note that m,n should be divisible by 16 so there is no
+	// remainder when we divide into thread groups.
+	GpuWaves(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		int m, int n, float dx, float dt, float speed, float damping);
+	GpuWaves(const GpuWaves& rhs) = delete;
+	GpuWaves& operator=(const GpuWaves& rhs) = delete;
+	~GpuWaves();
+
+	int RowCount()const;
+	int ColumnCount()const;
+	int VertexCount()const;
+	int TriangleCount()const;
+	float Width()const;
+	float Depth()const;
+	float SpatialStep()const;
+	float TimeStep()const;
+
+	// SRV of the current solution.  Changes after every simulation step.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE DisplacementMap()const;
+
+	// Number of consecutive CBV_SRV_UAV descriptors BuildDescriptors fills.
+	UINT DescriptorCount()const;
+
+	// The three solution textures, in no particular order.
+	std::array<ID3D12Resource*, 3> Resources()const;
+
+	// Call once the commands recorded by the constructor have executed.
+	void ReleaseUploadBuffers();
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Both record into cmdList, whose descriptor heap must already be set.  On
+	// return the current solution is readable by non-pixel shaders again.  Step
+	// advances the solution by one time step; the caller decides when.
+	void Step(ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig, ID3D12PipelineState* pso);
+	void Disturb(ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+		UINT i, UINT j, float magnitude);
+
+private:
+	void BuildResources(ID3D12GraphicsCommandList* cmdList);
+
+private:
+	int mNumRows = 0;
+	int mNumCols = 0;
+
+	int mVertexCount = 0;
+	int mTriangleCount = 0;
+
+	// Simulation constants we can precompute.
+	float mK[3];
+
+	float mTimeStep = 0.0f;
+	float mSpatialStep = 0.0f;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolSrv;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolUav;
+
+	// Two for ping-ponging the textures plus one for the new solution.  mCurrSol
+	// rests in NON_PIXEL_SHADER_RESOURCE, the other two in UNORDERED_ACCESS.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mNextSol = nullptr;
+
+	// Zero-filled initial data; must stay alive until the init commands execute.
+	// Dropped by ReleaseUploadBuffers.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevUploadBuffer = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrUploadBuffer = nullptr;
+};
+
+#endif // GPUWAVES_H
@@ -0,0 +1,104 @@
+//***************************************************************************************
+// MipFeedback.cpp
+//***************************************************************************************
+
+#include "MipFeedback.h"
+
+using Microsoft::WRL::ComPtr;
+
+MipFeedback::MipFeedback(ID3D12Device* device, UINT textureCount, UINT frameCount)
+	: mTextureCount(textureCount)
+{
+	const UINT64 size = sizeof(UINT)*textureCount;
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		nullptr,
+		IID_PPV_ARGS(&mRequests)));
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mClear)));
+
+	UINT* clear = nullptr;
+	ThrowIfFailed(mClear->Map(0, nullptr, reinterpret_cast<void**>(&clear)));
+	std::fill(clear, clear + textureCount, NoRequest);
+	mClear->Unmap(0, nullptr);
+
+	mReadback.resize(frameCount);
+	mReadbackData.resize(frameCount, nullptr);
+	mWritten.resize(frameCount, false);
+	for(UINT i = 0; i < frameCount; ++i)
+	{
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(size),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&mReadback[i])));
+
+		void* data = nullptr;
+		ThrowIfFailed(mReadback[i]->Map(0, nullptr, &data));
+		mReadbackData[i] = static_cast<const UINT*>(data);
+	}
+}
+
+MipFeedback::~MipFeedback()
+{
+	for(auto& readback : mReadback)
+		readback->Unmap(0, nullptr);
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS MipFeedback::RequestAddress()const
+{
+	return mRequests->GetGPUVirtualAddress();
+}
+
+const UINT* MipFeedback::Requests(UINT frame)const
+{
+	return mWritten[frame] ? mReadbackData[frame] : nullptr;
+}
+
+void MipFeedback::BeginFrame(ID3D12GraphicsCommandList* cmdList, UINT frame)
+{
+	const UINT64 size = sizeof(UINT)*mTextureCount;
+
+	// Before the first clear the buffer holds nothing worth reading.
+	if(mCleared)
+	{
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mRequests.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+		cmdList->CopyBufferRegion(mReadback[frame].Get(), 0, mRequests.Get(), 0, size);
+
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mRequests.Get(),
+			D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+		mWritten[frame] = true;
+	}
+	else
+	{
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mRequests.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST));
+	}
+
+	cmdList->CopyBufferRegion(mRequests.Get(), 0, mClear.Get(), 0, size);
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mRequests.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+	mCleared = true;
+}
+
+std::vector<ID3D12Resource*> MipFeedback::Resources()const
+{
+	std::vector<ID3D12Resource*> resources = { mRequests.Get(), mClear.Get() };
+	for(auto& readback : mReadback)
+		resources.push_back(readback.Get());
+	return resources;
+}
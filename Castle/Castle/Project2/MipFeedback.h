@@ -0,0 +1,60 @@
+//***************************************************************************************
+// MipFeedback.h
+//
+// Collects, per texture, the finest mip the pixel shader sampled in a frame, for
+// TiledTextureStreamer.  The shader computes the level of detail it would have
+// sampled at and keeps the minimum per texture with InterlockedMin into a buffer of
+// one uint per texture, so a request costs no more than a UAV write, and only for one
+// pixel in each 8x8 block.
+//
+// At the start of each frame the buffer, holding what the previous frame asked for,
+// is copied into the frame resource's readback buffer and cleared to NoRequest.  The
+// client reads the readback once it has waited for the frame resource, so requests
+// arrive gNumFrameResources frames late, which the streamer's tile uploads dwarf
+// anyway.  The buffer rests in UNORDERED_ACCESS.
+//***************************************************************************************
+
+#ifndef MIPFEEDBACK_H
+#define MIPFEEDBACK_H
+
+#include "../../Common/d3dUtil.h"
+
+class MipFeedback
+{
+public:
+	// A texture nothing sampled.
+	static const UINT NoRequest = 0xffffffff;
+
+	MipFeedback(ID3D12Device* device, UINT textureCount, UINT frameCount);
+	MipFeedback(const MipFeedback& rhs) = delete;
+	MipFeedback& operator=(const MipFeedback& rhs) = delete;
+	~MipFeedback();
+
+	// For the pixel shader's root UAV.
+	D3D12_GPU_VIRTUAL_ADDRESS RequestAddress()const;
+
+	// Each texture's finest requested mip, as copied out by the last BeginFrame with
+	// frame, or nullptr if there was none.  The frame's commands must have executed.
+	const UINT* Requests(UINT frame)const;
+
+	// Copies the requests out to frame's readback buffer and clears them.
+	void BeginFrame(ID3D12GraphicsCommandList* cmdList, UINT frame);
+
+	// The buffers, for residency tracking.
+	std::vector<ID3D12Resource*> Resources()const;
+
+private:
+	UINT mTextureCount = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mRequests;
+	// NoRequest for every texture; the source of the clear.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mClear;
+
+	// Persistently mapped.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mReadback;
+	std::vector<const UINT*> mReadbackData;
+	std::vector<bool> mWritten;
+	bool mCleared = false;
+};
+
+#endif // MIPFEEDBACK_H
@@ -0,0 +1,317 @@
+//***************************************************************************************
+// OcclusionCulling.cpp
+//***************************************************************************************
+
+#include "OcclusionCulling.h"
+#include <cassert>
+
+using namespace DirectX;
+
+OcclusionCulling::OcclusionCulling(ID3D12Device* device, UINT maxCommands, UINT commandStride)
+{
+	assert(maxCommands > 0 && commandStride % 4 == 0);
+
+	md3dDevice = device;
+	mMaxCommands = maxCommands;
+	mCommandStride = commandStride;
+	mPyramidViewProj = MathHelper::Identity4x4();
+
+	BuildResources();
+}
+
+OcclusionCulling::~OcclusionCulling()
+{
+}
+
+UINT OcclusionCulling::MaxCommands()const
+{
+	return mMaxCommands;
+}
+
+UINT OcclusionCulling::DescriptorCount()
+{
+	return 2*MaxMipCount + 1;
+}
+
+std::array<ID3D12Resource*, 3> OcclusionCulling::Resources()const
+{
+	return { mArguments.Get(), mCounts.Get(), mRejected.Get() };
+}
+
+void OcclusionCulling::BuildResources()
+{
+	const UINT64 argumentsByteSize = (UINT64)PhaseCount*mMaxCommands*mCommandStride;
+
+	// A batch holds at least one command, so there are no more batches than commands.
+	const UINT64 countsByteSize = (UINT64)PhaseCount*mMaxCommands*sizeof(UINT);
+
+	// Written by every cull before they are read, so none needs initial data.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(argumentsByteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+		nullptr,
+		IID_PPV_ARGS(&mArguments)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(countsByteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+		nullptr,
+		IID_PPV_ARGS(&mCounts)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer((UINT64)mMaxCommands*sizeof(UINT), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		nullptr,
+		IID_PPV_ARGS(&mRejected)));
+
+	// Kept for the life of the object; the early phase copies from it every frame.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(countsByteSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mCountsReset)));
+
+	void* mapped = nullptr;
+	ThrowIfFailed(mCountsReset->Map(0, nullptr, &mapped));
+	memset(mapped, 0, (size_t)countsByteSize);
+	mCountsReset->Unmap(0, nullptr);
+}
+
+void OcclusionCulling::Resize(ID3D12Resource* depthBuffer, UINT width, UINT height)
+{
+	mDepthBuffer = depthBuffer;
+	mDepthWidth = width;
+	mDepthHeight = height;
+
+	// Each mip halves the one above, rounding up, down to a single texel.
+	UINT mipWidth = (width + 1) / 2;
+	UINT mipHeight = (height + 1) / 2;
+	mMipCount = 1;
+	while((mipWidth > 1 || mipHeight > 1) && mMipCount < MaxMipCount)
+	{
+		mipWidth = (mipWidth + 1) / 2;
+		mipHeight = (mipHeight + 1) / 2;
+		++mMipCount;
+	}
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_FLOAT, (width + 1) / 2, (height + 1) / 2, 1, (UINT16)mMipCount,
+			1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		nullptr,
+		IID_PPV_ARGS(mPyramid.ReleaseAndGetAddressOf())));
+
+	Invalidate();
+}
+
+void OcclusionCulling::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+	UINT descriptorSize)
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+	// Unused slots past the pyramid's mips are left as they are.
+	for(UINT mip = 0; mip < mMipCount; ++mip)
+	{
+		CD3DX12_CPU_DESCRIPTOR_HANDLE srv(hCpuDescriptor, 2*mip, descriptorSize);
+		CD3DX12_CPU_DESCRIPTOR_HANDLE uav(hCpuDescriptor, 2*mip + 1, descriptorSize);
+
+		if(mip == 0)
+		{
+			// The depth half of the D24S8 depth buffer.
+			srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+			srvDesc.Texture2D.MostDetailedMip = 0;
+			md3dDevice->CreateShaderResourceView(mDepthBuffer, &srvDesc, srv);
+		}
+		else
+		{
+			srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+			srvDesc.Texture2D.MostDetailedMip = mip - 1;
+			md3dDevice->CreateShaderResourceView(mPyramid.Get(), &srvDesc, srv);
+		}
+
+		uavDesc.Texture2D.MipSlice = mip;
+		md3dDevice->CreateUnorderedAccessView(mPyramid.Get(), nullptr, &uavDesc, uav);
+
+		mReduceSrvs[mip] = CD3DX12_GPU_DESCRIPTOR_HANDLE(hGpuDescriptor, 2*mip, descriptorSize);
+		mReduceUavs[mip] = CD3DX12_GPU_DESCRIPTOR_HANDLE(hGpuDescriptor, 2*mip + 1, descriptorSize);
+	}
+
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = mMipCount;
+	md3dDevice->CreateShaderResourceView(mPyramid.Get(), &srvDesc,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(hCpuDescriptor, 2*MaxMipCount, descriptorSize));
+	mPyramidSrv = CD3DX12_GPU_DESCRIPTOR_HANDLE(hGpuDescriptor, 2*MaxMipCount, descriptorSize);
+}
+
+void OcclusionCulling::Invalidate()
+{
+	mPyramidValid = false;
+}
+
+void OcclusionCulling::Cull(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+	Phase phase, D3D12_GPU_VIRTUAL_ADDRESS commands, D3D12_GPU_VIRTUAL_ADDRESS candidates,
+	UINT firstCommand, UINT commandCount)
+{
+	assert(commandCount <= mMaxCommands);
+
+	OcclusionCullConstants constants;
+	XMStoreFloat4x4(&constants.ViewProj, XMMatrixTranspose(XMLoadFloat4x4(&mPyramidViewProj)));
+	constants.CommandCount = commandCount;
+	constants.MaxCommands = mMaxCommands;
+	constants.CommandStride = mCommandStride;
+	constants.FirstCommand = firstCommand;
+	constants.Phase = phase;
+	constants.DepthWidth = mPyramidWidth;
+	constants.DepthHeight = mPyramidHeight;
+	constants.MipCount = mMipCount;
+	constants.PyramidValid = mPyramidValid ? 1 : 0;
+
+	if(phase == Early)
+	{
+		D3D12_RESOURCE_BARRIER barriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mCounts.Get(),
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST),
+			CD3DX12_RESOURCE_BARRIER::Transition(mArguments.Get(),
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		};
+		cmdList->ResourceBarrier(_countof(barriers), barriers);
+
+		cmdList->CopyBufferRegion(mCounts.Get(), 0, mCountsReset.Get(), 0, (UINT64)PhaseCount*mMaxCommands*sizeof(UINT));
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mCounts.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+	}
+	else
+	{
+		// The early phase's draws have read both; the late phase only adds to its own
+		// half, but a buffer has one state.
+		D3D12_RESOURCE_BARRIER barriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mCounts.Get(),
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+			CD3DX12_RESOURCE_BARRIER::Transition(mArguments.Get(),
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+			// The early phase wrote the rejected flags this phase reads.
+			CD3DX12_RESOURCE_BARRIER::UAV(mRejected.Get()),
+		};
+		cmdList->ResourceBarrier(_countof(barriers), barriers);
+	}
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetComputeRoot32BitConstants(0, CullConstantCount, &constants, 0);
+	cmdList->SetComputeRootShaderResourceView(1, commands);
+	cmdList->SetComputeRootShaderResourceView(2, candidates);
+	cmdList->SetComputeRootUnorderedAccessView(3, mArguments->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(4, mCounts->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(5, mRejected->GetGPUVirtualAddress());
+	cmdList->SetComputeRootDescriptorTable(6, mPyramidSrv);
+
+	// One thread per command.
+	cmdList->Dispatch((commandCount + CullThreadGroupSize - 1) / CullThreadGroupSize, 1, 1);
+
+	D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mCounts.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+		CD3DX12_RESOURCE_BARRIER::Transition(mArguments.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+void OcclusionCulling::BuildPyramid(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+	const XMFLOAT4X4& viewProj, UINT width, UINT height)
+{
+	{
+		D3D12_RESOURCE_BARRIER barriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mDepthBuffer,
+				D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+			CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+				D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		};
+		cmdList->ResourceBarrier(_countof(barriers), barriers);
+	}
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+
+	UINT mipWidth = mDepthWidth;
+	UINT mipHeight = mDepthHeight;
+	for(UINT mip = 0; mip < mMipCount; ++mip)
+	{
+		mipWidth = (mipWidth + 1) / 2;
+		mipHeight = (mipHeight + 1) / 2;
+
+		HiZReduceConstants constants = { mipWidth, mipHeight };
+		cmdList->SetComputeRoot32BitConstants(0, ReduceConstantCount, &constants, 0);
+		cmdList->SetComputeRootDescriptorTable(1, mReduceSrvs[mip]);
+		cmdList->SetComputeRootDescriptorTable(2, mReduceUavs[mip]);
+
+		cmdList->Dispatch((mipWidth + ReduceThreadGroupSize - 1) / ReduceThreadGroupSize,
+			(mipHeight + ReduceThreadGroupSize - 1) / ReduceThreadGroupSize, 1);
+
+		// The next step reads this mip.
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, mip));
+	}
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDepthBuffer,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+
+	mPyramidViewProj = viewProj;
+	mPyramidWidth = width;
+	mPyramidHeight = height;
+	mPyramidValid = true;
+}
+
+ID3D12Resource* OcclusionCulling::Arguments()const
+{
+	return mArguments.Get();
+}
+
+UINT64 OcclusionCulling::ArgumentOffset(Phase phase, UINT batchSlot)const
+{
+	return ((UINT64)phase*mMaxCommands + batchSlot)*mCommandStride;
+}
+
+ID3D12Resource* OcclusionCulling::Counts()const
+{
+	return mCounts.Get();
+}
+
+UINT64 OcclusionCulling::CountOffset(Phase phase, UINT batch)const
+{
+	return ((UINT64)phase*mMaxCommands + batch)*sizeof(UINT);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE OcclusionCulling::PyramidSrv()const
+{
+	return mPyramidSrv;
+}
+
+UINT OcclusionCulling::MipCount()const
+{
+	return mMipCount;
+}
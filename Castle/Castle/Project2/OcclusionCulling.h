@@ -0,0 +1,183 @@
+//***************************************************************************************
+// OcclusionCulling.h
+//
+// GPU occlusion culling of a layer's indirect draws against a hierarchical depth
+// buffer, in two phases.  The early phase tests every command's world bounds against
+// the pyramid left by the previous frame and copies the survivors into an argument
+// buffer of its own; the client draws them, then BuildPyramid reduces the depth they
+// laid down into a new pyramid.  The late phase re-tests only the commands the early
+// phase rejected, against the new pyramid and the current view, so anything that
+// came into view this frame is drawn by a second pass rather than popping in a frame
+// late.  The new pyramid is kept for the next frame's early phase.
+//
+// Commands keep their batches: each phase writes a batch's survivors from the
+// batch's first slot on and counts them per batch, for ExecuteIndirect's count
+// buffer.  Like Vegetation, this class does not draw anything itself.
+//***************************************************************************************
+
+#ifndef OCCLUSIONCULLING_H
+#define OCCLUSIONCULLING_H
+
+#include "../../Common/d3dUtil.h"
+
+// Root constants of the culling pass.  Must match cbCull in OcclusionCull.hlsl.
+struct OcclusionCullConstants
+{
+	// Transposed, as in PassConstants.
+	DirectX::XMFLOAT4X4 ViewProj;
+	UINT CommandCount;
+	UINT MaxCommands;
+	UINT CommandStride;
+	UINT FirstCommand;
+	UINT Phase;
+	// The viewport the pyramid's depth was drawn into, at the depth buffer's corner.
+	UINT DepthWidth;
+	UINT DepthHeight;
+	UINT MipCount;
+	// Zero when there is no pyramid to test against; everything then survives.
+	UINT PyramidValid;
+};
+
+// Root constants of one reduction step.  Must match cbReduce in OcclusionCull.hlsl.
+struct HiZReduceConstants
+{
+	UINT DstWidth;
+	UINT DstHeight;
+};
+
+// One command of the culled layer.  Must match OcclusionCandidate in OcclusionCull.hlsl.
+struct OcclusionCandidate
+{
+	// World space bounds.
+	DirectX::XMFLOAT3 Center;
+	// The command's batch, indexing the counts.
+	UINT Batch;
+	DirectX::XMFLOAT3 Extents;
+	// Slot of the batch's first command, from the layer's first command.
+	UINT BatchSlot;
+};
+
+class OcclusionCulling
+{
+public:
+	enum Phase : UINT
+	{
+		Early = 0,
+		Late,
+		PhaseCount
+	};
+
+	// Must match CULL_THREADS and REDUCE_THREADS in OcclusionCull.hlsl.
+	static const UINT CullThreadGroupSize = 64;
+	static const UINT ReduceThreadGroupSize = 8;
+
+	// The culling root signature has the constants at 0, the commands and candidates
+	// SRVs at 1 and 2, the arguments, counts and rejected UAVs at 3 to 5 and the
+	// pyramid's SRV table at 6.  The reduction's has its constants at 0 and tables of
+	// the source SRV and destination UAV at 1 and 2, on b1, t3 and u3.
+	static const UINT CullConstantCount = sizeof(OcclusionCullConstants) / 4;
+	static const UINT ReduceConstantCount = sizeof(HiZReduceConstants) / 4;
+
+	// Enough mips for a 16384 texel wide depth buffer.
+	static const UINT MaxMipCount = 14;
+
+	// maxCommands commands of commandStride bytes each, a multiple of four.
+	OcclusionCulling(ID3D12Device* device, UINT maxCommands, UINT commandStride);
+	OcclusionCulling(const OcclusionCulling& rhs) = delete;
+	OcclusionCulling& operator=(const OcclusionCulling& rhs) = delete;
+	~OcclusionCulling();
+
+	UINT MaxCommands()const;
+
+	// Number of consecutive CBV_SRV_UAV descriptors BuildDescriptors fills.
+	static UINT DescriptorCount();
+
+	// The buffers to keep resident.
+	std::array<ID3D12Resource*, 3> Resources()const;
+
+	// Recreates the pyramid for a depth buffer of the new size, which must be typeless
+	// R24G8 and no longer in use by the GPU.  Call BuildDescriptors again afterwards.
+	void Resize(ID3D12Resource* depthBuffer, UINT width, UINT height);
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Forget the pyramid, so the next early phase keeps everything.
+	void Invalidate();
+
+	// Culls commandCount commands of commands, starting at firstCommand, whose bounds
+	// and batches are in candidates.  The early phase tests all of them against the
+	// last pyramid built; the late phase tests those the early phase rejected against
+	// the pyramid built since.  Each is tested with the view its pyramid was built
+	// with.  On return the phase's arguments and counts are readable by
+	// ExecuteIndirect; the early phase resets both phases.
+	void Cull(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+		Phase phase, D3D12_GPU_VIRTUAL_ADDRESS commands, D3D12_GPU_VIRTUAL_ADDRESS candidates,
+		UINT firstCommand, UINT commandCount);
+
+	// Reduces the depth buffer, in DEPTH_WRITE on entry and return, into the pyramid
+	// the next cull tests against.  viewProj is the transform the depth was drawn with,
+	// into a viewport of the top left width by height texels; the rest of the buffer
+	// must be cleared, so it never occludes anything.  The descriptor heap must be set.
+	void BuildPyramid(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+		const DirectX::XMFLOAT4X4& viewProj, UINT width, UINT height);
+
+	// Where a phase's commands and count for a batch starting at batchSlot are.
+	ID3D12Resource* Arguments()const;
+	UINT64 ArgumentOffset(Phase phase, UINT batchSlot)const;
+	ID3D12Resource* Counts()const;
+	UINT64 CountOffset(Phase phase, UINT batch)const;
+
+	// For other passes testing against the pyramid: an SRV of all its mips, in
+	// NON_PIXEL_SHADER_RESOURCE between BuildPyramid calls, and how many there are.
+	// Both change only on Resize.
+	D3D12_GPU_DESCRIPTOR_HANDLE PyramidSrv()const;
+	UINT MipCount()const;
+
+private:
+	void BuildResources();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mMaxCommands = 0;
+	UINT mCommandStride = 0;
+
+	UINT mDepthWidth = 0;
+	UINT mDepthHeight = 0;
+	UINT mMipCount = 0;
+
+	// The depth buffer the pyramid is built from; owned by the client.
+	ID3D12Resource* mDepthBuffer = nullptr;
+
+	// The view and viewport the pyramid was built with, and whether it holds
+	// anything yet.
+	DirectX::XMFLOAT4X4 mPyramidViewProj;
+	UINT mPyramidWidth = 0;
+	UINT mPyramidHeight = 0;
+	bool mPyramidValid = false;
+
+	// Per mip m the SRV of mip m - 1, or of the depth buffer for mip 0, and the UAV
+	// of mip m; then one SRV of every mip.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mReduceSrvs[MaxMipCount];
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mReduceUavs[MaxMipCount];
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPyramidSrv;
+
+	// Farthest depth per texel; mip 0 is half the depth buffer, rounded up.  Rests
+	// in NON_PIXEL_SHADER_RESOURCE.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPyramid = nullptr;
+
+	// Both phases' surviving commands and per batch counts, resting in
+	// INDIRECT_ARGUMENT, and per command whether the early phase rejected it, in
+	// UNORDERED_ACCESS.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mArguments = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCounts = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mRejected = nullptr;
+
+	// Zeros, copied over mCounts before every early phase.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCountsReset = nullptr;
+};
+
+#endif // OCCLUSIONCULLING_H
@@ -0,0 +1,141 @@
+//***************************************************************************************
+// OitTargets.cpp
+//***************************************************************************************
+
+#include "OitTargets.h"
+
+// Nothing drawn: no color, and the background fully revealed.
+static const float gAccumClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+static const float gRevealageClear[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+OitTargets::OitTargets(ID3D12Device* device)
+{
+	md3dDevice = device;
+}
+
+OitTargets::~OitTargets()
+{
+}
+
+void OitTargets::SetAccumulateState(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	desc.NumRenderTargets = RtvCount;
+	desc.RTVFormats[0] = AccumFormat;
+	desc.RTVFormats[1] = RevealageFormat;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+
+	desc.BlendState.IndependentBlendEnable = true;
+
+	// Sum of the weighted colors and alphas.
+	D3D12_RENDER_TARGET_BLEND_DESC& accum = desc.BlendState.RenderTarget[0];
+	accum.BlendEnable = true;
+	accum.LogicOpEnable = false;
+	accum.SrcBlend = D3D12_BLEND_ONE;
+	accum.DestBlend = D3D12_BLEND_ONE;
+	accum.BlendOp = D3D12_BLEND_OP_ADD;
+	accum.SrcBlendAlpha = D3D12_BLEND_ONE;
+	accum.DestBlendAlpha = D3D12_BLEND_ONE;
+	accum.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+	accum.LogicOp = D3D12_LOGIC_OP_NOOP;
+	accum.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+
+	// The shader writes alpha to red: dest*(1 - alpha).
+	D3D12_RENDER_TARGET_BLEND_DESC& revealage = desc.BlendState.RenderTarget[1];
+	revealage = accum;
+	revealage.SrcBlend = D3D12_BLEND_ZERO;
+	revealage.DestBlend = D3D12_BLEND_INV_SRC_COLOR;
+	revealage.SrcBlendAlpha = D3D12_BLEND_ZERO;
+	revealage.DestBlendAlpha = D3D12_BLEND_INV_SRC_ALPHA;
+	revealage.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_RED;
+
+	// Still hidden by opaque surfaces, but never hiding each other.
+	desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+}
+
+void OitTargets::Resize(UINT width, UINT height)
+{
+	if(mWidth == width && mHeight == height)
+		return;
+
+	mWidth = width;
+	mHeight = height;
+
+	auto createTarget = [this](DXGI_FORMAT format, const float* clearColor, Microsoft::WRL::ComPtr<ID3D12Resource>& target)
+	{
+		D3D12_CLEAR_VALUE optClear;
+		optClear.Format = format;
+		memcpy(optClear.Color, clearColor, sizeof(optClear.Color));
+
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(format, mWidth, mHeight, 1, 1, 1, 0,
+				D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+			D3D12_RESOURCE_STATE_RENDER_TARGET,
+			&optClear,
+			IID_PPV_ARGS(target.ReleaseAndGetAddressOf())));
+	};
+
+	createTarget(AccumFormat, gAccumClear, mAccum);
+	createTarget(RevealageFormat, gRevealageClear, mRevealage);
+}
+
+void OitTargets::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+	UINT srvDescriptorSize,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv,
+	UINT rtvDescriptorSize)
+{
+	md3dDevice->CreateShaderResourceView(mAccum.Get(), nullptr, hCpuSrv);
+	md3dDevice->CreateShaderResourceView(mRevealage.Get(), nullptr, hCpuSrv.Offset(1, srvDescriptorSize));
+
+	mRtvs = hCpuRtv;
+	mRtvDescriptorSize = rtvDescriptorSize;
+	md3dDevice->CreateRenderTargetView(mAccum.Get(), nullptr, hCpuRtv);
+	md3dDevice->CreateRenderTargetView(mRevealage.Get(), nullptr, hCpuRtv.Offset(1, rtvDescriptorSize));
+
+	mSrvs = hGpuSrv;
+}
+
+void OitTargets::Clear(ID3D12GraphicsCommandList* cmdList)
+{
+	cmdList->ClearRenderTargetView(mRtvs, gAccumClear, 0, nullptr);
+	cmdList->ClearRenderTargetView(CD3DX12_CPU_DESCRIPTOR_HANDLE(mRtvs, 1, mRtvDescriptorSize), gRevealageClear, 0, nullptr);
+}
+
+void OitTargets::Bind(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE dsv)
+{
+	// The two views are consecutive in the RTV heap.
+	cmdList->OMSetRenderTargets(RtvCount, &mRtvs, true, &dsv);
+}
+
+void OitTargets::Composite(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso, D3D12_CPU_DESCRIPTOR_HANDLE backBuffer)
+{
+	D3D12_RESOURCE_BARRIER toRead[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mAccum.Get(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(mRevealage.Get(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+	};
+	cmdList->ResourceBarrier(_countof(toRead), toRead);
+
+	cmdList->OMSetRenderTargets(1, &backBuffer, true, nullptr);
+	cmdList->SetPipelineState(pso);
+	cmdList->SetGraphicsRootSignature(rootSig);
+	cmdList->SetGraphicsRootDescriptorTable(0, mSrvs);
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdList->DrawInstanced(3, 1, 0, 0);
+
+	D3D12_RESOURCE_BARRIER toWrite[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mAccum.Get(),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
+		CD3DX12_RESOURCE_BARRIER::Transition(mRevealage.Get(),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
+	};
+	cmdList->ResourceBarrier(_countof(toWrite), toWrite);
+}
@@ -0,0 +1,79 @@
+//***************************************************************************************
+// OitTargets.h
+//
+// Render targets for weighted blended order-independent transparency (McGuire and
+// Bavoil 2013).  Blended layers draw into an accumulation target, the sum of their
+// weighted premultiplied colors, and a revealage target, the product of (1 - alpha),
+// with blending that does not depend on draw order.  A full-screen pass then
+// composites the average color over the opaque image, so translucent items need no
+// depth sorting and any number of layers costs the same.
+//
+// The client draws with PSOs set up by SetAccumulateState and supplies the composite
+// PSO and root signature, whose parameter 0 is the table of the two SRVs.  The
+// targets are single sampled, like the scene target the composite blends into, and
+// so are the PSOs SetAccumulateState sets up whatever desc held before.
+//***************************************************************************************
+
+#ifndef OITTARGETS_H
+#define OITTARGETS_H
+
+#include "../../Common/d3dUtil.h"
+
+class OitTargets
+{
+public:
+	static const DXGI_FORMAT AccumFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	static const DXGI_FORMAT RevealageFormat = DXGI_FORMAT_R16_FLOAT;
+
+	// Consecutive descriptors BuildDescriptors fills: the accumulation target first,
+	// then the revealage target.
+	static const UINT SrvCount = 2;
+	static const UINT RtvCount = 2;
+
+	OitTargets(ID3D12Device* device);
+	OitTargets(const OitTargets& rhs) = delete;
+	OitTargets& operator=(const OitTargets& rhs) = delete;
+	~OitTargets();
+
+	// Sets the render targets, sample count, blending and depth writes of desc for
+	// drawing into the targets.
+	static void SetAccumulateState(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// Recreates the targets at the new size; the GPU must be done with the old ones.
+	// Call BuildDescriptors again afterwards.
+	void Resize(UINT width, UINT height);
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+		UINT srvDescriptorSize,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv,
+		UINT rtvDescriptorSize);
+
+	// Clears both targets for a new frame.
+	void Clear(ID3D12GraphicsCommandList* cmdList);
+
+	// Binds both targets with the scene's depth buffer, to be tested but not written.
+	void Bind(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE dsv);
+
+	// Blends the transparent layers over backBuffer.  The descriptor heap of the SRVs
+	// must be set.  Leaves backBuffer bound without a depth buffer.
+	void Composite(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso, D3D12_CPU_DESCRIPTOR_HANDLE backBuffer);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mSrvs;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mRtvs;
+	UINT mRtvDescriptorSize = 0;
+
+	// Both rest in RENDER_TARGET outside Composite.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mAccum = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mRevealage = nullptr;
+};
+
+#endif // OITTARGETS_H
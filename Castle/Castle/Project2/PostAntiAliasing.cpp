@@ -0,0 +1,70 @@
+//***************************************************************************************
+// PostAntiAliasing.cpp
+//***************************************************************************************
+
+#include "PostAntiAliasing.h"
+
+PostAntiAliasing::PostAntiAliasing(ID3D12Device* device, DXGI_FORMAT format)
+{
+	md3dDevice = device;
+	mFormat = format;
+}
+
+PostAntiAliasing::~PostAntiAliasing()
+{
+}
+
+void PostAntiAliasing::Resize(UINT width, UINT height)
+{
+	mWidth = width;
+	mHeight = height;
+}
+
+D3D12_RESOURCE_DESC PostAntiAliasing::OutputDesc()const
+{
+	return CD3DX12_RESOURCE_DESC::Tex2D(mFormat, mWidth, mHeight, 1, 1, 1, 0,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+}
+
+void PostAntiAliasing::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+	UINT descriptorSize,
+	ID3D12Resource* output)
+{
+	mSrv = hGpuDescriptor;
+	mUav = hGpuDescriptor.Offset(1, descriptorSize);
+
+	md3dDevice->CreateShaderResourceView(output, nullptr, hCpuDescriptor);
+	md3dDevice->CreateUnorderedAccessView(output, nullptr, nullptr, hCpuDescriptor.Offset(1, descriptorSize));
+}
+
+void PostAntiAliasing::Apply(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+	D3D12_GPU_DESCRIPTOR_HANDLE source, UINT width, UINT height, const FxaaSettings& settings)
+{
+	assert(width <= mWidth && height <= mHeight);
+
+	FxaaConstants constants;
+	constants.Width = width;
+	constants.Height = height;
+	constants.InvTargetSize = DirectX::XMFLOAT2(1.0f / mWidth, 1.0f / mHeight);
+	constants.MaxUV = DirectX::XMFLOAT2((width - 0.5f) / mWidth, (height - 0.5f) / mHeight);
+	constants.SearchSteps = settings.SearchSteps;
+	constants.Subpixel = settings.Subpixel;
+	constants.EdgeThreshold = settings.EdgeThreshold;
+	constants.EdgeThresholdMin = settings.EdgeThresholdMin;
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetComputeRoot32BitConstants(0, ConstantCount, &constants, 0);
+	cmdList->SetComputeRootDescriptorTable(1, source);
+	cmdList->SetComputeRootDescriptorTable(2, mUav);
+
+	cmdList->Dispatch((width + ThreadGroupSize - 1) / ThreadGroupSize,
+		(height + ThreadGroupSize - 1) / ThreadGroupSize, 1);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE PostAntiAliasing::Output()const
+{
+	return mSrv;
+}
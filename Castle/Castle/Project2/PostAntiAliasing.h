@@ -0,0 +1,100 @@
+//***************************************************************************************
+// PostAntiAliasing.h
+//
+// Smooths aliased edges of the finished image in a compute pass, in the manner of
+// FXAA 3.11 (Lottes 2009).  Each pixel whose luma contrast with its neighbors is high
+// enough takes the direction of the edge through it, searches along the edge for
+// both of its ends and blends across it by how far it is from the nearer end, plus a
+// little more for isolated subpixel features.  It costs a few samples per pixel on
+// one single sampled target, where 4x MSAA would render and store four.
+//
+// The pass reads the scene at its rendered size from the corner of a target, as left
+// by DynamicResolution, and writes the same corner of its output, a transient texture
+// of the frame's render graph made from OutputDesc, which makes the barriers.  The
+// client supplies the PSO and root signature: the FxaaConstants at 0, the table of
+// the source SRV at 1 and of the output UAV at 2, with a linear clamp sampler at s0.
+//***************************************************************************************
+
+#ifndef POSTANTIALIASING_H
+#define POSTANTIALIASING_H
+
+#include "../../Common/d3dUtil.h"
+
+// Root constants of the pass.  Must match cbFxaa in Fxaa.hlsl.
+struct FxaaConstants
+{
+	UINT Width;
+	UINT Height;
+	DirectX::XMFLOAT2 InvTargetSize;
+	// Largest uv a bilinear tap may have and still only read rendered texels.
+	DirectX::XMFLOAT2 MaxUV;
+	// Steps each way along an edge before giving up on finding its end.
+	UINT SearchSteps;
+	// How strongly subpixel features are blended away, 0 to 1.
+	float Subpixel;
+	// Minimum luma contrast, relative to the brightest neighbor and absolute, of a
+	// pixel that is filtered.
+	float EdgeThreshold;
+	float EdgeThresholdMin;
+};
+
+// Presets, from cheapest to sharpest.
+struct FxaaSettings
+{
+	UINT SearchSteps;
+	float Subpixel;
+	float EdgeThreshold;
+	float EdgeThresholdMin;
+};
+
+class PostAntiAliasing
+{
+public:
+	// Must match FXAA_THREADS in Fxaa.hlsl.
+	static const UINT ThreadGroupSize = 8;
+
+	static const UINT ConstantCount = sizeof(FxaaConstants) / 4;
+
+	// Consecutive descriptors BuildDescriptors fills: the output's SRV, then its UAV.
+	static const UINT DescriptorCount = 2;
+
+	// format must support typed UAV stores.
+	PostAntiAliasing(ID3D12Device* device, DXGI_FORMAT format);
+	PostAntiAliasing(const PostAntiAliasing& rhs) = delete;
+	PostAntiAliasing& operator=(const PostAntiAliasing& rhs) = delete;
+	~PostAntiAliasing();
+
+	// Sets the size of the source target, which the output must match.
+	void Resize(UINT width, UINT height);
+
+	// Of an output the size of the source target.
+	D3D12_RESOURCE_DESC OutputDesc()const;
+
+	// Views of output, again whenever the output is replaced.
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize,
+		ID3D12Resource* output);
+
+	// Filters the top left width by height texels of source, readable by non-pixel
+	// shaders, into the output, which must be in UNORDERED_ACCESS.  The descriptor
+	// heap must be set.
+	void Apply(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+		D3D12_GPU_DESCRIPTOR_HANDLE source, UINT width, UINT height, const FxaaSettings& settings);
+
+	// SRV of the filtered image.
+	D3D12_GPU_DESCRIPTOR_HANDLE Output()const;
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	DXGI_FORMAT mFormat = DXGI_FORMAT_UNKNOWN;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mUav;
+};
+
+#endif // POSTANTIALIASING_H
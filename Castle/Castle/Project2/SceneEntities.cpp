@@ -0,0 +1,136 @@
+//***************************************************************************************
+// SceneEntities.cpp
+//***************************************************************************************
+
+#include "SceneEntities.h"
+#include "../../Common/JobSystem.h"
+
+using namespace DirectX;
+
+UINT SceneEntities::Add(const XMFLOAT4X4& world, const XMFLOAT4X4& texTransform, Handle<Material> mat)
+{
+	UINT entity = Count();
+
+	Local.push_back(world);
+	World.push_back(world);
+	Parent.push_back(-1);
+	TexTransform.push_back(texTransform);
+	LocalBounds.emplace_back();
+	Bounds.emplace_back();
+	Materials.push_back(mat);
+	DrawArgs.emplace_back();
+	DirtyFrames.push_back(0);
+
+	if(mLevels.empty())
+		mLevels.emplace_back();
+	mLevels[0].push_back(entity);
+	mDepth.push_back(0);
+	mMoved.push_back(0);
+
+	return entity;
+}
+
+UINT SceneEntities::Add(const XMFLOAT4X4& world, const XMFLOAT4X4& texTransform, Handle<Material> mat,
+	const SubmeshGeometry& submesh)
+{
+	UINT entity = Add(world, texTransform, mat);
+
+	EntityDrawArgs& args = DrawArgs[entity];
+	args.IndexCount = submesh.IndexCount;
+	args.StartIndexLocation = submesh.StartIndexLocation;
+	args.BaseVertexLocation = submesh.BaseVertexLocation;
+
+	LocalBounds[entity] = submesh.Bounds;
+	submesh.Bounds.Transform(Bounds[entity], XMLoadFloat4x4(&world));
+
+	return entity;
+}
+
+void SceneEntities::SetParent(UINT entity, UINT parent)
+{
+	// Children's depths are not revisited, so give entity its parent before
+	// anything takes entity as theirs.
+	assert(parent < entity);
+
+	auto& level = mLevels[mDepth[entity]];
+	level.erase(std::find(level.begin(), level.end(), entity));
+
+	Parent[entity] = (INT)parent;
+	mDepth[entity] = mDepth[parent] + 1;
+	if(mLevels.size() <= mDepth[entity])
+		mLevels.emplace_back();
+
+	// Kept sorted so each level is walked in memory order.
+	auto& newLevel = mLevels[mDepth[entity]];
+	newLevel.insert(std::upper_bound(newLevel.begin(), newLevel.end(), entity), entity);
+
+	mMoved[entity] = 1;
+	mAnyMoved = true;
+}
+
+void SceneEntities::SetLocal(UINT entity, const XMFLOAT4X4& local)
+{
+	Local[entity] = local;
+	mMoved[entity] = 1;
+	mAnyMoved = true;
+}
+
+void SceneEntities::UpdateTransforms(std::vector<UINT>& changed)
+{
+	changed.clear();
+	if(!mAnyMoved)
+		return;
+
+	// A level only reads the level above, which is finished, so its chunks are
+	// independent.
+	for(const auto& level : mLevels)
+	{
+		JobSystem::Shared().ParallelFor(0, (UINT)level.size(), TransformChunkSize, [this, &level](UINT i)
+		{
+			UINT entity = level[i];
+			INT parent = Parent[entity];
+			if(parent >= 0 && mMoved[parent])
+				mMoved[entity] = 1;
+			if(!mMoved[entity])
+				return;
+
+			XMMATRIX world = XMLoadFloat4x4(&Local[entity]);
+			if(parent >= 0)
+				world = XMMatrixMultiply(world, XMLoadFloat4x4(&World[parent]));
+			XMStoreFloat4x4(&World[entity], world);
+		});
+	}
+
+	for(UINT entity = 0; entity < Count(); ++entity)
+	{
+		if(mMoved[entity])
+		{
+			changed.push_back(entity);
+			mMoved[entity] = 0;
+		}
+	}
+	mAnyMoved = false;
+}
+
+UINT SceneEntities::Count()const
+{
+	return (UINT)World.size();
+}
+
+void SceneEntities::Clear()
+{
+	Local.clear();
+	World.clear();
+	Parent.clear();
+	TexTransform.clear();
+	LocalBounds.clear();
+	Bounds.clear();
+	Materials.clear();
+	DrawArgs.clear();
+	DirtyFrames.clear();
+
+	mLevels.clear();
+	mDepth.clear();
+	mMoved.clear();
+	mAnyMoved = false;
+}
@@ -0,0 +1,93 @@
+//***************************************************************************************
+// SceneEntities.h
+//
+// The per-object data the frame loop reads for every render item, one array per
+// field, indexed by entity.  Culling reads only the bounds, the constant updates only
+// the transforms and command building only the draw arguments, so each walks packed
+// arrays instead of striding over whole render items.
+//
+// An entity's index is also its slot in the object constant buffer.  Render items
+// keep what is read only once an item is drawn (geometry, instances, LODs) and name
+// their entity by ObjCBIndex.  Items are added a layer at a time, so every layer is
+// one run of entities and visits them in memory order.
+//
+// Entities may have a parent, added before them.  Local is relative to the parent and
+// World is derived from it by UpdateTransforms, one depth of the hierarchy at a time
+// with each depth split into chunks updated in parallel.
+//***************************************************************************************
+
+#ifndef SCENEENTITIES_H
+#define SCENEENTITIES_H
+
+#include "../../Common/HandleRegistry.h"
+
+// DrawIndexedInstanced parameters of an entity.
+struct EntityDrawArgs
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	INT BaseVertexLocation = 0;
+};
+
+class SceneEntities
+{
+public:
+	// Entities updated together by one task of UpdateTransforms.
+	static const UINT TransformChunkSize = 256;
+
+	// Adds a root entity and returns its index; indices follow the order of the calls.
+	// submesh supplies the draw arguments and local bounds, which otherwise stay empty.
+	UINT Add(const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& texTransform,
+		Handle<Material> mat);
+	UINT Add(const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& texTransform,
+		Handle<Material> mat, const SubmeshGeometry& submesh);
+
+	// Makes entity's Local relative to parent, which must have been added before it.
+	// Call before entity is made the parent of anything.
+	void SetParent(UINT entity, UINT parent);
+
+	void SetLocal(UINT entity, const DirectX::XMFLOAT4X4& local);
+
+	// Recomputes World for the entities moved by SetLocal or SetParent since the last
+	// call and for their descendants, and lists them all in changed, in entity order.
+	void UpdateTransforms(std::vector<UINT>& changed);
+
+	UINT Count()const;
+
+	void Clear();
+
+public:
+	// Relative to the parent, and the product of the chain of Locals.
+	std::vector<DirectX::XMFLOAT4X4> Local;
+	std::vector<DirectX::XMFLOAT4X4> World;
+	// -1 for roots.
+	std::vector<INT> Parent;
+
+	std::vector<DirectX::XMFLOAT4X4> TexTransform;
+
+	// The submesh's box in local space, and in world space.  Bounds is refreshed
+	// together with the object constants whenever World changes.
+	std::vector<DirectX::BoundingBox> LocalBounds;
+	std::vector<DirectX::BoundingBox> Bounds;
+
+	std::vector<Handle<Material>> Materials;
+
+	// Items with a level of detail chain have the level picked this frame.
+	std::vector<EntityDrawArgs> DrawArgs;
+
+	// Because we have an object cbuffer for each FrameResource, a modified entity is
+	// queued on each FrameResource's dirty list.  Bit i is set while the entity waits
+	// on frame resource i's list, so it is queued there once however often it changes.
+	std::vector<UINT> DirtyFrames;
+
+private:
+	// Entities by depth in the hierarchy; a parent is always one level up.
+	std::vector<std::vector<UINT>> mLevels;
+	std::vector<UINT> mDepth;
+
+	// Set on the entities whose World must be recomputed.
+	std::vector<UINT8> mMoved;
+	bool mAnyMoved = false;
+};
+
+#endif // SCENEENTITIES_H
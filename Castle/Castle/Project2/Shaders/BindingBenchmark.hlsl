@@ -0,0 +1,56 @@
+//***************************************************************************************
+// BindingBenchmark.hlsl
+//
+// One small triangle per object, placed and colored by the object's constants, read
+// the way the binding model being measured binds them.  Compiled once per model:
+//   MODEL_CBV            a CBV at b0, from a descriptor table or a root CBV.
+//   MODEL_BINDLESS       gObjectIndex into an unbounded CBV table.
+//   otherwise            gObjectIndex into a structured buffer, from a root constant
+//                        or an ExecuteIndirect argument.
+//***************************************************************************************
+
+// Must match BenchmarkObject.
+struct ObjectData
+{
+	float2 Offset;
+	float  Scale;
+	float  ObjectPad0;
+	float4 Color;
+};
+
+#if defined(MODEL_CBV)
+ConstantBuffer<ObjectData> gObject : register(b0);
+#define OBJECT gObject
+#else
+cbuffer cbDraw : register(b0)
+{
+	uint gObjectIndex;
+};
+#if defined(MODEL_BINDLESS)
+ConstantBuffer<ObjectData> gObjects[] : register(b0, space1);
+#else
+StructuredBuffer<ObjectData> gObjects : register(t0);
+#endif
+#define OBJECT gObjects[gObjectIndex]
+#endif
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	nointerpolation float4 Color : COLOR;
+};
+
+VertexOut VS(uint vertexID : SV_VertexID)
+{
+	const float2 corners[3] = { float2(0.0f, 1.0f), float2(1.0f, -1.0f), float2(-1.0f, -1.0f) };
+
+	VertexOut vout;
+	vout.PosH = float4(OBJECT.Offset + corners[vertexID]*OBJECT.Scale, 0.5f, 1.0f);
+	vout.Color = OBJECT.Color;
+	return vout;
+}
+
+float4 PS(VertexOut pin) : SV_Target
+{
+	return pin.Color;
+}
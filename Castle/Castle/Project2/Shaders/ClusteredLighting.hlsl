@@ -0,0 +1,37 @@
+//***************************************************************************************
+// ClusteredLighting.hlsl
+//
+// The cluster grid shared by LightCull.hlsl and Default.hlsl.  Clusters are ordered
+// x fastest, then y from the top of the screen, then depth slice.  Each record is a
+// light count followed by CLUSTER_MAX_LIGHTS light indices.  Include after
+// LightingUtil.hlsl.
+//***************************************************************************************
+
+// Must match ClusteredLighting.
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_COUNT (CLUSTER_COUNT_X*CLUSTER_COUNT_Y*CLUSTER_COUNT_Z)
+#define CLUSTER_MAX_LIGHTS 127
+#define CLUSTER_STRIDE (CLUSTER_MAX_LIGHTS + 1)
+
+// The cluster of a pixel at screenUV, in [0, 1] from the top left, and view depth,
+// or -1 beyond the last slice.  depthScaleBias maps log2 of the depth to a slice.
+int ClusterIndex(float2 screenUV, float viewDepth, float2 depthScaleBias)
+{
+	int slice = (int)floor(log2(viewDepth)*depthScaleBias.x + depthScaleBias.y);
+	if(slice >= CLUSTER_COUNT_Z)
+		return -1;
+
+	uint2 tile = min((uint2)(screenUV*float2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y)),
+		uint2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+	return (max(slice, 0)*CLUSTER_COUNT_Y + tile.y)*CLUSTER_COUNT_X + tile.x;
+}
+
+// A local light with a SpotPower of zero is a point light.
+float3 ComputeLocalLight(Light L, Material mat, float3 pos, float3 normal, float3 toEye)
+{
+	if(L.SpotPower > 0.0f)
+		return ComputeSpotLight(L, mat, pos, normal, toEye);
+	return ComputePointLight(L, mat, pos, normal, toEye);
+}
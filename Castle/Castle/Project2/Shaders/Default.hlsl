@@ -9,8 +9,9 @@
     #define NUM_DIR_LIGHTS 3
 #endif
 
+// Point and spot lights are clustered rather than in the pass constants.
 #ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 2
+    #define NUM_POINT_LIGHTS 0
 #endif
 
 #ifndef NUM_SPOT_LIGHTS
@@ -19,8 +20,35 @@
 
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
+#include "ClusteredLighting.hlsl"
 
+#ifdef BINDLESS
+// Every view in the descriptor heap; the material picks its diffuse map by index.
+Texture2D    gTextureMaps[] : register(t0, space2);
+#else
 Texture2D    gDiffuseMap : register(t0);
+#endif
+Texture2D    gDisplacementMap : register(t1);
+
+#ifdef INSTANCING
+struct InstanceData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+};
+
+// Visible instances of the current draw, in space1 so t0 stays the diffuse map.
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+#endif
+
+#ifdef VIRTUAL_TEXTURES
+// Per streamed texture, the finest mip sampled this frame; see MipFeedback.
+RWStructuredBuffer<uint> gMipRequests : register(u0, space1);
+#endif
+
+// Every local light, and per cluster the ones that reach it.
+StructuredBuffer<Light> gLocalLights   : register(t3, space1);
+StructuredBuffer<uint>  gClusterLights : register(t4, space1);
 
 
 SamplerState gsamPointWrap        : register(s0);
@@ -30,12 +58,34 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
+#ifdef SHADOWS
+// Must match CascadedShadowMaps::CascadeCount.
+#define SHADOW_CASCADES 4
+
+// One slice per cascade: the cached static casters, and the moving casters of the
+// first few cascades.
+Texture2DArray gShadowMap        : register(t2);
+Texture2DArray gDynamicShadowMap : register(t3);
+SamplerComparisonState gsamShadow : register(s6);
+#endif
+
+#ifdef STRUCTURED_CONSTANTS
+#include "StructuredConstants.hlsl"
+#else
 // Constant data that varies per frame.
 cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+	float2   gDisplacementMapTexelSize;
+	float    gGridSpatialStep;
+	uint     gMaterialIndex;
+	float3   gPositionBias;
+	float    cbPerObjectPad0;
+	float3   gPositionScale;
+	float    cbPerObjectPad3;
 };
+#endif
 
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
@@ -59,27 +109,47 @@ cbuffer cbPass : register(b1)
 	float4 gFogColor;
 	float gFogStart;
 	float gFogRange;
-	float2 cbPerObjectPad2;
+	float2 gClusterDepthScaleBias;
 
     // Indices [0, NUM_DIR_LIGHTS) are directional lights;
     // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light gLights[MaxLights];
+
+	// Shadows of gLights[0].  gShadowCascadeCount is 0 with shadows off.
+	float4x4 gShadowTransforms[4];
+	float4 gCascadeSplits;
+	float4 gShadowTexelWorldSizes;
+	uint gShadowCascadeCount;
+	uint gDynamicShadowCascadeCount;
+	float gStaticShadowTexelSize;
+	float gDynamicShadowTexelSize;
 };
 
+#ifndef STRUCTURED_CONSTANTS
 cbuffer cbMaterial : register(b2)
 {
 	float4   gDiffuseAlbedo;
     float3   gFresnelR0;
     float    gRoughness;
 	float4x4 gMatTransform;
+	uint     gDiffuseMapIndex;
+	uint     gFeedbackIndex;
+	float    gDiffuseMinLod;
+	uint     cbMaterialPad0;
 };
+#endif
 
 struct VertexIn
 {
 	float3 PosL    : POSITION;
+#ifdef COMPACT_VERTEX
+	// Octahedral encoded.
+	float2 NormalL : NORMAL;
+#else
     float3 NormalL : NORMAL;
+#endif
 	float2 TexC    : TEXCOORD;
 };
 
@@ -91,43 +161,201 @@ struct VertexOut
 	float2 TexC    : TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+#if defined(COMPACT_VERTEX) || defined(MESHLETS) || defined(VISIBILITY_RESOLVE)
+// Inverse of MathHelper::OctahedralEncode.
+float3 OctahedralDecode(float2 e)
+{
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+#endif
+
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+#ifdef COMPACT_VERTEX
+	// The decode is the identity unless the positions are quantized.
+	float3 posL = gPositionBias + vin.PosL*gPositionScale;
+	float3 normalL = OctahedralDecode(vin.NormalL);
+#else
+	float3 posL = vin.PosL;
+	float3 normalL = vin.NormalL;
+#endif
+
+#ifdef DISPLACEMENT_MAP
+	// Sample the displacement map using non-transformed [0,1]^2 tex-coords.
+	posL.y += gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC, 0.0f).r;
+
+	// Estimate normal using finite difference.
+	float du = gDisplacementMapTexelSize.x;
+	float dv = gDisplacementMapTexelSize.y;
+	float l = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC - float2(du, 0.0f), 0.0f).r;
+	float r = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC + float2(du, 0.0f), 0.0f).r;
+	float t = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC - float2(0.0f, dv), 0.0f).r;
+	float b = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC + float2(0.0f, dv), 0.0f).r;
+	normalL = normalize(float3(-r + l, 2.0f*gGridSpatialStep, b - t));
+#endif
+
+#ifdef INSTANCING
+	float4x4 world = gInstanceData[instanceID].World;
+	float4x4 texTransform = gInstanceData[instanceID].TexTransform;
+#else
+	float4x4 world = gWorld;
+	float4x4 texTransform = gTexTransform;
+#endif
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), world);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(normalL, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
 	vout.TexC = mul(texC, gMatTransform).xy;
 
     return vout;
 }
 
-float4 PS(VertexOut pin) : SV_Target
+#ifdef TERRAIN
+// Must match Terrain::TileQuads.
+#define TERRAIN_TILE_QUADS 32
+
+// Must match Terrain::Height.
+float TerrainHeight(float2 p)
 {
-    float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
-	
+	float hills =
+		14.0f*sin(0.012f*p.x)*cos(0.010f*p.y) +
+		6.0f*sin(0.031f*p.x + 1.3f)*sin(0.027f*p.y) +
+		2.0f*sin(0.093f*p.x)*cos(0.087f*p.y + 0.7f);
+
+	float shore = smoothstep(60.0f, 140.0f, length(p));
+	return -3.0f + shore*(9.0f + hills);
+}
+
+// Terrain tiles share one grid mesh in [0,1]^2; the instance world matrix scales
+// and places it, and z marks the skirt vertices hung below the edges.
+VertexOut TerrainVS(float3 gridPos : POSITION, uint instanceID : SV_InstanceID)
+{
+	VertexOut vout = (VertexOut)0.0f;
+
+	float4x4 world = gInstanceData[instanceID].World;
+	float size = world[0][0];
+
+	float3 posW = mul(float4(gridPos.x, 0.0f, gridPos.y, 1.0f), world).xyz;
+	posW.y = TerrainHeight(posW.xz) - gridPos.z*(0.05f*size + 1.0f);
+	vout.PosW = posW;
+
+	// Central differences over one grid step of this tile.
+	float e = size / TERRAIN_TILE_QUADS;
+	float l = TerrainHeight(posW.xz - float2(e, 0.0f));
+	float r = TerrainHeight(posW.xz + float2(e, 0.0f));
+	float b = TerrainHeight(posW.xz - float2(0.0f, e));
+	float t = TerrainHeight(posW.xz + float2(0.0f, e));
+	vout.NormalW = normalize(float3(l - r, 2.0f*e, b - t));
+
+	vout.PosH = mul(float4(posW, 1.0f), gViewProj);
+
+	// Texture in world space so it runs on across tiles of every size.
+	float4 texC = mul(float4(posW.xz, 0.0f, 1.0f), gInstanceData[instanceID].TexTransform);
+	vout.TexC = mul(texC, gMatTransform).xy;
+
+	return vout;
+}
+#endif
+
+float4 SampleDiffuseAlbedo(float2 texC)
+{
+#if defined(VIRTUAL_TEXTURES) && defined(BINDLESS)
+    // Mips finer than gDiffuseMinLod may not be mapped yet.
+    return gTextureMaps[gDiffuseMapIndex].Sample(gsamAnisotropicWrap, texC, int2(0, 0), gDiffuseMinLod) * gDiffuseAlbedo;
+#elif defined(VIRTUAL_TEXTURES)
+    return gDiffuseMap.Sample(gsamAnisotropicWrap, texC, int2(0, 0), gDiffuseMinLod) * gDiffuseAlbedo;
+#elif defined(BINDLESS)
+    return gTextureMaps[gDiffuseMapIndex].Sample(gsamAnisotropicWrap, texC) * gDiffuseAlbedo;
+#else
+    return gDiffuseMap.Sample(gsamAnisotropicWrap, texC) * gDiffuseAlbedo;
+#endif
+}
+
+#ifdef VIRTUAL_TEXTURES
+// Asks for the mip the diffuse map would be sampled at without the clamp.  One pixel
+// in each 8x8 block writes; neighbours mostly want the same mip.
+void RequestDiffuseMip(float2 texC, uint2 pixel)
+{
+#ifdef BINDLESS
+    float lod = gTextureMaps[gDiffuseMapIndex].CalculateLevelOfDetail(gsamAnisotropicWrap, texC);
+#else
+    float lod = gDiffuseMap.CalculateLevelOfDetail(gsamAnisotropicWrap, texC);
+#endif
+
+    if(gFeedbackIndex != 0xffffffff && ((pixel.x | pixel.y) & 7) == 0)
+        InterlockedMin(gMipRequests[gFeedbackIndex], (uint)max(lod, 0.0f));
+}
+#endif
+
 #ifdef ALPHA_TEST
-	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
-	// as possible in the shader so that we can potentially exit the
-	// shader early, thereby skipping the rest of the shader code.
-	clip(diffuseAlbedo.a - 0.1f);
+// Depth pre-pass of alpha-tested geometry.  Only the cut-outs are tested, so the
+// shading pass after it can drop its clip and keep early-Z.
+void DepthPS(VertexOut pin)
+{
+	clip(SampleDiffuseAlbedo(pin.TexC).a - 0.1f);
+}
 #endif
 
+#ifdef SHADOWS
+// Fraction of 3x3 bilinear comparison taps around uvz that are lit.
+float ShadowPCF(Texture2DArray shadowMap, float3 uvz, uint cascade, float texelSize)
+{
+    float lit = 0.0f;
+    [unroll]
+    for(int y = -1; y <= 1; ++y)
+    {
+        [unroll]
+        for(int x = -1; x <= 1; ++x)
+        {
+            float3 location = float3(uvz.xy + float2(x, y)*texelSize, cascade);
+            lit += shadowMap.SampleCmpLevelZero(gsamShadow, location, uvz.z).r;
+        }
+    }
+    return lit / 9.0f;
+}
+
+// How much of gLights[0] reaches posW, at view depth viewZ.  The point is pushed a
+// texel along its normal first, against acne where the light grazes the surface.
+float CascadeShadow(float3 posW, float3 normalW, float viewZ)
+{
+    uint cascade = (uint)dot((float4)(viewZ > gCascadeSplits), 1.0f);
+    if(cascade >= gShadowCascadeCount)
+        return 1.0f;
+
+    float3 offsetW = posW + normalW*gShadowTexelWorldSizes[cascade];
+    float3 uvz = mul(float4(offsetW, 1.0f), gShadowTransforms[cascade]).xyz;
+
+    float lit = ShadowPCF(gShadowMap, uvz, cascade, gStaticShadowTexelSize);
+    if(cascade < gDynamicShadowCascadeCount)
+        lit = min(lit, ShadowPCF(gDynamicShadowMap, uvz, cascade, gDynamicShadowTexelSize));
+    return lit;
+}
+#endif
+
+// Lit and fogged color of a surface point, with diffuseAlbedo's alpha.  pixel is the
+// point's position in the render target and viewZ its view depth, for the light
+// clusters and the shadow cascades.
+float4 ShadeSurface(float4 diffuseAlbedo, float3 posW, float3 normalW, float2 pixel, float viewZ)
+{
     // Interpolating normal can unnormalize it, so renormalize it.
-    pin.NormalW = normalize(pin.NormalW);
+    normalW = normalize(normalW);
 
     // Vector from point being lit to eye. 
-	float3 toEyeW = gEyePosW - pin.PosW;
+	float3 toEyeW = gEyePosW - posW;
 	float distToEye = length(toEyeW);
 	toEyeW /= distToEye; // normalize
 
@@ -137,8 +365,26 @@ float4 PS(VertexOut pin) : SV_Target
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+#ifdef SHADOWS
+    shadowFactor[0] = CascadeShadow(posW, normalW, viewZ);
+#endif
+    float4 directLight = ComputeLighting(gLights, mat, posW,
+        normalW, toEyeW, shadowFactor);
+
+#ifdef LOCAL_LIGHTS
+    // Only the local lights binned into this pixel's cluster.
+    int cluster = ClusterIndex(pixel*gInvRenderTargetSize, viewZ, gClusterDepthScaleBias);
+    if(cluster >= 0)
+    {
+        uint base = cluster*CLUSTER_STRIDE;
+        uint lightCount = gClusterLights[base];
+        for(uint i = 0; i < lightCount; ++i)
+        {
+            Light L = gLocalLights[gClusterLights[base + 1 + i]];
+            directLight.rgb += ComputeLocalLight(L, mat, posW, normalW, toEyeW);
+        }
+    }
+#endif
 
     float4 litColor = ambient + directLight;
 
@@ -149,8 +395,70 @@ float4 PS(VertexOut pin) : SV_Target
 
     // Common convention to take alpha from diffuse albedo.
     litColor.a = diffuseAlbedo.a;
+    return litColor;
+}
+
+#ifdef OIT
+// Weighted blended order-independent transparency: the accumulation target sums
+// weighted premultiplied colors and the revealage target multiplies in (1 - alpha).
+// Must match the blend state of OitTargets::SetAccumulateState.
+struct OitOut
+{
+    float4 Accum     : SV_Target0;
+    float  Revealage : SV_Target1;
+};
+
+OitOut PS(VertexOut pin)
+#else
+#if defined(VIRTUAL_TEXTURES) && !defined(ALPHA_TEST)
+// The request's UAV write would otherwise move the depth test after the shader.
+[earlydepthstencil]
+#endif
+float4 PS(VertexOut pin) : SV_Target
+#endif
+{
+#ifdef VIRTUAL_TEXTURES
+    RequestDiffuseMip(pin.TexC, (uint2)pin.PosH.xy);
+#endif
+    float4 diffuseAlbedo = SampleDiffuseAlbedo(pin.TexC);
+	
+#ifdef ALPHA_TEST
+	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
+	// as possible in the shader so that we can potentially exit the
+	// shader early, thereby skipping the rest of the shader code.
+	clip(diffuseAlbedo.a - 0.1f);
+#endif
 
+    // PosH.w is the view depth.
+    float4 litColor = ShadeSurface(diffuseAlbedo, pin.PosW, pin.NormalW, pin.PosH.xy, pin.PosH.w);
+
+#ifdef OIT
+    // Depth weight of McGuire and Bavoil, equation 7, on the view depth.  Nearer
+    // surfaces dominate where several overlap.
+    float viewZ = pin.PosH.w;
+    float weight = litColor.a*clamp(10.0f / (1e-5f + pow(viewZ / 5.0f, 2.0f) + pow(viewZ / 200.0f, 6.0f)), 1e-2f, 3e3f);
+
+    OitOut pout;
+    pout.Accum = float4(litColor.rgb*litColor.a, litColor.a)*weight;
+    pout.Revealage = litColor.a;
+    return pout;
+#else
     return litColor;
+#endif
 }
 
+// Must match VisibilityBuffer::TriangleBits.
+#define VISIBILITY_TRIANGLE_BITS 19
 
+// The id pass of the visibility buffer: which triangle of which object is nearest.
+// It is only drawn with structured constants, where the draw's object index is at
+// hand; the other modes build it as object 0, so one shader manifest serves them all.
+uint VisibilityPS(VertexOut pin, uint primitiveID : SV_PrimitiveID) : SV_Target
+{
+#ifdef STRUCTURED_CONSTANTS
+    uint objectIndex = gObjectIndex;
+#else
+    uint objectIndex = 0;
+#endif
+    return ((objectIndex + 1) << VISIBILITY_TRIANGLE_BITS) | primitiveID;
+}
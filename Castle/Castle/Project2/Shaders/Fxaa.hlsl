@@ -0,0 +1,185 @@
+//***************************************************************************************
+// Fxaa.hlsl
+//
+// Post-process anti-aliasing after FXAA 3.11's quality path (Lottes 2009), one
+// thread per pixel of the rendered region.  See PostAntiAliasing.h.
+//***************************************************************************************
+
+#ifndef FXAA_THREADS
+    #define FXAA_THREADS 8
+#endif
+
+Texture2D gScene : register(t0);
+RWTexture2D<float4> gOutput : register(u0);
+
+SamplerState gsamLinearClamp : register(s0);
+
+cbuffer cbFxaa : register(b0)
+{
+	uint   gWidth;
+	uint   gHeight;
+	float2 gInvTargetSize;
+	float2 gMaxUV;
+	uint   gSearchSteps;
+	float  gSubpixel;
+	float  gEdgeThreshold;
+	float  gEdgeThresholdMin;
+};
+
+// Perceptual luma: the image is not gamma encoded, so take a square root.
+float Luma(float3 color)
+{
+	return sqrt(dot(color, float3(0.299f, 0.587f, 0.114f)));
+}
+
+float LumaAt(int2 texel)
+{
+	texel = clamp(texel, int2(0, 0), int2(gWidth, gHeight) - 1);
+	return Luma(gScene.Load(int3(texel, 0)).rgb);
+}
+
+float3 SampleScene(float2 uv)
+{
+	return gScene.SampleLevel(gsamLinearClamp, min(uv, gMaxUV), 0.0f).rgb;
+}
+
+// Search steps lengthen with distance, so long near-horizontal edges are found
+// without many samples.
+float SearchStep(uint i)
+{
+	return i < 5 ? 1.0f : (i == 5 ? 1.5f : (i < 10 ? 2.0f : (i < 11 ? 4.0f : 8.0f)));
+}
+
+[numthreads(FXAA_THREADS, FXAA_THREADS, 1)]
+void FxaaCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	int2 texel = dispatchThreadID.xy;
+	if(texel.x >= (int)gWidth || texel.y >= (int)gHeight)
+		return;
+
+	float3 colorCenter = gScene.Load(int3(texel, 0)).rgb;
+	float lumaCenter = Luma(colorCenter);
+
+	// y grows downwards.
+	float lumaUp = LumaAt(texel + int2(0, -1));
+	float lumaDown = LumaAt(texel + int2(0, 1));
+	float lumaLeft = LumaAt(texel + int2(-1, 0));
+	float lumaRight = LumaAt(texel + int2(1, 0));
+
+	float lumaMin = min(lumaCenter, min(min(lumaUp, lumaDown), min(lumaLeft, lumaRight)));
+	float lumaMax = max(lumaCenter, max(max(lumaUp, lumaDown), max(lumaLeft, lumaRight)));
+	float lumaRange = lumaMax - lumaMin;
+
+	// Flat areas and faint edges are left alone.
+	if(lumaRange < max(gEdgeThresholdMin, lumaMax*gEdgeThreshold))
+	{
+		gOutput[texel] = float4(colorCenter, 1.0f);
+		return;
+	}
+
+	float lumaUpLeft = LumaAt(texel + int2(-1, -1));
+	float lumaUpRight = LumaAt(texel + int2(1, -1));
+	float lumaDownLeft = LumaAt(texel + int2(-1, 1));
+	float lumaDownRight = LumaAt(texel + int2(1, 1));
+
+	float lumaUpDown = lumaUp + lumaDown;
+	float lumaLeftRight = lumaLeft + lumaRight;
+	float lumaLeftCorners = lumaUpLeft + lumaDownLeft;
+	float lumaRightCorners = lumaUpRight + lumaDownRight;
+	float lumaUpCorners = lumaUpLeft + lumaUpRight;
+	float lumaDownCorners = lumaDownLeft + lumaDownRight;
+
+	// The edge runs along the axis with the smaller second derivative.
+	float edgeHorizontal = abs(-2.0f*lumaLeft + lumaLeftCorners) + 2.0f*abs(-2.0f*lumaCenter + lumaUpDown) +
+		abs(-2.0f*lumaRight + lumaRightCorners);
+	float edgeVertical = abs(-2.0f*lumaUp + lumaUpCorners) + 2.0f*abs(-2.0f*lumaCenter + lumaLeftRight) +
+		abs(-2.0f*lumaDown + lumaDownCorners);
+	bool isHorizontal = edgeHorizontal >= edgeVertical;
+
+	// Which side of the pixel the edge is on: the side with the steeper gradient.
+	float luma1 = isHorizontal ? lumaUp : lumaLeft;
+	float luma2 = isHorizontal ? lumaDown : lumaRight;
+	float gradient1 = luma1 - lumaCenter;
+	float gradient2 = luma2 - lumaCenter;
+	bool is1Steepest = abs(gradient1) >= abs(gradient2);
+	float gradientScaled = 0.25f*max(abs(gradient1), abs(gradient2));
+
+	float stepLength = isHorizontal ? gInvTargetSize.y : gInvTargetSize.x;
+	float lumaLocalAverage;
+	if(is1Steepest)
+	{
+		stepLength = -stepLength;
+		lumaLocalAverage = 0.5f*(luma1 + lumaCenter);
+	}
+	else
+		lumaLocalAverage = 0.5f*(luma2 + lumaCenter);
+
+	// Start on the edge itself, half a texel towards it, and walk both ways along it
+	// until the luma leaves the edge's average.
+	float2 uv = (texel + 0.5f)*gInvTargetSize;
+	float2 edgeUV = uv;
+	if(isHorizontal)
+		edgeUV.y += 0.5f*stepLength;
+	else
+		edgeUV.x += 0.5f*stepLength;
+
+	float2 offset = isHorizontal ? float2(gInvTargetSize.x, 0.0f) : float2(0.0f, gInvTargetSize.y);
+	float2 uv1 = edgeUV - offset;
+	float2 uv2 = edgeUV + offset;
+
+	float lumaEnd1 = Luma(SampleScene(uv1)) - lumaLocalAverage;
+	float lumaEnd2 = Luma(SampleScene(uv2)) - lumaLocalAverage;
+	bool reached1 = abs(lumaEnd1) >= gradientScaled;
+	bool reached2 = abs(lumaEnd2) >= gradientScaled;
+
+	if(!reached1)
+		uv1 -= offset;
+	if(!reached2)
+		uv2 += offset;
+
+	for(uint i = 2; i < gSearchSteps && !(reached1 && reached2); ++i)
+	{
+		if(!reached1)
+		{
+			lumaEnd1 = Luma(SampleScene(uv1)) - lumaLocalAverage;
+			reached1 = abs(lumaEnd1) >= gradientScaled;
+			if(!reached1)
+				uv1 -= offset*SearchStep(i);
+		}
+		if(!reached2)
+		{
+			lumaEnd2 = Luma(SampleScene(uv2)) - lumaLocalAverage;
+			reached2 = abs(lumaEnd2) >= gradientScaled;
+			if(!reached2)
+				uv2 += offset*SearchStep(i);
+		}
+	}
+
+	float distance1 = isHorizontal ? uv.x - uv1.x : uv.y - uv1.y;
+	float distance2 = isHorizontal ? uv2.x - uv.x : uv2.y - uv.y;
+	bool isDirection1 = distance1 < distance2;
+	float distanceFinal = min(distance1, distance2);
+	float edgeLength = distance1 + distance2;
+
+	// Blend across the edge by how near its end the pixel is, but only if the luma at
+	// that end varies the way the center does; otherwise the pixel is off the edge.
+	float pixelOffset = 0.5f - distanceFinal/edgeLength;
+	bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+	bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0f) != isLumaCenterSmaller;
+	float finalOffset = correctVariation ? pixelOffset : 0.0f;
+
+	// Subpixel features, like thin lines no edge search resolves, blend with the
+	// average of the neighbors.
+	float lumaAverage = (1.0f/12.0f)*(2.0f*(lumaUpDown + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+	float subpixel1 = saturate(abs(lumaAverage - lumaCenter)/lumaRange);
+	float subpixel2 = (-2.0f*subpixel1 + 3.0f)*subpixel1*subpixel1;
+	finalOffset = max(finalOffset, subpixel2*subpixel2*gSubpixel);
+
+	float2 finalUV = uv;
+	if(isHorizontal)
+		finalUV.y += finalOffset*stepLength;
+	else
+		finalUV.x += finalOffset*stepLength;
+
+	gOutput[texel] = float4(SampleScene(finalUV), 1.0f);
+}
@@ -0,0 +1,90 @@
+//***************************************************************************************
+// LightCull.hlsl
+//
+// Culling pass used by ClusteredLighting.  Each thread builds the view space bounds
+// of one cluster and tests every light's sphere of influence against them.  The
+// group brings the lights into view space a batch at a time through shared memory,
+// so each light is read and transformed once per group rather than once per thread.
+//***************************************************************************************
+
+#include "LightingUtil.hlsl"
+#include "ClusteredLighting.hlsl"
+
+// Must match ClusteredLighting::CullThreadGroupSize.
+#define CULL_THREADS 64
+
+// Must match LightCullConstants.
+cbuffer cbCull : register(b0)
+{
+	float4x4 gView;
+	float    gProjScaleX;
+	float    gProjScaleY;
+	float    gNearZ;
+	float    gFarZ;
+	uint     gLightCount;
+};
+
+StructuredBuffer<Light>  gLights        : register(t0);
+RWStructuredBuffer<uint> gClusterLights : register(u0);
+
+// View space centre and radius of the current batch of lights.
+groupshared float4 gLightSpheres[CULL_THREADS];
+
+float SliceDepth(uint slice)
+{
+	return gNearZ*pow(gFarZ / gNearZ, (float)slice / CLUSTER_COUNT_Z);
+}
+
+[numthreads(CULL_THREADS, 1, 1)]
+void CullCS(uint3 dispatchThreadID : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	uint cluster = dispatchThreadID.x;
+	bool active = cluster < CLUSTER_COUNT;
+
+	uint x = cluster % CLUSTER_COUNT_X;
+	uint y = (cluster / CLUSTER_COUNT_X) % CLUSTER_COUNT_Y;
+	uint z = cluster / (CLUSTER_COUNT_X*CLUSTER_COUNT_Y);
+
+	// The tile's corner rays at unit depth, scaled out to the slice's near and far
+	// depths.  Tile rows run down the screen, so y is flipped into NDC.
+	float2 ndcMin = float2(2.0f*x / CLUSTER_COUNT_X - 1.0f, 1.0f - 2.0f*(y + 1) / CLUSTER_COUNT_Y);
+	float2 ndcMax = float2(2.0f*(x + 1) / CLUSTER_COUNT_X - 1.0f, 1.0f - 2.0f*y / CLUSTER_COUNT_Y);
+	float2 rayMin = ndcMin / float2(gProjScaleX, gProjScaleY);
+	float2 rayMax = ndcMax / float2(gProjScaleX, gProjScaleY);
+
+	float nearDepth = SliceDepth(z);
+	float farDepth = SliceDepth(z + 1);
+	float3 boundsMin = float3(min(rayMin*nearDepth, rayMin*farDepth), nearDepth);
+	float3 boundsMax = float3(max(rayMax*nearDepth, rayMax*farDepth), farDepth);
+
+	uint base = cluster*CLUSTER_STRIDE;
+	uint count = 0;
+
+	for(uint first = 0; first < gLightCount; first += CULL_THREADS)
+	{
+		uint index = first + groupIndex;
+		if(index < gLightCount)
+		{
+			Light L = gLights[index];
+			gLightSpheres[groupIndex] = float4(mul(float4(L.Position, 1.0f), gView).xyz, L.FalloffEnd);
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		uint batchCount = min(CULL_THREADS, gLightCount - first);
+		for(uint i = 0; i < batchCount; ++i)
+		{
+			// Distance from the sphere's centre to the nearest point of the bounds.
+			float4 sphere = gLightSpheres[i];
+			float3 d = max(max(boundsMin - sphere.xyz, sphere.xyz - boundsMax), 0.0f);
+			if(active && count < CLUSTER_MAX_LIGHTS && dot(d, d) <= sphere.w*sphere.w)
+			{
+				gClusterLights[base + 1 + count] = first + i;
+				++count;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if(active)
+		gClusterLights[base] = count;
+}
@@ -0,0 +1,239 @@
+//***************************************************************************************
+// Meshlet.hlsl
+//
+// Mesh shader path of the instanced layer, compiled with the INSTANCING permutation
+// of Default.hlsl, whose PS shades what it emits.  A draw covers one submesh's
+// meshlets for a run of instances: AS runs a thread per meshlet and instance and
+// keeps the meshlets whose bounding sphere is in the frustum and in front of the
+// Hi-Z pyramid, and whose normal cone does not face wholly away from the eye.  MS
+// then emits one kept meshlet per group, transforming its vertices as VS would.
+//
+// The vertices are read raw from the geometry's own vertex buffer, in whichever
+// VertexFormat it was built with.
+//***************************************************************************************
+
+#define MESHLETS 1
+#include "Default.hlsl"
+#include "VertexFetch.hlsl"
+
+// Must match MeshletBuilder::MaxVertices and MaxPrimitives.
+#define MAX_MESHLET_VERTICES 64
+#define MAX_MESHLET_PRIMITIVES 124
+
+// Must match gMeshletGroupSize.
+#define AS_THREADS 32
+#define MS_THREADS 128
+
+// Must match Meshlet in MeshletBuilder.h.
+struct Meshlet
+{
+	uint   VertexOffset;
+	uint   VertexCount;
+	uint   PrimitiveOffset;
+	uint   PrimitiveCount;
+	float3 Center;
+	float  Radius;
+	float3 ConeApex;
+	float  ConeCutoff;
+	float3 ConeAxis;
+	float  MeshletPad;
+};
+
+// Must match MeshletConstants.
+cbuffer cbMeshlets : register(b3)
+{
+	uint gFirstMeshlet;
+	uint gMeshletCount;
+	uint gVertexFormat;
+	// The viewport the pyramid's depth was drawn into this frame, with the current
+	// view.  gPyramidValid is zero when there is none; only Hi-Z culling is skipped.
+	uint gDepthWidth;
+	uint gDepthHeight;
+	uint gMipCount;
+	uint gPyramidValid;
+};
+
+ByteAddressBuffer         gVertices       : register(t0, space4);
+StructuredBuffer<Meshlet> gMeshlets       : register(t1, space4);
+StructuredBuffer<uint>    gMeshletIndices : register(t2, space4);
+Texture2D<float>          gPyramid        : register(t3, space4);
+
+// The meshlets an AS group kept, for the instance it tested.
+struct Payload
+{
+	uint Instance;
+	uint Meshlets[AS_THREADS];
+};
+
+groupshared Payload sPayload;
+groupshared uint sKeptCount;
+
+bool InFrustum(float3 center, float radius)
+{
+	// The planes of clip space, from the columns of the view-projection.
+	float4x4 columns = transpose(gViewProj);
+	float4 planes[6] =
+	{
+		columns[3] + columns[0],
+		columns[3] - columns[0],
+		columns[3] + columns[1],
+		columns[3] - columns[1],
+		columns[2],
+		columns[3] - columns[2]
+	};
+
+	[unroll]
+	for(uint i = 0; i < 6; ++i)
+	{
+		if(dot(planes[i].xyz, center) + planes[i].w < -radius*length(planes[i].xyz))
+			return false;
+	}
+	return true;
+}
+
+// As IsVisible in OcclusionCull.hlsl, for the box around a sphere.
+bool InFrontOfPyramid(float3 center, float radius)
+{
+	float minZ = 1.0f;
+	float2 minUV = 1.0f;
+	float2 maxUV = 0.0f;
+
+	[unroll]
+	for(uint i = 0; i < 8; ++i)
+	{
+		float3 corner = center + radius*float3(
+			(i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		float4 posH = mul(float4(corner, 1.0f), gViewProj);
+
+		if(posH.w <= 0.0f)
+			return true;
+
+		float3 ndc = posH.xyz / posH.w;
+		float2 uv = float2(0.5f*ndc.x + 0.5f, 0.5f - 0.5f*ndc.y);
+		minZ = min(minZ, ndc.z);
+		minUV = min(minUV, uv);
+		maxUV = max(maxUV, uv);
+	}
+
+	minUV = saturate(minUV);
+	maxUV = saturate(maxUV);
+	if(minZ < 0.0f)
+		return true;
+
+	float2 depthSize = float2(gDepthWidth, gDepthHeight);
+	uint2 minPixel = (uint2)(minUV*depthSize);
+	uint2 maxPixel = min((uint2)(maxUV*depthSize), uint2(gDepthWidth, gDepthHeight) - 1);
+
+	uint2 size = maxPixel - minPixel + 1;
+	uint mip = (uint)clamp((int)ceil(log2((float)max(size.x, size.y))) - 1, 0, (int)gMipCount - 1);
+
+	int2 texelMin = minPixel >> (mip + 1);
+	int2 texelMax = maxPixel >> (mip + 1);
+	float maxDepth = max(
+		max(gPyramid.Load(int3(texelMin.x, texelMin.y, mip)), gPyramid.Load(int3(texelMax.x, texelMin.y, mip))),
+		max(gPyramid.Load(int3(texelMin.x, texelMax.y, mip)), gPyramid.Load(int3(texelMax.x, texelMax.y, mip))));
+
+	return minZ <= maxDepth;
+}
+
+// Whether the eye sees only back faces of the meshlet.  The test runs in local space,
+// with the eye taken there through the inverse of world; a mirroring world swaps
+// which faces are back faces, so it culls nothing.
+bool FacesAway(Meshlet meshlet, float4x4 world)
+{
+	float3 r0 = world[0].xyz;
+	float3 r1 = world[1].xyz;
+	float3 r2 = world[2].xyz;
+	float3 c0 = cross(r1, r2);
+	float det = dot(r0, c0);
+	if(det <= 0.0f)
+		return false;
+
+	float3 toEye = gEyePosW - world[3].xyz;
+	float3 eyeL = float3(dot(toEye, c0), dot(toEye, cross(r2, r0)), dot(toEye, cross(r0, r1))) / det;
+
+	return dot(normalize(meshlet.ConeApex - eyeL), meshlet.ConeAxis) >= meshlet.ConeCutoff;
+}
+
+bool MeshletVisible(Meshlet meshlet, float4x4 world)
+{
+	if(FacesAway(meshlet, world))
+		return false;
+
+	// Rows of world are the local axes; the longest scales the radius.
+	float scale = sqrt(max(max(dot(world[0].xyz, world[0].xyz), dot(world[1].xyz, world[1].xyz)),
+		dot(world[2].xyz, world[2].xyz)));
+	float3 centerW = mul(float4(meshlet.Center, 1.0f), world).xyz;
+	float radiusW = meshlet.Radius*scale;
+
+	if(!InFrustum(centerW, radiusW))
+		return false;
+
+	return gPyramidValid == 0 || InFrontOfPyramid(centerW, radiusW);
+}
+
+// Groups run along x over the meshlets and along y over the draw's instances.
+[numthreads(AS_THREADS, 1, 1)]
+void AS(uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID)
+{
+	if(groupThreadID.x == 0)
+	{
+		sKeptCount = 0;
+		sPayload.Instance = groupID.y;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	uint meshlet = groupID.x*AS_THREADS + groupThreadID.x;
+	if(meshlet < gMeshletCount &&
+		MeshletVisible(gMeshlets[gFirstMeshlet + meshlet], gInstanceData[groupID.y].World))
+	{
+		uint slot;
+		InterlockedAdd(sKeptCount, 1, slot);
+		sPayload.Meshlets[slot] = meshlet;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	DispatchMesh(sKeptCount, 1, 1, sPayload);
+}
+
+VertexOut MeshletVertex(uint vertex, uint instance)
+{
+	VertexOut vout = (VertexOut)0.0f;
+
+	float3 posL;
+	float3 normalL;
+	float2 texC;
+	FetchVertex(gVertices, 0, gVertexFormat, vertex, posL, normalL, texC);
+
+	float4x4 world = gInstanceData[instance].World;
+	float4 posW = mul(float4(posL, 1.0f), world);
+	vout.PosW = posW.xyz;
+	vout.NormalW = mul(normalL, (float3x3)world);
+	vout.PosH = mul(posW, gViewProj);
+
+	float4 texCT = mul(float4(texC, 0.0f, 1.0f), gInstanceData[instance].TexTransform);
+	vout.TexC = mul(texCT, gMatTransform).xy;
+
+	return vout;
+}
+
+[outputtopology("triangle")]
+[numthreads(MS_THREADS, 1, 1)]
+void MS(uint groupThreadID : SV_GroupThreadID, uint groupID : SV_GroupID, in payload Payload kept,
+	out vertices VertexOut verts[MAX_MESHLET_VERTICES], out indices uint3 tris[MAX_MESHLET_PRIMITIVES])
+{
+	Meshlet meshlet = gMeshlets[gFirstMeshlet + kept.Meshlets[groupID]];
+	SetMeshOutputCounts(meshlet.VertexCount, meshlet.PrimitiveCount);
+
+	if(groupThreadID < meshlet.VertexCount)
+	{
+		uint vertex = gMeshletIndices[meshlet.VertexOffset + groupThreadID];
+		verts[groupThreadID] = MeshletVertex(vertex, kept.Instance);
+	}
+
+	if(groupThreadID < meshlet.PrimitiveCount)
+	{
+		uint packed = gMeshletIndices[meshlet.PrimitiveOffset + groupThreadID];
+		tris[groupThreadID] = uint3(packed & 0x3ff, (packed >> 10) & 0x3ff, (packed >> 20) & 0x3ff);
+	}
+}
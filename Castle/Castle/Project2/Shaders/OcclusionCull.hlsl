@@ -0,0 +1,161 @@
+//***************************************************************************************
+// OcclusionCull.hlsl
+//
+// Passes used by OcclusionCulling.  ReduceCS halves the depth buffer, then each mip
+// of the pyramid in turn, keeping the farthest depth of every 2x2 block.  CullCS
+// tests one command's world bounds against the pyramid: the screen rectangle of the
+// projected box picks the mip where it covers at most 2x2 texels, and the command
+// survives unless the box's nearest depth is behind all four.
+//***************************************************************************************
+
+// Must match OcclusionCulling::CullThreadGroupSize and ReduceThreadGroupSize.
+#define CULL_THREADS 64
+#define REDUCE_THREADS 8
+
+// Must match OcclusionCulling::Phase.
+#define PHASE_EARLY 0
+
+// Must match OcclusionCandidate in OcclusionCulling.h.
+struct OcclusionCandidate
+{
+	float3 Center;
+	uint   Batch;
+	float3 Extents;
+	uint   BatchSlot;
+};
+
+// Must match OcclusionCullConstants.
+cbuffer cbCull : register(b0)
+{
+	float4x4 gViewProj;
+	uint     gCommandCount;
+	uint     gMaxCommands;
+	uint     gCommandStride;
+	uint     gFirstCommand;
+	uint     gPhase;
+	uint     gDepthWidth;
+	uint     gDepthHeight;
+	uint     gMipCount;
+	uint     gPyramidValid;
+};
+
+// Must match HiZReduceConstants.
+cbuffer cbReduce : register(b1)
+{
+	uint gDstWidth;
+	uint gDstHeight;
+};
+
+ByteAddressBuffer                    gCommands   : register(t0);
+StructuredBuffer<OcclusionCandidate> gCandidates : register(t1);
+Texture2D<float>                     gPyramid    : register(t2);
+
+RWByteAddressBuffer    gArguments : register(u0);
+RWByteAddressBuffer    gCounts    : register(u1);
+RWStructuredBuffer<uint> gRejected : register(u2);
+
+// For ReduceCS, the mip above the one being written, or the depth buffer.  Kept off
+// the culling pass's registers so neither entry point sees the other's bindings.
+Texture2D<float>   gReduceSrc : register(t3);
+RWTexture2D<float> gReduceDst : register(u3);
+
+[numthreads(REDUCE_THREADS, REDUCE_THREADS, 1)]
+void ReduceCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint2 dst = dispatchThreadID.xy;
+	if(dst.x >= gDstWidth || dst.y >= gDstHeight)
+		return;
+
+	// Loads past an odd edge return zero, which never wins the max.
+	int3 src = int3(2*dst, 0);
+	float depth = max(
+		max(gReduceSrc.Load(src), gReduceSrc.Load(src, int2(1, 0))),
+		max(gReduceSrc.Load(src, int2(0, 1)), gReduceSrc.Load(src, int2(1, 1))));
+
+	gReduceDst[dst] = depth;
+}
+
+bool IsVisible(OcclusionCandidate candidate)
+{
+	float minZ = 1.0f;
+	float2 minUV = 1.0f;
+	float2 maxUV = 0.0f;
+
+	[unroll]
+	for(uint i = 0; i < 8; ++i)
+	{
+		float3 corner = candidate.Center + candidate.Extents*float3(
+			(i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		float4 posH = mul(float4(corner, 1.0f), gViewProj);
+
+		// A box reaching behind the eye cannot be bounded on screen.
+		if(posH.w <= 0.0f)
+			return true;
+
+		float3 ndc = posH.xyz / posH.w;
+		float2 uv = float2(0.5f*ndc.x + 0.5f, 0.5f - 0.5f*ndc.y);
+		minZ = min(minZ, ndc.z);
+		minUV = min(minUV, uv);
+		maxUV = max(maxUV, uv);
+	}
+
+	// Frustum culling is left to the caller; off screen is not occluded.
+	minUV = saturate(minUV);
+	maxUV = saturate(maxUV);
+	if(minZ < 0.0f)
+		return true;
+
+	float2 depthSize = float2(gDepthWidth, gDepthHeight);
+	uint2 minPixel = (uint2)(minUV*depthSize);
+	uint2 maxPixel = min((uint2)(maxUV*depthSize), uint2(gDepthWidth, gDepthHeight) - 1);
+
+	// Mip k texels cover 2^(k+1) pixels, so the first mip whose texels are at
+	// least as wide as the rectangle spans it with two.
+	uint2 size = maxPixel - minPixel + 1;
+	uint mip = (uint)clamp((int)ceil(log2((float)max(size.x, size.y))) - 1, 0, (int)gMipCount - 1);
+
+	int2 texelMin = minPixel >> (mip + 1);
+	int2 texelMax = maxPixel >> (mip + 1);
+	float maxDepth = max(
+		max(gPyramid.Load(int3(texelMin.x, texelMin.y, mip)), gPyramid.Load(int3(texelMax.x, texelMin.y, mip))),
+		max(gPyramid.Load(int3(texelMin.x, texelMax.y, mip)), gPyramid.Load(int3(texelMax.x, texelMax.y, mip))));
+
+	return minZ <= maxDepth;
+}
+
+[numthreads(CULL_THREADS, 1, 1)]
+void CullCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint index = dispatchThreadID.x;
+	if(index >= gCommandCount)
+		return;
+
+	bool visible;
+	if(gPhase == PHASE_EARLY)
+	{
+		visible = gPyramidValid == 0 || IsVisible(gCandidates[index]);
+		gRejected[index] = visible ? 0 : 1;
+	}
+	else
+	{
+		// Whatever the early phase kept has already been drawn.
+		if(gRejected[index] == 0)
+			return;
+		visible = IsVisible(gCandidates[index]);
+	}
+
+	if(!visible)
+		return;
+
+	OcclusionCandidate candidate = gCandidates[index];
+
+	// Both phases' counts and arguments follow one another, gMaxCommands each.
+	uint phaseBase = gPhase*gMaxCommands;
+	uint slot;
+	gCounts.InterlockedAdd((phaseBase + candidate.Batch)*4, 1, slot);
+
+	uint src = (gFirstCommand + index)*gCommandStride;
+	uint dst = (phaseBase + candidate.BatchSlot + slot)*gCommandStride;
+	for(uint offset = 0; offset < gCommandStride; offset += 4)
+		gArguments.Store(dst + offset, gCommands.Load(src + offset));
+}
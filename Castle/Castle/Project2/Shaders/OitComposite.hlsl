@@ -0,0 +1,34 @@
+//***************************************************************************************
+// OitComposite.hlsl
+//
+// Resolves the weighted blended transparency targets over the opaque image.  Drawn
+// as one full-screen triangle with SRC_ALPHA, INV_SRC_ALPHA blending, so the result
+// is the average transparent color over (1 - revealage) of the background.
+//***************************************************************************************
+
+Texture2D gAccum     : register(t0);
+Texture2D gRevealage : register(t1);
+
+float4 VS(uint vertexID : SV_VertexID) : SV_Position
+{
+	// (-1,1), (3,1), (-1,-3) covers the screen.
+	float2 uv = float2((vertexID << 1) & 2, vertexID & 2);
+	return float4(uv.x*2.0f - 1.0f, 1.0f - uv.y*2.0f, 0.0f, 1.0f);
+}
+
+float4 PS(float4 posH : SV_Position) : SV_Target
+{
+	int3 texel = int3(posH.xy, 0);
+
+	// Nothing transparent covers this pixel.
+	float revealage = gRevealage.Load(texel).r;
+	clip(0.9999f - revealage);
+
+	float4 accum = gAccum.Load(texel);
+
+	// A half float sum of many bright layers can overflow.
+	if(isinf(max(max(abs(accum.r), abs(accum.g)), abs(accum.b))))
+		accum.rgb = accum.aaa;
+
+	return float4(accum.rgb / max(accum.a, 1e-5f), 1.0f - revealage);
+}
@@ -0,0 +1,71 @@
+//***************************************************************************************
+// ShadingRate.hlsl
+//
+// Builds the shading rate image of VariableRateShading, one thread per tile.  Each
+// tile walks its depth texels, takes the distance to the eye of the nearest one and
+// picks the rate for how fogged that point is, the way Default.hlsl fogs it.  Texels
+// nothing was drawn to are at the far plane and fully fogged.
+//***************************************************************************************
+
+// Must match VariableRateShading::ThreadGroupSize.
+#define RATE_THREADS 8
+
+// Must match D3D12_SHADING_RATE.
+#define SHADING_RATE_1X1 0x0
+#define SHADING_RATE_2X2 0x5
+
+Texture2D gDepth : register(t0);
+RWTexture2D<uint> gRateImage : register(u0);
+
+// Must match ShadingRateConstants.
+cbuffer cbShadingRate : register(b0)
+{
+	float4x4 gInvProj;
+	uint     gWidth;
+	uint     gHeight;
+	float    gInvWidth;
+	float    gInvHeight;
+	uint     gTileSize;
+	uint     gTilesX;
+	uint     gTilesY;
+	float    gFogStart;
+	float    gFogRange;
+	float    gHalfRateFog;
+	float    gCoarseRateFog;
+	uint     gCoarseRate;
+};
+
+[numthreads(RATE_THREADS, RATE_THREADS, 1)]
+void RateCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint2 tile = dispatchThreadID.xy;
+	if(tile.x >= gTilesX || tile.y >= gTilesY)
+		return;
+
+	uint2 first = tile*gTileSize;
+	uint2 last = min(first + gTileSize, uint2(gWidth, gHeight));
+
+	float nearest = 1.#INF;
+	for(uint y = first.y; y < last.y; ++y)
+	{
+		for(uint x = first.x; x < last.x; ++x)
+		{
+			float depth = gDepth.Load(int3(x, y, 0)).r;
+
+			// Back to view space through the viewport and projection.
+			float2 ndc = float2((x + 0.5f)*gInvWidth*2.0f - 1.0f, 1.0f - (y + 0.5f)*gInvHeight*2.0f);
+			float4 posV = mul(float4(ndc, depth, 1.0f), gInvProj);
+			nearest = min(nearest, length(posV.xyz / posV.w));
+		}
+	}
+
+	float fogAmount = saturate((nearest - gFogStart) / gFogRange);
+
+	uint rate = SHADING_RATE_1X1;
+	if(fogAmount >= gCoarseRateFog)
+		rate = gCoarseRate;
+	else if(fogAmount >= gHalfRateFog)
+		rate = SHADING_RATE_2X2;
+
+	gRateImage[tile] = rate;
+}
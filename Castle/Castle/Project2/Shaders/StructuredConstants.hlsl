@@ -0,0 +1,67 @@
+//***************************************************************************************
+// StructuredConstants.hlsl
+//
+// Object and material constants read from tightly packed structured buffers instead
+// of the cbPerObject and cbMaterial cbuffers.  Each draw passes only its object's
+// index as a root constant and the object record names its material.  The cbuffer
+// member names are defined onto the records, so shaders read them the same way in
+// both modes.
+//***************************************************************************************
+
+// Must match ObjectConstants.
+struct ObjectData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+	float2   DisplacementMapTexelSize;
+	float    GridSpatialStep;
+	uint     MaterialIndex;
+	float3   PositionBias;
+	float    ObjectPad0;
+	float3   PositionScale;
+	float    ObjectPad1;
+};
+
+// Must match MaterialConstants.
+struct MaterialData
+{
+	float4   DiffuseAlbedo;
+	float3   FresnelR0;
+	float    Roughness;
+	float4x4 MatTransform;
+	uint     DiffuseMapIndex;
+	uint     FeedbackIndex;
+	float    DiffuseMinLod;
+	uint     MaterialPad;
+};
+
+#ifdef VISIBILITY_RESOLVE
+// Set per pixel from the visibility buffer rather than per draw.
+static uint gObjectIndex;
+#else
+cbuffer cbDraw : register(b0)
+{
+	uint gObjectIndex;
+};
+#endif
+
+StructuredBuffer<ObjectData>   gObjectData   : register(t1, space1);
+StructuredBuffer<MaterialData> gMaterialData : register(t2, space1);
+
+#define gObject                    gObjectData[gObjectIndex]
+#define gMaterial                  gMaterialData[gObject.MaterialIndex]
+
+#define gWorld                     gObject.World
+#define gTexTransform              gObject.TexTransform
+#define gDisplacementMapTexelSize  gObject.DisplacementMapTexelSize
+#define gGridSpatialStep           gObject.GridSpatialStep
+#define gPositionBias              gObject.PositionBias
+#define gPositionScale             gObject.PositionScale
+
+#define gDiffuseAlbedo             gMaterial.DiffuseAlbedo
+#define gFresnelR0                 gMaterial.FresnelR0
+#define gRoughness                 gMaterial.Roughness
+#define gMatTransform              gMaterial.MatTransform
+#define gDiffuseMapIndex           gMaterial.DiffuseMapIndex
+#define gFeedbackIndex             gMaterial.FeedbackIndex
+#define gDiffuseMinLod             gMaterial.DiffuseMinLod
@@ -18,7 +18,12 @@
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 //step5
+#ifdef BINDLESS
+// The descriptor heap viewed as texture arrays; the material picks its map by index.
+Texture2DArray gTreeMapArrays[] : register(t0, space3);
+#else
 Texture2DArray gTreeMapArray : register(t0);
+#endif
 
 //you can use dynamic indexing as well. Pay attention how we changed the sampler!
 //Texture2D gTreeMapArray[3] : register(t0);
@@ -31,12 +36,16 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
+#ifdef STRUCTURED_CONSTANTS
+#include "StructuredConstants.hlsl"
+#else
 // Constant data that varies per frame.
 cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
 };
+#endif
 
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
@@ -69,112 +78,85 @@ cbuffer cbPass : register(b1)
     Light gLights[MaxLights];
 };
 
+#ifndef STRUCTURED_CONSTANTS
 cbuffer cbMaterial : register(b2)
 {
 	float4   gDiffuseAlbedo;
     float3   gFresnelR0;
     float    gRoughness;
 	float4x4 gMatTransform;
+	uint     gDiffuseMapIndex;
+	uint     gFeedbackIndex;
+	float    gDiffuseMinLod;
+	uint     cbMaterialPad0;
 };
+#endif
  
-struct VertexIn
+// Must match TreeInstance in Vegetation.h.
+struct TreeInstance
 {
-	float3 PosW  : POSITION;
-	float2 SizeW : SIZE;
+	float3 PosW;
+	float  Width;
+	float  Height;
+	uint   TextureIndex;
+	float2 Pad;
 };
 
-struct VertexOut
-{
-	float3 CenterW : POSITION;
-	float2 SizeW   : SIZE;
-};
+// The trees that survived this frame's cull, one per instance.
+StructuredBuffer<TreeInstance> gVisibleTrees : register(t0, space1);
 
-struct GeoOut
+struct VertexOut
 {
 	float4 PosH    : SV_POSITION;
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
     float2 TexC    : TEXCOORD;
-    uint   PrimID  : SV_PrimitiveID;
+    nointerpolation uint TexIndex : TEXINDEX;
 };
 
-VertexOut VS(VertexIn vin)
+// Expands each instance into a quad drawn as a four vertex strip, which takes the
+// geometry shader's place.
+VertexOut VS(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
 {
-	VertexOut vout;
-
-	// Just pass data over to geometry shader.
-	vout.CenterW = vin.PosW;
-	vout.SizeW   = vin.SizeW;
+	TreeInstance tree = gVisibleTrees[instanceID];
 
-	return vout;
-}
- 
-//step4
- // We expand each point into a quad (4 vertices), so the maximum number of vertices
- // we output per geometry shader invocation is 4.
-[maxvertexcount(4)]
-void GS(point VertexOut gin[1], //PrimitiveType InputVertexType InputName[NumElements]-> one vertex for a point, two for aline, threefor atriangle, four for line with adjacency, and six for a triangle with adjacency.
-        uint primID : SV_PrimitiveID, //inout StreamOutputObject<OutputVertexType>
-        inout TriangleStream<GeoOut> triStream)  //OutputName
-{	
 	//
 	// Compute the local coordinate system of the sprite relative to the world
 	// space such that the billboard is aligned with the y-axis and faces the eye.
 	//
 
 	float3 up = float3(0.0f, 1.0f, 0.0f);
-	float3 look = gEyePosW - gin[0].CenterW;
+	float3 look = gEyePosW - tree.PosW;
 	look.y = 0.0f; // y-axis aligned, so project to xz-plane
 	look = normalize(look);
 	float3 right = cross(up, look);
 
-	//
-	// Compute triangle strip vertices (quad) in world space.
-	//
-	float halfWidth  = 0.5f*gin[0].SizeW.x;
-	float halfHeight = 0.5f*gin[0].SizeW.y;
-	
-	float4 v[4];
-	v[0] = float4(gin[0].CenterW + halfWidth*right - halfHeight*up, 1.0f);
-	v[1] = float4(gin[0].CenterW + halfWidth*right + halfHeight*up, 1.0f);
-	v[2] = float4(gin[0].CenterW - halfWidth*right - halfHeight*up, 1.0f);
-	v[3] = float4(gin[0].CenterW - halfWidth*right + halfHeight*up, 1.0f);
+	// Strip order: right bottom, right top, left bottom, left top.
+	float side = vertexID < 2 ? 1.0f : -1.0f;
+	float top = (float)(vertexID & 1);
 
-	//
-	// Transform quad vertices to world space and output 
-	// them as a triangle strip.
-	//
-	
-	float2 texC[4] = 
-	{
-		float2(0.0f, 1.0f),
-		float2(0.0f, 0.0f),
-		float2(1.0f, 1.0f),
-		float2(1.0f, 0.0f)
-	};
-	
-	GeoOut gout;
-	[unroll]
-	for(int i = 0; i < 4; ++i)
-	{
-		gout.PosH     = mul(v[i], gViewProj);
-		gout.PosW     = v[i].xyz;
-		gout.NormalW  = look;
-		gout.TexC     = texC[i];
-		gout.PrimID   = primID;
-		
-		triStream.Append(gout);
-	}
+	VertexOut vout;
+	vout.PosW     = tree.PosW + (0.5f*tree.Width*side)*right + (tree.Height*top)*up;
+	vout.PosH     = mul(float4(vout.PosW, 1.0f), gViewProj);
+	vout.NormalW  = look;
+	vout.TexC     = float2(vertexID < 2 ? 0.0f : 1.0f, 1.0f - top);
+	vout.TexIndex = tree.TextureIndex;
+
+	return vout;
 }
 
 //step6
-float4 PS(GeoOut pin) : SV_Target
+float4 PS(VertexOut pin) : SV_Target
 {
-	float3 uvw = float3(pin.TexC, pin.PrimID%3);
+	float3 uvw = float3(pin.TexC, pin.TexIndex);
+#ifdef BINDLESS
+    float4 diffuseAlbedo = gTreeMapArrays[gDiffuseMapIndex].Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
+#else
     float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
+#endif
 
     //using dynamic indexing
-    //float4 diffuseAlbedo = gTreeMapArray[pin.PrimID % 3].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+    //float4 diffuseAlbedo = gTreeMapArray[pin.TexIndex].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
 
 	
 #ifdef ALPHA_TEST
@@ -0,0 +1,66 @@
+//***************************************************************************************
+// Upscale.hlsl
+//
+// Stretches the region of the scene target that dynamic resolution rendered over the
+// whole back buffer.  Drawn as one full-screen triangle.  Filters with a Catmull-Rom
+// spline, taken as nine bilinear taps: the two middle weights of each axis are folded
+// into one tap between their texels (Jimenez, "Filmic SMAA", 2016).
+//***************************************************************************************
+
+Texture2D gScene : register(t0);
+
+SamplerState gsamLinearClamp : register(s0);
+
+cbuffer cbUpscale : register(b0)
+{
+	float2 gUVScale;
+	float2 gMaxUV;
+	float2 gTargetSize;
+	float2 gInvTargetSize;
+	float2 gInvOutputSize;
+};
+
+float4 VS(uint vertexID : SV_VertexID) : SV_Position
+{
+	// (-1,1), (3,1), (-1,-3) covers the screen.
+	float2 uv = float2((vertexID << 1) & 2, vertexID & 2);
+	return float4(uv.x*2.0f - 1.0f, 1.0f - uv.y*2.0f, 0.0f, 1.0f);
+}
+
+float3 SampleRendered(float2 uv)
+{
+	// Texels past the rendered region hold stale or cleared color.
+	return gScene.SampleLevel(gsamLinearClamp, min(uv, gMaxUV), 0.0f).rgb;
+}
+
+float4 PS(float4 posH : SV_Position) : SV_Target
+{
+	float2 samplePos = posH.xy*gInvOutputSize*gUVScale*gTargetSize;
+	float2 texPos1 = floor(samplePos - 0.5f) + 0.5f;
+	float2 f = samplePos - texPos1;
+
+	// Catmull-Rom weights of the four texels around samplePos on each axis.
+	float2 w0 = f*(-0.5f + f*(1.0f - 0.5f*f));
+	float2 w1 = 1.0f + f*f*(-2.5f + 1.5f*f);
+	float2 w2 = f*(0.5f + f*(2.0f - 1.5f*f));
+	float2 w3 = f*f*(-0.5f + 0.5f*f);
+
+	float2 w12 = w1 + w2;
+	float2 uv0 = (texPos1 - 1.0f)*gInvTargetSize;
+	float2 uv12 = (texPos1 + w2/w12)*gInvTargetSize;
+	float2 uv3 = (texPos1 + 2.0f)*gInvTargetSize;
+
+	float3 color =
+		SampleRendered(float2(uv0.x,  uv0.y))*w0.x*w0.y +
+		SampleRendered(float2(uv12.x, uv0.y))*w12.x*w0.y +
+		SampleRendered(float2(uv3.x,  uv0.y))*w3.x*w0.y +
+		SampleRendered(float2(uv0.x,  uv12.y))*w0.x*w12.y +
+		SampleRendered(float2(uv12.x, uv12.y))*w12.x*w12.y +
+		SampleRendered(float2(uv3.x,  uv12.y))*w3.x*w12.y +
+		SampleRendered(float2(uv0.x,  uv3.y))*w0.x*w3.y +
+		SampleRendered(float2(uv12.x, uv3.y))*w12.x*w3.y +
+		SampleRendered(float2(uv3.x,  uv3.y))*w3.x*w3.y;
+
+	// The negative lobes can ring past the displayable range at hard edges.
+	return float4(saturate(color), 1.0f);
+}
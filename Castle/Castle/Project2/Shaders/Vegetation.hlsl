@@ -0,0 +1,76 @@
+//***************************************************************************************
+// Vegetation.hlsl
+//
+// Culling pass used by Vegetation.  Each thread tests one tree's bounding sphere
+// against the frustum and the distance limit; each group reserves room for its
+// survivors with one atomic on the draw's instance count and appends them there.
+//***************************************************************************************
+
+// Must match Vegetation::CullThreadGroupSize.
+#define CULL_THREADS 64
+
+// Must match TreeInstance in Vegetation.h.
+struct TreeInstance
+{
+	float3 PosW;
+	float  Width;
+	float  Height;
+	uint   TextureIndex;
+	float2 Pad;
+};
+
+// Must match VegetationCullConstants.
+cbuffer cbCull : register(b0)
+{
+	float4 gFrustumPlanes[6];
+	float3 gEyePosW;
+	float  gMaxDistance;
+	uint   gTreeCount;
+};
+
+StructuredBuffer<TreeInstance>   gTrees        : register(t0);
+RWStructuredBuffer<TreeInstance> gVisibleTrees : register(u0);
+
+// D3D12_DRAW_ARGUMENTS; the instance count is at byte 4.
+RWByteAddressBuffer gDrawArgs : register(u1);
+
+groupshared uint gGroupCount;
+groupshared uint gGroupBase;
+
+[numthreads(CULL_THREADS, 1, 1)]
+void CullCS(uint3 dispatchThreadID : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	if(groupIndex == 0)
+		gGroupCount = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	// No early outs: every thread has to reach the barriers below.
+	TreeInstance tree = (TreeInstance)0;
+	bool visible = dispatchThreadID.x < gTreeCount;
+	if(visible)
+	{
+		tree = gTrees[dispatchThreadID.x];
+
+		float3 center = tree.PosW + float3(0.0f, 0.5f*tree.Height, 0.0f);
+		float radius = 0.5f*length(float2(tree.Width, tree.Height));
+
+		visible = distance(center, gEyePosW) - radius <= gMaxDistance;
+
+		// The planes face out, so a sphere entirely in front of one is outside.
+		[unroll]
+		for(int i = 0; i < 6; ++i)
+			visible = visible && dot(gFrustumPlanes[i].xyz, center) + gFrustumPlanes[i].w <= radius;
+	}
+
+	uint slot = 0;
+	if(visible)
+		InterlockedAdd(gGroupCount, 1, slot);
+	GroupMemoryBarrierWithGroupSync();
+
+	if(groupIndex == 0)
+		gDrawArgs.InterlockedAdd(4, gGroupCount, gGroupBase);
+	GroupMemoryBarrierWithGroupSync();
+
+	if(visible)
+		gVisibleTrees[gGroupBase + slot] = tree;
+}
@@ -0,0 +1,55 @@
+//***************************************************************************************
+// VertexFetch.hlsl
+//
+// Reads a vertex raw from a vertex buffer in any VertexFormat, for the passes that
+// fetch their own vertices instead of going through the input assembler.  Include
+// after Default.hlsl: quantized positions decode with the current object's
+// gPositionBias and gPositionScale.
+//***************************************************************************************
+
+// Must match VertexFormat.
+#define VERTEX_FORMAT_FULL 0
+#define VERTEX_FORMAT_COMPACT 1
+
+float SnormToFloat(uint bits)
+{
+	int value = (int)(bits << 16) >> 16;
+	return max(value / 32767.0f, -1.0f);
+}
+
+// The vertex as VS would have read it through the input layout of format, from
+// vertices that start at byte base of the buffer.
+void FetchVertex(ByteAddressBuffer vertices, uint base, uint format, uint vertex,
+	out float3 posL, out float3 normalL, out float2 texC)
+{
+	if(format == VERTEX_FORMAT_FULL)
+	{
+		uint address = base + 32*vertex;
+		posL = asfloat(vertices.Load3(address));
+		normalL = asfloat(vertices.Load3(address + 12));
+		texC = asfloat(vertices.Load2(address + 24));
+		return;
+	}
+
+	uint address;
+	if(format == VERTEX_FORMAT_COMPACT)
+	{
+		address = base + 20*vertex;
+		posL = asfloat(vertices.Load3(address));
+		address += 12;
+	}
+	else
+	{
+		address = base + 16*vertex;
+		uint2 p = vertices.Load2(address);
+		posL = float3(SnormToFloat(p.x & 0xffff), SnormToFloat(p.x >> 16), SnormToFloat(p.y & 0xffff));
+		address += 8;
+	}
+
+	// The decode is the identity unless the positions are quantized.
+	posL = gPositionBias + posL*gPositionScale;
+
+	uint2 normalTexC = vertices.Load2(address);
+	normalL = OctahedralDecode(float2(SnormToFloat(normalTexC.x & 0xffff), SnormToFloat(normalTexC.x >> 16)));
+	texC = f16tof32(uint2(normalTexC.y & 0xffff, normalTexC.y >> 16));
+}
@@ -0,0 +1,198 @@
+//***************************************************************************************
+// VisibilityBuffer.hlsl
+//
+// Shades the opaque layer from the visibility buffer, drawn as one full-screen
+// triangle.  Each pixel takes the object and triangle the id pass (VisibilityPS in
+// Default.hlsl) left there, fetches the triangle's vertices from the geometry heap and
+// transforms them as VS would, and interpolates them at the pixel with perspective
+// correct barycentrics.  Their screen-space derivatives, found analytically, give
+// the texture gradients a rasterized triangle would have had.  Lighting is
+// Default.hlsl's ShadeSurface.
+//***************************************************************************************
+
+#define VISIBILITY_RESOLVE 1
+#include "Default.hlsl"
+#include "VertexFetch.hlsl"
+
+#ifndef STRUCTURED_CONSTANTS
+// The resolve is only drawn with structured constants; the other modes build it
+// for the shader manifest, reading the cbuffer constants instead.
+static uint gObjectIndex;
+#endif
+
+#define VISIBILITY_MAX_TRIANGLES (1u << VISIBILITY_TRIANGLE_BITS)
+
+// Must match VisibilityGeometry.
+struct VisibilityGeometry
+{
+	uint VertexBuffer;
+	uint VertexOffset;
+	uint IndexBuffer;
+	uint IndexOffset;
+	uint VertexFormat;
+	uint IndexSize;
+	uint2 GeometryPad;
+};
+
+// The ids, then every buffer of the geometry heap, read raw.
+Texture2D<uint>   gVisibility        : register(t0, space5);
+ByteAddressBuffer gGeometryBuffers[] : register(t1, space5);
+
+// Where each object's draw finds its triangles, by object index.
+StructuredBuffer<VisibilityGeometry> gVisibilityGeometry : register(t0, space6);
+
+// Perspective correct barycentrics of a pixel, and their change over one pixel step
+// right and down.
+struct Barycentrics
+{
+	float3 Weights;
+	float3 Ddx;
+	float3 Ddy;
+};
+
+// The barycentrics at ndc of the triangle with clip space corners p0, p1 and p2.
+// Each weight divided by w is linear on screen, so its gradient follows from the
+// projected corners, and the weights at the pixel and its neighbours from that.
+Barycentrics ComputeBarycentrics(float4 p0, float4 p1, float4 p2, float2 ndc)
+{
+	float3 invW = rcp(float3(p0.w, p1.w, p2.w));
+	float2 ndc0 = p0.xy*invW.x;
+	float2 ndc1 = p1.xy*invW.y;
+	float2 ndc2 = p2.xy*invW.z;
+
+	float invDet = rcp(determinant(float2x2(ndc2 - ndc1, ndc0 - ndc1)));
+	float3 dx = float3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y)*invDet*invW;
+	float3 dy = float3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x)*invDet*invW;
+
+	float2 delta = ndc - ndc0;
+	float3 overW = float3(invW.x, 0.0f, 0.0f) + delta.x*dx + delta.y*dy;
+	float sumOverW = dot(overW, 1.0f);
+
+	Barycentrics b;
+	b.Weights = overW / sumOverW;
+
+	// From NDC to pixels, whose y runs down.
+	dx *= 2.0f*gInvRenderTargetSize.x;
+	dy *= -2.0f*gInvRenderTargetSize.y;
+	b.Ddx = (overW + dx) / (sumOverW + dot(dx, 1.0f)) - b.Weights;
+	b.Ddy = (overW + dy) / (sumOverW + dot(dy, 1.0f)) - b.Weights;
+	return b;
+}
+
+// Index i of the draw, 2 or 4 bytes wide, from indices that start at byte base.
+uint LoadIndex(ByteAddressBuffer indices, uint base, uint size, uint i)
+{
+	uint address = base + i*size;
+	uint word = indices.Load(address & ~3u);
+	if(size == 4)
+		return word;
+	return (address & 2) ? word >> 16 : word & 0xffff;
+}
+
+// SampleDiffuseAlbedo with explicit gradients.  The material differs from pixel to
+// pixel, so its texture index is not uniform.
+float4 SampleDiffuseAlbedoGrad(float2 texC, float2 texDdx, float2 texDdy)
+{
+#if defined(VIRTUAL_TEXTURES) && defined(BINDLESS)
+    return gTextureMaps[NonUniformResourceIndex(gDiffuseMapIndex)].SampleGrad(gsamAnisotropicWrap,
+        texC, texDdx, texDdy, int2(0, 0), gDiffuseMinLod) * gDiffuseAlbedo;
+#elif defined(VIRTUAL_TEXTURES)
+    return gDiffuseMap.SampleGrad(gsamAnisotropicWrap, texC, texDdx, texDdy, int2(0, 0), gDiffuseMinLod) * gDiffuseAlbedo;
+#elif defined(BINDLESS)
+    return gTextureMaps[NonUniformResourceIndex(gDiffuseMapIndex)].SampleGrad(gsamAnisotropicWrap,
+        texC, texDdx, texDdy) * gDiffuseAlbedo;
+#else
+    return gDiffuseMap.SampleGrad(gsamAnisotropicWrap, texC, texDdx, texDdy) * gDiffuseAlbedo;
+#endif
+}
+
+#ifdef VIRTUAL_TEXTURES
+// RequestDiffuseMip with the mip taken from explicit gradients.
+void RequestDiffuseMipGrad(float2 texDdx, float2 texDdy, uint2 pixel)
+{
+    if(gFeedbackIndex == 0xffffffff || ((pixel.x | pixel.y) & 7) != 0)
+        return;
+
+    uint width;
+    uint height;
+#ifdef BINDLESS
+    gTextureMaps[NonUniformResourceIndex(gDiffuseMapIndex)].GetDimensions(width, height);
+#else
+    gDiffuseMap.GetDimensions(width, height);
+#endif
+
+    float2 size = float2(width, height);
+    float2 ddxTexels = texDdx*size;
+    float2 ddyTexels = texDdy*size;
+    float lod = 0.5f*log2(max(dot(ddxTexels, ddxTexels), dot(ddyTexels, ddyTexels)));
+    InterlockedMin(gMipRequests[gFeedbackIndex], (uint)max(lod, 0.0f));
+}
+#endif
+
+float4 ResolveVS(uint vertexID : SV_VertexID) : SV_Position
+{
+	// (-1,1), (3,1), (-1,-3) covers the screen.
+	float2 uv = float2((vertexID << 1) & 2, vertexID & 2);
+	return float4(uv.x*2.0f - 1.0f, 1.0f - uv.y*2.0f, 0.0f, 1.0f);
+}
+
+float4 ResolvePS(float4 posH : SV_Position) : SV_Target
+{
+	uint id = gVisibility.Load(int3(posH.xy, 0));
+
+	// No opaque object here; the sky or a layer drawn after fills it.
+	if(id == 0)
+		discard;
+
+	gObjectIndex = (id >> VISIBILITY_TRIANGLE_BITS) - 1;
+	uint primitive = id & (VISIBILITY_MAX_TRIANGLES - 1);
+	VisibilityGeometry geometry = gVisibilityGeometry[gObjectIndex];
+
+	// The triangle's corners, as VS transforms them.
+	float4 posC[3];
+	float3 posW[3];
+	float3 normalW[3];
+	float2 texC[3];
+	[unroll]
+	for(uint i = 0; i < 3; ++i)
+	{
+		uint vertex = LoadIndex(gGeometryBuffers[NonUniformResourceIndex(geometry.IndexBuffer)],
+			geometry.IndexOffset, geometry.IndexSize, 3*primitive + i);
+
+		float3 posL;
+		float3 normalL;
+		FetchVertex(gGeometryBuffers[NonUniformResourceIndex(geometry.VertexBuffer)],
+			geometry.VertexOffset, geometry.VertexFormat, vertex, posL, normalL, texC[i]);
+
+		float4 world = mul(float4(posL, 1.0f), gWorld);
+		posW[i] = world.xyz;
+		posC[i] = mul(world, gViewProj);
+		normalW[i] = mul(normalL, (float3x3)gWorld);
+	}
+
+	// The pixel's center in NDC.
+	float2 ndc = float2(posH.x*gInvRenderTargetSize.x*2.0f - 1.0f, 1.0f - posH.y*gInvRenderTargetSize.y*2.0f);
+	Barycentrics b = ComputeBarycentrics(posC[0], posC[1], posC[2], ndc);
+
+	float3 pos = mul(b.Weights, float3x3(posW[0], posW[1], posW[2]));
+	float3 normal = mul(b.Weights, float3x3(normalW[0], normalW[1], normalW[2]));
+	float viewZ = dot(b.Weights, float3(posC[0].w, posC[1].w, posC[2].w));
+
+	float3x2 corners = float3x2(texC[0], texC[1], texC[2]);
+	float2 uv = mul(b.Weights, corners);
+	float2 uvDdx = mul(b.Ddx, corners);
+	float2 uvDdy = mul(b.Ddy, corners);
+
+	// VS's texture transforms are affine, so the gradients go through their linear part.
+	float4x4 texTransform = mul(gTexTransform, gMatTransform);
+	uv = mul(float4(uv, 0.0f, 1.0f), texTransform).xy;
+	uvDdx = mul(float4(uvDdx, 0.0f, 0.0f), texTransform).xy;
+	uvDdy = mul(float4(uvDdy, 0.0f, 0.0f), texTransform).xy;
+
+#ifdef VIRTUAL_TEXTURES
+	RequestDiffuseMipGrad(uvDdx, uvDdy, (uint2)posH.xy);
+#endif
+	float4 diffuseAlbedo = SampleDiffuseAlbedoGrad(uv, uvDdx, uvDdy);
+
+	return ShadeSurface(diffuseAlbedo, pos, normal, posH.xy, viewZ);
+}
@@ -0,0 +1,110 @@
+//***************************************************************************************
+// StaticBatcher.cpp
+//***************************************************************************************
+
+#include "StaticBatcher.h"
+#include "../../Common/MathHelper.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <tuple>
+
+using namespace DirectX;
+
+StaticBatcher::StaticBatcher(float cellSize)
+	: mCellSize(cellSize)
+{
+	assert(cellSize > 0.0f);
+}
+
+void StaticBatcher::Add(const std::string& material, const std::vector<Vertex>& vertices, const std::uint16_t* indices,
+	const SubmeshGeometry& submesh, FXMMATRIX world)
+{
+	Piece piece;
+	piece.Material = material;
+
+	// The submesh's indices count from its base vertex, so its vertices run up to
+	// the largest of them.
+	const std::uint16_t* first = indices + submesh.StartIndexLocation;
+	UINT vertexCount = (UINT)*std::max_element(first, first + submesh.IndexCount) + 1;
+
+	XMMATRIX normalWorld = MathHelper::InverseTranspose(world);
+	piece.Vertices.resize(vertexCount);
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		const Vertex& src = vertices[submesh.BaseVertexLocation + i];
+		Vertex& dst = piece.Vertices[i];
+
+		XMStoreFloat3(&dst.Pos, XMVector3TransformCoord(XMLoadFloat3(&src.Pos), world));
+		XMStoreFloat3(&dst.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&src.Normal), normalWorld)));
+		dst.TexC = src.TexC;
+	}
+
+	piece.Indices.assign(first, first + submesh.IndexCount);
+	if(XMVectorGetX(XMMatrixDeterminant(world)) < 0.0f)
+	{
+		for(size_t i = 0; i + 2 < piece.Indices.size(); i += 3)
+			std::swap(piece.Indices[i + 1], piece.Indices[i + 2]);
+	}
+
+	BoundingBox::CreateFromPoints(piece.Bounds, piece.Vertices.size(), &piece.Vertices[0].Pos, sizeof(Vertex));
+	piece.CellX = (int)std::floor(piece.Bounds.Center.x / mCellSize + 0.5f);
+	piece.CellZ = (int)std::floor(piece.Bounds.Center.z / mCellSize + 0.5f);
+
+	mPieces.push_back(std::move(piece));
+}
+
+UINT StaticBatcher::PieceCount()const
+{
+	return (UINT)mPieces.size();
+}
+
+void StaticBatcher::Build(std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, std::vector<Batch>& batches)const
+{
+	std::vector<UINT> order(mPieces.size());
+	for(UINT i = 0; i < (UINT)order.size(); ++i)
+		order[i] = i;
+
+	// Pieces added together stay together within a batch.
+	std::stable_sort(order.begin(), order.end(), [this](UINT a, UINT b)
+	{
+		const Piece& pa = mPieces[a];
+		const Piece& pb = mPieces[b];
+		return std::tie(pa.Material, pa.CellX, pa.CellZ) < std::tie(pb.Material, pb.CellX, pb.CellZ);
+	});
+
+	vertices.clear();
+	indices.clear();
+	batches.clear();
+
+	const Piece* batchKey = nullptr;
+	for(UINT i : order)
+	{
+		const Piece& piece = mPieces[i];
+		assert(piece.Vertices.size() <= 0x10000);
+
+		bool sameKey = batchKey && batchKey->Material == piece.Material &&
+			batchKey->CellX == piece.CellX && batchKey->CellZ == piece.CellZ;
+		if(!sameKey || vertices.size() - batches.back().Submesh.BaseVertexLocation + piece.Vertices.size() > 0x10000)
+		{
+			Batch batch;
+			batch.Material = piece.Material;
+			batch.Submesh.IndexCount = 0;
+			batch.Submesh.StartIndexLocation = (UINT)indices.size();
+			batch.Submesh.BaseVertexLocation = (INT)vertices.size();
+			batch.Submesh.Bounds = piece.Bounds;
+			batches.push_back(batch);
+			batchKey = &piece;
+		}
+
+		Batch& batch = batches.back();
+		std::uint16_t offset = (std::uint16_t)(vertices.size() - batch.Submesh.BaseVertexLocation);
+		for(std::uint16_t index : piece.Indices)
+			indices.push_back((std::uint16_t)(offset + index));
+		vertices.insert(vertices.end(), piece.Vertices.begin(), piece.Vertices.end());
+
+		batch.Submesh.IndexCount += (UINT)piece.Indices.size();
+		BoundingBox::CreateMerged(batch.Submesh.Bounds, batch.Submesh.Bounds, piece.Bounds);
+		++batch.PieceCount;
+	}
+}
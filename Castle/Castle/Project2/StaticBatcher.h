@@ -0,0 +1,64 @@
+//***************************************************************************************
+// StaticBatcher.h
+//
+// Bakes scenery that never moves into combined geometry.  Each piece's vertices are
+// taken into world space once, at startup, and the pieces sharing a material are
+// merged into batches, each drawn as one item with an identity world matrix, so they
+// cost one draw and one object constant slot between them.
+//
+// So that a batch can still be culled usefully, pieces are also split by a grid of
+// square cells on x/z, one centered on the origin, by the centers of their bounds.
+// A batch that would pass 65536 vertices is closed and another begun, so the indices
+// stay 16-bit.
+//***************************************************************************************
+
+#ifndef STATICBATCHER_H
+#define STATICBATCHER_H
+
+#include "FrameResource.h"
+
+class StaticBatcher
+{
+public:
+	struct Batch
+	{
+		std::string Material;
+
+		// The batch's range of the combined buffers, and its box in world space.
+		SubmeshGeometry Submesh;
+
+		UINT PieceCount = 0;
+	};
+
+	explicit StaticBatcher(float cellSize);
+	StaticBatcher(const StaticBatcher& rhs) = delete;
+	StaticBatcher& operator=(const StaticBatcher& rhs) = delete;
+
+	// Places submesh, of vertices and the 16-bit indices, by world and drawn with
+	// material.  A world that mirrors the piece has its triangles' winding reversed.
+	void Add(const std::string& material, const std::vector<Vertex>& vertices, const std::uint16_t* indices,
+		const SubmeshGeometry& submesh, DirectX::FXMMATRIX world);
+
+	UINT PieceCount()const;
+
+	// Merges the pieces added, the batches ordered by material and then cell.
+	void Build(std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, std::vector<Batch>& batches)const;
+
+private:
+	struct Piece
+	{
+		std::string Material;
+		int CellX = 0;
+		int CellZ = 0;
+
+		// In world space, the indices from the piece's first vertex.
+		std::vector<Vertex> Vertices;
+		std::vector<std::uint16_t> Indices;
+		DirectX::BoundingBox Bounds;
+	};
+
+	float mCellSize = 0.0f;
+	std::vector<Piece> mPieces;
+};
+
+#endif // STATICBATCHER_H
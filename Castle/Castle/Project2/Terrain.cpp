@@ -0,0 +1,191 @@
+//***************************************************************************************
+// Terrain.cpp
+//***************************************************************************************
+
+#include "Terrain.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+const float Terrain::MinHeight = -20.0f;
+const float Terrain::MaxHeight = 32.0f;
+
+namespace
+{
+	float SmoothStep(float edge0, float edge1, float x)
+	{
+		float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+		return t*t*(3.0f - 2.0f*t);
+	}
+}
+
+Terrain::Terrain(float tileSize, unsigned int levelCount)
+	: mTileSize(tileSize), mLevelCount(levelCount)
+{
+	mVisibleTiles.reserve(MaxTileCount());
+}
+
+unsigned int Terrain::MaxTileCount()const
+{
+	// 16 tiles in the first level, and the 12 around the hole in each other.
+	return mLevelCount == 0 ? 0 : 16 + 12*(mLevelCount - 1);
+}
+
+float Terrain::Extent()const
+{
+	// The outer block is four tiles across, but the snapping may leave the eye up to
+	// a tile off its centre.
+	return mLevelCount == 0 ? 0.0f : mTileSize*(float)(1u << (mLevelCount - 1));
+}
+
+float Terrain::Height(float x, float z)
+{
+	// A lake bed around the castle, rising through a shore into rolling hills.
+	float hills =
+		14.0f*sinf(0.012f*x)*cosf(0.010f*z) +
+		6.0f*sinf(0.031f*x + 1.3f)*sinf(0.027f*z) +
+		2.0f*sinf(0.093f*x)*cosf(0.087f*z + 0.7f);
+
+	float shore = SmoothStep(60.0f, 140.0f, sqrtf(x*x + z*z));
+	return -3.0f + shore*(9.0f + hills);
+}
+
+void Terrain::BuildTileMesh(std::vector<XMFLOAT3>& vertices, std::vector<std::uint16_t>& indices)
+{
+	const unsigned int n = TileQuads + 1;
+
+	vertices.clear();
+	indices.clear();
+
+	for(unsigned int j = 0; j < n; ++j)
+	{
+		for(unsigned int i = 0; i < n; ++i)
+			vertices.push_back(XMFLOAT3((float)i / TileQuads, (float)j / TileQuads, 0.0f));
+	}
+
+	// Orients each triangle so its clockwise front face points along outward.
+	auto addTriangle = [&](unsigned int a, unsigned int b, unsigned int c, XMVECTOR outward)
+	{
+		auto position = [&](unsigned int v)
+		{
+			// The grid's y is world z, and skirts hang down.
+			return XMVectorSet(vertices[v].x, -vertices[v].z, vertices[v].y, 0.0f);
+		};
+
+		XMVECTOR p0 = position(a);
+		XMVECTOR normal = XMVector3Cross(position(b) - p0, position(c) - p0);
+		if(XMVectorGetX(XMVector3Dot(normal, outward)) < 0.0f)
+			std::swap(b, c);
+
+		indices.push_back((std::uint16_t)a);
+		indices.push_back((std::uint16_t)b);
+		indices.push_back((std::uint16_t)c);
+	};
+
+	const XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	for(unsigned int j = 0; j < TileQuads; ++j)
+	{
+		for(unsigned int i = 0; i < TileQuads; ++i)
+		{
+			unsigned int v00 = j*n + i;
+			unsigned int v10 = v00 + 1;
+			unsigned int v01 = v00 + n;
+			unsigned int v11 = v01 + 1;
+			addTriangle(v00, v01, v10, up);
+			addTriangle(v10, v01, v11, up);
+		}
+	}
+
+	// One skirt strip per edge, walking the edge's grid points.
+	struct Edge
+	{
+		unsigned int Start;
+		int Step;
+		XMFLOAT3 Outward;
+	};
+
+	const Edge edges[] =
+	{
+		{ 0, 1, XMFLOAT3(0.0f, 0.0f, -1.0f) },                 // z = 0
+		{ (n - 1)*n, 1, XMFLOAT3(0.0f, 0.0f, 1.0f) },          // z = 1
+		{ 0, (int)n, XMFLOAT3(-1.0f, 0.0f, 0.0f) },            // x = 0
+		{ n - 1, (int)n, XMFLOAT3(1.0f, 0.0f, 0.0f) },         // x = 1
+	};
+
+	for(const auto& edge : edges)
+	{
+		unsigned int skirtStart = (unsigned int)vertices.size();
+		for(unsigned int k = 0; k < n; ++k)
+		{
+			XMFLOAT3 v = vertices[edge.Start + k*edge.Step];
+			vertices.push_back(XMFLOAT3(v.x, v.y, 1.0f));
+		}
+
+		XMVECTOR outward = XMLoadFloat3(&edge.Outward);
+		for(unsigned int k = 0; k < TileQuads; ++k)
+		{
+			unsigned int top0 = edge.Start + k*edge.Step;
+			unsigned int top1 = top0 + edge.Step;
+			unsigned int bottom0 = skirtStart + k;
+			unsigned int bottom1 = bottom0 + 1;
+			addTriangle(top0, top1, bottom0, outward);
+			addTriangle(top1, bottom1, bottom0, outward);
+		}
+	}
+}
+
+void Terrain::Update(const XMFLOAT3& eye, const BoundingFrustum& frustum, bool cull)
+{
+	mVisibleTiles.clear();
+
+	// Extent of the previous, finer level's block.
+	float innerMinX = 0.0f, innerMinZ = 0.0f, innerMaxX = 0.0f, innerMaxZ = 0.0f;
+
+	for(unsigned int level = 0; level < mLevelCount; ++level)
+	{
+		float size = mTileSize*(float)(1u << level);
+
+		// Snapping the block centre to twice the tile size keeps the finer block on
+		// this level's tile grid.
+		float snap = 2.0f*size;
+		float originX = floorf(eye.x / snap + 0.5f)*snap - 2.0f*size;
+		float originZ = floorf(eye.z / snap + 0.5f)*snap - 2.0f*size;
+
+		for(unsigned int j = 0; j < 4; ++j)
+		{
+			for(unsigned int i = 0; i < 4; ++i)
+			{
+				float x = originX + i*size;
+				float z = originZ + j*size;
+
+				if(level > 0 && x >= innerMinX && x + size <= innerMaxX &&
+					z >= innerMinZ && z + size <= innerMaxZ)
+					continue;
+
+				Tile tile;
+				tile.Origin = XMFLOAT2(x, z);
+				tile.Size = size;
+				tile.Level = level;
+
+				// The skirts hang below the lowest point.
+				float skirt = 0.05f*size + 1.0f;
+				tile.Bounds.Center = XMFLOAT3(x + 0.5f*size, 0.5f*(MinHeight - skirt + MaxHeight), z + 0.5f*size);
+				tile.Bounds.Extents = XMFLOAT3(0.5f*size, 0.5f*(MaxHeight - MinHeight + skirt), 0.5f*size);
+
+				if(!cull || frustum.Contains(tile.Bounds) != DirectX::DISJOINT)
+					mVisibleTiles.push_back(tile);
+			}
+		}
+
+		innerMinX = originX;
+		innerMinZ = originZ;
+		innerMaxX = originX + 4.0f*size;
+		innerMaxZ = originZ + 4.0f*size;
+	}
+}
+
+const std::vector<Terrain::Tile>& Terrain::VisibleTiles()const
+{
+	return mVisibleTiles;
+}
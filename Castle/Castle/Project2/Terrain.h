@@ -0,0 +1,74 @@
+//***************************************************************************************
+// Terrain.h
+//
+// Terrain of unbounded extent drawn as nested square levels of tiles around the
+// camera, a simple geometry clipmap.  Level 0 is a 4x4 block of the finest tiles;
+// each further level is a 4x4 block of tiles twice the size with the level inside
+// it cut out.  Every tile is the same grid mesh, scaled and placed by its instance
+// data, and its heights come from Height in the vertex shader, so nothing but the
+// tile layout is computed on the CPU.
+//
+// The blocks are snapped to their tile size as the camera moves, so vertices stay
+// put.  Tiles have skirts hanging from their edges to hide the cracks where levels
+// of different resolution meet.
+//***************************************************************************************
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class Terrain
+{
+public:
+	struct Tile
+	{
+		// Corner with the smallest x and z, and edge length.
+		DirectX::XMFLOAT2 Origin;
+		float Size;
+		unsigned int Level;
+		DirectX::BoundingBox Bounds;
+	};
+
+	// Quads along a tile edge.  Must match TERRAIN_TILE_QUADS in Default.hlsl.
+	static const unsigned int TileQuads = 32;
+
+	// Range of Height, for the tile bounds.
+	static const float MinHeight;
+	static const float MaxHeight;
+
+	// tileSize is the edge of the finest tiles; each of the levelCount levels
+	// doubles it.
+	Terrain(float tileSize, unsigned int levelCount);
+	Terrain(const Terrain& rhs) = delete;
+	Terrain& operator=(const Terrain& rhs) = delete;
+
+	unsigned int MaxTileCount()const;
+
+	// Half the edge of the area covered, whatever the camera position.
+	float Extent()const;
+
+	// Must match TerrainHeight in Default.hlsl.
+	static float Height(float x, float z);
+
+	// The tile mesh: (TileQuads+1)^2 grid points in [0,1]^2 as x and y, then skirt
+	// copies of the edge points with z = 1.  Front faces point up and out.
+	static void BuildTileMesh(std::vector<DirectX::XMFLOAT3>& vertices, std::vector<std::uint16_t>& indices);
+
+	// Lays the levels out around eye and keeps the tiles that intersect frustum,
+	// or all of them if cull is false.
+	void Update(const DirectX::XMFLOAT3& eye, const DirectX::BoundingFrustum& frustum, bool cull);
+
+	const std::vector<Tile>& VisibleTiles()const;
+
+private:
+	float mTileSize = 0.0f;
+	unsigned int mLevelCount = 0;
+
+	std::vector<Tile> mVisibleTiles;
+};
+
+#endif // TERRAIN_H
@@ -0,0 +1,169 @@
+//***************************************************************************************
+// VariableRateShading.cpp
+//***************************************************************************************
+
+#include "VariableRateShading.h"
+#include <cassert>
+
+using Microsoft::WRL::ComPtr;
+
+VariableRateShading::VariableRateShading(ID3D12Device* device)
+{
+	md3dDevice = device;
+
+	// Older runtimes do not know the query and leave the tier unsupported.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS6 options = {};
+	if(SUCCEEDED(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS6, &options, sizeof(options))))
+	{
+		mTier = options.VariableShadingRateTier;
+		mAdditionalRates = options.AdditionalShadingRatesSupported != FALSE;
+		mTileSize = options.ShadingRateImageTileSize;
+	}
+
+	// The per-primitive rate is not used; the image only ever coarsens a draw.
+	mCombiners[0] = D3D12_SHADING_RATE_COMBINER_PASSTHROUGH;
+	mCombiners[1] = D3D12_SHADING_RATE_COMBINER_MAX;
+}
+
+VariableRateShading::~VariableRateShading()
+{
+}
+
+bool VariableRateShading::Supported()const
+{
+	return mTier >= D3D12_VARIABLE_SHADING_RATE_TIER_1;
+}
+
+bool VariableRateShading::ImageSupported()const
+{
+	return mTier >= D3D12_VARIABLE_SHADING_RATE_TIER_2;
+}
+
+D3D12_SHADING_RATE VariableRateShading::CoarseRate()const
+{
+	return mAdditionalRates ? D3D12_SHADING_RATE_4X4 : D3D12_SHADING_RATE_2X2;
+}
+
+D3D12_SHADING_RATE VariableRateShading::RateForFog(float fogAmount)const
+{
+	if(fogAmount >= CoarseRateFog)
+		return CoarseRate();
+	if(fogAmount >= HalfRateFog)
+		return D3D12_SHADING_RATE_2X2;
+	return D3D12_SHADING_RATE_1X1;
+}
+
+const D3D12_SHADING_RATE_COMBINER* VariableRateShading::Combiners()const
+{
+	return ImageSupported() ? mCombiners : nullptr;
+}
+
+void VariableRateShading::Resize(ID3D12Resource* depthBuffer, UINT width, UINT height)
+{
+	if(!ImageSupported())
+		return;
+
+	mDepthBuffer = depthBuffer;
+	mTilesX = (width + mTileSize - 1) / mTileSize;
+	mTilesY = (height + mTileSize - 1) / mTileSize;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8_UINT, mTilesX, mTilesY, 1, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE,
+		nullptr,
+		IID_PPV_ARGS(mImage.ReleaseAndGetAddressOf())));
+}
+
+void VariableRateShading::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+	UINT descriptorSize)
+{
+	if(!ImageSupported())
+		return;
+
+	mDepthSrv = hGpuDescriptor;
+	mImageUav = hGpuDescriptor.Offset(1, descriptorSize);
+
+	// The depth half of the D24S8 depth buffer.
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	md3dDevice->CreateShaderResourceView(mDepthBuffer, &srvDesc, hCpuDescriptor);
+
+	md3dDevice->CreateUnorderedAccessView(mImage.Get(), nullptr, nullptr, hCpuDescriptor.Offset(1, descriptorSize));
+}
+
+void VariableRateShading::BuildImage(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+	const DirectX::XMFLOAT4X4& proj, UINT width, UINT height, float fogStart, float fogRange)
+{
+	assert(ImageSupported());
+
+	ShadingRateConstants constants;
+	DirectX::XMMATRIX P = DirectX::XMLoadFloat4x4(&proj);
+	DirectX::XMStoreFloat4x4(&constants.InvProj,
+		DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(&DirectX::XMMatrixDeterminant(P), P)));
+	constants.Width = width;
+	constants.Height = height;
+	constants.InvWidth = 1.0f / width;
+	constants.InvHeight = 1.0f / height;
+	constants.TileSize = mTileSize;
+	// Only the tiles over the viewport; the draws never reach the rest.
+	constants.TilesX = std::min(mTilesX, (width + mTileSize - 1) / mTileSize);
+	constants.TilesY = std::min(mTilesY, (height + mTileSize - 1) / mTileSize);
+	constants.FogStart = fogStart;
+	constants.FogRange = fogRange;
+	constants.HalfRateFog = HalfRateFog;
+	constants.CoarseRateFog = CoarseRateFog;
+	constants.CoarseRate = CoarseRate();
+
+	{
+		D3D12_RESOURCE_BARRIER barriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mDepthBuffer,
+				D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+			CD3DX12_RESOURCE_BARRIER::Transition(mImage.Get(),
+				D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		};
+		cmdList->ResourceBarrier(_countof(barriers), barriers);
+	}
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetComputeRoot32BitConstants(0, ConstantCount, &constants, 0);
+	cmdList->SetComputeRootDescriptorTable(1, mDepthSrv);
+	cmdList->SetComputeRootDescriptorTable(2, mImageUav);
+
+	cmdList->Dispatch((constants.TilesX + ThreadGroupSize - 1) / ThreadGroupSize,
+		(constants.TilesY + ThreadGroupSize - 1) / ThreadGroupSize, 1);
+
+	{
+		D3D12_RESOURCE_BARRIER barriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mDepthBuffer,
+				D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE),
+			CD3DX12_RESOURCE_BARRIER::Transition(mImage.Get(),
+				D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE),
+		};
+		cmdList->ResourceBarrier(_countof(barriers), barriers);
+	}
+}
+
+void VariableRateShading::Bind(CachedCommandList& cmdList, bool useImage)const
+{
+	cmdList.RSSetShadingRate(D3D12_SHADING_RATE_1X1, Combiners());
+	if(ImageSupported())
+		cmdList.RSSetShadingRateImage(useImage ? mImage.Get() : nullptr);
+}
+
+void VariableRateShading::Unbind(CachedCommandList& cmdList)const
+{
+	cmdList.RSSetShadingRate(D3D12_SHADING_RATE_1X1, nullptr);
+	if(ImageSupported())
+		cmdList.RSSetShadingRateImage(nullptr);
+}
@@ -0,0 +1,128 @@
+//***************************************************************************************
+// VariableRateShading.h
+//
+// Shades pixels the fog covers at a coarser rate.  Past gFogStart + gFogRange the
+// pixel shader's lighting is almost entirely replaced by the fog color, so running
+// it once per 2x2 or 4x4 block there loses nothing visible.
+//
+// At Tier 2 a compute pass turns the depth buffer into a shading rate image: each
+// tile takes the rate of its nearest, least fogged texel.  It needs this frame's
+// depth before shading, so it runs after the depth pre-pass.  At Tier 1, or without
+// the pre-pass, the client picks a rate per draw from how fogged the draw's nearest
+// point is; with the image as well, the coarser of the two wins.
+//
+// The client supplies the PSO and root signature of the pass: the
+// ShadingRateConstants at 0, the table of the depth SRV at 1 and of the image UAV at
+// 2.  Shading rates are set through ID3D12GraphicsCommandList5.
+//***************************************************************************************
+
+#ifndef VARIABLERATESHADING_H
+#define VARIABLERATESHADING_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/CachedCommandList.h"
+
+// Root constants of the rate image pass.  Must match cbShadingRate in ShadingRate.hlsl.
+struct ShadingRateConstants
+{
+	// Transposed, as in PassConstants.
+	DirectX::XMFLOAT4X4 InvProj;
+	// The viewport the depth was drawn into, at the depth buffer's corner.
+	UINT Width;
+	UINT Height;
+	float InvWidth;
+	float InvHeight;
+	UINT TileSize;
+	UINT TilesX;
+	UINT TilesY;
+	float FogStart;
+	float FogRange;
+	// Fog amounts from which a tile is shaded at HalfRate or CoarseRate.
+	float HalfRateFog;
+	float CoarseRateFog;
+	UINT CoarseRate;
+};
+
+class VariableRateShading
+{
+public:
+	// Must match RATE_THREADS in ShadingRate.hlsl.
+	static const UINT ThreadGroupSize = 8;
+
+	static const UINT ConstantCount = sizeof(ShadingRateConstants) / 4;
+
+	// Consecutive descriptors BuildDescriptors fills: the depth SRV, then the image UAV.
+	static const UINT DescriptorCount = 2;
+
+	// Nearest fog amounts of what is shaded at 2x2 and at the coarsest rate.
+	static constexpr float HalfRateFog = 0.6f;
+	static constexpr float CoarseRateFog = 0.9f;
+
+	// Queries the device's support; where it has none, only the queries below may
+	// be called.
+	explicit VariableRateShading(ID3D12Device* device);
+	VariableRateShading(const VariableRateShading& rhs) = delete;
+	VariableRateShading& operator=(const VariableRateShading& rhs) = delete;
+	~VariableRateShading();
+
+	// Per-draw rates, at Tier 1 and up.
+	bool Supported()const;
+	// The rate image, at Tier 2.
+	bool ImageSupported()const;
+
+	// 4x4 where the device has the additional rates, else 2x2.
+	D3D12_SHADING_RATE CoarseRate()const;
+
+	// The rate of something whose nearest point is fogAmount fogged.
+	D3D12_SHADING_RATE RateForFog(float fogAmount)const;
+
+	// How a per-draw rate combines with the image: nullptr at Tier 1.
+	const D3D12_SHADING_RATE_COMBINER* Combiners()const;
+
+	// Recreates the image for a depth buffer of the new size, which must be typeless
+	// R24G8 and no longer in use by the GPU.  Call BuildDescriptors again afterwards.
+	// Nothing to do without image support.
+	void Resize(ID3D12Resource* depthBuffer, UINT width, UINT height);
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Builds the image from the depth buffer, in DEPTH_WRITE on entry and return.
+	// proj is the projection the depth was drawn with, into a viewport of the top
+	// left width by height texels.  The descriptor heap must be set.
+	void BuildImage(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+		const DirectX::XMFLOAT4X4& proj, UINT width, UINT height, float fogStart, float fogRange);
+
+	// Sets a full base rate and, if useImage, the image on cmdList for the scene's
+	// draws, which may then set per-draw rates with Combiners.
+	void Bind(CachedCommandList& cmdList, bool useImage)const;
+
+	// Back to full rate everywhere, for passes drawn after the scene.
+	void Unbind(CachedCommandList& cmdList)const;
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	D3D12_VARIABLE_SHADING_RATE_TIER mTier = D3D12_VARIABLE_SHADING_RATE_TIER_NOT_SUPPORTED;
+	bool mAdditionalRates = false;
+	UINT mTileSize = 0;
+
+	D3D12_SHADING_RATE_COMBINER mCombiners[D3D12_RS_SET_SHADING_RATE_COMBINER_COUNT];
+
+	UINT mTilesX = 0;
+	UINT mTilesY = 0;
+
+	// The depth buffer the image is built from; owned by the client.
+	ID3D12Resource* mDepthBuffer = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mDepthSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mImageUav;
+
+	// One D3D12_SHADING_RATE per tile of the output size, resting in
+	// SHADING_RATE_SOURCE.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mImage = nullptr;
+};
+
+#endif // VARIABLERATESHADING_H
@@ -0,0 +1,163 @@
+//***************************************************************************************
+// Vegetation.cpp
+//***************************************************************************************
+
+#include "Vegetation.h"
+#include <cassert>
+
+using namespace DirectX;
+
+Vegetation::Vegetation(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	const std::vector<TreeInstance>& trees)
+{
+	assert(!trees.empty());
+
+	md3dDevice = device;
+	mTreeCount = (UINT)trees.size();
+
+	BuildResources(cmdList, trees);
+}
+
+Vegetation::~Vegetation()
+{
+}
+
+UINT Vegetation::TreeCount()const
+{
+	return mTreeCount;
+}
+
+std::array<ID3D12Resource*, 3> Vegetation::Resources()const
+{
+	return { mTrees.Get(), mVisibleTrees.Get(), mDrawArgs.Get() };
+}
+
+void Vegetation::ReleaseUploadBuffers()
+{
+	mTreesUploadBuffer = nullptr;
+}
+
+void Vegetation::BuildResources(ID3D12GraphicsCommandList* cmdList, const std::vector<TreeInstance>& trees)
+{
+	const UINT64 treesByteSize = (UINT64)mTreeCount*sizeof(TreeInstance);
+
+	mTrees = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+		trees.data(), treesByteSize, mTreesUploadBuffer);
+
+	// Written by every cull before it is read, so neither needs initial data.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(treesByteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		nullptr,
+		IID_PPV_ARGS(&mVisibleTrees)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(sizeof(D3D12_DRAW_ARGUMENTS), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+		nullptr,
+		IID_PPV_ARGS(&mDrawArgs)));
+
+	// Kept for the life of the object; the cull copies from it every frame.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(sizeof(D3D12_DRAW_ARGUMENTS)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mDrawArgsReset)));
+
+	// Four vertices of a strip per tree; the cull fills in the instance count.
+	D3D12_DRAW_ARGUMENTS resetArgs = {};
+	resetArgs.VertexCountPerInstance = 4;
+
+	void* mapped = nullptr;
+	ThrowIfFailed(mDrawArgsReset->Map(0, nullptr, &mapped));
+	memcpy(mapped, &resetArgs, sizeof(resetArgs));
+	mDrawArgsReset->Unmap(0, nullptr);
+
+	// Only draw arguments, so no root signature is needed.
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDesc = {};
+	argumentDesc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+
+	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+	commandSignatureDesc.pArgumentDescs = &argumentDesc;
+	commandSignatureDesc.NumArgumentDescs = 1;
+	commandSignatureDesc.ByteStride = sizeof(D3D12_DRAW_ARGUMENTS);
+
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&commandSignatureDesc,
+		nullptr, IID_PPV_ARGS(mCommandSignature.GetAddressOf())));
+}
+
+void Vegetation::Cull(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+	const BoundingFrustum& frustum, bool frustumCull, const XMFLOAT3& eye, float maxDistance)
+{
+	VegetationCullConstants constants;
+
+	XMVECTOR planes[6];
+	frustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+	for(int i = 0; i < 6; ++i)
+	{
+		// A plane behind everything rejects nothing.
+		if(!frustumCull)
+			planes[i] = XMVectorSet(0.0f, 0.0f, 0.0f, -1.0f);
+		XMStoreFloat4(&constants.FrustumPlanes[i], planes[i]);
+	}
+
+	constants.EyePosW = eye;
+	constants.MaxDistance = maxDistance;
+	constants.TreeCount = mTreeCount;
+
+	{
+		D3D12_RESOURCE_BARRIER barriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(),
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST),
+			CD3DX12_RESOURCE_BARRIER::Transition(mVisibleTrees.Get(),
+				D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		};
+		cmdList->ResourceBarrier(_countof(barriers), barriers);
+	}
+
+	cmdList->CopyBufferRegion(mDrawArgs.Get(), 0, mDrawArgsReset.Get(), 0, sizeof(D3D12_DRAW_ARGUMENTS));
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetComputeRoot32BitConstants(0, CullConstantCount, &constants, 0);
+	cmdList->SetComputeRootShaderResourceView(1, mTrees->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(2, mVisibleTrees->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(3, mDrawArgs->GetGPUVirtualAddress());
+
+	cmdList->Dispatch((mTreeCount + CullThreadGroupSize - 1) / CullThreadGroupSize, 1, 1);
+
+	{
+		D3D12_RESOURCE_BARRIER barriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(),
+				D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+			CD3DX12_RESOURCE_BARRIER::Transition(mVisibleTrees.Get(),
+				D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+		};
+		cmdList->ResourceBarrier(_countof(barriers), barriers);
+	}
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS Vegetation::VisibleTrees()const
+{
+	return mVisibleTrees->GetGPUVirtualAddress();
+}
+
+ID3D12Resource* Vegetation::DrawArguments()const
+{
+	return mDrawArgs.Get();
+}
+
+ID3D12CommandSignature* Vegetation::CommandSignature()const
+{
+	return mCommandSignature.Get();
+}
@@ -0,0 +1,101 @@
+//***************************************************************************************
+// Vegetation.h
+//
+// Tree billboards culled and drawn entirely on the GPU.  Every tree lives in a static
+// buffer; each frame a compute pass drops the trees outside the frustum or beyond a
+// distance, compacts the rest into VisibleTrees() and writes their count into the
+// instance count of a draw argument buffer.  The client then draws four vertices per
+// visible tree with ExecuteIndirect and expands each tree to a camera facing quad in
+// the vertex shader.  Like GpuWaves, this class does not draw anything itself.
+//***************************************************************************************
+
+#ifndef VEGETATION_H
+#define VEGETATION_H
+
+#include "../../Common/d3dUtil.h"
+
+// Must match TreeInstance in TreeSprite.hlsl and Vegetation.hlsl.
+struct TreeInstance
+{
+	// Centre of the base of the billboard.
+	DirectX::XMFLOAT3 Position;
+	float Width;
+	float Height;
+	UINT TextureIndex;
+	DirectX::XMFLOAT2 Pad;
+};
+
+// Root constants of the culling pass.  Must match cbCull in Vegetation.hlsl.
+struct VegetationCullConstants
+{
+	// World space, facing out of the frustum.
+	DirectX::XMFLOAT4 FrustumPlanes[6];
+	DirectX::XMFLOAT3 EyePosW;
+	float MaxDistance;
+	UINT TreeCount;
+};
+
+class Vegetation
+{
+public:
+	// Must match CULL_THREADS in Vegetation.hlsl.
+	static const UINT CullThreadGroupSize = 64;
+
+	// The culling root signature has the constants at 0, the trees SRV at 1 and
+	// the visible trees and draw argument UAVs at 2 and 3.
+	static const UINT CullConstantCount = sizeof(VegetationCullConstants) / 4;
+
+	// Records the upload of trees into cmdList.
+	Vegetation(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		const std::vector<TreeInstance>& trees);
+	Vegetation(const Vegetation& rhs) = delete;
+	Vegetation& operator=(const Vegetation& rhs) = delete;
+	~Vegetation();
+
+	UINT TreeCount()const;
+
+	// The buffers to keep resident.
+	std::array<ID3D12Resource*, 3> Resources()const;
+
+	// Call once the commands recorded by the constructor have executed.
+	void ReleaseUploadBuffers();
+
+	// Compacts the trees within maxDistance of eye that intersect frustum, or all of
+	// them if frustumCull is false.  On return VisibleTrees is readable by non-pixel
+	// shaders and DrawArguments by ExecuteIndirect.
+	void Cull(ID3D12GraphicsCommandList* cmdList, ID3D12RootSignature* rootSig, ID3D12PipelineState* pso,
+		const DirectX::BoundingFrustum& frustum, bool frustumCull, const DirectX::XMFLOAT3& eye, float maxDistance);
+
+	// Structured buffer of VisibleCount TreeInstances, for the vertex shader.
+	D3D12_GPU_VIRTUAL_ADDRESS VisibleTrees()const;
+
+	// One D3D12_DRAW_ARGUMENTS, for CommandSignature.
+	ID3D12Resource* DrawArguments()const;
+	ID3D12CommandSignature* CommandSignature()const;
+
+private:
+	void BuildResources(ID3D12GraphicsCommandList* cmdList, const std::vector<TreeInstance>& trees);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mTreeCount = 0;
+
+	// Every tree, in GENERIC_READ.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mTrees = nullptr;
+
+	// The survivors of the last cull, and the draw that reads them.  Rest in
+	// NON_PIXEL_SHADER_RESOURCE and INDIRECT_ARGUMENT between culls.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mVisibleTrees = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawArgs = nullptr;
+
+	// Draw arguments with no instances, copied over mDrawArgs before every cull.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawArgsReset = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> mCommandSignature = nullptr;
+
+	// Dropped by ReleaseUploadBuffers.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mTreesUploadBuffer = nullptr;
+};
+
+#endif // VEGETATION_H
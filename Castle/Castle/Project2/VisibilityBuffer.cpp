@@ -0,0 +1,107 @@
+//***************************************************************************************
+// VisibilityBuffer.cpp
+//***************************************************************************************
+
+#include "VisibilityBuffer.h"
+
+// No object.
+static const float gIdClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+UINT VisibilityBuffer::DescriptorCount(UINT bufferCount)
+{
+	return 1 + bufferCount;
+}
+
+VisibilityBuffer::VisibilityBuffer(ID3D12Device* device)
+{
+	md3dDevice = device;
+}
+
+VisibilityBuffer::~VisibilityBuffer()
+{
+}
+
+void VisibilityBuffer::SetIdState(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	desc.NumRenderTargets = RtvCount;
+	desc.RTVFormats[0] = Format;
+	desc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+}
+
+void VisibilityBuffer::Resize(UINT width, UINT height)
+{
+	if(mWidth == width && mHeight == height)
+		return;
+
+	mWidth = width;
+	mHeight = height;
+
+	D3D12_CLEAR_VALUE optClear;
+	optClear.Format = Format;
+	memcpy(optClear.Color, gIdClear, sizeof(optClear.Color));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(Format, mWidth, mHeight, 1, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+		D3D12_RESOURCE_STATE_RENDER_TARGET,
+		&optClear,
+		IID_PPV_ARGS(mIds.ReleaseAndGetAddressOf())));
+}
+
+void VisibilityBuffer::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+	UINT srvDescriptorSize,
+	const std::vector<ID3D12Resource*>& buffers,
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv)
+{
+	md3dDevice->CreateShaderResourceView(mIds.Get(), nullptr, hCpuSrv);
+
+	// Read as ByteAddressBuffers, whatever the buffers hold.
+	for(ID3D12Resource* buffer : buffers)
+	{
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = (UINT)(buffer->GetDesc().Width / 4);
+		srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+		md3dDevice->CreateShaderResourceView(buffer, &srvDesc, hCpuSrv.Offset(1, srvDescriptorSize));
+	}
+
+	mRtv = hCpuRtv;
+	md3dDevice->CreateRenderTargetView(mIds.Get(), nullptr, hCpuRtv);
+
+	mSrvs = hGpuSrv;
+}
+
+void VisibilityBuffer::Clear(ID3D12GraphicsCommandList* cmdList)
+{
+	cmdList->ClearRenderTargetView(mRtv, gIdClear, 0, nullptr);
+}
+
+void VisibilityBuffer::Bind(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE dsv)
+{
+	cmdList->OMSetRenderTargets(RtvCount, &mRtv, true, &dsv);
+}
+
+void VisibilityBuffer::Resolve(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso, UINT rootParameter,
+	D3D12_GPU_VIRTUAL_ADDRESS geometry, D3D12_CPU_DESCRIPTOR_HANDLE target)
+{
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mIds.Get(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	// Pixels no object covered are discarded, so the target keeps what was there.
+	cmdList->OMSetRenderTargets(1, &target, true, nullptr);
+	cmdList->SetPipelineState(pso);
+	cmdList->SetGraphicsRootDescriptorTable(rootParameter, mSrvs);
+	cmdList->SetGraphicsRootShaderResourceView(rootParameter + 1, geometry);
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdList->DrawInstanced(3, 1, 0, 0);
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mIds.Get(),
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+}
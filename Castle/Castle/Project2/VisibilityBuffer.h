@@ -0,0 +1,89 @@
+//***************************************************************************************
+// VisibilityBuffer.h
+//
+// A visibility buffer (Burns and Hunt 2013) for views where many layers of geometry
+// overlap.  An id pass rasterizes each object with a pixel shader that writes only
+// which triangle of which object is nearest, into one R32_UINT target, so covered
+// fragments cost a 4-byte write rather than a full shade.  A full-screen resolve then
+// shades each pixel once: it finds the triangle from the id, fetches and transforms
+// its vertices again and interpolates them at the pixel.
+//
+// An id is ((object index + 1) << TriangleBits) | primitive id within the draw; 0 is
+// the clear value, for pixels no object covered.
+//
+// The client draws the id pass with PSOs set up by SetIdState and supplies the
+// resolve PSO.  The resolve's table holds the id target's SRV followed by raw views
+// of the geometry's buffers, BuildDescriptors' block.  The target is single sampled,
+// like the scene.
+//***************************************************************************************
+
+#ifndef VISIBILITYBUFFER_H
+#define VISIBILITYBUFFER_H
+
+#include "../../Common/d3dUtil.h"
+
+class VisibilityBuffer
+{
+public:
+	static const DXGI_FORMAT Format = DXGI_FORMAT_R32_UINT;
+
+	// Must match VISIBILITY_TRIANGLE_BITS in Default.hlsl.  The rest of the id holds
+	// the object index plus one.
+	static const UINT TriangleBits = 19;
+	static const UINT MaxTriangles = 1u << TriangleBits;
+	static const UINT MaxObjects = (1u << (32 - TriangleBits)) - 1;
+
+	static const UINT RtvCount = 1;
+
+	// The id target's SRV and one raw view per geometry buffer.
+	static UINT DescriptorCount(UINT bufferCount);
+
+	VisibilityBuffer(ID3D12Device* device);
+	VisibilityBuffer(const VisibilityBuffer& rhs) = delete;
+	VisibilityBuffer& operator=(const VisibilityBuffer& rhs) = delete;
+	~VisibilityBuffer();
+
+	// Sets the render target and blending of desc for the id pass.  Depth is tested
+	// and written as the shading pass would.
+	static void SetIdState(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// Recreates the target at the new size; the GPU must be done with the old one.
+	// Call BuildDescriptors again afterwards.
+	void Resize(UINT width, UINT height);
+
+	// buffers are the geometry the resolve fetches from, in the order the
+	// VisibilityGeometry records index them.
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
+		UINT srvDescriptorSize,
+		const std::vector<ID3D12Resource*>& buffers,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuRtv);
+
+	// Clears the ids for a new frame.
+	void Clear(ID3D12GraphicsCommandList* cmdList);
+
+	// Binds the target with the scene's depth buffer.
+	void Bind(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE dsv);
+
+	// Shades the covered pixels into target.  The caller has set the root signature
+	// and everything else the resolve reads; rootParameter takes the table and
+	// rootParameter + 1 the records at geometry.  Leaves target bound without a depth
+	// buffer.
+	void Resolve(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso, UINT rootParameter,
+		D3D12_GPU_VIRTUAL_ADDRESS geometry, D3D12_CPU_DESCRIPTOR_HANDLE target);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mSrvs;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mRtv;
+
+	// Rests in RENDER_TARGET outside Resolve.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mIds = nullptr;
+};
+
+#endif // VISIBILITYBUFFER_H
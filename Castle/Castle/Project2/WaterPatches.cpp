@@ -0,0 +1,189 @@
+//***************************************************************************************
+// WaterPatches.cpp
+//***************************************************************************************
+
+#include "WaterPatches.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+WaterPatches::WaterPatches(const Waves& waves, int patchesPerSide, int patchQuads, int lodCount, int activeRadius)
+{
+	assert(waves.RowCount() == patchesPerSide*patchQuads + 1);
+	assert(waves.ColumnCount() == patchesPerSide*patchQuads + 1);
+	assert(lodCount > 0 && patchQuads % (1 << (lodCount - 1)) == 0);
+
+	mPatchesPerSide = patchesPerSide;
+	mPatchQuads = patchQuads;
+	mLodCount = lodCount;
+	mActiveRadius = activeRadius;
+
+	mGridColumns = waves.ColumnCount();
+	mSpatialStep = waves.SpatialStep();
+	mHalfWidth = 0.5f*(waves.ColumnCount() - 1)*mSpatialStep;
+	mHalfDepth = 0.5f*(waves.RowCount() - 1)*mSpatialStep;
+
+	mLods.assign(PatchCount(), 0);
+	mEdgeMasks.assign(PatchCount(), 0);
+}
+
+int WaterPatches::PatchCount()const
+{
+	return mPatchesPerSide*mPatchesPerSide;
+}
+
+int WaterPatches::PatchVertexCount()const
+{
+	return (mPatchQuads + 1)*(mPatchQuads + 1);
+}
+
+int WaterPatches::VertexCount()const
+{
+	return PatchCount()*PatchVertexCount();
+}
+
+int WaterPatches::GridIndex(int patch, int row, int col)const
+{
+	int patchRow = patch / mPatchesPerSide;
+	int patchCol = patch % mPatchesPerSide;
+	return (patchRow*mPatchQuads + row)*mGridColumns + patchCol*mPatchQuads + col;
+}
+
+BoundingBox WaterPatches::Bounds(int patch)const
+{
+	int patchRow = patch / mPatchesPerSide;
+	int patchCol = patch % mPatchesPerSide;
+	float size = mPatchQuads*mSpatialStep;
+
+	// The heights are animated, so bound the patch with some vertical slack.
+	BoundingBox bounds;
+	bounds.Center = XMFLOAT3(-mHalfWidth + (patchCol + 0.5f)*size, 0.0f, mHalfDepth - (patchRow + 0.5f)*size);
+	bounds.Extents = XMFLOAT3(0.5f*size, 2.0f, 0.5f*size);
+	return bounds;
+}
+
+void WaterPatches::BuildIndices(std::vector<std::uint16_t>& indices)
+{
+	assert(PatchVertexCount() <= 0x10000);
+
+	const int q = mPatchQuads;
+	auto vertex = [q](int row, int col) { return (std::uint16_t)(row*(q + 1) + col); };
+
+	mRanges.clear();
+	for(int lod = 0; lod < mLodCount; ++lod)
+	{
+		const int step = 1 << lod;
+		for(int mask = 0; mask < EdgeMaskCount; ++mask)
+		{
+			// On a stitched edge, points at odd multiples of step move back onto the
+			// even multiple before them, which the coarser neighbour also draws.
+			auto snapped = [=](int row, int col)
+			{
+				if((mask & North) && row == 0 && (col / step) % 2 == 1)
+					col -= step;
+				if((mask & South) && row == q && (col / step) % 2 == 1)
+					col -= step;
+				if((mask & West) && col == 0 && (row / step) % 2 == 1)
+					row -= step;
+				if((mask & East) && col == q && (row / step) % 2 == 1)
+					row -= step;
+				return vertex(row, col);
+			};
+
+			// The snapped triangles that collapse are left out.
+			auto triangle = [&indices](std::uint16_t a, std::uint16_t b, std::uint16_t c)
+			{
+				if(a != b && b != c && a != c)
+				{
+					indices.push_back(a);
+					indices.push_back(b);
+					indices.push_back(c);
+				}
+			};
+
+			IndexRange range;
+			range.StartIndexLocation = (unsigned int)indices.size();
+
+			// The winding of BuildWavesGeometry's grid.
+			for(int i = 0; i < q; i += step)
+			{
+				for(int j = 0; j < q; j += step)
+				{
+					triangle(snapped(i, j), snapped(i, j + step), snapped(i + step, j));
+					triangle(snapped(i + step, j), snapped(i, j + step), snapped(i + step, j + step));
+				}
+			}
+
+			range.IndexCount = (unsigned int)indices.size() - range.StartIndexLocation;
+			mRanges.push_back(range);
+		}
+	}
+}
+
+void WaterPatches::Update(const XMFLOAT3& eye)
+{
+	const float size = mPatchQuads*mSpatialStep;
+	mEyeCol = std::min(std::max((int)std::floor((eye.x + mHalfWidth) / size), 0), mPatchesPerSide - 1);
+	mEyeRow = std::min(std::max((int)std::floor((mHalfDepth - eye.z) / size), 0), mPatchesPerSide - 1);
+
+	// One level per ring of patches, so neighbours never differ by more than one.
+	for(int row = 0; row < mPatchesPerSide; ++row)
+	{
+		for(int col = 0; col < mPatchesPerSide; ++col)
+		{
+			int ring = std::max(std::abs(row - mEyeRow), std::abs(col - mEyeCol));
+			mLods[row*mPatchesPerSide + col] = std::min(std::max(ring - mActiveRadius, 0), mLodCount - 1);
+		}
+	}
+
+	for(int row = 0; row < mPatchesPerSide; ++row)
+	{
+		for(int col = 0; col < mPatchesPerSide; ++col)
+		{
+			int patch = row*mPatchesPerSide + col;
+			int lod = mLods[patch];
+
+			int mask = 0;
+			if(row > 0 && mLods[patch - mPatchesPerSide] > lod)
+				mask |= North;
+			if(row + 1 < mPatchesPerSide && mLods[patch + mPatchesPerSide] > lod)
+				mask |= South;
+			if(col > 0 && mLods[patch - 1] > lod)
+				mask |= West;
+			if(col + 1 < mPatchesPerSide && mLods[patch + 1] > lod)
+				mask |= East;
+			mEdgeMasks[patch] = mask;
+		}
+	}
+}
+
+int WaterPatches::Lod(int patch)const
+{
+	return mLods[patch];
+}
+
+WaterPatches::IndexRange WaterPatches::Indices(int patch)const
+{
+	return mRanges[mLods[patch]*EdgeMaskCount + mEdgeMasks[patch]];
+}
+
+Waves::Region WaterPatches::ActiveRegion()const
+{
+	int row0 = std::max(mEyeRow - mActiveRadius, 0);
+	int col0 = std::max(mEyeCol - mActiveRadius, 0);
+	int row1 = std::min(mEyeRow + mActiveRadius, mPatchesPerSide - 1);
+	int col1 = std::min(mEyeCol + mActiveRadius, mPatchesPerSide - 1);
+
+	// Up to and including the far edges' points.
+	return { row0*mPatchQuads, col0*mPatchQuads, (row1 + 1)*mPatchQuads + 1, (col1 + 1)*mPatchQuads + 1 };
+}
+
+bool WaterPatches::Overlaps(int patch, const Waves::Region& region)const
+{
+	int row0 = (patch / mPatchesPerSide)*mPatchQuads;
+	int col0 = (patch % mPatchesPerSide)*mPatchQuads;
+	return row0 < region.Row1 && row0 + mPatchQuads >= region.Row0 &&
+		col0 < region.Col1 && col0 + mPatchQuads >= region.Col0;
+}
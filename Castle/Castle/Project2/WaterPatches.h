@@ -0,0 +1,101 @@
+//***************************************************************************************
+// WaterPatches.h
+//
+// Splits the CPU wave grid into square patches, each drawn, culled and given a level
+// of detail on its own, so the water can cover a large lake.  A patch's vertices are
+// stored apart from its neighbours', copies of the grid points it covers, so every
+// patch indexes the same small mesh from its own base vertex and 16-bit indices do
+// for any grid size.
+//
+// Levels are picked by distance in patches from the one under the viewer: the patches
+// within ActiveRadius of it are drawn at full resolution and are the only ones
+// simulated; each ring beyond is drawn one level coarser, level l taking every 2^l-th
+// grid point.  Neighbours therefore differ by at most one level, and the finer of two
+// snaps the odd points of their shared edge onto the even ones the coarser draws, so
+// no cracks open between them.  Each level has an index range for every combination
+// of stitched edges.
+//***************************************************************************************
+
+#ifndef WATERPATCHES_H
+#define WATERPATCHES_H
+
+#include "Waves.h"
+#include <DirectXCollision.h>
+
+class WaterPatches
+{
+public:
+	// Edges of a patch stitched to a coarser neighbour, as a mask.  North is grid
+	// row 0's side, west column 0's.
+	enum Edge
+	{
+		North = 1,
+		South = 2,
+		West = 4,
+		East = 8,
+		EdgeMaskCount = 16
+	};
+
+	struct IndexRange
+	{
+		unsigned int IndexCount;
+		unsigned int StartIndexLocation;
+	};
+
+	// The grid must be patchesPerSide*patchQuads+1 points on a side, and patchQuads
+	// divisible by 2^(lodCount-1), so every level but the coarsest has an even number of
+	// quads along an edge to stitch.
+	WaterPatches(const Waves& waves, int patchesPerSide, int patchQuads, int lodCount, int activeRadius);
+	WaterPatches(const WaterPatches& rhs) = delete;
+	WaterPatches& operator=(const WaterPatches& rhs) = delete;
+
+	int PatchCount()const;
+	int PatchVertexCount()const;
+	int VertexCount()const;
+
+	// The grid point patch's local vertex (row, col) copies.
+	int GridIndex(int patch, int row, int col)const;
+
+	// The patch's box in the grid's space, with slack for the wave heights.
+	DirectX::BoundingBox Bounds(int patch)const;
+
+	// Every level's triangles with every combination of stitched edges, each a range
+	// of indices local to one patch's vertices.
+	void BuildIndices(std::vector<std::uint16_t>& indices);
+
+	// Picks the levels and stitched edges for a viewer at eye, in the grid's space.
+	void Update(const DirectX::XMFLOAT3& eye);
+
+	int Lod(int patch)const;
+	IndexRange Indices(int patch)const;
+
+	// The grid points of the patches within ActiveRadius of the viewer's, as of the
+	// last Update.
+	Waves::Region ActiveRegion()const;
+
+	// Whether patch covers any point of region.
+	bool Overlaps(int patch, const Waves::Region& region)const;
+
+private:
+	int mPatchesPerSide = 0;
+	int mPatchQuads = 0;
+	int mLodCount = 0;
+	int mActiveRadius = 0;
+
+	int mGridColumns = 0;
+	float mSpatialStep = 0.0f;
+	float mHalfWidth = 0.0f;
+	float mHalfDepth = 0.0f;
+
+	// By level, then edge mask.
+	std::vector<IndexRange> mRanges;
+
+	std::vector<int> mLods;
+	std::vector<int> mEdgeMasks;
+
+	// The patch under the viewer.
+	int mEyeRow = 0;
+	int mEyeCol = 0;
+};
+
+#endif // WATERPATCHES_H
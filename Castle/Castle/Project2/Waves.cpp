@@ -3,10 +3,11 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
+#include "../../Common/JobSystem.h"
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
 
 using namespace DirectX;
 
@@ -27,28 +28,27 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    mHalfWidth = (n - 1)*dx*0.5f;
+    mHalfDepth = (m - 1)*dx*0.5f;
 
-    // Generate grid vertices in system memory.
+    // The boundary rows and columns are never written, so they stay at zero
+    // height with straight-up normals.
+    for(auto& heights : mHeights)
+        heights.assign(m*n, 0.0f);
+    mNormalX.assign(m*n, 0.0f);
+    mNormalY.assign(m*n, 1.0f);
+    mNormalZ.assign(m*n, 0.0f);
+    mBackNormalX = mNormalX;
+    mBackNormalY = mNormalY;
+    mBackNormalZ = mNormalZ;
 
-    float halfWidth = (n - 1)*dx*0.5f;
-    float halfDepth = (m - 1)*dx*0.5f;
-    for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
+    const int maxBlocks = (m - 2 + StepBlockRows - 1) / StepBlockRows;
+    mHalos.assign((size_t)maxBlocks*2*n, 0.0f);
 
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+    mJobs = &JobSystem::Shared();
+
+    mRegion = { 1, 1, m - 1, n - 1 };
+    mRequestedRegion = mRegion;
 }
 
 Waves::~Waves()
@@ -85,73 +85,311 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Update(float dt)
+float Waves::SpatialStep()const
+{
+	return mSpatialStep;
+}
+
+float Waves::TimeStep()const
+{
+	return mTimeStep;
+}
+
+XMFLOAT3 Waves::TangentX(int i)const
+{
+	// The tangent (2dx, r-l, 0) is the normal (l-r, 2dx, b-t) rotated in the xy-plane.
+	XMVECTOR T = XMVector3Normalize(XMVectorSet(mNormalY[i], -mNormalX[i], 0.0f, 0.0f));
+
+	XMFLOAT3 tangent;
+	XMStoreFloat3(&tangent, T);
+	return tangent;
+}
+
+void Waves::StepRow(int i, float* out, int j0, int j1)const
+{
+	const int n = mNumCols;
+	const float* prev = &mHeights[mSimPrev][i*n];
+	const float* curr = &mHeights[mSimCurr][i*n];
+	const float* above = &mHeights[mSimCurr][(i-1)*n];
+	const float* below = &mHeights[mSimCurr][(i+1)*n];
+
+	const XMVECTOR k1 = XMVectorReplicate(mK1);
+	const XMVECTOR k2 = XMVectorReplicate(mK2);
+	const XMVECTOR k3 = XMVectorReplicate(mK3);
+
+	// Four columns at a time.  The j-1/j+1 neighbours make the loads unaligned
+	// whatever the row alignment, so use the unaligned load/store.
+	int j = j0;
+	for(; j + 4 <= j1; j += 4)
+	{
+		XMVECTOR neighbors = XMVectorAdd(
+			XMVectorAdd(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(below + j)),
+			            XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(above + j))),
+			XMVectorAdd(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j + 1)),
+			            XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j - 1))));
+
+		XMVECTOR h = XMVectorMultiply(k1, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(prev + j)));
+		h = XMVectorMultiplyAdd(k2, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j)), h);
+		h = XMVectorMultiplyAdd(k3, neighbors, h);
+
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(out + j), h);
+	}
+
+	for(; j < j1; ++j)
+	{
+		out[j] = mK1*prev[j] + mK2*curr[j] +
+			mK3*(below[j] + above[j] + curr[j+1] + curr[j-1]);
+	}
+}
+
+void Waves::NormalRow(int i, const float* above, const float* row, const float* below, int j0, int j1)
+{
+	const int n = mNumCols;
+	float* nx = &mBackNormalX[i*n];
+	float* ny = &mBackNormalY[i*n];
+	float* nz = &mBackNormalZ[i*n];
+
+	const float twoDx = 2.0f*mSpatialStep;
+	const XMVECTOR vTwoDx = XMVectorReplicate(twoDx);
+
+	int j = j0;
+	for(; j + 4 <= j1; j += 4)
+	{
+		XMVECTOR l = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + j - 1));
+		XMVECTOR r = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + j + 1));
+		XMVECTOR t = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(above + j));
+		XMVECTOR b = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(below + j));
+
+		XMVECTOR x = XMVectorSubtract(l, r);
+		XMVECTOR z = XMVectorSubtract(b, t);
+
+		// Normalize four (x, 2dx, z) vectors at once.
+		XMVECTOR lengthSq = XMVectorMultiplyAdd(x, x, XMVectorMultiplyAdd(z, z, XMVectorMultiply(vTwoDx, vTwoDx)));
+		XMVECTOR invLength = XMVectorReciprocalSqrt(lengthSq);
+
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(nx + j), XMVectorMultiply(x, invLength));
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(ny + j), XMVectorMultiply(vTwoDx, invLength));
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(nz + j), XMVectorMultiply(z, invLength));
+	}
+
+	for(; j < j1; ++j)
+	{
+		float x = row[j-1] - row[j+1];
+		float z = below[j] - above[j];
+		float invLength = 1.0f / sqrtf(x*x + twoDx*twoDx + z*z);
+
+		nx[j] = x*invLength;
+		ny[j] = twoDx*invLength;
+		nz[j] = z*invLength;
+	}
+}
+
+void Waves::SetJobSystem(JobSystem* jobs)
+{
+	mJobs = jobs;
+}
+
+void Waves::SetActiveRegion(const Region& region)
+{
+	mRequestedRegion.Row0 = std::max(region.Row0, 1);
+	mRequestedRegion.Col0 = std::max(region.Col0, 1);
+	mRequestedRegion.Row1 = std::max(std::min(region.Row1, mNumRows - 1), mRequestedRegion.Row0);
+	mRequestedRegion.Col1 = std::max(std::min(region.Col1, mNumCols - 1), mRequestedRegion.Col0);
+}
+
+const Waves::Region& Waves::ActiveRegion()const
+{
+	return mRegion;
+}
+
+bool Waves::InRegion(int i, int j)const
 {
-	static float t = 0;
+	return i >= mRegion.Row0 && i < mRegion.Row1 && j >= mRegion.Col0 && j < mRegion.Col1;
+}
 
-	// Accumulate time.
-	t += dt;
+void Waves::ApplyRequestedRegion()
+{
+	const Region& from = mRegion;
+	const Region& to = mRequestedRegion;
+	const int n = mNumCols;
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	// Points leaving the region keep their current height and normal in every
+	// buffer, so whichever buffers the steps and Publish pick leave them where they
+	// are.  Called from Publish, so the simulation's current buffer is the readers'.
+	// The readers' previous buffer is left alone so their blend still ends on the
+	// current height; Publish freezes it when it frees it.
+	auto freeze = [this, n](int i, int j0, int j1)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		if(j0 >= j1)
+			return;
+
+		const size_t first = (size_t)i*n + j0;
+		const size_t count = (size_t)(j1 - j0);
+		for(int b = 0; b < HeightBufferCount; ++b)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
-		});
+			if(b != mCurr && b != mPrev)
+				std::copy_n(&mHeights[mCurr][first], count, &mHeights[b][first]);
+		}
+		mPrevStale = true;
+		std::copy_n(&mNormalX[first], count, &mBackNormalX[first]);
+		std::copy_n(&mNormalY[first], count, &mBackNormalY[first]);
+		std::copy_n(&mNormalZ[first], count, &mBackNormalZ[first]);
+	};
+
+	for(int i = from.Row0; i < from.Row1; ++i)
+	{
+		if(i < to.Row0 || i >= to.Row1)
+			freeze(i, from.Col0, from.Col1);
+		else
+		{
+			freeze(i, from.Col0, std::min(from.Col1, to.Col0));
+			freeze(i, std::max(from.Col0, to.Col1), from.Col1);
+		}
+	}
+
+	mRegion = mRequestedRegion;
+}
+
+void Waves::FreezeOutsideRegion(int buffer)
+{
+	const int n = mNumCols;
+	auto copy = [this, n, buffer](int i, int j0, int j1)
+	{
+		const size_t first = (size_t)i*n + j0;
+		std::copy_n(&mHeights[mCurr][first], (size_t)(j1 - j0), &mHeights[buffer][first]);
+	};
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+	for(int i = 0; i < mNumRows; ++i)
+	{
+		if(i < mRegion.Row0 || i >= mRegion.Row1)
+			copy(i, 0, n);
+		else
+		{
+			copy(i, 0, mRegion.Col0);
+			copy(i, mRegion.Col1, n);
+		}
+	}
+}
+
+void Waves::Step()
+{
+	// Write to a buffer neither the readers nor the last two steps use.
+	int next = 0;
+	while(next == mPrev || next == mCurr || next == mSimPrev || next == mSimCurr)
+		++next;
+	std::vector<float>& nextHeights = mHeights[next];
 
-		t = 0.0f; // reset time
+	// A block plus its two halo rows stays in cache while the heights and then the
+	// normals of the block are computed.
+	const int blockRows = StepBlockRows;
+	const int regionRows = mRegion.Row1 - mRegion.Row0;
+	const int blockCount = (regionRows + blockRows - 1) / blockRows;
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+	// Only update the points of the active region, which never include the
+	// boundary; we use zero boundary conditions.
+	auto stepBlock = [this, blockRows, &nextHeights](UINT block)
+	{
+		const int n = mNumCols;
+		const int j0 = mRegion.Col0;
+		const int j1 = mRegion.Col1;
+		const int r0 = mRegion.Row0 + block*blockRows;
+		const int r1 = std::min(r0 + blockRows, mRegion.Row1);
+
+		// The normals of the first and last rows need the new heights of the
+		// neighbouring blocks' edge rows.  The old solutions are read-only during
+		// the step, so recompute those rows here rather than synchronize.
+		// Points outside the region, the boundary among them, hold the same
+		// height in every buffer and can be read from nextHeights.
+		// Each block has its own pair of rows; only [j0, j1) of them is read.
+		float* haloAbove = &mHalos[(size_t)block*2*n];
+		float* haloBelow = haloAbove + n;
+
+		const float* above = &nextHeights[(r0 - 1)*n];
+		if(r0 > mRegion.Row0)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			StepRow(r0 - 1, haloAbove, j0, j1);
+			above = haloAbove;
+		}
+
+		const float* below = &nextHeights[r1*n];
+		if(r1 < mRegion.Row1)
+		{
+			StepRow(r1, haloBelow, j0, j1);
+			below = haloBelow;
+		}
+
+		// Step row i, then finish the normals of row i-1 whose neighbours are
+		// now both known.
+		for(int i = r0; i < r1; ++i)
+		{
+			StepRow(i, &nextHeights[i*n], j0, j1);
+
+			if(i > r0)
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				const float* rowAbove = (i - 1 > r0) ? &nextHeights[(i-2)*n] : above;
+				NormalRow(i - 1, rowAbove, &nextHeights[(i-1)*n], &nextHeights[i*n], j0, j1);
 			}
-		});
+		}
+
+		const float* lastAbove = (r1 - 1 > r0) ? &nextHeights[(r1-2)*n] : above;
+		NormalRow(r1 - 1, lastAbove, &nextHeights[(r1-1)*n], below, j0, j1);
+	};
+
+	if(mJobs != nullptr)
+		mJobs->ParallelFor(0, (UINT)blockCount, 1, stepBlock);
+	else
+	{
+		for(int block = 0; block < blockCount; ++block)
+			stepBlock((UINT)block);
 	}
+
+	mSimPrev = mSimCurr;
+	mSimCurr = next;
+	++mStepsPending;
+}
+
+void Waves::Publish()
+{
+	if(mStepsPending > 0)
+	{
+		// The last two steps become the previous and current solutions; the buffers
+		// they replace are free for the next steps to overwrite.
+		const int released = mPrev;
+		mPrev = mSimPrev;
+		mCurr = mSimCurr;
+
+		// The steps only wrote the region, so the freed buffer still holds the
+		// heights the frozen points had before they froze.
+		if(mPrevStale)
+		{
+			FreezeOutsideRegion(released);
+			mPrevStale = false;
+		}
+
+		mNormalX.swap(mBackNormalX);
+		mNormalY.swap(mBackNormalY);
+		mNormalZ.swap(mBackNormalZ);
+
+		mStepsPending = 0;
+		++mRevision;
+	}
+
+	if(!mDisturbances.empty())
+	{
+		// A disturbance that would touch a frozen point is dropped: changing only its
+		// current height would make it flicker as the buffers rotate.
+		for(const auto& d : mDisturbances)
+		{
+			if(InRegion(d.I - 1, d.J - 1) && InRegion(d.I + 1, d.J + 1))
+				ApplyDisturbance(d.I, d.J, d.Magnitude);
+		}
+		mDisturbances.clear();
+		++mRevision;
+	}
+
+	if(mRequestedRegion.Row0 != mRegion.Row0 || mRequestedRegion.Row1 != mRegion.Row1 ||
+		mRequestedRegion.Col0 != mRegion.Col0 || mRequestedRegion.Col1 != mRegion.Col1)
+		ApplyRequestedRegion();
 }
 
 void Waves::Disturb(int i, int j, float magnitude)
@@ -160,13 +398,18 @@ void Waves::Disturb(int i, int j, float magnitude)
 	assert(i > 1 && i < mNumRows-2);
 	assert(j > 1 && j < mNumCols-2);
 
+	mDisturbances.push_back({ i, j, magnitude });
+}
+
+void Waves::ApplyDisturbance(int i, int j, float magnitude)
+{
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mHeights[mCurr][i*mNumCols+j]     += magnitude;
+	mHeights[mCurr][i*mNumCols+j+1]   += halfMag;
+	mHeights[mCurr][i*mNumCols+j-1]   += halfMag;
+	mHeights[mCurr][(i+1)*mNumCols+j] += halfMag;
+	mHeights[mCurr][(i-1)*mNumCols+j] += halfMag;
 }
 	
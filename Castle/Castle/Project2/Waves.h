@@ -4,14 +4,26 @@
 // Performs the calculations for the wave simulation.  After the simulation has been
 // updated, the client must copy the current solution into vertex buffers for rendering.
 // This class only does the calculations, it does not do any drawing.
+//
+// Step and Disturb never change the solution readers see: steps are written to back
+// buffers and disturbances are queued, and Publish makes both current.  So one thread
+// may step the simulation while another copies the current solution out, as long as
+// Publish runs while neither is busy.  The caller decides when to step; any number of
+// steps may run between Publishes.
+//
+// Only the points of the active region are stepped.  The rest keep the heights they
+// had when they left it, so a large grid can be simulated only around the viewer.
 //***************************************************************************************
 
 #ifndef WAVES_H
 #define WAVES_H
 
 #include <vector>
+#include <cstdint>
 #include <DirectXMath.h>
 
+class JobSystem;
+
 class Waves
 {
 public:
@@ -26,19 +38,85 @@ public:
 	int TriangleCount()const;
 	float Width()const;
 	float Depth()const;
+	float SpatialStep()const;
+	float TimeStep()const;
+
+	// Returns the solution at the ith grid point.  Only the heights are stored;
+	// x and z follow from the grid position.
+	DirectX::XMFLOAT3 Position(int i)const
+	{
+		int row = i / mNumCols;
+		int col = i - row*mNumCols;
+		return DirectX::XMFLOAT3(-mHalfWidth + col*mSpatialStep, mHeights[mCurr][i], mHalfDepth - row*mSpatialStep);
+	}
 
-	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+	// Returns the solution height at the ith grid point.
+	float Height(int i)const { return mHeights[mCurr][i]; }
+
+	// Returns the height at the ith grid point blended from the previous published
+	// solution, at 0, to the current one, at 1.
+	float Height(int i, float alpha)const
+	{
+		float prev = mHeights[mPrev][i];
+		return prev + alpha*(mHeights[mCurr][i] - prev);
+	}
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+	DirectX::XMFLOAT3 Normal(int i)const { return DirectX::XMFLOAT3(mNormalX[i], mNormalY[i], mNormalZ[i]); }
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+	DirectX::XMFLOAT3 TangentX(int i)const;
+
+	// Incremented whenever Publish changes the solution.  Never 0, so a copy tagged 0
+	// is always out of date.
+	std::uint64_t Revision()const { return mRevision; }
+
+	// Grid points [Row0, Row1) x [Col0, Col1).
+	struct Region
+	{
+		int Row0;
+		int Col0;
+		int Row1;
+		int Col1;
+	};
 
-	void Update(float dt);
+	// Steps only the points in region, clipped to the interior, from the next Publish
+	// on; the whole interior until set.  Disturbances outside it are dropped.
+	void SetActiveRegion(const Region& region);
+
+	// The region the steps since the last Publish covered.
+	const Region& ActiveRegion()const;
+
+	// The scheduler the step's row blocks run on; JobSystem::Shared() unless set.
+	// Null runs them all on the thread calling Update.
+	void SetJobSystem(JobSystem* jobs);
+
+	// Advances the unpublished solution by one time step.
+	void Step();
 	void Disturb(int i, int j, float magnitude);
 
+	// Makes the last step and the disturbances queued since current, then moves to
+	// the requested region.
+	void Publish();
+
+private:
+	// Writes the next height of columns [j0, j1) of row i to out.
+	void StepRow(int i, float* out, int j0, int j1)const;
+
+	// Computes the normals of columns [j0, j1) of row i from the new heights of rows
+	// i-1, i and i+1.
+	void NormalRow(int i, const float* above, const float* row, const float* below, int j0, int j1);
+
+	bool InRegion(int i, int j)const;
+
+	// Freezes the points leaving the region and makes the requested region current.
+	void ApplyRequestedRegion();
+
+	// Copies the current heights of the points outside the region into buffer.
+	void FreezeOutsideRegion(int buffer);
+
+	void ApplyDisturbance(int i, int j, float magnitude);
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -54,10 +132,52 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    std::uint64_t mRevision = 1;
+
+	JobSystem* mJobs = nullptr;
+
+	Region mRegion = {};
+	Region mRequestedRegion = {};
+
+	int mStepsPending = 0;
+
+	struct Disturbance
+	{
+		int I;
+		int J;
+		float Magnitude;
+	};
+	std::vector<Disturbance> mDisturbances;
+
+    float mHalfWidth = 0.0f;
+    float mHalfDepth = 0.0f;
+
+    // Heights and normals in structure-of-arrays form, one float per grid point,
+    // row-major.  Readers see the mPrev and mCurr height buffers.  The steps since
+    // the last Publish run ahead of them: each reads mSimPrev and mSimCurr and writes
+    // a buffer none of the four name, which becomes mSimCurr, along with the mBack
+    // normals.  Publish then makes the simulation's two buffers the readers' and
+    // swaps the normals.  Five buffers always leave one free.  Points outside the
+    // region hold the same height in every buffer but mPrev, which keeps the heights
+    // they were frozen from until Publish frees it (mPrevStale).
+    static const int HeightBufferCount = 5;
+    std::vector<float> mHeights[HeightBufferCount];
+    int mPrev = 0;
+    int mCurr = 1;
+    int mSimPrev = 0;
+    int mSimCurr = 1;
+    bool mPrevStale = false;
+    std::vector<float> mNormalX;
+    std::vector<float> mNormalY;
+    std::vector<float> mNormalZ;
+    std::vector<float> mBackNormalX;
+    std::vector<float> mBackNormalY;
+    std::vector<float> mBackNormalZ;
+
+    // Rows per Step task, and the new heights of the rows just above and below each
+    // task's block: two rows per block of the largest region.
+    static const int StepBlockRows = 16;
+    std::vector<float> mHalos;
 };
 
 #endif // WAVES_H
\ No newline at end of file
@@ -0,0 +1,128 @@
+//***************************************************************************************
+// AllocationTracker.cpp
+//***************************************************************************************
+
+#include "AllocationTracker.h"
+
+#if ALLOCATION_TRACKER_ENABLED
+
+#include <atomic>
+#include <crtdbg.h>
+#include <cstdio>
+
+namespace
+{
+	// At most one report per this many frames, so a steady leak of allocations does
+	// not flood the output; the frames flagged in between are counted in the next.
+	const UINT ReportIntervalFrames = 60;
+
+	bool gInstalled = false;
+	_CRT_ALLOC_HOOK gPreviousHook = nullptr;
+	UINT gWarmupFrames = 0;
+	UINT64 gFrame = 0;
+
+	// Set by EndFrame once the warm-up is over.
+	std::atomic<bool> gChecking(false);
+
+	// Written by the hook on any thread, read and cleared by EndFrame.
+	std::atomic<UINT> gAllocations(0);
+	std::atomic<size_t> gBytes(0);
+	std::atomic<UINT> gCheckedAllocations(0);
+	std::atomic<const char*> gFirstCheckedScope(nullptr);
+	std::atomic<long> gFirstCheckedRequest(0);
+
+	UINT gLastFrameAllocations = 0;
+	size_t gLastFrameBytes = 0;
+	UINT64 gLastReportFrame = 0;
+	UINT gFramesFlaggedSinceReport = 0;
+
+	thread_local const char* gCheckedScope = nullptr;
+
+	// Runs inside the CRT heap, so it must not allocate.
+	int __cdecl AllocHook(int allocType, void* userData, size_t size, int blockType,
+		long requestNumber, const unsigned char* filename, int lineNumber)
+	{
+		// The CRT's own blocks pass through with requestNumber 0 and no accounting.
+		if(blockType != _CRT_BLOCK && (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC))
+		{
+			gAllocations.fetch_add(1, std::memory_order_relaxed);
+			gBytes.fetch_add(size, std::memory_order_relaxed);
+
+			const char* scope = gCheckedScope;
+			if(scope != nullptr && gChecking.load(std::memory_order_relaxed))
+			{
+				if(gCheckedAllocations.fetch_add(1, std::memory_order_relaxed) == 0)
+				{
+					gFirstCheckedScope.store(scope, std::memory_order_relaxed);
+					gFirstCheckedRequest.store(requestNumber, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		if(gPreviousHook != nullptr)
+			return gPreviousHook(allocType, userData, size, blockType, requestNumber, filename, lineNumber);
+		return TRUE;
+	}
+}
+
+void AllocationTracker::Install(UINT warmupFrames)
+{
+	if(gInstalled)
+		return;
+
+	gInstalled = true;
+	gWarmupFrames = warmupFrames;
+	gChecking.store(warmupFrames == 0, std::memory_order_relaxed);
+	gPreviousHook = _CrtSetAllocHook(AllocHook);
+}
+
+void AllocationTracker::EndFrame()
+{
+	gLastFrameAllocations = gAllocations.exchange(0, std::memory_order_relaxed);
+	gLastFrameBytes = gBytes.exchange(0, std::memory_order_relaxed);
+
+	UINT checked = gCheckedAllocations.exchange(0, std::memory_order_relaxed);
+	if(checked > 0)
+	{
+		++gFramesFlaggedSinceReport;
+		if(gLastReportFrame == 0 || gFrame - gLastReportFrame >= ReportIntervalFrames)
+		{
+			char text[256];
+			sprintf_s(text, "***Allocations: frame %llu made %u heap allocations in checked scopes, "
+				"the first in %s (CRT request %ld); %u frames flagged since the last report.\n",
+				gFrame, checked, gFirstCheckedScope.load(std::memory_order_relaxed),
+				gFirstCheckedRequest.load(std::memory_order_relaxed), gFramesFlaggedSinceReport);
+			OutputDebugStringA(text);
+
+			gLastReportFrame = gFrame;
+			gFramesFlaggedSinceReport = 0;
+		}
+	}
+
+	++gFrame;
+	if(gFrame >= gWarmupFrames)
+		gChecking.store(true, std::memory_order_relaxed);
+}
+
+UINT AllocationTracker::LastFrameAllocations()
+{
+	return gLastFrameAllocations;
+}
+
+size_t AllocationTracker::LastFrameBytes()
+{
+	return gLastFrameBytes;
+}
+
+AllocationTracker::CheckedScope::CheckedScope(const char* name)
+	: mOuterName(gCheckedScope)
+{
+	gCheckedScope = name;
+}
+
+AllocationTracker::CheckedScope::~CheckedScope()
+{
+	gCheckedScope = mOuterName;
+}
+
+#endif // ALLOCATION_TRACKER_ENABLED
@@ -0,0 +1,73 @@
+//***************************************************************************************
+// AllocationTracker.h
+//
+// Counts the CRT heap allocations made each frame, through the debug CRT's allocation
+// hook, and flags the ones made inside scopes marked with CHECK_ALLOCATIONS_SCOPE, such
+// as Update and Draw, once the app has had WarmupFrames to grow its containers and
+// arenas to their steady-state sizes.  A flagged frame is reported to the debugger
+// output with the scope and the CRT request number of its first allocation there,
+// which _CrtSetBreakAlloc can then stop on.
+//
+// Needs the debug CRT; ALLOCATION_TRACKER_ENABLED defaults to on in debug builds only
+// and compiles all of it out otherwise.
+//***************************************************************************************
+
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#ifndef ALLOCATION_TRACKER_ENABLED
+#if defined(DEBUG) || defined(_DEBUG)
+#define ALLOCATION_TRACKER_ENABLED 1
+#else
+#define ALLOCATION_TRACKER_ENABLED 0
+#endif
+#endif
+
+#if ALLOCATION_TRACKER_ENABLED
+
+#include <windows.h>
+
+namespace AllocationTracker
+{
+	// Hooks the CRT heap, chaining whatever hook was there.  Allocations in checked
+	// scopes are flagged from the frame after warmupFrames on.
+	void Install(UINT warmupFrames);
+
+	// Closes the frame's counts, reporting it if it was flagged.  Call once a frame,
+	// from the thread that runs the frames.
+	void EndFrame();
+
+	// Heap allocations, on any thread, and their bytes in the last frame ended.
+	UINT LastFrameAllocations();
+	size_t LastFrameBytes();
+
+	// Marks the calling thread's allocations as checked while it lives.  name must be
+	// a string literal or otherwise outlive the tracker.  Scopes nest; the innermost
+	// names the allocations.
+	class CheckedScope
+	{
+	public:
+		explicit CheckedScope(const char* name);
+		~CheckedScope();
+
+		CheckedScope(const CheckedScope& rhs) = delete;
+		CheckedScope& operator=(const CheckedScope& rhs) = delete;
+
+	private:
+		const char* mOuterName;
+	};
+}
+
+#define ALLOCATION_CONCAT_INNER(a, b) a##b
+#define ALLOCATION_CONCAT(a, b) ALLOCATION_CONCAT_INNER(a, b)
+
+#define CHECK_ALLOCATIONS_SCOPE(name) \
+	AllocationTracker::CheckedScope ALLOCATION_CONCAT(checkedScope, __LINE__)(name)
+
+#else
+
+#define CHECK_ALLOCATIONS_SCOPE(name)
+
+#endif // ALLOCATION_TRACKER_ENABLED
+
+#endif // ALLOCATIONTRACKER_H
@@ -0,0 +1,218 @@
+//***************************************************************************************
+// CachedCommandList.cpp
+//***************************************************************************************
+
+#include "CachedCommandList.h"
+
+CachedCommandList::CachedCommandList(ID3D12GraphicsCommandList* cmdList)
+	: mCmdList(cmdList)
+{
+}
+
+ID3D12GraphicsCommandList* CachedCommandList::Get()const
+{
+	return mCmdList;
+}
+
+void CachedCommandList::Invalidate()
+{
+	mPso = nullptr;
+	mRootSignature = nullptr;
+	mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	mGeometry = nullptr;
+	mShadingRateKnown = false;
+	mShadingRateImageKnown = false;
+	InvalidateRootArgs();
+}
+
+void CachedCommandList::SetPipelineState(ID3D12PipelineState* pso)
+{
+	if(pso == mPso)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mCmdList->SetPipelineState(pso);
+	mPso = pso;
+	++mStats.Issued;
+}
+
+void CachedCommandList::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+{
+	if(rootSignature == mRootSignature)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mCmdList->SetGraphicsRootSignature(rootSignature);
+	mRootSignature = rootSignature;
+	InvalidateRootArgs();
+	++mStats.Issued;
+}
+
+void CachedCommandList::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+{
+	if(topology == mTopology)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	mCmdList->IASetPrimitiveTopology(topology);
+	mTopology = topology;
+	++mStats.Issued;
+}
+
+void CachedCommandList::SetGeometry(const MeshGeometry* geo)
+{
+	if(geo == mGeometry)
+	{
+		mStats.Elided += 2;
+		return;
+	}
+
+	D3D12_VERTEX_BUFFER_VIEW vbv = geo->VertexBufferView();
+	D3D12_INDEX_BUFFER_VIEW ibv = geo->IndexBufferView();
+	mCmdList->IASetVertexBuffers(0, 1, &vbv);
+	mCmdList->IASetIndexBuffer(&ibv);
+	mGeometry = geo;
+	mStats.Issued += 2;
+}
+
+void CachedCommandList::SetGraphicsRootDescriptorTable(UINT rootParameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+{
+	if(UpdateRootArg(rootParameter, RootArgType::Table, baseDescriptor.ptr))
+		mCmdList->SetGraphicsRootDescriptorTable(rootParameter, baseDescriptor);
+}
+
+void CachedCommandList::SetGraphicsRootConstantBufferView(UINT rootParameter, D3D12_GPU_VIRTUAL_ADDRESS address)
+{
+	if(UpdateRootArg(rootParameter, RootArgType::Cbv, address))
+		mCmdList->SetGraphicsRootConstantBufferView(rootParameter, address);
+}
+
+void CachedCommandList::SetGraphicsRootShaderResourceView(UINT rootParameter, D3D12_GPU_VIRTUAL_ADDRESS address)
+{
+	if(UpdateRootArg(rootParameter, RootArgType::Srv, address))
+		mCmdList->SetGraphicsRootShaderResourceView(rootParameter, address);
+}
+
+void CachedCommandList::SetGraphicsRootUnorderedAccessView(UINT rootParameter, D3D12_GPU_VIRTUAL_ADDRESS address)
+{
+	if(UpdateRootArg(rootParameter, RootArgType::Uav, address))
+		mCmdList->SetGraphicsRootUnorderedAccessView(rootParameter, address);
+}
+
+void CachedCommandList::SetGraphicsRoot32BitConstant(UINT rootParameter, UINT value, UINT destOffset)
+{
+	// Only the last constant written per parameter is remembered; a different
+	// offset is always forwarded.
+	if(UpdateRootArg(rootParameter, RootArgType::Constant, ((UINT64)destOffset << 32) | value))
+		mCmdList->SetGraphicsRoot32BitConstant(rootParameter, value, destOffset);
+}
+
+void CachedCommandList::RSSetShadingRate(D3D12_SHADING_RATE baseShadingRate, const D3D12_SHADING_RATE_COMBINER* combiners)
+{
+	D3D12_SHADING_RATE_COMBINER passthrough[D3D12_RS_SET_SHADING_RATE_COMBINER_COUNT] =
+	{
+		D3D12_SHADING_RATE_COMBINER_PASSTHROUGH, D3D12_SHADING_RATE_COMBINER_PASSTHROUGH
+	};
+	if(combiners == nullptr)
+		combiners = passthrough;
+
+	if(mShadingRateKnown && baseShadingRate == mShadingRate &&
+		memcmp(combiners, mShadingRateCombiners, sizeof(mShadingRateCombiners)) == 0)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	if(mCmdList5 == nullptr)
+		ThrowIfFailed(mCmdList->QueryInterface(IID_PPV_ARGS(&mCmdList5)));
+
+	mCmdList5->RSSetShadingRate(baseShadingRate, combiners);
+	mShadingRateKnown = true;
+	mShadingRate = baseShadingRate;
+	memcpy(mShadingRateCombiners, combiners, sizeof(mShadingRateCombiners));
+	++mStats.Issued;
+}
+
+void CachedCommandList::RSSetShadingRateImage(ID3D12Resource* shadingRateImage)
+{
+	if(mShadingRateImageKnown && shadingRateImage == mShadingRateImage)
+	{
+		++mStats.Elided;
+		return;
+	}
+
+	if(mCmdList5 == nullptr)
+		ThrowIfFailed(mCmdList->QueryInterface(IID_PPV_ARGS(&mCmdList5)));
+
+	mCmdList5->RSSetShadingRateImage(shadingRateImage);
+	mShadingRateImageKnown = true;
+	mShadingRateImage = shadingRateImage;
+	++mStats.Issued;
+}
+
+void CachedCommandList::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount,
+	UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+{
+	mCmdList->DrawIndexedInstanced(indexCountPerInstance, instanceCount,
+		startIndexLocation, baseVertexLocation, startInstanceLocation);
+	++mStats.Draws;
+}
+
+void CachedCommandList::DispatchMesh(UINT threadGroupCountX, UINT threadGroupCountY, UINT threadGroupCountZ)
+{
+	if(mCmdList6 == nullptr)
+		ThrowIfFailed(mCmdList->QueryInterface(IID_PPV_ARGS(&mCmdList6)));
+
+	mCmdList6->DispatchMesh(threadGroupCountX, threadGroupCountY, threadGroupCountZ);
+	++mStats.Draws;
+}
+
+void CachedCommandList::ExecuteIndirect(ID3D12CommandSignature* commandSignature, UINT maxCommandCount,
+	ID3D12Resource* argumentBuffer, UINT64 argumentBufferOffset,
+	ID3D12Resource* countBuffer, UINT64 countBufferOffset)
+{
+	mCmdList->ExecuteIndirect(commandSignature, maxCommandCount,
+		argumentBuffer, argumentBufferOffset, countBuffer, countBufferOffset);
+	++mStats.Draws;
+
+	mGeometry = nullptr;
+	InvalidateRootArgs();
+}
+
+const CommandListStats& CachedCommandList::Stats()const
+{
+	return mStats;
+}
+
+bool CachedCommandList::UpdateRootArg(UINT rootParameter, RootArgType type, UINT64 value)
+{
+	if(rootParameter >= MaxRootParameters)
+	{
+		++mStats.Issued;
+		return true;
+	}
+
+	RootArg& arg = mRootArgs[rootParameter];
+	if(arg.Type == type && arg.Value == value)
+	{
+		++mStats.Elided;
+		return false;
+	}
+
+	arg.Type = type;
+	arg.Value = value;
+	++mStats.Issued;
+	return true;
+}
+
+void CachedCommandList::InvalidateRootArgs()
+{
+	for(auto& arg : mRootArgs)
+		arg = RootArg();
+}
@@ -0,0 +1,123 @@
+//***************************************************************************************
+// CachedCommandList.h
+//
+// Thin recorder over a graphics command list that remembers the PSO, root signature,
+// topology, geometry and root arguments it last set and drops calls that would set
+// them to the same value again.  Geometry is tracked by MeshGeometry, so the buffer
+// views are only built when it changes.  Counts the calls forwarded and elided.
+//
+// State set on the underlying list directly is not seen; call Invalidate afterwards.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+struct CommandListStats
+{
+	UINT Issued = 0;
+	UINT Elided = 0;
+	UINT Draws = 0;
+
+	CommandListStats& operator+=(const CommandListStats& rhs)
+	{
+		Issued += rhs.Issued;
+		Elided += rhs.Elided;
+		Draws += rhs.Draws;
+		return *this;
+	}
+};
+
+class CachedCommandList
+{
+public:
+	explicit CachedCommandList(ID3D12GraphicsCommandList* cmdList);
+	CachedCommandList(const CachedCommandList& rhs) = delete;
+	CachedCommandList& operator=(const CachedCommandList& rhs) = delete;
+
+	ID3D12GraphicsCommandList* Get()const;
+
+	// Forgets everything, so the next call of each kind is forwarded.
+	void Invalidate();
+
+	void SetPipelineState(ID3D12PipelineState* pso);
+
+	// Changing the root signature resets every root argument.
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature);
+
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology);
+
+	// Binds geo's vertex buffer to slot 0 and its index buffer.
+	void SetGeometry(const MeshGeometry* geo);
+
+	void SetGraphicsRootDescriptorTable(UINT rootParameter, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor);
+	void SetGraphicsRootConstantBufferView(UINT rootParameter, D3D12_GPU_VIRTUAL_ADDRESS address);
+	void SetGraphicsRootShaderResourceView(UINT rootParameter, D3D12_GPU_VIRTUAL_ADDRESS address);
+	void SetGraphicsRootUnorderedAccessView(UINT rootParameter, D3D12_GPU_VIRTUAL_ADDRESS address);
+	void SetGraphicsRoot32BitConstant(UINT rootParameter, UINT value, UINT destOffset);
+
+	// Through ID3D12GraphicsCommandList5, which the device must support.  Null
+	// combiners are both passthrough.
+	void RSSetShadingRate(D3D12_SHADING_RATE baseShadingRate, const D3D12_SHADING_RATE_COMBINER* combiners);
+	void RSSetShadingRateImage(ID3D12Resource* shadingRateImage);
+
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount,
+		UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation);
+
+	// Through ID3D12GraphicsCommandList6, which the device must support.
+	void DispatchMesh(UINT threadGroupCountX, UINT threadGroupCountY, UINT threadGroupCountZ);
+
+	// The command signature may rebind the geometry and root arguments, so those are
+	// forgotten afterwards.  With a count buffer, the command count is the lesser of
+	// maxCommandCount and the UINT at countBufferOffset.
+	void ExecuteIndirect(ID3D12CommandSignature* commandSignature, UINT maxCommandCount,
+		ID3D12Resource* argumentBuffer, UINT64 argumentBufferOffset,
+		ID3D12Resource* countBuffer = nullptr, UINT64 countBufferOffset = 0);
+
+	const CommandListStats& Stats()const;
+
+private:
+	enum class RootArgType : UINT
+	{
+		Unset = 0,
+		Table,
+		Cbv,
+		Srv,
+		Uav,
+		Constant
+	};
+
+	struct RootArg
+	{
+		RootArgType Type = RootArgType::Unset;
+		UINT64 Value = 0;
+	};
+
+	// True if the argument changed and the call should be forwarded.
+	bool UpdateRootArg(UINT rootParameter, RootArgType type, UINT64 value);
+	void InvalidateRootArgs();
+
+private:
+	static const UINT MaxRootParameters = 16;
+
+	ID3D12GraphicsCommandList* mCmdList = nullptr;
+
+	ID3D12PipelineState* mPso = nullptr;
+	ID3D12RootSignature* mRootSignature = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	const MeshGeometry* mGeometry = nullptr;
+	RootArg mRootArgs[MaxRootParameters];
+
+	// Queried on the first shading rate call.
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList5> mCmdList5 = nullptr;
+	bool mShadingRateKnown = false;
+	D3D12_SHADING_RATE mShadingRate = D3D12_SHADING_RATE_1X1;
+	D3D12_SHADING_RATE_COMBINER mShadingRateCombiners[D3D12_RS_SET_SHADING_RATE_COMBINER_COUNT] = {};
+	bool mShadingRateImageKnown = false;
+	ID3D12Resource* mShadingRateImage = nullptr;
+
+	// Queried on the first mesh shader dispatch.
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList6> mCmdList6 = nullptr;
+
+	CommandListStats mStats;
+};
@@ -0,0 +1,142 @@
+//***************************************************************************************
+// CpuProfiler.cpp
+//***************************************************************************************
+
+#include "CpuProfiler.h"
+
+#if CPU_PROFILER_ENABLED
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct Zone
+	{
+		const char* Name;
+		const char* Category;
+		__int64 Begin;
+		__int64 End;
+	};
+
+	// Written only by its owning thread.  Head counts every zone ever recorded;
+	// the slot is Head % Capacity, so old zones are overwritten once it wraps.
+	struct ThreadRing
+	{
+		static const size_t Capacity = 1 << 14;
+
+		DWORD ThreadId = 0;
+		std::atomic<size_t> Head;
+		Zone Zones[Capacity];
+
+		ThreadRing() : Head(0) {}
+	};
+
+	// Taken only when a thread records its first zone and when exporting.
+	std::mutex gRingsMutex;
+	std::vector<std::unique_ptr<ThreadRing>> gRings;
+
+	ThreadRing* CurrentRing()
+	{
+		thread_local ThreadRing* ring = nullptr;
+		if(ring == nullptr)
+		{
+			auto newRing = std::make_unique<ThreadRing>();
+			newRing->ThreadId = GetCurrentThreadId();
+
+			std::lock_guard<std::mutex> lock(gRingsMutex);
+			ring = newRing.get();
+			gRings.push_back(std::move(newRing));
+		}
+		return ring;
+	}
+
+	// Calls f for each zone currently held by ring.
+	template<typename F>
+	void ForEachZone(const ThreadRing& ring, F f)
+	{
+		size_t head = ring.Head.load(std::memory_order_acquire);
+		size_t first = head > ThreadRing::Capacity ? head - ThreadRing::Capacity : 0;
+		for(size_t i = first; i < head; ++i)
+			f(ring.Zones[i % ThreadRing::Capacity]);
+	}
+}
+
+void CpuProfiler::Record(const char* name, const char* category, __int64 begin, __int64 end)
+{
+	ThreadRing* ring = CurrentRing();
+
+	size_t head = ring->Head.load(std::memory_order_relaxed);
+	ring->Zones[head % ThreadRing::Capacity] = { name, category, begin, end };
+	ring->Head.store(head + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::ExportChromeTrace(const std::wstring& filename)
+{
+	std::ofstream fout(filename);
+	if(!fout)
+		return false;
+
+	__int64 countsPerSec;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+	double usPerCount = 1000000.0 / (double)countsPerSec;
+
+	std::lock_guard<std::mutex> lock(gRingsMutex);
+
+	// Make the timestamps relative to the earliest zone so they stay readable.
+	__int64 origin = MAXLONGLONG;
+	for(const auto& ring : gRings)
+		ForEachZone(*ring, [&](const Zone& z) { if(z.Begin < origin) origin = z.Begin; });
+
+	fout << "{\"traceEvents\":[\n";
+
+	bool first = true;
+	for(const auto& ring : gRings)
+	{
+		ForEachZone(*ring, [&](const Zone& z)
+		{
+			if(!first)
+				fout << ",\n";
+			first = false;
+
+			fout << "{\"name\":\"" << z.Name << "\",\"cat\":\"" << z.Category
+				<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->ThreadId
+				<< ",\"ts\":" << (z.Begin - origin) * usPerCount
+				<< ",\"dur\":" << (z.End - z.Begin) * usPerCount << "}";
+		});
+	}
+
+	fout << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return true;
+}
+
+double CpuProfiler::AverageMs(const char* name)
+{
+	__int64 countsPerSec;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+
+	std::lock_guard<std::mutex> lock(gRingsMutex);
+
+	__int64 total = 0;
+	size_t count = 0;
+	for(const auto& ring : gRings)
+	{
+		ForEachZone(*ring, [&](const Zone& z)
+		{
+			if(strcmp(z.Name, name) == 0)
+			{
+				total += z.End - z.Begin;
+				++count;
+			}
+		});
+	}
+
+	return count > 0 ? 1000.0 * total / ((double)countsPerSec * count) : 0.0;
+}
+
+#endif // CPU_PROFILER_ENABLED
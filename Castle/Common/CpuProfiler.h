@@ -0,0 +1,78 @@
+//***************************************************************************************
+// CpuProfiler.h
+//
+// Scoped CPU timing zones on the QueryPerformanceCounter clock GameTimer uses.  Each
+// thread writes completed zones into its own fixed-size ring, so recording takes no
+// locks; ExportChromeTrace writes the rings as a Chrome trace (chrome://tracing,
+// Perfetto).  Zones opened with PROFILE_WAIT_SCOPE are tagged "wait" so time spent
+// blocked on fences and the swap chain shows up apart from real work.
+//
+// Define CPU_PROFILER_ENABLED to 0 to compile all of it out.
+//***************************************************************************************
+
+#ifndef CPUPROFILER_H
+#define CPUPROFILER_H
+
+#ifndef CPU_PROFILER_ENABLED
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+#if CPU_PROFILER_ENABLED
+
+#include <windows.h>
+#include <string>
+
+namespace CpuProfiler
+{
+	// Records one completed zone on the calling thread.  name must be a string
+	// literal or otherwise outlive the profiler.
+	void Record(const char* name, const char* category, __int64 begin, __int64 end);
+
+	// Writes every zone still held in the rings.  Zones being written while this
+	// runs may be dropped.  Returns false if the file could not be opened.
+	bool ExportChromeTrace(const std::wstring& filename);
+
+	// Average milliseconds of the zones named name over what the rings hold.
+	double AverageMs(const char* name);
+
+	class ScopedZone
+	{
+	public:
+		ScopedZone(const char* name, const char* category)
+			: mName(name), mCategory(category)
+		{
+			QueryPerformanceCounter((LARGE_INTEGER*)&mBegin);
+		}
+		~ScopedZone()
+		{
+			__int64 end;
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+			Record(mName, mCategory, mBegin, end);
+		}
+
+		ScopedZone(const ScopedZone& rhs) = delete;
+		ScopedZone& operator=(const ScopedZone& rhs) = delete;
+
+	private:
+		const char* mName;
+		const char* mCategory;
+		__int64 mBegin;
+	};
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#define PROFILE_SCOPE(name) \
+	CpuProfiler::ScopedZone PROFILE_CONCAT(profileZone, __LINE__)(name, "cpu")
+#define PROFILE_WAIT_SCOPE(name) \
+	CpuProfiler::ScopedZone PROFILE_CONCAT(profileZone, __LINE__)(name, "wait")
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_WAIT_SCOPE(name)
+
+#endif // CPU_PROFILER_ENABLED
+
+#endif // CPUPROFILER_H
@@ -128,6 +128,10 @@ struct handle_closer { void operator()(HANDLE h) { if (h) CloseHandle(h); } };
 
 typedef public std::unique_ptr<void, handle_closer> ScopedHandle;
 
+struct view_unmapper { void operator()(void* p) { if (p) UnmapViewOfFile(p); } };
+
+typedef public std::unique_ptr<void, view_unmapper> ScopedMappedView;
+
 inline HANDLE safe_handle( HANDLE h ) { return (h == INVALID_HANDLE_VALUE) ? 0 : h; }
 
 template<UINT TNameLength>
@@ -144,33 +148,26 @@ inline void SetDebugObjectName(_In_ ID3D11DeviceChild* resource, _In_ const char
 };
 
 //--------------------------------------------------------------------------------------
-static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
-                                        std::unique_ptr<uint8_t[]>& ddsData,
-                                        DDS_HEADER** header,
-                                        uint8_t** bitData,
-                                        size_t* bitSize
-                                      )
+static HRESULT OpenTextureFile( _In_z_ const wchar_t* fileName,
+                                ScopedHandle& hFile,
+                                LARGE_INTEGER* fileSize
+                              )
 {
-    if (!header || !bitData || !bitSize)
-    {
-        return E_POINTER;
-    }
-
     // open the file
 #if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
-    ScopedHandle hFile( safe_handle( CreateFile2( fileName,
-                                                  GENERIC_READ,
-                                                  FILE_SHARE_READ,
-                                                  OPEN_EXISTING,
-                                                  nullptr ) ) );
+    hFile.reset( safe_handle( CreateFile2( fileName,
+                                           GENERIC_READ,
+                                           FILE_SHARE_READ,
+                                           OPEN_EXISTING,
+                                           nullptr ) ) );
 #else
-    ScopedHandle hFile( safe_handle( CreateFileW( fileName,
-                                                  GENERIC_READ,
-                                                  FILE_SHARE_READ,
-                                                  nullptr,
-                                                  OPEN_EXISTING,
-                                                  FILE_ATTRIBUTE_NORMAL,
-                                                  nullptr ) ) );
+    hFile.reset( safe_handle( CreateFileW( fileName,
+                                           GENERIC_READ,
+                                           FILE_SHARE_READ,
+                                           nullptr,
+                                           OPEN_EXISTING,
+                                           FILE_ATTRIBUTE_NORMAL,
+                                           nullptr ) ) );
 #endif
 
     if ( !hFile )
@@ -204,38 +201,26 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
         return E_FAIL;
     }
 
-    // create enough space for the file data
-    ddsData.reset( new (std::nothrow) uint8_t[ FileSize.LowPart ] );
-    if (!ddsData)
-    {
-        return E_OUTOFMEMORY;
-    }
-
-    // read the data in
-    DWORD BytesRead = 0;
-    if (!ReadFile( hFile.get(),
-                   ddsData.get(),
-                   FileSize.LowPart,
-                   &BytesRead,
-                   nullptr
-                 ))
-    {
-        return HRESULT_FROM_WIN32( GetLastError() );
-    }
-
-    if (BytesRead < FileSize.LowPart)
-    {
-        return E_FAIL;
-    }
+    *fileSize = FileSize;
+    return S_OK;
+}
 
+//--------------------------------------------------------------------------------------
+static HRESULT ParseTextureData( _In_reads_bytes_(ddsDataSize) uint8_t* ddsData,
+                                 _In_ size_t ddsDataSize,
+                                 DDS_HEADER** header,
+                                 uint8_t** bitData,
+                                 size_t* bitSize
+                               )
+{
     // DDS files always start with the same magic number ("DDS ")
-    uint32_t dwMagicNumber = *( const uint32_t* )( ddsData.get() );
+    uint32_t dwMagicNumber = *( const uint32_t* )( ddsData );
     if (dwMagicNumber != DDS_MAGIC)
     {
         return E_FAIL;
     }
 
-    auto hdr = reinterpret_cast<DDS_HEADER*>( ddsData.get() + sizeof( uint32_t ) );
+    auto hdr = reinterpret_cast<DDS_HEADER*>( ddsData + sizeof( uint32_t ) );
 
     // Verify header to validate DDS file
     if (hdr->size != sizeof(DDS_HEADER) ||
@@ -250,7 +235,7 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
         (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
     {
         // Must be long enough for both headers and magic value
-        if (FileSize.LowPart < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
+        if (ddsDataSize < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
         {
             return E_FAIL;
         }
@@ -262,12 +247,60 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
     *header = hdr;
     ptrdiff_t offset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
                        + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
-    *bitData = ddsData.get() + offset;
-    *bitSize = FileSize.LowPart - offset;
+    *bitData = ddsData + offset;
+    *bitSize = ddsDataSize - offset;
 
     return S_OK;
 }
 
+//--------------------------------------------------------------------------------------
+static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
+                                        std::unique_ptr<uint8_t[]>& ddsData,
+                                        DDS_HEADER** header,
+                                        uint8_t** bitData,
+                                        size_t* bitSize
+                                      )
+{
+    if (!header || !bitData || !bitSize)
+    {
+        return E_POINTER;
+    }
+
+    ScopedHandle hFile;
+    LARGE_INTEGER FileSize = { 0 };
+    HRESULT hr = OpenTextureFile( fileName, hFile, &FileSize );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // create enough space for the file data
+    ddsData.reset( new (std::nothrow) uint8_t[ FileSize.LowPart ] );
+    if (!ddsData)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // read the data in
+    DWORD BytesRead = 0;
+    if (!ReadFile( hFile.get(),
+                   ddsData.get(),
+                   FileSize.LowPart,
+                   &BytesRead,
+                   nullptr
+                 ))
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    if (BytesRead < FileSize.LowPart)
+    {
+        return E_FAIL;
+    }
+
+    return ParseTextureData( ddsData.get(), FileSize.LowPart, header, bitData, bitSize );
+}
+
 
 //--------------------------------------------------------------------------------------
 // Return the BPP for a particular format
@@ -1241,7 +1274,10 @@ static HRESULT CreateD3DResources12(
 	_In_ bool isCubeMap,
 	_In_reads_opt_(mipCount*arraySize) D3D12_SUBRESOURCE_DATA* initData,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	_In_ D3D12_RESOURCE_STATES afterState,
+	_In_opt_ const DDS_UPLOAD_REGION* uploadRegion,
+	_Out_opt_ UINT64* requiredSize
 	)
 {
 	if (device == nullptr)
@@ -1269,6 +1305,61 @@ static HRESULT CreateD3DResources12(
 		texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 		texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
+		const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
+
+		if (uploadRegion)
+		{
+			// Lay the subresources out directly in the caller's upload memory, and
+			// make sure they fit before creating anything.
+			const size_t layoutBytes = sizeof(D3D12_PLACED_SUBRESOURCE_FOOTPRINT) + sizeof(UINT) + sizeof(UINT64);
+			std::unique_ptr<uint8_t[]> layoutData(new (std::nothrow) uint8_t[layoutBytes * num2DSubresources]);
+			if (!layoutData)
+				return E_OUTOFMEMORY;
+
+			auto layouts = reinterpret_cast<D3D12_PLACED_SUBRESOURCE_FOOTPRINT*>(layoutData.get());
+			auto rowSizes = reinterpret_cast<UINT64*>(layouts + num2DSubresources);
+			auto numRows = reinterpret_cast<UINT*>(rowSizes + num2DSubresources);
+
+			UINT64 totalBytes = 0;
+			device->GetCopyableFootprints(&texDesc, 0, num2DSubresources, uploadRegion->Offset,
+				layouts, numRows, rowSizes, &totalBytes);
+
+			if (requiredSize)
+				*requiredSize = totalBytes;
+
+			if (totalBytes > uploadRegion->Size)
+				return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+
+			hr = device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&texDesc,
+				D3D12_RESOURCE_STATE_COPY_DEST,
+				nullptr,
+				IID_PPV_ARGS(&texture)
+				);
+
+			if (FAILED(hr))
+			{
+				texture = nullptr;
+				return hr;
+			}
+
+			// initData points into the caller's mapping, so this is the only copy
+			// the texels take on the CPU.
+			if (UpdateSubresources(cmdList, texture.Get(), uploadRegion->Buffer, 0, num2DSubresources,
+				totalBytes, layouts, numRows, rowSizes, initData) != totalBytes)
+			{
+				texture = nullptr;
+				return E_FAIL;
+			}
+
+			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+				D3D12_RESOURCE_STATE_COPY_DEST, afterState));
+
+			return hr;
+		}
+
 		hr = device->CreateCommittedResource(
 			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 			D3D12_HEAP_FLAG_NONE,
@@ -1285,7 +1376,6 @@ static HRESULT CreateD3DResources12(
 		}
 		else
 		{
-			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
 			const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, num2DSubresources);
 
 			hr = device->CreateCommittedResource(
@@ -1309,7 +1399,7 @@ static HRESULT CreateD3DResources12(
 				UpdateSubresources(cmdList, texture.Get(), textureUploadHeap.Get(), 0, 0, num2DSubresources, initData);
 
 				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
-					D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+					D3D12_RESOURCE_STATE_COPY_DEST, afterState));
 			}
 		}
 	} break;
@@ -1678,7 +1768,10 @@ static HRESULT CreateTextureFromDDS12(
 	_In_ size_t maxsize,
 	_In_ bool forceSRGB,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	_In_ D3D12_RESOURCE_STATES afterState,
+	_In_opt_ const DDS_UPLOAD_REGION* uploadRegion,
+	_Out_opt_ UINT64* requiredSize)
 {
 	HRESULT hr = S_OK;
 
@@ -1867,7 +1960,10 @@ static HRESULT CreateTextureFromDDS12(
 			isCubeMap,
 			initData.get(),
 			texture, 
-			textureUploadHeap);
+			textureUploadHeap,
+			afterState,
+			uploadRegion,
+			requiredSize);
 	}
 
 	return hr;
@@ -1979,7 +2075,10 @@ HRESULT DirectX::CreateDDSTextureFromMemory12(
 		maxsize,
 		false,
 		texture,
-		textureUploadHeap
+		textureUploadHeap,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+		nullptr,
+		nullptr
 		);
 
 	if (SUCCEEDED(hr))
@@ -2140,7 +2239,8 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	_Out_ ComPtr<ID3D12Resource>& texture,
 	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap,
 	_In_ size_t maxsize,
-	_Out_opt_ DDS_ALPHA_MODE* alphaMode)
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode,
+	_In_ D3D12_RESOURCE_STATES afterState)
 {
 	if (texture)
 	{
@@ -2172,7 +2272,7 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	}
 
 	hr = CreateTextureFromDDS12(device, cmdList, header,
-		bitData, bitSize, maxsize, false, texture, textureUploadHeap);
+		bitData, bitSize, maxsize, false, texture, textureUploadHeap, afterState, nullptr, nullptr);
 
 	if (SUCCEEDED(hr))
 	{
@@ -2228,6 +2328,175 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	return hr;
 }
 
+HRESULT DirectX::CreateDDSTextureFromFileMapped12(_In_ ID3D12Device* device,
+	_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_z_ const wchar_t* szFileName,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	_In_ const DDS_UPLOAD_REGION& uploadRegion,
+	_Out_opt_ UINT64* requiredSize,
+	_In_ size_t maxsize,
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode,
+	_In_ D3D12_RESOURCE_STATES afterState)
+{
+	if (texture)
+	{
+		texture = nullptr;
+	}
+	if (requiredSize)
+	{
+		*requiredSize = 0;
+	}
+	if (alphaMode)
+	{
+		*alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+	}
+
+	if (!device || !cmdList || !szFileName || !uploadRegion.Buffer ||
+		(uploadRegion.Offset % D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT) != 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	ScopedHandle hFile;
+	LARGE_INTEGER fileSize = { 0 };
+	HRESULT hr = OpenTextureFile(szFileName, hFile, &fileSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// The texels are read straight out of the mapping as they are written to the
+	// upload region; the file is never staged in a heap allocation.
+	ScopedHandle hMapping(CreateFileMappingW(hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+	if (!hMapping)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	ScopedMappedView view(MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0));
+	if (!view)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	DDS_HEADER* header = nullptr;
+	uint8_t* bitData = nullptr;
+	size_t bitSize = 0;
+
+	// The view is read-only; the parsed pointers are only ever read through.
+	hr = ParseTextureData(static_cast<uint8_t*>(view.get()), fileSize.LowPart, &header, &bitData, &bitSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	ComPtr<ID3D12Resource> unusedUploadHeap;
+	hr = CreateTextureFromDDS12(device, cmdList, header,
+		bitData, bitSize, maxsize, false, texture, unusedUploadHeap, afterState, &uploadRegion, requiredSize);
+
+	if (SUCCEEDED(hr) && alphaMode)
+	{
+		*alphaMode = GetAlphaMode(header);
+	}
+
+	return hr;
+}
+
+HRESULT DirectX::GetDDSTextureLayout12(_In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+	_In_ size_t ddsDataSize,
+	_Out_ D3D12_RESOURCE_DESC& desc,
+	_Out_ std::vector<D3D12_SUBRESOURCE_DATA>& subresources)
+{
+	desc = {};
+	subresources.clear();
+
+	if (!ddsData)
+	{
+		return E_INVALIDARG;
+	}
+
+	if (ddsDataSize < (sizeof(uint32_t) + sizeof(DDS_HEADER)))
+	{
+		return E_FAIL;
+	}
+
+	DDS_HEADER* header = nullptr;
+	uint8_t* bitData = nullptr;
+	size_t bitSize = 0;
+
+	// ParseTextureData only offsets into the data; nothing is written through it.
+	HRESULT hr = ParseTextureData(const_cast<uint8_t*>(ddsData), ddsDataSize, &header, &bitData, &bitSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	UINT arraySize = 1;
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+
+	size_t mipCount = header->mipMapCount;
+	if (0 == mipCount) mipCount = 1;
+
+	if ((header->ddspf.flags & DDS_FOURCC) && (MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC))
+	{
+		auto d3d10ext = reinterpret_cast<const DDS_HEADER_DXT10*>((const char*)header + sizeof(DDS_HEADER));
+
+		arraySize = d3d10ext->arraySize;
+		if (arraySize == 0)
+			return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+		if (d3d10ext->resourceDimension != D3D11_RESOURCE_DIMENSION_TEXTURE2D ||
+			(d3d10ext->miscFlag & D3D11_RESOURCE_MISC_TEXTURECUBE) ||
+			BitsPerPixel(d3d10ext->dxgiFormat) == 0)
+		{
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+		}
+
+		format = d3d10ext->dxgiFormat;
+	}
+	else
+	{
+		format = GetDXGIFormat(header->ddspf);
+
+		if (format == DXGI_FORMAT_UNKNOWN ||
+			(header->flags & DDS_HEADER_FLAGS_VOLUME) ||
+			(header->caps2 & DDS_CUBEMAP))
+		{
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+		}
+	}
+
+	if ((mipCount > D3D12_REQ_MIP_LEVELS) ||
+		(arraySize > D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION) ||
+		(header->width > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION) ||
+		(header->height > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION))
+	{
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+
+	subresources.resize(mipCount * arraySize);
+
+	size_t skipMip = 0;
+	size_t twidth = 0;
+	size_t theight = 0;
+	size_t tdepth = 0;
+
+	hr = FillInitData12(
+		header->width, header->height, 1, mipCount, arraySize, format, 0, bitSize, bitData,
+		twidth, theight, tdepth, skipMip, subresources.data()
+		);
+	if (FAILED(hr))
+	{
+		subresources.clear();
+		return hr;
+	}
+
+	desc = CD3DX12_RESOURCE_DESC::Tex2D(format, header->width, header->height,
+		static_cast<UINT16>(arraySize), static_cast<UINT16>(mipCount));
+
+	return S_OK;
+}
+
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                            ID3D11DeviceContext* d3dContext,
@@ -25,6 +25,7 @@
 #include <wrl.h>
 #include <d3d11_1.h>
 #include "d3dx12.h"
+#include <vector>
 
 #pragma warning(push)
 #pragma warning(disable : 4005)
@@ -55,6 +56,16 @@ namespace DirectX
         DDS_ALPHA_MODE_CUSTOM        = 4,
     };
 
+    // Caller-owned upload memory for CreateDDSTextureFromFileMapped12.  Buffer must
+    // be an upload heap buffer and Offset a multiple of
+    // D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT.
+    struct DDS_UPLOAD_REGION
+    {
+        ID3D12Resource* Buffer;
+        UINT64          Offset;
+        UINT64          Size;
+    };
+
     // Standard version
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
@@ -89,9 +100,37 @@ namespace DirectX
 		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
 		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap,
 		                               _In_ size_t maxsize = 0,
-		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
+		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+		                               _In_ D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE
 		                               );
 
+	// Memory-maps the file and writes each subresource from the mapping straight into
+	// uploadRegion, laid out with GetCopyableFootprints, then records the copies.  No
+	// intermediate copy of the file is made and no upload heap is created.  If the
+	// region is too small nothing is created or recorded, *requiredSize holds the size
+	// needed and HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER) is returned.
+	HRESULT CreateDDSTextureFromFileMapped12(_In_ ID3D12Device* device,
+		                                     _In_ ID3D12GraphicsCommandList* cmdList,
+		                                     _In_z_ const wchar_t* szFileName,
+		                                     _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                                     _In_ const DDS_UPLOAD_REGION& uploadRegion,
+		                                     _Out_opt_ UINT64* requiredSize,
+		                                     _In_ size_t maxsize = 0,
+		                                     _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+		                                     _In_ D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE
+		                                     );
+
+	// Parses an in-memory DDS file without creating anything: desc describes the 2D
+	// texture it holds, with every mip, and subresources points each mip of each slice
+	// at its texels inside ddsData.  Cube maps, volumes and 1D textures return
+	// HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED).  For callers that place the texels
+	// themselves, such as into reserved resources.
+	HRESULT GetDDSTextureLayout12(_In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+		                          _In_ size_t ddsDataSize,
+		                          _Out_ D3D12_RESOURCE_DESC& desc,
+		                          _Out_ std::vector<D3D12_SUBRESOURCE_DATA>& subresources
+		                          );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
@@ -0,0 +1,191 @@
+//***************************************************************************************
+// DescriptorAllocator.cpp
+//***************************************************************************************
+
+#include "DescriptorAllocator.h"
+
+using Microsoft::WRL::ComPtr;
+
+DescriptorAllocator::DescriptorAllocator(ID3D12Device* device, UINT initialCapacity)
+	: md3dDevice(device)
+{
+	mDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	Grow(std::max(initialCapacity, 1u));
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+}
+
+UINT DescriptorAllocator::Allocate(UINT count)
+{
+	// First fit; the heap is small enough that a linear scan is not worth avoiding.
+	auto it = mFreeRanges.begin();
+	for(; it != mFreeRanges.end(); ++it)
+	{
+		if(it->Count >= count)
+			break;
+	}
+
+	if(it == mFreeRanges.end())
+	{
+		// The new descriptors are appended at the old capacity, which may extend a
+		// free range at the end, so search again.
+		Grow(mCapacity + count);
+		return Allocate(count);
+	}
+
+	UINT index = it->Begin;
+	it->Begin += count;
+	it->Count -= count;
+	if(it->Count == 0)
+		mFreeRanges.erase(it);
+
+	mAllocatedCount += count;
+
+	return index;
+}
+
+void DescriptorAllocator::Free(UINT index, UINT count)
+{
+	PendingFree pending;
+	pending.Descriptors.Begin = index;
+	pending.Descriptors.Count = count;
+	pending.Fence = mFrameFence;
+	mPendingFrees.push_back(pending);
+
+	mAllocatedCount -= count;
+}
+
+CD3DX12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::CpuHandle(UINT index)const
+{
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(mCpuHeap->GetCPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
+
+void DescriptorAllocator::Publish(UINT index, UINT count)
+{
+	md3dDevice->CopyDescriptorsSimple(count,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mGpuHeap->GetCPUDescriptorHandleForHeapStart(), index, mDescriptorSize),
+		CpuHandle(index),
+		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE DescriptorAllocator::GpuHandle(UINT index)const
+{
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(mGpuHeap->GetGPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
+
+ID3D12DescriptorHeap* DescriptorAllocator::Heap()const
+{
+	return mGpuHeap.Get();
+}
+
+UINT DescriptorAllocator::Capacity()const
+{
+	return mCapacity;
+}
+
+UINT DescriptorAllocator::AllocatedCount()const
+{
+	return mAllocatedCount;
+}
+
+UINT DescriptorAllocator::Generation()const
+{
+	return mGeneration;
+}
+
+void DescriptorAllocator::BeginFrame(UINT64 frameFence, UINT64 completedFence)
+{
+	mFrameFence = frameFence;
+
+	for(auto it = mPendingFrees.begin(); it != mPendingFrees.end(); )
+	{
+		if(it->Fence <= completedFence)
+		{
+			Release(it->Descriptors);
+			it = mPendingFrees.erase(it);
+		}
+		else
+			++it;
+	}
+
+	mRetiredHeaps.erase(std::remove_if(mRetiredHeaps.begin(), mRetiredHeaps.end(),
+		[completedFence](const RetiredHeap& retired) { return retired.Fence <= completedFence; }),
+		mRetiredHeaps.end());
+}
+
+void DescriptorAllocator::Grow(UINT minCapacity)
+{
+	UINT capacity = std::max(mCapacity * 2, minCapacity);
+	if(capacity > MaxCapacity)
+		capacity = MaxCapacity;
+	if(capacity < minCapacity)
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = capacity;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+
+	ComPtr<ID3D12DescriptorHeap> cpuHeap;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&cpuHeap)));
+
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+
+	ComPtr<ID3D12DescriptorHeap> gpuHeap;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&gpuHeap)));
+
+	// Carry the existing views over.  Shader-visible heaps may be slow to read from
+	// the CPU, so both copies come from the CPU-only heap.
+	if(mCapacity > 0)
+	{
+		md3dDevice->CopyDescriptorsSimple(mCapacity, cpuHeap->GetCPUDescriptorHandleForHeapStart(),
+			mCpuHeap->GetCPUDescriptorHandleForHeapStart(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		md3dDevice->CopyDescriptorsSimple(mCapacity, gpuHeap->GetCPUDescriptorHandleForHeapStart(),
+			mCpuHeap->GetCPUDescriptorHandleForHeapStart(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		// Frames up to this one may still have the old heap bound.
+		RetiredHeap retired;
+		retired.Heap = mGpuHeap;
+		retired.Fence = mFrameFence;
+		mRetiredHeaps.push_back(retired);
+
+		++mGeneration;
+	}
+
+	Range added;
+	added.Begin = mCapacity;
+	added.Count = capacity - mCapacity;
+
+	mCpuHeap = cpuHeap;
+	mGpuHeap = gpuHeap;
+	mCapacity = capacity;
+
+	Release(added);
+}
+
+void DescriptorAllocator::Release(Range range)
+{
+	auto next = std::lower_bound(mFreeRanges.begin(), mFreeRanges.end(), range,
+		[](const Range& a, const Range& b) { return a.Begin < b.Begin; });
+
+	// Merge with the neighbours so larger allocations can still be satisfied.
+	if(next != mFreeRanges.end() && range.Begin + range.Count == next->Begin)
+	{
+		range.Count += next->Count;
+		next = mFreeRanges.erase(next);
+	}
+	if(next != mFreeRanges.begin())
+	{
+		auto prev = next - 1;
+		if(prev->Begin + prev->Count == range.Begin)
+		{
+			prev->Count += range.Count;
+			return;
+		}
+	}
+
+	mFreeRanges.insert(next, range);
+}
@@ -0,0 +1,90 @@
+//***************************************************************************************
+// DescriptorAllocator.h
+//
+// Hands out CBV/SRV/UAV descriptors from one shader-visible heap, so views can be
+// created and released at run time instead of in a fixed layout.  Views are written
+// to a CPU-only copy of the heap and Publish copies them to the shader-visible one;
+// the CPU copy lets the heap grow by doubling, which creates a larger shader-visible
+// heap from it and bumps Generation.  GPU handles taken before a growth point into the
+// old heap, which is kept until the frames that may reference it have retired.
+//
+// Freed ranges are held back the same way and go back on the free list only once the
+// GPU has passed the frame that freed them.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(ID3D12Device* device, UINT initialCapacity = 64);
+	DescriptorAllocator(const DescriptorAllocator& rhs) = delete;
+	DescriptorAllocator& operator=(const DescriptorAllocator& rhs) = delete;
+	~DescriptorAllocator();
+
+	// Returns the first of count consecutive descriptors, growing the heap if no
+	// free range is large enough.
+	UINT Allocate(UINT count = 1);
+	void Free(UINT index, UINT count = 1);
+
+	// Where to create a view; it is not visible to shaders until published.
+	CD3DX12_CPU_DESCRIPTOR_HANDLE CpuHandle(UINT index)const;
+	void Publish(UINT index, UINT count = 1);
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE GpuHandle(UINT index)const;
+	ID3D12DescriptorHeap* Heap()const;
+
+	UINT Capacity()const;
+	UINT AllocatedCount()const;
+
+	// Changes whenever the shader-visible heap is replaced.
+	UINT Generation()const;
+
+	// Call once per frame, before anything is allocated or freed for it.  frameFence
+	// is the value the frame will signal; completedFence the last one the GPU passed.
+	void BeginFrame(UINT64 frameFence, UINT64 completedFence);
+
+private:
+	struct Range
+	{
+		UINT Begin = 0;
+		UINT Count = 0;
+	};
+
+	struct PendingFree
+	{
+		Range Descriptors;
+		UINT64 Fence = 0;
+	};
+
+	struct RetiredHeap
+	{
+		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> Heap;
+		UINT64 Fence = 0;
+	};
+
+	void Grow(UINT minCapacity);
+	void Release(Range range);
+
+private:
+	// Resource binding tiers 1 and 2 guarantee a CBV/SRV/UAV heap this large.
+	static const UINT MaxCapacity = 1000000;
+
+	ID3D12Device* md3dDevice = nullptr;
+	UINT mDescriptorSize = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mCpuHeap;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mGpuHeap;
+	UINT mCapacity = 0;
+	UINT mAllocatedCount = 0;
+	UINT mGeneration = 0;
+
+	// Sorted by Begin with adjacent ranges merged.
+	std::vector<Range> mFreeRanges;
+
+	UINT64 mFrameFence = 0;
+	std::vector<PendingFree> mPendingFrees;
+	std::vector<RetiredHeap> mRetiredHeaps;
+};
@@ -0,0 +1,228 @@
+//***************************************************************************************
+// DeviceCaps.cpp
+//***************************************************************************************
+
+#include "DeviceCaps.h"
+#include <cwctype>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	std::wstring Lower(std::wstring s)
+	{
+		for(auto& c : s)
+			c = (wchar_t)std::towlower(c);
+		return s;
+	}
+
+	// Each feature query fails on runtimes that predate it, leaving data as it was.
+	template<typename T>
+	bool Query(ID3D12Device* device, D3D12_FEATURE feature, T& data)
+	{
+		return SUCCEEDED(device->CheckFeatureSupport(feature, &data, sizeof(data)));
+	}
+
+	const wchar_t* ShaderModelName(D3D_SHADER_MODEL model)
+	{
+		switch(model)
+		{
+		case D3D_SHADER_MODEL_6_0: return L"6.0";
+		case D3D_SHADER_MODEL_6_1: return L"6.1";
+		case D3D_SHADER_MODEL_6_2: return L"6.2";
+		case D3D_SHADER_MODEL_6_3: return L"6.3";
+		case D3D_SHADER_MODEL_6_4: return L"6.4";
+		case D3D_SHADER_MODEL_6_5: return L"6.5";
+		case D3D_SHADER_MODEL_6_6: return L"6.6";
+		case D3D_SHADER_MODEL_6_7: return L"6.7";
+		default: return L"5.1";
+		}
+	}
+
+	const wchar_t* FeatureLevelName(D3D_FEATURE_LEVEL level)
+	{
+		switch(level)
+		{
+		case D3D_FEATURE_LEVEL_12_2: return L"12_2";
+		case D3D_FEATURE_LEVEL_12_1: return L"12_1";
+		case D3D_FEATURE_LEVEL_12_0: return L"12_0";
+		case D3D_FEATURE_LEVEL_11_1: return L"11_1";
+		default: return L"11_0";
+		}
+	}
+}
+
+bool DeviceCaps::BindlessSupported()const
+{
+	// Tier 1 caps a stage at 128 SRVs, too few for a table over the whole heap.
+	return ResourceBindingTier >= D3D12_RESOURCE_BINDING_TIER_2;
+}
+
+bool DeviceCaps::VariableRateShadingSupported()const
+{
+	return VariableShadingRateTier >= D3D12_VARIABLE_SHADING_RATE_TIER_1;
+}
+
+bool DeviceCaps::MeshShadersSupported()const
+{
+	return MeshShaderTier >= D3D12_MESH_SHADER_TIER_1 && HighestShaderModel >= D3D_SHADER_MODEL_6_5;
+}
+
+bool DeviceCaps::SamplerFeedbackSupported()const
+{
+	return SamplerFeedbackTier >= D3D12_SAMPLER_FEEDBACK_TIER_0_9;
+}
+
+std::wstring DeviceCaps::Report()const
+{
+	std::wostringstream out;
+	out << L"Adapter: " << AdapterName << (Software ? L" (software)" : L"") << L"\n";
+	out << L"  video memory:        " << DedicatedVideoMemory / (1024 * 1024) << L" MB\n";
+	out << L"  feature level:       " << FeatureLevelName(FeatureLevel) << L"\n";
+	out << L"  shader model:        " << ShaderModelName(HighestShaderModel) << L"\n";
+	out << L"  resource binding:    tier " << (int)ResourceBindingTier << L"\n";
+	out << L"  resource heaps:      tier " << (int)ResourceHeapTier << L"\n";
+	out << L"  tiled resources:     tier " << (int)TiledResourcesTier << L"\n";
+	out << L"  variable rate:       tier " << (int)VariableShadingRateTier << L"\n";
+	out << L"  mesh shaders:        " << (MeshShadersSupported() ? L"yes" : L"no") << L"\n";
+	out << L"  sampler feedback:    " << (SamplerFeedbackSupported() ? L"yes" : L"no") << L"\n";
+	out << L"  wave intrinsics:     ";
+	if(WaveOps)
+		out << WaveLaneCountMin << L"-" << WaveLaneCountMax << L" lanes\n";
+	else
+		out << L"no\n";
+	out << L"  enhanced barriers:   " << (EnhancedBarriers ? L"yes" : L"no") << L"\n";
+	out << L"  GPU upload heaps:    " << (GpuUploadHeap ? L"yes" : L"no") << L"\n";
+	return out.str();
+}
+
+ComPtr<IDXGIAdapter1> SelectAdapter(IDXGIFactory1* factory, DXGI_GPU_PREFERENCE preference, const std::wstring& name)
+{
+	// DXGI 1.6 ranks adapters by preference; before it, take them as listed.
+	ComPtr<IDXGIFactory6> factory6;
+	factory->QueryInterface(IID_PPV_ARGS(&factory6));
+
+	std::wstring wanted = Lower(name);
+	ComPtr<IDXGIAdapter1> first;
+
+	ComPtr<IDXGIAdapter1> adapter;
+	for(UINT i = 0; ; ++i)
+	{
+		HRESULT hr = factory6 != nullptr ?
+			factory6->EnumAdapterByGpuPreference(i, preference, IID_PPV_ARGS(adapter.ReleaseAndGetAddressOf())) :
+			factory->EnumAdapters1(i, adapter.ReleaseAndGetAddressOf());
+		if(hr == DXGI_ERROR_NOT_FOUND)
+			break;
+		ThrowIfFailed(hr);
+
+		DXGI_ADAPTER_DESC1 desc;
+		ThrowIfFailed(adapter->GetDesc1(&desc));
+		if(desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)
+			continue;
+
+		// Checks for support without creating the device.
+		if(FAILED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, __uuidof(ID3D12Device), nullptr)))
+			continue;
+
+		if(wanted.empty() || Lower(desc.Description).find(wanted) != std::wstring::npos)
+			return adapter;
+		if(first == nullptr)
+			first = adapter;
+	}
+
+	if(!wanted.empty() && first != nullptr)
+	{
+		DXGI_ADAPTER_DESC1 desc;
+		ThrowIfFailed(first->GetDesc1(&desc));
+		OutputDebugStringW((L"No adapter matches \"" + name + L"\"; using " + desc.Description + L"\n").c_str());
+	}
+
+	return first;
+}
+
+DeviceCaps QueryDeviceCaps(ID3D12Device* device, IDXGIAdapter1* adapter)
+{
+	DeviceCaps caps;
+
+	DXGI_ADAPTER_DESC1 desc;
+	ThrowIfFailed(adapter->GetDesc1(&desc));
+	caps.AdapterName = desc.Description;
+	caps.VendorId = desc.VendorId;
+	caps.DedicatedVideoMemory = desc.DedicatedVideoMemory;
+	caps.Software = (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) != 0;
+
+	static const D3D_FEATURE_LEVEL levels[] =
+	{
+		D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_12_0,
+		D3D_FEATURE_LEVEL_12_1, D3D_FEATURE_LEVEL_12_2
+	};
+	D3D12_FEATURE_DATA_FEATURE_LEVELS featureLevels = { _countof(levels), levels };
+	if(Query(device, D3D12_FEATURE_FEATURE_LEVELS, featureLevels))
+		caps.FeatureLevel = featureLevels.MaxSupportedFeatureLevel;
+	else
+	{
+		// Runtimes that do not know 12_2 reject the whole query.
+		featureLevels.NumFeatureLevels = _countof(levels) - 1;
+		if(Query(device, D3D12_FEATURE_FEATURE_LEVELS, featureLevels))
+			caps.FeatureLevel = featureLevels.MaxSupportedFeatureLevel;
+	}
+
+	// Asking for a model the runtime does not know fails, so step down until it answers.
+	static const D3D_SHADER_MODEL models[] =
+	{
+		D3D_SHADER_MODEL_6_7, D3D_SHADER_MODEL_6_6, D3D_SHADER_MODEL_6_5, D3D_SHADER_MODEL_6_4,
+		D3D_SHADER_MODEL_6_3, D3D_SHADER_MODEL_6_2, D3D_SHADER_MODEL_6_1, D3D_SHADER_MODEL_6_0
+	};
+	for(D3D_SHADER_MODEL model : models)
+	{
+		D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { model };
+		if(Query(device, D3D12_FEATURE_SHADER_MODEL, shaderModel))
+		{
+			caps.HighestShaderModel = shaderModel.HighestShaderModel;
+			break;
+		}
+	}
+
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	if(Query(device, D3D12_FEATURE_D3D12_OPTIONS, options))
+	{
+		caps.ResourceBindingTier = options.ResourceBindingTier;
+		caps.ResourceHeapTier = options.ResourceHeapTier;
+		caps.TiledResourcesTier = options.TiledResourcesTier;
+	}
+
+	D3D12_FEATURE_DATA_D3D12_OPTIONS1 options1 = {};
+	if(Query(device, D3D12_FEATURE_D3D12_OPTIONS1, options1))
+	{
+		caps.WaveOps = options1.WaveOps != FALSE;
+		caps.WaveLaneCountMin = options1.WaveLaneCountMin;
+		caps.WaveLaneCountMax = options1.WaveLaneCountMax;
+	}
+
+	D3D12_FEATURE_DATA_D3D12_OPTIONS6 options6 = {};
+	if(Query(device, D3D12_FEATURE_D3D12_OPTIONS6, options6))
+		caps.VariableShadingRateTier = options6.VariableShadingRateTier;
+
+	D3D12_FEATURE_DATA_D3D12_OPTIONS7 options7 = {};
+	if(Query(device, D3D12_FEATURE_D3D12_OPTIONS7, options7))
+	{
+		caps.MeshShaderTier = options7.MeshShaderTier;
+		caps.SamplerFeedbackTier = options7.SamplerFeedbackTier;
+	}
+
+	// OPTIONS12 is declared from the 10.0.22621 Windows SDK on and OPTIONS16 from
+	// 10.0.26100.  Built against older headers, these caps stay false.
+#if defined(NTDDI_WIN10_NI)
+	D3D12_FEATURE_DATA_D3D12_OPTIONS12 options12 = {};
+	if(Query(device, D3D12_FEATURE_D3D12_OPTIONS12, options12))
+		caps.EnhancedBarriers = options12.EnhancedBarriersSupported != FALSE;
+#endif
+
+#if defined(NTDDI_WIN11_GE)
+	D3D12_FEATURE_DATA_D3D12_OPTIONS16 options16 = {};
+	if(Query(device, D3D12_FEATURE_D3D12_OPTIONS16, options16))
+		caps.GpuUploadHeap = options16.GPUUploadHeapSupported != FALSE;
+#endif
+
+	return caps;
+}
@@ -0,0 +1,61 @@
+//***************************************************************************************
+// DeviceCaps.h
+//
+// Picks the adapter to create the device on and reports what the device can do.
+// Adapters are taken in the order DXGI ranks them for a GPU preference, so on a
+// machine with an integrated and a discrete GPU the high-performance preference
+// lands on the discrete one whichever the system lists first.  Software adapters are
+// skipped; the caller falls back to WARP itself.
+//
+// DeviceCaps gathers the feature queries the renderer's optional paths depend on in
+// one place, so each path asks it rather than probing the device on its own.  Queries
+// an older runtime does not know leave their feature unsupported.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+struct DeviceCaps
+{
+	std::wstring AdapterName;
+	UINT VendorId = 0;
+	UINT64 DedicatedVideoMemory = 0;
+	bool Software = false;
+
+	D3D_FEATURE_LEVEL FeatureLevel = D3D_FEATURE_LEVEL_11_0;
+	D3D_SHADER_MODEL HighestShaderModel = D3D_SHADER_MODEL_5_1;
+
+	D3D12_RESOURCE_BINDING_TIER ResourceBindingTier = D3D12_RESOURCE_BINDING_TIER_1;
+	D3D12_RESOURCE_HEAP_TIER ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_1;
+	D3D12_TILED_RESOURCES_TIER TiledResourcesTier = D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED;
+	D3D12_VARIABLE_SHADING_RATE_TIER VariableShadingRateTier = D3D12_VARIABLE_SHADING_RATE_TIER_NOT_SUPPORTED;
+	D3D12_MESH_SHADER_TIER MeshShaderTier = D3D12_MESH_SHADER_TIER_NOT_SUPPORTED;
+	D3D12_SAMPLER_FEEDBACK_TIER SamplerFeedbackTier = D3D12_SAMPLER_FEEDBACK_TIER_NOT_SUPPORTED;
+
+	// Wave intrinsics, and the lane counts a wave may have.
+	bool WaveOps = false;
+	UINT WaveLaneCountMin = 0;
+	UINT WaveLaneCountMax = 0;
+
+	// Queried only when built against headers that declare them; see QueryDeviceCaps.
+	bool EnhancedBarriers = false;
+	// CPU-visible video memory, written directly instead of through an upload copy.
+	bool GpuUploadHeap = false;
+
+	bool BindlessSupported()const;
+	bool VariableRateShadingSupported()const;
+	bool MeshShadersSupported()const;
+	bool SamplerFeedbackSupported()const;
+
+	// One line per capability, for the debug output and the startup log.
+	std::wstring Report()const;
+};
+
+// The first hardware adapter by preference that can create a device, or the first
+// whose description contains name, case-insensitively, if name is not empty and one
+// does, with a warning logged when none does.  Null if there is no hardware adapter.
+Microsoft::WRL::ComPtr<IDXGIAdapter1> SelectAdapter(IDXGIFactory1* factory,
+	DXGI_GPU_PREFERENCE preference, const std::wstring& name);
+
+DeviceCaps QueryDeviceCaps(ID3D12Device* device, IDXGIAdapter1* adapter);
@@ -0,0 +1,95 @@
+//***************************************************************************************
+// FixedStepScheduler.cpp
+//***************************************************************************************
+
+#include "FixedStepScheduler.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+UINT FixedStepScheduler::Add(const char* name, double stepSeconds, UINT maxCatchUp, std::function<void()> step)
+{
+	assert(stepSeconds > 0.0 && maxCatchUp > 0);
+
+	System system;
+	system.Name = name;
+	system.StepSeconds = stepSeconds;
+	system.MaxCatchUp = maxCatchUp;
+	system.Step = std::move(step);
+	system.NextTime = mTime + stepSeconds;
+	mSystems.push_back(std::move(system));
+
+	return (UINT)mSystems.size() - 1;
+}
+
+void FixedStepScheduler::Advance(double elapsedSeconds)
+{
+	mTime += std::max(elapsedSeconds, 0.0);
+
+	for(System& system : mSystems)
+		system.StepsThisAdvance = 0;
+
+	for(;;)
+	{
+		// The system due first; ties go to the one added first.
+		System* next = nullptr;
+		for(System& system : mSystems)
+		{
+			if(system.NextTime <= mTime && (next == nullptr || system.NextTime < next->NextTime))
+				next = &system;
+		}
+		if(next == nullptr)
+			break;
+
+		if(next->StepsThisAdvance == next->MaxCatchUp)
+		{
+			// Drop every step still due, keeping the phase, so the system resumes at
+			// the first boundary after now.
+			UINT64 skipped = (UINT64)std::floor((mTime - next->NextTime) / next->StepSeconds) + 1;
+			next->NextTime += skipped*next->StepSeconds;
+			next->StepsSkipped += skipped;
+			continue;
+		}
+
+		{
+			PROFILE_SCOPE(next->Name);
+			next->Step();
+		}
+		next->NextTime += next->StepSeconds;
+		++next->StepsRun;
+		++next->StepsThisAdvance;
+	}
+
+	for(System& system : mSystems)
+	{
+		float alpha = (float)(1.0 - (system.NextTime - mTime) / system.StepSeconds);
+		system.Alpha = std::min(std::max(alpha, 0.0f), 1.0f);
+	}
+}
+
+void FixedStepScheduler::Publish()
+{
+	for(System& system : mSystems)
+		system.PublishedAlpha = system.Alpha;
+}
+
+float FixedStepScheduler::Alpha(UINT id)const
+{
+	return mSystems[id].PublishedAlpha;
+}
+
+double FixedStepScheduler::StepSeconds(UINT id)const
+{
+	return mSystems[id].StepSeconds;
+}
+
+UINT64 FixedStepScheduler::StepsRun(UINT id)const
+{
+	return mSystems[id].StepsRun;
+}
+
+UINT64 FixedStepScheduler::StepsSkipped(UINT id)const
+{
+	return mSystems[id].StepsSkipped;
+}
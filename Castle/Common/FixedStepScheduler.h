@@ -0,0 +1,75 @@
+//***************************************************************************************
+// FixedStepScheduler.h
+//
+// Steps simulation systems at fixed rates of their own, whatever the frame rate.  Each
+// Advance moves the scheduler's clock on by a frame's elapsed time and runs every step
+// that falls due, the systems' steps interleaved in time order, so a system costs the
+// same per second at 30 frames a second as at 240.
+//
+// A system that falls behind, after a hitch or a long frame, catches up by at most
+// MaxCatchUp steps per Advance; the steps beyond are skipped, and its clock jumps
+// ahead, rather than the next frames spending ever longer catching up.
+//
+// Like the systems' own state, what the renderer reads is only changed by Publish:
+// Alpha is how far each system was from its last step to its next as of the last
+// published Advance, for blending its previous and current states.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <functional>
+
+class FixedStepScheduler
+{
+public:
+	FixedStepScheduler() = default;
+	FixedStepScheduler(const FixedStepScheduler& rhs) = delete;
+	FixedStepScheduler& operator=(const FixedStepScheduler& rhs) = delete;
+
+	// Adds a system stepped every stepSeconds, its first step one stepSeconds after the
+	// clock's time now.  name must outlive the scheduler (a string literal).  Returns
+	// the system's id.
+	UINT Add(const char* name, double stepSeconds, UINT maxCatchUp, std::function<void()> step);
+
+	// Moves the clock on by elapsedSeconds and runs the steps that fall due.
+	void Advance(double elapsedSeconds);
+
+	// Makes the blend factors of the last Advance the ones Alpha returns.
+	void Publish();
+
+	// In [0, 1): 0 just after system id stepped, approaching 1 just before its next step.
+	float Alpha(UINT id)const;
+
+	double StepSeconds(UINT id)const;
+
+	// Steps system id has run and skipped since it was added.
+	UINT64 StepsRun(UINT id)const;
+	UINT64 StepsSkipped(UINT id)const;
+
+private:
+	struct System
+	{
+		const char* Name = nullptr;
+		double StepSeconds = 0.0;
+		UINT MaxCatchUp = 1;
+		std::function<void()> Step;
+
+		// Clock time of the next step.
+		double NextTime = 0.0;
+		// Steps run by the Advance in progress.
+		UINT StepsThisAdvance = 0;
+
+		float Alpha = 0.0f;
+		float PublishedAlpha = 0.0f;
+
+		UINT64 StepsRun = 0;
+		UINT64 StepsSkipped = 0;
+	};
+
+	std::vector<System> mSystems;
+
+	// Seconds advanced since construction.  A double keeps step boundaries exact for
+	// far longer than any session.
+	double mTime = 0.0;
+};
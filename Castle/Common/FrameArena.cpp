@@ -0,0 +1,70 @@
+//***************************************************************************************
+// FrameArena.cpp
+//***************************************************************************************
+
+#include "FrameArena.h"
+#include <cassert>
+
+FrameArena::FrameArena(size_t pageSize)
+	: mPageSize(pageSize)
+{
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	if(!mPages.empty())
+	{
+		Page& page = mPages.back();
+		uintptr_t base = (uintptr_t)page.Data.get();
+		uintptr_t aligned = (base + mOffset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		if(aligned + size <= base + page.Size)
+		{
+			mOffset = aligned + size - base;
+			mPeakBytesUsed = std::max(mPeakBytesUsed, BytesUsed());
+			return (void*)aligned;
+		}
+
+		mFullPagesBytes += mOffset;
+	}
+
+	// Room for the allocation at any alignment, so it always fits the new page.
+	Page page;
+	page.Size = std::max(mPageSize, size + alignment);
+	page.Data.reset(new BYTE[page.Size]);
+	mPages.push_back(std::move(page));
+	mOffset = 0;
+
+	return Allocate(size, alignment);
+}
+
+void FrameArena::Reset()
+{
+	if(mPages.size() > 1)
+	{
+		size_t total = 0;
+		for(const Page& page : mPages)
+			total += page.Size;
+
+		mPages.clear();
+
+		Page page;
+		page.Size = total;
+		page.Data.reset(new BYTE[page.Size]);
+		mPages.push_back(std::move(page));
+	}
+
+	mOffset = 0;
+	mFullPagesBytes = 0;
+}
+
+size_t FrameArena::BytesUsed()const
+{
+	return mFullPagesBytes + mOffset;
+}
+
+size_t FrameArena::PeakBytesUsed()const
+{
+	return mPeakBytesUsed;
+}
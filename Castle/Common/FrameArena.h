@@ -0,0 +1,100 @@
+//***************************************************************************************
+// FrameArena.h
+//
+// Bump allocator in CPU memory for data that only lives for a frame, such as the
+// scratch arrays of culling, sorting and the render graph.  Nothing is freed on its
+// own; Reset frees it all at once.  When a page runs out another is added, and the
+// next Reset folds them into one page big enough for the whole frame, as
+// LinearAllocator does for upload memory, so once the app has warmed up a frame's
+// transient containers never touch the heap.
+//
+// ArenaAllocator adapts an arena for standard containers; ArenaVector is the usual
+// one.  A container must not outlive its arena's next Reset.  An arena is not
+// thread-safe: give each thread its own.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t pageSize = 64*1024);
+	FrameArena(const FrameArena& rhs) = delete;
+	FrameArena& operator=(const FrameArena& rhs) = delete;
+
+	// alignment must be a power of two.
+	void* Allocate(size_t size, size_t alignment);
+
+	// Frees everything allocated since the last Reset.
+	void Reset();
+
+	// Bytes handed out since the last Reset, alignment included, and the most any
+	// frame has used.
+	size_t BytesUsed()const;
+	size_t PeakBytesUsed()const;
+
+private:
+	struct Page
+	{
+		std::unique_ptr<BYTE[]> Data;
+		size_t Size = 0;
+	};
+
+	size_t mPageSize = 0;
+	std::vector<Page> mPages;
+
+	// Into the last page; the pages before it are full.
+	size_t mOffset = 0;
+	size_t mFullPagesBytes = 0;
+	size_t mPeakBytesUsed = 0;
+};
+
+template<typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator(FrameArena& arena) : mArena(&arena)
+	{
+	}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& rhs) : mArena(rhs.Arena())
+	{
+	}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(mArena->Allocate(n*sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, size_t n)
+	{
+	}
+
+	FrameArena* Arena()const
+	{
+		return mArena;
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& rhs)const
+	{
+		return mArena == rhs.Arena();
+	}
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& rhs)const
+	{
+		return mArena != rhs.Arena();
+	}
+
+private:
+	FrameArena* mArena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
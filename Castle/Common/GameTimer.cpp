@@ -7,7 +7,7 @@
 
 GameTimer::GameTimer()
 : mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
-  mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
+  mPausedTime(0), mPrevTime(0), mCurrTime(0), mFixedStepCount(0), mStopped(false)
 {
 	__int64 countsPerSec;
 	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
@@ -106,6 +106,14 @@ void GameTimer::Tick()
 		return;
 	}
 
+	if( mFixedStepCount > 0 )
+	{
+		mCurrTime = mPrevTime + mFixedStepCount;
+		mDeltaTime = mFixedStepCount*mSecondsPerCount;
+		mPrevTime = mCurrTime;
+		return;
+	}
+
 	__int64 currTime;
 	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
 	mCurrTime = currTime;
@@ -125,8 +133,7 @@ void GameTimer::Tick()
 	}
 }
 
-
-
-
-
-
+void GameTimer::SetFixedTimeStep(double seconds)
+{
+	mFixedStepCount = seconds > 0.0 ? (__int64)(seconds / mSecondsPerCount + 0.5) : 0;
+}
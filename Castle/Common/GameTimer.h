@@ -18,6 +18,10 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// When seconds > 0, every Tick advances the clock by exactly that much
+	// regardless of wall time, for repeatable runs.  0 restores real time.
+	void SetFixedTimeStep(double seconds);
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
@@ -28,6 +32,9 @@ private:
 	__int64 mPrevTime;
 	__int64 mCurrTime;
 
+	// Counts added per Tick in fixed-step mode, or 0 for real time.
+	__int64 mFixedStepCount;
+
 	bool mStopped;
 };
 
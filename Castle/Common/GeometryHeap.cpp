@@ -0,0 +1,163 @@
+//***************************************************************************************
+// GeometryHeap.cpp
+//***************************************************************************************
+
+#include "GeometryHeap.h"
+
+using Microsoft::WRL::ComPtr;
+
+GeometryHeap::GeometryHeap(ID3D12Device* device, UINT64 heapSize)
+	: md3dDevice(device), mHeapSize(heapSize)
+{
+}
+
+GeometryHeap::~GeometryHeap()
+{
+}
+
+GeometryRange GeometryHeap::Allocate(const void* initData, UINT64 byteSize)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if(mHeaps.empty() ||
+		((mHeaps.back().Used + RangeAlignment - 1) & ~(RangeAlignment - 1)) + byteSize > mHeaps.back().Size)
+	{
+		AddHeap(byteSize);
+	}
+
+	Heap& heap = mHeaps.back();
+
+	UINT64 offset = (heap.Used + RangeAlignment - 1) & ~(RangeAlignment - 1);
+
+	// Mirror the heap layout, padding included, so the pending bytes go up in
+	// one contiguous copy.
+	heap.PendingData.resize((size_t)(offset + byteSize - heap.PendingOffset));
+	memcpy(&heap.PendingData[(size_t)(offset - heap.PendingOffset)], initData, (size_t)byteSize);
+	heap.Used = offset + byteSize;
+
+	GeometryRange range;
+	range.Resource = heap.Buffer.Get();
+	range.Offset = offset;
+	range.Size = byteSize;
+
+	return range;
+}
+
+void GeometryHeap::UploadVertices(MeshGeometry& geo, const void* initData, UINT64 byteSize)
+{
+	GeometryRange range = Allocate(initData, byteSize);
+	geo.VertexBufferGPU = range.Resource;
+	geo.VertexBufferOffset = range.Offset;
+}
+
+void GeometryHeap::UploadIndices(MeshGeometry& geo, const void* initData, UINT64 byteSize)
+{
+	GeometryRange range = Allocate(initData, byteSize);
+	geo.IndexBufferGPU = range.Resource;
+	geo.IndexBufferOffset = range.Offset;
+}
+
+void GeometryHeap::RecordUploads(ID3D12GraphicsCommandList* cmdList)
+{
+	UINT64 stagingSize = 0;
+	for(const auto& heap : mHeaps)
+		stagingSize += (heap.PendingData.size() + RangeAlignment - 1) & ~(RangeAlignment - 1);
+
+	if(stagingSize == 0)
+		return;
+
+	ComPtr<ID3D12Resource> staging;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(stagingSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&staging)));
+
+	BYTE* mapped = nullptr;
+	ThrowIfFailed(staging->Map(0, nullptr, reinterpret_cast<void**>(&mapped)));
+
+	std::vector<D3D12_RESOURCE_BARRIER> toCopyDest;
+	std::vector<D3D12_RESOURCE_BARRIER> toRead;
+	for(auto& heap : mHeaps)
+	{
+		if(heap.PendingData.empty())
+			continue;
+
+		toCopyDest.push_back(CD3DX12_RESOURCE_BARRIER::Transition(heap.Buffer.Get(),
+			heap.Initialized ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_COMMON,
+			D3D12_RESOURCE_STATE_COPY_DEST));
+		toRead.push_back(CD3DX12_RESOURCE_BARRIER::Transition(heap.Buffer.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+	}
+
+	cmdList->ResourceBarrier((UINT)toCopyDest.size(), toCopyDest.data());
+
+	UINT64 stagingOffset = 0;
+	for(auto& heap : mHeaps)
+	{
+		if(heap.PendingData.empty())
+			continue;
+
+		memcpy(mapped + stagingOffset, heap.PendingData.data(), heap.PendingData.size());
+		cmdList->CopyBufferRegion(heap.Buffer.Get(), heap.PendingOffset,
+			staging.Get(), stagingOffset, heap.PendingData.size());
+
+		stagingOffset += (heap.PendingData.size() + RangeAlignment - 1) & ~(RangeAlignment - 1);
+
+		heap.PendingOffset = heap.Used;
+		heap.PendingData.clear();
+		heap.PendingData.shrink_to_fit();
+		heap.Initialized = true;
+	}
+
+	staging->Unmap(0, nullptr);
+
+	cmdList->ResourceBarrier((UINT)toRead.size(), toRead.data());
+
+	// Kept alive until the copies have executed.
+	mStaging.push_back(staging);
+}
+
+void GeometryHeap::ReleaseStaging()
+{
+	mStaging.clear();
+}
+
+UINT GeometryHeap::HeapCount()const
+{
+	return (UINT)mHeaps.size();
+}
+
+ID3D12Heap* GeometryHeap::Heap(UINT i)const
+{
+	return mHeaps[i].Memory.Get();
+}
+
+ID3D12Resource* GeometryHeap::Buffer(UINT i)const
+{
+	return mHeaps[i].Buffer.Get();
+}
+
+void GeometryHeap::AddHeap(UINT64 minSize)
+{
+	const UINT64 granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+	Heap heap;
+	heap.Size = (std::max(minSize, mHeapSize) + granularity - 1) & ~(granularity - 1);
+
+	CD3DX12_HEAP_DESC heapDesc(heap.Size, D3D12_HEAP_TYPE_DEFAULT, 0, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+	ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap.Memory)));
+
+	// One buffer over the whole heap; ranges are offsets into it.
+	ThrowIfFailed(md3dDevice->CreatePlacedResource(
+		heap.Memory.Get(),
+		0,
+		&CD3DX12_RESOURCE_DESC::Buffer(heap.Size),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&heap.Buffer)));
+
+	mHeaps.push_back(std::move(heap));
+}
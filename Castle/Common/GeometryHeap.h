@@ -0,0 +1,82 @@
+//***************************************************************************************
+// GeometryHeap.h
+//
+// Suballocates static vertex and index buffers from a few large default heaps, each
+// covered by one placed buffer.  Initial data is kept on the CPU until RecordUploads,
+// which stages everything pending through one upload buffer and copies it with one
+// CopyBufferRegion per heap.  The staging buffer is dropped by ReleaseStaging once
+// the GPU has executed the copies.
+//
+// Allocate and the Upload functions may be called from several threads at once.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <mutex>
+
+struct GeometryRange
+{
+	ID3D12Resource* Resource = nullptr;
+	UINT64 Offset = 0;
+	UINT64 Size = 0;
+};
+
+class GeometryHeap
+{
+public:
+	GeometryHeap(ID3D12Device* device, UINT64 heapSize = 16 * 1024 * 1024);
+	GeometryHeap(const GeometryHeap& rhs) = delete;
+	GeometryHeap& operator=(const GeometryHeap& rhs) = delete;
+	~GeometryHeap();
+
+	// Reserves byteSize bytes and queues initData to be copied there.  The range
+	// is readable as a vertex or index buffer once the recorded copy has run.
+	GeometryRange Allocate(const void* initData, UINT64 byteSize);
+
+	// Allocate and point geo's vertex or index buffer at the range.
+	void UploadVertices(MeshGeometry& geo, const void* initData, UINT64 byteSize);
+	void UploadIndices(MeshGeometry& geo, const void* initData, UINT64 byteSize);
+
+	// Records the copies for everything allocated since the last call.
+	void RecordUploads(ID3D12GraphicsCommandList* cmdList);
+
+	// Call once the GPU has passed the fence after the RecordUploads list.
+	void ReleaseStaging();
+
+	UINT HeapCount()const;
+	ID3D12Heap* Heap(UINT i)const;
+	// The placed buffer covering heap i, which every range in it is a slice of.
+	ID3D12Resource* Buffer(UINT i)const;
+
+private:
+	struct Heap
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> Memory;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+		UINT64 Size = 0;
+		UINT64 Used = 0;
+
+		// Bytes [PendingOffset, Used) have not been uploaded yet.
+		UINT64 PendingOffset = 0;
+		std::vector<BYTE> PendingData;
+
+		// False until the first copy; the buffer starts out in COMMON.
+		bool Initialized = false;
+	};
+
+	void AddHeap(UINT64 minSize);
+
+private:
+	// Satisfies vertex, index and constant buffer placement.
+	static const UINT64 RangeAlignment = 256;
+
+	ID3D12Device* md3dDevice = nullptr;
+	UINT64 mHeapSize = 0;
+
+	// Guards the heaps while geometry is built on several threads.
+	std::mutex mMutex;
+
+	std::vector<Heap> mHeaps;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mStaging;
+};
@@ -0,0 +1,192 @@
+//***************************************************************************************
+// GpuProfiler.cpp
+//***************************************************************************************
+
+#include "GpuProfiler.h"
+
+using Microsoft::WRL::ComPtr;
+
+GpuProfiler::GpuProfiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameCount, UINT maxScopes)
+	: mQueue(queue), mMaxScopes(maxScopes), mNextScope(0)
+{
+	UINT64 ticksPerSecond = 0;
+	ThrowIfFailed(queue->GetTimestampFrequency(&ticksPerSecond));
+	mMsPerTick = 1000.0 / (double)ticksPerSecond;
+
+	LARGE_INTEGER cpuTicksPerSecond;
+	QueryPerformanceFrequency(&cpuTicksPerSecond);
+	mMsPerCpuTick = 1000.0 / (double)cpuTicksPerSecond.QuadPart;
+
+	// Every scope takes a begin and an end timestamp.
+	D3D12_QUERY_HEAP_DESC heapDesc;
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = 2 * maxScopes;
+	heapDesc.NodeMask = 0;
+
+	mFrames.resize(frameCount);
+	for(auto& frame : mFrames)
+	{
+		ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&frame.QueryHeap)));
+
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(heapDesc.Count * sizeof(UINT64)),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&frame.Readback)));
+
+		frame.ScopeNames.resize(maxScopes, nullptr);
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+}
+
+void GpuProfiler::BeginFrame(UINT frameIndex)
+{
+	assert(frameIndex < mFrames.size());
+	mCurrFrame = &mFrames[frameIndex];
+
+	// Whatever this slot resolved last time around is complete now.
+	if(mCurrFrame->ScopeCount > 0)
+	{
+		D3D12_RANGE readRange = { 0, 2 * mCurrFrame->ScopeCount * sizeof(UINT64) };
+		UINT64* timestamps = nullptr;
+		ThrowIfFailed(mCurrFrame->Readback->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+
+		// Calibrated now, for timestamps taken a few frames ago; the clocks drift
+		// far less than that in between.
+		UINT64 gpuNow = 0;
+		UINT64 cpuNow = 0;
+		ThrowIfFailed(mQueue->GetClockCalibration(&gpuNow, &cpuNow));
+		double cpuNowMs = (double)cpuNow * mMsPerCpuTick;
+
+		for(UINT i = 0; i < mCurrFrame->ScopeCount; ++i)
+		{
+			UINT64 begin = timestamps[2 * i];
+			UINT64 end = timestamps[2 * i + 1];
+			if(end >= begin)
+			{
+				double beginMs = cpuNowMs - (double)(INT64)(gpuNow - begin) * mMsPerTick;
+				Accumulate(mCurrFrame->ScopeNames[i], beginMs, beginMs + (end - begin) * mMsPerTick);
+			}
+		}
+
+		D3D12_RANGE writeRange = { 0, 0 };
+		mCurrFrame->Readback->Unmap(0, &writeRange);
+	}
+
+	mCurrFrame->ScopeCount = 0;
+	mNextScope = 0;
+}
+
+UINT GpuProfiler::BeginScope(ID3D12GraphicsCommandList* cmdList, const char* name)
+{
+	assert(mCurrFrame != nullptr);
+
+	UINT scope = mNextScope++;
+	if(scope >= mMaxScopes)
+		return UINT_MAX;
+
+	mCurrFrame->ScopeNames[scope] = name;
+	cmdList->EndQuery(mCurrFrame->QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * scope);
+
+	return scope;
+}
+
+void GpuProfiler::EndScope(ID3D12GraphicsCommandList* cmdList, UINT scope)
+{
+	if(scope == UINT_MAX)
+		return;
+
+	cmdList->EndQuery(mCurrFrame->QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * scope + 1);
+}
+
+void GpuProfiler::EndFrame(ID3D12GraphicsCommandList* cmdList)
+{
+	mCurrFrame->ScopeCount = std::min((UINT)mNextScope, mMaxScopes);
+	if(mCurrFrame->ScopeCount == 0)
+		return;
+
+	cmdList->ResolveQueryData(mCurrFrame->QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+		0, 2 * mCurrFrame->ScopeCount, mCurrFrame->Readback.Get(), 0);
+}
+
+double GpuProfiler::AverageMs(const std::string& name)const
+{
+	auto it = mStats.find(name);
+	return it != mStats.end() ? it->second.AverageMs : 0.0;
+}
+
+double GpuProfiler::LastMs(const std::string& name)const
+{
+	auto it = mStats.find(name);
+	return it != mStats.end() ? it->second.LastMs : 0.0;
+}
+
+bool GpuProfiler::LastInterval(const std::string& name, double& beginMs, double& endMs)const
+{
+	auto it = mStats.find(name);
+	if(it == mStats.end())
+		return false;
+
+	beginMs = it->second.LastBeginMs;
+	endMs = it->second.LastEndMs;
+	return true;
+}
+
+std::wstring GpuProfiler::Summary()const
+{
+	std::wostringstream out;
+	out.setf(std::ios::fixed);
+	out.precision(2);
+
+	for(const auto& name : mScopeOrder)
+	{
+		if(out.tellp() > 0)
+			out << L"  ";
+		out << AnsiToWString(name) << L" " << mStats.at(name).AverageMs;
+	}
+
+	return out.str();
+}
+
+void GpuProfiler::WriteCsv(const std::wstring& filename)const
+{
+	std::ofstream fout(filename);
+	if(!fout)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
+
+	fout << "scope,avg_ms,min_ms,max_ms,samples\n";
+	for(const auto& name : mScopeOrder)
+	{
+		const ScopeStats& s = mStats.at(name);
+		fout << name << "," << s.AverageMs << "," << s.MinMs << "," << s.MaxMs << "," << s.Samples << "\n";
+	}
+}
+
+void GpuProfiler::Accumulate(const char* name, double beginMs, double endMs)
+{
+	double ms = endMs - beginMs;
+
+	auto it = mStats.find(name);
+	if(it == mStats.end())
+	{
+		mScopeOrder.push_back(name);
+		it = mStats.emplace(name, ScopeStats()).first;
+		it->second.AverageMs = ms;
+		it->second.MinMs = ms;
+		it->second.MaxMs = ms;
+	}
+
+	ScopeStats& s = it->second;
+	s.AverageMs += AverageWeight * (ms - s.AverageMs);
+	s.LastMs = ms;
+	s.LastBeginMs = beginMs;
+	s.LastEndMs = endMs;
+	s.MinMs = std::min(s.MinMs, ms);
+	s.MaxMs = std::max(s.MaxMs, ms);
+	++s.Samples;
+}
@@ -0,0 +1,97 @@
+//***************************************************************************************
+// GpuProfiler.h
+//
+// Measures GPU time of named scopes with timestamp queries.  There is one query heap
+// and readback buffer per frame in flight, so results are read back without stalling
+// once the frame's fence has been reached.  Keeps a rolling average per scope name.
+//
+// One profiler times one queue.  Each scope's latest sample is also kept as an
+// interval on the CPU's QueryPerformanceCounter clock, through the queue's clock
+// calibration, so scopes timed on different queues can be lined up.
+//***************************************************************************************
+
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include "d3dUtil.h"
+#include <atomic>
+
+class GpuProfiler
+{
+public:
+	// frameCount must match the number of frame resources; maxScopes bounds the
+	// number of Begin/End pairs recorded in one frame.
+	GpuProfiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameCount, UINT maxScopes);
+	GpuProfiler(const GpuProfiler& rhs) = delete;
+	GpuProfiler& operator=(const GpuProfiler& rhs) = delete;
+	~GpuProfiler();
+
+	// Call once the GPU has finished the previous use of frameIndex.  Folds those
+	// timings into the averages and starts a new set of scopes.
+	void BeginFrame(UINT frameIndex);
+
+	// Safe to call from several recording threads at once.  name must outlive the
+	// profiler (a string literal or a static table entry).
+	UINT BeginScope(ID3D12GraphicsCommandList* cmdList, const char* name);
+	void EndScope(ID3D12GraphicsCommandList* cmdList, UINT scope);
+
+	// Resolves this frame's queries.  Record into the list that executes last.
+	void EndFrame(ID3D12GraphicsCommandList* cmdList);
+
+	// Average milliseconds of a scope, or 0 if it has not been measured.
+	double AverageMs(const std::string& name)const;
+
+	// Most recent sample of a scope, from the frame BeginFrame last read back.
+	double LastMs(const std::string& name)const;
+
+	// Start and end of that sample in milliseconds of QueryPerformanceCounter time.
+	// False if the scope has not been measured.
+	bool LastInterval(const std::string& name, double& beginMs, double& endMs)const;
+
+	// "name 0.12" pairs in first-seen order, for the window caption.
+	std::wstring Summary()const;
+
+	// One row per scope: name, average, minimum and maximum ms and sample count.
+	void WriteCsv(const std::wstring& filename)const;
+
+private:
+	struct FrameQueries
+	{
+		Microsoft::WRL::ComPtr<ID3D12QueryHeap> QueryHeap;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Readback;
+		std::vector<const char*> ScopeNames;
+		UINT ScopeCount = 0;
+	};
+
+	struct ScopeStats
+	{
+		double AverageMs = 0.0;
+		double LastMs = 0.0;
+		double LastBeginMs = 0.0;
+		double LastEndMs = 0.0;
+		double MinMs = 0.0;
+		double MaxMs = 0.0;
+		UINT64 Samples = 0;
+	};
+
+	void Accumulate(const char* name, double beginMs, double endMs);
+
+private:
+	// Weight of the newest sample in the rolling average.
+	static constexpr double AverageWeight = 0.05;
+
+	ID3D12CommandQueue* mQueue = nullptr;
+
+	UINT mMaxScopes = 0;
+	double mMsPerTick = 0.0;
+	double mMsPerCpuTick = 0.0;
+
+	std::vector<FrameQueries> mFrames;
+	FrameQueries* mCurrFrame = nullptr;
+	std::atomic<UINT> mNextScope;
+
+	std::unordered_map<std::string, ScopeStats> mStats;
+	std::vector<std::string> mScopeOrder;
+};
+
+#endif // GPUPROFILER_H
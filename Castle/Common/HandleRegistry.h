@@ -0,0 +1,201 @@
+//***************************************************************************************
+// HandleRegistry.h
+//
+// Named objects in a dense array, referred to by 32-bit handles.  A handle holds a
+// slot index and the slot's generation; removing an entry bumps the generation, so
+// handles to it stop resolving rather than aliasing whatever takes the slot next.
+// The values stay packed as entries come and go, so iterating touches only live ones.
+//
+// Names are hashed only by Add, Find and the string operator[], which are meant for
+// load time.  Per-frame code keeps handles and resolves them with the handle
+// operator[], an index check and two array reads.
+//
+// Storage is how an entry is held: by default a unique_ptr, so the objects themselves
+// never move; ComPtr for COM objects.  Adding or removing entries moves the Storage
+// values, invalidating references to them but not the objects they point at.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+template<typename T>
+struct Handle
+{
+	static const UINT IndexBits = 24;
+	static const UINT IndexMask = (1u << IndexBits) - 1;
+
+	// Zero is never a live handle.
+	UINT Value = 0;
+
+	bool IsValid()const
+	{
+		return Value != 0;
+	}
+
+	UINT Index()const
+	{
+		return Value & IndexMask;
+	}
+
+	UINT Generation()const
+	{
+		return Value >> IndexBits;
+	}
+
+	bool operator==(const Handle& rhs)const
+	{
+		return Value == rhs.Value;
+	}
+
+	bool operator!=(const Handle& rhs)const
+	{
+		return Value != rhs.Value;
+	}
+};
+
+template<typename T, typename Storage = std::unique_ptr<T>>
+class HandleRegistry
+{
+public:
+	typedef typename std::vector<Storage>::iterator iterator;
+	typedef typename std::vector<Storage>::const_iterator const_iterator;
+
+	HandleRegistry() = default;
+	HandleRegistry(const HandleRegistry& rhs) = delete;
+	HandleRegistry& operator=(const HandleRegistry& rhs) = delete;
+
+	// The handle of name's entry, adding an empty one if there is none.
+	Handle<T> Add(const std::string& name)
+	{
+		auto it = mNames.find(name);
+		if(it != mNames.end())
+			return it->second;
+
+		UINT slot = 0;
+		if(!mFreeSlots.empty())
+		{
+			slot = mFreeSlots.back();
+			mFreeSlots.pop_back();
+		}
+		else
+		{
+			slot = (UINT)mSlots.size();
+			assert(slot < Handle<T>::IndexMask);
+			mSlots.push_back({ 0, 1 });
+		}
+
+		Handle<T> handle = MakeHandle(slot);
+		mSlots[slot].Dense = (UINT)mValues.size();
+		mValues.emplace_back();
+		mDenseHandles.push_back(handle);
+		mDenseNames.push_back(name);
+		mNames.emplace(name, handle);
+		return handle;
+	}
+
+	// The handle of name's entry, or an invalid handle if there is none.
+	Handle<T> Find(const std::string& name)const
+	{
+		auto it = mNames.find(name);
+		return it != mNames.end() ? it->second : Handle<T>();
+	}
+
+	// Whether handle still refers to a live entry.
+	bool Contains(Handle<T> handle)const
+	{
+		UINT slot = handle.Index() - 1;
+		return handle.IsValid() && slot < mSlots.size() &&
+			mSlots[slot].Generation == handle.Generation();
+	}
+
+	Storage& operator[](Handle<T> handle)
+	{
+		assert(Contains(handle));
+		return mValues[mSlots[handle.Index() - 1].Dense];
+	}
+
+	const Storage& operator[](Handle<T> handle)const
+	{
+		assert(Contains(handle));
+		return mValues[mSlots[handle.Index() - 1].Dense];
+	}
+
+	// The entry for name, added empty if there is none.  Load time only.
+	Storage& operator[](const std::string& name)
+	{
+		return (*this)[Add(name)];
+	}
+
+	// Drops the entry; its handle and any copies of it stop resolving.
+	void Remove(Handle<T> handle)
+	{
+		assert(Contains(handle));
+		Slot& slot = mSlots[handle.Index() - 1];
+		UINT dense = slot.Dense;
+		mNames.erase(mDenseNames[dense]);
+
+		// Move the last value into the hole to keep the values packed.
+		UINT last = (UINT)mValues.size() - 1;
+		if(dense != last)
+		{
+			mValues[dense] = std::move(mValues[last]);
+			mDenseHandles[dense] = mDenseHandles[last];
+			mDenseNames[dense] = std::move(mDenseNames[last]);
+			mSlots[mDenseHandles[dense].Index() - 1].Dense = dense;
+		}
+		mValues.pop_back();
+		mDenseHandles.pop_back();
+		mDenseNames.pop_back();
+
+		// Zero would make the next handle to this slot look invalid.
+		slot.Generation = (slot.Generation + 1) & (0xffffffffu >> Handle<T>::IndexBits);
+		if(slot.Generation == 0)
+			slot.Generation = 1;
+		mFreeSlots.push_back(handle.Index() - 1);
+	}
+
+	void Clear()
+	{
+		while(!mDenseHandles.empty())
+			Remove(mDenseHandles.back());
+	}
+
+	UINT Size()const
+	{
+		return (UINT)mValues.size();
+	}
+
+	// The live values, in no particular order.
+	iterator begin() { return mValues.begin(); }
+	iterator end() { return mValues.end(); }
+	const_iterator begin()const { return mValues.begin(); }
+	const_iterator end()const { return mValues.end(); }
+
+private:
+	struct Slot
+	{
+		// Position of the slot's value in mValues.
+		UINT Dense;
+		UINT Generation;
+	};
+
+	Handle<T> MakeHandle(UINT slot)const
+	{
+		// Slot indices are stored plus one so that no live handle is zero.
+		Handle<T> handle;
+		handle.Value = (mSlots[slot].Generation << Handle<T>::IndexBits) | (slot + 1);
+		return handle;
+	}
+
+private:
+	std::vector<Slot> mSlots;
+	std::vector<UINT> mFreeSlots;
+
+	// Parallel arrays: each value with its handle and name.
+	std::vector<Storage> mValues;
+	std::vector<Handle<T>> mDenseHandles;
+	std::vector<std::string> mDenseNames;
+
+	std::unordered_map<std::string, Handle<T>> mNames;
+};
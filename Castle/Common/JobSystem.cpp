@@ -0,0 +1,209 @@
+//***************************************************************************************
+// JobSystem.cpp
+//***************************************************************************************
+
+#include "JobSystem.h"
+
+namespace
+{
+	// Index into mQueues of the calling thread's deque; workers set theirs.
+	thread_local UINT tQueueIndex = UINT_MAX;
+}
+
+JobSystem::JobSystem(UINT workerCount)
+{
+	if(workerCount == 0)
+		workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	for(UINT i = 0; i <= workerCount; ++i)
+		mQueues.push_back(std::make_unique<Queue>());
+
+	for(UINT i = 0; i < workerCount; ++i)
+		mWorkers.emplace_back(&JobSystem::WorkerMain, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+
+	for(auto& worker : mWorkers)
+		worker.join();
+}
+
+JobSystem& JobSystem::Shared()
+{
+	static JobSystem jobs;
+	return jobs;
+}
+
+UINT JobSystem::WorkerCount()const
+{
+	return (UINT)mWorkers.size();
+}
+
+void JobSystem::Run(std::function<void()> job, JobCounter* counter)
+{
+	if(counter != nullptr)
+		counter->mPending.fetch_add(1, std::memory_order_relaxed);
+
+	Job j;
+	j.Work = std::move(job);
+	j.Counter = counter;
+	Push(std::move(j));
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, std::function<void()> job, JobCounter* counter)
+{
+	// Counted now so counter is not done before the continuation is even queued.
+	if(counter != nullptr)
+		counter->mPending.fetch_add(1, std::memory_order_relaxed);
+
+	Job j;
+	j.Work = std::move(job);
+	j.Counter = counter;
+
+	{
+		std::lock_guard<std::mutex> lock(dependency.mMutex);
+		if(!dependency.IsDone())
+		{
+			// Job is moved into a shared_ptr because std::function must be copyable.
+			auto pending = std::make_shared<Job>(std::move(j));
+			dependency.mContinuations.push_back([this, pending]() { Push(std::move(*pending)); });
+			return;
+		}
+	}
+
+	Push(std::move(j));
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while(!counter.IsDone())
+	{
+		if(!TryRunOne())
+			std::this_thread::yield();
+	}
+
+	std::lock_guard<std::mutex> lock(counter.mMutex);
+	if(counter.mError != nullptr)
+	{
+		std::exception_ptr error = counter.mError;
+		counter.mError = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void JobSystem::Push(Job job)
+{
+	UINT index = std::min(tQueueIndex, (UINT)mQueues.size() - 1);
+	{
+		Queue& queue = *mQueues[index];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		queue.Jobs.push_back(std::move(job));
+	}
+
+	mQueuedCount.fetch_add(1, std::memory_order_release);
+	{
+		// Taken so a worker between checking mQueuedCount and sleeping cannot miss this.
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mWake.notify_one();
+}
+
+bool JobSystem::TryRunOne()
+{
+	if(mQueuedCount.load(std::memory_order_acquire) == 0)
+		return false;
+
+	const UINT queueCount = (UINT)mQueues.size();
+	const UINT own = std::min(tQueueIndex, queueCount - 1);
+
+	Job job;
+	bool found = false;
+	for(UINT n = 0; n < queueCount && !found; ++n)
+	{
+		UINT index = (own + n) % queueCount;
+		Queue& queue = *mQueues[index];
+
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if(queue.Jobs.empty())
+			continue;
+
+		// Newest from our own deque, oldest from anyone else's.
+		if(index == own)
+		{
+			job = std::move(queue.Jobs.back());
+			queue.Jobs.pop_back();
+		}
+		else
+		{
+			job = std::move(queue.Jobs.front());
+			queue.Jobs.pop_front();
+		}
+		found = true;
+	}
+
+	if(!found)
+		return false;
+
+	mQueuedCount.fetch_sub(1, std::memory_order_relaxed);
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(Job& job)
+{
+	JobCounter* counter = job.Counter;
+	if(counter == nullptr)
+	{
+		job.Work();
+		return;
+	}
+
+	try
+	{
+		job.Work();
+	}
+	catch(...)
+	{
+		std::lock_guard<std::mutex> lock(counter->mMutex);
+		if(counter->mError == nullptr)
+			counter->mError = std::current_exception();
+	}
+
+	// Counted down under the lock so RunAfter either sees the counter done or leaves
+	// a continuation for whoever brings it to zero.  Wait takes the lock too, so once
+	// the counter is done nothing here touches it after unlocking.
+	std::vector<std::function<void()>> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter->mMutex);
+		if(counter->mPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			continuations.swap(counter->mContinuations);
+	}
+	for(auto& continuation : continuations)
+		continuation();
+}
+
+void JobSystem::WorkerMain(UINT index)
+{
+	tQueueIndex = index;
+
+	// The main thread keeps processor 0.
+	if(index + 1 < sizeof(DWORD_PTR)*8)
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (index + 1));
+
+	for(;;)
+	{
+		if(TryRunOne())
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mWake.wait(lock, [this]() { return mStopping || mQueuedCount.load(std::memory_order_acquire) > 0; });
+		if(mStopping)
+			return;
+	}
+}
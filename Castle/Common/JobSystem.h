@@ -0,0 +1,146 @@
+//***************************************************************************************
+// JobSystem.h
+//
+// The one pool of worker threads every subsystem schedules its parallel work on: a
+// worker per hardware thread except the main thread's, each pinned to its own logical
+// processor.  Every worker owns a deque of jobs.  A thread pushes and pops jobs at the
+// back of its own deque, and when that is empty it steals from the front of the
+// others', so recently split work stays on the core that split it.  Threads that are
+// not workers share one extra deque.
+//
+// A job may count down a JobCounter when it finishes.  Waiting on a counter runs other
+// jobs until it reaches zero, so nested parallelism never blocks a worker, and jobs
+// queued with RunAfter start once a counter reaches zero.  ParallelFor splits an index
+// range into jobs of grain indices each and runs the last piece on the calling thread;
+// a range of one grain or less runs inline without touching the queues.
+//
+// The first exception thrown by a job is rethrown by Wait on its counter.  Jobs run
+// without a counter must not throw.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter& rhs) = delete;
+	JobCounter& operator=(const JobCounter& rhs) = delete;
+
+	bool IsDone()const
+	{
+		return mPending.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class JobSystem;
+
+	std::atomic<UINT> mPending{ 0 };
+
+	// Guards mContinuations and mError.
+	std::mutex mMutex;
+	std::vector<std::function<void()>> mContinuations;
+	std::exception_ptr mError;
+};
+
+class JobSystem
+{
+public:
+	// workerCount 0 starts one worker per hardware thread less one.
+	explicit JobSystem(UINT workerCount = 0);
+	JobSystem(const JobSystem& rhs) = delete;
+	JobSystem& operator=(const JobSystem& rhs) = delete;
+	~JobSystem();
+
+	// The scheduler shared by the whole process, started on first use.
+	static JobSystem& Shared();
+
+	UINT WorkerCount()const;
+
+	// Queues job.  counter, if given, is not done until job has finished.
+	void Run(std::function<void()> job, JobCounter* counter = nullptr);
+
+	// Queues job once dependency is done.  Give dependency no more jobs afterwards.
+	void RunAfter(JobCounter& dependency, std::function<void()> job, JobCounter* counter = nullptr);
+
+	// Runs queued jobs until counter is done, then rethrows the first exception any
+	// of its jobs threw.
+	void Wait(JobCounter& counter);
+
+	// Calls body(i) for each i in [begin, end), grain indices per job, and returns
+	// once every call has finished.
+	template<typename Body>
+	void ParallelFor(UINT begin, UINT end, UINT grain, Body&& body)
+	{
+		grain = std::max(grain, 1u);
+		if(end - begin <= grain)
+		{
+			for(UINT i = begin; i < end; ++i)
+				body(i);
+			return;
+		}
+
+		JobCounter counter;
+		UINT first = begin;
+		for(; end - first > grain; first += grain)
+		{
+			Run([first, grain, &body]()
+			{
+				for(UINT i = first; i < first + grain; ++i)
+					body(i);
+			}, &counter);
+		}
+
+		// The calling thread takes the last piece itself, then helps with the rest.
+		try
+		{
+			for(UINT i = first; i < end; ++i)
+				body(i);
+		}
+		catch(...)
+		{
+			// The queued pieces still reference body.
+			Wait(counter);
+			throw;
+		}
+		Wait(counter);
+	}
+
+private:
+	struct Job
+	{
+		std::function<void()> Work;
+		JobCounter* Counter = nullptr;
+	};
+
+	struct Queue
+	{
+		std::mutex Mutex;
+		std::deque<Job> Jobs;
+	};
+
+	void Push(Job job);
+	bool TryRunOne();
+	void Execute(Job& job);
+	void WorkerMain(UINT index);
+
+private:
+	std::vector<std::thread> mWorkers;
+
+	// One per worker, then the one shared by other threads.
+	std::vector<std::unique_ptr<Queue>> mQueues;
+
+	// Jobs queued and not yet taken, so idle workers know when to sleep.
+	std::atomic<UINT> mQueuedCount{ 0 };
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+	bool mStopping = false;
+};
@@ -0,0 +1,107 @@
+//***************************************************************************************
+// LinearAllocator.cpp
+//***************************************************************************************
+
+#include "LinearAllocator.h"
+
+LinearAllocator::LinearAllocator(ID3D12Device* device, UINT64 pageSize)
+	: md3dDevice(device), mPageSize(pageSize)
+{
+	AddPage(mPageSize);
+}
+
+LinearAllocator::~LinearAllocator()
+{
+	for(auto& page : mPages)
+		page.Resource->Unmap(0, nullptr);
+}
+
+LinearAllocation LinearAllocator::Allocate(UINT64 size, UINT64 alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	UINT64 offset = (mOffset + alignment - 1) & ~(alignment - 1);
+	if(offset + size > mPages.back().Size)
+	{
+		// Page alignment (64KB) satisfies any alignment asked for here.
+		AddPage(size);
+		offset = 0;
+	}
+
+	const Page& page = mPages.back();
+
+	LinearAllocation allocation;
+	allocation.Resource = page.Resource.Get();
+	allocation.Offset = offset;
+	allocation.CpuAddress = page.CpuBase + offset;
+	allocation.GpuAddress = page.GpuBase + offset;
+	allocation.Size = size;
+
+	mUsedBytes += (offset + size) - mOffset;
+	mOffset = offset + size;
+
+	return allocation;
+}
+
+void LinearAllocator::Reset()
+{
+	// The last frame overflowed.  Replace the pages with one that holds all of
+	// them so slices stay in a single resource from now on.
+	if(mPages.size() > 1)
+	{
+		UINT64 total = 0;
+		for(auto& page : mPages)
+		{
+			total += page.Size;
+			page.Resource->Unmap(0, nullptr);
+		}
+		mPages.clear();
+
+		mPageSize = total;
+		AddPage(mPageSize);
+	}
+
+	mOffset = 0;
+	mUsedBytes = 0;
+}
+
+UINT64 LinearAllocator::UsedBytes()const
+{
+	return mUsedBytes;
+}
+
+UINT64 LinearAllocator::CapacityBytes()const
+{
+	UINT64 total = 0;
+	for(const auto& page : mPages)
+		total += page.Size;
+	return total;
+}
+
+UINT LinearAllocator::PageCount()const
+{
+	return (UINT)mPages.size();
+}
+
+void LinearAllocator::AddPage(UINT64 minSize)
+{
+	const UINT64 granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+	Page page;
+	page.Size = (std::max(minSize, mPageSize) + granularity - 1) & ~(granularity - 1);
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(page.Size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&page.Resource)));
+
+	// Stays mapped for the life of the page; the CPU only writes to it.
+	ThrowIfFailed(page.Resource->Map(0, nullptr, reinterpret_cast<void**>(&page.CpuBase)));
+	page.GpuBase = page.Resource->GetGPUVirtualAddress();
+
+	mPages.push_back(page);
+	mOffset = 0;
+}
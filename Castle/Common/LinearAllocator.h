@@ -0,0 +1,160 @@
+//***************************************************************************************
+// LinearAllocator.h
+//
+// Bump allocator over persistently mapped upload-heap pages for data that is written
+// by the CPU once per frame.  Slices are handed out on demand with the alignment the
+// caller asks for (256 bytes for constant buffers).  When a page runs out another is
+// added; the next Reset folds them into one page big enough for the whole frame, so
+// after a frame or two everything comes from a single resource.
+//
+// Reset only once the GPU is done with every slice handed out since the last Reset.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "UploadWriter.h"
+
+struct LinearAllocation
+{
+	ID3D12Resource* Resource = nullptr;
+	UINT64 Offset = 0;
+	BYTE* CpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+	UINT64 Size = 0;
+};
+
+// Typed view of a LinearAllocation with the same write API as UploadBuffer.
+template<typename T>
+class UploadSlice
+{
+public:
+	UploadSlice() = default;
+	UploadSlice(const LinearAllocation& allocation, UINT elementByteSize) :
+		mAllocation(allocation), mElementByteSize(elementByteSize)
+	{
+	}
+
+	ID3D12Resource* Resource()const
+	{
+		return mAllocation.Resource;
+	}
+
+	// Byte offset of the slice within Resource().
+	UINT64 Offset()const
+	{
+		return mAllocation.Offset;
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS GpuAddress(UINT elementIndex = 0)const
+	{
+		return mAllocation.GpuAddress + (UINT64)elementIndex*mElementByteSize;
+	}
+
+	// Where element elementIndex is mapped, for writing it in place.  Write-combined,
+	// like MappedData.
+	BYTE* CpuAddress(UINT elementIndex = 0)const
+	{
+		return mAllocation.CpuAddress + (UINT64)elementIndex*mElementByteSize;
+	}
+
+	UINT ElementByteSize()const
+	{
+		return mElementByteSize;
+	}
+
+	// One element with plain stores.  Runs of elements go through the streaming
+	// writes below.
+	void CopyData(int elementIndex, const T& data)
+	{
+		memcpy(&mAllocation.CpuAddress[elementIndex*mElementByteSize], &data, sizeof(T));
+	}
+
+	// count elements from data into first onwards, streamed.
+	void CopyRange(UINT first, const T* data, UINT count)
+	{
+		Writer(first).Write(data, count);
+	}
+
+	// data[i] into element indices[i], streamed.
+	void CopyScatter(const UINT* indices, const T* data, UINT count)
+	{
+		UploadWriter<T>::Scatter(mAllocation.CpuAddress, mElementByteSize, indices, data, count);
+	}
+
+	// Streams elements into first onwards, one after another.
+	UploadWriter<T> Writer(UINT first = 0)
+	{
+		return UploadWriter<T>(mAllocation.CpuAddress, mElementByteSize, first);
+	}
+
+	// Only tightly packed slices can be viewed as an array of T.  The memory is
+	// write-combined: write it, never read it.
+	T* MappedData()
+	{
+		assert(mElementByteSize == sizeof(T));
+		return reinterpret_cast<T*>(mAllocation.CpuAddress);
+	}
+
+private:
+	LinearAllocation mAllocation;
+	UINT mElementByteSize = 0;
+};
+
+class LinearAllocator
+{
+public:
+	LinearAllocator(ID3D12Device* device, UINT64 pageSize);
+	LinearAllocator(const LinearAllocator& rhs) = delete;
+	LinearAllocator& operator=(const LinearAllocator& rhs) = delete;
+	~LinearAllocator();
+
+	// alignment must be a power of two.
+	LinearAllocation Allocate(UINT64 size, UINT64 alignment);
+
+	// count elements each padded to 256 bytes, for root CBVs.
+	template<typename T>
+	UploadSlice<T> AllocateConstants(UINT count)
+	{
+		UINT elementByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(T));
+		return UploadSlice<T>(Allocate((UINT64)elementByteSize*count,
+			D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT), elementByteSize);
+	}
+
+	// count tightly packed elements, for vertex, structured and argument buffers.
+	template<typename T>
+	UploadSlice<T> AllocateArray(UINT count)
+	{
+		return UploadSlice<T>(Allocate((UINT64)sizeof(T)*count, 16), sizeof(T));
+	}
+
+	// Makes all memory available again.  Everything handed out since the last
+	// Reset must be idle on the GPU.
+	void Reset();
+
+	// Bytes handed out since the last Reset, including alignment padding.
+	UINT64 UsedBytes()const;
+	UINT64 CapacityBytes()const;
+	UINT PageCount()const;
+
+private:
+	struct Page
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		BYTE* CpuBase = nullptr;
+		D3D12_GPU_VIRTUAL_ADDRESS GpuBase = 0;
+		UINT64 Size = 0;
+	};
+
+	void AddPage(UINT64 minSize);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT64 mPageSize = 0;
+	std::vector<Page> mPages;
+
+	// Next free byte in the last page.
+	UINT64 mOffset = 0;
+	UINT64 mUsedBytes = 0;
+};
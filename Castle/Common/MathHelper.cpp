@@ -79,4 +79,89 @@ XMVECTOR MathHelper::RandHemisphereUnitVec3(XMVECTOR n)
 
 		return XMVector3Normalize(v);
 	}
-}
\ No newline at end of file
+}
+
+XMFLOAT2 MathHelper::OctahedralEncode(const XMFLOAT3& n)
+{
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if(l1 == 0.0f)
+		return XMFLOAT2(0.0f, 0.0f);
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if(n.z < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	return XMFLOAT2(x, y);
+}
+
+XMFLOAT3 MathHelper::OctahedralDecode(const XMFLOAT2& e)
+{
+	XMFLOAT3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+	float t = Clamp(-n.z, 0.0f, 1.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+
+	XMFLOAT3 result;
+	XMStoreFloat3(&result, XMVector3Normalize(XMLoadFloat3(&n)));
+	return result;
+}
+
+XMMATRIX MathHelper::InverseRigid(CXMMATRIX M)
+{
+	XMMATRIX rotation = M;
+	rotation.r[3] = g_XMIdentityR3;
+
+	XMMATRIX inverse = XMMatrixTranspose(rotation);
+	XMVECTOR translation = XMVector3TransformNormal(M.r[3], inverse);
+	inverse.r[3] = XMVectorSelect(g_XMIdentityR3, XMVectorNegate(translation), g_XMSelect1110);
+	return inverse;
+}
+
+XMMATRIX MathHelper::InversePerspective(CXMMATRIX P)
+{
+	// P is [a 0 0 0; 0 b 0 0; 0 0 c 1; 0 0 d 0].
+	float a = XMVectorGetX(P.r[0]);
+	float b = XMVectorGetY(P.r[1]);
+	float c = XMVectorGetZ(P.r[2]);
+	float d = XMVectorGetZ(P.r[3]);
+
+	return XMMATRIX(
+		1.0f / a, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f / b, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f / d,
+		0.0f, 0.0f, 1.0f, -c / d);
+}
+
+void MathHelper::TransposeMatrices(const XMFLOAT4X4* src, UINT srcStride,
+	XMFLOAT4X4* dst, UINT dstStride, UINT count)
+{
+	const BYTE* in = reinterpret_cast<const BYTE*>(src);
+	BYTE* out = reinterpret_cast<BYTE*>(dst);
+
+	// Two matrices per iteration keep both sets of loads in flight while the
+	// shuffles of the other run.
+	UINT i = 0;
+	for(; i + 1 < count; i += 2)
+	{
+		XMMATRIX m0 = XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(in));
+		XMMATRIX m1 = XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(in + srcStride));
+		m0 = XMMatrixTranspose(m0);
+		m1 = XMMatrixTranspose(m1);
+		XMStoreFloat4x4A(reinterpret_cast<XMFLOAT4X4A*>(out), m0);
+		XMStoreFloat4x4A(reinterpret_cast<XMFLOAT4X4A*>(out + dstStride), m1);
+
+		in += 2*srcStride;
+		out += 2*dstStride;
+	}
+	if(i < count)
+	{
+		XMMATRIX m = XMMatrixTranspose(XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(in)));
+		XMStoreFloat4x4A(reinterpret_cast<XMFLOAT4X4A*>(out), m);
+	}
+}
@@ -78,6 +78,21 @@ public:
         return DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(&det, A));
 	}
 
+	// Inverse of a rotation followed by a translation, such as a view matrix: the
+	// transposed rotation and the translation taken back through it.
+	static DirectX::XMMATRIX InverseRigid(DirectX::CXMMATRIX M);
+
+	// Inverse of a left-handed perspective projection, as built by
+	// XMMatrixPerspectiveFovLH, from its four non-trivial entries.
+	static DirectX::XMMATRIX InversePerspective(DirectX::CXMMATRIX P);
+
+	// Writes the transposes of count matrices read every srcStride bytes from src to
+	// every dstStride bytes from dst, so a field of an array of structs can be filled
+	// in place.  dst is only written, never read, so it may be mapped upload memory;
+	// it must be 16 byte aligned, and so must dstStride.
+	static void TransposeMatrices(const DirectX::XMFLOAT4X4* src, UINT srcStride,
+		DirectX::XMFLOAT4X4* dst, UINT dstStride, UINT count);
+
     static DirectX::XMFLOAT4X4 Identity4x4()
     {
         static DirectX::XMFLOAT4X4 I(
@@ -92,6 +107,12 @@ public:
     static DirectX::XMVECTOR RandUnitVec3();
     static DirectX::XMVECTOR RandHemisphereUnitVec3(DirectX::XMVECTOR n);
 
+	// Maps a unit vector onto the [-1,1]^2 octahedral square: projected onto the
+	// octahedron |x|+|y|+|z| = 1, with the lower half folded over the diagonals.
+	static DirectX::XMFLOAT2 OctahedralEncode(const DirectX::XMFLOAT3& n);
+	// Inverse of OctahedralEncode, as the shaders decode it.
+	static DirectX::XMFLOAT3 OctahedralDecode(const DirectX::XMFLOAT2& e);
+
 	static const float Infinity;
 	static const float Pi;
 
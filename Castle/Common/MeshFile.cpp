@@ -0,0 +1,189 @@
+//***************************************************************************************
+// MeshFile.cpp
+//***************************************************************************************
+
+#include "MeshFile.h"
+#include <cassert>
+#include <fstream>
+
+using namespace DirectX;
+
+MeshFile::~MeshFile()
+{
+	Close();
+}
+
+bool MeshFile::Write(const std::wstring& filename, UINT64 sourceKey, const MeshFileData& data,
+	const D3D12_INPUT_ELEMENT_DESC* layout, UINT layoutCount)
+{
+	if(data.Vertices == nullptr || data.Indices == nullptr)
+		return false;
+
+	std::vector<VertexElement> elements;
+	for(UINT i = 0; i < layoutCount; ++i)
+		elements.push_back(ToVertexElement(layout[i]));
+
+	std::vector<Submesh> submeshes;
+	for(const MeshFileSubmesh& s : data.Submeshes)
+	{
+		if(s.Name.size() >= sizeof(Submesh::Name))
+			return false;
+
+		Submesh submesh = {};
+		strcpy_s(submesh.Name, s.Name.c_str());
+		submesh.IndexCount = s.IndexCount;
+		submesh.StartIndexLocation = s.StartIndexLocation;
+		submesh.BaseVertexLocation = s.BaseVertexLocation;
+		submesh.BoundsCenter = s.Bounds.Center;
+		submesh.BoundsExtents = s.Bounds.Extents;
+		submeshes.push_back(submesh);
+	}
+
+	Header header = {};
+	header.Magic = Magic;
+	header.Version = Version;
+	header.SourceKey = sourceKey;
+	header.VertexByteStride = data.VertexByteStride;
+	header.VertexBufferByteSize = data.VertexBufferByteSize;
+	header.IndexFormat = data.IndexFormat;
+	header.IndexBufferByteSize = data.IndexBufferByteSize;
+	header.LayoutCount = (UINT)elements.size();
+	header.SubmeshCount = (UINT)submeshes.size();
+	header.PositionBias = data.PositionBias;
+	header.PositionScale = data.PositionScale;
+	header.LayoutOffset = sizeof(Header);
+	header.SubmeshOffset = header.LayoutOffset + elements.size()*sizeof(VertexElement);
+	header.VertexDataOffset = header.SubmeshOffset + submeshes.size()*sizeof(Submesh);
+	header.IndexDataOffset = header.VertexDataOffset + data.VertexBufferByteSize;
+
+	// Write under a temporary name and rename, so a partly written file is never
+	// opened.
+	std::wstring tempFile = filename + L".tmp";
+	{
+		std::ofstream fout(tempFile, std::ios::binary | std::ios::trunc);
+		fout.write((const char*)&header, sizeof(header));
+		fout.write((const char*)elements.data(), elements.size()*sizeof(VertexElement));
+		fout.write((const char*)submeshes.data(), submeshes.size()*sizeof(Submesh));
+		fout.write((const char*)data.Vertices, data.VertexBufferByteSize);
+		fout.write((const char*)data.Indices, data.IndexBufferByteSize);
+		if(!fout)
+			return false;
+	}
+
+	return MoveFileExW(tempFile.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool MeshFile::Open(const std::wstring& filename, UINT64 sourceKey,
+	const D3D12_INPUT_ELEMENT_DESC* layout, UINT layoutCount, UINT vertexByteStride)
+{
+	Close();
+
+	mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size = {};
+	if(!GetFileSizeEx(mFile, &size) || size.QuadPart < (LONGLONG)sizeof(Header))
+	{
+		Close();
+		return false;
+	}
+	mSize = (UINT64)size.QuadPart;
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mMapping != nullptr)
+		mView = (const BYTE*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if(mView == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	const Header& header = *(const Header*)mView;
+	bool valid =
+		header.Magic == Magic &&
+		header.Version == Version &&
+		header.SourceKey == sourceKey &&
+		header.VertexByteStride == vertexByteStride &&
+		header.LayoutCount == layoutCount &&
+		header.LayoutOffset + (UINT64)header.LayoutCount*sizeof(VertexElement) <= mSize &&
+		header.SubmeshOffset + (UINT64)header.SubmeshCount*sizeof(Submesh) <= mSize &&
+		header.VertexDataOffset + header.VertexBufferByteSize <= mSize &&
+		header.IndexDataOffset + header.IndexBufferByteSize <= mSize &&
+		(header.IndexFormat == DXGI_FORMAT_R16_UINT || header.IndexFormat == DXGI_FORMAT_R32_UINT);
+
+	if(valid)
+	{
+		const VertexElement* elements = (const VertexElement*)(mView + header.LayoutOffset);
+		for(UINT i = 0; i < layoutCount && valid; ++i)
+		{
+			VertexElement expected = ToVertexElement(layout[i]);
+			valid = memcmp(&expected, &elements[i], sizeof(VertexElement)) == 0;
+		}
+	}
+
+	if(!valid)
+		Close();
+
+	return valid;
+}
+
+void MeshFile::Close()
+{
+	if(mView != nullptr)
+		UnmapViewOfFile(mView);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+	if(mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mView = nullptr;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+	mSize = 0;
+}
+
+MeshFileData MeshFile::Data()const
+{
+	assert(mView != nullptr);
+	const Header& header = *(const Header*)mView;
+
+	MeshFileData data;
+	data.Vertices = mView + header.VertexDataOffset;
+	data.VertexByteStride = header.VertexByteStride;
+	data.VertexBufferByteSize = header.VertexBufferByteSize;
+	data.Indices = mView + header.IndexDataOffset;
+	data.IndexFormat = (DXGI_FORMAT)header.IndexFormat;
+	data.IndexBufferByteSize = header.IndexBufferByteSize;
+	data.PositionBias = header.PositionBias;
+	data.PositionScale = header.PositionScale;
+
+	const Submesh* submeshes = (const Submesh*)(mView + header.SubmeshOffset);
+	for(UINT i = 0; i < header.SubmeshCount; ++i)
+	{
+		const Submesh& s = submeshes[i];
+
+		MeshFileSubmesh submesh;
+		// The name is not trusted to be terminated.
+		submesh.Name.assign(s.Name, strnlen(s.Name, sizeof(s.Name)));
+		submesh.IndexCount = s.IndexCount;
+		submesh.StartIndexLocation = s.StartIndexLocation;
+		submesh.BaseVertexLocation = s.BaseVertexLocation;
+		submesh.Bounds.Center = s.BoundsCenter;
+		submesh.Bounds.Extents = s.BoundsExtents;
+		data.Submeshes.push_back(submesh);
+	}
+
+	return data;
+}
+
+MeshFile::VertexElement MeshFile::ToVertexElement(const D3D12_INPUT_ELEMENT_DESC& desc)
+{
+	VertexElement element = {};
+	strncpy_s(element.SemanticName, desc.SemanticName, _TRUNCATE);
+	element.SemanticIndex = desc.SemanticIndex;
+	element.Format = desc.Format;
+	element.AlignedByteOffset = desc.AlignedByteOffset;
+	return element;
+}
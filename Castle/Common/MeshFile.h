@@ -0,0 +1,128 @@
+//***************************************************************************************
+// MeshFile.h
+//
+// Versioned binary container for a mesh: a header, the vertex layout and position
+// decode, the index format, a submesh table with bounds, then the vertex and index
+// data.  Open memory-maps the file and checks it against what the caller expects;
+// Data points straight into the mapping, so the caller uploads the vertex and index
+// data from there and a cached mesh is never rebuilt or reparsed.
+//
+// The caller's source key, typically a version of the code that generated the mesh,
+// is stored in the header; a different key or layout makes Open fail so the caller
+// regenerates and rewrites the file.
+//
+// Only Windows and Direct3D headers are used, not the MeshGeometry of any d3dUtil.h,
+// so every project shares this one copy.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <d3d12.h>
+#include <DirectXCollision.h>
+#include <string>
+#include <vector>
+
+struct MeshFileSubmesh
+{
+	std::string Name;
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	INT BaseVertexLocation = 0;
+	DirectX::BoundingBox Bounds;
+};
+
+// What a mesh file holds.  The vertex and index data are referenced, not copied.
+struct MeshFileData
+{
+	const void* Vertices = nullptr;
+	UINT VertexByteStride = 0;
+	UINT VertexBufferByteSize = 0;
+
+	const void* Indices = nullptr;
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+	UINT IndexBufferByteSize = 0;
+
+	// Decodes quantized positions as Bias + Scale*stored.
+	DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+
+	std::vector<MeshFileSubmesh> Submeshes;
+};
+
+class MeshFile
+{
+public:
+	static const UINT Magic = 0x4853454d; // "MESH"
+	static const UINT Version = 2;
+
+	MeshFile() = default;
+	MeshFile(const MeshFile& rhs) = delete;
+	MeshFile& operator=(const MeshFile& rhs) = delete;
+	~MeshFile();
+
+	static bool Write(const std::wstring& filename, UINT64 sourceKey, const MeshFileData& data,
+		const D3D12_INPUT_ELEMENT_DESC* layout, UINT layoutCount);
+
+	// False if the file is missing, truncated, from another version, or does not
+	// match sourceKey and the layout.
+	bool Open(const std::wstring& filename, UINT64 sourceKey,
+		const D3D12_INPUT_ELEMENT_DESC* layout, UINT layoutCount, UINT vertexByteStride);
+	void Close();
+
+	// The open file's contents.  The vertex and index data point into the mapping
+	// and are valid until Close.
+	MeshFileData Data()const;
+
+private:
+	struct Header
+	{
+		UINT Magic;
+		UINT Version;
+		UINT64 SourceKey;
+
+		UINT VertexByteStride;
+		UINT VertexBufferByteSize;
+		UINT IndexFormat;
+		UINT IndexBufferByteSize;
+
+		UINT LayoutCount;
+		UINT SubmeshCount;
+
+		// MeshFileData::PositionBias and PositionScale, for quantized positions.
+		DirectX::XMFLOAT3 PositionBias;
+		DirectX::XMFLOAT3 PositionScale;
+
+		// Byte offsets from the start of the file.
+		UINT64 LayoutOffset;
+		UINT64 SubmeshOffset;
+		UINT64 VertexDataOffset;
+		UINT64 IndexDataOffset;
+	};
+
+	struct VertexElement
+	{
+		char SemanticName[16];
+		UINT SemanticIndex;
+		UINT Format;
+		UINT AlignedByteOffset;
+	};
+
+	struct Submesh
+	{
+		char Name[32];
+		UINT IndexCount;
+		UINT StartIndexLocation;
+		INT BaseVertexLocation;
+		DirectX::XMFLOAT3 BoundsCenter;
+		DirectX::XMFLOAT3 BoundsExtents;
+	};
+
+	static VertexElement ToVertexElement(const D3D12_INPUT_ELEMENT_DESC& desc);
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const BYTE* mView = nullptr;
+	UINT64 mSize = 0;
+};
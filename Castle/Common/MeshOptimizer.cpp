@@ -0,0 +1,392 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using uint32 = GeometryGenerator::uint32;
+
+const float MeshOptimizer::DefaultOverdrawThreshold = 1.05f;
+
+namespace
+{
+	// Forsyth's scoring constants.
+	const float CacheDecayPower = 1.5f;
+	const float LastTriangleScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	const uint32 NotRemapped = 0xffffffff;
+
+	// Favours vertices near the front of the cache and, to avoid leaving lone
+	// triangles behind, vertices with few triangles left.
+	float VertexScore(int cachePosition, uint32 remainingTriangles)
+	{
+		if(remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if(cachePosition >= 0)
+		{
+			// The last triangle's vertices all score the same, whichever order they
+			// went in.
+			if(cachePosition < 3)
+				score = LastTriangleScore;
+			else
+			{
+				float scale = 1.0f / (MeshOptimizer::CacheSize - 3);
+				score = powf(1.0f - (cachePosition - 3)*scale, CacheDecayPower);
+			}
+		}
+
+		return score + ValenceBoostScale*powf((float)remainingTriangles, -ValenceBoostPower);
+	}
+
+	// FIFO cache simulation by timestamp; a vertex is cached if it missed within the
+	// last cacheSize misses.  Reset by advancing the time past every timestamp.
+	struct FifoCache
+	{
+		FifoCache(size_t vertexCount, unsigned int cacheSize)
+			: Timestamps(vertexCount, 0), Size(cacheSize), Time(cacheSize + 1)
+		{
+		}
+
+		unsigned int Misses(const uint32* triangle)
+		{
+			unsigned int misses = 0;
+			for(int k = 0; k < 3; ++k)
+			{
+				uint32 v = triangle[k];
+				if(Time - Timestamps[v] > Size)
+				{
+					Timestamps[v] = Time++;
+					++misses;
+				}
+			}
+			return misses;
+		}
+
+		void Reset()
+		{
+			Time += Size + 1;
+		}
+
+		std::vector<unsigned int> Timestamps;
+		unsigned int Size;
+		unsigned int Time;
+	};
+}
+
+MeshOptimizer::Report MeshOptimizer::Optimize(GeometryGenerator::MeshData& mesh, float overdrawThreshold)
+{
+	Report report;
+	report.AcmrBefore = Acmr(mesh.Indices32, mesh.Vertices.size());
+
+	// Tiny meshes can come out worse; keep the original then.
+	GeometryGenerator::MeshData original = mesh;
+
+	OptimizeVertexCache(mesh.Indices32, mesh.Vertices.size());
+	OptimizeOverdraw(mesh, overdrawThreshold);
+	OptimizeVertexFetch(mesh);
+
+	report.AcmrAfter = Acmr(mesh.Indices32, mesh.Vertices.size());
+	if(report.AcmrAfter > report.AcmrBefore)
+	{
+		mesh = original;
+		report.AcmrAfter = report.AcmrBefore;
+	}
+
+	return report;
+}
+
+float MeshOptimizer::Acmr(const std::vector<uint32>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if(triangleCount == 0)
+		return 0.0f;
+
+	FifoCache cache(vertexCount, cacheSize);
+	size_t misses = 0;
+	for(size_t t = 0; t < triangleCount; ++t)
+		misses += cache.Misses(&indices[t*3]);
+
+	return (float)misses / triangleCount;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32>& indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if(triangleCount == 0)
+		return;
+
+	// Triangles not yet emitted around each vertex, as slices of one array.  Emitted
+	// triangles are swapped out of the end of the slice.
+	std::vector<uint32> remaining(vertexCount, 0);
+	for(uint32 v : indices)
+		++remaining[v];
+
+	std::vector<uint32> offsets(vertexCount + 1, 0);
+	for(size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<uint32> adjacency(indices.size());
+	{
+		std::vector<uint32> fill(offsets.begin(), offsets.end() - 1);
+		for(size_t i = 0; i < indices.size(); ++i)
+			adjacency[fill[indices[i]]++] = (uint32)(i / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for(size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for(size_t t = 0; t < triangleCount; ++t)
+	{
+		triangleScore[t] = vertexScore[indices[t*3 + 0]] +
+			vertexScore[indices[t*3 + 1]] + vertexScore[indices[t*3 + 2]];
+	}
+
+	// Adds delta to the score of v's remaining triangles.
+	auto rescore = [&](uint32 v, int position)
+	{
+		float score = VertexScore(position, remaining[v]);
+		float delta = score - vertexScore[v];
+		vertexScore[v] = score;
+		cachePosition[v] = position;
+
+		for(uint32 i = offsets[v]; i < offsets[v] + remaining[v]; ++i)
+			triangleScore[adjacency[i]] += delta;
+	};
+
+	int best = (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+	std::vector<uint32> result;
+	result.reserve(indices.size());
+
+	// LRU order, most recent first.  Holds up to three extra entries while a
+	// triangle is pushed in.
+	std::vector<uint32> cache;
+	std::vector<uint32> nextCache;
+	cache.reserve(CacheSize + 3);
+	nextCache.reserve(CacheSize + 3);
+
+	size_t scanCursor = 0;
+	while(best >= 0)
+	{
+		const uint32* triangle = &indices[best*3];
+		emitted[best] = true;
+		result.insert(result.end(), triangle, triangle + 3);
+
+		for(int k = 0; k < 3; ++k)
+		{
+			uint32 v = triangle[k];
+			uint32* begin = &adjacency[offsets[v]];
+			uint32* end = begin + remaining[v];
+			std::iter_swap(std::find(begin, end, (uint32)best), end - 1);
+			--remaining[v];
+		}
+
+		nextCache.assign(triangle, triangle + 3);
+		for(uint32 v : cache)
+		{
+			if(v != triangle[0] && v != triangle[1] && v != triangle[2])
+				nextCache.push_back(v);
+		}
+
+		// Vertices pushed out of the cache lose their position bonus.
+		for(size_t i = CacheSize; i < nextCache.size(); ++i)
+			rescore(nextCache[i], -1);
+		if(nextCache.size() > CacheSize)
+			nextCache.resize(CacheSize);
+		cache.swap(nextCache);
+
+		for(size_t i = 0; i < cache.size(); ++i)
+			rescore(cache[i], (int)i);
+
+		// The next triangle almost always shares a cached vertex, so only those
+		// triangles are candidates.
+		best = -1;
+		float bestScore = -1.0f;
+		for(uint32 v : cache)
+		{
+			for(uint32 i = offsets[v]; i < offsets[v] + remaining[v]; ++i)
+			{
+				uint32 t = adjacency[i];
+				if(triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = (int)t;
+				}
+			}
+		}
+
+		// Dead end; restart from the first triangle left.
+		if(best < 0)
+		{
+			while(scanCursor < triangleCount && emitted[scanCursor])
+				++scanCursor;
+			if(scanCursor < triangleCount)
+				best = (int)scanCursor;
+		}
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(GeometryGenerator::MeshData& mesh, float threshold)
+{
+	auto& indices = mesh.Indices32;
+	const size_t triangleCount = indices.size() / 3;
+	if(triangleCount < 2)
+		return;
+
+	// Hard boundaries are where a triangle misses on all three vertices, so the
+	// cache starts cold anyway.
+	std::vector<size_t> hardClusters;
+	{
+		FifoCache cache(mesh.Vertices.size(), CacheSize);
+		for(size_t t = 0; t < triangleCount; ++t)
+		{
+			if(cache.Misses(&indices[t*3]) == 3 || t == 0)
+				hardClusters.push_back(t);
+		}
+		hardClusters.push_back(triangleCount);
+	}
+
+	// Within those, split again wherever the cluster so far is already about as
+	// cache efficient as the whole, since a reordered small cluster costs only its
+	// warm up.
+	std::vector<size_t> clusters;
+	FifoCache cache(mesh.Vertices.size(), CacheSize);
+	for(size_t c = 0; c + 1 < hardClusters.size(); ++c)
+	{
+		size_t start = hardClusters[c];
+		size_t end = hardClusters[c + 1];
+
+		cache.Reset();
+		size_t clusterMisses = 0;
+		for(size_t t = start; t < end; ++t)
+			clusterMisses += cache.Misses(&indices[t*3]);
+		float clusterThreshold = threshold * clusterMisses / (end - start);
+
+		cache.Reset();
+		clusters.push_back(start);
+		size_t misses = 0;
+		size_t clusterStart = start;
+		for(size_t t = start; t + 1 < end; ++t)
+		{
+			misses += cache.Misses(&indices[t*3]);
+			if((float)misses / (t + 1 - clusterStart) <= clusterThreshold)
+			{
+				clusters.push_back(t + 1);
+				clusterStart = t + 1;
+				misses = 0;
+				cache.Reset();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// Area weighted centroid and normal of each cluster.  Clusters facing away from
+	// the mesh centre are likely to occlude the rest, so they draw first.
+	struct Cluster
+	{
+		size_t Start;
+		size_t End;
+		float SortKey;
+	};
+
+	const auto& vertices = mesh.Vertices;
+	std::vector<Cluster> sorted;
+	std::vector<XMFLOAT3> centroids;
+	std::vector<XMFLOAT3> normals;
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+
+	for(size_t c = 0; c + 1 < clusters.size(); ++c)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+
+		for(size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t*3 + 0]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t*3 + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t*3 + 2]].Position);
+
+			// Clockwise front faces.
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			float a = XMVectorGetX(XMVector3Length(n));
+
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		XMFLOAT3 c3;
+		XMStoreFloat3(&c3, area > 0.0f ? centroid / area : centroid);
+		centroids.push_back(c3);
+
+		XMFLOAT3 n3;
+		XMStoreFloat3(&n3, XMVector3Normalize(normal));
+		normals.push_back(n3);
+
+		sorted.push_back({ clusters[c], clusters[c + 1], 0.0f });
+	}
+
+	if(meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	for(size_t c = 0; c < sorted.size(); ++c)
+	{
+		XMVECTOR toCluster = XMLoadFloat3(&centroids[c]) - meshCentroid;
+		sorted[c].SortKey = XMVectorGetX(XMVector3Dot(toCluster, XMLoadFloat3(&normals[c])));
+	}
+
+	std::stable_sort(sorted.begin(), sorted.end(),
+		[](const Cluster& a, const Cluster& b) { return a.SortKey > b.SortKey; });
+
+	std::vector<uint32> result;
+	result.reserve(indices.size());
+	for(const auto& cluster : sorted)
+		result.insert(result.end(), indices.begin() + cluster.Start*3, indices.begin() + cluster.End*3);
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GeometryGenerator::MeshData& mesh)
+{
+	const size_t vertexCount = mesh.Vertices.size();
+
+	std::vector<uint32> remap(vertexCount, NotRemapped);
+	uint32 next = 0;
+	for(uint32& i : mesh.Indices32)
+	{
+		if(remap[i] == NotRemapped)
+			remap[i] = next++;
+		i = remap[i];
+	}
+
+	// Unreferenced vertices are kept, after the rest, so the count does not change.
+	for(auto& r : remap)
+	{
+		if(r == NotRemapped)
+			r = next++;
+	}
+
+	std::vector<GeometryGenerator::Vertex> vertices(vertexCount);
+	for(size_t v = 0; v < vertexCount; ++v)
+		vertices[remap[v]] = mesh.Vertices[v];
+
+	mesh.Vertices.swap(vertices);
+}
@@ -0,0 +1,167 @@
+//***************************************************************************************
+// MeshletBuilder.cpp
+//***************************************************************************************
+
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Cones whose normals reach this close to perpendicular to their axis would pass
+	// the test from too few views to be worth the shader's time.
+	const float MinConeSpread = 0.1f;
+
+	const UINT NotInMeshlet = 0xffffffff;
+}
+
+UINT MeshletBuilder::Build(const std::uint16_t* indices, UINT indexCount, INT baseVertex,
+	const std::vector<XMFLOAT3>& positions, MeshletData& data)
+{
+	const size_t firstMeshlet = data.Meshlets.size();
+
+	// The local index of each vertex in the meshlet being filled.
+	std::vector<UINT> local(positions.size(), NotInMeshlet);
+	std::vector<UINT> vertices;
+	std::vector<UINT> primitives;
+
+	auto flush = [&]()
+	{
+		if(primitives.empty())
+			return;
+
+		Meshlet meshlet = {};
+		meshlet.VertexOffset = (UINT)data.Indices.size();
+		meshlet.VertexCount = (UINT)vertices.size();
+		data.Indices.insert(data.Indices.end(), vertices.begin(), vertices.end());
+		meshlet.PrimitiveOffset = (UINT)data.Indices.size();
+		meshlet.PrimitiveCount = (UINT)primitives.size();
+		data.Indices.insert(data.Indices.end(), primitives.begin(), primitives.end());
+
+		ComputeBounds(meshlet, data, positions);
+		data.Meshlets.push_back(meshlet);
+
+		for(UINT v : vertices)
+			local[v] = NotInMeshlet;
+		vertices.clear();
+		primitives.clear();
+	};
+
+	for(UINT i = 0; i + 2 < indexCount; i += 3)
+	{
+		UINT triangle[3];
+		for(int k = 0; k < 3; ++k)
+			triangle[k] = (UINT)(baseVertex + indices[i + k]);
+
+		// Triangles repeating a vertex draw nothing.
+		if(triangle[0] == triangle[1] || triangle[0] == triangle[2] || triangle[1] == triangle[2])
+			continue;
+
+		UINT newVertices = 0;
+		for(int k = 0; k < 3; ++k)
+		{
+			if(local[triangle[k]] == NotInMeshlet)
+				++newVertices;
+		}
+
+		if(vertices.size() + newVertices > MaxVertices || primitives.size() + 1 > MaxPrimitives)
+			flush();
+
+		UINT packed = 0;
+		for(int k = 0; k < 3; ++k)
+		{
+			UINT& l = local[triangle[k]];
+			if(l == NotInMeshlet)
+			{
+				l = (UINT)vertices.size();
+				vertices.push_back(triangle[k]);
+			}
+			packed |= l << (10*k);
+		}
+		primitives.push_back(packed);
+	}
+	flush();
+
+	return (UINT)(data.Meshlets.size() - firstMeshlet);
+}
+
+void MeshletBuilder::ComputeBounds(Meshlet& meshlet, const MeshletData& data,
+	const std::vector<XMFLOAT3>& positions)
+{
+	const UINT* vertices = &data.Indices[meshlet.VertexOffset];
+	const UINT* primitives = &data.Indices[meshlet.PrimitiveOffset];
+
+	// The sphere around the box of the vertices.
+	XMVECTOR vmin = XMLoadFloat3(&positions[vertices[0]]);
+	XMVECTOR vmax = vmin;
+	for(UINT i = 1; i < meshlet.VertexCount; ++i)
+	{
+		XMVECTOR p = XMLoadFloat3(&positions[vertices[i]]);
+		vmin = XMVectorMin(vmin, p);
+		vmax = XMVectorMax(vmax, p);
+	}
+	XMVECTOR center = 0.5f*(vmin + vmax);
+
+	float radius = 0.0f;
+	for(UINT i = 0; i < meshlet.VertexCount; ++i)
+	{
+		XMVECTOR p = XMLoadFloat3(&positions[vertices[i]]);
+		radius = std::max(radius, XMVectorGetX(XMVector3Length(p - center)));
+	}
+	XMStoreFloat3(&meshlet.Center, center);
+	meshlet.Radius = radius;
+
+	// Front faces wind clockwise seen from the eye, so cross(p1 - p0, p2 - p0)
+	// points out of them, towards it.
+	std::vector<XMVECTOR> normals;
+	std::vector<XMVECTOR> corners;
+	XMVECTOR axis = XMVectorZero();
+	for(UINT i = 0; i < meshlet.PrimitiveCount; ++i)
+	{
+		XMVECTOR p[3];
+		for(int k = 0; k < 3; ++k)
+			p[k] = XMLoadFloat3(&positions[vertices[(primitives[i] >> (10*k)) & 0x3ff]]);
+
+		XMVECTOR n = XMVector3Cross(p[1] - p[0], p[2] - p[0]);
+		float area = XMVectorGetX(XMVector3Length(n));
+		// Degenerate triangles are never drawn, so they bound nothing.
+		if(area <= 1e-12f)
+			continue;
+
+		n /= area;
+		normals.push_back(n);
+		corners.push_back(p[0]);
+		axis += n;
+	}
+
+	meshlet.ConeAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	meshlet.ConeApex = meshlet.Center;
+	meshlet.ConeCutoff = 1.0f;
+
+	float axisLength = XMVectorGetX(XMVector3Length(axis));
+	if(normals.empty() || axisLength <= 1e-6f)
+		return;
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for(const XMVECTOR& n : normals)
+		minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(n, axis)));
+	if(minDot <= MinConeSpread)
+		return;
+
+	// Slide the apex back along the axis until it is behind every triangle's plane,
+	// so from any eye inside the cone the whole meshlet faces away.
+	float maxT = 0.0f;
+	for(size_t i = 0; i < normals.size(); ++i)
+	{
+		float dc = XMVectorGetX(XMVector3Dot(center - corners[i], normals[i]));
+		float dn = XMVectorGetX(XMVector3Dot(axis, normals[i]));
+		maxT = std::max(maxT, dc / dn);
+	}
+
+	XMStoreFloat3(&meshlet.ConeAxis, axis);
+	XMStoreFloat3(&meshlet.ConeApex, center - axis*maxT);
+	meshlet.ConeCutoff = sqrtf(1.0f - minDot*minDot);
+}
@@ -0,0 +1,66 @@
+//***************************************************************************************
+// MeshletBuilder.h
+//
+// Splits indexed triangle lists into meshlets for mesh shaders: runs of consecutive
+// triangles touching at most MaxVertices vertices, MaxPrimitives triangles each.
+// Triangles are taken in index order, so a mesh already ordered by MeshOptimizer
+// packs into few meshlets sharing few vertices.
+//
+// Each meshlet is bounded for culling by a sphere and by a cone around its triangles'
+// normals.  A view from anywhere the cone test passes sees only their back faces:
+//
+//     dot(normalize(ConeApex - eye), ConeAxis) >= ConeCutoff
+//
+// Meshlets whose normals spread too far to be culled that way get a zero axis and a
+// cutoff of one, which no eye passes.  The test holds in the mesh's local space; an
+// affine world transform that keeps the winding keeps which faces are back faces, so
+// it holds for an eye brought into local space too.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+// Must match Meshlet in Meshlet.hlsl.
+struct Meshlet
+{
+	// Where the meshlet's vertices and triangles are in MeshletData::Indices.
+	UINT VertexOffset;
+	UINT VertexCount;
+	UINT PrimitiveOffset;
+	UINT PrimitiveCount;
+
+	// Bounds in the mesh's local space.
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+	DirectX::XMFLOAT3 ConeApex;
+	float ConeCutoff;
+	DirectX::XMFLOAT3 ConeAxis;
+	float Pad;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> Meshlets;
+
+	// Per meshlet its vertices, as indices into the vertex buffer, then its triangles,
+	// three 10 bit indices into those vertices packed in the low 30 bits.
+	std::vector<UINT> Indices;
+};
+
+class MeshletBuilder
+{
+public:
+	// The limits recommended for the widest range of hardware.
+	static const UINT MaxVertices = 64;
+	static const UINT MaxPrimitives = 124;
+
+	// Appends the meshlets of indexCount indices, relative to baseVertex, to data and
+	// returns how many there are.  positions holds the whole vertex buffer's.
+	static UINT Build(const std::uint16_t* indices, UINT indexCount, INT baseVertex,
+		const std::vector<DirectX::XMFLOAT3>& positions, MeshletData& data);
+
+private:
+	static void ComputeBounds(Meshlet& meshlet, const MeshletData& data,
+		const std::vector<DirectX::XMFLOAT3>& positions);
+};
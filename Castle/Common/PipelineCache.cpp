@@ -0,0 +1,450 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	template<typename T>
+	UINT64 HashValue(const T& value, UINT64 seed)
+	{
+		return d3dUtil::HashBytes(&value, sizeof(T), seed);
+	}
+
+	UINT64 HashString(const char* s, UINT64 seed)
+	{
+		return s != nullptr ? d3dUtil::HashBytes(s, strlen(s) + 1, seed) : HashValue(0, seed);
+	}
+
+	UINT64 HashShader(const D3D12_SHADER_BYTECODE& shader, UINT64 seed)
+	{
+		seed = HashValue(shader.BytecodeLength, seed);
+		return d3dUtil::HashBytes(shader.pShaderBytecode, shader.BytecodeLength, seed);
+	}
+
+	// The blend and depth-stencil descriptions are hashed member by member: the UINT8
+	// write and stencil masks are followed by padding, which desc initialization leaves
+	// undefined.
+	UINT64 HashBlendDesc(const D3D12_BLEND_DESC& desc, UINT64 seed)
+	{
+		seed = HashValue(desc.AlphaToCoverageEnable, seed);
+		seed = HashValue(desc.IndependentBlendEnable, seed);
+		for(const D3D12_RENDER_TARGET_BLEND_DESC& rt : desc.RenderTarget)
+		{
+			seed = HashValue(rt.BlendEnable, seed);
+			seed = HashValue(rt.LogicOpEnable, seed);
+			seed = HashValue(rt.SrcBlend, seed);
+			seed = HashValue(rt.DestBlend, seed);
+			seed = HashValue(rt.BlendOp, seed);
+			seed = HashValue(rt.SrcBlendAlpha, seed);
+			seed = HashValue(rt.DestBlendAlpha, seed);
+			seed = HashValue(rt.BlendOpAlpha, seed);
+			seed = HashValue(rt.LogicOp, seed);
+			seed = HashValue(rt.RenderTargetWriteMask, seed);
+		}
+		return seed;
+	}
+
+	UINT64 HashStencilOpDesc(const D3D12_DEPTH_STENCILOP_DESC& desc, UINT64 seed)
+	{
+		seed = HashValue(desc.StencilFailOp, seed);
+		seed = HashValue(desc.StencilDepthFailOp, seed);
+		seed = HashValue(desc.StencilPassOp, seed);
+		return HashValue(desc.StencilFunc, seed);
+	}
+
+	UINT64 HashDepthStencilDesc(const D3D12_DEPTH_STENCIL_DESC& desc, UINT64 seed)
+	{
+		seed = HashValue(desc.DepthEnable, seed);
+		seed = HashValue(desc.DepthWriteMask, seed);
+		seed = HashValue(desc.DepthFunc, seed);
+		seed = HashValue(desc.StencilEnable, seed);
+		seed = HashValue(desc.StencilReadMask, seed);
+		seed = HashValue(desc.StencilWriteMask, seed);
+		seed = HashStencilOpDesc(desc.FrontFace, seed);
+		return HashStencilOpDesc(desc.BackFace, seed);
+	}
+
+	// A pipeline state stream subobject: its type, then its value, each starting on a
+	// pointer boundary as CreatePipelineState parses them.
+	template<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE Type, typename T>
+	struct alignas(void*) StreamSubobject
+	{
+		D3D12_PIPELINE_STATE_SUBOBJECT_TYPE SubobjectType = Type;
+		T Value;
+	};
+
+	// Everything a mesh shader pipeline sets.  The topology is the mesh shader's.
+	struct MeshPipelineStream
+	{
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE, ID3D12RootSignature*> RootSignature;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_AS, D3D12_SHADER_BYTECODE> AS;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_MS, D3D12_SHADER_BYTECODE> MS;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS, D3D12_SHADER_BYTECODE> PS;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_BLEND, D3D12_BLEND_DESC> Blend;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_MASK, UINT> SampleMask;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RASTERIZER, D3D12_RASTERIZER_DESC> Rasterizer;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL, D3D12_DEPTH_STENCIL_DESC> DepthStencil;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS, D3D12_RT_FORMAT_ARRAY> RenderTargets;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT, DXGI_FORMAT> DepthStencilFormat;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_DESC, DXGI_SAMPLE_DESC> SampleDesc;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_NODE_MASK, UINT> NodeMask;
+		StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_FLAGS, D3D12_PIPELINE_STATE_FLAGS> Flags;
+	};
+}
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& filename)
+	: md3dDevice(device), mFilename(filename)
+{
+	// Pipeline libraries need ID3D12Device1.  Without one every PSO is compiled.
+	if(SUCCEEDED(device->QueryInterface(IID_PPV_ARGS(&md3dDevice1))))
+		OpenLibrary();
+
+	// Only mesh shader pipelines need it, and only devices that have it offer them.
+	device->QueryInterface(IID_PPV_ARGS(&md3dDevice2));
+
+#if defined(DEBUG) || defined(_DEBUG)
+	CheckHashIgnoresPadding();
+#endif
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateGraphicsPipelineState(
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	ComPtr<ID3D12PipelineState> pso;
+	if(mLibrary == nullptr)
+	{
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+		return pso;
+	}
+
+	std::wstring name = EntryName(L'G', HashDesc(desc));
+
+	// Fails if there is no such entry, or if the stored PSO does not match desc.
+	bool hit = SUCCEEDED(mLibrary->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso)));
+	if(!hit)
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+
+	Record(name, pso.Get(), hit);
+	return pso;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateComputePipelineState(
+	const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	ComPtr<ID3D12PipelineState> pso;
+	if(mLibrary == nullptr)
+	{
+		ThrowIfFailed(md3dDevice->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso)));
+		return pso;
+	}
+
+	std::wstring name = EntryName(L'C', HashDesc(desc));
+
+	bool hit = SUCCEEDED(mLibrary->LoadComputePipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso)));
+	if(!hit)
+		ThrowIfFailed(md3dDevice->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso)));
+
+	Record(name, pso.Get(), hit);
+	return pso;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateMeshPipelineState(
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+	const D3D12_SHADER_BYTECODE& as, const D3D12_SHADER_BYTECODE& ms)
+{
+	if(md3dDevice2 == nullptr)
+		ThrowIfFailed(E_NOINTERFACE);
+
+	MeshPipelineStream stream;
+	stream.RootSignature.Value = desc.pRootSignature;
+	stream.AS.Value = as;
+	stream.MS.Value = ms;
+	stream.PS.Value = desc.PS;
+	stream.Blend.Value = desc.BlendState;
+	stream.SampleMask.Value = desc.SampleMask;
+	stream.Rasterizer.Value = desc.RasterizerState;
+	stream.DepthStencil.Value = desc.DepthStencilState;
+	stream.RenderTargets.Value.NumRenderTargets = desc.NumRenderTargets;
+	for(UINT i = 0; i < 8; ++i)
+		stream.RenderTargets.Value.RTFormats[i] = desc.RTVFormats[i];
+	stream.DepthStencilFormat.Value = desc.DSVFormat;
+	stream.SampleDesc.Value = desc.SampleDesc;
+	stream.NodeMask.Value = desc.NodeMask;
+	stream.Flags.Value = desc.Flags;
+
+	D3D12_PIPELINE_STATE_STREAM_DESC streamDesc;
+	streamDesc.SizeInBytes = sizeof(stream);
+	streamDesc.pPipelineStateSubobjectStream = &stream;
+
+	ComPtr<ID3D12PipelineState> pso;
+	if(mLibrary1 == nullptr)
+	{
+		ThrowIfFailed(md3dDevice2->CreatePipelineState(&streamDesc, IID_PPV_ARGS(&pso)));
+		return pso;
+	}
+
+	UINT64 hash = HashDesc(desc);
+	hash = HashShader(as, hash);
+	hash = HashShader(ms, hash);
+	std::wstring name = EntryName(L'M', hash);
+
+	bool hit = SUCCEEDED(mLibrary1->LoadPipeline(name.c_str(), &streamDesc, IID_PPV_ARGS(&pso)));
+	if(!hit)
+		ThrowIfFailed(md3dDevice2->CreatePipelineState(&streamDesc, IID_PPV_ARGS(&pso)));
+
+	Record(name, pso.Get(), hit);
+	return pso;
+}
+
+void PipelineCache::Save()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if(mLibrary == nullptr || mMissCount == 0)
+		return;
+
+	// Stale entries cannot be removed from or replaced in a library, so write a new
+	// one holding exactly this run's PSOs.
+	ComPtr<ID3D12PipelineLibrary> library;
+	ThrowIfFailed(md3dDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&library)));
+
+	for(const auto& e : mCreated)
+	{
+		// A PSO requested twice is only stored once.
+		HRESULT hr = library->StorePipeline(e.first.c_str(), e.second.Get());
+		if(hr != E_INVALIDARG)
+			ThrowIfFailed(hr);
+	}
+
+	std::vector<char> data(library->GetSerializedSize());
+	ThrowIfFailed(library->Serialize(data.data(), data.size()));
+
+	std::ofstream fout(mFilename, std::ios::binary | std::ios::trunc);
+	fout.write(data.data(), data.size());
+	if(!fout)
+	{
+		OutputDebugStringW((L"PipelineCache: could not write " + mFilename + L"\n").c_str());
+		return;
+	}
+
+	mMissCount = 0;
+}
+
+bool PipelineCache::Enabled()const
+{
+	return mLibrary != nullptr;
+}
+
+UINT PipelineCache::HitCount()const
+{
+	return mHitCount;
+}
+
+UINT PipelineCache::MissCount()const
+{
+	return mMissCount;
+}
+
+UINT64 PipelineCache::HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	UINT64 hash = d3dUtil::HashBytes(nullptr, 0);
+
+	hash = HashShader(desc.VS, hash);
+	hash = HashShader(desc.PS, hash);
+	hash = HashShader(desc.DS, hash);
+	hash = HashShader(desc.HS, hash);
+	hash = HashShader(desc.GS, hash);
+
+	hash = HashValue(desc.StreamOutput.NumEntries, hash);
+	for(UINT i = 0; i < desc.StreamOutput.NumEntries; ++i)
+	{
+		const D3D12_SO_DECLARATION_ENTRY& entry = desc.StreamOutput.pSODeclaration[i];
+		hash = HashValue(entry.Stream, hash);
+		hash = HashString(entry.SemanticName, hash);
+		hash = HashValue(entry.SemanticIndex, hash);
+		hash = HashValue(entry.StartComponent, hash);
+		hash = HashValue(entry.ComponentCount, hash);
+		hash = HashValue(entry.OutputSlot, hash);
+	}
+	hash = d3dUtil::HashBytes(desc.StreamOutput.pBufferStrides,
+		desc.StreamOutput.NumStrides*sizeof(UINT), hash);
+	hash = HashValue(desc.StreamOutput.RasterizedStream, hash);
+
+	hash = HashBlendDesc(desc.BlendState, hash);
+	hash = HashValue(desc.SampleMask, hash);
+	hash = HashValue(desc.RasterizerState, hash);
+	hash = HashDepthStencilDesc(desc.DepthStencilState, hash);
+
+	hash = HashValue(desc.InputLayout.NumElements, hash);
+	for(UINT i = 0; i < desc.InputLayout.NumElements; ++i)
+	{
+		const D3D12_INPUT_ELEMENT_DESC& element = desc.InputLayout.pInputElementDescs[i];
+		hash = HashString(element.SemanticName, hash);
+		hash = HashValue(element.SemanticIndex, hash);
+		hash = HashValue(element.Format, hash);
+		hash = HashValue(element.InputSlot, hash);
+		hash = HashValue(element.AlignedByteOffset, hash);
+		hash = HashValue(element.InputSlotClass, hash);
+		hash = HashValue(element.InstanceDataStepRate, hash);
+	}
+
+	hash = HashValue(desc.IBStripCutValue, hash);
+	hash = HashValue(desc.PrimitiveTopologyType, hash);
+	hash = HashValue(desc.NumRenderTargets, hash);
+	hash = HashValue(desc.RTVFormats, hash);
+	hash = HashValue(desc.DSVFormat, hash);
+	hash = HashValue(desc.SampleDesc, hash);
+	hash = HashValue(desc.NodeMask, hash);
+	hash = HashValue(desc.Flags, hash);
+
+	return hash;
+}
+
+UINT64 PipelineCache::HashDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	UINT64 hash = d3dUtil::HashBytes(nullptr, 0);
+
+	hash = HashShader(desc.CS, hash);
+	hash = HashValue(desc.NodeMask, hash);
+	hash = HashValue(desc.Flags, hash);
+
+	return hash;
+}
+
+#if defined(DEBUG) || defined(_DEBUG)
+void PipelineCache::CheckHashIgnoresPadding()
+{
+	// Two equal descriptions over storage filled differently beforehand, so only
+	// their padding bytes differ.
+	alignas(D3D12_GRAPHICS_PIPELINE_STATE_DESC) BYTE storage[2][sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC)];
+	memset(storage[0], 0x00, sizeof(storage[0]));
+	memset(storage[1], 0xff, sizeof(storage[1]));
+
+	UINT64 hashes[2];
+	for(int i = 0; i < 2; ++i)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc = *reinterpret_cast<D3D12_GRAPHICS_PIPELINE_STATE_DESC*>(storage[i]);
+		desc.VS = {};
+		desc.PS = {};
+		desc.DS = {};
+		desc.HS = {};
+		desc.GS = {};
+		desc.StreamOutput = {};
+		desc.pRootSignature = nullptr;
+
+		D3D12_BLEND_DESC& blend = desc.BlendState;
+		blend.AlphaToCoverageEnable = FALSE;
+		blend.IndependentBlendEnable = FALSE;
+		for(D3D12_RENDER_TARGET_BLEND_DESC& rt : blend.RenderTarget)
+		{
+			rt.BlendEnable = TRUE;
+			rt.LogicOpEnable = FALSE;
+			rt.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+			rt.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+			rt.BlendOp = D3D12_BLEND_OP_ADD;
+			rt.SrcBlendAlpha = D3D12_BLEND_ONE;
+			rt.DestBlendAlpha = D3D12_BLEND_ZERO;
+			rt.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+			rt.LogicOp = D3D12_LOGIC_OP_NOOP;
+			rt.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+		}
+		desc.SampleMask = UINT_MAX;
+		desc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+
+		D3D12_DEPTH_STENCIL_DESC& depth = desc.DepthStencilState;
+		depth.DepthEnable = TRUE;
+		depth.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+		depth.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+		depth.StencilEnable = TRUE;
+		depth.StencilReadMask = D3D12_DEFAULT_STENCIL_READ_MASK;
+		depth.StencilWriteMask = D3D12_DEFAULT_STENCIL_WRITE_MASK;
+		depth.FrontFace = { D3D12_STENCIL_OP_KEEP, D3D12_STENCIL_OP_KEEP, D3D12_STENCIL_OP_REPLACE, D3D12_COMPARISON_FUNC_ALWAYS };
+		depth.BackFace = depth.FrontFace;
+
+		desc.InputLayout = {};
+		desc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
+		desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+		desc.NumRenderTargets = 1;
+		for(DXGI_FORMAT& format : desc.RTVFormats)
+			format = DXGI_FORMAT_UNKNOWN;
+		desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		desc.SampleDesc = { 1, 0 };
+		desc.NodeMask = 0;
+		desc.CachedPSO = {};
+		desc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+
+		hashes[i] = HashDesc(desc);
+	}
+
+	assert(memcmp(storage[0], storage[1], sizeof(storage[0])) != 0);
+	assert(hashes[0] == hashes[1]);
+}
+#endif
+
+std::wstring PipelineCache::EntryName(wchar_t kind, UINT64 hash)
+{
+	wchar_t name[20];
+	swprintf_s(name, L"%c%016llx", kind, hash);
+	return name;
+}
+
+void PipelineCache::OpenLibrary()
+{
+	std::ifstream fin(mFilename, std::ios::binary | std::ios::ate);
+	if(fin)
+	{
+		std::streamoff size = fin.tellg();
+		fin.seekg(0, std::ios::beg);
+
+		mFileData.resize((size_t)size);
+		if(size > 0 && fin.read(mFileData.data(), size))
+		{
+			// Fails with D3D12_ERROR_DRIVER_VERSION_MISMATCH or
+			// D3D12_ERROR_ADAPTER_NOT_FOUND if the file was written on another
+			// driver or adapter, and E_INVALIDARG if it is corrupt.  It is
+			// replaced on the next Save either way.
+			HRESULT hr = md3dDevice1->CreatePipelineLibrary(mFileData.data(), mFileData.size(),
+				IID_PPV_ARGS(&mLibrary));
+			if(FAILED(hr))
+			{
+				char msg[64];
+				sprintf_s(msg, "PipelineCache: ignoring stale library (0x%08x)\n", (unsigned)hr);
+				OutputDebugStringA(msg);
+				mLibrary = nullptr;
+			}
+		}
+	}
+
+	if(mLibrary == nullptr)
+	{
+		mFileData.clear();
+
+		// Some tools and older runtimes report DXGI_ERROR_UNSUPPORTED; fall back to
+		// compiling every PSO.
+		if(FAILED(md3dDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+			mLibrary = nullptr;
+	}
+
+	if(mLibrary != nullptr)
+		mLibrary.As(&mLibrary1);
+}
+
+void PipelineCache::Record(const std::wstring& name, ID3D12PipelineState* pso, bool hit)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mCreated.push_back(std::make_pair(name, pso));
+	if(hit)
+		++mHitCount;
+	else
+		++mMissCount;
+}
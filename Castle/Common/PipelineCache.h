@@ -0,0 +1,85 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Creates pipeline state objects through an ID3D12PipelineLibrary persisted to disk, so
+// PSOs compiled on an earlier run are reloaded instead of compiled by the driver again.
+// Entries are named by a hash of the whole pipeline description, shader bytecode and
+// input layout included, so any change to a PSO makes it a new entry.  The root
+// signature is identified by pointer only, but the library checks it when loading and
+// a mismatch counts as a miss.
+//
+// A file written by another driver or adapter, or one that fails to parse, is ignored
+// and every PSO is created normally.  Save rewrites the file, with just the PSOs
+// created since construction, only if one of them missed.
+//
+// Creation may be called from several threads at once.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <mutex>
+
+class PipelineCache
+{
+public:
+	PipelineCache(ID3D12Device* device, const std::wstring& filename);
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+	~PipelineCache();
+
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateGraphicsPipelineState(
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateComputePipelineState(
+		const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+	// An amplification and mesh shader pipeline, with the root signature, pixel shader
+	// and fixed-function state of desc, which must have no vertex stages or input
+	// layout.  as may be empty.  Needs ID3D12Device2.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateMeshPipelineState(
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+		const D3D12_SHADER_BYTECODE& as, const D3D12_SHADER_BYTECODE& ms);
+
+	// Writes the library back to disk if any PSO had to be compiled.
+	void Save();
+
+	// False when the device has no pipeline library support and every PSO is
+	// compiled each run.
+	bool Enabled()const;
+
+	UINT HitCount()const;
+	UINT MissCount()const;
+
+private:
+	static UINT64 HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	static UINT64 HashDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+	static std::wstring EntryName(wchar_t kind, UINT64 hash);
+
+#if defined(DEBUG) || defined(_DEBUG)
+	// Asserts that descriptions equal member for member hash alike whatever their
+	// padding bytes hold.
+	static void CheckHashIgnoresPadding();
+#endif
+
+	void OpenLibrary();
+	void Record(const std::wstring& name, ID3D12PipelineState* pso, bool hit);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> md3dDevice;
+	Microsoft::WRL::ComPtr<ID3D12Device1> md3dDevice1;
+	Microsoft::WRL::ComPtr<ID3D12Device2> md3dDevice2;
+	std::wstring mFilename;
+
+	// The library reads from the serialized blob for as long as it is alive.
+	std::vector<char> mFileData;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+	// Loads pipelines described by a stream, such as mesh shader ones; null on
+	// runtimes without it, which then compile those every run.
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary1> mLibrary1;
+
+	// Every PSO created through the cache, for rebuilding the library on Save.
+	std::mutex mMutex;
+	std::vector<std::pair<std::wstring, Microsoft::WRL::ComPtr<ID3D12PipelineState>>> mCreated;
+	UINT mHitCount = 0;
+	UINT mMissCount = 0;
+};
@@ -0,0 +1,605 @@
+//***************************************************************************************
+// RenderGraph.cpp
+//***************************************************************************************
+
+#include "RenderGraph.h"
+#include <sstream>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	// What a compute list may transition between.  COMMON is zero, so it is included.
+	const D3D12_RESOURCE_STATES gComputeStates = D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_COPY_DEST |
+		D3D12_RESOURCE_STATE_COPY_SOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+
+	bool ComputeState(D3D12_RESOURCE_STATES state)
+	{
+		return (state & ~gComputeStates) == 0;
+	}
+
+	bool RenderOrDepthTarget(const D3D12_RESOURCE_DESC& desc)
+	{
+		return (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0;
+	}
+
+	// Field by field, since the padding of a caller's desc is not initialized.
+	bool SameDesc(const D3D12_RESOURCE_DESC& a, const D3D12_RESOURCE_DESC& b)
+	{
+		return a.Dimension == b.Dimension && a.Alignment == b.Alignment && a.Width == b.Width &&
+			a.Height == b.Height && a.DepthOrArraySize == b.DepthOrArraySize && a.MipLevels == b.MipLevels &&
+			a.Format == b.Format && a.SampleDesc.Count == b.SampleDesc.Count &&
+			a.SampleDesc.Quality == b.SampleDesc.Quality && a.Layout == b.Layout && a.Flags == b.Flags;
+	}
+
+	UINT64 AlignUp(UINT64 value, UINT64 alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	double ToMB(UINT64 bytes)
+	{
+		return (double)bytes / (1024.0 * 1024.0);
+	}
+}
+
+RenderGraph::RenderGraph(ID3D12Device* device)
+	: md3dDevice(device)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+}
+
+void RenderGraph::Reset(UINT64 completedFence, FrameArena& arena)
+{
+	mArena = &arena;
+	mPasses.clear();
+	mResources.clear();
+	mSchedule.clear();
+	mAsyncPassCount = 0;
+	mStartBarriers[0].clear();
+	mStartBarriers[1].clear();
+	mEndBarriers.clear();
+
+	mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+		[completedFence](const Retired& retired) { return retired.Fence <= completedFence; }), mRetired.end());
+}
+
+RenderGraph::Handle RenderGraph::Import(const char* name, ID3D12Resource* resource,
+	D3D12_RESOURCE_STATES state, D3D12_RESOURCE_STATES finalState)
+{
+	GraphResource r;
+	r.Name = name;
+	r.Imported = resource;
+	r.State = state;
+	r.FinalState = finalState;
+	mResources.push_back(r);
+	return (Handle)mResources.size() - 1;
+}
+
+RenderGraph::Handle RenderGraph::CreateTexture(const char* name, const D3D12_RESOURCE_DESC& desc)
+{
+	GraphResource r;
+	r.Name = name;
+	r.Desc = desc;
+	mResources.push_back(r);
+	return (Handle)mResources.size() - 1;
+}
+
+UINT RenderGraph::AddPass(const char* name, RenderGraphQueue queue,
+	std::function<void(ID3D12GraphicsCommandList*)> execute)
+{
+	Pass pass(*mArena);
+	pass.Name = name;
+	pass.Queue = queue;
+	pass.Execute = std::move(execute);
+	mPasses.push_back(std::move(pass));
+	return (UINT)mPasses.size() - 1;
+}
+
+void RenderGraph::Read(UINT pass, Handle resource, D3D12_RESOURCE_STATES state)
+{
+	assert(pass < mPasses.size() && resource < mResources.size());
+
+	Access access;
+	access.Resource = resource;
+	access.State = state;
+	mPasses[pass].Accesses.push_back(access);
+}
+
+void RenderGraph::Write(UINT pass, Handle resource, D3D12_RESOURCE_STATES state)
+{
+	assert(pass < mPasses.size() && resource < mResources.size());
+
+	Access access;
+	access.Resource = resource;
+	access.State = state;
+	access.Write = true;
+	mPasses[pass].Accesses.push_back(access);
+}
+
+void RenderGraph::SetSideEffects(UINT pass)
+{
+	mPasses[pass].SideEffects = true;
+}
+
+void RenderGraph::Compile(bool asyncCompute)
+{
+	CullPasses();
+	AssignQueues(asyncCompute);
+	PlaceTransients();
+	ScheduleBarriers();
+}
+
+void RenderGraph::CullPasses()
+{
+	// Backwards, so a pass is kept once a kept pass after it reads what it writes.
+	// A write satisfies the reads after it; the reads before it need the earlier writer.
+	ArenaVector<UINT8> needed(mResources.size(), 0, *mArena);
+	mCulledCount = 0;
+	for(size_t i = mPasses.size(); i-- > 0;)
+	{
+		Pass& pass = mPasses[i];
+
+		bool keep = pass.SideEffects;
+		for(const Access& access : pass.Accesses)
+		{
+			if(access.Write && (mResources[access.Resource].Imported != nullptr || needed[access.Resource]))
+				keep = true;
+		}
+
+		pass.Culled = !keep;
+		if(!keep)
+		{
+			++mCulledCount;
+			continue;
+		}
+
+		for(const Access& access : pass.Accesses)
+		{
+			if(access.Write)
+				needed[access.Resource] = 0;
+		}
+		for(const Access& access : pass.Accesses)
+		{
+			if(!access.Write)
+				needed[access.Resource] = 1;
+		}
+	}
+}
+
+void RenderGraph::AssignQueues(bool asyncCompute)
+{
+	// A compute pass goes to the compute list, which runs ahead of the whole graphics
+	// list, only if no graphics pass before it touches its resources.  Transients stay
+	// on the graphics list, as aliasing cannot be ordered across queues.
+	ArenaVector<UINT8> graphicsTouched(mResources.size(), 0, *mArena);
+	ArenaVector<D3D12_RESOURCE_STATES> asyncStates(mResources.size(), D3D12_RESOURCE_STATE_COMMON, *mArena);
+	for(size_t r = 0; r < mResources.size(); ++r)
+		asyncStates[r] = mResources[r].State;
+
+	for(Pass& pass : mPasses)
+	{
+		pass.Async = false;
+		if(pass.Culled)
+			continue;
+
+		bool async = asyncCompute && pass.Queue == RenderGraphQueue::Compute;
+		for(const Access& access : pass.Accesses)
+		{
+			if(!async)
+				break;
+
+			const GraphResource& resource = mResources[access.Resource];
+			D3D12_RESOURCE_STATES state = PassState(pass, access.Resource, nullptr);
+			D3D12_RESOURCE_STATES current = asyncStates[access.Resource];
+			async = resource.Imported != nullptr && !graphicsTouched[access.Resource] &&
+				(current == state || (ComputeState(current) && ComputeState(state)));
+		}
+
+		pass.Async = async;
+		for(const Access& access : pass.Accesses)
+		{
+			if(async)
+				asyncStates[access.Resource] = PassState(pass, access.Resource, nullptr);
+			else
+				graphicsTouched[access.Resource] = 1;
+		}
+	}
+
+	for(int async = 1; async >= 0; --async)
+	{
+		for(UINT i = 0; i < (UINT)mPasses.size(); ++i)
+		{
+			if(!mPasses[i].Culled && mPasses[i].Async == (async == 1))
+				mSchedule.push_back(i);
+		}
+		if(async == 1)
+			mAsyncPassCount = (UINT)mSchedule.size();
+	}
+}
+
+void RenderGraph::PlaceTransients()
+{
+	for(UINT s = 0; s < (UINT)mSchedule.size(); ++s)
+	{
+		for(const Access& access : mPasses[mSchedule[s]].Accesses)
+		{
+			GraphResource& resource = mResources[access.Resource];
+			resource.FirstUse = std::min(resource.FirstUse, s);
+			resource.LastUse = std::max(resource.LastUse, s);
+		}
+	}
+
+	// The transients some kept pass uses, in the order they were created.
+	ArenaVector<Handle> live(*mArena);
+	ArenaVector<TransientTexture> layout(*mArena);
+	UINT64 alignments[HeapCount] =
+	{
+		D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
+		D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT
+	};
+	for(Handle h = 0; h < (Handle)mResources.size(); ++h)
+	{
+		GraphResource& resource = mResources[h];
+		if(resource.Imported != nullptr || resource.FirstUse == UINT_MAX)
+			continue;
+
+		D3D12_RESOURCE_ALLOCATION_INFO info = md3dDevice->GetResourceAllocationInfo(0, 1, &resource.Desc);
+
+		TransientTexture texture;
+		texture.Desc = resource.Desc;
+		texture.Heap = RenderOrDepthTarget(resource.Desc) ? 0 : 1;
+		texture.Size = info.SizeInBytes;
+		alignments[texture.Heap] = std::max(alignments[texture.Heap], info.Alignment);
+
+		resource.Transient = (UINT)layout.size();
+		live.push_back(h);
+		layout.push_back(texture);
+	}
+
+	// Largest first, each at the lowest offset clear of every texture placed so far
+	// that is alive at the same time.  The candidates are the start of the heap and
+	// the ends of the textures already there.
+	ArenaVector<UINT> order(layout.size(), 0, *mArena);
+	for(UINT i = 0; i < (UINT)order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(),
+		[&layout](UINT a, UINT b) { return layout[a].Size > layout[b].Size; });
+
+	UINT64 heapSizes[HeapCount] = {};
+	ArenaVector<UINT> placed(*mArena);
+	ArenaVector<UINT64> candidates(*mArena);
+	mTransientBytes = 0;
+	for(UINT i : order)
+	{
+		TransientTexture& texture = layout[i];
+		const GraphResource& resource = mResources[live[i]];
+		UINT64 alignment = alignments[texture.Heap];
+
+		auto overlaps = [&](UINT other, UINT64 offset)
+		{
+			const TransientTexture& o = layout[other];
+			const GraphResource& r = mResources[live[other]];
+			return o.Heap == texture.Heap &&
+				resource.FirstUse <= r.LastUse && r.FirstUse <= resource.LastUse &&
+				offset < o.Offset + o.Size && o.Offset < offset + texture.Size;
+		};
+
+		candidates.assign(1, 0);
+		for(UINT other : placed)
+		{
+			if(layout[other].Heap == texture.Heap)
+				candidates.push_back(AlignUp(layout[other].Offset + layout[other].Size, alignment));
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		for(UINT64 offset : candidates)
+		{
+			if(std::none_of(placed.begin(), placed.end(), [&](UINT other) { return overlaps(other, offset); }))
+			{
+				texture.Offset = offset;
+				break;
+			}
+		}
+
+		placed.push_back(i);
+		heapSizes[texture.Heap] = std::max(heapSizes[texture.Heap], texture.Offset + texture.Size);
+		mTransientBytes += texture.Size;
+	}
+
+	// Sharing any memory with another texture, at any time, takes an aliasing barrier
+	// on entry.
+	for(UINT i = 0; i < (UINT)layout.size(); ++i)
+	{
+		for(UINT j = 0; j < (UINT)layout.size(); ++j)
+		{
+			const TransientTexture& a = layout[i];
+			const TransientTexture& b = layout[j];
+			if(i != j && a.Heap == b.Heap && a.Offset < b.Offset + b.Size && b.Offset < a.Offset + a.Size)
+				layout[i].Aliased = true;
+		}
+	}
+
+	mHeapBytes = 0;
+	for(UINT heap = 0; heap < HeapCount; ++heap)
+		mHeapBytes += heapSizes[heap];
+
+	// Most frames declare what the last one did, and keep its textures.
+	bool same = layout.size() == mTransients.size();
+	for(UINT heap = 0; heap < HeapCount && same; ++heap)
+		same = heapSizes[heap] == mHeapSizes[heap];
+	for(size_t i = 0; i < layout.size() && same; ++i)
+	{
+		same = SameDesc(layout[i].Desc, mTransients[i].Desc) &&
+			layout[i].Heap == mTransients[i].Heap && layout[i].Offset == mTransients[i].Offset;
+	}
+	if(same)
+		return;
+
+	// The last frame to use the old textures may still be in flight.
+	Retired retired;
+	for(UINT heap = 0; heap < HeapCount; ++heap)
+		retired.Heaps[heap] = std::move(mHeaps[heap]);
+	retired.Textures = std::move(mTransients);
+	retired.Fence = mLastFrameFence;
+	mRetired.push_back(std::move(retired));
+
+	const D3D12_HEAP_FLAGS heapFlags[HeapCount] =
+	{
+		D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES
+	};
+	for(UINT heap = 0; heap < HeapCount; ++heap)
+	{
+		mHeapSizes[heap] = heapSizes[heap];
+		if(heapSizes[heap] == 0)
+			continue;
+
+		CD3DX12_HEAP_DESC heapDesc(heapSizes[heap], D3D12_HEAP_TYPE_DEFAULT, alignments[heap], heapFlags[heap]);
+		ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&mHeaps[heap])));
+	}
+
+	for(TransientTexture& texture : layout)
+	{
+		ThrowIfFailed(md3dDevice->CreatePlacedResource(mHeaps[texture.Heap].Get(), texture.Offset,
+			&texture.Desc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&texture.Texture)));
+		texture.State = D3D12_RESOURCE_STATE_COMMON;
+	}
+	mTransients.assign(std::make_move_iterator(layout.begin()), std::make_move_iterator(layout.end()));
+	++mTransientGeneration;
+}
+
+void RenderGraph::ScheduleBarriers()
+{
+	struct Track
+	{
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+		int LastPass = -1;
+		bool LastWrite = false;
+	};
+
+	ArenaVector<Track> tracks(mResources.size(), Track(), *mArena);
+	for(size_t r = 0; r < mResources.size(); ++r)
+		tracks[r].State = CurrentState(mResources[r]);
+
+	for(Pass& pass : mPasses)
+	{
+		pass.Before.clear();
+		pass.After.clear();
+		pass.Discards.clear();
+	}
+
+	mBarrierCount = 0;
+	ArenaVector<Handle> seen(*mArena);
+	for(int s = 0; s < (int)mSchedule.size(); ++s)
+	{
+		Pass& pass = mPasses[mSchedule[s]];
+		int queueStart = pass.Async ? 0 : (int)mAsyncPassCount;
+
+		seen.clear();
+		for(const Access& access : pass.Accesses)
+		{
+			Handle h = access.Resource;
+			if(std::find(seen.begin(), seen.end(), h) != seen.end())
+				continue;
+			seen.push_back(h);
+
+			bool write = false;
+			D3D12_RESOURCE_STATES state = PassState(pass, h, &write);
+
+			const GraphResource& resource = mResources[h];
+			ID3D12Resource* ptr = ResourcePtr(resource);
+			Track& track = tracks[h];
+
+			// A transient's memory may have held another texture until now.
+			bool entering = resource.Transient != UINT_MAX && track.LastPass < 0;
+			assert(!entering || write);
+			if(entering && mTransients[resource.Transient].Aliased)
+				pass.Before.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, ptr));
+
+			if(track.State != state)
+			{
+				// A resource left idle by an earlier pass on the same list, or since the
+				// list began, starts its transition there and ends it here.  Not for
+				// transients entering, whose memory may be in use until now.
+				int previous = track.LastPass;
+				bool sameList = previous < 0 || mPasses[mSchedule[previous]].Async == pass.Async;
+				bool split = !entering && sameList && (previous < 0 ? s > queueStart : s - previous > 1);
+				if(split)
+				{
+					D3D12_RESOURCE_BARRIER begin = CD3DX12_RESOURCE_BARRIER::Transition(ptr, track.State, state,
+						D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+					if(previous < 0)
+						mStartBarriers[pass.Async ? 1 : 0].push_back(begin);
+					else
+						mPasses[mSchedule[previous]].After.push_back(begin);
+					pass.Before.push_back(CD3DX12_RESOURCE_BARRIER::Transition(ptr, track.State, state,
+						D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+				}
+				else
+					pass.Before.push_back(CD3DX12_RESOURCE_BARRIER::Transition(ptr, track.State, state));
+				++mBarrierCount;
+			}
+			else if(state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && track.LastPass >= 0 && (write || track.LastWrite))
+			{
+				pass.Before.push_back(CD3DX12_RESOURCE_BARRIER::UAV(ptr));
+				++mBarrierCount;
+			}
+
+			if(entering && RenderOrDepthTarget(resource.Desc))
+				pass.Discards.push_back(ptr);
+
+			track.State = state;
+			track.LastPass = s;
+			track.LastWrite = write;
+		}
+	}
+
+	// Imported resources end in their final states, from after their last graphics
+	// pass where that is not the last.  Transients keep theirs for the next frame.
+	for(size_t r = 0; r < mResources.size(); ++r)
+	{
+		const GraphResource& resource = mResources[r];
+		const Track& track = tracks[r];
+		if(resource.Imported == nullptr)
+		{
+			if(resource.Transient != UINT_MAX)
+				mTransients[resource.Transient].State = track.State;
+			continue;
+		}
+		if(track.State == resource.FinalState)
+			continue;
+
+		int last = track.LastPass;
+		if(last >= 0 && !mPasses[mSchedule[last]].Async && last + 1 < (int)mSchedule.size())
+		{
+			mPasses[mSchedule[last]].After.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource.Imported,
+				track.State, resource.FinalState, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+				D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+			mEndBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource.Imported,
+				track.State, resource.FinalState, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+				D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+		}
+		else
+			mEndBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource.Imported, track.State, resource.FinalState));
+		++mBarrierCount;
+	}
+}
+
+D3D12_RESOURCE_STATES RenderGraph::PassState(const Pass& pass, Handle resource, bool* write)const
+{
+	// Reads combine; a pass that writes a resource may only read it in the same state.
+	D3D12_RESOURCE_STATES readState = D3D12_RESOURCE_STATE_COMMON;
+	D3D12_RESOURCE_STATES writeState = D3D12_RESOURCE_STATE_COMMON;
+	bool anyWrite = false;
+	for(const Access& access : pass.Accesses)
+	{
+		if(access.Resource != resource)
+			continue;
+
+		if(access.Write)
+		{
+			assert(!anyWrite || writeState == access.State);
+			writeState = access.State;
+			anyWrite = true;
+		}
+		else
+			readState |= access.State;
+	}
+
+	if(write != nullptr)
+		*write = anyWrite;
+	if(anyWrite)
+	{
+		assert(readState == D3D12_RESOURCE_STATE_COMMON || readState == writeState);
+		return writeState;
+	}
+	return readState;
+}
+
+D3D12_RESOURCE_STATES RenderGraph::CurrentState(const GraphResource& resource)const
+{
+	if(resource.Imported == nullptr && resource.Transient != UINT_MAX)
+		return mTransients[resource.Transient].State;
+	return resource.State;
+}
+
+ID3D12Resource* RenderGraph::ResourcePtr(const GraphResource& resource)const
+{
+	if(resource.Imported != nullptr)
+		return resource.Imported;
+	return resource.Transient != UINT_MAX ? mTransients[resource.Transient].Texture.Get() : nullptr;
+}
+
+ID3D12Resource* RenderGraph::Resource(Handle resource)const
+{
+	return ResourcePtr(mResources[resource]);
+}
+
+UINT RenderGraph::TransientGeneration()const
+{
+	return mTransientGeneration;
+}
+
+bool RenderGraph::PassCulled(UINT pass)const
+{
+	return mPasses[pass].Culled;
+}
+
+bool RenderGraph::HasComputeWork()const
+{
+	return mAsyncPassCount > 0;
+}
+
+void RenderGraph::Flush(ID3D12GraphicsCommandList* cmdList, const D3D12_RESOURCE_BARRIER* barriers, UINT count)
+{
+	if(count == 0)
+		return;
+
+	cmdList->ResourceBarrier(count, barriers);
+	++mBarrierCallCount;
+}
+
+void RenderGraph::Execute(ID3D12GraphicsCommandList* graphicsList, ID3D12GraphicsCommandList* computeList,
+	UINT64 frameFence)
+{
+	assert(computeList != nullptr || mAsyncPassCount == 0);
+
+	mLastFrameFence = frameFence;
+	mBarrierCallCount = 0;
+
+	if(mAsyncPassCount > 0)
+		Flush(computeList, mStartBarriers[1].data(), (UINT)mStartBarriers[1].size());
+	Flush(graphicsList, mStartBarriers[0].data(), (UINT)mStartBarriers[0].size());
+
+	for(UINT i : mSchedule)
+	{
+		Pass& pass = mPasses[i];
+		ID3D12GraphicsCommandList* cmdList = pass.Async ? computeList : graphicsList;
+
+		Flush(cmdList, pass.Before.data(), (UINT)pass.Before.size());
+		for(ID3D12Resource* resource : pass.Discards)
+			cmdList->DiscardResource(resource, nullptr);
+
+		pass.Execute(cmdList);
+
+		Flush(cmdList, pass.After.data(), (UINT)pass.After.size());
+	}
+
+	Flush(graphicsList, mEndBarriers.data(), (UINT)mEndBarriers.size());
+}
+
+std::wstring RenderGraph::Summary()const
+{
+	std::wostringstream out;
+	out.setf(std::ios::fixed);
+	out.precision(1);
+	out << (mPasses.size() - mCulledCount) << L"/" << mPasses.size() << L" passes, " <<
+		mBarrierCount << L" barriers in " << mBarrierCallCount << L" calls, " <<
+		ToMB(mHeapBytes) << L"/" << ToMB(mTransientBytes) << L" MB";
+	return out.str();
+}
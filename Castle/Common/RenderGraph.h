@@ -0,0 +1,203 @@
+//***************************************************************************************
+// RenderGraph.h
+//
+// Records a frame's GPU passes from what each declares it reads and writes, instead
+// of hand-written barriers.  A graph is rebuilt every frame: import the resources
+// the app owns, create the transient textures that only live within the frame, add
+// passes with their accesses, then Compile and Execute.
+//
+// Compile culls passes whose output nothing reads, schedules every state transition
+// (batched into one ResourceBarrier call per pass, and split across the passes in
+// between where a resource sits unused), and places the transient textures in
+// heaps, aliasing those whose lifetimes do not overlap.  The placed textures are
+// kept while the frames that follow declare the same transients, so most frames
+// create nothing.
+//
+// Compute passes whose inputs no graphics pass of the graph touches, and whose
+// transitions the compute queue can make, run on the async compute list; the caller
+// submits it ahead of the graphics list and has the graphics queue wait for it.  The
+// rest run on the graphics list in order.
+//
+// The passes' lists and Compile's scratch live in the frame's arena, given to Reset,
+// so building a graph the same shape as the last frame's allocates nothing.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "FrameArena.h"
+#include <functional>
+
+enum class RenderGraphQueue
+{
+	Graphics,
+	Compute
+};
+
+class RenderGraph
+{
+public:
+	typedef UINT Handle;
+	static const Handle InvalidHandle = UINT_MAX;
+
+	RenderGraph(ID3D12Device* device);
+	RenderGraph(const RenderGraph& rhs) = delete;
+	RenderGraph& operator=(const RenderGraph& rhs) = delete;
+	~RenderGraph();
+
+	// Starts a new frame's graph.  completedFence is the last fence value the GPU has
+	// passed, for releasing transient memory retired by earlier frames.  The graph
+	// allocates from arena until the next Reset, so arena must not be reset before then.
+	void Reset(UINT64 completedFence, FrameArena& arena);
+
+	// A resource the app owns, in state when Execute starts.  Execute leaves it in
+	// finalState.  name must outlive the graph (a string literal).
+	Handle Import(const char* name, ID3D12Resource* resource,
+		D3D12_RESOURCE_STATES state, D3D12_RESOURCE_STATES finalState);
+
+	// A texture that lives from its first pass to its last.  The first pass must
+	// overwrite all of it: its contents are undefined, and may be another texture's.
+	Handle CreateTexture(const char* name, const D3D12_RESOURCE_DESC& desc);
+
+	// execute records the pass; the graph has made the barriers its accesses need.
+	UINT AddPass(const char* name, RenderGraphQueue queue,
+		std::function<void(ID3D12GraphicsCommandList*)> execute);
+	void Read(UINT pass, Handle resource, D3D12_RESOURCE_STATES state);
+	void Write(UINT pass, Handle resource, D3D12_RESOURCE_STATES state);
+
+	// Keeps a pass that writes nothing the graph reads, such as one that resolves
+	// queries.  Passes writing imported resources are always kept.
+	void SetSideEffects(UINT pass);
+
+	// asyncCompute lets compute passes move to the compute list.
+	void Compile(bool asyncCompute);
+
+	// After Compile.  A transient texture's resource stays the same until
+	// TransientGeneration changes, so views of it need only be rebuilt then.
+	ID3D12Resource* Resource(Handle resource)const;
+	UINT TransientGeneration()const;
+
+	bool PassCulled(UINT pass)const;
+	bool HasComputeWork()const;
+
+	// Records the compiled passes.  computeList may be null if HasComputeWork is false.
+	// frameFence is the value the frame will signal, which retires replaced transients.
+	void Execute(ID3D12GraphicsCommandList* graphicsList, ID3D12GraphicsCommandList* computeList,
+		UINT64 frameFence);
+
+	// Passes kept and culled, barriers in how many calls and transient memory with
+	// and without aliasing, of the last Execute; for the window caption.
+	std::wstring Summary()const;
+
+private:
+	// One heap for render and depth targets and one for other textures, as resource
+	// heap tier 1 requires.
+	static const UINT HeapCount = 2;
+
+	struct Access
+	{
+		Handle Resource = InvalidHandle;
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+		bool Write = false;
+	};
+
+	struct Pass
+	{
+		explicit Pass(FrameArena& arena)
+			: Accesses(arena), Before(arena), After(arena), Discards(arena)
+		{
+		}
+
+		const char* Name = nullptr;
+		RenderGraphQueue Queue = RenderGraphQueue::Graphics;
+		std::function<void(ID3D12GraphicsCommandList*)> Execute;
+		ArenaVector<Access> Accesses;
+		bool SideEffects = false;
+
+		bool Culled = false;
+		bool Async = false;
+
+		// Made before and after the pass, each in one call.
+		ArenaVector<D3D12_RESOURCE_BARRIER> Before;
+		ArenaVector<D3D12_RESOURCE_BARRIER> After;
+		// Render and depth targets entering their memory, discarded after Before.
+		ArenaVector<ID3D12Resource*> Discards;
+	};
+
+	struct GraphResource
+	{
+		const char* Name = nullptr;
+		ID3D12Resource* Imported = nullptr;
+		D3D12_RESOURCE_STATES FinalState = D3D12_RESOURCE_STATE_COMMON;
+
+		// Transients only: the texture it is given, and its passes in the schedule.
+		D3D12_RESOURCE_DESC Desc = {};
+		UINT Transient = UINT_MAX;
+		UINT FirstUse = UINT_MAX;
+		UINT LastUse = 0;
+
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+	};
+
+	// A placed texture.  Kept across frames, with the state the last frame left it in.
+	struct TransientTexture
+	{
+		D3D12_RESOURCE_DESC Desc = {};
+		UINT Heap = 0;
+		UINT64 Offset = 0;
+		UINT64 Size = 0;
+		bool Aliased = false;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Texture;
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+	};
+
+	struct Retired
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> Heaps[HeapCount];
+		std::vector<TransientTexture> Textures;
+		UINT64 Fence = 0;
+	};
+
+	void CullPasses();
+	void AssignQueues(bool asyncCompute);
+	void PlaceTransients();
+	void ScheduleBarriers();
+
+	// The state a pass needs resource in, from all its accesses.
+	D3D12_RESOURCE_STATES PassState(const Pass& pass, Handle resource, bool* write)const;
+	D3D12_RESOURCE_STATES CurrentState(const GraphResource& resource)const;
+	ID3D12Resource* ResourcePtr(const GraphResource& resource)const;
+
+	void Flush(ID3D12GraphicsCommandList* cmdList, const D3D12_RESOURCE_BARRIER* barriers, UINT count);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	// The frame's arena, from Reset.
+	FrameArena* mArena = nullptr;
+
+	std::vector<Pass> mPasses;
+	std::vector<GraphResource> mResources;
+
+	// Pass indices in the order they are recorded: the async passes, then the rest.
+	std::vector<UINT> mSchedule;
+	UINT mAsyncPassCount = 0;
+
+	// Split barriers begun before the first pass of each queue.
+	std::vector<D3D12_RESOURCE_BARRIER> mStartBarriers[2];
+	// Imported resources to their final states, after the last graphics pass.
+	std::vector<D3D12_RESOURCE_BARRIER> mEndBarriers;
+
+	Microsoft::WRL::ComPtr<ID3D12Heap> mHeaps[HeapCount];
+	UINT64 mHeapSizes[HeapCount] = {};
+	std::vector<TransientTexture> mTransients;
+	UINT mTransientGeneration = 0;
+	std::vector<Retired> mRetired;
+	UINT64 mLastFrameFence = 0;
+
+	UINT mCulledCount = 0;
+	UINT mBarrierCount = 0;
+	UINT mBarrierCallCount = 0;
+	UINT64 mTransientBytes = 0;
+	UINT64 mHeapBytes = 0;
+};
@@ -0,0 +1,105 @@
+//***************************************************************************************
+// RenderQueue.cpp
+//***************************************************************************************
+
+#include "RenderQueue.h"
+
+namespace
+{
+	UINT64 Field(UINT value, UINT bits, UINT shift)
+	{
+		// Values that do not fit wrap rather than spilling into the next field.
+		return ((UINT64)value & ((1ull << bits) - 1)) << shift;
+	}
+}
+
+UINT64 RenderQueue::MakeOpaqueKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth)
+{
+	return Field(layer, LayerBits, 60) |
+		Field(pso, PsoBits, 56) |
+		Field(geometry, GeometryBits, 48) |
+		Field(material, MaterialBits, 36) |
+		(QuantizeDepth(depth) << 12);
+}
+
+UINT64 RenderQueue::MakeBlendedKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth)
+{
+	const UINT64 maxDepth = (1ull << DepthBits) - 1;
+
+	return Field(layer, LayerBits, 60) |
+		Field(pso, PsoBits, 56) |
+		((maxDepth - QuantizeDepth(depth)) << 32) |
+		Field(geometry, GeometryBits, 24) |
+		Field(material, MaterialBits, 12);
+}
+
+UINT RenderQueue::KeyLayer(UINT64 key)
+{
+	return (UINT)(key >> 60);
+}
+
+void RenderQueue::Clear()
+{
+	mEntries.clear();
+}
+
+void RenderQueue::Push(UINT64 key, UINT item)
+{
+	Entry entry;
+	entry.Key = key;
+	entry.Item = item;
+	mEntries.push_back(entry);
+}
+
+void RenderQueue::Sort()
+{
+	const size_t n = mEntries.size();
+	if(n < 2)
+		return;
+
+	mScratch.resize(n);
+
+	// Least significant digit first, eight bits at a time.  Each pass is stable,
+	// so the result is ordered by the whole key and ties keep push order.
+	for(UINT shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = {};
+		for(const auto& e : mEntries)
+			++counts[(e.Key >> shift) & 0xff];
+
+		// Every key has the same digit here, so the pass would not move anything.
+		// Unused key bits and small ids make this the common case.
+		if(counts[(mEntries[0].Key >> shift) & 0xff] == n)
+			continue;
+
+		size_t offset = 0;
+		for(size_t& c : counts)
+		{
+			size_t count = c;
+			c = offset;
+			offset += count;
+		}
+
+		for(const auto& e : mEntries)
+			mScratch[counts[(e.Key >> shift) & 0xff]++] = e;
+
+		mEntries.swap(mScratch);
+	}
+}
+
+const std::vector<RenderQueue::Entry>& RenderQueue::Entries()const
+{
+	return mEntries;
+}
+
+UINT64 RenderQueue::QuantizeDepth(float depth)
+{
+	const UINT64 maxDepth = (1ull << DepthBits) - 1;
+
+	if(!(depth > 0.0f))
+		return 0;
+	if(depth >= 1.0f)
+		return maxDepth;
+
+	return (UINT64)(depth * (float)maxDepth);
+}
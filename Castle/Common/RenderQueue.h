@@ -0,0 +1,57 @@
+//***************************************************************************************
+// RenderQueue.h
+//
+// Orders a frame's draws by 64-bit sort keys.  Each visible item is pushed with a key
+// packed by one of the Make*Key functions and an index that identifies the item to
+// the caller; Sort radix-sorts the entries by key, so draws emitted in that order
+// change state only where a key field changes.
+//
+// Opaque key, most significant first:
+//   layer:4 | pso:4 | geometry:8 | material:12 | depth:24 | unused:12
+// Blended key, depth first so items draw back to front:
+//   layer:4 | pso:4 | inverted depth:24 | geometry:8 | material:12 | unused:12
+//
+// Depth is normalized to [0,1] over the camera's depth range; opaque items sort
+// front to back within a state group, for early-Z rejection.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class RenderQueue
+{
+public:
+	struct Entry
+	{
+		UINT64 Key = 0;
+		UINT Item = 0;
+	};
+
+	static const UINT LayerBits = 4;
+	static const UINT PsoBits = 4;
+	static const UINT GeometryBits = 8;
+	static const UINT MaterialBits = 12;
+	static const UINT DepthBits = 24;
+
+	static UINT64 MakeOpaqueKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth);
+	static UINT64 MakeBlendedKey(UINT layer, UINT pso, UINT geometry, UINT material, float depth);
+
+	// The layer a key was built with.
+	static UINT KeyLayer(UINT64 key);
+
+	void Clear();
+	void Push(UINT64 key, UINT item);
+
+	// Ascending by key.  Entries with equal keys keep their push order.
+	void Sort();
+
+	const std::vector<Entry>& Entries()const;
+
+private:
+	static UINT64 QuantizeDepth(float depth);
+
+private:
+	std::vector<Entry> mEntries;
+	std::vector<Entry> mScratch;
+};
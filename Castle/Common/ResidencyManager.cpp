@@ -0,0 +1,230 @@
+//***************************************************************************************
+// ResidencyManager.cpp
+//***************************************************************************************
+
+#include "ResidencyManager.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const wchar_t* CategoryName(ResidencyCategory category)
+	{
+		static const wchar_t* names[] = { L"texture", L"geometry", L"compute" };
+		return names[(int)category];
+	}
+
+	double ToMB(UINT64 bytes)
+	{
+		return (double)bytes / (1024.0 * 1024.0);
+	}
+}
+
+ResidencyManager::ResidencyManager(ID3D12Device* device, IDXGIFactory1* factory)
+	: md3dDevice(device)
+{
+	// The budget is per adapter; find the one the device was created on.
+	ComPtr<IDXGIFactory4> factory4;
+	ThrowIfFailed(factory->QueryInterface(IID_PPV_ARGS(&factory4)));
+	ThrowIfFailed(factory4->EnumAdapterByLuid(device->GetAdapterLuid(), IID_PPV_ARGS(&mAdapter)));
+
+	mBudgetEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mBudgetEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	ThrowIfFailed(mAdapter->RegisterVideoMemoryBudgetChangeNotificationEvent(mBudgetEvent, &mBudgetCookie));
+
+	QueryBudget();
+}
+
+ResidencyManager::~ResidencyManager()
+{
+	mAdapter->UnregisterVideoMemoryBudgetChangeNotification(mBudgetCookie);
+	CloseHandle(mBudgetEvent);
+}
+
+void ResidencyManager::Track(ID3D12Resource* resource, ResidencyCategory category, bool evictable)
+{
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	UINT64 size = md3dDevice->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+
+	TrackObject(resource, size, category, evictable);
+}
+
+void ResidencyManager::Track(ID3D12Heap* heap, ResidencyCategory category)
+{
+	// Placed resources in the heap should not be tracked on their own.
+	TrackObject(heap, heap->GetDesc().SizeInBytes, category, false);
+}
+
+void ResidencyManager::Untrack(ID3D12Pageable* object)
+{
+	mEntries.erase(object);
+	mBudgetDirty = true;
+}
+
+void ResidencyManager::MarkUsed(ID3D12Pageable* object, UINT64 fenceValue)
+{
+	auto it = mEntries.find(object);
+	if(it == mEntries.end())
+		return;
+
+	Entry& entry = it->second;
+	entry.LastUsedFence = fenceValue;
+
+	// Only objects that went unused for a while are evicted, so this is rare and
+	// blocking here is simpler than batching.
+	if(!entry.Resident)
+	{
+		ID3D12Pageable* objects[] = { object };
+		ThrowIfFailed(md3dDevice->MakeResident(_countof(objects), objects));
+		entry.Resident = true;
+		mBudgetDirty = true;
+	}
+}
+
+void ResidencyManager::Update(UINT64 completedFence)
+{
+	if(WaitForSingleObject(mBudgetEvent, 0) == WAIT_OBJECT_0)
+		mBudgetDirty = true;
+
+	if(mBudgetDirty)
+	{
+		QueryBudget();
+		mBudgetDirty = false;
+	}
+
+	if(mLocalInfo.CurrentUsage > mLocalInfo.Budget)
+		EvictOverBudget(completedFence);
+}
+
+UINT64 ResidencyManager::LocalBudget()const
+{
+	return mLocalInfo.Budget;
+}
+
+UINT64 ResidencyManager::LocalUsage()const
+{
+	return mLocalInfo.CurrentUsage;
+}
+
+std::wstring ResidencyManager::Summary()const
+{
+	std::wostringstream out;
+	out.setf(std::ios::fixed);
+	out.precision(0);
+
+	out << ToMB(mLocalInfo.CurrentUsage) << L"/" << ToMB(mLocalInfo.Budget) << L" MB";
+
+	UINT evicted = 0;
+	for(const auto& e : mEntries)
+	{
+		if(!e.second.Resident)
+			++evicted;
+	}
+	if(evicted > 0)
+		out << L" (" << evicted << L" evicted)";
+
+	return out.str();
+}
+
+void ResidencyManager::WriteReport(const std::wstring& filename)const
+{
+	std::wofstream fout(filename);
+	if(!fout)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
+
+	fout.setf(std::ios::fixed);
+	fout.precision(1);
+
+	fout << L"segment,usage_mb,budget_mb,reserved_mb\n";
+	fout << L"local," << ToMB(mLocalInfo.CurrentUsage) << L"," << ToMB(mLocalInfo.Budget) << L"," << ToMB(mLocalInfo.CurrentReservation) << L"\n";
+	fout << L"nonlocal," << ToMB(mNonLocalInfo.CurrentUsage) << L"," << ToMB(mNonLocalInfo.Budget) << L"," << ToMB(mNonLocalInfo.CurrentReservation) << L"\n";
+	fout << L"\n";
+
+	UINT64 resident[(int)ResidencyCategory::Count] = {};
+	UINT64 evicted[(int)ResidencyCategory::Count] = {};
+	UINT count[(int)ResidencyCategory::Count] = {};
+	UINT64 trackedResident = 0;
+	for(const auto& e : mEntries)
+	{
+		int c = (int)e.second.Category;
+		++count[c];
+		if(e.second.Resident)
+		{
+			resident[c] += e.second.Size;
+			trackedResident += e.second.Size;
+		}
+		else
+			evicted[c] += e.second.Size;
+	}
+
+	fout << L"category,objects,resident_mb,evicted_mb\n";
+	for(int c = 0; c < (int)ResidencyCategory::Count; ++c)
+	{
+		fout << CategoryName((ResidencyCategory)c) << L"," << count[c] << L"," <<
+			ToMB(resident[c]) << L"," << ToMB(evicted[c]) << L"\n";
+	}
+
+	// Swap chain buffers, descriptor heaps, pipeline state and so on.
+	UINT64 untracked = mLocalInfo.CurrentUsage > trackedResident ? mLocalInfo.CurrentUsage - trackedResident : 0;
+	fout << L"untracked,," << ToMB(untracked) << L",\n";
+	fout << L"\nevictions," << mEvictionCount << L"\n";
+}
+
+void ResidencyManager::TrackObject(ID3D12Pageable* object, UINT64 size, ResidencyCategory category, bool evictable)
+{
+	Entry entry;
+	entry.Category = category;
+	entry.Size = size;
+	entry.Evictable = evictable;
+	mEntries[object] = entry;
+
+	mBudgetDirty = true;
+}
+
+void ResidencyManager::QueryBudget()
+{
+	ThrowIfFailed(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &mLocalInfo));
+	ThrowIfFailed(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, &mNonLocalInfo));
+}
+
+void ResidencyManager::EvictOverBudget(UINT64 completedFence)
+{
+	// Least recently used first, among the objects the GPU is done with.
+	std::vector<std::pair<UINT64, ID3D12Pageable*>> candidates;
+	for(const auto& e : mEntries)
+	{
+		const Entry& entry = e.second;
+		if(entry.Evictable && entry.Resident &&
+			entry.LastUsedFence + MinIdleFences <= completedFence)
+		{
+			candidates.push_back(std::make_pair(entry.LastUsedFence, e.first));
+		}
+	}
+
+	if(candidates.empty())
+		return;
+
+	std::sort(candidates.begin(), candidates.end());
+
+	const UINT64 target = mLocalInfo.Budget / 100 * TargetPercent;
+	UINT64 usage = mLocalInfo.CurrentUsage;
+
+	std::vector<ID3D12Pageable*> evict;
+	for(const auto& c : candidates)
+	{
+		if(usage <= target)
+			break;
+
+		Entry& entry = mEntries[c.second];
+		evict.push_back(c.second);
+		entry.Resident = false;
+		usage = usage > entry.Size ? usage - entry.Size : 0;
+	}
+
+	ThrowIfFailed(md3dDevice->Evict((UINT)evict.size(), evict.data()));
+	mEvictionCount += evict.size();
+
+	QueryBudget();
+}
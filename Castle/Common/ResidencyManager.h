@@ -0,0 +1,90 @@
+//***************************************************************************************
+// ResidencyManager.h
+//
+// Keeps the app's video memory within the budget DXGI gives the process.  Resources and
+// heaps are tracked by category for the memory report.  Evictable ones also carry the
+// fence value of the last frame that used them; while the process is over budget the
+// least recently used of those the GPU is done with are evicted, and MarkUsed makes
+// them resident again before a frame references them.
+//
+// Fence values are expected to advance once per frame, as they do in D3DApp.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+enum class ResidencyCategory : int
+{
+	Texture = 0,
+	Geometry,
+	Compute,
+	Count
+};
+
+class ResidencyManager
+{
+public:
+	ResidencyManager(ID3D12Device* device, IDXGIFactory1* factory);
+	ResidencyManager(const ResidencyManager& rhs) = delete;
+	ResidencyManager& operator=(const ResidencyManager& rhs) = delete;
+	~ResidencyManager();
+
+	void Track(ID3D12Resource* resource, ResidencyCategory category, bool evictable = false);
+	void Track(ID3D12Heap* heap, ResidencyCategory category);
+	void Untrack(ID3D12Pageable* object);
+
+	// Work up to fenceValue references object.  Makes it resident again first if it
+	// was evicted, so call it before submitting that work.
+	void MarkUsed(ID3D12Pageable* object, UINT64 fenceValue);
+
+	// Call once per frame.  Refreshes the budget when DXGI reports a change or the
+	// tracked set has changed, then evicts while over budget.
+	void Update(UINT64 completedFence);
+
+	UINT64 LocalBudget()const;
+	UINT64 LocalUsage()const;
+
+	// One line for the window caption.
+	std::wstring Summary()const;
+
+	// Budget, usage and the per-category breakdown.
+	void WriteReport(const std::wstring& filename)const;
+
+private:
+	struct Entry
+	{
+		ResidencyCategory Category = ResidencyCategory::Texture;
+		UINT64 Size = 0;
+		bool Evictable = false;
+		bool Resident = true;
+		UINT64 LastUsedFence = 0;
+	};
+
+	void TrackObject(ID3D12Pageable* object, UINT64 size, ResidencyCategory category, bool evictable);
+	void QueryBudget();
+	void EvictOverBudget(UINT64 completedFence);
+
+private:
+	// Frames an object must go unused before it is a candidate for eviction, so
+	// objects drawn every frame or two are not bounced in and out.
+	static const UINT64 MinIdleFences = 120;
+
+	// Evict down to this fraction of the budget, for some headroom before the next
+	// allocation pushes usage over again.
+	static const UINT64 TargetPercent = 95;
+
+	ID3D12Device* md3dDevice = nullptr;
+	Microsoft::WRL::ComPtr<IDXGIAdapter3> mAdapter;
+
+	HANDLE mBudgetEvent = nullptr;
+	DWORD mBudgetCookie = 0;
+	bool mBudgetDirty = true;
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO mLocalInfo = {};
+	DXGI_QUERY_VIDEO_MEMORY_INFO mNonLocalInfo = {};
+
+	std::unordered_map<ID3D12Pageable*, Entry> mEntries;
+
+	UINT64 mEvictionCount = 0;
+};
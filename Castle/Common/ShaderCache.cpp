@@ -0,0 +1,280 @@
+//***************************************************************************************
+// ShaderCache.cpp
+//***************************************************************************************
+
+#include "ShaderCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	bool ReadTextFile(const std::wstring& filename, std::string& contents)
+	{
+		std::ifstream fin(filename, std::ios::binary);
+		if(!fin)
+			return false;
+
+		std::ostringstream ss;
+		ss << fin.rdbuf();
+		contents = ss.str();
+		return true;
+	}
+
+	std::wstring DirectoryOf(const std::wstring& filename)
+	{
+		size_t slash = filename.find_last_of(L"\\/");
+		return slash == std::wstring::npos ? std::wstring() : filename.substr(0, slash + 1);
+	}
+
+	std::wstring StemOf(const std::wstring& filename)
+	{
+		size_t slash = filename.find_last_of(L"\\/");
+		std::wstring name = slash == std::wstring::npos ? filename : filename.substr(slash + 1);
+		return name.substr(0, name.find_last_of(L'.'));
+	}
+
+	// The file names of the #include "..." lines in source.
+	std::vector<std::string> FindIncludes(const std::string& source)
+	{
+		std::vector<std::string> includes;
+
+		std::istringstream lines(source);
+		std::string line;
+		while(std::getline(lines, line))
+		{
+			size_t pos = line.find_first_not_of(" \t");
+			if(pos == std::string::npos || line.compare(pos, 8, "#include") != 0)
+				continue;
+
+			size_t open = line.find('"', pos + 8);
+			size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			if(close != std::string::npos)
+				includes.push_back(line.substr(open + 1, close - open - 1));
+		}
+
+		return includes;
+	}
+
+	UINT CompileFlags()
+	{
+		UINT compileFlags = 0;
+#if defined(DEBUG) || defined(_DEBUG)  
+		compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+		return compileFlags;
+	}
+}
+
+ShaderCache::ShaderCache(const std::wstring& directory, ShaderCompiler compiler)
+	: mDirectory(directory), mCompiler(compiler)
+{
+	if(!mDirectory.empty() && mDirectory.back() != L'\\' && mDirectory.back() != L'/')
+		mDirectory += L'\\';
+
+	// Fails harmlessly if the directory exists; a directory that cannot be created
+	// shows up as every store failing.
+	CreateDirectoryW(mDirectory.c_str(), nullptr);
+
+	if(mCompiler == ShaderCompiler::Dxc)
+	{
+		mDxcModule = LoadLibraryW(L"dxcompiler.dll");
+		auto createInstance = mDxcModule != nullptr ?
+			(DxcCreateInstanceProc)GetProcAddress(mDxcModule, "DxcCreateInstance") : nullptr;
+
+		if(createInstance == nullptr ||
+			FAILED(createInstance(CLSID_DxcUtils, IID_PPV_ARGS(&mDxcUtils))) ||
+			FAILED(createInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&mDxcCompiler))))
+		{
+			OutputDebugStringA("ShaderCache: dxcompiler.dll unavailable, using FXC\n");
+			mDxcUtils = nullptr;
+			mDxcCompiler = nullptr;
+			mCompiler = ShaderCompiler::Fxc;
+		}
+	}
+}
+
+ShaderCache::~ShaderCache()
+{
+	// The compiler objects live in the DLL, so release them before unloading it.
+	mDxcCompiler = nullptr;
+	mDxcUtils = nullptr;
+	if(mDxcModule != nullptr)
+		FreeLibrary(mDxcModule);
+}
+
+ComPtr<ID3DBlob> ShaderCache::Compile(
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint,
+	const std::string& target)
+{
+	UINT64 hash = 0;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		hash = HashSource(filename, d3dUtil::HashBytes(nullptr, 0));
+	}
+	for(const D3D_SHADER_MACRO* d = defines; d != nullptr && d->Name != nullptr; ++d)
+	{
+		hash = d3dUtil::HashBytes(d->Name, strlen(d->Name) + 1, hash);
+		if(d->Definition != nullptr)
+			hash = d3dUtil::HashBytes(d->Definition, strlen(d->Definition) + 1, hash);
+	}
+	hash = d3dUtil::HashBytes(entrypoint.c_str(), entrypoint.size() + 1, hash);
+	hash = d3dUtil::HashBytes(target.c_str(), target.size() + 1, hash);
+
+	UINT compileFlags = CompileFlags();
+	hash = d3dUtil::HashBytes(&compileFlags, sizeof(compileFlags), hash);
+	hash = d3dUtil::HashBytes(&mCompiler, sizeof(mCompiler), hash);
+
+	wchar_t hashText[17];
+	swprintf_s(hashText, L"%016llx", hash);
+	std::wstring cacheFile = mDirectory + StemOf(filename) + L"_" +
+		AnsiToWString(entrypoint) + L"_" + hashText + L".cso";
+
+	bool hit = GetFileAttributesW(cacheFile.c_str()) != INVALID_FILE_ATTRIBUTES;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if(hit)
+			++mHitCount;
+		else
+			++mMissCount;
+	}
+
+	if(hit)
+		return d3dUtil::LoadBinary(cacheFile);
+
+	ComPtr<ID3DBlob> byteCode = mCompiler == ShaderCompiler::Dxc ?
+		CompileDxc(filename, defines, entrypoint, target) :
+		d3dUtil::CompileShader(filename, defines, entrypoint, target);
+
+	// Write under a temporary name and rename, so a partly written file is never
+	// taken for a hit.
+	std::wstring tempFile = cacheFile + L".tmp";
+	{
+		std::ofstream fout(tempFile, std::ios::binary | std::ios::trunc);
+		fout.write((const char*)byteCode->GetBufferPointer(), byteCode->GetBufferSize());
+	}
+	if(!MoveFileExW(tempFile.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFile.c_str());
+		OutputDebugStringW((L"ShaderCache: could not store " + cacheFile + L"\n").c_str());
+	}
+
+	return byteCode;
+}
+
+ShaderCompiler ShaderCache::Compiler()const
+{
+	return mCompiler;
+}
+
+UINT ShaderCache::HitCount()const
+{
+	return mHitCount;
+}
+
+UINT ShaderCache::MissCount()const
+{
+	return mMissCount;
+}
+
+UINT64 ShaderCache::HashSource(const std::wstring& filename, UINT64 seed)
+{
+	auto it = mSourceHashes.find(filename);
+	if(it == mSourceHashes.end())
+	{
+		std::string source;
+		if(!ReadTextFile(filename, source))
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+		// Placeholder so an include cycle terminates.
+		mSourceHashes[filename] = 0;
+
+		UINT64 hash = d3dUtil::HashBytes(source.data(), source.size());
+		for(const auto& include : FindIncludes(source))
+		{
+			std::wstring includeFile = DirectoryOf(filename) + AnsiToWString(include);
+
+			// Includes resolved elsewhere by the compiler are not tracked.
+			if(GetFileAttributesW(includeFile.c_str()) != INVALID_FILE_ATTRIBUTES)
+				hash = HashSource(includeFile, hash);
+		}
+
+		mSourceHashes[filename] = hash;
+		it = mSourceHashes.find(filename);
+	}
+
+	return d3dUtil::HashBytes(&it->second, sizeof(it->second), seed);
+}
+
+ComPtr<ID3DBlob> ShaderCache::CompileDxc(
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint,
+	const std::string& target)
+{
+	std::lock_guard<std::mutex> lock(mDxcMutex);
+
+	ComPtr<IDxcBlobEncoding> source;
+	ThrowIfFailed(mDxcUtils->LoadFile(filename.c_str(), nullptr, &source));
+
+	DxcBuffer sourceBuffer;
+	sourceBuffer.Ptr = source->GetBufferPointer();
+	sourceBuffer.Size = source->GetBufferSize();
+	sourceBuffer.Encoding = DXC_CP_ACP;
+
+	// "vs_5_1" becomes "vs_6_0"; shader model 6 targets, such as the mesh shader
+	// stages, are kept.
+	std::string target6 = target;
+	if(target.compare(target.find('_'), 3, "_5_") == 0)
+		target6 = target.substr(0, target.find('_')) + "_6_0";
+
+	// Language version 2018 keeps the FXC-era rules the shaders are written to.
+	std::vector<std::wstring> args =
+	{
+		filename,
+		L"-E", AnsiToWString(entrypoint),
+		L"-T", AnsiToWString(target6),
+		L"-HV", L"2018",
+	};
+	for(const D3D_SHADER_MACRO* d = defines; d != nullptr && d->Name != nullptr; ++d)
+	{
+		args.push_back(L"-D");
+		args.push_back(AnsiToWString(d->Name) + L"=" +
+			(d->Definition != nullptr ? AnsiToWString(d->Definition) : L"1"));
+	}
+#if defined(DEBUG) || defined(_DEBUG)  
+	args.push_back(L"-Zi");
+	args.push_back(L"-Qembed_debug");
+	args.push_back(L"-Od");
+#endif
+
+	std::vector<LPCWSTR> argPtrs;
+	for(const auto& a : args)
+		argPtrs.push_back(a.c_str());
+
+	ComPtr<IDxcIncludeHandler> includeHandler;
+	ThrowIfFailed(mDxcUtils->CreateDefaultIncludeHandler(&includeHandler));
+
+	ComPtr<IDxcResult> result;
+	ThrowIfFailed(mDxcCompiler->Compile(&sourceBuffer, argPtrs.data(), (UINT32)argPtrs.size(),
+		includeHandler.Get(), IID_PPV_ARGS(&result)));
+
+	ComPtr<IDxcBlobUtf8> errors;
+	if(SUCCEEDED(result->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&errors), nullptr)) &&
+		errors != nullptr && errors->GetStringLength() > 0)
+		OutputDebugStringA(errors->GetStringPointer());
+
+	HRESULT hr = S_OK;
+	ThrowIfFailed(result->GetStatus(&hr));
+	ThrowIfFailed(hr);
+
+	ComPtr<IDxcBlob> object;
+	ThrowIfFailed(result->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&object), nullptr));
+
+	ComPtr<ID3DBlob> byteCode;
+	ThrowIfFailed(D3DCreateBlob(object->GetBufferSize(), &byteCode));
+	memcpy(byteCode->GetBufferPointer(), object->GetBufferPointer(), object->GetBufferSize());
+
+	return byteCode;
+}
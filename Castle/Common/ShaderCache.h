@@ -0,0 +1,81 @@
+//***************************************************************************************
+// ShaderCache.h
+//
+// Compiles shaders through a directory of .cso files.  Each request is keyed by a hash
+// of the source file and everything it #includes, the defines, entry point, target,
+// compiler and compile flags; a hit loads the bytecode with d3dUtil::LoadBinary and a
+// miss compiles the source and stores the result for the next run.  Editing a shader
+// or one of its includes therefore only recompiles the permutations built from it.
+//
+// Includes are found by scanning for #include "file" lines relative to the including
+// file, whether or not the preprocessor would take them, so the key may change more
+// often than strictly needed but never less.
+//
+// With ShaderCompiler::Dxc, shader model 5 targets are compiled as 6.0 by
+// dxcompiler.dll, and shader model 6 targets as they are.  If the DLL cannot be
+// loaded the cache falls back to FXC, which cannot compile the latter.
+//
+// Compile may be called from several threads at once; DXC compiles are serialized.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <dxcapi.h>
+#include <mutex>
+
+enum class ShaderCompiler
+{
+	Fxc,
+	Dxc
+};
+
+class ShaderCache
+{
+public:
+	ShaderCache(const std::wstring& directory, ShaderCompiler compiler = ShaderCompiler::Fxc);
+	ShaderCache(const ShaderCache& rhs) = delete;
+	ShaderCache& operator=(const ShaderCache& rhs) = delete;
+	~ShaderCache();
+
+	// Same arguments as d3dUtil::CompileShader.  Throws if the shader fails to compile.
+	Microsoft::WRL::ComPtr<ID3DBlob> Compile(
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint,
+		const std::string& target);
+
+	ShaderCompiler Compiler()const;
+
+	UINT HitCount()const;
+	UINT MissCount()const;
+
+private:
+	// Call with mMutex held.
+	UINT64 HashSource(const std::wstring& filename, UINT64 seed);
+	Microsoft::WRL::ComPtr<ID3DBlob> CompileDxc(
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint,
+		const std::string& target);
+
+private:
+	std::wstring mDirectory;
+	ShaderCompiler mCompiler = ShaderCompiler::Fxc;
+
+	// Guards the source hashes and counters.
+	std::mutex mMutex;
+
+	// Source hashes by file, so an include shared by many permutations is read once.
+	std::unordered_map<std::wstring, UINT64> mSourceHashes;
+
+	// A DXC compiler instance is not free-threaded.
+	std::mutex mDxcMutex;
+
+	HMODULE mDxcModule = nullptr;
+	Microsoft::WRL::ComPtr<IDxcUtils> mDxcUtils;
+	Microsoft::WRL::ComPtr<IDxcCompiler3> mDxcCompiler;
+
+	UINT mHitCount = 0;
+	UINT mMissCount = 0;
+};
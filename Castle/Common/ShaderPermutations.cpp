@@ -0,0 +1,115 @@
+//***************************************************************************************
+// ShaderPermutations.cpp
+//***************************************************************************************
+
+#include "ShaderPermutations.h"
+
+using Microsoft::WRL::ComPtr;
+
+bool ShaderPermutations::Key::operator==(const Key& rhs)const
+{
+	return Features == rhs.Features && Filename == rhs.Filename &&
+		Entrypoint == rhs.Entrypoint && Target == rhs.Target;
+}
+
+size_t ShaderPermutations::KeyHash::operator()(const Key& key)const
+{
+	size_t h = std::hash<std::wstring>()(key.Filename);
+	h = h*31 + std::hash<std::string>()(key.Entrypoint);
+	h = h*31 + std::hash<std::string>()(key.Target);
+	return h*31 + key.Features;
+}
+
+ShaderPermutations::ShaderPermutations(ShaderCache* cache, const std::vector<ShaderFeatureField>& fields,
+	const std::vector<D3D_SHADER_MACRO>& defines)
+	: mCache(cache), mFields(fields)
+{
+	for(const auto& define : defines)
+	{
+		if(define.Name != nullptr)
+			mDefines.push_back(define);
+	}
+}
+
+ID3DBlob* ShaderPermutations::Get(const std::wstring& filename, const std::string& entrypoint,
+	const std::string& target, UINT features)
+{
+	Key key = { filename, entrypoint, target, features };
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mShaders.find(key);
+		if(it != mShaders.end())
+			return it->second.Get();
+	}
+
+	// Two threads asking for the same new permutation both compile it; the cache
+	// makes the second compile a load, and the first result is kept.
+	std::vector<std::string> values;
+	std::vector<D3D_SHADER_MACRO> macros;
+	BuildDefines(features, values, macros);
+	ComPtr<ID3DBlob> byteCode = mCache->Compile(filename, macros.data(), entrypoint, target);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mShaders.emplace(key, byteCode).first->second.Get();
+}
+
+UINT ShaderPermutations::PermutationCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (UINT)mShaders.size();
+}
+
+void ShaderPermutations::WriteManifest(const std::wstring& filename)const
+{
+	std::wofstream fout(filename);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	for(const auto& e : mShaders)
+	{
+		const Key& key = e.first;
+		fout << key.Features << L' ' << AnsiToWString(key.Entrypoint) << L' ' <<
+			AnsiToWString(key.Target) << L' ' << key.Filename << L'\n';
+	}
+}
+
+void ShaderPermutations::Precompile(const std::wstring& filename)
+{
+	std::wifstream fin(filename);
+
+	UINT features = 0;
+	std::wstring entrypoint;
+	std::wstring target;
+	std::wstring file;
+	while(fin >> features >> entrypoint >> target && std::getline(fin >> std::ws, file))
+	{
+		// Entry points and targets are plain ASCII.
+		Get(file, std::string(entrypoint.begin(), entrypoint.end()),
+			std::string(target.begin(), target.end()), features);
+	}
+}
+
+void ShaderPermutations::BuildDefines(UINT features, std::vector<std::string>& values,
+	std::vector<D3D_SHADER_MACRO>& macros)const
+{
+	// Reserved up front so the values do not move while macros point at them.
+	values.clear();
+	values.reserve(mFields.size());
+
+	macros = mDefines;
+	for(const auto& field : mFields)
+	{
+		UINT value = (features >> field.Shift) & ((1u << field.Width) - 1);
+		if(field.Width == 1)
+		{
+			if(value != 0)
+				macros.push_back({ field.Define, "1" });
+		}
+		else
+		{
+			values.push_back(std::to_string(value));
+			macros.push_back({ field.Define, values.back().c_str() });
+		}
+	}
+	macros.push_back({ NULL, NULL });
+}
@@ -0,0 +1,78 @@
+//***************************************************************************************
+// ShaderPermutations.h
+//
+// Compiles permutations of shader entry points on demand through a ShaderCache.  A
+// permutation is named by a feature mask, which the fields given at construction turn
+// into defines: a one bit field defines its name as 1 when set and leaves it undefined
+// otherwise, and a wider field always defines its name as the field's value.
+//
+// Only the masks actually requested are compiled, each once, so a new feature costs
+// nothing until something asks for it.  Every request is remembered and can be
+// written out as a manifest, which Precompile replays ahead of time.
+//
+// Get may be called from several threads at once.
+//***************************************************************************************
+
+#pragma once
+
+#include "ShaderCache.h"
+
+struct ShaderFeatureField
+{
+	const char* Define;
+	UINT Shift;
+	UINT Width;
+};
+
+class ShaderPermutations
+{
+public:
+	// defines are added to every permutation; the array need not be terminated.
+	ShaderPermutations(ShaderCache* cache, const std::vector<ShaderFeatureField>& fields,
+		const std::vector<D3D_SHADER_MACRO>& defines);
+	ShaderPermutations(const ShaderPermutations& rhs) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations& rhs) = delete;
+
+	// The permutation of entrypoint in filename for features.  The blob lives as long
+	// as this object.  Throws if the shader fails to compile.
+	ID3DBlob* Get(const std::wstring& filename, const std::string& entrypoint,
+		const std::string& target, UINT features);
+
+	UINT PermutationCount()const;
+
+	// One line per permutation requested so far.
+	void WriteManifest(const std::wstring& filename)const;
+
+	// Compiles every permutation a manifest lists.  A missing file lists none.
+	void Precompile(const std::wstring& filename);
+
+private:
+	struct Key
+	{
+		std::wstring Filename;
+		std::string Entrypoint;
+		std::string Target;
+		UINT Features;
+
+		bool operator==(const Key& rhs)const;
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key)const;
+	};
+
+	// Fills macros with the defines of features, keeping the values of wide fields
+	// in values.  The result is terminated.
+	void BuildDefines(UINT features, std::vector<std::string>& values,
+		std::vector<D3D_SHADER_MACRO>& macros)const;
+
+private:
+	ShaderCache* mCache = nullptr;
+	std::vector<ShaderFeatureField> mFields;
+	std::vector<D3D_SHADER_MACRO> mDefines;
+
+	// Guards mShaders.  Compiles run unlocked.
+	mutable std::mutex mMutex;
+	std::unordered_map<Key, Microsoft::WRL::ComPtr<ID3DBlob>, KeyHash> mShaders;
+};
@@ -0,0 +1,194 @@
+//***************************************************************************************
+// StartupGraph.cpp
+//***************************************************************************************
+
+#include "StartupGraph.h"
+#include "JobSystem.h"
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+void StartupGraph::Add(const char* name, std::initializer_list<const char*> dependencies,
+	std::function<void()> work, StartupThread thread)
+{
+	assert(Find(name) == mTasks.size());
+
+	Task task;
+	task.Name = name;
+	task.Work = std::move(work);
+	task.Thread = thread;
+	task.DependencyCount = (UINT)dependencies.size();
+
+	size_t index = mTasks.size();
+	for(const char* dependency : dependencies)
+	{
+		size_t d = Find(dependency);
+		if(d == mTasks.size())
+			throw std::invalid_argument(std::string("StartupGraph: unknown dependency ") + dependency);
+		mTasks[d].Dependents.push_back(index);
+	}
+
+	mTasks.push_back(std::move(task));
+}
+
+void StartupGraph::Run()
+{
+	__int64 countsPerSec = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+	mSecondsPerCount = 1.0 / (double)countsPerSec;
+	QueryPerformanceCounter((LARGE_INTEGER*)&mRunBegin);
+
+	std::vector<UINT> remaining(mTasks.size());
+	for(size_t i = 0; i < mTasks.size(); ++i)
+		remaining[i] = mTasks[i].DependencyCount;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<size_t> mainQueue;
+	size_t finished = 0;
+	std::exception_ptr error;
+
+	JobSystem& jobs = JobSystem::Shared();
+	JobCounter workers;
+
+	// Declared before it is defined so a finishing task can start its dependents.
+	std::function<void(size_t)> start;
+
+	auto execute = [&](size_t i)
+	{
+		Task& task = mTasks[i];
+		QueryPerformanceCounter((LARGE_INTEGER*)&task.Begin);
+		task.ThreadId = GetCurrentThreadId();
+
+		bool failed = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			failed = error != nullptr;
+		}
+		if(!failed)
+		{
+			try
+			{
+				task.Work();
+			}
+			catch(...)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(error == nullptr)
+					error = std::current_exception();
+			}
+		}
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&task.End);
+
+		std::vector<size_t> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(size_t d : task.Dependents)
+			{
+				if(--remaining[d] == 0)
+					ready.push_back(d);
+			}
+			++finished;
+		}
+		for(size_t d : ready)
+			start(d);
+
+		wake.notify_one();
+	};
+
+	start = [&](size_t i)
+	{
+		if(mTasks[i].Thread == StartupThread::Worker)
+		{
+			jobs.Run([&execute, i]() { execute(i); }, &workers);
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			mainQueue.push_back(i);
+		}
+	};
+
+	for(size_t i = 0; i < mTasks.size(); ++i)
+	{
+		if(remaining[i] == 0)
+			start(i);
+	}
+
+	// Run main-thread tasks as they become ready until every task has finished.
+	for(;;)
+	{
+		size_t next = 0;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return !mainQueue.empty() || finished == mTasks.size(); });
+			if(mainQueue.empty())
+				break;
+
+			next = mainQueue.front();
+			mainQueue.pop_front();
+		}
+
+		execute(next);
+	}
+
+	jobs.Wait(workers);
+	QueryPerformanceCounter((LARGE_INTEGER*)&mRunEnd);
+
+	if(error != nullptr)
+		std::rethrow_exception(error);
+}
+
+double StartupGraph::TotalMs()const
+{
+	return ToMs(mRunEnd - mRunBegin);
+}
+
+std::string StartupGraph::Timeline()const
+{
+	std::vector<const Task*> order;
+	for(const auto& task : mTasks)
+		order.push_back(&task);
+	std::sort(order.begin(), order.end(),
+		[](const Task* a, const Task* b) { return a->Begin < b->Begin; });
+
+	std::ostringstream ss;
+	ss.setf(std::ios::fixed);
+	ss.precision(2);
+	ss << "task,start_ms,end_ms,duration_ms,thread\n";
+	for(const Task* task : order)
+	{
+		ss << task->Name << ","
+			<< ToMs(task->Begin - mRunBegin) << ","
+			<< ToMs(task->End - mRunBegin) << ","
+			<< ToMs(task->End - task->Begin) << ","
+			<< (task->Thread == StartupThread::Main ? "main" : "worker") << " " << task->ThreadId << "\n";
+	}
+	ss << "total,0.00," << TotalMs() << "," << TotalMs() << ",\n";
+
+	return ss.str();
+}
+
+bool StartupGraph::WriteTimeline(const std::wstring& filename)const
+{
+	std::ofstream fout(filename);
+	fout << Timeline();
+	return (bool)fout;
+}
+
+size_t StartupGraph::Find(const char* name)const
+{
+	for(size_t i = 0; i < mTasks.size(); ++i)
+	{
+		if(strcmp(mTasks[i].Name, name) == 0)
+			return i;
+	}
+
+	return mTasks.size();
+}
+
+double StartupGraph::ToMs(__int64 counts)const
+{
+	return counts*mSecondsPerCount*1000.0;
+}
@@ -0,0 +1,68 @@
+//***************************************************************************************
+// StartupGraph.h
+//
+// Runs initialization steps as a dependency graph.  Each task names the tasks it needs;
+// Run starts every task whose dependencies have finished, worker tasks on the shared
+// JobSystem and main-thread tasks on the calling thread, so the steps that record into
+// the app's one initialization command list never race while CPU-side work such as
+// shader compilation and geometry generation overlaps.
+//
+// Each task's start and end are kept for the startup timeline.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <functional>
+#include <stdexcept>
+
+enum class StartupThread
+{
+	Worker,
+	Main
+};
+
+class StartupGraph
+{
+public:
+	// name must outlive the graph (a string literal); dependencies must already have
+	// been added, so the graph cannot have cycles.
+	void Add(const char* name, std::initializer_list<const char*> dependencies,
+		std::function<void()> work, StartupThread thread = StartupThread::Worker);
+
+	// Runs every task and returns once all have finished.  If a task throws, tasks
+	// not yet started are skipped and the first exception is rethrown here.
+	void Run();
+
+	// Wall time of the last Run.
+	double TotalMs()const;
+
+	// One line per task, by start time: start and end in ms from the start of Run, and
+	// the thread it ran on.
+	std::string Timeline()const;
+	bool WriteTimeline(const std::wstring& filename)const;
+
+private:
+	struct Task
+	{
+		const char* Name = nullptr;
+		std::function<void()> Work;
+		StartupThread Thread = StartupThread::Worker;
+		std::vector<size_t> Dependents;
+		UINT DependencyCount = 0;
+
+		__int64 Begin = 0;
+		__int64 End = 0;
+		DWORD ThreadId = 0;
+	};
+
+	size_t Find(const char* name)const;
+	double ToMs(__int64 counts)const;
+
+private:
+	std::vector<Task> mTasks;
+
+	__int64 mRunBegin = 0;
+	__int64 mRunEnd = 0;
+	double mSecondsPerCount = 0.0;
+};
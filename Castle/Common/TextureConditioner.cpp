@@ -0,0 +1,551 @@
+//***************************************************************************************
+// TextureConditioner.cpp
+//***************************************************************************************
+
+#include "TextureConditioner.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+namespace
+{
+	const UINT DdsMagic = 0x20534444; // "DDS "
+
+	// The DDS_HEADER and DDS_HEADER_DXT10 fields written, in file order.
+	const UINT DdsHeaderSize = 124;
+	const UINT DdsFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT, LINEARSIZE
+	const UINT DdsPixelFormatSize = 32;
+	const UINT DdsFourCC = 0x4;
+	const UINT DdsDx10 = MAKEFOURCC('D', 'X', '1', '0');
+	const UINT DdsCaps = 0x1000 | 0x400000 | 0x8; // TEXTURE, MIPMAP, COMPLEX
+
+	// BC7's 4 bit index weights, out of 64.
+	const int Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	float SrgbToLinear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float LinearToSrgb(float c)
+	{
+		return c <= 0.0031308f ? c*12.92f : 1.055f*powf(c, 1.0f / 2.4f) - 0.055f;
+	}
+
+	int ToByte(float c)
+	{
+		return (int)(MathHelper::Clamp(c, 0.0f, 1.0f)*255.0f + 0.5f);
+	}
+
+	// Writes fields least significant bit first, as the BC formats lay them out.
+	struct BitWriter
+	{
+		std::uint8_t* Bytes;
+		UINT Position = 0;
+
+		void Write(UINT value, UINT bits)
+		{
+			for(UINT i = 0; i < bits; ++i, ++Position)
+			{
+				if(value & (1u << i))
+					Bytes[Position / 8] |= (std::uint8_t)(1u << (Position % 8));
+			}
+		}
+	};
+
+	// Mode 6 endpoints: seven bits a channel plus a shared low bit per endpoint.
+	struct Bc7Endpoints
+	{
+		int Color[2][4];
+		int PBit[2];
+	};
+
+	// The nearest representable endpoint to each of e, with its best low bit.
+	Bc7Endpoints QuantizeBc7(const float e[2][4])
+	{
+		Bc7Endpoints q = {};
+		for(int i = 0; i < 2; ++i)
+		{
+			float bestError = FLT_MAX;
+			for(int p = 0; p < 2; ++p)
+			{
+				int color[4];
+				float error = 0.0f;
+				for(int c = 0; c < 4; ++c)
+				{
+					float v = MathHelper::Clamp(e[i][c], 0.0f, 255.0f);
+					color[c] = MathHelper::Clamp((int)floorf((v - p) / 2.0f + 0.5f), 0, 127);
+					float d = (float)(color[c]*2 + p) - v;
+					error += d*d;
+				}
+				if(error < bestError)
+				{
+					bestError = error;
+					std::copy(color, color + 4, q.Color[i]);
+					q.PBit[i] = p;
+				}
+			}
+		}
+		return q;
+	}
+
+	// Picks each texel's nearest palette entry and returns the total squared error.
+	float IndexBc7(const Bc7Endpoints& q, const int texels[16][4], int indices[16])
+	{
+		int palette[16][4];
+		for(int w = 0; w < 16; ++w)
+		{
+			for(int c = 0; c < 4; ++c)
+			{
+				int e0 = q.Color[0][c]*2 + q.PBit[0];
+				int e1 = q.Color[1][c]*2 + q.PBit[1];
+				palette[w][c] = ((64 - Bc7Weights[w])*e0 + Bc7Weights[w]*e1 + 32) >> 6;
+			}
+		}
+
+		float total = 0.0f;
+		for(int i = 0; i < 16; ++i)
+		{
+			int bestError = INT_MAX;
+			for(int w = 0; w < 16; ++w)
+			{
+				int error = 0;
+				for(int c = 0; c < 4; ++c)
+				{
+					int d = palette[w][c] - texels[i][c];
+					error += d*d;
+				}
+				if(error < bestError)
+				{
+					bestError = error;
+					indices[i] = w;
+				}
+			}
+			total += (float)bestError;
+		}
+		return total;
+	}
+
+	void EncodeBc7Block(const int texels[16][4], std::uint8_t* block)
+	{
+		// The principal axis of the block's texels, by power iteration on their
+		// covariance.
+		float mean[4] = {};
+		for(int i = 0; i < 16; ++i)
+			for(int c = 0; c < 4; ++c)
+				mean[c] += texels[i][c] / 16.0f;
+
+		float cov[4][4] = {};
+		for(int i = 0; i < 16; ++i)
+			for(int a = 0; a < 4; ++a)
+				for(int b = 0; b < 4; ++b)
+					cov[a][b] += (texels[i][a] - mean[a])*(texels[i][b] - mean[b]);
+
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for(int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			for(int a = 0; a < 4; ++a)
+				for(int b = 0; b < 4; ++b)
+					next[a] += cov[a][b]*axis[b];
+
+			float length = sqrtf(next[0]*next[0] + next[1]*next[1] + next[2]*next[2] + next[3]*next[3]);
+			if(length < 1e-6f)
+				break;
+			for(int c = 0; c < 4; ++c)
+				axis[c] = next[c] / length;
+		}
+
+		float minT = FLT_MAX;
+		float maxT = -FLT_MAX;
+		for(int i = 0; i < 16; ++i)
+		{
+			float t = 0.0f;
+			for(int c = 0; c < 4; ++c)
+				t += (texels[i][c] - mean[c])*axis[c];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		float e[2][4];
+		for(int c = 0; c < 4; ++c)
+		{
+			e[0][c] = mean[c] + axis[c]*minT;
+			e[1][c] = mean[c] + axis[c]*maxT;
+		}
+
+		Bc7Endpoints q = QuantizeBc7(e);
+		int indices[16];
+		float error = IndexBc7(q, texels, indices);
+
+		// Refit the endpoints to the chosen weights by least squares and keep the
+		// refit if it does better.
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ra[4] = {}, rb[4] = {};
+		for(int i = 0; i < 16; ++i)
+		{
+			float w = Bc7Weights[indices[i]] / 64.0f;
+			aa += (1.0f - w)*(1.0f - w);
+			ab += (1.0f - w)*w;
+			bb += w*w;
+			for(int c = 0; c < 4; ++c)
+			{
+				ra[c] += (1.0f - w)*texels[i][c];
+				rb[c] += w*texels[i][c];
+			}
+		}
+
+		float det = aa*bb - ab*ab;
+		if(fabsf(det) > 1e-6f)
+		{
+			float refit[2][4];
+			for(int c = 0; c < 4; ++c)
+			{
+				refit[0][c] = (bb*ra[c] - ab*rb[c]) / det;
+				refit[1][c] = (aa*rb[c] - ab*ra[c]) / det;
+			}
+
+			Bc7Endpoints refitQ = QuantizeBc7(refit);
+			int refitIndices[16];
+			float refitError = IndexBc7(refitQ, texels, refitIndices);
+			if(refitError < error)
+			{
+				q = refitQ;
+				std::copy(refitIndices, refitIndices + 16, indices);
+			}
+		}
+
+		// The first index's top bit is implied zero; swap the endpoints to make it so.
+		if(indices[0] & 8)
+		{
+			std::swap(q.Color[0], q.Color[1]);
+			std::swap(q.PBit[0], q.PBit[1]);
+			for(int i = 0; i < 16; ++i)
+				indices[i] = 15 - indices[i];
+		}
+
+		std::fill(block, block + 16, (std::uint8_t)0);
+		BitWriter bits = { block };
+		bits.Write(1u << 6, 7);
+		for(int c = 0; c < 4; ++c)
+		{
+			bits.Write(q.Color[0][c], 7);
+			bits.Write(q.Color[1][c], 7);
+		}
+		bits.Write(q.PBit[0], 1);
+		bits.Write(q.PBit[1], 1);
+		bits.Write(indices[0], 3);
+		for(int i = 1; i < 16; ++i)
+			bits.Write(indices[i], 4);
+	}
+
+	// The eight-value mode, from the block's range.
+	void EncodeBc4Block(const int values[16], std::uint8_t* block)
+	{
+		int hi = *std::max_element(values, values + 16);
+		int lo = *std::min_element(values, values + 16);
+
+		int palette[8] = { hi, lo };
+		for(int i = 2; i < 8; ++i)
+			palette[i] = ((8 - i)*hi + (i - 1)*lo + 3) / 7;
+
+		std::fill(block, block + 8, (std::uint8_t)0);
+		block[0] = (std::uint8_t)hi;
+		block[1] = (std::uint8_t)lo;
+
+		BitWriter bits = { block + 2 };
+		for(int i = 0; i < 16; ++i)
+		{
+			int best = 0;
+			for(int p = 1; p < 8; ++p)
+			{
+				if(abs(palette[p] - values[i]) < abs(palette[best] - values[i]))
+					best = p;
+			}
+			bits.Write(best, 3);
+		}
+	}
+
+	bool LastWriteTime(const std::wstring& filename, ULARGE_INTEGER& time)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if(!GetFileAttributesExW(filename.c_str(), GetFileExInfoStandard, &data))
+			return false;
+
+		time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+		time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+		return true;
+	}
+}
+
+TextureConditioner::TextureConditioner()
+{
+	// S_FALSE if the thread already had COM; either way it needs a matching call.
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	mUninitializeCom = SUCCEEDED(hr);
+	if(FAILED(hr) && hr != RPC_E_CHANGED_MODE)
+		ThrowIfFailed(hr);
+
+	ThrowIfFailed(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER,
+		IID_PPV_ARGS(&mFactory)));
+}
+
+TextureConditioner::~TextureConditioner()
+{
+	mFactory = nullptr;
+
+	if(mUninitializeCom)
+		CoUninitialize();
+}
+
+void TextureConditioner::Condition(const std::vector<std::wstring>& sources, TextureEncoding encoding,
+	const std::wstring& output)
+{
+	std::vector<Image> slices;
+	for(const auto& source : sources)
+	{
+		slices.push_back(Load(source));
+		if(slices.back().Width != slices[0].Width || slices.back().Height != slices[0].Height)
+			throw DxException(E_INVALIDARG, L"TextureConditioner " + source, AnsiToWString(__FILE__), __LINE__);
+	}
+
+	const UINT width = slices[0].Width;
+	const UINT height = slices[0].Height;
+	UINT mipCount = 1;
+	while((std::max(width, height) >> mipCount) > 0)
+		++mipCount;
+
+	// DDS keeps each slice's mips together, finest first.
+	std::vector<std::uint8_t> data;
+	UINT topLevelSize = 0;
+	for(const Image& slice : slices)
+	{
+		Image level = slice;
+		for(UINT mip = 0; mip < mipCount; ++mip)
+		{
+			size_t before = data.size();
+			Encode(level, encoding, data);
+			if(mip == 0)
+				topLevelSize = (UINT)(data.size() - before);
+
+			if(mip + 1 < mipCount)
+				level = Downsample(level, encoding);
+		}
+	}
+
+	UINT header[1 + 31 + 5] = {};
+	header[0] = DdsMagic;
+	header[1] = DdsHeaderSize;
+	header[2] = DdsFlags;
+	header[3] = height;
+	header[4] = width;
+	header[5] = topLevelSize;
+	header[7] = mipCount;
+	header[19] = DdsPixelFormatSize;
+	header[20] = DdsFourCC;
+	header[21] = DdsDx10;
+	header[27] = DdsCaps;
+	header[32] = (UINT)Format(encoding);
+	header[33] = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	header[35] = (UINT)slices.size();
+
+	size_t slash = output.find_last_of(L"\\/");
+	if(slash != std::wstring::npos)
+		CreateDirectoryW(output.substr(0, slash).c_str(), nullptr);
+
+	std::ofstream fout(output, std::ios::binary);
+	fout.write((const char*)header, sizeof(header));
+	fout.write((const char*)data.data(), data.size());
+	if(!fout)
+		throw DxException(HRESULT_FROM_WIN32(ERROR_WRITE_FAULT), L"TextureConditioner " + output, AnsiToWString(__FILE__), __LINE__);
+}
+
+bool TextureConditioner::IsUpToDate(const std::vector<std::wstring>& sources, const std::wstring& output)
+{
+	ULARGE_INTEGER outputTime;
+	if(!LastWriteTime(output, outputTime))
+		return false;
+
+	for(const auto& source : sources)
+	{
+		ULARGE_INTEGER sourceTime;
+		if(!LastWriteTime(source, sourceTime) || sourceTime.QuadPart > outputTime.QuadPart)
+			return false;
+	}
+	return true;
+}
+
+bool TextureConditioner::IsConditioned(const std::wstring& file, TextureEncoding encoding)
+{
+	UINT header[1 + 31 + 5] = {};
+	std::ifstream fin(file, std::ios::binary);
+	fin.read((char*)header, sizeof(header));
+	if(!fin || header[0] != DdsMagic || header[20] != DdsFourCC || header[21] != DdsDx10 ||
+		header[32] != (UINT)Format(encoding))
+		return false;
+
+	const UINT width = header[4];
+	const UINT height = header[3];
+	UINT mipCount = 1;
+	while((std::max(width, height) >> mipCount) > 0)
+		++mipCount;
+	return header[7] == mipCount;
+}
+
+DXGI_FORMAT TextureConditioner::Format(TextureEncoding encoding)
+{
+	switch(encoding)
+	{
+	case TextureEncoding::BC5:
+		return DXGI_FORMAT_BC5_UNORM;
+	case TextureEncoding::BC4:
+		return DXGI_FORMAT_BC4_UNORM;
+	default:
+		return DXGI_FORMAT_BC7_UNORM;
+	}
+}
+
+TextureConditioner::Image TextureConditioner::Load(const std::wstring& filename)
+{
+	ComPtr<IWICBitmapDecoder> decoder;
+	ThrowIfFailed(mFactory->CreateDecoderFromFilename(filename.c_str(), nullptr, GENERIC_READ,
+		WICDecodeMetadataCacheOnDemand, &decoder));
+
+	ComPtr<IWICBitmapFrameDecode> frame;
+	ThrowIfFailed(decoder->GetFrame(0, &frame));
+
+	Image image;
+	ThrowIfFailed(frame->GetSize(&image.Width, &image.Height));
+
+	WICPixelFormatGUID format;
+	ThrowIfFailed(frame->GetPixelFormat(&format));
+
+	const UINT stride = image.Width * 4;
+	std::vector<BYTE> pixels((size_t)stride*image.Height);
+	bool bgr = false;
+
+	// 32 bit BMPs decode as BGR with the fourth byte ignored, but files such as the
+	// tree frames keep alpha there.  Read them as they are and use it if any is set.
+	if(format == GUID_WICPixelFormat32bppBGR)
+	{
+		ThrowIfFailed(frame->CopyPixels(nullptr, stride, (UINT)pixels.size(), pixels.data()));
+		bool hasAlpha = false;
+		for(size_t i = 3; i < pixels.size() && !hasAlpha; i += 4)
+			hasAlpha = pixels[i] != 0;
+		if(!hasAlpha)
+		{
+			for(size_t i = 3; i < pixels.size(); i += 4)
+				pixels[i] = 0xff;
+		}
+		bgr = true;
+	}
+	else
+	{
+		ComPtr<IWICFormatConverter> converter;
+		ThrowIfFailed(mFactory->CreateFormatConverter(&converter));
+		ThrowIfFailed(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA,
+			WICBitmapDitherTypeNone, nullptr, 0.0f, WICBitmapPaletteTypeCustom));
+		ThrowIfFailed(converter->CopyPixels(nullptr, stride, (UINT)pixels.size(), pixels.data()));
+	}
+
+	image.Texels.resize((size_t)image.Width*image.Height);
+	for(size_t i = 0; i < image.Texels.size(); ++i)
+	{
+		const BYTE* p = &pixels[i*4];
+		image.Texels[i] = XMFLOAT4(p[bgr ? 2 : 0] / 255.0f, p[1] / 255.0f, p[bgr ? 0 : 2] / 255.0f, p[3] / 255.0f);
+	}
+	return image;
+}
+
+TextureConditioner::Image TextureConditioner::Downsample(const Image& src, TextureEncoding encoding)
+{
+	Image dst;
+	dst.Width = std::max(src.Width / 2, 1u);
+	dst.Height = std::max(src.Height / 2, 1u);
+	dst.Texels.resize((size_t)dst.Width*dst.Height);
+
+	for(UINT y = 0; y < dst.Height; ++y)
+	{
+		for(UINT x = 0; x < dst.Width; ++x)
+		{
+			// A 2x2 box, clamped where a dimension is already 1.
+			XMVECTOR sum = XMVectorZero();
+			for(UINT k = 0; k < 4; ++k)
+			{
+				UINT sx = std::min(2*x + (k & 1), src.Width - 1);
+				UINT sy = std::min(2*y + (k >> 1), src.Height - 1);
+				XMFLOAT4 t = src.Texels[(size_t)sy*src.Width + sx];
+
+				if(encoding == TextureEncoding::BC7)
+					t = XMFLOAT4(SrgbToLinear(t.x), SrgbToLinear(t.y), SrgbToLinear(t.z), t.w);
+				else if(encoding == TextureEncoding::BC5)
+					XMStoreFloat4(&t, XMLoadFloat4(&t)*2.0f - XMVectorSet(1.0f, 1.0f, 1.0f, 0.0f));
+
+				sum += XMLoadFloat4(&t);
+			}
+
+			XMFLOAT4 avg;
+			XMStoreFloat4(&avg, sum*0.25f);
+
+			if(encoding == TextureEncoding::BC7)
+				avg = XMFLOAT4(LinearToSrgb(avg.x), LinearToSrgb(avg.y), LinearToSrgb(avg.z), avg.w);
+			else if(encoding == TextureEncoding::BC5)
+			{
+				XMVECTOR n = XMVector3Normalize(XMVectorSetW(XMLoadFloat4(&avg), 0.0f));
+				XMStoreFloat4(&avg, XMVectorSetW(n*0.5f + XMVectorReplicate(0.5f), avg.w));
+			}
+
+			dst.Texels[(size_t)y*dst.Width + x] = avg;
+		}
+	}
+	return dst;
+}
+
+void TextureConditioner::Encode(const Image& image, TextureEncoding encoding, std::vector<std::uint8_t>& out)
+{
+	const UINT blocksWide = (image.Width + 3) / 4;
+	const UINT blocksHigh = (image.Height + 3) / 4;
+	const UINT blockSize = encoding == TextureEncoding::BC4 ? 8 : 16;
+
+	size_t offset = out.size();
+	out.resize(offset + (size_t)blocksWide*blocksHigh*blockSize);
+
+	for(UINT by = 0; by < blocksHigh; ++by)
+	{
+		for(UINT bx = 0; bx < blocksWide; ++bx, offset += blockSize)
+		{
+			// Levels smaller than a block repeat their edge texels.
+			int texels[16][4];
+			for(UINT i = 0; i < 16; ++i)
+			{
+				UINT x = std::min(bx*4 + i % 4, image.Width - 1);
+				UINT y = std::min(by*4 + i / 4, image.Height - 1);
+				const XMFLOAT4& t = image.Texels[(size_t)y*image.Width + x];
+				texels[i][0] = ToByte(t.x);
+				texels[i][1] = ToByte(t.y);
+				texels[i][2] = ToByte(t.z);
+				texels[i][3] = ToByte(t.w);
+			}
+
+			if(encoding == TextureEncoding::BC7)
+			{
+				EncodeBc7Block(texels, &out[offset]);
+				continue;
+			}
+
+			// BC4 is red alone; BC5 is a BC4 block of red then one of green.
+			int channel[16];
+			for(UINT c = 0; c < blockSize / 8; ++c)
+			{
+				for(UINT i = 0; i < 16; ++i)
+					channel[i] = texels[i][c];
+				EncodeBc4Block(channel, &out[offset + 8*c]);
+			}
+		}
+	}
+}
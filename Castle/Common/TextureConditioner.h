@@ -0,0 +1,76 @@
+//***************************************************************************************
+// TextureConditioner.h
+//
+// Turns source images into textures ready to sample: block-compressed, with a full
+// mip chain, written as DDS files CreateDDSTextureFromFile12 loads directly.  Sources
+// are read through WIC, so PNG, BMP, JPEG and the DDS formats WIC decodes all work.
+// Several sources of one size become the slices of an array texture.
+//
+// Encodings:
+//   BC7  colour and alpha, 8 bits per texel.  Mips are filtered in linear space.
+//   BC5  tangent-space normal maps, x and y only; the shader rebuilds z.  Mips are
+//        averaged as vectors and renormalized.
+//   BC4  one channel, taken from red, 4 bits per texel.
+//
+// BC7 uses mode 6 alone, one endpoint pair per block fitted along the block's
+// principal axis and refined by least squares.  It is quick and suits smooth
+// textures; blocks with sharp edges between several colours lose some detail that a
+// full mode search would keep.
+//
+// Device-free; COM is initialized on the calling thread for the lifetime of the
+// object.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <wincodec.h>
+
+enum class TextureEncoding
+{
+	BC7,
+	BC5,
+	BC4
+};
+
+class TextureConditioner
+{
+public:
+	TextureConditioner();
+	TextureConditioner(const TextureConditioner& rhs) = delete;
+	TextureConditioner& operator=(const TextureConditioner& rhs) = delete;
+	~TextureConditioner();
+
+	// Loads each of sources as one array slice, builds its mip chain and writes the
+	// slices block-compressed to output.  The sources must share one size.  Throws if
+	// a source cannot be read or the output cannot be written.
+	void Condition(const std::vector<std::wstring>& sources, TextureEncoding encoding,
+		const std::wstring& output);
+
+	// Whether output was written after every one of sources last changed.
+	static bool IsUpToDate(const std::vector<std::wstring>& sources, const std::wstring& output);
+
+	// Whether file is a DDS in encoding's format with a full mip chain, as Condition
+	// would write it.  False for anything unreadable.
+	static bool IsConditioned(const std::wstring& file, TextureEncoding encoding);
+
+	// The DXGI format each encoding writes.
+	static DXGI_FORMAT Format(TextureEncoding encoding);
+
+private:
+	// Unorm texels, red to alpha, in the source's own encoding.
+	struct Image
+	{
+		UINT Width = 0;
+		UINT Height = 0;
+		std::vector<DirectX::XMFLOAT4> Texels;
+	};
+
+	Image Load(const std::wstring& filename);
+	static Image Downsample(const Image& src, TextureEncoding encoding);
+	static void Encode(const Image& image, TextureEncoding encoding, std::vector<std::uint8_t>& out);
+
+private:
+	Microsoft::WRL::ComPtr<IWICImagingFactory> mFactory;
+	bool mUninitializeCom = false;
+};
@@ -0,0 +1,259 @@
+//***************************************************************************************
+// TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+#include "DDSTextureLoader.h"
+
+using Microsoft::WRL::ComPtr;
+
+TextureStreamer::TextureStreamer(ID3D12Device* device)
+	: md3dDevice(device), mPendingCount(0)
+{
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+	mFenceEvent = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// Workers still reference the queue and the upload heaps must outlive the copies.
+	WaitIdle();
+
+	CloseHandle(mFenceEvent);
+}
+
+UINT TextureStreamer::Request(const std::wstring& filename)
+{
+	UINT ticket = mNextTicket++;
+	++mPendingCount;
+
+	mTasks.run([this, ticket, filename]()
+	{
+		Load(ticket, filename);
+	});
+
+	return ticket;
+}
+
+std::vector<StreamedTexture> TextureStreamer::Poll(ID3D12CommandQueue* queue)
+{
+	std::vector<StreamedTexture> ready;
+
+	UINT64 completed = mFence->GetCompletedValue();
+	UINT64 waitFence = 0;
+	{
+		std::lock_guard<std::mutex> lock(mSubmitMutex);
+
+		for(auto it = mUploads.begin(); it != mUploads.end(); )
+		{
+			if(it->Fence > completed)
+			{
+				++it;
+				continue;
+			}
+
+			if(FAILED(it->Result))
+				throw DxException(it->Result, L"CreateDDSTextureFromFile12 " + it->Filename, AnsiToWString(__FILE__), __LINE__);
+
+			StreamedTexture texture;
+			texture.Ticket = it->Ticket;
+			texture.Resource = it->Resource;
+			ready.push_back(texture);
+
+			waitFence = std::max(waitFence, it->Fence);
+
+			it = mUploads.erase(it);
+			--mPendingCount;
+		}
+	}
+
+	// The copies are already done, so this costs the graphics queue nothing; it
+	// just orders the hand-over.
+	if(waitFence > 0)
+		ThrowIfFailed(queue->Wait(mFence.Get(), waitFence));
+
+	return ready;
+}
+
+UINT TextureStreamer::PendingCount()const
+{
+	return mPendingCount;
+}
+
+void TextureStreamer::WaitIdle()
+{
+	mTasks.wait();
+
+	UINT64 fence = 0;
+	{
+		std::lock_guard<std::mutex> lock(mSubmitMutex);
+		fence = mCurrentFence;
+	}
+
+	if(mFence->GetCompletedValue() < fence)
+	{
+		ThrowIfFailed(mFence->SetEventOnCompletion(fence, mFenceEvent));
+		WaitForSingleObject(mFenceEvent, INFINITE);
+	}
+}
+
+void TextureStreamer::Load(UINT ticket, const std::wstring& filename)
+{
+	Upload upload;
+	upload.Ticket = ticket;
+	upload.Filename = filename;
+
+	std::unique_ptr<CopyContext> context;
+	try
+	{
+		context = AcquireContext();
+	}
+	catch(DxException& e)
+	{
+		upload.Result = e.ErrorCode;
+	}
+
+	if(context != nullptr)
+	{
+		// Reading and parsing the file happens here, on the worker.
+		UINT64 requiredSize = 0;
+		upload.Result = context->Staging != nullptr ? S_OK : GrowStaging(*context, 0);
+		if(SUCCEEDED(upload.Result))
+			upload.Result = LoadMapped(*context, filename, upload.Resource, &requiredSize);
+		if(upload.Result == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER))
+		{
+			// Nothing was recorded; make room and map the file again.
+			upload.Result = GrowStaging(*context, requiredSize);
+			if(SUCCEEDED(upload.Result))
+				upload.Result = LoadMapped(*context, filename, upload.Resource, &requiredSize);
+		}
+
+		HRESULT hr = context->CmdList->Close();
+		if(SUCCEEDED(upload.Result))
+			upload.Result = hr;
+
+		if(SUCCEEDED(upload.Result))
+			WarnIfUnconditioned(filename, upload.Resource->GetDesc());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mSubmitMutex);
+
+		if(SUCCEEDED(upload.Result))
+		{
+			ID3D12CommandList* cmdsLists[] = { context->CmdList.Get() };
+			mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+		}
+
+		// Failed requests get a fence value too so Poll reports them in order.
+		upload.Fence = ++mCurrentFence;
+		mCopyQueue->Signal(mFence.Get(), upload.Fence);
+
+		if(context != nullptr)
+			context->Fence = upload.Fence;
+
+		mUploads.push_back(std::move(upload));
+	}
+
+	if(context != nullptr)
+		ReleaseContext(std::move(context));
+}
+
+HRESULT TextureStreamer::LoadMapped(CopyContext& context, const std::wstring& filename,
+	ComPtr<ID3D12Resource>& texture, UINT64* requiredSize)
+{
+	DirectX::DDS_UPLOAD_REGION region;
+	region.Buffer = context.Staging.Get();
+	region.Offset = 0;
+	region.Size = context.StagingSize;
+
+	return DirectX::CreateDDSTextureFromFileMapped12(md3dDevice,
+		context.CmdList.Get(), filename.c_str(), texture, region, requiredSize,
+		0, nullptr, D3D12_RESOURCE_STATE_COMMON);
+}
+
+void TextureStreamer::WarnIfUnconditioned(const std::wstring& filename, const D3D12_RESOURCE_DESC& desc)
+{
+	bool compressed = (desc.Format >= DXGI_FORMAT_BC1_TYPELESS && desc.Format <= DXGI_FORMAT_BC5_SNORM) ||
+		(desc.Format >= DXGI_FORMAT_BC6H_TYPELESS && desc.Format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+	bool mipless = desc.MipLevels == 1 && (desc.Width > 1 || desc.Height > 1);
+
+	if(!compressed)
+		OutputDebugStringW((L"TextureStreamer: " + filename + L" is not block-compressed\n").c_str());
+	if(mipless)
+		OutputDebugStringW((L"TextureStreamer: " + filename + L" has no mips\n").c_str());
+}
+
+HRESULT TextureStreamer::GrowStaging(CopyContext& context, UINT64 size)
+{
+	const UINT64 granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	if(size < MinStagingSize)
+		size = MinStagingSize;
+	size = (size + granularity - 1) & ~(granularity - 1);
+
+	// The old buffer has no copies in flight; AcquireContext waited for them.
+	context.Staging = nullptr;
+	context.StagingSize = 0;
+
+	HRESULT hr = md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&context.Staging));
+
+	if(SUCCEEDED(hr))
+		context.StagingSize = size;
+
+	return hr;
+}
+
+std::unique_ptr<TextureStreamer::CopyContext> TextureStreamer::AcquireContext()
+{
+	std::unique_ptr<CopyContext> context;
+	{
+		std::lock_guard<std::mutex> lock(mContextMutex);
+
+		UINT64 completed = mFence->GetCompletedValue();
+		for(auto it = mFreeContexts.begin(); it != mFreeContexts.end(); ++it)
+		{
+			if((*it)->Fence <= completed)
+			{
+				context = std::move(*it);
+				mFreeContexts.erase(it);
+				break;
+			}
+		}
+	}
+
+	if(context != nullptr)
+	{
+		ThrowIfFailed(context->CmdListAlloc->Reset());
+		ThrowIfFailed(context->CmdList->Reset(context->CmdListAlloc.Get(), nullptr));
+		return context;
+	}
+
+	// Every free context still has a copy in flight.
+	context = std::make_unique<CopyContext>();
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(context->CmdListAlloc.GetAddressOf())));
+	ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+		context->CmdListAlloc.Get(), nullptr, IID_PPV_ARGS(context->CmdList.GetAddressOf())));
+
+	return context;
+}
+
+void TextureStreamer::ReleaseContext(std::unique_ptr<CopyContext> context)
+{
+	std::lock_guard<std::mutex> lock(mContextMutex);
+	mFreeContexts.push_back(std::move(context));
+}
@@ -0,0 +1,112 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Loads DDS textures off the startup path.  Each request is memory-mapped and parsed on
+// a PPL worker, its texels written into the staging buffer of a pooled copy context,
+// recorded into that context's copy command list and submitted to a dedicated copy
+// queue, which signals the streamer's fence.  Staging memory is reused once a
+// context's copy retires, so it scales with the copies in flight rather than with
+// the size of the texture set.  Poll hands back the textures whose copies have retired
+// and makes the graphics queue wait on that fence, so anything it executes afterwards
+// may sample them.
+//
+// Textures that are not block-compressed or have no mips are loaded as they are, with
+// a warning in the debug output; TextureConditioner fixes both.
+//
+// Textures are left in COMMON since a copy list cannot transition to shader resource
+// states; the graphics queue promotes them implicitly on first use.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <ppl.h>
+#include <mutex>
+#include <atomic>
+
+struct StreamedTexture
+{
+	UINT Ticket = 0;
+	Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+};
+
+class TextureStreamer
+{
+public:
+	TextureStreamer(ID3D12Device* device);
+	TextureStreamer(const TextureStreamer& rhs) = delete;
+	TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+	~TextureStreamer();
+
+	// Queues a DDS file for loading.  The returned ticket identifies the texture
+	// when Poll hands it back.
+	UINT Request(const std::wstring& filename);
+
+	// Returns the textures whose copies completed since the last call and inserts
+	// a wait for them on queue.  Throws if one of them failed to load.
+	std::vector<StreamedTexture> Poll(ID3D12CommandQueue* queue);
+
+	// Requests that Poll has not returned yet.
+	UINT PendingCount()const;
+
+	// Blocks until every request has been loaded and its copy has executed.
+	void WaitIdle();
+
+private:
+	struct CopyContext
+	{
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CmdList;
+
+		// Upload memory the file's texels are laid out in; grows to the largest
+		// texture this context has loaded.
+		Microsoft::WRL::ComPtr<ID3D12Resource> Staging;
+		UINT64 StagingSize = 0;
+
+		// The allocator and staging buffer may be reused once the copy queue has
+		// passed this value.
+		UINT64 Fence = 0;
+	};
+
+	struct Upload
+	{
+		UINT Ticket = 0;
+		std::wstring Filename;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		UINT64 Fence = 0;
+		HRESULT Result = S_OK;
+	};
+
+	void Load(UINT ticket, const std::wstring& filename);
+	HRESULT LoadMapped(CopyContext& context, const std::wstring& filename,
+		Microsoft::WRL::ComPtr<ID3D12Resource>& texture, UINT64* requiredSize);
+	HRESULT GrowStaging(CopyContext& context, UINT64 size);
+	static void WarnIfUnconditioned(const std::wstring& filename, const D3D12_RESOURCE_DESC& desc);
+
+	std::unique_ptr<CopyContext> AcquireContext();
+	void ReleaseContext(std::unique_ptr<CopyContext> context);
+
+private:
+	// Enough for a 1024x1024 RGBA texture with mips without growing.
+	static const UINT64 MinStagingSize = 8 * 1024 * 1024;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	HANDLE mFenceEvent = nullptr;
+
+	concurrency::task_group mTasks;
+
+	// Guards submission to the copy queue, so fence values follow submission
+	// order, and the list of uploads in flight.
+	std::mutex mSubmitMutex;
+	UINT64 mCurrentFence = 0;
+	std::vector<Upload> mUploads;
+
+	std::mutex mContextMutex;
+	std::vector<std::unique_ptr<CopyContext>> mFreeContexts;
+
+	UINT mNextTicket = 0;
+	std::atomic<UINT> mPendingCount;
+};
@@ -0,0 +1,556 @@
+//***************************************************************************************
+// TiledTextureStreamer.cpp
+//***************************************************************************************
+
+#include "TiledTextureStreamer.h"
+#include "DDSTextureLoader.h"
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+TiledTextureStreamer::Texture::~Texture()
+{
+	if(View != nullptr)
+		UnmapViewOfFile(View);
+	if(Mapping != nullptr)
+		CloseHandle(Mapping);
+	if(File != INVALID_HANDLE_VALUE)
+		CloseHandle(File);
+}
+
+TiledTextureStreamer::TiledTextureStreamer(ID3D12Device* device, UINT64 budget)
+	: md3dDevice(device)
+{
+	const UINT64 tileSize = D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+	mTileCount = (UINT)std::max<UINT64>(budget / tileSize, 1);
+
+	CD3DX12_HEAP_DESC heapDesc(mTileCount*tileSize, D3D12_HEAP_TYPE_DEFAULT, 0,
+		D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES);
+	ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&mHeap)));
+
+	// Handed out from the back, so the first tiles go first.
+	mFreeTiles.reserve(mTileCount);
+	for(UINT i = mTileCount; i > 0; --i)
+		mFreeTiles.push_back(i - 1);
+
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+	mFenceEvent = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+TiledTextureStreamer::~TiledTextureStreamer()
+{
+	// Workers read the mapped files and the copies the staging buffers.
+	WaitIdle();
+
+	CloseHandle(mFenceEvent);
+}
+
+UINT TiledTextureStreamer::Add(const std::wstring& filename)
+{
+	auto texture = std::make_unique<Texture>();
+	texture->Filename = filename;
+
+	texture->File = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(texture->File == INVALID_HANDLE_VALUE)
+		throw DxException(HRESULT_FROM_WIN32(GetLastError()), L"CreateFileW " + filename, AnsiToWString(__FILE__), __LINE__);
+
+	LARGE_INTEGER fileSize = {};
+	if(!GetFileSizeEx(texture->File, &fileSize))
+		throw DxException(HRESULT_FROM_WIN32(GetLastError()), L"GetFileSizeEx " + filename, AnsiToWString(__FILE__), __LINE__);
+
+	texture->Mapping = CreateFileMappingW(texture->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(texture->Mapping != nullptr)
+		texture->View = static_cast<const std::uint8_t*>(MapViewOfFile(texture->Mapping, FILE_MAP_READ, 0, 0, 0));
+	if(texture->View == nullptr)
+		throw DxException(HRESULT_FROM_WIN32(GetLastError()), L"MapViewOfFile " + filename, AnsiToWString(__FILE__), __LINE__);
+
+	HRESULT hr = DirectX::GetDDSTextureLayout12(texture->View, (size_t)fileSize.QuadPart,
+		texture->Desc, texture->Subresources);
+	if(SUCCEEDED(hr) && texture->Desc.DepthOrArraySize != 1)
+		hr = HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	if(FAILED(hr))
+		throw DxException(hr, L"GetDDSTextureLayout12 " + filename, AnsiToWString(__FILE__), __LINE__);
+
+	ThrowIfFailed(md3dDevice->CreateReservedResource(&texture->Desc, D3D12_RESOURCE_STATE_COMMON,
+		nullptr, IID_PPV_ARGS(&texture->Resource)));
+
+	texture->MipCount = texture->Desc.MipLevels;
+	texture->Tiling.resize(texture->MipCount);
+
+	UINT tileCount = 0;
+	UINT subresourceCount = texture->MipCount;
+	D3D12_TILE_SHAPE tileShape = {};
+	md3dDevice->GetResourceTiling(texture->Resource.Get(), &tileCount, &texture->PackedMips,
+		&tileShape, &subresourceCount, 0, texture->Tiling.data());
+
+	texture->BaseMip = texture->PackedMips.NumPackedMips > 0 ?
+		texture->PackedMips.NumStandardMips : texture->MipCount - 1;
+	texture->MipTiles.resize(texture->MipCount);
+	texture->ResidentMip = texture->MipCount;
+	texture->LoadingMip = texture->MipCount;
+	texture->RequestedMip = texture->BaseMip;
+	texture->WantedMip = texture->BaseMip;
+
+	std::vector<UINT> tiles;
+	if(!AllocateTiles(TilesForMip(*texture, texture->BaseMip), tiles))
+		throw DxException(E_OUTOFMEMORY, L"TiledTextureStreamer budget " + filename, AnsiToWString(__FILE__), __LINE__);
+
+	MapTiles(*texture, texture->BaseMip, &tiles);
+	texture->MipTiles[texture->BaseMip] = std::move(tiles);
+
+	UINT id = (UINT)mTextures.size();
+	UINT baseMip = texture->BaseMip;
+	mTextures.push_back(std::move(texture));
+	QueueUpload(id, baseMip);
+
+	return id;
+}
+
+ID3D12Resource* TiledTextureStreamer::Resource(UINT id)const
+{
+	return mTextures[id]->Resource.Get();
+}
+
+UINT TiledTextureStreamer::MipCount(UINT id)const
+{
+	return mTextures[id]->MipCount;
+}
+
+UINT TiledTextureStreamer::ResidentMip(UINT id)const
+{
+	return mTextures[id]->ResidentMip;
+}
+
+void TiledTextureStreamer::Request(UINT id, UINT mip)
+{
+	Texture& texture = *mTextures[id];
+	texture.RequestedMip = std::min(texture.RequestedMip, mip);
+}
+
+std::vector<UINT> TiledTextureStreamer::Update(ID3D12CommandQueue* queue,
+	UINT64 completedFrameFence, UINT64 frameFence)
+{
+	std::vector<UINT> changed;
+
+	UINT64 completed = mFence->GetCompletedValue();
+	UINT64 waitFence = 0;
+	{
+		std::lock_guard<std::mutex> lock(mSubmitMutex);
+
+		for(auto it = mUploads.begin(); it != mUploads.end(); )
+		{
+			if(it->Fence > completed)
+			{
+				++it;
+				continue;
+			}
+
+			Texture& texture = *mTextures[it->Id];
+			if(FAILED(it->Result))
+				throw DxException(it->Result, L"TiledTextureStreamer " + texture.Filename, AnsiToWString(__FILE__), __LINE__);
+
+			texture.ResidentMip = it->Mip;
+			texture.LoadingMip = texture.MipCount;
+			changed.push_back(it->Id);
+
+			waitFence = std::max(waitFence, it->Fence);
+			it = mUploads.erase(it);
+		}
+	}
+
+	// As in TextureStreamer::Poll, this only orders the hand-over.
+	if(waitFence > 0)
+		ThrowIfFailed(queue->Wait(mFence.Get(), waitFence));
+
+	for(auto it = mRetired.begin(); it != mRetired.end(); )
+	{
+		if(it->Fence > completedFrameFence)
+		{
+			++it;
+			continue;
+		}
+
+		// A mip wanted again since has been mapped to other tiles.
+		const Texture& texture = *mTextures[it->Id];
+		if(texture.MipTiles[it->Mip].empty())
+			MapTiles(texture, it->Mip, nullptr);
+
+		mFreeTiles.insert(mFreeTiles.end(), it->Tiles.begin(), it->Tiles.end());
+		mRetiredTileCount -= (UINT)it->Tiles.size();
+		it = mRetired.erase(it);
+	}
+
+	// Coarser requests only take over once they have lasted.
+	UINT loading = 0;
+	std::vector<UINT> candidates;
+	for(UINT id = 0; id < (UINT)mTextures.size(); ++id)
+	{
+		Texture& texture = *mTextures[id];
+
+		UINT requested = std::min(texture.RequestedMip, texture.BaseMip);
+		if(requested <= texture.WantedMip || ++texture.WantedAge > EvictionDelay)
+		{
+			texture.WantedMip = requested;
+			texture.WantedAge = 0;
+		}
+		texture.RequestedMip = texture.BaseMip;
+
+		if(texture.LoadingMip != texture.MipCount)
+			++loading;
+		else if(texture.ResidentMip <= texture.BaseMip && texture.ResidentMip > texture.WantedMip)
+			candidates.push_back(id);
+	}
+
+	// The textures furthest from what they want go first.
+	std::sort(candidates.begin(), candidates.end(), [this](UINT a, UINT b)
+	{
+		const Texture& ta = *mTextures[a];
+		const Texture& tb = *mTextures[b];
+		return ta.ResidentMip - ta.WantedMip > tb.ResidentMip - tb.WantedMip;
+	});
+
+	for(UINT id : candidates)
+	{
+		if(loading >= MaxUploadsInFlight)
+			break;
+
+		Texture& texture = *mTextures[id];
+		UINT mip = texture.ResidentMip - 1;
+
+		// Evicted tiles free up over the next few updates; the upload waits for them.
+		std::vector<UINT> tiles;
+		UINT count = TilesForMip(texture, mip);
+		if(!EvictFor(count, frameFence, changed) || !AllocateTiles(count, tiles))
+			break;
+
+		MapTiles(texture, mip, &tiles);
+		texture.MipTiles[mip] = std::move(tiles);
+		QueueUpload(id, mip);
+		++loading;
+	}
+
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+	return changed;
+}
+
+ID3D12Heap* TiledTextureStreamer::Heap()const
+{
+	return mHeap.Get();
+}
+
+UINT TiledTextureStreamer::TileCount()const
+{
+	return mTileCount;
+}
+
+UINT TiledTextureStreamer::FreeTileCount()const
+{
+	return (UINT)mFreeTiles.size();
+}
+
+UINT TiledTextureStreamer::LoadingCount()const
+{
+	UINT loading = 0;
+	for(const std::unique_ptr<Texture>& texture : mTextures)
+	{
+		if(texture->LoadingMip != texture->MipCount)
+			++loading;
+	}
+	return loading;
+}
+
+void TiledTextureStreamer::WaitIdle()
+{
+	mTasks.wait();
+
+	UINT64 fence = 0;
+	{
+		std::lock_guard<std::mutex> lock(mSubmitMutex);
+		fence = mCurrentFence;
+	}
+
+	if(mFence->GetCompletedValue() < fence)
+	{
+		ThrowIfFailed(mFence->SetEventOnCompletion(fence, mFenceEvent));
+		WaitForSingleObject(mFenceEvent, INFINITE);
+	}
+}
+
+UINT TiledTextureStreamer::TilesForMip(const Texture& texture, UINT mip)const
+{
+	if(texture.PackedMips.NumPackedMips > 0 && mip >= texture.PackedMips.NumStandardMips)
+		return texture.PackedMips.NumTilesForPackedMips;
+
+	const D3D12_SUBRESOURCE_TILING& tiling = texture.Tiling[mip];
+	return tiling.WidthInTiles*tiling.HeightInTiles*tiling.DepthInTiles;
+}
+
+bool TiledTextureStreamer::AllocateTiles(UINT count, std::vector<UINT>& tiles)
+{
+	if(mFreeTiles.size() < count)
+		return false;
+
+	tiles.assign(mFreeTiles.end() - count, mFreeTiles.end());
+	mFreeTiles.resize(mFreeTiles.size() - count);
+	return true;
+}
+
+void TiledTextureStreamer::MapTiles(const Texture& texture, UINT mip, const std::vector<UINT>* tiles)
+{
+	D3D12_TILED_RESOURCE_COORDINATE coordinate = {};
+	D3D12_TILE_REGION_SIZE region = {};
+
+	if(texture.PackedMips.NumPackedMips > 0 && mip >= texture.PackedMips.NumStandardMips)
+	{
+		// The packed mips are addressed as a run of tiles from the first of them.
+		coordinate.Subresource = texture.PackedMips.NumStandardMips;
+		region.NumTiles = texture.PackedMips.NumTilesForPackedMips;
+		region.UseBox = FALSE;
+	}
+	else
+	{
+		const D3D12_SUBRESOURCE_TILING& tiling = texture.Tiling[mip];
+		coordinate.Subresource = mip;
+		region.NumTiles = tiling.WidthInTiles*tiling.HeightInTiles*tiling.DepthInTiles;
+		region.UseBox = TRUE;
+		region.Width = tiling.WidthInTiles;
+		region.Height = tiling.HeightInTiles;
+		region.Depth = tiling.DepthInTiles;
+	}
+
+	std::lock_guard<std::mutex> lock(mSubmitMutex);
+
+	if(tiles == nullptr)
+	{
+		D3D12_TILE_RANGE_FLAGS flags = D3D12_TILE_RANGE_FLAG_NULL;
+		mCopyQueue->UpdateTileMappings(texture.Resource.Get(), 1, &coordinate, &region,
+			nullptr, 1, &flags, nullptr, &region.NumTiles, D3D12_TILE_MAPPING_FLAG_NONE);
+		return;
+	}
+
+	// The free tiles are scattered through the heap, so each is a range of its own.
+	std::vector<D3D12_TILE_RANGE_FLAGS> flags(tiles->size(), D3D12_TILE_RANGE_FLAG_NONE);
+	std::vector<UINT> counts(tiles->size(), 1);
+	mCopyQueue->UpdateTileMappings(texture.Resource.Get(), 1, &coordinate, &region,
+		mHeap.Get(), (UINT)tiles->size(), flags.data(), tiles->data(), counts.data(),
+		D3D12_TILE_MAPPING_FLAG_NONE);
+}
+
+bool TiledTextureStreamer::EvictFor(UINT tiles, UINT64 frameFence, std::vector<UINT>& changed)
+{
+	while(mFreeTiles.size() + mRetiredTileCount < tiles)
+	{
+		// The texture resident furthest past what it wants gives up its finest mip.
+		UINT victim = (UINT)mTextures.size();
+		UINT excess = 0;
+		for(UINT id = 0; id < (UINT)mTextures.size(); ++id)
+		{
+			const Texture& texture = *mTextures[id];
+			if(texture.LoadingMip != texture.MipCount || texture.ResidentMip >= texture.BaseMip)
+				continue;
+
+			if(texture.WantedMip > texture.ResidentMip && texture.WantedMip - texture.ResidentMip > excess)
+			{
+				victim = id;
+				excess = texture.WantedMip - texture.ResidentMip;
+			}
+		}
+
+		if(victim == (UINT)mTextures.size())
+			return false;
+
+		Texture& texture = *mTextures[victim];
+
+		Retired retired;
+		retired.Id = victim;
+		retired.Mip = texture.ResidentMip;
+		retired.Tiles = std::move(texture.MipTiles[retired.Mip]);
+		retired.Fence = frameFence;
+		texture.MipTiles[retired.Mip].clear();
+
+		mRetiredTileCount += (UINT)retired.Tiles.size();
+		mRetired.push_back(std::move(retired));
+
+		++texture.ResidentMip;
+		changed.push_back(victim);
+	}
+
+	return mFreeTiles.size() >= tiles;
+}
+
+void TiledTextureStreamer::QueueUpload(UINT id, UINT mip)
+{
+	Texture* texture = mTextures[id].get();
+	texture->LoadingMip = mip;
+
+	mTasks.run([this, id, texture, mip]()
+	{
+		Load(id, *texture, mip);
+	});
+}
+
+void TiledTextureStreamer::Load(UINT id, const Texture& texture, UINT mip)
+{
+	Upload upload;
+	upload.Id = id;
+	upload.Mip = mip;
+
+	// The base upload brings in every permanent mip.
+	UINT mipCount = mip == texture.BaseMip ? texture.MipCount - mip : 1;
+
+	std::unique_ptr<CopyContext> context;
+	try
+	{
+		context = AcquireContext();
+	}
+	catch(DxException& e)
+	{
+		upload.Result = e.ErrorCode;
+	}
+
+	if(context != nullptr)
+	{
+		upload.Result = Record(*context, texture, mip, mipCount);
+
+		HRESULT hr = context->CmdList->Close();
+		if(SUCCEEDED(upload.Result))
+			upload.Result = hr;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mSubmitMutex);
+
+		if(SUCCEEDED(upload.Result))
+		{
+			ID3D12CommandList* cmdsLists[] = { context->CmdList.Get() };
+			mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+		}
+
+		upload.Fence = ++mCurrentFence;
+		mCopyQueue->Signal(mFence.Get(), upload.Fence);
+
+		if(context != nullptr)
+			context->Fence = upload.Fence;
+
+		mUploads.push_back(upload);
+	}
+
+	if(context != nullptr)
+		ReleaseContext(std::move(context));
+}
+
+HRESULT TiledTextureStreamer::Record(CopyContext& context, const Texture& texture, UINT firstMip, UINT mipCount)
+{
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(mipCount);
+	std::vector<UINT> numRows(mipCount);
+	std::vector<UINT64> rowSizes(mipCount);
+	UINT64 requiredSize = 0;
+	md3dDevice->GetCopyableFootprints(&texture.Desc, firstMip, mipCount, 0,
+		layouts.data(), numRows.data(), rowSizes.data(), &requiredSize);
+
+	HRESULT hr = S_OK;
+	if(context.StagingSize < requiredSize)
+	{
+		hr = GrowStaging(context, requiredSize);
+		if(FAILED(hr))
+			return hr;
+	}
+
+	BYTE* data = nullptr;
+	hr = context.Staging->Map(0, nullptr, reinterpret_cast<void**>(&data));
+	if(FAILED(hr))
+		return hr;
+
+	for(UINT i = 0; i < mipCount; ++i)
+	{
+		D3D12_MEMCPY_DEST dest = { data + layouts[i].Offset, layouts[i].Footprint.RowPitch,
+			SIZE_T(layouts[i].Footprint.RowPitch)*numRows[i] };
+		MemcpySubresource(&dest, &texture.Subresources[firstMip + i], (SIZE_T)rowSizes[i],
+			numRows[i], layouts[i].Footprint.Depth);
+	}
+	context.Staging->Unmap(0, nullptr);
+
+	for(UINT i = 0; i < mipCount; ++i)
+	{
+		CD3DX12_TEXTURE_COPY_LOCATION dst(texture.Resource.Get(), firstMip + i);
+		CD3DX12_TEXTURE_COPY_LOCATION src(context.Staging.Get(), layouts[i]);
+		context.CmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+
+	return S_OK;
+}
+
+HRESULT TiledTextureStreamer::GrowStaging(CopyContext& context, UINT64 size)
+{
+	const UINT64 granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	if(size < MinStagingSize)
+		size = MinStagingSize;
+	size = (size + granularity - 1) & ~(granularity - 1);
+
+	context.Staging = nullptr;
+	context.StagingSize = 0;
+
+	HRESULT hr = md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&context.Staging));
+
+	if(SUCCEEDED(hr))
+		context.StagingSize = size;
+
+	return hr;
+}
+
+std::unique_ptr<TiledTextureStreamer::CopyContext> TiledTextureStreamer::AcquireContext()
+{
+	std::unique_ptr<CopyContext> context;
+	{
+		std::lock_guard<std::mutex> lock(mContextMutex);
+
+		UINT64 completed = mFence->GetCompletedValue();
+		for(auto it = mFreeContexts.begin(); it != mFreeContexts.end(); ++it)
+		{
+			if((*it)->Fence <= completed)
+			{
+				context = std::move(*it);
+				mFreeContexts.erase(it);
+				break;
+			}
+		}
+	}
+
+	if(context != nullptr)
+	{
+		ThrowIfFailed(context->CmdListAlloc->Reset());
+		ThrowIfFailed(context->CmdList->Reset(context->CmdListAlloc.Get(), nullptr));
+		return context;
+	}
+
+	context = std::make_unique<CopyContext>();
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(context->CmdListAlloc.GetAddressOf())));
+	ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+		context->CmdListAlloc.Get(), nullptr, IID_PPV_ARGS(context->CmdList.GetAddressOf())));
+
+	return context;
+}
+
+void TiledTextureStreamer::ReleaseContext(std::unique_ptr<CopyContext> context)
+{
+	std::lock_guard<std::mutex> lock(mContextMutex);
+	mFreeContexts.push_back(std::move(context));
+}
@@ -0,0 +1,181 @@
+//***************************************************************************************
+// TiledTextureStreamer.h
+//
+// Keeps large textures in reserved resources whose 64KB tiles come from one heap of a
+// fixed size, so the textures' video memory is capped however many are added.  Each
+// texture's smallest mips, those the device packs into shared tiles or else just the
+// last, are mapped and uploaded when it is added and stay resident; finer mips are
+// mapped and uploaded one at a time as the client asks for them, and evicted, their
+// tiles going back to the heap, when other textures need the room.
+//
+// The client reports, for each texture, the finest mip it sampled, and each Update
+// moves the textures' resident mips one step towards what was asked for.  Shaders
+// must clamp their sampling to ResidentMip; a mip is only made resident once its
+// copy has finished, and a mip is only unmapped once the frames that might still
+// sample it have.  A mip stays wanted for EvictionDelay updates after the last
+// request, so a texture at the edge of a view does not flip between two mips.
+//
+// Texels are read from the memory-mapped DDS file, on a PPL worker, into the staging
+// buffer of a pooled copy context, as in TextureStreamer.  Tile mappings and copies
+// both go to the streamer's copy queue, which orders them.  Only 2D textures without
+// array slices are supported.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <ppl.h>
+#include <mutex>
+
+class TiledTextureStreamer
+{
+public:
+	TiledTextureStreamer(ID3D12Device* device, UINT64 budget);
+	TiledTextureStreamer(const TiledTextureStreamer& rhs) = delete;
+	TiledTextureStreamer& operator=(const TiledTextureStreamer& rhs) = delete;
+	~TiledTextureStreamer();
+
+	// Maps a DDS file, creates its reserved resource and queues the upload of its
+	// permanent mips.  Throws if the file cannot be read, holds an array, or the
+	// permanent mips do not fit in the heap's free tiles.
+	UINT Add(const std::wstring& filename);
+
+	ID3D12Resource* Resource(UINT id)const;
+	UINT MipCount(UINT id)const;
+
+	// The finest mip that may be sampled; MipCount until the permanent mips are in.
+	UINT ResidentMip(UINT id)const;
+
+	// Records that mip of the texture was wanted this update.
+	void Request(UINT id, UINT mip);
+
+	// Publishes the mips whose copies have finished, making queue wait for them,
+	// frees the tiles of evicted mips that no frame up to completedFrameFence can
+	// still sample, and maps and queues the uploads the requests call for.  Mips
+	// evicted here are retired with frameFence, the fence of the frame about to be
+	// recorded.  Returns the textures whose ResidentMip changed.  Throws if an
+	// upload failed.
+	std::vector<UINT> Update(ID3D12CommandQueue* queue, UINT64 completedFrameFence, UINT64 frameFence);
+
+	// The heap the tiles come from, for residency tracking.
+	ID3D12Heap* Heap()const;
+
+	UINT TileCount()const;
+	UINT FreeTileCount()const;
+
+	// Mips queued for upload whose copies have not been published by Update yet.
+	UINT LoadingCount()const;
+
+	// Blocks until every queued upload has executed.
+	void WaitIdle();
+
+private:
+	struct Texture
+	{
+		Texture() = default;
+		Texture(const Texture& rhs) = delete;
+		Texture& operator=(const Texture& rhs) = delete;
+		~Texture();
+
+		std::wstring Filename;
+
+		// The file stays mapped; uploads read their texels straight from it.
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+		const std::uint8_t* View = nullptr;
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		D3D12_RESOURCE_DESC Desc = {};
+		std::vector<D3D12_SUBRESOURCE_DATA> Subresources;
+
+		D3D12_PACKED_MIP_INFO PackedMips = {};
+		std::vector<D3D12_SUBRESOURCE_TILING> Tiling;
+
+		// This mip and every coarser one are permanent.
+		UINT BaseMip = 0;
+		UINT MipCount = 0;
+
+		// The heap tiles mapped to each mip; BaseMip's hold all the permanent mips'.
+		std::vector<std::vector<UINT>> MipTiles;
+
+		UINT ResidentMip = 0;
+		// The mip being uploaded, or MipCount.
+		UINT LoadingMip = 0;
+
+		UINT RequestedMip = 0;
+		UINT WantedMip = 0;
+		UINT WantedAge = 0;
+	};
+
+	struct CopyContext
+	{
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CmdList;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Staging;
+		UINT64 StagingSize = 0;
+		UINT64 Fence = 0;
+	};
+
+	struct Upload
+	{
+		UINT Id = 0;
+		UINT Mip = 0;
+		UINT64 Fence = 0;
+		HRESULT Result = S_OK;
+	};
+
+	// Tiles of an evicted mip, free once the graphics queue passes Fence.
+	struct Retired
+	{
+		UINT Id = 0;
+		UINT Mip = 0;
+		std::vector<UINT> Tiles;
+		UINT64 Fence = 0;
+	};
+
+	UINT TilesForMip(const Texture& texture, UINT mip)const;
+	bool AllocateTiles(UINT count, std::vector<UINT>& tiles);
+	void MapTiles(const Texture& texture, UINT mip, const std::vector<UINT>* tiles);
+	bool EvictFor(UINT tiles, UINT64 frameFence, std::vector<UINT>& changed);
+	void QueueUpload(UINT id, UINT mip);
+
+	void Load(UINT id, const Texture& texture, UINT mip);
+	HRESULT Record(CopyContext& context, const Texture& texture, UINT firstMip, UINT mipCount);
+	HRESULT GrowStaging(CopyContext& context, UINT64 size);
+
+	std::unique_ptr<CopyContext> AcquireContext();
+	void ReleaseContext(std::unique_ptr<CopyContext> context);
+
+private:
+	// Mips being uploaded at once, across every texture.
+	static const UINT MaxUploadsInFlight = 4;
+	static const UINT EvictionDelay = 60;
+
+	static const UINT64 MinStagingSize = 4 * 1024 * 1024;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12Heap> mHeap;
+	UINT mTileCount = 0;
+	std::vector<UINT> mFreeTiles;
+	std::vector<Retired> mRetired;
+	UINT mRetiredTileCount = 0;
+
+	// Held by pointer so workers keep a stable reference as textures are added.
+	std::vector<std::unique_ptr<Texture>> mTextures;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	HANDLE mFenceEvent = nullptr;
+
+	concurrency::task_group mTasks;
+
+	// Guards the copy queue, so mappings and copies execute in the order they were
+	// made, and the list of uploads in flight.
+	std::mutex mSubmitMutex;
+	UINT64 mCurrentFence = 0;
+	std::vector<Upload> mUploads;
+
+	std::mutex mContextMutex;
+	std::vector<std::unique_ptr<CopyContext>> mFreeContexts;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "d3dUtil.h"
+#include "UploadWriter.h"
 
 template<typename T>
 class UploadBuffer
@@ -50,11 +51,40 @@ public:
         return mUploadBuffer.Get();
     }
 
+    // One element with plain stores.  Runs of elements go through the streaming
+    // writes below.
     void CopyData(int elementIndex, const T& data)
     {
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // count elements from data into first onwards, streamed.
+    void CopyRange(UINT first, const T* data, UINT count)
+    {
+        Writer(first).Write(data, count);
+    }
+
+    // data[i] into element indices[i], streamed.
+    void CopyScatter(const UINT* indices, const T* data, UINT count)
+    {
+        UploadWriter<T>::Scatter(mMappedData, mElementByteSize, indices, data, count);
+    }
+
+    // Streams elements into first onwards, one after another.
+    UploadWriter<T> Writer(UINT first = 0)
+    {
+        return UploadWriter<T>(mMappedData, mElementByteSize, first);
+    }
+
+    // Writable view of the mapped elements, for filling the whole buffer in one
+    // sequential pass.  Only tightly packed (non-constant) buffers can be viewed
+    // as an array of T.  The memory is write-combined: write it, never read it.
+    T* MappedData()
+    {
+        assert(!mIsConstantBuffer);
+        return reinterpret_cast<T*>(mMappedData);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -0,0 +1,89 @@
+//***************************************************************************************
+// UploadWriter.h
+//
+// Streams elements into mapped upload memory with non-temporal stores, for the
+// bulk writes of UploadBuffer and UploadSlice.  Upload heaps are write-combined:
+// small stores scattered over them, or a struct filled in place field by field,
+// leave partly written lines that go out as several bus transactions, while whole
+// elements streamed in order fill whole lines.
+//
+// A writer fills consecutive elements from where it starts.  Everything it wrote
+// is ordered before any later store once it is destroyed, so the frame that reads
+// the elements is always submitted after they land.  Scatter does the same for
+// elements in any order.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+template<typename T>
+class UploadWriter
+{
+public:
+	// Elements are elementByteSize apart, from element first at base.
+	UploadWriter(BYTE* base, UINT elementByteSize, UINT first) :
+		mNext(base + (UINT64)first*elementByteSize), mElementByteSize(elementByteSize), mIndex(first)
+	{
+	}
+
+	UploadWriter(const UploadWriter& rhs) = delete;
+	UploadWriter& operator=(const UploadWriter& rhs) = delete;
+	UploadWriter(UploadWriter&& rhs) = default;
+
+	~UploadWriter()
+	{
+		d3dUtil::StreamFence();
+	}
+
+	// The element the next write goes to.
+	UINT Index()const
+	{
+		return mIndex;
+	}
+
+	void Write(const T& data)
+	{
+		d3dUtil::StreamCopy(mNext, &data, sizeof(T));
+		mNext += mElementByteSize;
+		++mIndex;
+	}
+
+	// count elements from data.  Tightly packed elements go out as one stream.
+	void Write(const T* data, UINT count)
+	{
+		if(mElementByteSize == sizeof(T))
+		{
+			d3dUtil::StreamCopy(mNext, data, (size_t)count*sizeof(T));
+			mNext += (size_t)count*sizeof(T);
+			mIndex += count;
+			return;
+		}
+
+		for(UINT i = 0; i < count; ++i)
+			Write(data[i]);
+	}
+
+	// Value-initializes the next element in cached memory, has fill set it, then
+	// streams it whole.
+	template<typename Fill>
+	void Emplace(Fill&& fill)
+	{
+		T element = {};
+		fill(element);
+		Write(element);
+	}
+
+	// data[i] into element indices[i] for each of count elements, from base.
+	static void Scatter(BYTE* base, UINT elementByteSize, const UINT* indices, const T* data, UINT count)
+	{
+		for(UINT i = 0; i < count; ++i)
+			d3dUtil::StreamCopy(base + (UINT64)indices[i]*elementByteSize, &data[i], sizeof(T));
+		d3dUtil::StreamFence();
+	}
+
+private:
+	BYTE* mNext = nullptr;
+	UINT mElementByteSize = 0;
+	UINT mIndex = 0;
+};
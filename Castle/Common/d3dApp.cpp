@@ -33,8 +33,15 @@ D3DApp::D3DApp(HINSTANCE hInstance)
 
 D3DApp::~D3DApp()
 {
+	StopSimulationThread();
+
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if(mFrameLatencyWaitableObject != nullptr)
+		CloseHandle(mFrameLatencyWaitableObject);
+	if(mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -63,18 +70,210 @@ void D3DApp::Set4xMsaaState(bool value)
     {
         m4xMsaaState = value;
 
+		// The old back buffers must be idle and released before the swap chain
+		// goes away; OnResize then rebuilds them from scratch.
+		FlushCommandQueue();
+		for(int i = 0; i < SwapChainBufferCount; ++i)
+			mSwapChainBuffer[i].Reset();
+
         // Recreate the swapchain and buffers with new multisample settings.
-        CreateSwapChain();
+		if(!mHeadless)
+			CreateSwapChain();
         OnResize();
     }
 }
 
+UINT D3DApp::GetMaxFrameLatency()const
+{
+	return mMaxFrameLatency;
+}
+
+void D3DApp::SetMaxFrameLatency(UINT frames)
+{
+	// DXGI accepts 1 to 16 queued frames.
+	mMaxFrameLatency = std::max(1u, std::min(frames, 16u));
+
+	// Takes effect immediately once the swap chain exists.
+	if(mSwapChain != nullptr && mFrameLatencyWaitable)
+	{
+		ComPtr<IDXGISwapChain2> swapChain2;
+		ThrowIfFailed(mSwapChain.As(&swapChain2));
+		ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+	}
+}
+
+bool D3DApp::GetPipelined()const
+{
+	return mPipelined;
+}
+
+void D3DApp::SetPipelined(bool value)
+{
+	mPipelined = value;
+}
+
+bool D3DApp::GetRenderOnDemand()const
+{
+	return mRenderOnDemand;
+}
+
+void D3DApp::SetRenderOnDemand(bool value)
+{
+	mRenderOnDemand = value;
+	RequestFrames();
+}
+
+void D3DApp::SetMinimumFrameRate(double framesPerSecond)
+{
+	mMinimumFrameRate = std::max(framesPerSecond, 0.0);
+}
+
+void D3DApp::RequestFrames(UINT count)
+{
+	mFramesRequested = std::max(mFramesRequested, count);
+}
+
+bool D3DApp::FrameDue()
+{
+	if(mFramesRequested > 0 || FrameNeeded())
+		return true;
+
+	return IdleTimeout() == 0;
+}
+
+DWORD D3DApp::IdleTimeout()const
+{
+	if(mMinimumFrameRate <= 0.0)
+		return INFINITE;
+
+	__int64 freq, now;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+	QueryPerformanceCounter((LARGE_INTEGER*)&now);
+
+	__int64 target = mLastFrameTime + (__int64)(freq / mMinimumFrameRate);
+	return now < target ? (DWORD)((target - now) * 1000 / freq) : 0;
+}
+
+PresentMode D3DApp::GetPresentMode()const
+{
+	return mPresentMode;
+}
+
+void D3DApp::SetPresentMode(PresentMode mode)
+{
+	// The swap chain always carries ALLOW_TEARING when the system supports it,
+	// so switching modes only changes the Present arguments.
+	mPresentMode = mode;
+	mLastPresentTime = 0;
+}
+
+bool D3DApp::TearingSupported()const
+{
+	return mTearingSupported;
+}
+
+void D3DApp::SetAdapterPreference(DXGI_GPU_PREFERENCE preference)
+{
+	mAdapterPreference = preference;
+}
+
+void D3DApp::SetAdapterName(const std::wstring& name)
+{
+	mAdapterName = name;
+}
+
+const DeviceCaps& D3DApp::Caps()const
+{
+	return mCaps;
+}
+
+void D3DApp::Present()
+{
+	// Nothing to show; the frame is finished once it is submitted.
+	if(mHeadless)
+		return;
+
+	if(mPresentMode == PresentMode::Vsync)
+	{
+		ThrowIfFailed(mSwapChain->Present(1, 0));
+		return;
+	}
+
+	if(mPresentMode == PresentMode::VariableRefresh)
+	{
+		// Cap a few Hz below the refresh rate.  Above the VRR window the display
+		// falls back to vsync (or tears), which is what VRR is meant to avoid.
+		__int64 freq, now;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+		QueryPerformanceCounter((LARGE_INTEGER*)&now);
+
+		double minInterval = 1.0 / std::max(mRefreshRate - 3.0, 30.0);
+		__int64 target = mLastPresentTime + (__int64)(minInterval * freq);
+		if(mLastPresentTime != 0 && now < target)
+		{
+			DWORD ms = (DWORD)((target - now) * 1000 / freq);
+			if(ms > 1)
+				Sleep(ms - 1);
+			do
+			{
+				YieldProcessor();
+				QueryPerformanceCounter((LARGE_INTEGER*)&now);
+			} while(now < target);
+		}
+		mLastPresentTime = now;
+	}
+
+	// Tearing is not allowed in exclusive fullscreen; flip-model windowed and
+	// borderless fullscreen present straight to the display instead.
+	UINT flags = 0;
+	if(mTearingSupported)
+	{
+		BOOL fullscreen = FALSE;
+		mSwapChain->GetFullscreenState(&fullscreen, nullptr);
+		if(!fullscreen)
+			flags = DXGI_PRESENT_ALLOW_TEARING;
+	}
+
+	ThrowIfFailed(mSwapChain->Present(0, flags));
+}
+
+double D3DApp::QueryRefreshRate()const
+{
+	ComPtr<IDXGIOutput> output;
+	if(mSwapChain == nullptr || FAILED(mSwapChain->GetContainingOutput(&output)))
+		return 60.0;
+
+	DXGI_OUTPUT_DESC desc;
+	ThrowIfFailed(output->GetDesc(&desc));
+
+	DEVMODEW mode = {};
+	mode.dmSize = sizeof(DEVMODEW);
+	if(!EnumDisplaySettingsW(desc.DeviceName, ENUM_CURRENT_SETTINGS, &mode) ||
+		mode.dmDisplayFrequency <= 1)
+		return 60.0;
+
+	return (double)mode.dmDisplayFrequency;
+}
+
 int D3DApp::Run()
 {
 	MSG msg = {0};
  
 	mTimer.Reset();
 
+	// However the loop ends, a DxException from Update or Draw included, the
+	// simulation thread is joined before the derived app that it simulates is
+	// destroyed.
+	struct SimulationThreadGuard
+	{
+		D3DApp* App;
+		~SimulationThreadGuard() { App->StopSimulationThread(); }
+	} simulationThreadGuard = { this };
+
+#if ALLOCATION_TRACKER_ENABLED
+	AllocationTracker::Install(AllocationWarmupFrames);
+#endif
+
 	while(msg.message != WM_QUIT)
 	{
 		// If there are Window messages then process them.
@@ -86,13 +285,76 @@ int D3DApp::Run()
 		// Otherwise, do animation/game stuff.
 		else
         {	
+			// On demand with nothing to draw, sleep until a message arrives or the
+			// minimum rate calls for a frame.  Without a minimum rate the clock stops
+			// too, so the time spent idle does not come out as one long frame.
+			if(mRenderOnDemand && !mAppPaused && !mHeadless && !FrameDue())
+			{
+				if(!mIdle && mMinimumFrameRate <= 0.0)
+					mTimer.Stop();
+				mIdle = true;
+
+				MsgWaitForMultipleObjectsEx(0, nullptr, IdleTimeout(), QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+				continue;
+			}
+			if(mIdle)
+			{
+				mIdle = false;
+				if(!mAppPaused)
+					mTimer.Start();
+			}
+
 			mTimer.Tick();
 
-			if( !mAppPaused )
+			// A hidden headless window can still be deactivated; keep running.
+			if( !mAppPaused || mHeadless )
 			{
+				PROFILE_SCOPE("Frame");
+
 				CalculateFrameStats();
-				Update(mTimer);	
-                Draw(mTimer);
+
+				// Pipelined, the next frame simulates while this one records, and its
+				// results are published once both are done.  Otherwise this frame's
+				// simulation comes first.
+				if(mPipelined)
+				{
+					StartSimulation();
+				}
+				else
+				{
+					PROFILE_SCOPE("Simulate");
+					SimulateFrame(mTimer);
+					mSimulationSteps.Publish();
+					PublishSimulation();
+				}
+
+				WaitForFrameLatency();
+				{
+					PROFILE_SCOPE("Update");
+					CHECK_ALLOCATIONS_SCOPE("Update");
+					Update(mTimer);
+				}
+				{
+					PROFILE_SCOPE("Draw");
+					CHECK_ALLOCATIONS_SCOPE("Draw");
+					Draw(mTimer);
+				}
+
+				if(mPipelined)
+				{
+					PROFILE_WAIT_SCOPE("FinishSimulation");
+					FinishSimulation();
+					mSimulationSteps.Publish();
+					PublishSimulation();
+				}
+
+				if(mFramesRequested > 0)
+					--mFramesRequested;
+				QueryPerformanceCounter((LARGE_INTEGER*)&mLastFrameTime);
+
+#if ALLOCATION_TRACKER_ENABLED
+				AllocationTracker::EndFrame();
+#endif
 			}
 			else
 			{
@@ -104,6 +366,91 @@ int D3DApp::Run()
 	return (int)msg.wParam;
 }
 
+void D3DApp::SimulateFrame(const GameTimer& gt)
+{
+	Simulate(gt);
+	mSimulationSteps.Advance(gt.DeltaTime());
+}
+
+void D3DApp::StartSimulation()
+{
+	if(!mSimulationThread.joinable())
+		mSimulationThread = std::thread(&D3DApp::SimulationThreadMain, this);
+
+	{
+		std::lock_guard<std::mutex> lock(mSimulationMutex);
+		mSimulationTimer = mTimer;
+		mSimulationRequested = true;
+		mSimulationBusy = true;
+	}
+	mSimulationWake.notify_all();
+}
+
+void D3DApp::FinishSimulation()
+{
+	std::unique_lock<std::mutex> lock(mSimulationMutex);
+	mSimulationWake.wait(lock, [this]() { return !mSimulationBusy; });
+
+	if(mSimulationError != nullptr)
+	{
+		std::exception_ptr error = mSimulationError;
+		mSimulationError = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void D3DApp::StopSimulationThread()
+{
+	if(!mSimulationThread.joinable())
+		return;
+
+	// A frame being simulated finishes first; its result is dropped.
+	{
+		std::lock_guard<std::mutex> lock(mSimulationMutex);
+		mSimulationExit = true;
+	}
+	mSimulationWake.notify_all();
+	mSimulationThread.join();
+
+	std::lock_guard<std::mutex> lock(mSimulationMutex);
+	mSimulationExit = false;
+	mSimulationRequested = false;
+	mSimulationBusy = false;
+	mSimulationError = nullptr;
+}
+
+void D3DApp::SimulationThreadMain()
+{
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mSimulationMutex);
+			mSimulationWake.wait(lock, [this]() { return mSimulationRequested || mSimulationExit; });
+			if(mSimulationExit)
+				return;
+			mSimulationRequested = false;
+		}
+
+		std::exception_ptr error;
+		try
+		{
+			PROFILE_SCOPE("Simulate");
+			SimulateFrame(mSimulationTimer);
+		}
+		catch(...)
+		{
+			error = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mSimulationMutex);
+			mSimulationError = error;
+			mSimulationBusy = false;
+		}
+		mSimulationWake.notify_all();
+	}
+}
+
 bool D3DApp::Initialize()
 {
 	if(!InitMainWindow())
@@ -141,9 +488,21 @@ void D3DApp::CreateRtvAndDsvDescriptorHeaps()
 void D3DApp::OnResize()
 {
 	assert(md3dDevice);
-	assert(mSwapChain);
+	assert(mSwapChain || mHeadless);
     assert(mDirectCmdListAlloc);
 
+	// The window may have moved to another monitor.
+	mRefreshRate = QueryRefreshRate();
+
+	// WM_EXITSIZEMOVE and restore-from-minimize often arrive with an unchanged
+	// client area.  Skip the GPU stall and buffer rebuild in that case.
+	if(mSwapChainBuffer[0] != nullptr)
+	{
+		D3D12_RESOURCE_DESC backBufferDesc = mSwapChainBuffer[0]->GetDesc();
+		if(backBufferDesc.Width == (UINT64)mClientWidth && backBufferDesc.Height == (UINT)mClientHeight)
+			return;
+	}
+
 	// Flush before changing any resources.
 	FlushCommandQueue();
 
@@ -155,18 +514,41 @@ void D3DApp::OnResize()
     mDepthStencilBuffer.Reset();
 	
 	// Resize the swap chain.
-    ThrowIfFailed(mSwapChain->ResizeBuffers(
-		SwapChainBufferCount, 
-		mClientWidth, mClientHeight, 
-		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+	if(!mHeadless)
+	{
+		ThrowIfFailed(mSwapChain->ResizeBuffers(
+			SwapChainBufferCount, 
+			mClientWidth, mClientHeight, 
+			mBackBufferFormat, 
+			mSwapChainFlags));
+	}
 
 	mCurrBackBuffer = 0;
  
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHeapHandle(mRtvHeap->GetCPUDescriptorHandleForHeapStart());
 	for (UINT i = 0; i < SwapChainBufferCount; i++)
 	{
-		ThrowIfFailed(mSwapChain->GetBuffer(i, IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		if(mHeadless)
+		{
+			// Stand-ins for the swap chain buffers.  COMMON is the same state as
+			// PRESENT, so the usual back buffer barriers apply unchanged.
+			CD3DX12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Tex2D(mBackBufferFormat,
+				mClientWidth, mClientHeight, 1, 1,
+				m4xMsaaState ? 4 : 1, m4xMsaaState ? (m4xMsaaQuality - 1) : 0,
+				D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+
+			ThrowIfFailed(md3dDevice->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&desc,
+				D3D12_RESOURCE_STATE_COMMON,
+				nullptr,
+				IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		}
+		else
+		{
+			ThrowIfFailed(mSwapChain->GetBuffer(i, IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		}
 		md3dDevice->CreateRenderTargetView(mSwapChainBuffer[i].Get(), nullptr, rtvHeapHandle);
 		rtvHeapHandle.Offset(1, mRtvDescriptorSize);
 	}
@@ -236,6 +618,32 @@ void D3DApp::OnResize()
  
 LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
+	// When rendering on demand, input and changes to the window are what call for
+	// new frames.  The mouse only moves the view while a button is held.
+	switch( msg )
+	{
+	case WM_ACTIVATE:
+	case WM_SIZE:
+	case WM_EXITSIZEMOVE:
+	case WM_PAINT:
+	case WM_DISPLAYCHANGE:
+	case WM_LBUTTONDOWN:
+	case WM_MBUTTONDOWN:
+	case WM_RBUTTONDOWN:
+	case WM_LBUTTONUP:
+	case WM_MBUTTONUP:
+	case WM_RBUTTONUP:
+	case WM_MOUSEWHEEL:
+	case WM_KEYDOWN:
+	case WM_KEYUP:
+		RequestFrames();
+		break;
+	case WM_MOUSEMOVE:
+		if(wParam & (MK_LBUTTON | MK_MBUTTON | MK_RBUTTON))
+			RequestFrames();
+		break;
+	}
+
 	switch( msg )
 	{
 	// WM_ACTIVATE is sent when the window is activated or deactivated.  
@@ -364,6 +772,8 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         }
         else if((int)wParam == VK_F2)
             Set4xMsaaState(!m4xMsaaState);
+        else
+            OnKeyUp(wParam);
 
         return 0;
 	}
@@ -405,7 +815,7 @@ bool D3DApp::InitMainWindow()
 		return false;
 	}
 
-	ShowWindow(mhMainWnd, SW_SHOW);
+	ShowWindow(mhMainWnd, mHeadless ? SW_HIDE : SW_SHOW);
 	UpdateWindow(mhMainWnd);
 
 	return true;
@@ -424,38 +834,47 @@ bool D3DApp::InitDirect3D()
 
 	ThrowIfFailed(CreateDXGIFactory1(IID_PPV_ARGS(&mdxgiFactory)));
 
-	//Hooman: I added this code to take advantage of your "stronger" GPU. 
-	//In the lab, seond graphics card NVDIA is much stronger, that would stop blinking!
-	UINT i = 0;
-	IDXGIAdapter* adapter = nullptr;
-	std::vector<IDXGIAdapter*> adapterList;
-	while (mdxgiFactory->EnumAdapters(i, &adapter) != DXGI_ERROR_NOT_FOUND)
+	// Tearing presents need a DXGI 1.5 factory and OS/driver support.
+	ComPtr<IDXGIFactory5> factory5;
+	if(SUCCEEDED(mdxgiFactory.As(&factory5)))
 	{
-		adapterList.push_back(adapter);
-		++i;
+		BOOL allowTearing = FALSE;
+		if(SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING,
+			&allowTearing, sizeof(allowTearing))))
+			mTearingSupported = allowTearing == TRUE;
 	}
-	// Try to create hardware device.
-	HRESULT hardwareResult = D3D12CreateDevice(
-		//nullptr,             // default adapter
-		adapterList[0],          //NVDIA adapter! at home, you can comment this out and use nullptr to point to a stronger adapter
-		D3D_FEATURE_LEVEL_11_0,
-		IID_PPV_ARGS(&md3dDevice));
 
+	// On hybrid machines the default adapter is often the integrated GPU, so take the
+	// one DXGI ranks first for the preference.
+	ComPtr<IDXGIAdapter1> adapter = SelectAdapter(mdxgiFactory.Get(), mAdapterPreference, mAdapterName);
+
+	// Try to create hardware device.
+	HRESULT hardwareResult = adapter != nullptr ?
+		D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&md3dDevice)) :
+		DXGI_ERROR_NOT_FOUND;
 
 	// Fallback to WARP device.
 	if(FAILED(hardwareResult))
 	{
-		ComPtr<IDXGIAdapter> pWarpAdapter;
-		ThrowIfFailed(mdxgiFactory->EnumWarpAdapter(IID_PPV_ARGS(&pWarpAdapter)));
+		ThrowIfFailed(mdxgiFactory->EnumWarpAdapter(IID_PPV_ARGS(adapter.ReleaseAndGetAddressOf())));
 
 		ThrowIfFailed(D3D12CreateDevice(
-			pWarpAdapter.Get(),
+			adapter.Get(),
 			D3D_FEATURE_LEVEL_11_0,
 			IID_PPV_ARGS(&md3dDevice)));
 	}
 
+	mCaps = QueryDeviceCaps(md3dDevice.Get(), adapter.Get());
+	OutputDebugString(mCaps.Report().c_str());
+
 	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
 		IID_PPV_ARGS(&mFence)));
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
+		IID_PPV_ARGS(&mComputeFence)));
+
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
 
 	mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
@@ -483,7 +902,8 @@ bool D3DApp::InitDirect3D()
 #endif
 
 	CreateCommandObjects();
-    CreateSwapChain();
+	if(!mHeadless)
+		CreateSwapChain();
     CreateRtvAndDsvDescriptorHeaps();
 
 	return true;
@@ -498,6 +918,9 @@ void D3DApp::CreateCommandObjects()
 	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
 	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCommandQueue)));
 
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mComputeQueue)));
+
 	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(mDirectCmdListAlloc.GetAddressOf())));
@@ -518,34 +941,60 @@ void D3DApp::CreateCommandObjects()
 void D3DApp::CreateSwapChain()
 {
     // Release the previous swapchain we will be recreating.
+	if(mFrameLatencyWaitableObject != nullptr)
+	{
+		CloseHandle(mFrameLatencyWaitableObject);
+		mFrameLatencyWaitableObject = nullptr;
+	}
     mSwapChain.Reset();
 
-    DXGI_SWAP_CHAIN_DESC sd;
-    sd.BufferDesc.Width = mClientWidth;
-    sd.BufferDesc.Height = mClientHeight;
-    sd.BufferDesc.RefreshRate.Numerator = 60;
-    sd.BufferDesc.RefreshRate.Denominator = 1;
-    sd.BufferDesc.Format = mBackBufferFormat;
-    sd.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-    sd.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+	mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+	if(mFrameLatencyWaitable)
+		mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	if(mTearingSupported)
+		mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
+    DXGI_SWAP_CHAIN_DESC1 sd;
+    sd.Width = mClientWidth;
+    sd.Height = mClientHeight;
+    sd.Format = mBackBufferFormat;
+    sd.Stereo = FALSE;
     sd.SampleDesc.Count = m4xMsaaState ? 4 : 1;
     sd.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
     sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
     sd.BufferCount = SwapChainBufferCount;
-    sd.OutputWindow = mhMainWnd;
-    sd.Windowed = true;
+    sd.Scaling = DXGI_SCALING_STRETCH;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+    sd.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+    sd.Flags = mSwapChainFlags;
 
 	// Note: Swap chain uses queue to perform flush.
-    ThrowIfFailed(mdxgiFactory->CreateSwapChain(
+	ComPtr<IDXGISwapChain1> swapChain1;
+    ThrowIfFailed(mdxgiFactory->CreateSwapChainForHwnd(
 		mCommandQueue.Get(),
-		&sd, 
-		mSwapChain.GetAddressOf()));
+		mhMainWnd,
+		&sd,
+		nullptr,
+		nullptr,
+		swapChain1.GetAddressOf()));
+	ThrowIfFailed(swapChain1.As(&mSwapChain));
+
+	mRefreshRate = QueryRefreshRate();
+
+	if(mFrameLatencyWaitable)
+	{
+		ComPtr<IDXGISwapChain2> swapChain2;
+		ThrowIfFailed(mSwapChain.As(&swapChain2));
+		ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+		mFrameLatencyWaitableObject = swapChain2->GetFrameLatencyWaitableObject();
+	}
 }
 
 void D3DApp::FlushCommandQueue()
 {
+	// Put everything on the compute queue ahead of the fence below.
+	GraphicsWaitForCompute(SignalCompute());
+
 	// Advance the fence value to mark commands up to this fence point.
     mCurrentFence++;
 
@@ -555,16 +1004,46 @@ void D3DApp::FlushCommandQueue()
     ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
 
 	// Wait until the GPU has completed commands up to this fence point.
-    if(mFence->GetCompletedValue() < mCurrentFence)
+	WaitForFence(mCurrentFence);
+}
+
+void D3DApp::WaitForFence(UINT64 fenceValue)
+{
+    if(mFence->GetCompletedValue() < fenceValue)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		PROFILE_WAIT_SCOPE("WaitForFence");
 
-        // Fire event when GPU hits current fence.  
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+        // Fire event when GPU hits the fence.  
+        ThrowIfFailed(mFence->SetEventOnCompletion(fenceValue, mFenceEvent));
 
-        // Wait until the GPU hits current fence event is fired.
-		WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+        // Wait until the GPU hits the fence and the event is fired.
+		WaitForSingleObject(mFenceEvent, INFINITE);
+	}
+}
+
+UINT64 D3DApp::SignalCompute()
+{
+	ThrowIfFailed(mComputeQueue->Signal(mComputeFence.Get(), ++mCurrentComputeFence));
+	return mCurrentComputeFence;
+}
+
+void D3DApp::GraphicsWaitForCompute(UINT64 computeFenceValue)
+{
+	ThrowIfFailed(mCommandQueue->Wait(mComputeFence.Get(), computeFenceValue));
+}
+
+void D3DApp::ComputeWaitForGraphics(UINT64 fenceValue)
+{
+	ThrowIfFailed(mComputeQueue->Wait(mFence.Get(), fenceValue));
+}
+
+void D3DApp::WaitForFrameLatency()
+{
+	// Time out rather than hang if presentation stalls (e.g., a lost device).
+	if(mFrameLatencyWaitableObject != nullptr)
+	{
+		PROFILE_WAIT_SCOPE("WaitForFrameLatency");
+		WaitForSingleObjectEx(mFrameLatencyWaitableObject, 1000, true);
 	}
 }
 
@@ -605,14 +1084,19 @@ void D3DApp::CalculateFrameStats()
 		float fps = (float)frameCnt; // fps = frameCnt / 1
 		float mspf = 1000.0f / fps;
 
-        wstring fpsStr = to_wstring(fps);
-        wstring mspfStr = to_wstring(mspf);
+		wchar_t text[128];
+#if ALLOCATION_TRACKER_ENABLED
+		swprintf_s(text, L"    fps: %f   mspf: %f   allocs: %u", fps, mspf,
+			AllocationTracker::LastFrameAllocations());
+#else
+		swprintf_s(text, L"    fps: %f   mspf: %f", fps, mspf);
+#endif
 
-        wstring windowText = mMainWndCaption +
-            L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+		mCaptionText.assign(mMainWndCaption);
+		mCaptionText.append(text);
+		mCaptionText.append(FrameStatsText());
 
-        SetWindowText(mhMainWnd, windowText.c_str());
+        SetWindowText(mhMainWnd, mCaptionText.c_str());
 		
 		// Reset for next average.
 		frameCnt = 0;
@@ -9,12 +9,31 @@
 
 #include "d3dUtil.h"
 #include "GameTimer.h"
+#include "FixedStepScheduler.h"
+#include "CpuProfiler.h"
+#include "AllocationTracker.h"
+#include "DeviceCaps.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 #pragma comment(lib, "dxgi.lib")
 
+// How finished frames are handed to the flip-model swap chain.
+//   Vsync           - wait for vertical blank; never tears.
+//   Immediate       - present as soon as the frame is done; tears when supported.
+//   VariableRefresh - tearing-allowed present paced just under the refresh rate
+//                     so a G-Sync/FreeSync display stays inside its VRR window.
+enum class PresentMode
+{
+	Vsync,
+	Immediate,
+	VariableRefresh
+};
+
 class D3DApp
 {
 protected:
@@ -35,6 +54,37 @@ public:
     bool Get4xMsaaState()const;
     void Set4xMsaaState(bool value);
 
+	// Number of frames DXGI lets the app queue ahead of the display when the swap
+	// chain is frame-latency waitable.  Lower values reduce input latency.
+	UINT GetMaxFrameLatency()const;
+	void SetMaxFrameLatency(UINT frames);
+
+	PresentMode GetPresentMode()const;
+	void SetPresentMode(PresentMode mode);
+	bool TearingSupported()const;
+
+	// Pipelined frames run Simulate for the next frame on a thread of its own while
+	// Update and Draw record this one, rather than all three back to back.  Set
+	// before Run.
+	bool GetPipelined()const;
+	void SetPipelined(bool value);
+
+	// On demand, Run draws a frame only when input, a change to the window or
+	// FrameNeeded calls for one, and otherwise sleeps on the message queue.  A minimum
+	// frame rate above 0 also draws at least that often; at 0 the timer stops while
+	// idle, so time-driven animation picks up where it left off.
+	bool GetRenderOnDemand()const;
+	void SetRenderOnDemand(bool value);
+	void SetMinimumFrameRate(double framesPerSecond);
+
+	// Which GPU InitDirect3D creates the device on: the first by preference, or the
+	// first whose description contains name if that is set.  Set before Initialize.
+	void SetAdapterPreference(DXGI_GPU_PREFERENCE preference);
+	void SetAdapterName(const std::wstring& name);
+
+	// What the device supports, for choosing between a fast path and its fallback.
+	const DeviceCaps& Caps()const;
+
 	int Run();
  
     virtual bool Initialize();
@@ -46,11 +96,26 @@ protected:
 	virtual void Update(const GameTimer& gt)=0;
     virtual void Draw(const GameTimer& gt)=0;
 
+	// The part of a frame that only advances simulation state, kept apart from what
+	// Update and Draw read until PublishSimulation.  When pipelined it runs on the
+	// simulation thread, concurrently with Update and Draw of the previous frame;
+	// PublishSimulation runs on the main thread with neither stage busy.  The steps
+	// of mSimulationSteps run in the same stage, right after Simulate.
+	virtual void Simulate(const GameTimer& gt){ }
+	virtual void PublishSimulation(){ }
+
 	// Convenience overrides for handling mouse input.
 	virtual void OnMouseDown(WPARAM btnState, int x, int y){ }
 	virtual void OnMouseUp(WPARAM btnState, int x, int y)  { }
 	virtual void OnMouseMove(WPARAM btnState, int x, int y){ }
 
+	// Called on key release for keys the framework does not handle itself (Esc, F2).
+	virtual void OnKeyUp(WPARAM vkeyCode){ }
+
+	// Whether something no window message announces, such as content still streaming
+	// in, calls for another frame when rendering on demand.
+	virtual bool FrameNeeded(){ return false; }
+
 protected:
 
 	bool InitMainWindow();
@@ -58,14 +123,63 @@ protected:
 	void CreateCommandObjects();
     void CreateSwapChain();
 
+	// Waits for both queues to drain.
 	void FlushCommandQueue();
 
+	// Blocks until the GPU has reached fenceValue on mFence.
+	void WaitForFence(UINT64 fenceValue);
+
+	// Work submitted to mComputeQueue runs alongside the direct queue; these order the
+	// two on the GPU timeline without blocking the CPU.  SignalCompute marks the
+	// compute work submitted so far and returns its value on mComputeFence.
+	UINT64 SignalCompute();
+
+	// Holds back direct queue work submitted after the call until the compute queue
+	// has reached computeFenceValue.
+	void GraphicsWaitForCompute(UINT64 computeFenceValue);
+
+	// Holds back compute queue work submitted after the call until the direct queue
+	// has reached fenceValue on mFence.
+	void ComputeWaitForGraphics(UINT64 fenceValue);
+
+	// Blocks until the swap chain is ready to accept another frame.  Called before
+	// Update so input is sampled as late as possible.
+	void WaitForFrameLatency();
+
+	// Presents the current back buffer according to mPresentMode.
+	void Present();
+
+	// Has the next count frames drawn when rendering on demand.
+	void RequestFrames(UINT count = OnDemandSettleFrames);
+
+	// Whether Run should draw now rather than wait when rendering on demand, and the
+	// longest it may wait for a message if not.
+	bool FrameDue();
+	DWORD IdleTimeout()const;
+
+	// Simulate, then the steps of mSimulationSteps due in the frame's time.
+	void SimulateFrame(const GameTimer& gt);
+
+	// Hand the simulation thread the next frame, and wait for it to finish.
+	void StartSimulation();
+	void FinishSimulation();
+	void SimulationThreadMain();
+
+	// Waits for the frame being simulated, if any, then joins the thread.
+	void StopSimulationThread();
+
+	// Refresh rate of the output the swap chain is on, or 60 if unknown.
+	double QueryRefreshRate()const;
+
 	ID3D12Resource* CurrentBackBuffer()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView()const;
 
 	void CalculateFrameStats();
 
+	// Extra text appended to the frame stats in the window caption.
+	virtual std::wstring FrameStatsText()const { return L""; }
+
     void LogAdapters();
     void LogAdapterOutputs(IDXGIAdapter* adapter);
     void LogOutputDisplayModes(IDXGIOutput* output, DXGI_FORMAT format);
@@ -95,8 +209,21 @@ protected:
 
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
     UINT64 mCurrentFence = 0;
+
+	// Reused for every CPU wait on mFence.
+	HANDLE mFenceEvent = nullptr;
+
+	// Signaled by mComputeQueue only.  The CPU never waits on it directly: the direct
+	// queue waits on it first, so reaching mFence implies it too.
+	Microsoft::WRL::ComPtr<ID3D12Fence> mComputeFence;
+	UINT64 mCurrentComputeFence = 0;
+
+	// Signaled by DXGI when a queued frame has been presented.
+	HANDLE mFrameLatencyWaitableObject = nullptr;
+	UINT mSwapChainFlags = 0;
 	
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mComputeQueue;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
 
@@ -122,5 +249,58 @@ protected:
     DXGI_FORMAT mDepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	int mClientWidth = 800;
 	int mClientHeight = 600;
+
+	// Render into offscreen textures with no swap chain and a hidden window, for
+	// benchmarks.  Must be set before Initialize.
+	bool mHeadless = false;
+	bool mFrameLatencyWaitable = true;
+	UINT mMaxFrameLatency = 1;
+	// Presenting without waiting for vertical blank, as the samples always have.
+	PresentMode mPresentMode = PresentMode::Immediate;
+
+	// DXGI_FEATURE_PRESENT_ALLOW_TEARING as reported by the factory.
+	bool mTearingSupported = false;
+
+	DXGI_GPU_PREFERENCE mAdapterPreference = DXGI_GPU_PREFERENCE_HIGH_PERFORMANCE;
+	std::wstring mAdapterName;
+	DeviceCaps mCaps;
+
+	// Used to pace PresentMode::VariableRefresh.
+	double mRefreshRate = 60.0;
+	__int64 mLastPresentTime = 0;
+
+	bool mPipelined = false;
+
+	// Systems the simulation stage steps at fixed rates, after Simulate, in the
+	// frame's game time; published along with PublishSimulation.  Time the clock is
+	// stopped, paused or idle on demand, is never made up.
+	FixedStepScheduler mSimulationSteps;
+
+	// A change is drawn for a few frames rather than one, so what lags the view by a
+	// frame or two (pipelined simulation, occlusion, temporal filters) catches up.
+	static const UINT OnDemandSettleFrames = 3;
+	bool mRenderOnDemand = false;
+	double mMinimumFrameRate = 0.0;
+	UINT mFramesRequested = 0;
+	__int64 mLastFrameTime = 0;
+	bool mIdle = false;
+
+	// Frames allowed to allocate freely in Update and Draw while the app's containers
+	// and arenas grow, before the allocation tracker flags allocations there.
+	static const UINT AllocationWarmupFrames = 120;
+
+	// Rebuilt once a second; kept so the caption's capacity is reused.
+	std::wstring mCaptionText;
+
+	// Started by the first pipelined frame.  mSimulationMutex guards the flags and
+	// mSimulationError; mSimulationTimer is the main timer as of StartSimulation.
+	std::thread mSimulationThread;
+	std::mutex mSimulationMutex;
+	std::condition_variable mSimulationWake;
+	bool mSimulationRequested = false;
+	bool mSimulationBusy = false;
+	bool mSimulationExit = false;
+	std::exception_ptr mSimulationError;
+	GameTimer mSimulationTimer;
 };
 
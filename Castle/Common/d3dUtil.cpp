@@ -2,6 +2,7 @@
 #include "d3dUtil.h"
 #include <comdef.h>
 #include <fstream>
+#include <emmintrin.h>
 
 using Microsoft::WRL::ComPtr;
 
@@ -35,6 +36,55 @@ ComPtr<ID3DBlob> d3dUtil::LoadBinary(const std::wstring& filename)
     return blob;
 }
 
+UINT64 d3dUtil::HashBytes(const void* data, size_t byteSize, UINT64 seed)
+{
+	const BYTE* bytes = reinterpret_cast<const BYTE*>(data);
+
+	UINT64 hash = seed;
+	for(size_t i = 0; i < byteSize; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+void d3dUtil::StreamCopy(void* dst, const void* src, size_t byteSize)
+{
+	BYTE* out = reinterpret_cast<BYTE*>(dst);
+	const BYTE* in = reinterpret_cast<const BYTE*>(src);
+
+	// Plain stores up to the first 16 byte boundary, where the streaming stores can start.
+	size_t head = std::min(byteSize, (size_t)(0 - (uintptr_t)out) & 15);
+	memcpy(out, in, head);
+	out += head;
+	in += head;
+	byteSize -= head;
+
+	// Four stores per iteration, a whole 64 byte line when the output is line aligned.
+	for(; byteSize >= 64; byteSize -= 64, in += 64, out += 64)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 32));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 48));
+		_mm_stream_si128(reinterpret_cast<__m128i*>(out), a);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(out + 16), b);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(out + 32), c);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(out + 48), d);
+	}
+	for(; byteSize >= 16; byteSize -= 16, in += 16, out += 16)
+		_mm_stream_si128(reinterpret_cast<__m128i*>(out), _mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+
+	memcpy(out, in, byteSize);
+}
+
+void d3dUtil::StreamFence()
+{
+	_mm_sfence();
+}
+
 Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     ID3D12Device* device,
     ID3D12GraphicsCommandList* cmdList,
@@ -4,7 +4,7 @@
 
 #include <windows.h>
 #include <wrl.h>
-#include <dxgi1_4.h>
+#include <dxgi1_6.h>
 #include <d3d12.h>
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
@@ -110,6 +110,16 @@ public:
 
     static Microsoft::WRL::ComPtr<ID3DBlob> LoadBinary(const std::wstring& filename);
 
+	// 64-bit FNV-1a.  Pass a previous result as the seed to hash several ranges as one.
+	static UINT64 HashBytes(const void* data, size_t byteSize, UINT64 seed = 14695981039346656037ull);
+
+	// Copies into mapped upload memory with non-temporal stores, which fill whole
+	// write-combining lines without reading them and bypass the cache where the heap
+	// is cached.  They are weakly ordered: StreamFence orders them before every
+	// store after it, such as whatever tells the GPU to read them.
+	static void StreamCopy(void* dst, const void* src, size_t byteSize);
+	static void StreamFence();
+
     static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
         ID3D12Device* device,
         ID3D12GraphicsCommandList* cmdList,
@@ -172,9 +182,23 @@ struct MeshGeometry
     // Data about the buffers.
 	UINT VertexByteStride = 0;
 	UINT VertexBufferByteSize = 0;
+
 	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
 	UINT IndexBufferByteSize = 0;
 
+	// Application defined id of the vertex layout, which picks the input layout and
+	// vertex shader the geometry is drawn with.
+	UINT VertexFormat = 0;
+
+	// Quantized positions decode as PositionBias + stored*PositionScale.
+	DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+
+	// Byte offsets of the vertices and indices within VertexBufferGPU and
+	// IndexBufferGPU, for buffers that are slices of a larger resource.
+	UINT64 VertexBufferOffset = 0;
+	UINT64 IndexBufferOffset = 0;
+
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
 	// Use this container to define the Submesh geometries so we can draw
 	// the Submeshes individually.
@@ -183,7 +207,7 @@ struct MeshGeometry
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 	{
 		D3D12_VERTEX_BUFFER_VIEW vbv;
-		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
+		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress() + VertexBufferOffset;
 		vbv.StrideInBytes = VertexByteStride;
 		vbv.SizeInBytes = VertexBufferByteSize;
 
@@ -193,7 +217,7 @@ struct MeshGeometry
 	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
 	{
 		D3D12_INDEX_BUFFER_VIEW ibv;
-		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
+		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress() + IndexBufferOffset;
 		ibv.Format = IndexFormat;
 		ibv.SizeInBytes = IndexBufferByteSize;
 
@@ -228,6 +252,15 @@ struct MaterialConstants
 
 	// Used in texture mapping.
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	// Descriptor heap index of the diffuse map, for shaders built with BINDLESS.
+	UINT DiffuseMapIndex = 0;
+
+	// For shaders built with VIRTUAL_TEXTURES: the slot the diffuse map's mip requests
+	// go to, or 0xffffffff for none, and the finest mip that may be sampled.
+	UINT FeedbackIndex = 0xffffffff;
+	float DiffuseMinLod = 0.0f;
+	UINT MaterialPad0 = 0;
 };
 
 // Simple struct to represent a material for our demos.  A production 3D engine
@@ -246,11 +279,10 @@ struct Material
 	// Index into SRV heap for normal texture.
 	int NormalSrvHeapIndex = -1;
 
-	// Dirty flag indicating the material has changed and we need to update the constant buffer.
-	// Because we have a material constant buffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify a material we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	// Because we have a material constant buffer for each FrameResource, a modified material
+	// is queued on each FrameResource's dirty list.  Bit i is set while the material waits
+	// on frame resource i's list, so it is queued there once however often it changes.
+	UINT DirtyFrames = 0;
 
 	// Material constant buffer data used for shading.
 	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -0,0 +1,391 @@
+//***************************************************************************************
+// TextModelImporter.cpp
+//***************************************************************************************
+
+#include "TextModelImporter.h"
+#include <ppl.h>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Chunks smaller than this are not worth a task of their own.
+	const size_t MinChunkBytes = 64 * 1024;
+
+	// A mantissa of up to 19 digits scaled past this either way is beyond float
+	// range, so exponents are clamped to it and the scaling stays finite.
+	const int MaxExponent = 64;
+
+	bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	const char* SkipSpace(const char* p, const char* end)
+	{
+		while(p < end && IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	// Returns the first character after the number, or nullptr if there is none.
+	const char* ParseUInt(const char* p, const char* end, std::uint32_t& value)
+	{
+		if(p == end || !IsDigit(*p))
+			return nullptr;
+
+		std::uint64_t v = 0;
+		while(p < end && IsDigit(*p))
+		{
+			v = v*10 + (*p - '0');
+			if(v > UINT32_MAX)
+				return nullptr;
+			++p;
+		}
+
+		value = (std::uint32_t)v;
+		return p;
+	}
+
+	double Pow10(int exponent)
+	{
+		// Exact as doubles, so in-range values round only once.
+		static const double table[] =
+		{
+			1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		return exponent < (int)_countof(table) ? table[exponent] : pow(10.0, exponent);
+	}
+
+	// Decimal and exponent notation, as written by the model exporters.  Not
+	// correctly rounded in the last bit of a double, which float output hides.
+	const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		std::uint64_t mantissa = 0;
+		int significantDigits = 0;
+		int exponent = 0;
+		bool anyDigits = false;
+
+		for(; p < end && IsDigit(*p); ++p)
+		{
+			anyDigits = true;
+			if(significantDigits < 19)
+			{
+				mantissa = mantissa*10 + (*p - '0');
+				if(mantissa != 0)
+					++significantDigits;
+			}
+			else
+				++exponent;
+		}
+
+		if(p < end && *p == '.')
+		{
+			for(++p; p < end && IsDigit(*p); ++p)
+			{
+				anyDigits = true;
+				if(significantDigits < 19)
+				{
+					mantissa = mantissa*10 + (*p - '0');
+					if(mantissa != 0)
+						++significantDigits;
+					--exponent;
+				}
+			}
+		}
+
+		if(!anyDigits)
+			return nullptr;
+
+		if(p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* q = p + 1;
+			bool negativeExponent = false;
+			if(q < end && (*q == '-' || *q == '+'))
+			{
+				negativeExponent = *q == '-';
+				++q;
+			}
+
+			std::uint32_t e = 0;
+			q = ParseUInt(q, end, e);
+			if(q == nullptr)
+				return nullptr;
+
+			e = std::min(e, 400u);
+			exponent += negativeExponent ? -(int)e : (int)e;
+			p = q;
+		}
+
+		// Zero stays zero whatever its exponent.
+		double v = 0.0;
+		if(mantissa != 0)
+		{
+			exponent = std::max(-MaxExponent, std::min(exponent, MaxExponent));
+			v = (double)mantissa;
+			v = exponent < 0 ? v / Pow10(-exponent) : v * Pow10(exponent);
+
+			// Converting a double beyond float range is undefined; infinity is not.
+			if(v > FLT_MAX)
+				v = HUGE_VAL;
+		}
+		value = (float)(negative ? -v : v);
+		return p;
+	}
+
+	// Moves p past the next occurrence of token.
+	const char* Find(const char* p, const char* end, const char* token)
+	{
+		size_t length = strlen(token);
+		for(; p + length <= end; ++p)
+		{
+			if(memcmp(p, token, length) == 0)
+				return p + length;
+		}
+
+		return nullptr;
+	}
+
+	// Splits [begin, end) into pieces that start at a line, for parsing in parallel.
+	std::vector<const char*> SplitLines(const char* begin, const char* end)
+	{
+		size_t chunkCount = std::max<size_t>(1, std::min<size_t>(
+			(end - begin) / MinChunkBytes, concurrency::GetProcessorCount() * 4));
+		size_t chunkSize = (end - begin) / chunkCount;
+
+		std::vector<const char*> bounds;
+		bounds.push_back(begin);
+		for(size_t i = 1; i < chunkCount; ++i)
+		{
+			const char* p = std::max(bounds.back(), begin + i*chunkSize);
+			while(p < end && *p != '\n')
+				++p;
+			bounds.push_back(p);
+		}
+		bounds.push_back(end);
+
+		return bounds;
+	}
+
+	struct VertexChunk
+	{
+		std::vector<TextModelVertex> Vertices;
+		XMFLOAT3 Min = { +FLT_MAX, +FLT_MAX, +FLT_MAX };
+		XMFLOAT3 Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		bool Failed = false;
+	};
+
+	void ParseVertices(const char* p, const char* end, VertexChunk& chunk)
+	{
+		for(p = SkipSpace(p, end); p < end; p = SkipSpace(p, end))
+		{
+			float v[6];
+			for(int i = 0; i < 6; ++i)
+			{
+				p = ParseFloat(SkipSpace(p, end), end, v[i]);
+				if(p == nullptr)
+				{
+					chunk.Failed = true;
+					return;
+				}
+			}
+
+			TextModelVertex vertex;
+			vertex.Position = XMFLOAT3(v[0], v[1], v[2]);
+			vertex.Normal = XMFLOAT3(v[3], v[4], v[5]);
+			chunk.Vertices.push_back(vertex);
+
+			chunk.Min.x = std::min(chunk.Min.x, v[0]);
+			chunk.Min.y = std::min(chunk.Min.y, v[1]);
+			chunk.Min.z = std::min(chunk.Min.z, v[2]);
+			chunk.Max.x = std::max(chunk.Max.x, v[0]);
+			chunk.Max.y = std::max(chunk.Max.y, v[1]);
+			chunk.Max.z = std::max(chunk.Max.z, v[2]);
+		}
+	}
+
+	struct IndexChunk
+	{
+		std::vector<std::uint32_t> Indices;
+		bool Failed = false;
+	};
+
+	void ParseIndices(const char* p, const char* end, IndexChunk& chunk)
+	{
+		for(p = SkipSpace(p, end); p < end; p = SkipSpace(p, end))
+		{
+			std::uint32_t index = 0;
+			p = ParseUInt(p, end, index);
+			if(p == nullptr)
+			{
+				chunk.Failed = true;
+				return;
+			}
+			chunk.Indices.push_back(index);
+		}
+	}
+
+	bool Fail(std::string* error, const std::string& message)
+	{
+		if(error != nullptr)
+			*error = message;
+		return false;
+	}
+}
+
+bool TextModelImporter::Load(const std::wstring& filename, TextModel& model, std::string* error)
+{
+	HANDLE file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return Fail(error, "file not found");
+
+	LARGE_INTEGER size = {};
+	GetFileSizeEx(file, &size);
+
+	HANDLE mapping = size.QuadPart > 0 ?
+		CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	const char* view = mapping != nullptr ?
+		(const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+	bool result = false;
+	if(view == nullptr)
+		result = Fail(error, "file could not be mapped");
+	else
+	{
+		const char* end = view + size.QuadPart;
+
+		std::uint32_t vertexCount = 0;
+		std::uint32_t triangleCount = 0;
+
+		const char* p = Find(view, end, "VertexCount:");
+		p = p != nullptr ? ParseUInt(SkipSpace(p, end), end, vertexCount) : nullptr;
+		p = p != nullptr ? Find(p, end, "TriangleCount:") : nullptr;
+		p = p != nullptr ? ParseUInt(SkipSpace(p, end), end, triangleCount) : nullptr;
+
+		const char* vertexBegin = p != nullptr ? Find(p, end, "{") : nullptr;
+		const char* vertexEnd = vertexBegin != nullptr ? Find(vertexBegin, end, "}") : nullptr;
+		const char* indexBegin = vertexEnd != nullptr ? Find(vertexEnd, end, "{") : nullptr;
+		const char* indexEnd = indexBegin != nullptr ? Find(indexBegin, end, "}") : nullptr;
+
+		if(indexEnd == nullptr)
+			result = Fail(error, "missing header or list");
+		else
+		{
+			// Find returns the position after the brace.
+			--vertexEnd;
+			--indexEnd;
+
+			auto vertexBounds = SplitLines(vertexBegin, vertexEnd);
+			auto indexBounds = SplitLines(indexBegin, indexEnd);
+			std::vector<VertexChunk> vertexChunks(vertexBounds.size() - 1);
+			std::vector<IndexChunk> indexChunks(indexBounds.size() - 1);
+
+			// Both lists in one loop, so the short index list does not wait on the
+			// vertex list.
+			int vertexChunkCount = (int)vertexChunks.size();
+			concurrency::parallel_for(0, vertexChunkCount + (int)indexChunks.size(), [&](int i)
+			{
+				if(i < vertexChunkCount)
+					ParseVertices(vertexBounds[i], vertexBounds[i + 1], vertexChunks[i]);
+				else
+				{
+					int j = i - vertexChunkCount;
+					ParseIndices(indexBounds[j], indexBounds[j + 1], indexChunks[j]);
+				}
+			});
+
+			model.Vertices.clear();
+			model.Indices.clear();
+			model.Vertices.reserve(vertexCount);
+			model.Indices.reserve(3 * (size_t)triangleCount);
+
+			XMFLOAT3 vMin = { +FLT_MAX, +FLT_MAX, +FLT_MAX };
+			XMFLOAT3 vMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			bool failed = false;
+			for(const auto& chunk : vertexChunks)
+			{
+				failed |= chunk.Failed;
+				model.Vertices.insert(model.Vertices.end(), chunk.Vertices.begin(), chunk.Vertices.end());
+				vMin.x = std::min(vMin.x, chunk.Min.x);
+				vMin.y = std::min(vMin.y, chunk.Min.y);
+				vMin.z = std::min(vMin.z, chunk.Min.z);
+				vMax.x = std::max(vMax.x, chunk.Max.x);
+				vMax.y = std::max(vMax.y, chunk.Max.y);
+				vMax.z = std::max(vMax.z, chunk.Max.z);
+			}
+			for(const auto& chunk : indexChunks)
+			{
+				failed |= chunk.Failed;
+				model.Indices.insert(model.Indices.end(), chunk.Indices.begin(), chunk.Indices.end());
+			}
+
+			if(failed)
+				result = Fail(error, "malformed number");
+			else if(model.Vertices.size() != vertexCount || model.Indices.size() != 3 * (size_t)triangleCount)
+				result = Fail(error, "list length does not match the header");
+			else if(std::any_of(model.Indices.begin(), model.Indices.end(),
+				[vertexCount](std::uint32_t i) { return i >= vertexCount; }))
+				result = Fail(error, "index out of range");
+			else
+			{
+				XMVECTOR lo = XMLoadFloat3(&vMin);
+				XMVECTOR hi = XMLoadFloat3(&vMax);
+				if(vertexCount == 0)
+					lo = hi = XMVectorZero();
+				XMStoreFloat3(&model.Bounds.Center, 0.5f*(lo + hi));
+				XMStoreFloat3(&model.Bounds.Extents, 0.5f*(hi - lo));
+				result = true;
+			}
+		}
+
+		UnmapViewOfFile(view);
+	}
+
+	if(mapping != nullptr)
+		CloseHandle(mapping);
+	CloseHandle(file);
+
+	return result;
+}
+
+UINT64 TextModelImporter::SourceKey(const std::wstring& filename)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!GetFileAttributesExW(filename.c_str(), GetFileExInfoStandard, &attributes))
+		return 0;
+
+	UINT values[] =
+	{
+		attributes.nFileSizeLow, attributes.nFileSizeHigh,
+		attributes.ftLastWriteTime.dwLowDateTime, attributes.ftLastWriteTime.dwHighDateTime,
+		Version
+	};
+
+	// 64-bit FNV-1a.
+	UINT64 hash = 14695981039346656037ull;
+	const BYTE* bytes = (const BYTE*)values;
+	for(size_t i = 0; i < sizeof(values); ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash != 0 ? hash : 1;
+}
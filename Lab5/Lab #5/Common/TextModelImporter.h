@@ -0,0 +1,49 @@
+//***************************************************************************************
+// TextModelImporter.h
+//
+// Reads the text model format of Models/skull.txt and Models/car.txt:
+//
+//   VertexCount: <n>
+//   TriangleCount: <m>
+//   VertexList (pos, normal)
+//   { <n lines of six floats> }
+//   TriangleList
+//   { <m lines of three indices> }
+//
+// The file is memory-mapped and each list is cut at line boundaries into chunks that
+// are parsed on PPL workers with a locale-free number parser.  The bounding box is
+// accumulated per chunk while parsing, so no second pass over the vertices is needed.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+struct TextModelVertex
+{
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Normal;
+};
+
+struct TextModel
+{
+	std::vector<TextModelVertex> Vertices;
+	std::vector<std::uint32_t> Indices;
+	DirectX::BoundingBox Bounds;
+};
+
+class TextModelImporter
+{
+public:
+	// Returns false and describes the problem in error if the file is missing or
+	// malformed.
+	static bool Load(const std::wstring& filename, TextModel& model, std::string* error = nullptr);
+
+	// Changes whenever the file is rewritten; a MeshFile source key for caching the
+	// parsed model.  Zero if the file does not exist.
+	static UINT64 SourceKey(const std::wstring& filename);
+
+private:
+	// Bump when the importer's output changes, to invalidate cached meshes.
+	static const UINT Version = 1;
+};
@@ -6,6 +6,9 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/TextModelImporter.h"
+// Shared with the Castle project, which owns it.
+#include "../../../../Castle/Common/MeshFile.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -17,6 +20,13 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Layout of Vertex, checked against cached meshes.
+const D3D12_INPUT_ELEMENT_DESC gVertexLayout[] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -612,40 +622,62 @@ void LitColumnsApp::BuildShapeGeometry()
 
 void LitColumnsApp::BuildSkullGeometry()
 {
-	std::ifstream fin("Models/skull.txt");
+	const std::wstring modelFile = L"Models/skull.txt";
+	const std::wstring cacheFile = L"Models/skull.mesh";
+
+	// The parsed model is cached next to the text file and reused until the text
+	// file changes.
+	UINT64 sourceKey = TextModelImporter::SourceKey(modelFile);
 
-	if(!fin)
+	MeshFile cache;
+	if(sourceKey != 0 &&
+		cache.Open(cacheFile, sourceKey, gVertexLayout, _countof(gVertexLayout), sizeof(Vertex)))
 	{
-		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
-		return;
-	}
+		MeshFileData data = cache.Data();
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
+		auto geo = std::make_unique<MeshGeometry>();
+		geo->Name = "skullGeo";
 
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
+		geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+			data.Vertices, data.VertexBufferByteSize, geo->VertexBufferUploader);
+		geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+			data.Indices, data.IndexBufferByteSize, geo->IndexBufferUploader);
 
-	std::vector<Vertex> vertices(vcount);
-	for(UINT i = 0; i < vcount; ++i)
-	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+		geo->VertexByteStride = data.VertexByteStride;
+		geo->VertexBufferByteSize = data.VertexBufferByteSize;
+		geo->IndexFormat = data.IndexFormat;
+		geo->IndexBufferByteSize = data.IndexBufferByteSize;
+
+		for(const MeshFileSubmesh& s : data.Submeshes)
+		{
+			SubmeshGeometry submesh;
+			submesh.IndexCount = s.IndexCount;
+			submesh.StartIndexLocation = s.StartIndexLocation;
+			submesh.BaseVertexLocation = s.BaseVertexLocation;
+			submesh.Bounds = s.Bounds;
+			geo->DrawArgs[s.Name] = submesh;
+		}
+
+		mGeometries[geo->Name] = std::move(geo);
+		return;
 	}
 
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
+	TextModel model;
+	std::string error;
+	if(!TextModelImporter::Load(modelFile, model, &error))
+	{
+		MessageBox(0, (L"Models/skull.txt: " + AnsiToWString(error)).c_str(), 0, 0);
+		return;
+	}
 
-	std::vector<std::int32_t> indices(3 * tcount);
-	for(UINT i = 0; i < tcount; ++i)
+	std::vector<Vertex> vertices(model.Vertices.size());
+	for(size_t i = 0; i < model.Vertices.size(); ++i)
 	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+		vertices[i].Pos = model.Vertices[i].Position;
+		vertices[i].Normal = model.Vertices[i].Normal;
 	}
 
-	fin.close();
+	const std::vector<std::uint32_t>& indices = model.Indices;
 
 	//
 	// Pack the indices of all the meshes into one index buffer.
@@ -653,7 +685,7 @@ void LitColumnsApp::BuildSkullGeometry()
 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::int32_t);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "skullGeo";
@@ -679,9 +711,25 @@ void LitColumnsApp::BuildSkullGeometry()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	submesh.Bounds = model.Bounds;
 
 	geo->DrawArgs["skull"] = submesh;
 
+	MeshFileData data;
+	data.Vertices = vertices.data();
+	data.VertexByteStride = geo->VertexByteStride;
+	data.VertexBufferByteSize = vbByteSize;
+	data.Indices = indices.data();
+	data.IndexFormat = geo->IndexFormat;
+	data.IndexBufferByteSize = ibByteSize;
+	data.Submeshes.resize(1);
+	data.Submeshes[0].Name = "skull";
+	data.Submeshes[0].IndexCount = submesh.IndexCount;
+	data.Submeshes[0].StartIndexLocation = submesh.StartIndexLocation;
+	data.Submeshes[0].BaseVertexLocation = submesh.BaseVertexLocation;
+	data.Submeshes[0].Bounds = submesh.Bounds;
+
+	MeshFile::Write(cacheFile, sourceKey, data, gVertexLayout, _countof(gVertexLayout));
 	mGeometries[geo->Name] = std::move(geo);
 }
 